@@ -0,0 +1,419 @@
+/**
+ * @file    bench_main.c
+ * @brief   Driver hot-path benchmark suite.
+ *
+ * Each row times one call of a driver's hot function.  On target the numbers
+ * are core cycles; on the host they include the register simulator and are
+ * only useful for spotting regressions between builds.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "adc.h"
+#include "bench.h"
+#include "cache.h"
+#include "crc.h"
+#include "gpio.h"
+#include "irq.h"
+#include "memdma.h"
+#include "qspi.h"
+#include "rcc.h"
+#include "sdio.h"
+#include "sections.h"
+#include "spi.h"
+#include "timebase.h"
+#include "usart.h"
+
+#if defined(STM32_SIM)
+#include "sim.h"
+#endif
+#if !defined(STM32_HOST)
+#include "startup.h"
+#endif
+
+#define BENCH_SAMPLES   BENCH_MAX_SAMPLES
+
+#define BENCH_LED_PIN   5u
+
+/* A line no driver uses: software-triggered interrupt rows. */
+#define BENCH_IRQ       TIM7_IRQn
+
+static gpio_group_t bench_group;
+
+static void gpio_setup(void)
+{
+    const gpio_config_t out = { .mode = GPIO_MODE_OUTPUT, .speed = GPIO_SPEED_HIGH };
+
+    (void)gpio_configure(GPIOA, 0xFFFFu, &out);
+    (void)gpio_group_init(&bench_group, GPIOA, 8, 8);
+}
+
+static void gpio_set_pin(void)
+{
+    gpio_set(GPIOA, GPIO_PIN(BENCH_LED_PIN));
+}
+
+static void gpio_pin_write_low(void)
+{
+    gpio_pin_write(GPIOA, BENCH_LED_PIN, false);
+}
+
+static void gpio_toggle_pin(void)
+{
+    gpio_toggle(GPIOA, GPIO_PIN(BENCH_LED_PIN));
+}
+
+static void gpio_group_byte(void)
+{
+    gpio_group_write(&bench_group, 0xA5u);
+}
+
+/* Baseline the BSRR path replaces: read-modify-write of ODR. */
+static void gpio_odr_rmw(void)
+{
+    REG_MODIFY(GPIOA->ODR, 0xFF00u, 0xA500u);
+}
+
+static void usart_setup(void)
+{
+    const usart_config_t cfg = { .pclk_hz = 42000000u, .baud = 115200u };
+
+    (void)usart_init(USART2, &cfg);
+}
+
+static void usart_send(void)
+{
+    usart_write_byte(USART2, 0x55u);
+}
+
+static spi_bus_t bench_spi;
+static spi_dev_t bench_spi_dev = { .max_hz = 42000000u };
+
+static void spi_setup(void)
+{
+    const spi_config_t cfg = { .pclk_hz = 84000000u, .fill = 0xFFFFu };
+
+    (void)spi_init(&bench_spi, SPI1, &cfg);
+    (void)spi_dev_init(&bench_spi_dev, &bench_spi);
+}
+
+static void spi_frame(void)
+{
+    (void)spi_exchange(&bench_spi, &bench_spi_dev, 0xA5u);
+}
+
+/* One DMA half of an 8-channel scan: 64 frames averaged 8:1. */
+static uint16_t bench_adc_buf[64u * 8u];
+
+static void adc_setup(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(bench_adc_buf); i++) {
+        bench_adc_buf[i] = (uint16_t)((i * 2654435761u) >> 20);
+    }
+}
+
+static void adc_decimate_pairs(void)
+{
+    (void)adc_decimate(bench_adc_buf, 8, 64, 8);
+}
+
+/* Odd channel count: the one-sample-at-a-time kernel. */
+static void adc_decimate_odd(void)
+{
+    (void)adc_decimate(bench_adc_buf, 7, 64, 8);
+}
+
+/* 1 KiB blocks: bit loop (baseline), slicing-by-8, and the CRC unit. */
+static uint32_t bench_crc_buf[256];
+static crc_table_t bench_crc_table;
+static crc_t bench_crc_bit;
+static crc_t bench_crc_sw;
+static crc_t bench_crc_hw;
+
+static void crc_setup(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(bench_crc_buf); i++) {
+        bench_crc_buf[i] = i * 2654435761u;
+    }
+    (void)crc_init(&bench_crc_bit, &crc_spec_crc32, NULL, false);
+    (void)crc_init(&bench_crc_sw, &crc_spec_crc32, &bench_crc_table, false);
+    (void)crc_init(&bench_crc_hw, &crc_spec_stm32, NULL, false);
+}
+
+static void crc_bitwise(void)
+{
+    (void)crc_compute_sw(&bench_crc_bit, bench_crc_buf, sizeof(bench_crc_buf));
+}
+
+static void crc_slice8(void)
+{
+    (void)crc_compute_sw(&bench_crc_sw, bench_crc_buf, sizeof(bench_crc_buf));
+}
+
+static void crc_unit(void)
+{
+    uint32_t v;
+
+    (void)crc_compute(&bench_crc_hw, bench_crc_buf, sizeof(bench_crc_buf), &v);
+}
+
+/* Startup loops on 1 KiB, the CRC buffer as the load image. */
+static uint32_t bench_section[256];
+
+static void section_copy(void)
+{
+    const sections_copy_t t = { bench_crc_buf, bench_section, bench_section + 256 };
+
+    sections_copy(&t, &t + 1);
+}
+
+static void section_zero(void)
+{
+    const sections_zero_t t = { bench_section, bench_section + 256 };
+
+    sections_zero(&t, &t + 1);
+}
+
+static timebase_timer_t bench_timer;
+
+static void timer_expired(timebase_timer_t *t, void *ctx)
+{
+    (void)t;
+    (void)ctx;
+}
+
+static void timebase_setup(void)
+{
+    (void)timebase_init(TIM5, 1000000u);
+    timebase_timer_init(&bench_timer, timer_expired, NULL);
+}
+
+static void timebase_read(void)
+{
+    (void)timebase_now();
+}
+
+/* Arm one second out and cancel: wheel insert, compare update, unlink. */
+static void timebase_start_stop(void)
+{
+    (void)timebase_timer_after(&bench_timer, 1000000u, 0u);
+    (void)timebase_timer_stop(&bench_timer);
+}
+
+/*
+ * Inline and DMA paths side by side on 1 and 4 KiB: where the memdma_*
+ * rows drop below the memcpy/memset ones is the crossover for
+ * MEMDMA_*_MIN_BYTES.  The DMA rows force the stream and wait for it.
+ */
+static STM32_ALIGNED(16) uint8_t bench_mem_src[4096];
+static STM32_ALIGNED(16) uint8_t bench_mem_dst[4096];
+static memdma_t bench_memdma;
+
+static void memdma_setup(void)
+{
+    (void)memdma_init(&bench_memdma);
+    bench_memdma.copy_min = 0;
+    bench_memdma.set_min = 0;
+}
+
+static void mem_copy_1k(void)
+{
+    memcpy(bench_mem_dst, bench_mem_src, 1024u);
+}
+
+static void memdma_copy_1k(void)
+{
+    (void)memdma_copy(&bench_memdma, bench_mem_dst, bench_mem_src, 1024u, NULL, NULL);
+    (void)memdma_wait(&bench_memdma);
+}
+
+static void mem_copy_4k(void)
+{
+    memcpy(bench_mem_dst, bench_mem_src, 4096u);
+}
+
+static void memdma_copy_4k(void)
+{
+    (void)memdma_copy(&bench_memdma, bench_mem_dst, bench_mem_src, 4096u, NULL, NULL);
+    (void)memdma_wait(&bench_memdma);
+}
+
+static void mem_set_4k(void)
+{
+    memset(bench_mem_dst, 0x55, 4096u);
+}
+
+static void memdma_set_4k(void)
+{
+    (void)memdma_set(&bench_memdma, bench_mem_dst, 0x55u, 4096u, NULL, NULL);
+    (void)memdma_wait(&bench_memdma);
+}
+
+/*
+ * SD card throughput: one block, and 16 KiB as one CMD18/CMD25 each way;
+ * bytes over cycles is the sustained rate.  On target this needs a card in
+ * the slot and PLL48CK running, otherwise sdio_init() fails and the rows
+ * time only the rejected call.  On the host the card is the simulator's.
+ */
+#define BENCH_SD_BLOCKS 32u
+
+static uint8_t bench_sd_buf[BENCH_SD_BLOCKS * SDIO_BLOCK_SIZE] CACHE_ALIGNED;
+static sdio_t bench_sd;
+
+#if defined(STM32_SIM)
+static uint8_t bench_sd_card[1024u * SDIO_BLOCK_SIZE];
+#endif
+
+static void sdio_setup(void)
+{
+#if defined(STM32_SIM)
+    static rcc_plan_t plan;
+
+    (void)rcc_solve(&(rcc_request_t){ .hse_hz = 8000000u, .need_48mhz = true }, &plan);
+    rcc_set_current(&plan);
+    sim_sdio_insert(SDIO, &(sim_sdio_card_t){ .data = bench_sd_card, .blocks = 1024u });
+#endif
+    (void)sdio_init(&bench_sd, &(sdio_config_t){ 0 });
+}
+
+static void sdio_read_block(void)
+{
+    (void)sdio_read(&bench_sd, 0u, bench_sd_buf, 1u);
+}
+
+static void sdio_read_16k(void)
+{
+    (void)sdio_read(&bench_sd, 0u, bench_sd_buf, BENCH_SD_BLOCKS);
+}
+
+static void sdio_write_16k(void)
+{
+    (void)sdio_write(&bench_sd, 0u, bench_sd_buf, BENCH_SD_BLOCKS);
+    (void)sdio_sync(&bench_sd);
+}
+
+/*
+ * External NOR flash: 4 KiB copied out of the memory-mapped bank, against
+ * one page programmed by DMA with its write enable and busy polling.  The
+ * page is the flash's last, rewritten with the same data.  Without a flash
+ * qspi_init() fails and the rows time only the rejected calls.
+ */
+#define BENCH_QSPI_LOG2 20u
+
+static uint8_t bench_qspi_buf[4096];
+static qspi_t bench_qspi;
+
+#if defined(STM32_SIM)
+static uint8_t bench_qspi_flash[1u << BENCH_QSPI_LOG2];
+#endif
+
+static void qspi_setup(void)
+{
+    /* DMA2 stream 7, the QUADSPI's only one, is the memdma rows'. */
+    memdma_deinit(&bench_memdma);
+#if defined(STM32_SIM)
+    static rcc_plan_t plan;
+
+    (void)rcc_solve(&(rcc_request_t){ .hse_hz = 8000000u, .need_48mhz = true }, &plan);
+    rcc_set_current(&plan);
+    sim_qspi_attach(QUADSPI, &(sim_qspi_flash_t){
+        .data = bench_qspi_flash,
+        .size = sizeof(bench_qspi_flash),
+        .jedec_id = 0xEF4014u,
+        .qe = SIM_QSPI_QE_SR2,
+        .dummy_cycles = QSPI_DUMMY_CYCLES,
+    });
+#endif
+    (void)qspi_init(&bench_qspi, &(qspi_config_t){ .size_log2 = BENCH_QSPI_LOG2,
+                                                   .qe = QSPI_QE_SR2_BIT1 });
+}
+
+static void qspi_read_4k(void)
+{
+    (void)qspi_read(&bench_qspi, 0u, bench_qspi_buf, sizeof(bench_qspi_buf));
+}
+
+static void qspi_program_page(void)
+{
+    (void)qspi_write(&bench_qspi, (1u << BENCH_QSPI_LOG2) - QSPI_PAGE_SIZE, bench_qspi_buf,
+                     QSPI_PAGE_SIZE);
+}
+
+static void irq_empty(void)
+{
+}
+
+static void irq_setup(void)
+{
+    (void)irq_set_handler(BENCH_IRQ, irq_empty);
+    irq_enable(BENCH_IRQ);
+}
+
+/* Trigger, entry, empty handler and exit. */
+static void irq_round_trip(void)
+{
+    irq_trigger(BENCH_IRQ);
+}
+
+static const bench_case_t bench_cases[] = {
+    { "gpio_set",           gpio_setup,     gpio_set_pin },
+    { "gpio_pin_write",     NULL,           gpio_pin_write_low },
+    { "gpio_toggle",        NULL,           gpio_toggle_pin },
+    { "gpio_group_write",   NULL,           gpio_group_byte },
+    { "gpio_odr_rmw",       NULL,           gpio_odr_rmw },
+    { "usart_write_byte",   usart_setup,    usart_send },
+    { "spi_exchange",       spi_setup,      spi_frame },
+    { "adc_decimate_8ch",   adc_setup,      adc_decimate_pairs },
+    { "adc_decimate_7ch",   adc_setup,      adc_decimate_odd },
+    { "crc32_1k_bitwise",   crc_setup,      crc_bitwise },
+    { "crc32_1k_slice8",    NULL,           crc_slice8 },
+    { "crc_1k_unit",        NULL,           crc_unit },
+    { "sections_copy_1k",   NULL,           section_copy },
+    { "sections_zero_1k",   NULL,           section_zero },
+    { "timebase_now",       timebase_setup, timebase_read },
+    { "timebase_timer_arm", NULL,           timebase_start_stop },
+    { "memcpy_1k",          memdma_setup,   mem_copy_1k },
+    { "memdma_copy_1k",     NULL,           memdma_copy_1k },
+    { "memcpy_4k",          NULL,           mem_copy_4k },
+    { "memdma_copy_4k",     NULL,           memdma_copy_4k },
+    { "memset_4k",          NULL,           mem_set_4k },
+    { "memdma_set_4k",      NULL,           memdma_set_4k },
+    { "sdio_read_block",    sdio_setup,     sdio_read_block },
+    { "sdio_read_16k",      NULL,           sdio_read_16k },
+    { "sdio_write_16k",     NULL,           sdio_write_16k },
+    { "qspi_read_4k",       qspi_setup,     qspi_read_4k },
+    { "qspi_program_page",  NULL,           qspi_program_page },
+    { "irq_sw_round_trip",  irq_setup,      irq_round_trip },
+};
+
+int main(void)
+{
+    char line[96];
+    bench_result_t r;
+
+#if defined(STM32_SIM)
+    sim_reset();
+#endif
+    (void)irq_init(NULL, IRQ_PREEMPT_BITS_DEFAULT);
+    /* Measure with the flash accelerator and caches on, as an application runs. */
+    cache_init();
+    bench_init();
+    bench_run_table(bench_cases, STM32_ARRAY_SIZE(bench_cases), BENCH_SAMPLES);
+    irq_disable(BENCH_IRQ);
+    if (irq_measure_latency(BENCH_IRQ, BENCH_SAMPLES, &r) == DRV_OK) {
+        snprintf(line, sizeof(line), "%-28s %10lu %10lu %10lu", "irq_entry_latency",
+                 (unsigned long)r.min, (unsigned long)r.median, (unsigned long)r.max);
+        bench_puts(line);
+    }
+#if !defined(STM32_HOST)
+    snprintf(line, sizeof(line), "boot cycles: clock %lu sections %lu ctors %lu total %lu",
+             (unsigned long)startup_timing()->clock, (unsigned long)startup_timing()->sections,
+             (unsigned long)startup_timing()->ctors, (unsigned long)startup_timing()->total);
+    bench_puts(line);
+#endif
+    return 0;
+}
@@ -0,0 +1,24 @@
+# Cross toolchain for the target build:
+#
+#   cmake -S . -B build-arm -DCMAKE_TOOLCHAIN_FILE=cmake/arm-none-eabi.cmake \
+#         -DSTM32_FAMILY=F4
+#
+# CPU and FPU flags follow STM32_FAMILY and are set in the top-level
+# CMakeLists.txt; this file only selects the tools.
+
+set(CMAKE_SYSTEM_NAME Generic)
+set(CMAKE_SYSTEM_PROCESSOR arm)
+
+set(STM32_TOOLCHAIN_PREFIX "arm-none-eabi-" CACHE STRING "Cross tool name prefix")
+
+set(CMAKE_C_COMPILER ${STM32_TOOLCHAIN_PREFIX}gcc)
+set(CMAKE_ASM_COMPILER ${STM32_TOOLCHAIN_PREFIX}gcc)
+set(CMAKE_OBJCOPY ${STM32_TOOLCHAIN_PREFIX}objcopy CACHE FILEPATH "objcopy")
+set(CMAKE_SIZE ${STM32_TOOLCHAIN_PREFIX}size CACHE FILEPATH "size")
+
+# No OS to link a test executable against while probing the compiler.
+set(CMAKE_TRY_COMPILE_TARGET_TYPE STATIC_LIBRARY)
+
+set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
@@ -0,0 +1,17 @@
+/**
+ * @file    host.h
+ * @brief   Host build support API.
+ */
+#ifndef STM32_HOST_H
+#define STM32_HOST_H
+
+#include "stm32.h"
+
+#if !defined(STM32_HOST)
+#error "host.h is only available in the host build"
+#endif
+
+/** Zero every peripheral RAM stand-in. */
+void stm32_host_reset(void);
+
+#endif /* STM32_HOST_H */
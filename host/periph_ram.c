@@ -0,0 +1,22 @@
+/**
+ * @file    periph_ram.c
+ * @brief   Host build: plain RAM stand-ins for every peripheral instance.
+ *
+ * On the host, STM32_PERIPH() resolves each instance to one of the structs
+ * defined here, so drivers and register-layer code run unchanged on Linux
+ * and the resulting register contents can be inspected by unit tests.
+ */
+#include <string.h>
+
+#include "stm32.h"
+
+#define STM32_HOST_DEFINE(name, type, kind) type stm32_host_##name;
+STM32_PERIPH_LIST(STM32_HOST_DEFINE)
+#undef STM32_HOST_DEFINE
+
+void stm32_host_reset(void)
+{
+#define STM32_HOST_CLEAR(name, type, kind) memset(&stm32_host_##name, 0, sizeof(type));
+    STM32_PERIPH_LIST(STM32_HOST_CLEAR)
+#undef STM32_HOST_CLEAR
+}
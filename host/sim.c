@@ -0,0 +1,305 @@
+/**
+ * @file    sim.c
+ * @brief   Host peripheral register simulator core.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_MAX_ATTACH  16
+
+/* Bus address space: 255 windows of 16 MiB, window n at (n + 1) << 24. */
+#define SIM_BUS_SHIFT   24u
+#define SIM_BUS_WINDOWS 255u
+
+/* Core debug/trace blocks behave as plain RAM on the host. */
+const sim_model_t sim_model_core = { 0 };
+
+#define SIM_PERIPH_ENTRY(name, type, kind) \
+    { #name, name##_BASE, &stm32_host_##name, sizeof(type), &sim_model_##kind, NULL },
+
+static sim_periph_t sim_periphs[] = {
+    STM32_PERIPH_LIST(SIM_PERIPH_ENTRY)
+};
+
+#undef SIM_PERIPH_ENTRY
+
+static sim_periph_t sim_attached[SIM_MAX_ATTACH];
+static size_t sim_nattached;
+static sim_periph_t *sim_last;
+static uint32_t sim_irq_bits[(STM32_IRQ_COUNT + 31) / 32];
+/* Register writes in progress; interrupts are taken only between them. */
+static uint32_t sim_write_depth;
+static uintptr_t sim_bus_windows[SIM_BUS_WINDOWS];
+static uint32_t sim_bus_nwindows;
+
+sim_stats_t sim_stats;
+
+static bool sim_contains(const sim_periph_t *p, const volatile void *addr)
+{
+    uintptr_t a = (uintptr_t)addr;
+    uintptr_t b = (uintptr_t)p->regs;
+
+    return a >= b && a < b + p->size;
+}
+
+sim_periph_t *sim_find(const volatile void *addr)
+{
+    size_t i;
+
+    if (sim_last != NULL && sim_contains(sim_last, addr)) {
+        return sim_last;
+    }
+    for (i = 0; i < STM32_ARRAY_SIZE(sim_periphs); i++) {
+        if (sim_contains(&sim_periphs[i], addr)) {
+            sim_last = &sim_periphs[i];
+            return sim_last;
+        }
+    }
+    for (i = 0; i < sim_nattached; i++) {
+        if (sim_contains(&sim_attached[i], addr)) {
+            sim_last = &sim_attached[i];
+            return sim_last;
+        }
+    }
+    return NULL;
+}
+
+sim_periph_t *sim_find_base(uint32_t base)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(sim_periphs); i++) {
+        if (sim_periphs[i].base == base) {
+            return &sim_periphs[i];
+        }
+    }
+    for (i = 0; i < sim_nattached; i++) {
+        if (sim_attached[i].base == base) {
+            return &sim_attached[i];
+        }
+    }
+    return NULL;
+}
+
+static const sim_reg_t *sim_attr(const sim_periph_t *p, uint32_t off)
+{
+    size_t i;
+
+    if (p->model == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < p->model->nregs; i++) {
+        if (p->model->regs[i].offset == off) {
+            return &p->model->regs[i];
+        }
+    }
+    return NULL;
+}
+
+static void sim_periph_reset(sim_periph_t *p, bool clear)
+{
+    size_t i;
+
+    if (clear) {
+        memset(p->regs, 0, p->size);
+    }
+    if (p->model == NULL) {
+        return;
+    }
+    for (i = 0; i < p->model->nregs; i++) {
+        const sim_reg_t *r = &p->model->regs[i];
+        *(volatile uint32_t *)((uint8_t *)p->regs + r->offset) = r->reset;
+    }
+    if (p->model->reset != NULL) {
+        p->model->reset(p);
+    }
+}
+
+void sim_reset(void)
+{
+    size_t i;
+
+    sim_nattached = 0;
+    sim_last = NULL;
+    memset(sim_irq_bits, 0, sizeof(sim_irq_bits));
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    for (i = 0; i < STM32_ARRAY_SIZE(sim_periphs); i++) {
+        sim_periph_reset(&sim_periphs[i], true);
+    }
+}
+
+sim_periph_t *sim_attach(const char *name, uint32_t base, void *regs,
+                         size_t size, const sim_model_t *model)
+{
+    sim_periph_t *p;
+
+    if (sim_nattached == SIM_MAX_ATTACH) {
+        return NULL;
+    }
+    p = &sim_attached[sim_nattached++];
+    p->name = name;
+    p->base = base;
+    p->regs = regs;
+    p->size = size;
+    p->model = model;
+    p->state = NULL;
+    /* The caller owns the memory: apply reset values but do not clear it. */
+    sim_periph_reset(p, false);
+    return p;
+}
+
+uint32_t sim_read32(const volatile uint32_t *reg)
+{
+    sim_periph_t *p = sim_find(reg);
+    uint32_t val = *reg;
+
+    sim_stats.reads++;
+    if (p != NULL && p->model != NULL && p->model->read != NULL) {
+        val = p->model->read(p, (uint32_t)((uintptr_t)reg - (uintptr_t)p->regs), val);
+    }
+    return val;
+}
+
+void sim_write32(volatile uint32_t *reg, uint32_t val)
+{
+    sim_periph_t *p = sim_find(reg);
+    const sim_reg_t *a;
+    uint32_t off;
+    uint32_t old = *reg;
+    uint32_t next;
+
+    sim_stats.writes++;
+    if (p == NULL) {
+        *reg = val;
+        return;
+    }
+
+    off = (uint32_t)((uintptr_t)reg - (uintptr_t)p->regs);
+    a = sim_attr(p, off);
+    if (a == NULL) {
+        next = val;
+    } else {
+        uint32_t plain = ~(a->ro | a->w0c | a->w1c);
+
+        next = (val & plain)
+             | (old & a->ro)
+             | (old & val & a->w0c)
+             | (old & ~val & a->w1c);
+    }
+    *reg = next;
+
+    sim_write_depth++;
+    if (p->model != NULL && p->model->write != NULL) {
+        p->model->write(p, off, old, val);
+    }
+    if (a != NULL) {
+        *reg &= ~a->sc;
+    }
+    if (--sim_write_depth == 0u) {
+        sim_nvic_kick();
+    }
+}
+
+void sim_irq_raise(irqn_t irqn)
+{
+    if ((int)irqn >= 0 && (int)irqn < STM32_IRQ_COUNT) {
+        sim_irq_bits[irqn / 32] |= 1u << (irqn % 32);
+        if (sim_write_depth == 0u) {
+            sim_nvic_kick();
+        }
+    }
+}
+
+bool sim_irq_pending(irqn_t irqn)
+{
+    if ((int)irqn < 0 || (int)irqn >= STM32_IRQ_COUNT) {
+        return false;
+    }
+    return (sim_irq_bits[irqn / 32] & (1u << (irqn % 32))) != 0u;
+}
+
+bool sim_irq_take(irqn_t irqn)
+{
+    bool pending = sim_irq_pending(irqn);
+
+    if (pending) {
+        sim_irq_bits[irqn / 32] &= ~(1u << (irqn % 32));
+    }
+    return pending;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Bus addresses                                                            */
+/* ------------------------------------------------------------------------ */
+
+uint32_t sim_bus_addr(const volatile void *ptr)
+{
+    const uintptr_t mask = ((uintptr_t)1 << SIM_BUS_SHIFT) - 1u;
+    uintptr_t host = (uintptr_t)ptr & ~mask;
+    uint32_t i;
+
+    if (ptr == NULL) {
+        return 0;
+    }
+    for (i = 0; i < sim_bus_nwindows; i++) {
+        if (sim_bus_windows[i] == host) {
+            break;
+        }
+    }
+    if (i == sim_bus_nwindows) {
+        if (sim_bus_nwindows == SIM_BUS_WINDOWS) {
+            return 0;
+        }
+        sim_bus_windows[sim_bus_nwindows++] = host;
+    }
+    return ((i + 1u) << SIM_BUS_SHIFT) | (uint32_t)((uintptr_t)ptr & mask);
+}
+
+void *sim_bus_ptr(uint32_t addr)
+{
+    uint32_t i = (addr >> SIM_BUS_SHIFT);
+
+    if (i == 0u || i > sim_bus_nwindows) {
+        return NULL;
+    }
+    return (void *)(sim_bus_windows[i - 1u] + (addr & ((1u << SIM_BUS_SHIFT) - 1u)));
+}
+
+uint32_t sim_bus_read(uint32_t addr, uint32_t size)
+{
+    uint8_t *ptr = sim_bus_ptr(addr);
+    uint32_t val = 0;
+
+    if (ptr == NULL) {
+        return 0;
+    }
+    if (sim_find(ptr) != NULL) {
+        /* Narrow reads of a register return the addressed byte lanes. */
+        uint32_t lane = (uint32_t)((uintptr_t)ptr & 3u);
+
+        val = sim_read32((volatile uint32_t *)(ptr - lane)) >> (8u * lane);
+        return (size >= 4u) ? val : (val & ((1u << (8u * size)) - 1u));
+    }
+    memcpy(&val, ptr, size);
+    return val;
+}
+
+void sim_bus_write(uint32_t addr, uint32_t val, uint32_t size)
+{
+    uint8_t *ptr = sim_bus_ptr(addr);
+
+    if (ptr == NULL) {
+        return;
+    }
+    if (sim_find(ptr) != NULL) {
+        uint32_t lane = (uint32_t)((uintptr_t)ptr & 3u);
+
+        if (size < 4u) {
+            val &= (1u << (8u * size)) - 1u;
+        }
+        sim_write32((volatile uint32_t *)(ptr - lane), val << (8u * lane));
+        return;
+    }
+    memcpy(ptr, &val, size);
+}
@@ -0,0 +1,563 @@
+/**
+ * @file    sim.h
+ * @brief   Host peripheral register simulator.
+ *
+ * Each peripheral instance's RAM stand-in (host/periph_ram.c) is registered
+ * with a register model chosen by the `kind` column of STM32_PERIPH_LIST.
+ * REG_READ/REG_WRITE from driver code land in sim_read32()/sim_write32(),
+ * which apply per-register access attributes and then call the model hooks
+ * that emulate the hardware side effects.
+ *
+ * Model code touches the register file directly through the typed struct
+ * (e.g. `p->regs`), which bypasses the attributes just like hardware does.
+ */
+#ifndef STM32_SIM_H
+#define STM32_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "host.h"
+
+#if !defined(STM32_SIM)
+#error "sim.h requires the simulator build (STM32_SIM)"
+#endif
+
+typedef struct sim_periph sim_periph_t;
+
+/**
+ * Access attributes of one 32-bit register.  Bits not named in any mask are
+ * plain read/write.
+ */
+typedef struct {
+    uint16_t offset;    /**< Byte offset in the peripheral. */
+    uint32_t reset;     /**< Reset value. */
+    uint32_t ro;        /**< Read-only: software writes are ignored. */
+    uint32_t w0c;       /**< rc_w0: writing 0 clears, writing 1 has no effect. */
+    uint32_t w1c;       /**< rc_w1: writing 1 clears, writing 0 has no effect. */
+    uint32_t sc;        /**< Self-clearing / write-only: reads back 0 once the
+                             write hook has run. */
+} sim_reg_t;
+
+typedef struct {
+    const sim_reg_t *regs;  /**< Attribute table (may be NULL). */
+    size_t nregs;
+    /** Called after attributes are applied; @p val is what software wrote. */
+    void (*write)(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val);
+    /** Returns the value software observes; may have side effects. */
+    uint32_t (*read)(sim_periph_t *p, uint32_t off, uint32_t val);
+    /** Called after the register file is set to its reset values. */
+    void (*reset)(sim_periph_t *p);
+} sim_model_t;
+
+struct sim_periph {
+    const char *name;
+    uint32_t base;          /**< Bus address on the real part. */
+    void *regs;             /**< Host register file. */
+    size_t size;
+    const sim_model_t *model;
+    void *state;            /**< Model private state. */
+};
+
+/* Register models; one per `kind` in STM32_PERIPH_LIST. */
+extern const sim_model_t sim_model_core;
+extern const sim_model_t sim_model_scb;
+extern const sim_model_t sim_model_nvic;
+extern const sim_model_t sim_model_rcc;
+extern const sim_model_t sim_model_flash;
+extern const sim_model_t sim_model_flashmem;
+extern const sim_model_t sim_model_gpio;
+extern const sim_model_t sim_model_usart;
+extern const sim_model_t sim_model_spi;
+extern const sim_model_t sim_model_i2c;
+extern const sim_model_t sim_model_dma;
+extern const sim_model_t sim_model_tim;
+extern const sim_model_t sim_model_adc;
+extern const sim_model_t sim_model_crc;
+extern const sim_model_t sim_model_can;
+extern const sim_model_t sim_model_otg;
+extern const sim_model_t sim_model_eth;
+extern const sim_model_t sim_model_sdio;
+extern const sim_model_t sim_model_qspi;
+
+/** Reset every peripheral to its reset values and clear pending IRQs. */
+void sim_reset(void);
+
+/** Peripheral whose register file contains @p addr, or NULL. */
+sim_periph_t *sim_find(const volatile void *addr);
+
+/** Peripheral with bus base address @p base, or NULL. */
+sim_periph_t *sim_find_base(uint32_t base);
+
+/**
+ * Attach @p model to an arbitrary host memory block (test fixtures, memory
+ * regions).  Attachments are dropped by sim_reset().
+ */
+sim_periph_t *sim_attach(const char *name, uint32_t base, void *regs,
+                         size_t size, const sim_model_t *model);
+
+/*
+ * Interrupt lines raised by models.  A line enabled in the NVIC model with
+ * VTOR set is taken through the vector table (see sim_nvic.c); the others
+ * stay pending until a test takes them.
+ */
+void sim_irq_raise(irqn_t irqn);
+bool sim_irq_pending(irqn_t irqn);
+/** Clear and return the pending state of @p irqn. */
+bool sim_irq_take(irqn_t irqn);
+
+/** Model internal: take pending enabled interrupts that can preempt. */
+void sim_nvic_kick(void);
+
+/** Software register accesses since the last sim_reset(). */
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+} sim_stats_t;
+
+extern sim_stats_t sim_stats;
+
+/*
+ * Bus accesses on behalf of a bus master (DMA).  Addresses are simulator bus
+ * addresses (REG_ADDR()); accesses that land in a peripheral go through its
+ * register model, everything else is plain memory.
+ */
+uint32_t sim_bus_read(uint32_t addr, uint32_t size);
+void sim_bus_write(uint32_t addr, uint32_t val, uint32_t size);
+
+/* SCB model: one cache maintenance register write (offset and operand). */
+typedef struct {
+    uint16_t reg;       /**< Offset in SCB, e.g. 0x268 for DCCMVAC. */
+    uint32_t arg;       /**< Address (bus address on the host) or set/way. */
+} sim_cache_op_t;
+
+/** Move up to @p max logged cache operations into @p buf, oldest first. */
+size_t sim_cache_take(sim_cache_op_t *buf, size_t max);
+
+/* RCC model: with @p fail set the HSE oscillator never becomes ready. */
+void sim_rcc_hse_fail(bool fail);
+
+/* GPIO model: drive the external level of input pins. */
+void sim_gpio_set_input(gpio_regs_t *port, uint16_t mask, uint16_t level);
+
+/** Called after every change of a port's ODR (other models on the pins). */
+typedef void (*sim_gpio_watch_t)(void *ctx, gpio_regs_t *port, uint16_t old, uint16_t odr);
+
+/** Watch @p port's ODR; one watcher per port, dropped by sim_reset(). */
+void sim_gpio_watch(gpio_regs_t *port, sim_gpio_watch_t fn, void *ctx);
+
+/* ------------------------------------------------------------------------ */
+/* DMA model                                                                */
+/* ------------------------------------------------------------------------ */
+
+/** Peripheral DMA request lines (RM0090 tables 42 and 43). */
+typedef enum {
+    SIM_DREQ_NONE = 0,
+    SIM_DREQ_USART1_RX,
+    SIM_DREQ_USART1_TX,
+    SIM_DREQ_USART2_RX,
+    SIM_DREQ_USART2_TX,
+    SIM_DREQ_USART3_RX,
+    SIM_DREQ_USART3_TX,
+    SIM_DREQ_UART4_RX,
+    SIM_DREQ_UART4_TX,
+    SIM_DREQ_UART5_RX,
+    SIM_DREQ_UART5_TX,
+    SIM_DREQ_USART6_RX,
+    SIM_DREQ_USART6_TX,
+    SIM_DREQ_SPI1_RX,
+    SIM_DREQ_SPI1_TX,
+    SIM_DREQ_SPI2_RX,
+    SIM_DREQ_SPI2_TX,
+    SIM_DREQ_SPI3_RX,
+    SIM_DREQ_SPI3_TX,
+    SIM_DREQ_I2C1_RX,
+    SIM_DREQ_I2C1_TX,
+    SIM_DREQ_I2C2_RX,
+    SIM_DREQ_I2C2_TX,
+    SIM_DREQ_I2C3_RX,
+    SIM_DREQ_I2C3_TX,
+    SIM_DREQ_ADC1,
+    SIM_DREQ_ADC2,
+    SIM_DREQ_ADC3,
+    SIM_DREQ_TIM1_UP,
+    SIM_DREQ_TIM2_UP,
+    SIM_DREQ_TIM3_UP,
+    SIM_DREQ_TIM4_UP,
+    SIM_DREQ_TIM5_UP,
+    SIM_DREQ_TIM8_UP,
+    SIM_DREQ_SDIO,
+    SIM_DREQ_QUADSPI,
+    SIM_DREQ_COUNT
+} sim_dreq_t;
+
+/**
+ * Assert request @p req: one data item is moved by every enabled stream
+ * mapped to it.  With no stream ready the request is held until one is
+ * enabled or sim_dma_release() drops it.
+ */
+void sim_dma_request(sim_dreq_t req);
+void sim_dma_release(sim_dreq_t req);
+
+/**
+ * Items still to move on the enabled stream serving @p req, not counting
+ * one being moved right now (the DMA end-of-transfer signal some
+ * peripherals use); 0 if no stream is enabled.
+ */
+uint32_t sim_dma_remaining(sim_dreq_t req);
+
+/**
+ * End of transfer signalled by a flow-controlling peripheral: every enabled
+ * stream serving @p req with SxCR.PFCTRL set stops and sets TCIF.
+ */
+void sim_dma_flow_end(sim_dreq_t req);
+
+/* ------------------------------------------------------------------------ */
+/* USART model                                                              */
+/* ------------------------------------------------------------------------ */
+
+/** Shift @p len bytes into the receiver, one frame after the other. */
+void sim_usart_rx(usart_regs_t *usart, const uint8_t *data, size_t len);
+
+/** Line idle for one frame time after reception: raises IDLE. */
+void sim_usart_idle(usart_regs_t *usart);
+
+/** Move up to @p max transmitted bytes into @p buf; returns the count. */
+size_t sim_usart_tx_take(usart_regs_t *usart, uint8_t *buf, size_t max);
+
+/* ------------------------------------------------------------------------ */
+/* SPI model                                                                */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Slave device on a simulated bus: receives every frame the master shifts
+ * out and returns the frame shifted back in.  Chip select is the caller's
+ * business (check the GPIO ODR from the hook).
+ */
+typedef uint16_t (*sim_spi_dev_t)(void *ctx, uint16_t mosi);
+
+/** Attach @p dev to @p spi; NULL restores the MOSI-to-MISO loopback. */
+void sim_spi_attach(spi_regs_t *spi, sim_spi_dev_t dev, void *ctx);
+
+/** Frames shifted out on @p spi since the last sim_reset(). */
+uint32_t sim_spi_frames(spi_regs_t *spi);
+
+/* ------------------------------------------------------------------------ */
+/* I2C model                                                                */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Target device on a simulated bus.  @p start is called when the master
+ * addresses the target (after a START or repeated START) and returns the
+ * ACK; @p write receives each written byte and returns the ACK; @p read
+ * supplies each byte read; @p stop sees the STOP.  Unused hooks may be NULL
+ * (ACK everything, read 0xFF).
+ */
+typedef struct {
+    bool (*start)(void *ctx, bool read);
+    bool (*write)(void *ctx, uint8_t byte);
+    uint8_t (*read)(void *ctx);
+    void (*stop)(void *ctx);
+} sim_i2c_target_t;
+
+/** Put @p target at 7-bit address @p addr on @p i2c's bus (up to 4). */
+void sim_i2c_attach(i2c_regs_t *i2c, uint8_t addr, const sim_i2c_target_t *target,
+                    void *ctx);
+
+/**
+ * Wire the bus lines to GPIO pins (pulled up) so the model sees SCL clocked
+ * by hand and can hold SDA low.
+ */
+void sim_i2c_wire(i2c_regs_t *i2c, gpio_regs_t *scl_port, uint8_t scl_pin,
+                  gpio_regs_t *sda_port, uint8_t sda_pin);
+
+/**
+ * A target stuck mid-read holds SDA low (and the interface BUSY) until it
+ * has seen @p clocks rising edges on the wired SCL pin.
+ */
+void sim_i2c_stuck(i2c_regs_t *i2c, uint32_t clocks);
+
+/** SCL rising edges driven through GPIO since sim_i2c_wire(). */
+uint32_t sim_i2c_scl_pulses(i2c_regs_t *i2c);
+
+/** Raise SR1 error flags (I2C_SR1_BERR, I2C_SR1_ARLO, ...) on @p i2c. */
+void sim_i2c_fault(i2c_regs_t *i2c, uint32_t sr1);
+
+/* ------------------------------------------------------------------------ */
+/* Timer model                                                              */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Let @p n update events of an enabled timer elapse (counter overflows).
+ * Each sets UIF, raises the update interrupt if enabled and, with
+ * CR2.MMS = update, pulses TRGO to the ADC trigger inputs; with DIER.UDE it
+ * runs the DCR burst on the update DMA request.
+ */
+void sim_tim_update(tim_regs_t *tim, uint32_t n);
+
+/**
+ * Let @p ticks counter ticks of an enabled up-counting timer elapse.  Each
+ * output-compare channel the counter reaches sets CCxIF (and raises the
+ * compare interrupt with CCxIE); passing ARR is an update as above.
+ */
+void sim_tim_advance(tim_regs_t *tim, uint64_t ticks);
+
+/**
+ * Compare value channel @p ch (1..4) is running with: the CCR value latched
+ * at the last update event when output compare preload is on, else CCR.
+ */
+uint32_t sim_tim_compare(tim_regs_t *tim, uint32_t ch);
+
+/* ------------------------------------------------------------------------ */
+/* ADC model                                                                */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Analog input: the 12-bit level of @p channel at conversion of regular
+ * sequence number @p seq (counted from sim_reset()).
+ */
+typedef uint16_t (*sim_adc_input_t)(void *ctx, uint32_t channel, uint32_t seq);
+
+/** Connect @p in to the inputs of @p adc; NULL grounds every channel. */
+void sim_adc_attach(adc_regs_t *adc, sim_adc_input_t in, void *ctx);
+
+/** Regular sequences converted by @p adc since the last sim_reset(). */
+uint32_t sim_adc_sequences(adc_regs_t *adc);
+
+/** Model internal: external trigger source @p extsel pulsed (ADC_EXTSEL_*). */
+void sim_adc_trigger(uint32_t extsel);
+
+/* ------------------------------------------------------------------------ */
+/* CRC model                                                                */
+/* ------------------------------------------------------------------------ */
+
+/** Words written to the CRC data register since the last sim_reset(). */
+uint32_t sim_crc_words(void);
+
+/* ------------------------------------------------------------------------ */
+/* CAN model                                                                */
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    uint32_t id;        /**< 11-bit or 29-bit identifier. */
+    bool ext;
+    bool rtr;
+    uint8_t len;
+    uint8_t data[8];
+} sim_can_frame_t;
+
+/**
+ * Another node sends @p f on @p can's bus.  False if the instance is not
+ * on the bus (init or sleep mode) or no active filter accepts the frame;
+ * otherwise it is in a FIFO, or overran one (FOVR).
+ */
+bool sim_can_receive(can_regs_t *can, const sim_can_frame_t *f);
+
+/**
+ * The pending mailbox that wins arbitration (lowest identifier, or the
+ * oldest request with MCR.TXFP) goes out: RQCP/TXOK/TME are set and the
+ * frame is copied to @p out (may be NULL).  In loopback mode (BTR.LBKM)
+ * the frame is received as well.  False if no mailbox is pending.
+ */
+bool sim_can_transmit(can_regs_t *can, sim_can_frame_t *out);
+
+/** Mailboxes holding a transmit request, as a bit mask. */
+uint32_t sim_can_pending(can_regs_t *can);
+
+/** Set error bits @p esr (CAN_ESR_*) and ERRI, as a bus error would. */
+void sim_can_error(can_regs_t *can, uint32_t esr);
+
+/**
+ * Parse the next frame of a candump log at *@p text and advance past its
+ * line.  Lines look like `(1436509052.249713) can0 123#11223344`: the last
+ * field is the frame, three hex digits for a standard identifier, eight
+ * for an extended one, then up to eight data bytes or `R` for a remote
+ * frame.  Lines starting with `#` and lines without a frame are skipped.
+ * False at the end of the text.
+ */
+bool sim_can_parse(const char **text, sim_can_frame_t *f);
+
+/* ------------------------------------------------------------------------ */
+/* USB OTG_FS model                                                         */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * The test plays the USB host, one transaction per call.  Transactions go
+ * to the address set with sim_otg_address() and get no response unless the
+ * device is attached (D+ pulled up: GCCFG.PWRDWN set, DCTL.SDIS clear) and
+ * has that address.  A new DCFG.DAD takes effect after the next EP0 IN
+ * transaction, the status stage of SET_ADDRESS, as on the real core.  Data
+ * toggles are not modelled.
+ */
+typedef enum {
+    SIM_OTG_ACK = 0,
+    SIM_OTG_NAK,
+    SIM_OTG_STALL,
+    SIM_OTG_NORESP,         /**< Detached, wrong address or RX FIFO full. */
+} sim_otg_result_t;
+
+/** Host attaches and resets the bus; false if D+ is not pulled up. */
+bool sim_otg_connect(otg_regs_t *otg);
+
+/**
+ * Bus reset: USBRST and, at its end, ENUMDNE at full speed; the device
+ * and host address return to 0.
+ */
+void sim_otg_bus_reset(otg_regs_t *otg);
+
+/** Address the host uses from now on. */
+void sim_otg_address(otg_regs_t *otg, uint8_t addr);
+
+/**
+ * SETUP transaction to EP0: the 8 bytes and the SETUP-done status go to
+ * the receive FIFO.  SETUP is never NAKed; a STALL on EP0 is cleared.
+ */
+sim_otg_result_t sim_otg_setup(otg_regs_t *otg, const uint8_t setup[8]);
+
+/**
+ * OUT transaction of @p len bytes to endpoint @p ep.  ACK when the
+ * endpoint is enabled with packets left and the receive FIFO has room;
+ * a short packet or the last one completes the transfer.
+ */
+sim_otg_result_t sim_otg_out(otg_regs_t *otg, uint32_t ep, const void *data, size_t len);
+
+/**
+ * IN transaction on endpoint @p ep: ACK when the endpoint is enabled and
+ * its transmit FIFO holds the whole next packet (maximum packet size or
+ * what is left of the transfer).  The packet is copied to @p buf (at most
+ * @p max bytes) and its length stored in @p len.
+ */
+sim_otg_result_t sim_otg_in(otg_regs_t *otg, uint32_t ep, void *buf, size_t max, size_t *len);
+
+/** Words waiting in the transmit FIFO of IN endpoint @p ep. */
+uint32_t sim_otg_tx_words(otg_regs_t *otg, uint32_t ep);
+
+/** FIFO words written past a full transmit FIFO or read from an empty RX FIFO. */
+uint32_t sim_otg_fifo_errors(otg_regs_t *otg);
+
+/* ------------------------------------------------------------------------ */
+/* Ethernet MAC model                                                       */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * The test plays the wire and the PHY.  The DMA walks the descriptor rings
+ * in memory through bus addresses, as the real one does: a received frame
+ * is written to the buffer of the current receive descriptor, which must
+ * hold it whole; a transmitted frame is gathered from owned transmit
+ * descriptors.  The address filter (perfect match on address 0, broadcast,
+ * pass-all-multicast, promiscuous), FCS stripping, the IPv4 checksum
+ * engine both ways, the receive watchdog and the suspend/poll-demand
+ * behaviour of both DMA directions are modelled; collisions, flow control
+ * and VLAN tags are not.  The interrupt line follows the DMASR summary
+ * bits.
+ */
+typedef enum {
+    SIM_ETH_RX_OK = 0,
+    SIM_ETH_RX_OFF,         /**< Receiver or receive DMA stopped. */
+    SIM_ETH_RX_FILTERED,    /**< Rejected by the address filter. */
+    SIM_ETH_RX_MISSED,      /**< No owned descriptor: RBUS, counted in DMAMFBOCR. */
+    SIM_ETH_RX_DROPPED,     /**< Checksum error, dropped by the MAC (DTCEFD clear). */
+} sim_eth_rx_t;
+
+/**
+ * Attach a PHY at MDIO address @p addr with the given link state and link
+ * partner abilities (ANLPAR).  Without one MDIO reads return 0xFFFF.
+ */
+void sim_eth_phy(eth_regs_t *eth, uint8_t addr, bool link, uint16_t anlpar);
+
+/** A frame of @p len bytes (no FCS) arrives from the wire. */
+sim_eth_rx_t sim_eth_receive(eth_regs_t *eth, const void *frame, size_t len);
+
+/** Let @p cycles HCLK cycles pass for the receive watchdog. */
+void sim_eth_advance(eth_regs_t *eth, uint32_t cycles);
+
+/**
+ * The transmit DMA sends the next frame, if it is running and owns one:
+ * the frame (without FCS, at most @p max bytes) is copied to @p buf and
+ * its length returned; 0 if nothing was sent.
+ */
+size_t sim_eth_transmit(eth_regs_t *eth, void *buf, size_t max);
+
+/* ------------------------------------------------------------------------ */
+/* SDIO model                                                               */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * The test inserts an SD memory card backed by its own buffer.  The card
+ * answers the commands of the identification and data transfer sequence
+ * (CMD0/2/3/6/7/8/9/12/13/16/17/18/24/25/55, ACMD6/41) with the responses
+ * and state changes of the physical layer specification; any other
+ * command, or one in the wrong state, gets no response (CTIMEOUT).
+ * SDIOCLK is taken as 48 MHz.
+ */
+typedef struct {
+    uint8_t *data;          /**< blocks * 512 bytes of card contents. */
+    uint32_t blocks;        /**< Multiple of 1024 (SDHC) or 512 (SDSC). */
+    bool sdsc;              /**< SD 1.x standard capacity: no CMD8, byte addresses. */
+    bool no_high_speed;     /**< CMD6 reports high speed unsupported. */
+    uint8_t init_busy;      /**< ACMD41 rounds answered busy. */
+    uint8_t write_busy;     /**< CMD13 rounds answered programming after a write. */
+} sim_sdio_card_t;
+
+/** Insert @p card, powered up in the idle state; NULL removes the card. */
+void sim_sdio_insert(sdio_regs_t *sdio, const sim_sdio_card_t *card);
+
+#define SIM_SDIO_FAULT_CMD_TIMEOUT  0x1u    /**< Next command gets no response. */
+#define SIM_SDIO_FAULT_DATA_CRC     0x2u    /**< Next data block fails its CRC. */
+#define SIM_SDIO_FAULT_DATA_TIMEOUT 0x4u    /**< Next read sends no data. */
+
+/** Arm one-shot faults (SIM_SDIO_FAULT_*). */
+void sim_sdio_fault(sdio_regs_t *sdio, uint32_t faults);
+
+/** Times command @p cmd (or SIM_SDIO_ACMD(n)) was sent, answered or not. */
+#define SIM_SDIO_ACMD(n)            (64u + (n))
+uint32_t sim_sdio_commands(sdio_regs_t *sdio, uint32_t cmd);
+
+/* ------------------------------------------------------------------------ */
+/* QUADSPI model                                                            */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * A serial NOR flash on bank 1, backed by the test's buffer.  It answers
+ * the JEDEC commands 0x01/02/03/04/05/06/0B/20/35/60/66/99/9F/C7/D8 and the
+ * quad I/O read 0xEB, with one-line instruction and three address bytes;
+ * a command sent with other phases is not understood (counted by
+ * sim_qspi_errors(), reads 0xFF).  Programs, erases and status writes need
+ * the write enable latch and leave the flash busy for a number of status
+ * reads.  With no flash attached the data lines float high.
+ */
+#define SIM_QSPI_QE_NONE    0u      /**< Quad reads always work. */
+#define SIM_QSPI_QE_SR2     1u      /**< Quad enable is bit 1 of status register 2. */
+#define SIM_QSPI_QE_SR1     2u      /**< Quad enable is bit 6 of status register 1. */
+
+typedef struct {
+    uint8_t *data;          /**< size bytes of flash contents. */
+    uint32_t size;          /**< Power of two, 64 KiB .. 16 MiB. */
+    uint32_t jedec_id;      /**< 0x9F answer, first byte in bits 23:16. */
+    uint8_t qe;             /**< SIM_QSPI_QE_* */
+    uint8_t dummy_cycles;   /**< 0xEB dummy cycles after the mode byte. */
+    uint8_t sr1;            /**< Status registers at power-up (QE bits only kept). */
+    uint8_t sr2;
+    uint16_t program_busy;  /**< Status reads showing WIP after a program or status write. */
+    uint16_t erase_busy;    /**< Status reads showing WIP after an erase. */
+} sim_qspi_flash_t;
+
+/** Attach @p flash, powered up and idle; NULL removes it. */
+void sim_qspi_attach(quadspi_regs_t *qspi, const sim_qspi_flash_t *flash);
+
+#define SIM_QSPI_FAULT_NO_WEL       0x1u    /**< Next write enable is ignored. */
+
+/** Arm one-shot faults (SIM_QSPI_FAULT_*). */
+void sim_qspi_fault(quadspi_regs_t *qspi, uint32_t faults);
+
+/** Times instruction @p op was sent; each automatic polling round counts. */
+uint32_t sim_qspi_commands(quadspi_regs_t *qspi, uint8_t op);
+
+/** Commands sent with phases the flash does not expect. */
+uint32_t sim_qspi_errors(quadspi_regs_t *qspi);
+
+/** Status register 1, and 2 into @p sr2 unless NULL. */
+uint8_t sim_qspi_status_regs(quadspi_regs_t *qspi, uint8_t *sr2);
+
+#endif /* STM32_SIM_H */
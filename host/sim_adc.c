@@ -0,0 +1,172 @@
+/**
+ * @file    sim_adc.c
+ * @brief   ADC register model (ADC1..ADC3, regular group).
+ *
+ * A trigger (CR2.SWSTART, or the external source selected by EXTSEL/EXTEN)
+ * converts the whole regular sequence at once, rank by rank: each result
+ * lands in DR, sets EOC (per conversion with EOCS, else at the end of the
+ * sequence) and, with CR2.DMA set, raises the DMA request.  A result that
+ * overwrites an unread DR sets OVR and aborts the sequence; DMA requests
+ * then stay blocked until CR2.DMA is cleared and set again, as on the part.
+ * Input levels come from the function attached with sim_adc_attach().
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_ADC_COUNT   3u
+
+typedef struct {
+    sim_adc_input_t in;
+    void *ctx;
+    uint32_t seq;           /**< Sequences converted. */
+    bool unread;            /**< DR holds a result software/DMA has not read. */
+    bool dma_blocked;       /**< Overrun with DMA: requests stopped. */
+} sim_adc_state_t;
+
+static const sim_reg_t sim_adc_regs[] = {
+    { .offset = 0x00, .w0c = 0x0000003Fu },                         /* SR */
+    { .offset = 0x08, .sc = ADC_CR2_SWSTART | ADC_CR2_JSWSTART },   /* CR2 */
+    { .offset = 0x4C, .ro = 0xFFFFFFFFu },                          /* DR */
+};
+
+static const sim_dreq_t sim_adc_dreq[SIM_ADC_COUNT] = {
+    SIM_DREQ_ADC1, SIM_DREQ_ADC2, SIM_DREQ_ADC3,
+};
+
+static sim_adc_state_t sim_adc_state[SIM_ADC_COUNT];
+
+static uint32_t sim_adc_index(const sim_periph_t *p)
+{
+    return (p->base - ADC1_BASE) / 0x100u;
+}
+
+static uint32_t sim_adc_rank(const adc_regs_t *adc, uint32_t rank)
+{
+    const volatile uint32_t *sqr = (rank < 6u) ? &adc->SQR3 :
+                                   (rank < 12u) ? &adc->SQR2 : &adc->SQR1;
+
+    return reg_field_get(*sqr, ADC_SQR_SQ(rank));
+}
+
+static uint32_t sim_adc_sample(const adc_regs_t *adc, const sim_adc_state_t *st,
+                               uint32_t ch)
+{
+    uint32_t shift = 2u * reg_field_get(adc->CR1, ADC_CR1_RES);
+    uint32_t v = (st->in != NULL) ? (st->in(st->ctx, ch, st->seq) & 0x0FFFu) : 0u;
+
+    v >>= shift;
+    if ((adc->CR2 & ADC_CR2_ALIGN) != 0u) {
+        v <<= 4u + shift;
+    }
+    return v;
+}
+
+static void sim_adc_sequence(sim_periph_t *p)
+{
+    adc_regs_t *adc = p->regs;
+    uint32_t i = sim_adc_index(p);
+    sim_adc_state_t *st = &sim_adc_state[i];
+    uint32_t len = ((adc->CR1 & ADC_CR1_SCAN) != 0u) ?
+                   reg_field_get(adc->SQR1, ADC_SQR1_L) + 1u : 1u;
+    uint32_t r;
+
+    if ((adc->CR2 & ADC_CR2_ADON) == 0u) {
+        return;
+    }
+    for (r = 0; r < len; r++) {
+        if (st->unread && (adc->CR2 & (ADC_CR2_DMA | ADC_CR2_EOCS)) != 0u) {
+            adc->SR |= ADC_SR_OVR;
+            st->dma_blocked = (adc->CR2 & ADC_CR2_DMA) != 0u;
+            if ((adc->CR1 & ADC_CR1_OVRIE) != 0u) {
+                sim_irq_raise(ADC_IRQn);
+            }
+            break;
+        }
+        adc->DR = sim_adc_sample(adc, st, sim_adc_rank(adc, r));
+        st->unread = true;
+        adc->SR |= ADC_SR_STRT;
+        if ((adc->CR2 & ADC_CR2_EOCS) != 0u || r + 1u == len) {
+            adc->SR |= ADC_SR_EOC;
+            if ((adc->CR1 & ADC_CR1_EOCIE) != 0u) {
+                sim_irq_raise(ADC_IRQn);
+            }
+        }
+        if ((adc->CR2 & ADC_CR2_DMA) != 0u && !st->dma_blocked) {
+            sim_dma_request(sim_adc_dreq[i]);
+        }
+    }
+    st->seq++;
+}
+
+static void sim_adc_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    adc_regs_t *adc = p->regs;
+    uint32_t i = sim_adc_index(p);
+
+    (void)old;
+    if (off != 0x08u) {
+        return;
+    }
+    if ((adc->CR2 & ADC_CR2_DMA) == 0u) {
+        sim_adc_state[i].dma_blocked = false;
+        sim_dma_release(sim_adc_dreq[i]);
+    }
+    if ((val & ADC_CR2_SWSTART) != 0u) {
+        sim_adc_sequence(p);
+    }
+}
+
+static uint32_t sim_adc_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    adc_regs_t *adc = p->regs;
+    uint32_t i = sim_adc_index(p);
+
+    if (off == 0x4Cu) {
+        adc->SR &= ~ADC_SR_EOC;
+        sim_adc_state[i].unread = false;
+        sim_dma_release(sim_adc_dreq[i]);
+    }
+    return val;
+}
+
+static void sim_adc_reset(sim_periph_t *p)
+{
+    memset(&sim_adc_state[sim_adc_index(p)], 0, sizeof(sim_adc_state[0]));
+}
+
+void sim_adc_trigger(uint32_t extsel)
+{
+    adc_regs_t *const adcs[SIM_ADC_COUNT] = { ADC1, ADC2, ADC3 };
+    uint32_t i;
+
+    for (i = 0; i < SIM_ADC_COUNT; i++) {
+        uint32_t cr2 = adcs[i]->CR2;
+
+        if (reg_field_get(cr2, ADC_CR2_EXTEN) != ADC_EXTEN_OFF &&
+            reg_field_get(cr2, ADC_CR2_EXTSEL) == extsel) {
+            sim_adc_sequence(sim_find(adcs[i]));
+        }
+    }
+}
+
+void sim_adc_attach(adc_regs_t *adc, sim_adc_input_t in, void *ctx)
+{
+    sim_adc_state_t *st = &sim_adc_state[sim_adc_index(sim_find(adc))];
+
+    st->in = in;
+    st->ctx = ctx;
+}
+
+uint32_t sim_adc_sequences(adc_regs_t *adc)
+{
+    return sim_adc_state[sim_adc_index(sim_find(adc))].seq;
+}
+
+const sim_model_t sim_model_adc = {
+    .regs = sim_adc_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_adc_regs),
+    .write = sim_adc_write,
+    .read = sim_adc_read,
+    .reset = sim_adc_reset,
+};
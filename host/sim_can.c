@@ -0,0 +1,491 @@
+/**
+ * @file    sim_can.c
+ * @brief   bxCAN model: mode handshake, transmit mailboxes, acceptance
+ *          filters and receive FIFOs.
+ *
+ * Mode requests are acknowledged within the MCR write.  The bus is driven
+ * by the test: sim_can_receive() puts a frame from another node on the bus,
+ * which goes through the acceptance filters into a FIFO, and
+ * sim_can_transmit() lets the pending mailbox that wins arbitration go out.
+ * Filters follow the reference manual: banks FMR.CAN2SB and up belong to
+ * CAN2, filter numbers count every element of the banks assigned to a FIFO
+ * from the instance's first bank, and of several matching filters a 32-bit
+ * one beats a 16-bit one, a list entry beats a mask, then the lower number
+ * wins.  TSR.CODE names the lowest empty mailbox.  Interrupt lines are
+ * levels, re-raised after every register write while their condition holds.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_CAN_COUNT       2u
+
+#define SIM_CAN_MSR_W1C     (CAN_MSR_ERRI | CAN_MSR_WKUI | CAN_MSR_SLAKI)
+#define SIM_CAN_TSR_RQCP    (CAN_TSR_RQCP(0) | CAN_TSR_RQCP(1) | CAN_TSR_RQCP(2))
+#define SIM_CAN_TSR_ABRQ    (CAN_TSR_ABRQ(0) | CAN_TSR_ABRQ(1) | CAN_TSR_ABRQ(2))
+
+typedef struct {
+    uint32_t base;
+    irqn_t tx;
+    irqn_t rx[CAN_RX_FIFOS];
+    irqn_t sce;
+} sim_can_info_t;
+
+typedef struct {
+    uint32_t rir;
+    uint32_t rdtr;
+    uint32_t rdlr;
+    uint32_t rdhr;
+} sim_can_mailbox_t;
+
+typedef struct {
+    sim_can_mailbox_t fifo[CAN_RX_FIFOS][CAN_RX_FIFO_DEPTH];
+    uint8_t count[CAN_RX_FIFOS];
+    uint32_t seq[CAN_TX_MAILBOXES];     /* Request order, for TXFP. */
+    uint32_t next_seq;
+} sim_can_state_t;
+
+static const sim_can_info_t sim_can_info[SIM_CAN_COUNT] = {
+    { CAN1_BASE, CAN1_TX_IRQn, { CAN1_RX0_IRQn, CAN1_RX1_IRQn }, CAN1_SCE_IRQn },
+    { CAN2_BASE, CAN2_TX_IRQn, { CAN2_RX0_IRQn, CAN2_RX1_IRQn }, CAN2_SCE_IRQn },
+};
+
+static sim_can_state_t sim_can_state[SIM_CAN_COUNT];
+
+#define SIM_CAN_RX_RO(off) { .offset = (off), .ro = 0xFFFFFFFFu }
+
+static const sim_reg_t sim_can_regs[] = {
+    { .offset = 0x000, .reset = CAN_MCR_DBF | CAN_MCR_SLEEP,
+      .sc = CAN_MCR_RESET },                                    /* MCR */
+    { .offset = 0x004, .reset = CAN_MSR_SLAK | CAN_MSR_SAMP | CAN_MSR_RX,
+      .ro = ~SIM_CAN_MSR_W1C, .w1c = SIM_CAN_MSR_W1C },         /* MSR */
+    { .offset = 0x008, .reset = CAN_TSR_TME_ALL,
+      .ro = ~(SIM_CAN_TSR_RQCP | SIM_CAN_TSR_ABRQ),
+      .w1c = SIM_CAN_TSR_RQCP },                                /* TSR */
+    { .offset = 0x00C, .ro = REG_MASK(0u, 2u),
+      .w1c = CAN_RFR_FULL | CAN_RFR_FOVR, .sc = CAN_RFR_RFOM }, /* RF0R */
+    { .offset = 0x010, .ro = REG_MASK(0u, 2u),
+      .w1c = CAN_RFR_FULL | CAN_RFR_FOVR, .sc = CAN_RFR_RFOM }, /* RF1R */
+    { .offset = 0x018, .ro = ~REG_MASK(4u, 3u) },    /* ESR */
+    { .offset = 0x01C, .reset = 0x01230000u },                  /* BTR */
+    SIM_CAN_RX_RO(0x1B0), SIM_CAN_RX_RO(0x1B4), SIM_CAN_RX_RO(0x1B8), SIM_CAN_RX_RO(0x1BC),
+    SIM_CAN_RX_RO(0x1C0), SIM_CAN_RX_RO(0x1C4), SIM_CAN_RX_RO(0x1C8), SIM_CAN_RX_RO(0x1CC),
+    { .offset = 0x200, .reset = 0x2A1C0E01u },                  /* FMR */
+};
+
+static uint32_t sim_can_index(const sim_periph_t *p)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_CAN_COUNT; i++) {
+        if (sim_can_info[i].base == p->base) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* Refresh TSR.CODE (lowest empty mailbox) and raise the interrupt levels. */
+static void sim_can_update(sim_periph_t *p)
+{
+    can_regs_t *c = p->regs;
+    const sim_can_info_t *info = &sim_can_info[sim_can_index(p)];
+    uint32_t ier = c->IER;
+    uint32_t rfr[CAN_RX_FIFOS] = { c->RF0R, c->RF1R };
+    uint32_t f;
+
+    for (f = 0; f < CAN_TX_MAILBOXES && (c->TSR & CAN_TSR_TME(f)) == 0u; f++) {
+    }
+    c->TSR = reg_field_set(c->TSR, CAN_TSR_CODE, (f < CAN_TX_MAILBOXES) ? f : 0u);
+
+    if ((ier & CAN_IER_TMEIE) != 0u && (c->TSR & SIM_CAN_TSR_RQCP) != 0u) {
+        sim_irq_raise(info->tx);
+    }
+    for (f = 0; f < CAN_RX_FIFOS; f++) {
+        /* FMPIE/FFIE/FOVIE of FIFO 1 sit three bits above those of FIFO 0. */
+        uint32_t en = ier >> (3u * f);
+
+        if (((en & CAN_IER_FMPIE0) != 0u && reg_field_get(rfr[f], CAN_RFR_FMP) != 0u) ||
+            ((en & CAN_IER_FFIE0) != 0u && (rfr[f] & CAN_RFR_FULL) != 0u) ||
+            ((en & CAN_IER_FOVIE0) != 0u && (rfr[f] & CAN_RFR_FOVR) != 0u)) {
+            sim_irq_raise(info->rx[f]);
+        }
+    }
+    if ((ier & CAN_IER_ERRIE) != 0u && (c->MSR & CAN_MSR_ERRI) != 0u) {
+        sim_irq_raise(info->sce);
+    }
+}
+
+/* Present the oldest frame of FIFO @p f in its output mailbox. */
+static void sim_can_fifo_show(can_regs_t *c, sim_can_state_t *st, uint32_t f)
+{
+    volatile uint32_t *rfr = (f == 0u) ? &c->RF0R : &c->RF1R;
+    sim_can_mailbox_t head = { 0 };
+
+    if (st->count[f] != 0u) {
+        head = st->fifo[f][0];
+    }
+    c->RX[f].RIR = head.rir;
+    c->RX[f].RDTR = head.rdtr;
+    c->RX[f].RDLR = head.rdlr;
+    c->RX[f].RDHR = head.rdhr;
+    *rfr = reg_field_set(*rfr, CAN_RFR_FMP, st->count[f]);
+}
+
+static void sim_can_fifo_release(can_regs_t *c, sim_can_state_t *st, uint32_t f)
+{
+    volatile uint32_t *rfr = (f == 0u) ? &c->RF0R : &c->RF1R;
+
+    if (st->count[f] == 0u) {
+        return;
+    }
+    memmove(&st->fifo[f][0], &st->fifo[f][1], sizeof(st->fifo[f][0]) * (CAN_RX_FIFO_DEPTH - 1u));
+    st->count[f]--;
+    *rfr &= ~CAN_RFR_FULL;
+    sim_can_fifo_show(c, st, f);
+}
+
+/* Complete or abort mailbox @p n: it is empty again. */
+static void sim_can_mailbox_done(can_regs_t *c, uint32_t n, bool ok)
+{
+    c->TX[n].TIR &= ~CAN_IR_TXRQ;
+    c->TSR &= ~(CAN_TSR_TXOK(n) | CAN_TSR_ALST(n) | CAN_TSR_TERR(n) | CAN_TSR_ABRQ(n));
+    c->TSR |= CAN_TSR_RQCP(n) | CAN_TSR_TME(n) | (ok ? CAN_TSR_TXOK(n) : 0u);
+}
+
+static void sim_can_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    can_regs_t *c = p->regs;
+    sim_can_state_t *st = &sim_can_state[sim_can_index(p)];
+    uint32_t n;
+
+    (void)old;
+    switch (off) {
+    case 0x000:
+        c->MSR &= ~(CAN_MSR_INAK | CAN_MSR_SLAK);
+        if ((val & CAN_MCR_INRQ) != 0u) {
+            c->MSR |= CAN_MSR_INAK;
+        } else if ((val & CAN_MCR_SLEEP) != 0u) {
+            c->MSR |= CAN_MSR_SLAK;
+        }
+        break;
+    case 0x008:
+        for (n = 0; n < CAN_TX_MAILBOXES; n++) {
+            if ((val & CAN_TSR_RQCP(n)) != 0u) {
+                c->TSR &= ~(CAN_TSR_TXOK(n) | CAN_TSR_ALST(n) | CAN_TSR_TERR(n));
+            }
+            if ((val & CAN_TSR_ABRQ(n)) != 0u) {
+                if ((c->TSR & CAN_TSR_TME(n)) == 0u) {
+                    sim_can_mailbox_done(c, n, false);
+                } else {
+                    c->TSR &= ~CAN_TSR_ABRQ(n);
+                }
+            }
+        }
+        break;
+    case 0x00C:
+    case 0x010:
+        if ((val & CAN_RFR_RFOM) != 0u) {
+            sim_can_fifo_release(c, st, (off - 0x00Cu) / 4u);
+        }
+        break;
+    case 0x180:
+    case 0x190:
+    case 0x1A0:
+        n = (off - 0x180u) / 16u;
+        if ((val & CAN_IR_TXRQ) != 0u) {
+            if ((c->TSR & CAN_TSR_TME(n)) == 0u) {
+                break;  /* Already pending: the request stands as it was. */
+            }
+            c->TSR &= ~CAN_TSR_TME(n);
+            st->seq[n] = st->next_seq++;
+        }
+        break;
+    default:
+        break;
+    }
+    sim_can_update(p);
+}
+
+static void sim_can_reset(sim_periph_t *p)
+{
+    memset(&sim_can_state[sim_can_index(p)], 0, sizeof(sim_can_state[0]));
+}
+
+const sim_model_t sim_model_can = {
+    .regs = sim_can_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_can_regs),
+    .write = sim_can_write,
+    .reset = sim_can_reset,
+};
+
+/* ------------------------------------------------------------------------ */
+/* Bus                                                                      */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t sim_can_ir(const sim_can_frame_t *f)
+{
+    uint32_t ir = f->rtr ? CAN_IR_RTR : 0u;
+
+    if (f->ext) {
+        return ir | CAN_IR_IDE | reg_field_prep(CAN_IR_EXID, f->id);
+    }
+    return ir | reg_field_prep(CAN_IR_STID, f->id);
+}
+
+/* The 16-bit filter image of identifier word @p ir. */
+static uint32_t sim_can_ir16(uint32_t ir)
+{
+    return ((ir >> 21) << CAN_F16_STID_SHIFT) | ((ir & CAN_IR_RTR) ? CAN_F16_RTR : 0u) |
+           ((ir & CAN_IR_IDE) ? CAN_F16_IDE : 0u) | ((ir >> 18) & 7u);
+}
+
+/*
+ * Run @p ir through the active filters of CAN instance @p idx.  Returns
+ * false when none matches, else the FIFO and filter number.
+ */
+static bool sim_can_filter(uint32_t idx, uint32_t ir, uint32_t *fifo, uint32_t *fmi)
+{
+    const can_regs_t *f1 = &stm32_host_CAN1;
+    uint32_t sb = reg_field_get(f1->FMR, CAN_FMR_CAN2SB);
+    uint32_t first = (idx == 0u) ? 0u : sb;
+    uint32_t last = (idx == 0u) ? sb : CAN_FILTER_BANKS;
+    uint32_t num[CAN_RX_FIFOS] = { 0, 0 };
+    uint32_t best_rank = 0;
+    uint32_t ir16 = sim_can_ir16(ir);
+    uint32_t b;
+
+    if ((f1->FMR & CAN_FMR_FINIT) != 0u) {
+        return false;
+    }
+    for (b = first; b < last && b < CAN_FILTER_BANKS; b++) {
+        uint32_t bit = 1u << b;
+        uint32_t ff = ((f1->FFA1R & bit) != 0u) ? 1u : 0u;
+        bool list = (f1->FM1R & bit) != 0u;
+        bool wide = (f1->FS1R & bit) != 0u;
+        uint32_t r1 = f1->FB[b].FR1;
+        uint32_t r2 = f1->FB[b].FR2;
+        uint32_t v[4];
+        uint32_t m[4];
+        uint32_t nel;
+        uint32_t e;
+
+        /* Elements as (value, mask) pairs in filter number order. */
+        if (wide && !list) {
+            v[0] = r1; m[0] = r2; nel = 1;
+        } else if (wide) {
+            v[0] = r1; v[1] = r2; m[0] = m[1] = 0xFFFFFFFFu; nel = 2;
+        } else if (!list) {
+            v[0] = r1 & 0xFFFFu; m[0] = r1 >> 16;
+            v[1] = r2 & 0xFFFFu; m[1] = r2 >> 16; nel = 2;
+        } else {
+            v[0] = r1 & 0xFFFFu; v[1] = r1 >> 16;
+            v[2] = r2 & 0xFFFFu; v[3] = r2 >> 16;
+            m[0] = m[1] = m[2] = m[3] = 0xFFFFu; nel = 4;
+        }
+        for (e = 0; e < nel; e++) {
+            uint32_t id = wide ? ir : ir16;
+            uint32_t rank = (wide ? 2u : 0u) + (list ? 1u : 0u) + 1u;
+
+            if ((f1->FA1R & bit) != 0u && ((id ^ v[e]) & m[e] & ~CAN_IR_TXRQ) == 0u &&
+                rank > best_rank) {
+                best_rank = rank;
+                *fifo = ff;
+                *fmi = num[ff] + e;
+            }
+        }
+        num[ff] += nel;
+    }
+    return best_rank != 0u;
+}
+
+/* Deliver @p f to instance @p p as a frame seen on its bus. */
+static bool sim_can_deliver(sim_periph_t *p, const sim_can_frame_t *f)
+{
+    can_regs_t *c = p->regs;
+    uint32_t idx = sim_can_index(p);
+    sim_can_state_t *st = &sim_can_state[idx];
+    sim_can_mailbox_t mb;
+    uint32_t fifo = 0;
+    uint32_t fmi = 0;
+    uint32_t ir = sim_can_ir(f);
+    volatile uint32_t *rfr;
+    uint8_t lo[4] = { 0 };
+    uint8_t hi[4] = { 0 };
+    uint32_t len = (f->len > 8u) ? 8u : f->len;
+
+    if ((c->MSR & (CAN_MSR_INAK | CAN_MSR_SLAK)) != 0u || !sim_can_filter(idx, ir, &fifo, &fmi)) {
+        return false;
+    }
+    memcpy(lo, f->data, (len < 4u) ? len : 4u);
+    if (len > 4u) {
+        memcpy(hi, &f->data[4], len - 4u);
+    }
+    mb.rir = ir;
+    mb.rdtr = reg_field_prep(CAN_DTR_DLC, len) | reg_field_prep(CAN_DTR_FMI, fmi);
+    mb.rdlr = (uint32_t)lo[0] | ((uint32_t)lo[1] << 8) | ((uint32_t)lo[2] << 16) | ((uint32_t)lo[3] << 24);
+    mb.rdhr = (uint32_t)hi[0] | ((uint32_t)hi[1] << 8) | ((uint32_t)hi[2] << 16) | ((uint32_t)hi[3] << 24);
+
+    rfr = (fifo == 0u) ? &c->RF0R : &c->RF1R;
+    if (st->count[fifo] == CAN_RX_FIFO_DEPTH) {
+        /* Overrun: a locked FIFO drops the new frame, else it replaces the last. */
+        *rfr |= CAN_RFR_FOVR;
+        if ((c->MCR & CAN_MCR_RFLM) == 0u) {
+            st->fifo[fifo][CAN_RX_FIFO_DEPTH - 1u] = mb;
+        }
+    } else {
+        st->fifo[fifo][st->count[fifo]++] = mb;
+        if (st->count[fifo] == CAN_RX_FIFO_DEPTH) {
+            *rfr |= CAN_RFR_FULL;
+        }
+    }
+    sim_can_fifo_show(c, st, fifo);
+    sim_can_update(p);
+    return true;
+}
+
+bool sim_can_receive(can_regs_t *can, const sim_can_frame_t *f)
+{
+    return sim_can_deliver(sim_find(can), f);
+}
+
+bool sim_can_transmit(can_regs_t *can, sim_can_frame_t *out)
+{
+    sim_periph_t *p = sim_find(can);
+    sim_can_state_t *st = &sim_can_state[sim_can_index(p)];
+    bool fifo_order = (can->MCR & CAN_MCR_TXFP) != 0u;
+    uint32_t win = CAN_TX_MAILBOXES;
+    sim_can_frame_t f;
+    uint32_t tir;
+    uint32_t n;
+
+    if ((can->MSR & (CAN_MSR_INAK | CAN_MSR_SLAK)) != 0u) {
+        return false;
+    }
+    for (n = 0; n < CAN_TX_MAILBOXES; n++) {
+        if ((can->TSR & CAN_TSR_TME(n)) != 0u) {
+            continue;
+        }
+        if (win == CAN_TX_MAILBOXES ||
+            (fifo_order ? st->seq[n] - st->seq[win] > 0x80000000u
+                        : (can->TX[n].TIR & ~CAN_IR_TXRQ) < (can->TX[win].TIR & ~CAN_IR_TXRQ))) {
+            win = n;
+        }
+    }
+    if (win == CAN_TX_MAILBOXES) {
+        return false;
+    }
+
+    tir = can->TX[win].TIR;
+    f.ext = (tir & CAN_IR_IDE) != 0u;
+    f.rtr = (tir & CAN_IR_RTR) != 0u;
+    f.id = f.ext ? reg_field_get(tir, CAN_IR_EXID) : reg_field_get(tir, CAN_IR_STID);
+    f.len = (uint8_t)reg_field_get(can->TX[win].TDTR, CAN_DTR_DLC);
+    if (f.len > 8u) {
+        f.len = 8u;
+    }
+    for (n = 0; n < 4u; n++) {
+        f.data[n] = (uint8_t)(can->TX[win].TDLR >> (8u * n));
+        f.data[4u + n] = (uint8_t)(can->TX[win].TDHR >> (8u * n));
+    }
+    sim_can_mailbox_done(can, win, true);
+    if (out != NULL) {
+        *out = f;
+    }
+    sim_can_update(p);
+    if ((can->BTR & CAN_BTR_LBKM) != 0u) {
+        (void)sim_can_deliver(p, &f);
+    }
+    return true;
+}
+
+uint32_t sim_can_pending(can_regs_t *can)
+{
+    return (~reg_field_get(can->TSR, REG_FIELD(26u, 3u))) & 7u;
+}
+
+void sim_can_error(can_regs_t *can, uint32_t esr)
+{
+    sim_periph_t *p = sim_find(can);
+
+    can->ESR |= esr;
+    can->MSR |= CAN_MSR_ERRI;
+    sim_can_update(p);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Traces                                                                   */
+/* ------------------------------------------------------------------------ */
+
+static int sim_can_hex(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Parse "ID#DATA" at @p s; false if it is not one. */
+static bool sim_can_parse_frame(const char *s, const char *end, sim_can_frame_t *f)
+{
+    uint32_t digits = 0;
+    int h;
+    int l;
+
+    memset(f, 0, sizeof(*f));
+    while (s < end && (h = sim_can_hex(*s)) >= 0) {
+        f->id = (f->id << 4) | (uint32_t)h;
+        digits++;
+        s++;
+    }
+    if (s == end || *s != '#' || (digits != 3u && digits != 8u)) {
+        return false;
+    }
+    s++;
+    f->ext = (digits == 8u);
+    if (s < end && (*s == 'R' || *s == 'r')) {
+        f->rtr = true;
+        return true;
+    }
+    while (s + 1 < end && f->len < 8u && (h = sim_can_hex(s[0])) >= 0 &&
+           (l = sim_can_hex(s[1])) >= 0) {
+        f->data[f->len++] = (uint8_t)((h << 4) | l);
+        s += 2;
+    }
+    return true;
+}
+
+bool sim_can_parse(const char **text, sim_can_frame_t *f)
+{
+    const char *s = *text;
+
+    while (*s != '\0') {
+        const char *eol = strchr(s, '\n');
+        const char *tok;
+
+        if (eol == NULL) {
+            eol = s + strlen(s);
+        }
+        *text = (*eol == '\n') ? eol + 1 : eol;
+        /* The frame is the last whitespace separated field of the line. */
+        tok = eol;
+        while (tok > s && (tok[-1] == ' ' || tok[-1] == '\t' || tok[-1] == '\r')) {
+            tok--;
+        }
+        eol = tok;
+        while (tok > s && tok[-1] != ' ' && tok[-1] != '\t') {
+            tok--;
+        }
+        if (*s != '#' && tok < eol && sim_can_parse_frame(tok, eol, f)) {
+            return true;
+        }
+        s = *text;
+    }
+    return false;
+}
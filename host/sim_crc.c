@@ -0,0 +1,116 @@
+/**
+ * @file    sim_crc.c
+ * @brief   CRC calculation unit model.
+ *
+ * Every 32-bit write to DR shifts the word through the CRC register, MSB
+ * first; DR reads return the register.  CR.RESET reloads it with 0xFFFFFFFF
+ * (F4) or INIT (F7).  On F7 the model applies POL, REV_IN and REV_OUT; only
+ * the 32-bit polynomial size is modelled.
+ */
+#include "sim.h"
+
+static uint32_t sim_crc_reg;
+static uint32_t sim_crc_nwords;
+
+static const sim_reg_t sim_crc_regs[] = {
+    { .offset = 0x00, .reset = CRC_INIT_DEFAULT },      /* DR */
+    { .offset = 0x08, .sc = CRC_CR_RESET },             /* CR */
+#if CRC_PROGRAMMABLE
+    { .offset = 0x10, .reset = CRC_INIT_DEFAULT },      /* INIT */
+    { .offset = 0x14, .reset = CRC_POLY_DEFAULT },      /* POL */
+#endif
+};
+
+#if CRC_PROGRAMMABLE
+static uint32_t sim_crc_rbit(uint32_t v)
+{
+    uint32_t r = 0;
+    uint32_t i;
+
+    for (i = 0; i < 32u; i++) {
+        r = (r << 1) | ((v >> i) & 1u);
+    }
+    return r;
+}
+
+/* Bit reversal within each byte, half-word or the whole word. */
+static uint32_t sim_crc_rev_in(uint32_t v, uint32_t mode)
+{
+    uint32_t r = sim_crc_rbit(v);
+
+    switch (mode) {
+    case CRC_REV_IN_BYTE:
+        return __builtin_bswap32(r);
+    case CRC_REV_IN_HALFWORD:
+        return (r << 16) | (r >> 16);
+    case CRC_REV_IN_WORD:
+        return r;
+    default:
+        return v;
+    }
+}
+#endif
+
+static void sim_crc_publish(crc_regs_t *crc)
+{
+#if CRC_PROGRAMMABLE
+    crc->DR = ((crc->CR & CRC_CR_REV_OUT) != 0u) ? sim_crc_rbit(sim_crc_reg) : sim_crc_reg;
+#else
+    crc->DR = sim_crc_reg;
+#endif
+}
+
+static void sim_crc_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    crc_regs_t *crc = p->regs;
+    uint32_t poly = CRC_POLY_DEFAULT;
+    uint32_t i;
+
+    (void)old;
+    switch (off) {
+    case 0x00u:     /* DR */
+#if CRC_PROGRAMMABLE
+        poly = crc->POL;
+        val = sim_crc_rev_in(val, reg_field_get(crc->CR, CRC_CR_REV_IN));
+#endif
+        sim_crc_reg ^= val;
+        for (i = 0; i < 32u; i++) {
+            sim_crc_reg = ((sim_crc_reg & 0x80000000u) != 0u) ?
+                          (sim_crc_reg << 1) ^ poly : sim_crc_reg << 1;
+        }
+        sim_crc_nwords++;
+        sim_crc_publish(crc);
+        break;
+    case 0x08u:     /* CR */
+        if ((val & CRC_CR_RESET) != 0u) {
+#if CRC_PROGRAMMABLE
+            sim_crc_reg = crc->INIT;
+#else
+            sim_crc_reg = CRC_INIT_DEFAULT;
+#endif
+        }
+        sim_crc_publish(crc);
+        break;
+    default:
+        break;
+    }
+}
+
+static void sim_crc_reset(sim_periph_t *p)
+{
+    (void)p;
+    sim_crc_reg = CRC_INIT_DEFAULT;
+    sim_crc_nwords = 0;
+}
+
+uint32_t sim_crc_words(void)
+{
+    return sim_crc_nwords;
+}
+
+const sim_model_t sim_model_crc = {
+    .regs = sim_crc_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_crc_regs),
+    .write = sim_crc_write,
+    .reset = sim_crc_reset,
+};
@@ -0,0 +1,368 @@
+/**
+ * @file    sim_dma.c
+ * @brief   DMA controller model (DMA1/DMA2, 8 streams each).
+ *
+ * Peripheral-to-memory and memory-to-peripheral streams move one data item
+ * per peripheral request (sim_dma_request()).  Memory-to-memory streams run
+ * to completion as soon as they are enabled.  Circular and double-buffer
+ * modes reload NDTR on completion; double-buffer mode toggles CT.  Disabling
+ * an active stream sets TCIF as on hardware.  With peripheral flow control
+ * NDTR starts at 0xFFFF and the peripheral stops the stream
+ * (sim_dma_flow_end()).  Configuration registers are write-protected while
+ * the stream is enabled.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_DMA_HELD_WORDS  ((SIM_DREQ_COUNT + 31) / 32)
+
+typedef struct {
+    uint32_t ndtr;      /**< NDTR latched at enable, for reload and HT. */
+    uint32_t idx;       /**< Items moved in the current buffer. */
+    bool beat;          /**< An item is being moved. */
+} sim_dma_stream_t;
+
+static sim_dma_stream_t sim_dma_streams[2][8];
+static uint32_t sim_dma_held[SIM_DMA_HELD_WORDS];
+static uint32_t sim_dma_pending[SIM_DMA_HELD_WORDS];
+static bool sim_dma_busy;
+
+/* Request mapped to [controller][stream][channel]. */
+static const uint8_t sim_dma_map[2][8][8] = {
+    {   /* DMA1 */
+        [0] = { [0] = SIM_DREQ_SPI3_RX, [1] = SIM_DREQ_I2C1_RX, [4] = SIM_DREQ_UART5_RX,
+                [6] = SIM_DREQ_TIM5_UP },
+        [1] = { [3] = SIM_DREQ_TIM2_UP, [4] = SIM_DREQ_USART3_RX },
+        [2] = { [0] = SIM_DREQ_SPI3_RX, [3] = SIM_DREQ_I2C3_RX, [4] = SIM_DREQ_UART4_RX,
+                [5] = SIM_DREQ_TIM3_UP, [7] = SIM_DREQ_I2C2_RX },
+        [3] = { [0] = SIM_DREQ_SPI2_RX, [4] = SIM_DREQ_USART3_TX, [7] = SIM_DREQ_I2C2_RX },
+        [4] = { [0] = SIM_DREQ_SPI2_TX, [3] = SIM_DREQ_I2C3_TX, [4] = SIM_DREQ_UART4_TX,
+                [7] = SIM_DREQ_USART3_TX },
+        [5] = { [0] = SIM_DREQ_SPI3_TX, [1] = SIM_DREQ_I2C1_RX, [4] = SIM_DREQ_USART2_RX },
+        [6] = { [1] = SIM_DREQ_I2C1_TX, [2] = SIM_DREQ_TIM4_UP, [4] = SIM_DREQ_USART2_TX,
+                [6] = SIM_DREQ_TIM5_UP },
+        [7] = { [0] = SIM_DREQ_SPI3_TX, [1] = SIM_DREQ_I2C1_TX, [3] = SIM_DREQ_TIM2_UP,
+                [4] = SIM_DREQ_UART5_TX, [7] = SIM_DREQ_I2C2_TX },
+    },
+    {   /* DMA2 */
+        [0] = { [0] = SIM_DREQ_ADC1, [2] = SIM_DREQ_ADC3, [3] = SIM_DREQ_SPI1_RX },
+        [1] = { [2] = SIM_DREQ_ADC3, [5] = SIM_DREQ_USART6_RX, [7] = SIM_DREQ_TIM8_UP },
+        [2] = { [1] = SIM_DREQ_ADC2, [3] = SIM_DREQ_SPI1_RX,
+                [4] = SIM_DREQ_USART1_RX, [5] = SIM_DREQ_USART6_RX },
+        [3] = { [1] = SIM_DREQ_ADC2, [3] = SIM_DREQ_SPI1_TX, [4] = SIM_DREQ_SDIO },
+        [4] = { [0] = SIM_DREQ_ADC1 },
+        [5] = { [3] = SIM_DREQ_SPI1_TX, [4] = SIM_DREQ_USART1_RX, [6] = SIM_DREQ_TIM1_UP },
+        [6] = { [4] = SIM_DREQ_SDIO, [5] = SIM_DREQ_USART6_TX },
+        [7] = { [3] = SIM_DREQ_QUADSPI, [4] = SIM_DREQ_USART1_TX, [5] = SIM_DREQ_USART6_TX },
+    },
+};
+
+static const irqn_t sim_dma_irqs[2][8] = {
+    { DMA1_Stream0_IRQn, DMA1_Stream1_IRQn, DMA1_Stream2_IRQn, DMA1_Stream3_IRQn,
+      DMA1_Stream4_IRQn, DMA1_Stream5_IRQn, DMA1_Stream6_IRQn, DMA1_Stream7_IRQn },
+    { DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+      DMA2_Stream4_IRQn, DMA2_Stream5_IRQn, DMA2_Stream6_IRQn, DMA2_Stream7_IRQn },
+};
+
+static const sim_reg_t sim_dma_regs[] = {
+    { .offset = 0x00, .ro = 0xFFFFFFFFu },  /* LISR */
+    { .offset = 0x04, .ro = 0xFFFFFFFFu },  /* HISR */
+    { .offset = 0x08, .sc = 0xFFFFFFFFu },  /* LIFCR */
+    { .offset = 0x0C, .sc = 0xFFFFFFFFu },  /* HIFCR */
+    { .offset = 0x24, .reset = 0x21u },     /* S0FCR */
+    { .offset = 0x3C, .reset = 0x21u },
+    { .offset = 0x54, .reset = 0x21u },
+    { .offset = 0x6C, .reset = 0x21u },
+    { .offset = 0x84, .reset = 0x21u },
+    { .offset = 0x9C, .reset = 0x21u },
+    { .offset = 0xB4, .reset = 0x21u },
+    { .offset = 0xCC, .reset = 0x21u },     /* S7FCR */
+};
+
+static uint32_t sim_dma_index(const sim_periph_t *p)
+{
+    return (p->base == DMA1_BASE) ? 0u : 1u;
+}
+
+static void sim_dma_flag(dma_regs_t *dma, uint32_t ctrl, uint32_t s, uint32_t flags)
+{
+    volatile uint32_t *isr = (s < 4u) ? &dma->LISR : &dma->HISR;
+    uint32_t cr = dma->S[s].CR;
+
+    *isr |= flags << DMA_ISR_SHIFT(s);
+    if (((flags & DMA_FLAG_TCIF) && (cr & DMA_SCR_TCIE)) ||
+        ((flags & DMA_FLAG_HTIF) && (cr & DMA_SCR_HTIE)) ||
+        ((flags & DMA_FLAG_TEIF) && (cr & DMA_SCR_TEIE))) {
+        sim_irq_raise(sim_dma_irqs[ctrl][s]);
+    }
+}
+
+/* Move one item on stream s; returns false once the stream stops. */
+static bool sim_dma_beat(dma_regs_t *dma, uint32_t ctrl, uint32_t s)
+{
+    dma_stream_regs_t *st = &dma->S[s];
+    sim_dma_stream_t *ss = &sim_dma_streams[ctrl][s];
+    uint32_t cr = st->CR;
+    uint32_t dir = reg_field_get(cr, DMA_SCR_DIR);
+    uint32_t size = 1u << reg_field_get(cr, DMA_SCR_PSIZE);
+    uint32_t mem = ((cr & DMA_SCR_DBM) && (cr & DMA_SCR_CT)) ? st->M1AR : st->M0AR;
+    uint32_t poff = (cr & DMA_SCR_PINC) ? ss->idx * size : 0u;
+    uint32_t moff = (cr & DMA_SCR_MINC) ? ss->idx * size : 0u;
+
+    if ((cr & DMA_SCR_EN) == 0u || st->NDTR == 0u) {
+        return false;
+    }
+    ss->beat = true;
+    if (dir == DMA_DIR_M2P) {
+        sim_bus_write(st->PAR + poff, sim_bus_read(mem + moff, size), size);
+    } else {
+        sim_bus_write(mem + moff, sim_bus_read(st->PAR + poff, size), size);
+    }
+    ss->beat = false;
+    ss->idx++;
+    st->NDTR--;
+
+    if (st->NDTR == ss->ndtr / 2u && ss->ndtr > 1u && (cr & DMA_SCR_PFCTRL) == 0u) {
+        sim_dma_flag(dma, ctrl, s, DMA_FLAG_HTIF);
+    }
+    if (st->NDTR != 0u) {
+        return true;
+    }
+    if ((cr & (DMA_SCR_CIRC | DMA_SCR_DBM)) != 0u && dir != DMA_DIR_M2M) {
+        st->NDTR = ss->ndtr;
+        ss->idx = 0;
+        if ((cr & DMA_SCR_DBM) != 0u) {
+            st->CR = cr ^ DMA_SCR_CT;
+        }
+        sim_dma_flag(dma, ctrl, s, DMA_FLAG_TCIF);
+        return true;
+    }
+    st->CR = cr & ~DMA_SCR_EN;
+    sim_dma_flag(dma, ctrl, s, DMA_FLAG_TCIF);
+    return false;
+}
+
+static dma_regs_t *sim_dma_ctrl(uint32_t ctrl)
+{
+    return (ctrl == 0u) ? &stm32_host_DMA1 : &stm32_host_DMA2;
+}
+
+static bool sim_dma_service(sim_dreq_t req)
+{
+    bool served = false;
+    uint32_t ctrl;
+    uint32_t s;
+
+    for (ctrl = 0; ctrl < 2u; ctrl++) {
+        dma_regs_t *dma = sim_dma_ctrl(ctrl);
+
+        for (s = 0; s < 8u; s++) {
+            uint32_t cr = dma->S[s].CR;
+
+            if ((cr & DMA_SCR_EN) == 0u ||
+                reg_field_get(cr, DMA_SCR_DIR) == DMA_DIR_M2M ||
+                sim_dma_map[ctrl][s][reg_field_get(cr, DMA_SCR_CHSEL)] != req) {
+                continue;
+            }
+            sim_dma_beat(dma, ctrl, s);
+            served = true;
+        }
+    }
+    return served;
+}
+
+static void sim_dma_bit(uint32_t *set, sim_dreq_t req, bool on)
+{
+    if (on) {
+        set[req / 32] |= 1u << (req % 32);
+    } else {
+        set[req / 32] &= ~(1u << (req % 32));
+    }
+}
+
+static bool sim_dma_test(const uint32_t *set, sim_dreq_t req)
+{
+    return (set[req / 32] & (1u << (req % 32))) != 0u;
+}
+
+/*
+ * Peripheral models re-assert requests from inside the accesses a beat makes
+ * (e.g. a TX data register write raising TXE again).  Those are queued and
+ * drained here instead of recursing once per item.
+ */
+static void sim_dma_drain(void)
+{
+    bool again = true;
+    uint32_t r;
+
+    while (again) {
+        again = false;
+        for (r = 1; r < SIM_DREQ_COUNT; r++) {
+            if (sim_dma_test(sim_dma_pending, (sim_dreq_t)r)) {
+                sim_dma_bit(sim_dma_pending, (sim_dreq_t)r, false);
+                if (!sim_dma_service((sim_dreq_t)r)) {
+                    sim_dma_bit(sim_dma_held, (sim_dreq_t)r, true);
+                }
+                again = true;
+            }
+        }
+    }
+}
+
+void sim_dma_request(sim_dreq_t req)
+{
+    if (req == SIM_DREQ_NONE || req >= SIM_DREQ_COUNT) {
+        return;
+    }
+    sim_dma_bit(sim_dma_pending, req, true);
+    if (sim_dma_busy) {
+        return;
+    }
+    sim_dma_busy = true;
+    sim_dma_drain();
+    sim_dma_busy = false;
+}
+
+void sim_dma_release(sim_dreq_t req)
+{
+    if (req != SIM_DREQ_NONE && req < SIM_DREQ_COUNT) {
+        sim_dma_bit(sim_dma_held, req, false);
+        sim_dma_bit(sim_dma_pending, req, false);
+    }
+}
+
+uint32_t sim_dma_remaining(sim_dreq_t req)
+{
+    uint32_t ctrl;
+    uint32_t s;
+
+    for (ctrl = 0; ctrl < 2u; ctrl++) {
+        dma_regs_t *dma = sim_dma_ctrl(ctrl);
+
+        for (s = 0; s < 8u; s++) {
+            uint32_t cr = dma->S[s].CR;
+
+            if ((cr & DMA_SCR_EN) != 0u &&
+                sim_dma_map[ctrl][s][reg_field_get(cr, DMA_SCR_CHSEL)] == req) {
+                return dma->S[s].NDTR - (sim_dma_streams[ctrl][s].beat ? 1u : 0u);
+            }
+        }
+    }
+    return 0;
+}
+
+void sim_dma_flow_end(sim_dreq_t req)
+{
+    uint32_t ctrl;
+    uint32_t s;
+
+    for (ctrl = 0; ctrl < 2u; ctrl++) {
+        dma_regs_t *dma = sim_dma_ctrl(ctrl);
+
+        for (s = 0; s < 8u; s++) {
+            uint32_t cr = dma->S[s].CR;
+
+            if ((cr & (DMA_SCR_EN | DMA_SCR_PFCTRL)) == (DMA_SCR_EN | DMA_SCR_PFCTRL) &&
+                sim_dma_map[ctrl][s][reg_field_get(cr, DMA_SCR_CHSEL)] == req) {
+                dma->S[s].CR = cr & ~DMA_SCR_EN;
+                sim_dma_flag(dma, ctrl, s, DMA_FLAG_TCIF);
+            }
+        }
+    }
+}
+
+static void sim_dma_enable(dma_regs_t *dma, uint32_t ctrl, uint32_t s)
+{
+    dma_stream_regs_t *st = &dma->S[s];
+    sim_dma_stream_t *ss = &sim_dma_streams[ctrl][s];
+    uint32_t cr = st->CR;
+    sim_dreq_t req;
+
+    if ((cr & DMA_SCR_PFCTRL) != 0u) {
+        /* The peripheral ends the transfer; NDTR only counts down. */
+        st->NDTR = 0xFFFFu;
+    }
+    ss->ndtr = st->NDTR;
+    ss->idx = 0;
+
+    if (reg_field_get(cr, DMA_SCR_DIR) == DMA_DIR_M2M) {
+        /* M2M is not circular and needs no request: run it now. */
+        while (sim_dma_beat(dma, ctrl, s)) {
+        }
+        return;
+    }
+    req = (sim_dreq_t)sim_dma_map[ctrl][s][reg_field_get(cr, DMA_SCR_CHSEL)];
+    if (req != SIM_DREQ_NONE && sim_dma_test(sim_dma_held, req)) {
+        sim_dma_bit(sim_dma_held, req, false);
+        sim_dma_request(req);
+    }
+}
+
+static void sim_dma_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    dma_regs_t *dma = p->regs;
+    uint32_t ctrl = sim_dma_index(p);
+    uint32_t s;
+    uint32_t reg;
+
+    if (off == 0x08u) {
+        dma->LISR &= ~val;
+        return;
+    }
+    if (off == 0x0Cu) {
+        dma->HISR &= ~val;
+        return;
+    }
+    if (off < 0x10u) {
+        return;
+    }
+
+    s = (off - 0x10u) / sizeof(dma_stream_regs_t);
+    reg = (off - 0x10u) % sizeof(dma_stream_regs_t);
+
+    if (reg != 0x00u) {
+        /* NDTR, PAR, M0AR, FCR are locked while enabled; M1AR stays writable
+         * in double-buffer mode so software can refill the idle buffer. */
+        bool dbm = (dma->S[s].CR & DMA_SCR_DBM) != 0u;
+
+        if ((dma->S[s].CR & DMA_SCR_EN) != 0u && !(reg == 0x10u && dbm)) {
+            *(volatile uint32_t *)((uint8_t *)dma + off) = old;
+        }
+        return;
+    }
+
+    if ((old & DMA_SCR_EN) != 0u) {
+        if ((val & DMA_SCR_EN) == 0u) {
+            if (dma->S[s].NDTR != 0u) {
+                sim_dma_flag(dma, ctrl, s, DMA_FLAG_TCIF);
+            }
+        } else {
+            /* Only EN can be changed on an enabled stream. */
+            dma->S[s].CR = old;
+        }
+        return;
+    }
+    if ((val & DMA_SCR_EN) != 0u) {
+        sim_dma_enable(dma, ctrl, s);
+    }
+}
+
+static void sim_dma_reset(sim_periph_t *p)
+{
+    uint32_t ctrl = sim_dma_index(p);
+
+    memset(sim_dma_streams[ctrl], 0, sizeof(sim_dma_streams[ctrl]));
+    if (ctrl == 0u) {
+        memset(sim_dma_held, 0, sizeof(sim_dma_held));
+        memset(sim_dma_pending, 0, sizeof(sim_dma_pending));
+        sim_dma_busy = false;
+    }
+}
+
+const sim_model_t sim_model_dma = {
+    .regs = sim_dma_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_dma_regs),
+    .write = sim_dma_write,
+    .reset = sim_dma_reset,
+};
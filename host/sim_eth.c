@@ -0,0 +1,645 @@
+/**
+ * @file    sim_eth.c
+ * @brief   Ethernet MAC and DMA model with a clause 22 PHY behind MDIO.
+ *
+ * Both DMA directions keep their position in DMACHRDR / DMACHTDR and walk
+ * the rings in ring or chained mode with the descriptor stride DMABMR
+ * selects.  Receive suspends (RBUS) on a descriptor the driver still owns
+ * and resumes on a poll demand or the next frame; transmit suspends
+ * (TBUS) on one and resumes only on a poll demand, as the real DMA does.
+ * A frame received into a descriptor with RDES1.DIC set starts the receive
+ * watchdog instead of setting RS; sim_eth_advance() runs it down.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_ETH_OFF(reg)        ((uint32_t)offsetof(eth_regs_t, reg))
+
+#define SIM_ETH_HEADER_LEN      14u
+#define SIM_ETH_MIN_FRAME       60u         /* Padded to this, FCS excluded. */
+#define SIM_ETH_FRAME_MAX       2048u
+
+#define SIM_ETH_NORMAL          (ETH_DMA_TS | ETH_DMA_TBUS | ETH_DMA_RS | ETH_DMA_ERS)
+#define SIM_ETH_ABNORMAL        (ETH_DMA_TPSS | ETH_DMA_TJTS | ETH_DMA_ROS | ETH_DMA_TUS |   \
+                                 ETH_DMA_RBUS | ETH_DMA_RPSS | ETH_DMA_RWTS | ETH_DMA_ETS | \
+                                 ETH_DMA_FBES)
+#define SIM_ETH_DMASR_W1C       REG_MASK(0u, 17u)
+#define SIM_ETH_TDES0_STATUS    REG_MASK(0u, 18u)
+
+#define SIM_ETH_RPS_WAITING     3u
+#define SIM_ETH_TPS_RUNNING     1u
+
+/* PHY */
+#define SIM_ETH_BMSR            0x7809u     /* 100/10 FD/HD, AN able, extended. */
+#define SIM_ETH_BMSR_LINK       0x0004u
+#define SIM_ETH_BMSR_ANC        0x0020u
+
+#define SIM_ETH_IP_ICMP         1u
+#define SIM_ETH_IP_TCP          6u
+#define SIM_ETH_IP_UDP          17u
+
+typedef struct {
+    uint16_t phy[32];
+    uint16_t anlpar;
+    uint8_t phy_addr;
+    bool phy_present;
+    bool link;
+    uint32_t rswt_left;             /* HCLK cycles to the watchdog RS; 0: idle. */
+} sim_eth_state_t;
+
+static sim_eth_state_t sim_eth_state;
+
+static const sim_reg_t sim_eth_regs[] = {
+    { .offset = 0x0000, .reset = 0x00008000u },                 /* MACCR */
+    { .offset = 0x0010, .sc = ETH_MACMIIAR_MB },                /* MACMIIAR */
+    { .offset = 0x0040, .reset = 0x8000FFFFu, .ro = ETH_MACA0HR_MO }, /* MACA0HR */
+    { .offset = 0x0044, .reset = 0xFFFFFFFFu },                 /* MACA0LR */
+    { .offset = 0x1000, .reset = 0x00020101u, .sc = ETH_DMABMR_SR }, /* DMABMR */
+    { .offset = 0x1004, .sc = 0xFFFFFFFFu },                    /* DMATPDR */
+    { .offset = 0x1008, .sc = 0xFFFFFFFFu },                    /* DMARPDR */
+    { .offset = 0x1014, .ro = ~SIM_ETH_DMASR_W1C, .w1c = SIM_ETH_DMASR_W1C }, /* DMASR */
+    { .offset = 0x1018, .sc = ETH_DMAOMR_FTF },                 /* DMAOMR */
+    { .offset = 0x1020, .ro = 0xFFFFFFFFu },                    /* DMAMFBOCR */
+    { .offset = 0x1048, .ro = 0xFFFFFFFFu },                    /* DMACHTDR */
+    { .offset = 0x104C, .ro = 0xFFFFFFFFu },                    /* DMACHRDR */
+    { .offset = 0x1050, .ro = 0xFFFFFFFFu },                    /* DMACHTBAR */
+    { .offset = 0x1054, .ro = 0xFFFFFFFFu },                    /* DMACHRBAR */
+};
+
+/* ------------------------------------------------------------------------ */
+/* Frame helpers                                                            */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t sim_eth_be16(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static void sim_eth_put_be16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/* One's complement sum of big-endian 16-bit words, not yet folded. */
+static uint32_t sim_eth_sum(uint32_t sum, const uint8_t *p, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 1u < len; i += 2u) {
+        sum += sim_eth_be16(&p[i]);
+    }
+    if ((len & 1u) != 0u) {
+        sum += (uint32_t)p[len - 1u] << 8;
+    }
+    return sum;
+}
+
+static uint32_t sim_eth_fold(uint32_t sum)
+{
+    while ((sum >> 16) != 0u) {
+        sum = (sum & 0xFFFFu) + (sum >> 16);
+    }
+    return sum;
+}
+
+/* Ethernet FCS: reflected CRC-32. */
+static uint32_t sim_eth_fcs(const uint8_t *p, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    size_t i;
+    int k;
+
+    for (i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+typedef struct {
+    uint8_t *hdr;
+    uint32_t ihl;
+    uint32_t total;
+    uint8_t proto;
+    bool fragment;
+} sim_eth_ip_t;
+
+/* Untagged IPv4 frame whose header and total length fit @p len. */
+static bool sim_eth_ipv4(uint8_t *f, size_t len, sim_eth_ip_t *ip)
+{
+    if (len < SIM_ETH_HEADER_LEN + 20u || sim_eth_be16(&f[12]) != 0x0800u ||
+        (f[SIM_ETH_HEADER_LEN] >> 4) != 4u) {
+        return false;
+    }
+    ip->hdr = &f[SIM_ETH_HEADER_LEN];
+    ip->ihl = 4u * (ip->hdr[0] & 0x0Fu);
+    ip->total = sim_eth_be16(&ip->hdr[2]);
+    ip->proto = ip->hdr[9];
+    ip->fragment = (sim_eth_be16(&ip->hdr[6]) & 0x3FFFu) != 0u;
+    return ip->ihl >= 20u && ip->total >= ip->ihl && SIM_ETH_HEADER_LEN + ip->total <= len;
+}
+
+/* Offset of the checksum in the payload, or 0 for protocols not offloaded. */
+static uint32_t sim_eth_csum_off(uint8_t proto)
+{
+    switch (proto) {
+    case SIM_ETH_IP_TCP:
+        return 16u;
+    case SIM_ETH_IP_UDP:
+        return 6u;
+    case SIM_ETH_IP_ICMP:
+        return 2u;
+    default:
+        return 0u;
+    }
+}
+
+static uint32_t sim_eth_pseudo(const sim_eth_ip_t *ip)
+{
+    return sim_eth_sum(0u, &ip->hdr[12], 8u) + ip->proto + (ip->total - ip->ihl);
+}
+
+/* Receive checksum engine: RDES4 for the frame. */
+static uint32_t sim_eth_rx_check(uint8_t *f, size_t len)
+{
+    sim_eth_ip_t ip;
+    uint32_t des4 = ETH_RDES4_IPV4PR;
+    uint32_t off;
+    uint32_t plen;
+    uint8_t *pay;
+    uint32_t sum;
+
+    if (!sim_eth_ipv4(f, len, &ip)) {
+        return 0u;
+    }
+    if (sim_eth_fold(sim_eth_sum(0u, ip.hdr, ip.ihl)) != 0xFFFFu) {
+        return des4 | ETH_RDES4_IPHE;
+    }
+    off = sim_eth_csum_off(ip.proto);
+    if (off == 0u) {
+        return des4;
+    }
+    if (ip.fragment) {
+        return des4 | ETH_RDES4_IPCB;
+    }
+    des4 |= reg_field_prep(ETH_RDES4_IPPT, (ip.proto == SIM_ETH_IP_TCP) ? ETH_IPPT_TCP :
+                                           (ip.proto == SIM_ETH_IP_UDP) ? ETH_IPPT_UDP :
+                                                                          ETH_IPPT_ICMP);
+    pay = ip.hdr + ip.ihl;
+    plen = ip.total - ip.ihl;
+    if (plen < off + 2u) {
+        return des4 | ETH_RDES4_IPPE;
+    }
+    if (ip.proto == SIM_ETH_IP_UDP && sim_eth_be16(&pay[off]) == 0u) {
+        return des4;            /* No UDP checksum. */
+    }
+    sum = sim_eth_sum((ip.proto == SIM_ETH_IP_ICMP) ? 0u : sim_eth_pseudo(&ip), pay, plen);
+    if (sim_eth_fold(sum) != 0xFFFFu) {
+        des4 |= ETH_RDES4_IPPE;
+    }
+    return des4;
+}
+
+/* Transmit checksum insertion, TDES0.CIC mode @p cic. */
+static void sim_eth_tx_insert(uint8_t *f, size_t len, uint32_t cic)
+{
+    sim_eth_ip_t ip;
+    uint32_t off;
+    uint32_t plen;
+    uint8_t *pay;
+    uint32_t sum = 0;
+    uint32_t c;
+
+    if (cic == ETH_CIC_NONE || !sim_eth_ipv4(f, len, &ip)) {
+        return;
+    }
+    sim_eth_put_be16(&ip.hdr[10], 0u);
+    sim_eth_put_be16(&ip.hdr[10], ~sim_eth_fold(sim_eth_sum(0u, ip.hdr, ip.ihl)) & 0xFFFFu);
+    off = sim_eth_csum_off(ip.proto);
+    pay = ip.hdr + ip.ihl;
+    plen = ip.total - ip.ihl;
+    if (cic == ETH_CIC_IP_HEADER || off == 0u || ip.fragment || plen < off + 2u) {
+        return;
+    }
+    if (cic == ETH_CIC_FULL) {
+        /* The pseudo-header is computed here; otherwise it is in the field. */
+        sim_eth_put_be16(&pay[off], 0u);
+        sum = (ip.proto == SIM_ETH_IP_ICMP) ? 0u : sim_eth_pseudo(&ip);
+    }
+    c = ~sim_eth_fold(sim_eth_sum(sum, pay, plen)) & 0xFFFFu;
+    if (ip.proto == SIM_ETH_IP_UDP && c == 0u) {
+        c = 0xFFFFu;
+    }
+    sim_eth_put_be16(&pay[off], c);
+}
+
+static bool sim_eth_accept(const eth_regs_t *e, const uint8_t *dst)
+{
+    static const uint8_t bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t own[6];
+
+    if ((e->MACFFR & (ETH_MACFFR_PM | ETH_MACFFR_RA)) != 0u) {
+        return true;
+    }
+    if (memcmp(dst, bcast, sizeof(bcast)) == 0) {
+        return (e->MACFFR & ETH_MACFFR_BFD) == 0u;
+    }
+    if ((dst[0] & 1u) != 0u) {
+        return (e->MACFFR & ETH_MACFFR_PAM) != 0u;
+    }
+    own[0] = (uint8_t)e->MACA0LR;
+    own[1] = (uint8_t)(e->MACA0LR >> 8);
+    own[2] = (uint8_t)(e->MACA0LR >> 16);
+    own[3] = (uint8_t)(e->MACA0LR >> 24);
+    own[4] = (uint8_t)e->MACA0HR;
+    own[5] = (uint8_t)(e->MACA0HR >> 8);
+    return memcmp(dst, own, sizeof(own)) == 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* DMA                                                                      */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t sim_eth_stride(const eth_regs_t *e)
+{
+    return (((e->DMABMR & ETH_DMABMR_EDFE) != 0u) ? 32u : 16u) +
+           4u * reg_field_get(e->DMABMR, ETH_DMABMR_DSL);
+}
+
+static eth_dma_desc_t *sim_eth_desc(uint32_t addr)
+{
+    return sim_bus_ptr(addr);
+}
+
+static void sim_eth_set_rps(eth_regs_t *e, uint32_t state)
+{
+    e->DMASR = reg_field_set(e->DMASR, ETH_DMASR_RPS, state);
+}
+
+static void sim_eth_set_tps(eth_regs_t *e, uint32_t state)
+{
+    e->DMASR = reg_field_set(e->DMASR, ETH_DMASR_TPS, state);
+}
+
+/* Transmit DMA fetches the current descriptor: run, or suspend with TBUS. */
+static void sim_eth_tx_fetch(eth_regs_t *e)
+{
+    const eth_dma_desc_t *d = sim_eth_desc(e->DMACHTDR);
+
+    if (d != NULL && (d->des0 & ETH_DES0_OWN) != 0u) {
+        sim_eth_set_tps(e, SIM_ETH_TPS_RUNNING);
+    } else {
+        sim_eth_set_tps(e, ETH_DMA_TPS_SUSPENDED);
+        e->DMASR |= ETH_DMA_TBUS;
+    }
+}
+
+/* Recompute the summary bits and raise the interrupt level. */
+static void sim_eth_update(eth_regs_t *e)
+{
+    uint32_t sr = e->DMASR & ~(ETH_DMA_NIS | ETH_DMA_AIS);
+
+    if ((sr & e->DMAIER & SIM_ETH_NORMAL) != 0u) {
+        sr |= ETH_DMA_NIS;
+    }
+    if ((sr & e->DMAIER & SIM_ETH_ABNORMAL) != 0u) {
+        sr |= ETH_DMA_AIS;
+    }
+    e->DMASR = sr;
+    if ((sr & e->DMAIER & (ETH_DMA_NIS | ETH_DMA_AIS)) != 0u) {
+        sim_irq_raise(ETH_IRQn);
+    }
+}
+
+/* DMABMR.SR: every MAC and DMA register back to reset; the PHY is external. */
+static void sim_eth_dma_reset(eth_regs_t *e, sim_eth_state_t *st)
+{
+    size_t i;
+
+    memset((void *)e, 0, sizeof(*e));
+    for (i = 0; i < STM32_ARRAY_SIZE(sim_eth_regs); i++) {
+        *(volatile uint32_t *)((uint8_t *)e + sim_eth_regs[i].offset) = sim_eth_regs[i].reset;
+    }
+    st->rswt_left = 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* PHY                                                                      */
+/* ------------------------------------------------------------------------ */
+
+static void sim_eth_phy_defaults(sim_eth_state_t *st)
+{
+    memset(st->phy, 0, sizeof(st->phy));
+    st->phy[0] = 0x3100u;       /* BMCR: 100 Mbit/s, AN enabled, full duplex. */
+    st->phy[2] = 0x0007u;       /* PHYID1/2 */
+    st->phy[3] = 0xC0F1u;
+    st->phy[4] = 0x01E1u;       /* ANAR: all four modes, 802.3. */
+}
+
+static uint16_t sim_eth_phy_read(const sim_eth_state_t *st, uint32_t reg)
+{
+    switch (reg) {
+    case 1u:
+        return SIM_ETH_BMSR | (st->link ? (SIM_ETH_BMSR_LINK | SIM_ETH_BMSR_ANC) : 0u);
+    case 5u:
+        return st->link ? st->anlpar : 0u;
+    default:
+        return st->phy[reg];
+    }
+}
+
+static void sim_eth_phy_write(sim_eth_state_t *st, uint32_t reg, uint16_t val)
+{
+    if (reg == 0u) {
+        if ((val & 0x8000u) != 0u) {
+            sim_eth_phy_defaults(st);
+        } else {
+            st->phy[0] = val;
+        }
+    } else if (reg == 4u) {
+        st->phy[4] = val;
+    }
+}
+
+static void sim_eth_mdio(eth_regs_t *e, sim_eth_state_t *st, uint32_t cmd)
+{
+    uint32_t reg = reg_field_get(cmd, ETH_MACMIIAR_MR);
+    bool write = (cmd & ETH_MACMIIAR_MW) != 0u;
+
+    if (!st->phy_present || reg_field_get(cmd, ETH_MACMIIAR_PA) != st->phy_addr) {
+        if (!write) {
+            e->MACMIIDR = 0xFFFFu;
+        }
+    } else if (write) {
+        sim_eth_phy_write(st, reg, (uint16_t)e->MACMIIDR);
+    } else {
+        e->MACMIIDR = sim_eth_phy_read(st, reg);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Registers                                                                */
+/* ------------------------------------------------------------------------ */
+
+static void sim_eth_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    eth_regs_t *e = p->regs;
+    sim_eth_state_t *st = &sim_eth_state;
+
+    if (off == SIM_ETH_OFF(MACMIIAR)) {
+        if ((val & ETH_MACMIIAR_MB) != 0u) {
+            sim_eth_mdio(e, st, val);
+        }
+    } else if (off == SIM_ETH_OFF(DMABMR)) {
+        if ((val & ETH_DMABMR_SR) != 0u) {
+            sim_eth_dma_reset(e, st);
+        }
+    } else if (off == SIM_ETH_OFF(DMARDLAR)) {
+        e->DMACHRDR = val;
+    } else if (off == SIM_ETH_OFF(DMATDLAR)) {
+        e->DMACHTDR = val;
+    } else if (off == SIM_ETH_OFF(DMARPDR)) {
+        if (reg_field_get(e->DMASR, ETH_DMASR_RPS) == ETH_DMA_RPS_SUSPENDED) {
+            sim_eth_set_rps(e, SIM_ETH_RPS_WAITING);
+        }
+    } else if (off == SIM_ETH_OFF(DMATPDR)) {
+        if (reg_field_get(e->DMASR, ETH_DMASR_TPS) == ETH_DMA_TPS_SUSPENDED) {
+            sim_eth_tx_fetch(e);
+        }
+    } else if (off == SIM_ETH_OFF(DMAOMR)) {
+        if (((old ^ val) & ETH_DMAOMR_SR) != 0u) {
+            sim_eth_set_rps(e, ((val & ETH_DMAOMR_SR) != 0u) ? SIM_ETH_RPS_WAITING
+                                                            : ETH_DMA_PS_STOPPED);
+            st->rswt_left = 0;
+        }
+        if (((old ^ val) & ETH_DMAOMR_ST) != 0u) {
+            if ((val & ETH_DMAOMR_ST) != 0u) {
+                sim_eth_tx_fetch(e);
+            } else {
+                sim_eth_set_tps(e, ETH_DMA_PS_STOPPED);
+            }
+        }
+    }
+    sim_eth_update(e);
+}
+
+static uint32_t sim_eth_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    eth_regs_t *e = p->regs;
+
+    if (off == SIM_ETH_OFF(DMAMFBOCR)) {
+        e->DMAMFBOCR = 0;
+    }
+    return val;
+}
+
+static void sim_eth_reset(sim_periph_t *p)
+{
+    (void)p;
+    memset(&sim_eth_state, 0, sizeof(sim_eth_state));
+}
+
+const sim_model_t sim_model_eth = {
+    .regs = sim_eth_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_eth_regs),
+    .write = sim_eth_write,
+    .read = sim_eth_read,
+    .reset = sim_eth_reset,
+};
+
+/* ------------------------------------------------------------------------ */
+/* Wire                                                                     */
+/* ------------------------------------------------------------------------ */
+
+void sim_eth_phy(eth_regs_t *eth, uint8_t addr, bool link, uint16_t anlpar)
+{
+    sim_eth_state_t *st = &sim_eth_state;
+
+    (void)eth;
+    if (!st->phy_present || st->phy_addr != addr) {
+        sim_eth_phy_defaults(st);
+    }
+    st->phy_present = true;
+    st->phy_addr = addr;
+    st->link = link;
+    st->anlpar = anlpar;
+}
+
+sim_eth_rx_t sim_eth_receive(eth_regs_t *eth, const void *frame, size_t len)
+{
+    sim_eth_state_t *st = &sim_eth_state;
+    uint8_t f[SIM_ETH_FRAME_MAX];
+    eth_dma_desc_t *d;
+    uint8_t *buf;
+    uint32_t des0;
+    uint32_t des4 = 0;
+    uint32_t mfc;
+    size_t flen;
+    bool type;
+    bool strip;
+
+    if ((eth->MACCR & ETH_MACCR_RE) == 0u ||
+        reg_field_get(eth->DMASR, ETH_DMASR_RPS) == ETH_DMA_PS_STOPPED ||
+        len < SIM_ETH_HEADER_LEN || len > sizeof(f) - 4u) {
+        return SIM_ETH_RX_OFF;
+    }
+    memcpy(f, frame, len);
+    if (!sim_eth_accept(eth, f)) {
+        return SIM_ETH_RX_FILTERED;
+    }
+    if ((eth->MACCR & ETH_MACCR_IPCO) != 0u) {
+        des4 = sim_eth_rx_check(f, len);
+        if ((des4 & (ETH_RDES4_IPHE | ETH_RDES4_IPPE)) != 0u &&
+            (eth->DMAOMR & ETH_DMAOMR_DTCEFD) == 0u) {
+            return SIM_ETH_RX_DROPPED;
+        }
+    }
+
+    d = sim_eth_desc(eth->DMACHRDR);
+    if (d == NULL || (d->des0 & ETH_DES0_OWN) == 0u) {
+        mfc = reg_field_get(eth->DMAMFBOCR, ETH_DMAMFBOCR_MFC);
+        if (mfc < 0xFFFFu) {
+            eth->DMAMFBOCR = reg_field_set(eth->DMAMFBOCR, ETH_DMAMFBOCR_MFC, mfc + 1u);
+        }
+        sim_eth_set_rps(eth, ETH_DMA_RPS_SUSPENDED);
+        eth->DMASR |= ETH_DMA_RBUS;
+        sim_eth_update(eth);
+        return SIM_ETH_RX_MISSED;
+    }
+
+    type = sim_eth_be16(&f[12]) >= 0x0600u;
+    strip = (eth->MACCR & (type ? ETH_MACCR_CSTF : ETH_MACCR_APCS)) != 0u;
+    flen = len;
+    if (!strip) {
+        uint32_t fcs = sim_eth_fcs(f, len);
+
+        f[flen++] = (uint8_t)fcs;
+        f[flen++] = (uint8_t)(fcs >> 8);
+        f[flen++] = (uint8_t)(fcs >> 16);
+        f[flen++] = (uint8_t)(fcs >> 24);
+    }
+    des0 = ETH_RDES0_FS | ETH_RDES0_LS | reg_field_prep(ETH_RDES0_FL, (uint32_t)flen) |
+           (type ? ETH_RDES0_FT : 0u);
+    buf = sim_bus_ptr(d->des2);
+    if (buf == NULL || flen > reg_field_get(d->des1, ETH_RDES1_RBS1)) {
+        des0 |= ETH_RDES0_ES | ETH_RDES0_DE;
+    } else {
+        memcpy(buf, f, flen);
+    }
+    if ((eth->MACCR & ETH_MACCR_IPCO) != 0u) {
+        des0 |= ETH_RDES0_ESA;
+    }
+    d->des4 = des4;
+    d->des0 = des0;
+
+    eth->DMACHRBAR = d->des2;
+    if ((d->des1 & ETH_RDES1_RER) != 0u) {
+        eth->DMACHRDR = eth->DMARDLAR;
+    } else if ((d->des1 & ETH_RDES1_RCH) != 0u) {
+        eth->DMACHRDR = d->des3;
+    } else {
+        eth->DMACHRDR += sim_eth_stride(eth);
+    }
+    if ((d->des1 & ETH_RDES1_DIC) == 0u) {
+        eth->DMASR |= ETH_DMA_RS;
+        st->rswt_left = 0;
+    } else if (st->rswt_left == 0u) {
+        st->rswt_left = reg_field_get(eth->DMARSWTR, ETH_DMARSWTR_RSWTC) * ETH_RSWT_CYCLES;
+    }
+    sim_eth_set_rps(eth, SIM_ETH_RPS_WAITING);
+    sim_eth_update(eth);
+    return SIM_ETH_RX_OK;
+}
+
+void sim_eth_advance(eth_regs_t *eth, uint32_t cycles)
+{
+    sim_eth_state_t *st = &sim_eth_state;
+
+    if (st->rswt_left == 0u) {
+        return;
+    }
+    if (cycles < st->rswt_left) {
+        st->rswt_left -= cycles;
+        return;
+    }
+    st->rswt_left = 0;
+    eth->DMASR |= ETH_DMA_RS;
+    sim_eth_update(eth);
+}
+
+size_t sim_eth_transmit(eth_regs_t *eth, void *buf, size_t max)
+{
+    uint8_t f[SIM_ETH_FRAME_MAX];
+    size_t len = 0;
+    eth_dma_desc_t *d;
+    uint32_t cic;
+    uint32_t des0;
+
+    if ((eth->DMAOMR & ETH_DMAOMR_ST) == 0u || (eth->MACCR & ETH_MACCR_TE) == 0u ||
+        reg_field_get(eth->DMASR, ETH_DMASR_TPS) != SIM_ETH_TPS_RUNNING) {
+        return 0;
+    }
+    d = sim_eth_desc(eth->DMACHTDR);
+    if (d == NULL || (d->des0 & ETH_DES0_OWN) == 0u) {
+        sim_eth_tx_fetch(eth);
+        sim_eth_update(eth);
+        return 0;
+    }
+    cic = reg_field_get(d->des0, ETH_TDES0_CIC);
+    for (;;) {
+        uint32_t n1 = reg_field_get(d->des1, ETH_TDES1_TBS1);
+        uint32_t n2 = ((d->des0 & ETH_TDES0_TCH) != 0u) ? 0u
+                                                        : reg_field_get(d->des1, ETH_TDES1_TBS2);
+        const uint8_t *b1 = sim_bus_ptr(d->des2);
+        const uint8_t *b2 = sim_bus_ptr(d->des3);
+
+        if (b1 != NULL && len + n1 <= sizeof(f)) {
+            memcpy(&f[len], b1, n1);
+            len += n1;
+        }
+        if (n2 != 0u && b2 != NULL && len + n2 <= sizeof(f)) {
+            memcpy(&f[len], b2, n2);
+            len += n2;
+        }
+        des0 = d->des0;
+        d->des0 = des0 & ~(ETH_DES0_OWN | SIM_ETH_TDES0_STATUS);
+        eth->DMACHTBAR = d->des2;
+        if ((des0 & ETH_TDES0_TER) != 0u) {
+            eth->DMACHTDR = eth->DMATDLAR;
+        } else if ((des0 & ETH_TDES0_TCH) != 0u) {
+            eth->DMACHTDR = d->des3;
+        } else {
+            eth->DMACHTDR += sim_eth_stride(eth);
+        }
+        if ((des0 & ETH_TDES0_LS) != 0u) {
+            break;
+        }
+        d = sim_eth_desc(eth->DMACHTDR);
+        if (d == NULL || (d->des0 & ETH_DES0_OWN) == 0u) {
+            /* Frame ends in a descriptor the DMA does not own. */
+            eth->DMASR |= ETH_DMA_TUS;
+            sim_eth_tx_fetch(eth);
+            sim_eth_update(eth);
+            return 0;
+        }
+    }
+
+    if ((eth->DMAOMR & ETH_DMAOMR_TSF) != 0u) {
+        sim_eth_tx_insert(f, len, cic);
+    }
+    if (len < SIM_ETH_MIN_FRAME) {
+        memset(&f[len], 0, SIM_ETH_MIN_FRAME - len);
+        len = SIM_ETH_MIN_FRAME;
+    }
+    if ((des0 & ETH_TDES0_IC) != 0u) {
+        eth->DMASR |= ETH_DMA_TS;
+    }
+    sim_eth_tx_fetch(eth);
+    sim_eth_update(eth);
+    memcpy(buf, f, (len < max) ? len : max);
+    return len;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file    sim_flash.c
+ * @brief   Flash interface register model and flash memory array.
+ *
+ * ACR is plain read/write storage: wait states and accelerator enables
+ * read back as written and have no timing effect on the host.
+ *
+ * CR unlocks with FLASH_KEY1 then FLASH_KEY2 in KEYR; any other write to
+ * KEYR locks it until the next sim_reset(), like the bus error on the part.
+ * Operations complete within the write that starts them, so BSY never
+ * reads set.  The array (FLASHMEM) comes out of reset erased and behaves
+ * like flash: a store with CR.PG set can only clear bits, a store without
+ * it changes nothing and flags a sequence error, and a sector or mass
+ * erase sets everything back to 1.  Stores must match CR.PSIZE: x32 takes
+ * single words, x64 pairs of words to one 8-byte aligned double word, in
+ * order.  x8 and x16 would need narrow stores, which the host register
+ * access cannot express; they fail with PGPERR.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#if defined(STM32F7)
+#define SIM_FLASH_SEQERR    FLASH_SR_ERSERR
+#else
+#define SIM_FLASH_SEQERR    FLASH_SR_PGSERR
+#endif
+
+static const sim_reg_t sim_flash_regs[] = {
+    { .offset = 0x04, .sc = 0xFFFFFFFFu },      /* KEYR */
+    { .offset = 0x08, .sc = 0xFFFFFFFFu },      /* OPTKEYR */
+    { .offset = 0x0C, .ro = FLASH_SR_BSY,
+      .w1c = FLASH_SR_EOP | FLASH_SR_ERRORS },  /* SR */
+    { .offset = 0x10, .reset = FLASH_CR_LOCK,
+      .sc = FLASH_CR_STRT },                    /* CR */
+};
+
+static struct {
+    uint32_t keys;          /* Keys accepted; 2: unlocked, 3: locked out. */
+    bool half;              /* First word of an x64 double word stored. */
+    uint32_t half_off;
+    uint32_t half_val;
+} sim_flash;
+
+/* Flag @p bits in SR (EOP only with EOPIE); interrupt if CR enables it. */
+static void sim_flash_done(uint32_t bits)
+{
+    uint32_t cr = stm32_host_FLASH.CR;
+
+    if ((cr & FLASH_CR_EOPIE) == 0u) {
+        bits &= ~FLASH_SR_EOP;
+    }
+    stm32_host_FLASH.SR |= bits;
+    if ((bits & FLASH_SR_EOP) != 0u ||
+        ((bits & FLASH_SR_ERRORS) != 0u && (cr & FLASH_CR_ERRIE) != 0u)) {
+        sim_irq_raise(FLASH_IRQn);
+    }
+}
+
+static void sim_flash_erase(uint32_t off, uint32_t size)
+{
+    memset((uint8_t *)stm32_host_FLASHMEM.W + off, 0xFF, size);
+}
+
+static void sim_flash_start(uint32_t cr)
+{
+    uint32_t snb = reg_field_get(cr, FLASH_CR_SNB);
+
+    if ((cr & FLASH_CR_PG) != 0u || (cr & (FLASH_CR_SER | FLASH_CR_MER)) == 0u) {
+        sim_flash_done(SIM_FLASH_SEQERR);
+    } else if ((cr & FLASH_CR_MER) != 0u) {
+        sim_flash_erase(0u, FLASH_MEM_SIZE);
+        sim_flash_done(FLASH_SR_EOP);
+    } else if (snb >= FLASH_SECTOR_COUNT) {
+        sim_flash_done(FLASH_SR_WRPERR);
+    } else {
+        sim_flash_erase(FLASH_SECTOR_OFFSET(snb), FLASH_SECTOR_SIZE(snb));
+        sim_flash_done(FLASH_SR_EOP);
+    }
+}
+
+static void sim_flash_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    flash_regs_t *f = p->regs;
+
+    switch (off) {
+    case 0x04:
+        if (sim_flash.keys == 0u && val == FLASH_KEY1) {
+            sim_flash.keys = 1u;
+        } else if (sim_flash.keys == 1u && val == FLASH_KEY2) {
+            sim_flash.keys = 2u;
+            f->CR &= ~FLASH_CR_LOCK;
+        } else {
+            sim_flash.keys = 3u;
+            f->CR |= FLASH_CR_LOCK;
+        }
+        break;
+    case 0x10:
+        if ((old & FLASH_CR_LOCK) != 0u) {
+            f->CR = old;
+            break;
+        }
+        if ((val & FLASH_CR_LOCK) != 0u) {
+            sim_flash.keys = 0u;
+            sim_flash.half = false;
+        }
+        if ((val & FLASH_CR_STRT) != 0u) {
+            sim_flash_start(val);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void sim_flash_reset(sim_periph_t *p)
+{
+    (void)p;
+    memset(&sim_flash, 0, sizeof(sim_flash));
+}
+
+const sim_model_t sim_model_flash = {
+    .regs = sim_flash_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_flash_regs),
+    .write = sim_flash_write,
+    .reset = sim_flash_reset,
+};
+
+/* ------------------------------------------------------------------------ */
+/* Memory array                                                             */
+/* ------------------------------------------------------------------------ */
+
+static void sim_flashmem_program(uint32_t off, uint32_t val)
+{
+    stm32_host_FLASHMEM.W[off / 4u] &= val;
+}
+
+static void sim_flashmem_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    uint32_t cr = stm32_host_FLASH.CR;
+    uint32_t psize = reg_field_get(cr, FLASH_CR_PSIZE);
+
+    (void)p;
+    /* Nothing reaches the array but what programming lets through. */
+    stm32_host_FLASHMEM.W[off / 4u] = old;
+
+    if ((cr & (FLASH_CR_LOCK | FLASH_CR_PG)) != FLASH_CR_PG ||
+        (cr & (FLASH_CR_SER | FLASH_CR_MER)) != 0u) {
+        sim_flash_done(SIM_FLASH_SEQERR);
+        return;
+    }
+    if (psize < FLASH_PSIZE_X32) {
+        sim_flash_done(FLASH_SR_PGPERR);
+        return;
+    }
+    if (psize == FLASH_PSIZE_X32) {
+        sim_flashmem_program(off, val);
+        sim_flash_done(FLASH_SR_EOP);
+        return;
+    }
+
+    if (!sim_flash.half) {
+        if ((off & 7u) != 0u) {
+            sim_flash_done(FLASH_SR_PGAERR);
+            return;
+        }
+        sim_flash.half = true;
+        sim_flash.half_off = off;
+        sim_flash.half_val = val;
+        return;
+    }
+    sim_flash.half = false;
+    if (off != sim_flash.half_off + 4u) {
+        sim_flash_done(FLASH_SR_PGAERR);
+        return;
+    }
+    sim_flashmem_program(sim_flash.half_off, sim_flash.half_val);
+    sim_flashmem_program(off, val);
+    sim_flash_done(FLASH_SR_EOP);
+}
+
+static void sim_flashmem_reset(sim_periph_t *p)
+{
+    memset(p->regs, 0xFF, p->size);
+}
+
+const sim_model_t sim_model_flashmem = {
+    .write = sim_flashmem_write,
+    .reset = sim_flashmem_reset,
+};
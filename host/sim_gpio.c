@@ -0,0 +1,116 @@
+/**
+ * @file    sim_gpio.c
+ * @brief   GPIO register model.
+ *
+ * BSRR is write-only and updates ODR atomically.  IDR is read-only and
+ * reflects ODR for pins in output mode and the externally driven level
+ * (sim_gpio_set_input()) for every other pin.
+ */
+#include "sim.h"
+
+#define SIM_GPIO_PORTS  9u
+
+static const sim_reg_t sim_gpio_regs[] = {
+    { .offset = 0x10, .ro = 0xFFFFFFFFu },      /* IDR */
+    { .offset = 0x18, .sc = 0xFFFFFFFFu },      /* BSRR */
+};
+
+static uint16_t sim_gpio_ext[SIM_GPIO_PORTS];
+
+static struct {
+    sim_gpio_watch_t fn;
+    void *ctx;
+} sim_gpio_watchers[SIM_GPIO_PORTS];
+
+static uint32_t sim_gpio_index(const sim_periph_t *p)
+{
+    return (p->base - GPIOA_BASE) / 0x400u;
+}
+
+static uint32_t sim_gpio_output_mask(const gpio_regs_t *g)
+{
+    uint32_t out = 0;
+    uint32_t n;
+
+    for (n = 0; n < 16u; n++) {
+        if (reg_field_get(g->MODER, GPIO_MODER_MODE(n)) == GPIO_MODE_OUTPUT) {
+            out |= 1u << n;
+        }
+    }
+    return out;
+}
+
+static void sim_gpio_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    gpio_regs_t *g = p->regs;
+    uint32_t i = sim_gpio_index(p);
+    uint16_t prev = (uint16_t)g->ODR;
+
+    (void)old;
+    if (off == 0x18u) {
+        /* Set wins over reset when both bits are written. */
+        g->ODR = ((g->ODR & ~(val >> 16)) | val) & 0xFFFFu;
+    } else if (off == 0x14u) {
+        g->ODR = val & 0xFFFFu;
+    } else {
+        return;
+    }
+    if (sim_gpio_watchers[i].fn != NULL && g->ODR != prev) {
+        sim_gpio_watchers[i].fn(sim_gpio_watchers[i].ctx, g, prev, (uint16_t)g->ODR);
+    }
+}
+
+static uint32_t sim_gpio_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    gpio_regs_t *g = p->regs;
+    uint32_t out;
+
+    if (off != 0x10u) {
+        return val;
+    }
+    out = sim_gpio_output_mask(g);
+    g->IDR = (g->ODR & out) | (sim_gpio_ext[sim_gpio_index(p)] & ~out);
+    return g->IDR;
+}
+
+static void sim_gpio_reset(sim_periph_t *p)
+{
+    gpio_regs_t *g = p->regs;
+
+    sim_gpio_ext[sim_gpio_index(p)] = 0;
+    sim_gpio_watchers[sim_gpio_index(p)].fn = NULL;
+    /* Debug pins come out of reset in alternate function mode. */
+    if (p->base == GPIOA_BASE) {
+        g->MODER = 0xA8000000u;
+        g->OSPEEDR = 0x0C000000u;
+        g->PUPDR = 0x64000000u;
+    } else if (p->base == GPIOB_BASE) {
+        g->MODER = 0x00000280u;
+        g->OSPEEDR = 0x000000C0u;
+        g->PUPDR = 0x00000100u;
+    }
+}
+
+const sim_model_t sim_model_gpio = {
+    .regs = sim_gpio_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_gpio_regs),
+    .write = sim_gpio_write,
+    .read = sim_gpio_read,
+    .reset = sim_gpio_reset,
+};
+
+void sim_gpio_set_input(gpio_regs_t *port, uint16_t mask, uint16_t level)
+{
+    sim_periph_t *p = sim_find(port);
+    uint32_t i = sim_gpio_index(p);
+
+    sim_gpio_ext[i] = (uint16_t)((sim_gpio_ext[i] & ~mask) | (level & mask));
+}
+
+void sim_gpio_watch(gpio_regs_t *port, sim_gpio_watch_t fn, void *ctx)
+{
+    uint32_t i = sim_gpio_index(sim_find(port));
+
+    sim_gpio_watchers[i].fn = fn;
+    sim_gpio_watchers[i].ctx = ctx;
+}
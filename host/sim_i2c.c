@@ -0,0 +1,374 @@
+/**
+ * @file    sim_i2c.c
+ * @brief   I2C master model with attachable targets.
+ *
+ * Bus conditions and bytes take no time.  A START (CR1.START with PE set
+ * and the bus free) sets SB; the address byte written to DR goes to the
+ * target at that address, whose ACK sets ADDR and whose NACK (or no target)
+ * sets AF.  ADDR clears on an SR1 read followed by an SR2 read.
+ *
+ * Transmitter: every DR write is sent at once, so TXE and BTF are set again
+ * right away; a NACKed byte sets AF.  Receiver: a byte is clocked in when
+ * ADDR clears and again after each DR read, as long as the previous byte was
+ * ACKed.  A byte is ACKed while CR1.ACK is set, except the one that ends the
+ * RX stream when CR2.DMAEN and CR2.LAST are set.  CR1.STOP ends the
+ * transfer.
+ *
+ * Event and error interrupts follow the flags and the CR2 enables after
+ * every register write and bus event.  TXE/RXNE raise DMA requests while
+ * CR2.DMAEN is set.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_I2C_COUNT       3u
+#define SIM_I2C_TARGETS     4u
+
+enum {
+    SIM_I2C_IDLE = 0,
+    SIM_I2C_SB,         /* START sent, address byte expected. */
+    SIM_I2C_TX,
+    SIM_I2C_RX,
+    SIM_I2C_HALT,       /* NACK or error: nothing until STOP/START. */
+};
+
+typedef struct {
+    uint32_t base;
+    irqn_t ev_irqn;
+    irqn_t er_irqn;
+    sim_dreq_t rx_req;
+    sim_dreq_t tx_req;
+} sim_i2c_info_t;
+
+typedef struct {
+    uint8_t addr;
+    const sim_i2c_target_t *t;
+    void *ctx;
+} sim_i2c_slot_t;
+
+typedef struct {
+    sim_i2c_slot_t slots[SIM_I2C_TARGETS];
+    uint32_t nslots;
+    const sim_i2c_slot_t *cur;  /**< Addressed target. */
+    uint8_t phase;
+    bool sr1_read;              /**< SR1 read since ADDR was set. */
+    bool acked;                 /**< Last received byte was ACKed. */
+    gpio_regs_t *scl_port;
+    gpio_regs_t *sda_port;
+    uint8_t scl_pin;
+    uint8_t sda_pin;
+    uint32_t stuck;             /**< SCL edges until SDA is released. */
+    uint32_t pulses;
+} sim_i2c_state_t;
+
+static const sim_i2c_info_t sim_i2c_info[SIM_I2C_COUNT] = {
+    { I2C1_BASE, I2C1_EV_IRQn, I2C1_ER_IRQn, SIM_DREQ_I2C1_RX, SIM_DREQ_I2C1_TX },
+    { I2C2_BASE, I2C2_EV_IRQn, I2C2_ER_IRQn, SIM_DREQ_I2C2_RX, SIM_DREQ_I2C2_TX },
+    { I2C3_BASE, I2C3_EV_IRQn, I2C3_ER_IRQn, SIM_DREQ_I2C3_RX, SIM_DREQ_I2C3_TX },
+};
+
+static sim_i2c_state_t sim_i2c_state[SIM_I2C_COUNT];
+
+static const sim_reg_t sim_i2c_regs[] = {
+    { .offset = 0x00, .sc = I2C_CR1_START | I2C_CR1_STOP },             /* CR1 */
+    { .offset = 0x14, .ro = ~I2C_SR1_ERRORS, .w0c = I2C_SR1_ERRORS },    /* SR1 */
+    { .offset = 0x18, .ro = 0xFFFFFFFFu },                              /* SR2 */
+    { .offset = 0x20, .reset = 0x0002u },                               /* TRISE */
+};
+
+static uint32_t sim_i2c_index(const sim_periph_t *p)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_I2C_COUNT; i++) {
+        if (sim_i2c_info[i].base == p->base) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void sim_i2c_update_irq(const i2c_regs_t *i2c, uint32_t i)
+{
+    uint32_t sr1 = i2c->SR1;
+    uint32_t cr2 = i2c->CR2;
+    const uint32_t ev = I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_STOPF | I2C_SR1_ADD10;
+    const uint32_t buf = I2C_SR1_TXE | I2C_SR1_RXNE;
+
+    if ((cr2 & I2C_CR2_ITEVTEN) != 0u &&
+        ((sr1 & ev) != 0u || ((sr1 & buf) != 0u && (cr2 & I2C_CR2_ITBUFEN) != 0u))) {
+        sim_irq_raise(sim_i2c_info[i].ev_irqn);
+    }
+    if ((cr2 & I2C_CR2_ITERREN) != 0u && (sr1 & I2C_SR1_ERRORS) != 0u) {
+        sim_irq_raise(sim_i2c_info[i].er_irqn);
+    }
+}
+
+static void sim_i2c_error(i2c_regs_t *i2c, sim_i2c_state_t *st, uint32_t flag)
+{
+    i2c->SR1 |= flag;
+    st->phase = SIM_I2C_HALT;
+}
+
+/* Clock in one byte from the addressed target. */
+static void sim_i2c_rx(i2c_regs_t *i2c, uint32_t i)
+{
+    sim_i2c_state_t *st = &sim_i2c_state[i];
+    const sim_i2c_target_t *t = st->cur->t;
+    const uint32_t last = I2C_CR2_DMAEN | I2C_CR2_LAST;
+    bool ack = (i2c->CR1 & I2C_CR1_ACK) != 0u;
+
+    if ((i2c->CR2 & last) == last && sim_dma_remaining(sim_i2c_info[i].rx_req) == 1u) {
+        ack = false;
+    }
+    i2c->DR = (t->read != NULL) ? t->read(st->cur->ctx) : 0xFFu;
+    i2c->SR1 |= I2C_SR1_RXNE;
+    st->acked = ack;
+    if ((i2c->CR2 & I2C_CR2_DMAEN) != 0u) {
+        sim_dma_request(sim_i2c_info[i].rx_req);
+    }
+}
+
+static void sim_i2c_address(i2c_regs_t *i2c, uint32_t i, uint8_t byte)
+{
+    sim_i2c_state_t *st = &sim_i2c_state[i];
+    bool rd = (byte & 1u) != 0u;
+    uint32_t n;
+
+    st->cur = NULL;
+    for (n = 0; n < st->nslots; n++) {
+        if (st->slots[n].addr == (byte >> 1)) {
+            st->cur = &st->slots[n];
+        }
+    }
+    if (st->cur == NULL ||
+        (st->cur->t->start != NULL && !st->cur->t->start(st->cur->ctx, rd))) {
+        sim_i2c_error(i2c, st, I2C_SR1_AF);
+        return;
+    }
+    i2c->SR1 |= I2C_SR1_ADDR;
+    i2c->SR2 = (i2c->SR2 & ~I2C_SR2_TRA) | (rd ? 0u : I2C_SR2_TRA);
+    st->phase = rd ? SIM_I2C_RX : SIM_I2C_TX;
+    st->sr1_read = false;
+}
+
+static void sim_i2c_tx(i2c_regs_t *i2c, uint32_t i, uint8_t byte)
+{
+    sim_i2c_state_t *st = &sim_i2c_state[i];
+    const sim_i2c_target_t *t = st->cur->t;
+
+    i2c->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+    if (t->write != NULL && !t->write(st->cur->ctx, byte)) {
+        sim_i2c_error(i2c, st, I2C_SR1_AF);
+        return;
+    }
+    i2c->SR1 |= I2C_SR1_TXE | I2C_SR1_BTF;
+    if ((i2c->CR2 & I2C_CR2_DMAEN) != 0u) {
+        sim_dma_request(sim_i2c_info[i].tx_req);
+    }
+}
+
+static void sim_i2c_stop(i2c_regs_t *i2c, sim_i2c_state_t *st)
+{
+    if (st->cur != NULL && st->cur->t->stop != NULL) {
+        st->cur->t->stop(st->cur->ctx);
+    }
+    st->cur = NULL;
+    st->phase = SIM_I2C_IDLE;
+    i2c->SR1 &= ~(I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_TXE);
+    i2c->SR2 &= ~(I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+    if (st->stuck != 0u) {
+        i2c->SR2 |= I2C_SR2_BUSY;
+    }
+}
+
+static void sim_i2c_cr1(i2c_regs_t *i2c, uint32_t i, uint32_t val)
+{
+    sim_i2c_state_t *st = &sim_i2c_state[i];
+
+    if ((val & I2C_CR1_SWRST) != 0u || (val & I2C_CR1_PE) == 0u) {
+        /* Held in reset / disabled: the logic forgets the transfer. */
+        if ((val & I2C_CR1_SWRST) != 0u) {
+            i2c->CR2 = 0;
+            i2c->CCR = 0;
+            i2c->TRISE = 0x0002u;
+        }
+        st->cur = NULL;
+        st->phase = SIM_I2C_IDLE;
+        i2c->SR1 = 0;
+        i2c->SR2 = (st->stuck != 0u) ? I2C_SR2_BUSY : 0u;
+        return;
+    }
+    if ((val & I2C_CR1_STOP) != 0u) {
+        sim_i2c_stop(i2c, st);
+    }
+    if ((val & I2C_CR1_START) != 0u && st->stuck == 0u) {
+        st->phase = SIM_I2C_SB;
+        i2c->SR1 = (i2c->SR1 & ~(I2C_SR1_BTF | I2C_SR1_TXE)) | I2C_SR1_SB;
+        i2c->SR2 |= I2C_SR2_MSL | I2C_SR2_BUSY;
+    }
+}
+
+static void sim_i2c_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    i2c_regs_t *i2c = p->regs;
+    uint32_t i = sim_i2c_index(p);
+    sim_i2c_state_t *st = &sim_i2c_state[i];
+
+    if (off == 0x00u) {
+        sim_i2c_cr1(i2c, i, val);
+    } else if (off == 0x04u) {
+        if ((val & I2C_CR2_DMAEN) == 0u) {
+            sim_dma_release(sim_i2c_info[i].rx_req);
+            sim_dma_release(sim_i2c_info[i].tx_req);
+        } else if ((old & I2C_CR2_DMAEN) == 0u) {
+            if (st->phase == SIM_I2C_TX && (i2c->SR1 & (I2C_SR1_TXE | I2C_SR1_ADDR)) == I2C_SR1_TXE) {
+                sim_dma_request(sim_i2c_info[i].tx_req);
+            } else if ((i2c->SR1 & I2C_SR1_RXNE) != 0u) {
+                sim_dma_request(sim_i2c_info[i].rx_req);
+            }
+        }
+    } else if (off == 0x10u) {
+        if (st->phase == SIM_I2C_SB && (i2c->SR1 & I2C_SR1_SB) != 0u) {
+            i2c->SR1 &= ~I2C_SR1_SB;
+            sim_i2c_address(i2c, i, (uint8_t)val);
+        } else if (st->phase == SIM_I2C_TX && (i2c->SR1 & I2C_SR1_ADDR) == 0u) {
+            sim_i2c_tx(i2c, i, (uint8_t)val);
+        }
+    }
+    sim_i2c_update_irq(i2c, i);
+}
+
+static uint32_t sim_i2c_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    i2c_regs_t *i2c = p->regs;
+    uint32_t i = sim_i2c_index(p);
+    sim_i2c_state_t *st = &sim_i2c_state[i];
+
+    if (off == 0x14u) {
+        st->sr1_read = true;
+    } else if (off == 0x18u && st->sr1_read && (i2c->SR1 & I2C_SR1_ADDR) != 0u) {
+        /* ADDR cleared: SCL released, the data phase begins. */
+        i2c->SR1 &= ~I2C_SR1_ADDR;
+        st->sr1_read = false;
+        if (st->phase == SIM_I2C_TX) {
+            i2c->SR1 |= I2C_SR1_TXE;
+            if ((i2c->CR2 & I2C_CR2_DMAEN) != 0u) {
+                sim_dma_request(sim_i2c_info[i].tx_req);
+            }
+        } else if (st->phase == SIM_I2C_RX) {
+            sim_i2c_rx(i2c, i);
+        }
+        sim_i2c_update_irq(i2c, i);
+    } else if (off == 0x10u && (i2c->SR1 & I2C_SR1_RXNE) != 0u) {
+        i2c->SR1 &= ~I2C_SR1_RXNE;
+        sim_dma_release(sim_i2c_info[i].rx_req);
+        if (st->phase == SIM_I2C_RX && st->acked) {
+            sim_i2c_rx(i2c, i);
+            sim_i2c_update_irq(i2c, i);
+        }
+    }
+    return val;
+}
+
+static void sim_i2c_reset(sim_periph_t *p)
+{
+    memset(&sim_i2c_state[sim_i2c_index(p)], 0, sizeof(sim_i2c_state[0]));
+}
+
+const sim_model_t sim_model_i2c = {
+    .regs = sim_i2c_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_i2c_regs),
+    .write = sim_i2c_write,
+    .read = sim_i2c_read,
+    .reset = sim_i2c_reset,
+};
+
+static sim_i2c_state_t *sim_i2c_find(i2c_regs_t *i2c)
+{
+    return &sim_i2c_state[sim_i2c_index(sim_find(i2c))];
+}
+
+void sim_i2c_attach(i2c_regs_t *i2c, uint8_t addr, const sim_i2c_target_t *target,
+                    void *ctx)
+{
+    sim_i2c_state_t *st = sim_i2c_find(i2c);
+
+    if (st->nslots < SIM_I2C_TARGETS) {
+        st->slots[st->nslots++] = (sim_i2c_slot_t){ addr, target, ctx };
+    }
+}
+
+/* SDA follows the stuck target; released it floats high (pull-up). */
+static void sim_i2c_sda(const sim_i2c_state_t *st)
+{
+    uint16_t pin = (uint16_t)(1u << st->sda_pin);
+
+    sim_gpio_set_input(st->sda_port, pin, (st->stuck != 0u) ? 0u : pin);
+}
+
+static void sim_i2c_scl(void *ctx, gpio_regs_t *port, uint16_t old, uint16_t odr)
+{
+    sim_i2c_state_t *st = ctx;
+    uint16_t pin = (uint16_t)(1u << st->scl_pin);
+    i2c_regs_t *i2c = (i2c_regs_t *)sim_find_base(sim_i2c_info[st - sim_i2c_state].base)->regs;
+
+    /* Only edges the pin actually drives (output mode) clock the bus. */
+    if (reg_field_get(port->MODER, GPIO_MODER_MODE(st->scl_pin)) != GPIO_MODE_OUTPUT ||
+        (old & pin) != 0u || (odr & pin) == 0u) {
+        return;
+    }
+    st->pulses++;
+    if (st->stuck != 0u && --st->stuck == 0u) {
+        sim_i2c_sda(st);
+        i2c->SR2 &= ~I2C_SR2_BUSY;
+    }
+}
+
+void sim_i2c_wire(i2c_regs_t *i2c, gpio_regs_t *scl_port, uint8_t scl_pin,
+                  gpio_regs_t *sda_port, uint8_t sda_pin)
+{
+    sim_i2c_state_t *st = sim_i2c_find(i2c);
+
+    st->scl_port = scl_port;
+    st->scl_pin = scl_pin;
+    st->sda_port = sda_port;
+    st->sda_pin = sda_pin;
+    st->pulses = 0;
+    sim_gpio_set_input(scl_port, (uint16_t)(1u << scl_pin), (uint16_t)(1u << scl_pin));
+    sim_i2c_sda(st);
+    sim_gpio_watch(scl_port, sim_i2c_scl, st);
+}
+
+void sim_i2c_stuck(i2c_regs_t *i2c, uint32_t clocks)
+{
+    sim_i2c_state_t *st = sim_i2c_find(i2c);
+
+    st->stuck = clocks;
+    if (st->sda_port != NULL) {
+        sim_i2c_sda(st);
+    }
+    if (clocks != 0u) {
+        i2c->SR2 |= I2C_SR2_BUSY;
+    }
+}
+
+uint32_t sim_i2c_scl_pulses(i2c_regs_t *i2c)
+{
+    return sim_i2c_find(i2c)->pulses;
+}
+
+void sim_i2c_fault(i2c_regs_t *i2c, uint32_t sr1)
+{
+    sim_periph_t *p = sim_find(i2c);
+    uint32_t i = sim_i2c_index(p);
+
+    sim_i2c_error(i2c, &sim_i2c_state[i], sr1 & I2C_SR1_ERRORS);
+    if ((sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO)) != 0u) {
+        /* No longer master. */
+        sim_i2c_state[i].cur = NULL;
+        i2c->SR2 &= ~(I2C_SR2_MSL | I2C_SR2_TRA);
+    }
+    sim_i2c_update_irq(i2c, i);
+}
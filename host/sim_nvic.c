@@ -0,0 +1,183 @@
+/**
+ * @file    sim_nvic.c
+ * @brief   Nested vectored interrupt controller model.
+ *
+ * ISER/ICER and ISPR/ICPR are write-1 set/clear views of the enable and
+ * pending state; pending is the simulator's interrupt line state
+ * (sim_irq_raise()/sim_irq_take()), so lines models raise show up in ISPR.
+ * IPR is plain storage.
+ *
+ * Once a line is enabled and VTOR points at a table (a simulator bus
+ * address), a pending line is taken as soon as no register write is in
+ * progress: its table entry is called synchronously, IABR shows it active,
+ * and only lines of a strictly lower preemption level (SCB AIRCR.PRIGROUP)
+ * are taken from inside it.  Lines pended by the handler that cannot
+ * preempt it are taken after it returns, lowest priority byte (then lowest
+ * number) first.  Lines never enabled stay pending for the tests to take,
+ * as before this model existed.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_NVIC_WORDS      ((STM32_IRQ_COUNT + 31) / 32)
+#define SIM_NVIC_THREAD     0x100u  /* Below every preemption level. */
+
+typedef void (*sim_vector_t)(void);
+
+static uint32_t sim_nvic_enabled[SIM_NVIC_WORDS];
+static uint32_t sim_nvic_active[SIM_NVIC_WORDS];
+static uint32_t sim_nvic_level = SIM_NVIC_THREAD;
+
+static uint32_t sim_nvic_prio(const nvic_regs_t *nvic, uint32_t n)
+{
+    return (nvic->IPR[n / 4u] >> (8u * (n % 4u))) & 0xFFu;
+}
+
+static uint32_t sim_nvic_preempt(uint32_t prio)
+{
+    return prio >> (reg_field_get(SCB->AIRCR, SCB_AIRCR_PRIGROUP) + 1u);
+}
+
+static bool sim_nvic_any_enabled(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_NVIC_WORDS; i++) {
+        if (sim_nvic_enabled[i] != 0u) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void sim_nvic_kick(void)
+{
+    const nvic_regs_t *nvic = NVIC;
+
+    while (sim_nvic_any_enabled()) {
+        const sim_vector_t *table = sim_bus_ptr(SCB->VTOR);
+        uint32_t best = STM32_IRQ_COUNT;
+        uint32_t best_prio = 0x100u;
+        uint32_t saved;
+        uint32_t n;
+
+        if (table == NULL) {
+            return;
+        }
+        for (n = 0; n < (uint32_t)STM32_IRQ_COUNT; n++) {
+            uint32_t bit = 1u << (n % 32u);
+
+            if ((sim_nvic_enabled[n / 32u] & bit) != 0u &&
+                (sim_nvic_active[n / 32u] & bit) == 0u &&
+                sim_irq_pending((irqn_t)n) && sim_nvic_prio(nvic, n) < best_prio) {
+                best = n;
+                best_prio = sim_nvic_prio(nvic, n);
+            }
+        }
+        if (best == STM32_IRQ_COUNT || sim_nvic_preempt(best_prio) >= sim_nvic_level) {
+            return;
+        }
+        (void)sim_irq_take((irqn_t)best);
+        sim_nvic_active[best / 32u] |= 1u << (best % 32u);
+        saved = sim_nvic_level;
+        sim_nvic_level = sim_nvic_preempt(best_prio);
+        table[16u + best]();
+        sim_nvic_level = saved;
+        sim_nvic_active[best / 32u] &= ~(1u << (best % 32u));
+    }
+}
+
+static void sim_nvic_pend(uint32_t word, uint32_t bits)
+{
+    uint32_t b;
+
+    for (b = 0; b < 32u; b++) {
+        if ((bits & (1u << b)) != 0u && word * 32u + b < (uint32_t)STM32_IRQ_COUNT) {
+            sim_irq_raise((irqn_t)(word * 32u + b));
+        }
+    }
+}
+
+static void sim_nvic_unpend(uint32_t word, uint32_t bits)
+{
+    uint32_t b;
+
+    for (b = 0; b < 32u; b++) {
+        if ((bits & (1u << b)) != 0u && word * 32u + b < (uint32_t)STM32_IRQ_COUNT) {
+            (void)sim_irq_take((irqn_t)(word * 32u + b));
+        }
+    }
+}
+
+static void sim_nvic_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    uint32_t *reg = (uint32_t *)((uint8_t *)p->regs + off);
+    uint32_t w = (off % 0x80u) / 4u;
+
+    (void)old;
+    if (off >= 0x300u || w >= SIM_NVIC_WORDS) {
+        return;
+    }
+    switch (off / 0x80u) {
+    case 0:
+        sim_nvic_enabled[w] |= val;
+        break;
+    case 1:
+        sim_nvic_enabled[w] &= ~val;
+        break;
+    case 2:
+        sim_nvic_pend(w, val);
+        break;
+    case 3:
+        sim_nvic_unpend(w, val);
+        break;
+    default:
+        break;
+    }
+    /* Views of model state: nothing is stored. */
+    *reg = 0u;
+}
+
+static uint32_t sim_nvic_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    uint32_t w = (off % 0x80u) / 4u;
+    uint32_t pending = 0;
+    uint32_t b;
+
+    (void)p;
+    if (off >= 0x300u || w >= SIM_NVIC_WORDS) {
+        return val;
+    }
+    switch (off / 0x80u) {
+    case 0:
+    case 1:
+        return sim_nvic_enabled[w];
+    case 2:
+    case 3:
+        for (b = 0; b < 32u && w * 32u + b < (uint32_t)STM32_IRQ_COUNT; b++) {
+            if (sim_irq_pending((irqn_t)(w * 32u + b))) {
+                pending |= 1u << b;
+            }
+        }
+        return pending;
+    case 4:
+        return sim_nvic_active[w];
+    default:
+        return val;
+    }
+}
+
+static void sim_nvic_reset(sim_periph_t *p)
+{
+    (void)p;
+    memset(sim_nvic_enabled, 0, sizeof(sim_nvic_enabled));
+    memset(sim_nvic_active, 0, sizeof(sim_nvic_active));
+    sim_nvic_level = SIM_NVIC_THREAD;
+}
+
+const sim_model_t sim_model_nvic = {
+    .write = sim_nvic_write,
+    .read = sim_nvic_read,
+    .reset = sim_nvic_reset,
+};
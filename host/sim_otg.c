@@ -0,0 +1,512 @@
+/**
+ * @file    sim_otg.c
+ * @brief   USB OTG_FS device-mode model: FIFOs, endpoint transfers and the
+ *          host side of the bus.
+ *
+ * The receive FIFO is a queue of status entries, each followed by its data
+ * words; popping GRXSTSP makes an entry current and FIFO window reads take
+ * its data.  Popping an OUT-transfer-complete entry sets DOEPINT.XFRC, and
+ * popping a SETUP-done entry sets DOEPINT.STUP, as on the real core.  Each
+ * IN endpoint has its own word FIFO sized by DIEPTXFx; an IN token is
+ * answered only once the whole packet is in it.  FIFO space is accounted
+ * in words against GRXFSIZ and DIEPTXFx, so FIFO sizing mistakes show.
+ * Interrupt lines are levels, re-raised after every register access while
+ * a masked-in GINTSTS bit is set.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_OTG_RX_ENTRIES  32u
+#define SIM_OTG_PKT_MAX     64u         /* Full-speed bulk/control packets. */
+
+#define SIM_OTG_OFF(reg)    ((uint32_t)offsetof(otg_regs_t, reg))
+#define SIM_OTG_FIFO_OFF    SIM_OTG_OFF(FIFO)
+
+#define SIM_OTG_GINT_W1C    (OTG_GINT_MMIS | OTG_GINT_SOF | OTG_GINT_ESUSP |          \
+                             OTG_GINT_USBSUSP | OTG_GINT_USBRST | OTG_GINT_ENUMDNE |  \
+                             REG_MASK(14u, 2u) | REG_MASK(20u, 2u) | REG_MASK(28u, 4u))
+#define SIM_OTG_EPCTL_SC    (OTG_EPCTL_CNAK | OTG_EPCTL_SNAK | OTG_EPCTL_SD0PID |     \
+                             OTG_EPCTL_SODDFRM)
+
+typedef struct {
+    uint32_t sts;
+    uint32_t data[SIM_OTG_PKT_MAX / 4u];
+    uint32_t words;
+} sim_otg_rx_t;
+
+typedef struct {
+    sim_otg_rx_t rx[SIM_OTG_RX_ENTRIES];
+    uint32_t rx_head;
+    uint32_t rx_count;
+    uint32_t rx_used;               /* FIFO words held, current entry included. */
+    sim_otg_rx_t cur;               /* Entry popped through GRXSTSP. */
+    uint32_t cur_pos;
+    uint32_t tx[OTG_FS_EP_COUNT][OTG_FS_FIFO_WORDS];
+    uint32_t tx_head[OTG_FS_EP_COUNT];
+    uint32_t tx_count[OTG_FS_EP_COUNT];
+    bool attached;
+    uint8_t addr;                   /* Address the device answers to. */
+    bool addr_pending;              /* DCFG.DAD changed, not yet in effect. */
+    uint8_t host_addr;
+    uint32_t fifo_errors;
+} sim_otg_state_t;
+
+static sim_otg_state_t sim_otg_state;
+
+#define SIM_OTG_EP_REGS(n)                                                  \
+    { .offset = 0x900 + 0x20 * (n), .ro = OTG_EPCTL_NAKSTS,                 \
+      .sc = SIM_OTG_EPCTL_SC },                                 /* DIEPCTL */ \
+    { .offset = 0x908 + 0x20 * (n), .reset = OTG_EPINT_TXFE,                \
+      .ro = OTG_EPINT_TXFE, .w1c = ~OTG_EPINT_TXFE },           /* DIEPINT */ \
+    { .offset = 0x918 + 0x20 * (n), .ro = 0xFFFFFFFFu },        /* DTXFSTS */ \
+    { .offset = 0xB00 + 0x20 * (n), .ro = OTG_EPCTL_NAKSTS,                 \
+      .sc = SIM_OTG_EPCTL_SC },                                 /* DOEPCTL */ \
+    { .offset = 0xB08 + 0x20 * (n), .w1c = 0xFFFFFFFFu }        /* DOEPINT */
+
+static const sim_reg_t sim_otg_regs[] = {
+    { .offset = 0x00C, .reset = 0x00001400u | OTG_GUSBCFG_PHYSEL,
+      .ro = OTG_GUSBCFG_PHYSEL },                               /* GUSBCFG */
+    { .offset = 0x010, .reset = OTG_GRSTCTL_AHBIDL, .ro = OTG_GRSTCTL_AHBIDL,
+      .sc = OTG_GRSTCTL_CSRST | OTG_GRSTCTL_RXFFLSH | OTG_GRSTCTL_TXFFLSH },
+    { .offset = 0x014, .reset = 0x04000020u,
+      .ro = ~SIM_OTG_GINT_W1C, .w1c = SIM_OTG_GINT_W1C },       /* GINTSTS */
+    { .offset = 0x01C, .ro = 0xFFFFFFFFu },                     /* GRXSTSR */
+    { .offset = 0x020, .ro = 0xFFFFFFFFu },                     /* GRXSTSP */
+    { .offset = 0x024, .reset = 0x00000200u },                  /* GRXFSIZ */
+    { .offset = 0x028, .reset = 0x00000200u },                  /* DIEPTXF0 */
+    { .offset = 0x03C, .reset = 0x00001200u },                  /* CID */
+    { .offset = 0x104, .reset = 0x02000400u },                  /* DIEPTXF1 */
+    { .offset = 0x108, .reset = 0x02000400u },
+    { .offset = 0x10C, .reset = 0x02000400u },
+    { .offset = 0x800, .reset = 0x02200000u },                  /* DCFG */
+    { .offset = 0x804, .reset = OTG_DCTL_SDIS,
+      .sc = OTG_DCTL_SGINAK | OTG_DCTL_CGINAK | OTG_DCTL_SGONAK | OTG_DCTL_CGONAK },
+    { .offset = 0x808, .reset = 0x00000010u, .ro = 0xFFFFFFFFu }, /* DSTS */
+    { .offset = 0x818, .ro = 0xFFFFFFFFu },                     /* DAINT */
+    SIM_OTG_EP_REGS(0),
+    SIM_OTG_EP_REGS(1),
+    SIM_OTG_EP_REGS(2),
+    SIM_OTG_EP_REGS(3),
+#if OTG_FS_EP_COUNT > 4
+    { .offset = 0x110, .reset = 0x02000400u },                  /* DIEPTXF4 */
+    { .offset = 0x114, .reset = 0x02000400u },
+    SIM_OTG_EP_REGS(4),
+    SIM_OTG_EP_REGS(5),
+#endif
+};
+
+static uint32_t sim_otg_tx_depth(const otg_regs_t *c, uint32_t ep)
+{
+    uint32_t f = (ep == 0u) ? c->DIEPTXF0 : c->DIEPTXF[ep - 1u];
+    uint32_t depth = reg_field_get(f, OTG_TXF_DEPTH);
+
+    return (depth < OTG_FS_FIFO_WORDS) ? depth : OTG_FS_FIFO_WORDS;
+}
+
+static uint32_t sim_otg_mps(uint32_t ctl, uint32_t ep)
+{
+    static const uint8_t ep0[4] = { 64u, 32u, 16u, 8u };
+
+    if (ep == 0u) {
+        return ep0[reg_field_get(ctl, OTG_EPCTL_MPSIZ_EP0)];
+    }
+    return reg_field_get(ctl, OTG_EPCTL_MPSIZ);
+}
+
+/* Recompute the derived status bits and raise the interrupt level. */
+static void sim_otg_update(otg_regs_t *c)
+{
+    sim_otg_state_t *st = &sim_otg_state;
+    uint32_t daint = 0;
+    uint32_t gint;
+    uint32_t ep;
+
+    for (ep = 0; ep < OTG_FS_EP_COUNT; ep++) {
+        uint32_t depth = sim_otg_tx_depth(c, ep);
+        uint32_t free = depth - st->tx_count[ep];
+        bool txfe = ((c->GAHBCFG & OTG_GAHBCFG_TXFELVL) != 0u) ? (st->tx_count[ep] == 0u)
+                                                               : (2u * free >= depth);
+
+        c->IEP[ep].TXFSTS = free;
+        c->IEP[ep].INT = txfe ? (c->IEP[ep].INT | OTG_EPINT_TXFE)
+                              : (c->IEP[ep].INT & ~OTG_EPINT_TXFE);
+        if ((c->IEP[ep].INT & c->DIEPMSK & ~OTG_EPINT_TXFE) != 0u ||
+            (txfe && (c->DIEPEMPMSK & REG_BIT(ep)) != 0u)) {
+            daint |= OTG_DAINT_IEP(ep);
+        }
+        if ((c->OEP[ep].INT & c->DOEPMSK) != 0u) {
+            daint |= OTG_DAINT_OEP(ep);
+        }
+    }
+    c->DAINT = daint;
+
+    gint = c->GINTSTS & ~(OTG_GINT_CMOD | OTG_GINT_RXFLVL | OTG_GINT_IEPINT | OTG_GINT_OEPINT);
+    if (st->rx_count != 0u) {
+        gint |= OTG_GINT_RXFLVL;
+    }
+    if ((daint & c->DAINTMSK & 0xFFFFu) != 0u) {
+        gint |= OTG_GINT_IEPINT;
+    }
+    if ((daint & c->DAINTMSK & 0xFFFF0000u) != 0u) {
+        gint |= OTG_GINT_OEPINT;
+    }
+    c->GINTSTS = gint;
+
+    if ((c->GAHBCFG & OTG_GAHBCFG_GINT) != 0u && (gint & c->GINTMSK) != 0u) {
+        sim_irq_raise(OTG_FS_IRQn);
+    }
+}
+
+static void sim_otg_rx_flush(sim_otg_state_t *st)
+{
+    st->rx_head = 0;
+    st->rx_count = 0;
+    st->rx_used = 0;
+    st->cur_pos = 0;
+    st->cur.words = 0;
+}
+
+static void sim_otg_tx_flush(sim_otg_state_t *st, uint32_t ep)
+{
+    st->tx_head[ep] = 0;
+    st->tx_count[ep] = 0;
+}
+
+static bool sim_otg_rx_fits(const otg_regs_t *c, const sim_otg_state_t *st,
+                            uint32_t entries, uint32_t words)
+{
+    return st->rx_count + entries <= SIM_OTG_RX_ENTRIES &&
+           st->rx_used + words <= reg_field_get(c->GRXFSIZ, OTG_GRXFSIZ_RXFD);
+}
+
+static void sim_otg_rx_push(sim_otg_state_t *st, uint32_t ep, uint32_t pktsts,
+                            const void *data, size_t len)
+{
+    sim_otg_rx_t *e = &st->rx[(st->rx_head + st->rx_count) % SIM_OTG_RX_ENTRIES];
+
+    e->sts = reg_field_prep(OTG_GRXSTS_EPNUM, ep) |
+             reg_field_prep(OTG_GRXSTS_BCNT, (uint32_t)len) |
+             reg_field_prep(OTG_GRXSTS_PKTSTS, pktsts);
+    memset(e->data, 0, sizeof(e->data));
+    if (len != 0u) {
+        memcpy(e->data, data, len);
+    }
+    e->words = ((uint32_t)len + 3u) / 4u;
+    st->rx_count++;
+    st->rx_used += 1u + e->words;
+}
+
+static uint32_t sim_otg_rx_pop(otg_regs_t *c, sim_otg_state_t *st)
+{
+    uint32_t ep;
+
+    if (st->rx_count == 0u) {
+        st->fifo_errors++;
+        return 0;
+    }
+    /* Data of the previous entry not read by now is lost. */
+    st->rx_used -= st->cur.words - st->cur_pos;
+    st->cur = st->rx[st->rx_head];
+    st->cur_pos = 0;
+    st->rx_head = (st->rx_head + 1u) % SIM_OTG_RX_ENTRIES;
+    st->rx_count--;
+    st->rx_used--;
+
+    ep = reg_field_get(st->cur.sts, OTG_GRXSTS_EPNUM);
+    switch (reg_field_get(st->cur.sts, OTG_GRXSTS_PKTSTS)) {
+    case OTG_PKTSTS_OUT_DONE:
+        c->OEP[ep].INT |= OTG_EPINT_XFRC;
+        break;
+    case OTG_PKTSTS_SETUP_DONE:
+        c->OEP[0].INT |= OTG_EPINT_STUP;
+        break;
+    default:
+        break;
+    }
+    return st->cur.sts;
+}
+
+/* Core soft reset: every register but the FIFO windows back to reset. */
+static void sim_otg_core_reset(otg_regs_t *c, sim_otg_state_t *st)
+{
+    size_t i;
+
+    memset((void *)c, 0, SIM_OTG_FIFO_OFF);
+    for (i = 0; i < STM32_ARRAY_SIZE(sim_otg_regs); i++) {
+        *(volatile uint32_t *)((uint8_t *)c + sim_otg_regs[i].offset) = sim_otg_regs[i].reset;
+    }
+    memset(st, 0, sizeof(*st));
+}
+
+static void sim_otg_ep_ctl(otg_ep_regs_t *r, uint32_t old, uint32_t val)
+{
+    if ((val & OTG_EPCTL_SNAK) != 0u) {
+        r->CTL |= OTG_EPCTL_NAKSTS;
+    }
+    if ((val & OTG_EPCTL_CNAK) != 0u) {
+        r->CTL &= ~OTG_EPCTL_NAKSTS;
+    }
+    if ((val & OTG_EPCTL_EPDIS) != 0u) {
+        r->CTL &= ~(OTG_EPCTL_EPDIS | OTG_EPCTL_EPENA);
+        if ((old & OTG_EPCTL_EPENA) != 0u) {
+            r->INT |= OTG_EPINT_EPDISD;
+        }
+    }
+}
+
+static void sim_otg_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    otg_regs_t *c = p->regs;
+    sim_otg_state_t *st = &sim_otg_state;
+    uint32_t ep;
+
+    if (off >= SIM_OTG_FIFO_OFF) {
+        ep = (off - SIM_OTG_FIFO_OFF) / sizeof(c->FIFO[0]);
+        if (st->tx_count[ep] < sim_otg_tx_depth(c, ep)) {
+            st->tx[ep][(st->tx_head[ep] + st->tx_count[ep]) % OTG_FS_FIFO_WORDS] = val;
+            st->tx_count[ep]++;
+        } else {
+            st->fifo_errors++;
+        }
+    } else if (off == SIM_OTG_OFF(GRSTCTL)) {
+        if ((val & OTG_GRSTCTL_CSRST) != 0u) {
+            sim_otg_core_reset(c, st);
+        }
+        if ((val & OTG_GRSTCTL_RXFFLSH) != 0u) {
+            sim_otg_rx_flush(st);
+        }
+        if ((val & OTG_GRSTCTL_TXFFLSH) != 0u) {
+            uint32_t n = reg_field_get(val, OTG_GRSTCTL_TXFNUM);
+
+            for (ep = 0; ep < OTG_FS_EP_COUNT; ep++) {
+                if (n == OTG_GRSTCTL_TXFNUM_ALL || n == ep) {
+                    sim_otg_tx_flush(st, ep);
+                }
+            }
+        }
+    } else if (off == SIM_OTG_OFF(DCFG)) {
+        if (reg_field_get(old ^ val, OTG_DCFG_DAD) != 0u) {
+            st->addr_pending = true;
+        }
+    } else if (off == SIM_OTG_OFF(DCTL)) {
+        if ((val & OTG_DCTL_SDIS) != 0u) {
+            st->attached = false;
+        }
+    } else if (off >= SIM_OTG_OFF(IEP) && off < SIM_OTG_OFF(RESERVED7) &&
+               (off % sizeof(otg_ep_regs_t)) == 0u) {
+        ep = (off - SIM_OTG_OFF(IEP)) / sizeof(otg_ep_regs_t);
+        if (ep < 16u) {
+            sim_otg_ep_ctl(&c->IEP[ep], old, val);
+        } else {
+            sim_otg_ep_ctl(&c->OEP[ep - 16u], old, val);
+        }
+    }
+    sim_otg_update(c);
+}
+
+static uint32_t sim_otg_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    otg_regs_t *c = p->regs;
+    sim_otg_state_t *st = &sim_otg_state;
+
+    if (off >= SIM_OTG_FIFO_OFF) {
+        if (st->cur_pos < st->cur.words) {
+            val = st->cur.data[st->cur_pos++];
+            st->rx_used--;
+        } else {
+            st->fifo_errors++;
+            val = 0;
+        }
+    } else if (off == SIM_OTG_OFF(GRXSTSR)) {
+        val = (st->rx_count != 0u) ? st->rx[st->rx_head].sts : 0u;
+    } else if (off == SIM_OTG_OFF(GRXSTSP)) {
+        val = sim_otg_rx_pop(c, st);
+    } else {
+        return val;
+    }
+    sim_otg_update(c);
+    return val;
+}
+
+static void sim_otg_reset(sim_periph_t *p)
+{
+    (void)p;
+    memset(&sim_otg_state, 0, sizeof(sim_otg_state));
+}
+
+const sim_model_t sim_model_otg = {
+    .regs = sim_otg_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_otg_regs),
+    .write = sim_otg_write,
+    .read = sim_otg_read,
+    .reset = sim_otg_reset,
+};
+
+/* ------------------------------------------------------------------------ */
+/* Bus                                                                      */
+/* ------------------------------------------------------------------------ */
+
+static bool sim_otg_pullup(const otg_regs_t *c)
+{
+    return (c->GCCFG & OTG_GCCFG_PWRDWN) != 0u && (c->DCTL & OTG_DCTL_SDIS) == 0u;
+}
+
+/* The device sees this transaction at all. */
+static bool sim_otg_listening(const otg_regs_t *c, const sim_otg_state_t *st)
+{
+    return st->attached && sim_otg_pullup(c) && st->host_addr == st->addr;
+}
+
+bool sim_otg_connect(otg_regs_t *otg)
+{
+    if (!sim_otg_pullup(otg)) {
+        return false;
+    }
+    sim_otg_state.attached = true;
+    sim_otg_bus_reset(otg);
+    return true;
+}
+
+void sim_otg_bus_reset(otg_regs_t *otg)
+{
+    sim_otg_state_t *st = &sim_otg_state;
+
+    st->addr = 0;
+    st->addr_pending = false;
+    st->host_addr = 0;
+    otg->DSTS = reg_field_set(otg->DSTS, OTG_DSTS_ENUMSPD, OTG_DCFG_DSPD_FS);
+    otg->GINTSTS |= OTG_GINT_USBRST | OTG_GINT_ENUMDNE;
+    sim_otg_update(otg);
+}
+
+void sim_otg_address(otg_regs_t *otg, uint8_t addr)
+{
+    (void)otg;
+    sim_otg_state.host_addr = addr;
+}
+
+sim_otg_result_t sim_otg_setup(otg_regs_t *otg, const uint8_t setup[8])
+{
+    sim_otg_state_t *st = &sim_otg_state;
+    uint32_t stupcnt = reg_field_get(otg->OEP[0].TSIZ, OTG_TSIZ_STUPCNT);
+
+    if (!sim_otg_listening(otg, st) || !sim_otg_rx_fits(otg, st, 2u, 4u)) {
+        return SIM_OTG_NORESP;
+    }
+    sim_otg_rx_push(st, 0u, OTG_PKTSTS_SETUP_DATA, setup, 8u);
+    sim_otg_rx_push(st, 0u, OTG_PKTSTS_SETUP_DONE, NULL, 0u);
+    otg->IEP[0].CTL &= ~OTG_EPCTL_STALL;
+    otg->OEP[0].CTL &= ~(OTG_EPCTL_STALL | OTG_EPCTL_EPENA);
+    if (stupcnt != 0u) {
+        otg->OEP[0].TSIZ = reg_field_set(otg->OEP[0].TSIZ, OTG_TSIZ_STUPCNT, stupcnt - 1u);
+    }
+    sim_otg_update(otg);
+    return SIM_OTG_ACK;
+}
+
+sim_otg_result_t sim_otg_out(otg_regs_t *otg, uint32_t ep, const void *data, size_t len)
+{
+    sim_otg_state_t *st = &sim_otg_state;
+    otg_ep_regs_t *r;
+    reg_field_t fpkt = (ep == 0u) ? OTG_TSIZ_PKTCNT_EP0 : OTG_TSIZ_PKTCNT;
+    reg_field_t fsize = (ep == 0u) ? OTG_TSIZ_XFRSIZ_EP0 : OTG_TSIZ_XFRSIZ;
+    uint32_t mps;
+    uint32_t pkts;
+    uint32_t size;
+
+    if (!sim_otg_listening(otg, st) || ep >= OTG_FS_EP_COUNT || len > SIM_OTG_PKT_MAX) {
+        return SIM_OTG_NORESP;
+    }
+    r = &otg->OEP[ep];
+    if ((r->CTL & OTG_EPCTL_STALL) != 0u) {
+        return SIM_OTG_STALL;
+    }
+    mps = sim_otg_mps(r->CTL, ep);
+    pkts = reg_field_get(r->TSIZ, fpkt);
+    if ((r->CTL & (OTG_EPCTL_EPENA | OTG_EPCTL_NAKSTS)) != OTG_EPCTL_EPENA || pkts == 0u ||
+        len > mps || !sim_otg_rx_fits(otg, st, 2u, 2u + ((uint32_t)len + 3u) / 4u)) {
+        return SIM_OTG_NAK;
+    }
+    sim_otg_rx_push(st, ep, OTG_PKTSTS_OUT_DATA, data, len);
+    size = reg_field_get(r->TSIZ, fsize);
+    size -= (len < size) ? (uint32_t)len : size;
+    pkts--;
+    r->TSIZ = reg_field_set(reg_field_set(r->TSIZ, fpkt, pkts), fsize, size);
+    if (len < mps || pkts == 0u) {
+        sim_otg_rx_push(st, ep, OTG_PKTSTS_OUT_DONE, NULL, 0u);
+        r->CTL = (r->CTL & ~OTG_EPCTL_EPENA) | OTG_EPCTL_NAKSTS;
+    }
+    sim_otg_update(otg);
+    return SIM_OTG_ACK;
+}
+
+sim_otg_result_t sim_otg_in(otg_regs_t *otg, uint32_t ep, void *buf, size_t max, size_t *len)
+{
+    sim_otg_state_t *st = &sim_otg_state;
+    otg_ep_regs_t *r;
+    reg_field_t fpkt = (ep == 0u) ? OTG_TSIZ_PKTCNT_EP0 : OTG_TSIZ_PKTCNT;
+    reg_field_t fsize = (ep == 0u) ? OTG_TSIZ_XFRSIZ_EP0 : OTG_TSIZ_XFRSIZ;
+    uint32_t pkt[SIM_OTG_PKT_MAX / 4u];
+    uint32_t pkts;
+    uint32_t size;
+    uint32_t plen;
+    uint32_t words;
+    uint32_t i;
+
+    *len = 0;
+    if (!sim_otg_listening(otg, st) || ep >= OTG_FS_EP_COUNT) {
+        return SIM_OTG_NORESP;
+    }
+    r = &otg->IEP[ep];
+    if ((r->CTL & OTG_EPCTL_STALL) != 0u) {
+        return SIM_OTG_STALL;
+    }
+    pkts = reg_field_get(r->TSIZ, fpkt);
+    size = reg_field_get(r->TSIZ, fsize);
+    plen = sim_otg_mps(r->CTL, ep);
+    if (size < plen) {
+        plen = size;
+    }
+    if (plen > SIM_OTG_PKT_MAX) {
+        return SIM_OTG_NORESP;
+    }
+    words = (plen + 3u) / 4u;
+    if ((r->CTL & (OTG_EPCTL_EPENA | OTG_EPCTL_NAKSTS)) != OTG_EPCTL_EPENA || pkts == 0u ||
+        st->tx_count[ep] < words) {
+        return SIM_OTG_NAK;
+    }
+    for (i = 0; i < words; i++) {
+        pkt[i] = st->tx[ep][st->tx_head[ep]];
+        st->tx_head[ep] = (st->tx_head[ep] + 1u) % OTG_FS_FIFO_WORDS;
+        st->tx_count[ep]--;
+    }
+    if (plen != 0u && max != 0u) {
+        memcpy(buf, pkt, (plen < max) ? plen : max);
+    }
+    *len = plen;
+    pkts--;
+    r->TSIZ = reg_field_set(reg_field_set(r->TSIZ, fpkt, pkts), fsize, size - plen);
+    if (pkts == 0u) {
+        r->CTL &= ~OTG_EPCTL_EPENA;
+        r->INT |= OTG_EPINT_XFRC;
+    }
+    if (ep == 0u && st->addr_pending) {
+        st->addr = (uint8_t)reg_field_get(otg->DCFG, OTG_DCFG_DAD);
+        st->addr_pending = false;
+    }
+    sim_otg_update(otg);
+    return SIM_OTG_ACK;
+}
+
+uint32_t sim_otg_tx_words(otg_regs_t *otg, uint32_t ep)
+{
+    (void)otg;
+    return (ep < OTG_FS_EP_COUNT) ? sim_otg_state.tx_count[ep] : 0u;
+}
+
+uint32_t sim_otg_fifo_errors(otg_regs_t *otg)
+{
+    (void)otg;
+    return sim_otg_state.fifo_errors;
+}
@@ -0,0 +1,743 @@
+/**
+ * @file    sim_qspi.c
+ * @brief   QUADSPI model with a serial NOR flash on bank 1.
+ *
+ * Commands start when the QUADSPI would send them: on the CCR write when
+ * they have neither address nor data to wait for (or read data), on the AR
+ * write when they have an address, and on the first DR write for a write
+ * without one.  The flash decodes each as it comes: the phases (lines,
+ * address size, dummy cycles) must be the ones the flash expects for the
+ * opcode, or the command is garbage to it: it is ignored, reads return the
+ * 0xFF of the pulled-up lines, and the protocol error is counted
+ * (sim_qspi_errors()).  A write enable is needed before programs, erases
+ * and status writes, and is cleared when they finish; while the flash is
+ * busy (WIP) only status reads are answered.  Busy time is counted in
+ * status reads, as is the recovery after a software reset (the first reads
+ * return 0xFF).  Quad reads need the flash's quad enable bit.
+ *
+ * Indirect writes move one word per DMA request into the FIFO; indirect
+ * reads fill the FIFO up to its size and refill it as it is drained.
+ * Automatic status polling runs its rounds at once: it stops at a match
+ * (APMS) or keeps BUSY set, polling forever, if none comes.  Memory-mapped
+ * mode copies the flash into QSPIMEM when CCR enters it (the flash cannot
+ * change meanwhile) and clears the window again when it is left, so reads
+ * outside the mode see zeros rather than the flash.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_QSPI_OFF(reg)       ((uint32_t)offsetof(quadspi_regs_t, reg))
+
+#define SIM_QSPI_FIFO           32u
+#define SIM_QSPI_POLL_ROUNDS    100000u     /* Rounds before polling is taken as endless. */
+#define SIM_QSPI_RESET_READS    2u          /* Status reads of 0xFF after a reset. */
+#define SIM_QSPI_PAGE           256u
+
+#define SIM_QSPI_SR1_WIP        0x01u
+#define SIM_QSPI_SR1_WEL        0x02u
+#define SIM_QSPI_SR1_QE         0x40u
+#define SIM_QSPI_SR2_QE         0x02u
+
+/* Expected command formats: address on one line (3 bytes), data on one line. */
+enum {
+    SIM_QSPI_FMT_INS = 0,       /* Instruction only */
+    SIM_QSPI_FMT_READ,          /* Instruction, data in */
+    SIM_QSPI_FMT_ADDR,          /* Instruction, address */
+    SIM_QSPI_FMT_ADDR_READ,     /* Instruction, address, data in */
+    SIM_QSPI_FMT_ADDR_WRITE,    /* Instruction, address, data out */
+    SIM_QSPI_FMT_STATUS,        /* Instruction, 1-2 bytes out (data or alternate bytes) */
+    SIM_QSPI_FMT_QUAD_READ,     /* 0xEB: address, mode byte, dummies, data on 4 lines */
+};
+
+typedef struct {
+    sim_qspi_flash_t flash;
+    bool present;
+    uint8_t sr1;
+    uint8_t sr2;
+    uint32_t busy_left;         /* Status reads still showing WIP. */
+    uint32_t reset_left;        /* Status reads still floating after a reset. */
+    bool reset_enabled;
+    bool mapped;
+    uint32_t counts[256];
+    uint32_t errors;
+    uint32_t faults;
+    /* Command on the bus. */
+    bool active;
+    bool waiting;               /* Configured, waiting for AR or DR. */
+    bool garbage;               /* Not understood by the flash. */
+    uint8_t op;
+    bool rx;
+    uint32_t addr;
+    uint32_t left;              /* Data bytes still to move. */
+    uint8_t status[2];          /* Status register write bytes. */
+    uint32_t nstatus;
+    uint8_t fifo[SIM_QSPI_FIFO];
+    uint32_t fifo_head;
+    uint32_t fifo_n;
+    bool pumping;
+} sim_qspi_state_t;
+
+static sim_qspi_state_t sim_qspi_state;
+
+static const sim_reg_t sim_qspi_regs[] = {
+    { .offset = 0x00, .sc = QUADSPI_CR_ABORT },     /* CR */
+    { .offset = 0x08, .ro = 0xFFFFFFFFu },          /* SR */
+    { .offset = 0x0C, .sc = 0xFFFFFFFFu },          /* FCR */
+};
+
+static quadspi_regs_t *sim_qspi_regs_of(void)
+{
+    return &stm32_host_QUADSPI;
+}
+
+static void sim_qspi_irq(quadspi_regs_t *r)
+{
+    uint32_t cr = r->CR;
+    uint32_t sr = r->SR;
+
+    if (((sr & QUADSPI_SR_TEF) != 0u && (cr & QUADSPI_CR_TEIE) != 0u) ||
+        ((sr & QUADSPI_SR_TCF) != 0u && (cr & QUADSPI_CR_TCIE) != 0u) ||
+        ((sr & QUADSPI_SR_SMF) != 0u && (cr & QUADSPI_CR_SMIE) != 0u)) {
+        sim_irq_raise(QUADSPI_IRQn);
+    }
+}
+
+static void sim_qspi_level(quadspi_regs_t *r, const sim_qspi_state_t *st)
+{
+    r->SR = (r->SR & ~reg_field_mask(QUADSPI_SR_FLEVEL)) |
+            reg_field_prep(QUADSPI_SR_FLEVEL, st->fifo_n);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Flash                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t sim_qspi_map_size(const quadspi_regs_t *r, const sim_qspi_state_t *st)
+{
+    uint32_t fsize = 2u << reg_field_get(r->DCR, QUADSPI_DCR_FSIZE);
+    uint32_t n = st->flash.size;
+
+    if (fsize < n) {
+        n = fsize;
+    }
+    return (n < QSPIMEM_SIZE) ? n : QSPIMEM_SIZE;
+}
+
+static bool sim_qspi_quad_enabled(const sim_qspi_state_t *st)
+{
+    switch (st->flash.qe) {
+    case SIM_QSPI_QE_SR1:
+        return (st->sr1 & SIM_QSPI_SR1_QE) != 0u;
+    case SIM_QSPI_QE_SR2:
+        return (st->sr2 & SIM_QSPI_SR2_QE) != 0u;
+    default:
+        return true;
+    }
+}
+
+/* One status read on the bus; busy and reset recovery count down. */
+static uint8_t sim_qspi_status(sim_qspi_state_t *st)
+{
+    uint8_t b;
+
+    if (st->reset_left > 0u) {
+        st->reset_left--;
+        return 0xFFu;
+    }
+    if (st->busy_left > 0u) {
+        b = st->sr1 | SIM_QSPI_SR1_WIP;
+        if (--st->busy_left == 0u) {
+            st->sr1 &= (uint8_t)~SIM_QSPI_SR1_WEL;
+        }
+        return b;
+    }
+    return st->sr1;
+}
+
+/* The flash is busy until WIP reads clear; WEL clears with it. */
+static void sim_qspi_busy(sim_qspi_state_t *st, uint32_t reads)
+{
+    st->busy_left = reads;
+    if (reads == 0u) {
+        st->sr1 &= (uint8_t)~SIM_QSPI_SR1_WEL;
+    }
+}
+
+static bool sim_qspi_wel(const sim_qspi_state_t *st)
+{
+    return (st->sr1 & SIM_QSPI_SR1_WEL) != 0u;
+}
+
+static void sim_qspi_erase(sim_qspi_state_t *st, uint32_t addr, uint32_t size)
+{
+    addr &= ~(size - 1u) & (st->flash.size - 1u);
+    memset(st->flash.data + addr, 0xFF, size);
+    sim_qspi_busy(st, st->flash.erase_busy);
+}
+
+static uint32_t sim_qspi_format(uint8_t op)
+{
+    switch (op) {
+    case 0x01u:
+        return SIM_QSPI_FMT_STATUS;
+    case 0x02u:
+        return SIM_QSPI_FMT_ADDR_WRITE;
+    case 0x03u:
+    case 0x0Bu:
+        return SIM_QSPI_FMT_ADDR_READ;
+    case 0x05u:
+    case 0x35u:
+    case 0x9Fu:
+        return SIM_QSPI_FMT_READ;
+    case 0x20u:
+    case 0xD8u:
+        return SIM_QSPI_FMT_ADDR;
+    case 0xEBu:
+        return SIM_QSPI_FMT_QUAD_READ;
+    default:
+        return SIM_QSPI_FMT_INS;
+    }
+}
+
+/* Whether the phases in @p ccr are what the flash expects for its opcode. */
+static bool sim_qspi_format_ok(const sim_qspi_state_t *st, uint32_t ccr)
+{
+    uint32_t imode = reg_field_get(ccr, QUADSPI_CCR_IMODE);
+    uint32_t admode = reg_field_get(ccr, QUADSPI_CCR_ADMODE);
+    uint32_t adsize = reg_field_get(ccr, QUADSPI_CCR_ADSIZE);
+    uint32_t abmode = reg_field_get(ccr, QUADSPI_CCR_ABMODE);
+    uint32_t absize = reg_field_get(ccr, QUADSPI_CCR_ABSIZE);
+    uint32_t dcyc = reg_field_get(ccr, QUADSPI_CCR_DCYC);
+    uint32_t dmode = reg_field_get(ccr, QUADSPI_CCR_DMODE);
+    uint8_t op = (uint8_t)reg_field_get(ccr, QUADSPI_CCR_INSTRUCTION);
+    bool addr1 = admode == QUADSPI_LINES_1 && adsize == 2u;
+    uint32_t dummies = (op == 0x0Bu) ? 8u : 0u;
+
+    if (imode != QUADSPI_LINES_1 || (ccr & (QUADSPI_CCR_DDRM | QUADSPI_CCR_SIOO)) != 0u) {
+        return false;
+    }
+    switch (sim_qspi_format(op)) {
+    case SIM_QSPI_FMT_INS:
+        return admode == 0u && abmode == 0u && dcyc == 0u && dmode == 0u;
+    case SIM_QSPI_FMT_READ:
+        return admode == 0u && abmode == 0u && dcyc == 0u && dmode == QUADSPI_LINES_1;
+    case SIM_QSPI_FMT_ADDR:
+        return addr1 && abmode == 0u && dcyc == 0u && dmode == 0u;
+    case SIM_QSPI_FMT_ADDR_READ:
+        return addr1 && abmode == 0u && dcyc == dummies && dmode == QUADSPI_LINES_1;
+    case SIM_QSPI_FMT_ADDR_WRITE:
+        return addr1 && abmode == 0u && dcyc == 0u && dmode == QUADSPI_LINES_1;
+    case SIM_QSPI_FMT_STATUS:
+        /* Bytes as alternate bytes or as data, on one line either way. */
+        return admode == 0u && dcyc == 0u &&
+               ((abmode == QUADSPI_LINES_1 && absize <= 1u && dmode == 0u) ||
+                (abmode == 0u && dmode == QUADSPI_LINES_1));
+    default:
+        return admode == QUADSPI_LINES_4 && adsize == 2u && abmode == QUADSPI_LINES_4 &&
+               absize == 0u && dcyc == st->flash.dummy_cycles && dmode == QUADSPI_LINES_4 &&
+               sim_qspi_quad_enabled(st);
+    }
+}
+
+/* The flash takes a status register write byte. */
+static void sim_qspi_status_in(sim_qspi_state_t *st, uint8_t b)
+{
+    if (st->nstatus < 2u) {
+        st->status[st->nstatus++] = b;
+    }
+}
+
+/* End of a write command (CS high): status writes and programs take effect. */
+static void sim_qspi_finish(sim_qspi_state_t *st)
+{
+    uint8_t qe1 = (st->flash.qe == SIM_QSPI_QE_SR1) ? SIM_QSPI_SR1_QE : 0u;
+    uint8_t qe2 = (st->flash.qe == SIM_QSPI_QE_SR2) ? SIM_QSPI_SR2_QE : 0u;
+
+    if (st->garbage || !st->present) {
+        return;
+    }
+    if (st->op == 0x01u && sim_qspi_wel(st) && st->nstatus > 0u) {
+        st->sr1 = (uint8_t)((st->sr1 & ~qe1) | (st->status[0] & qe1));
+        if (st->nstatus > 1u) {
+            st->sr2 = (uint8_t)((st->sr2 & ~qe2) | (st->status[1] & qe2));
+        }
+        sim_qspi_busy(st, st->flash.program_busy);
+    } else if (st->op == 0x02u && sim_qspi_wel(st)) {
+        sim_qspi_busy(st, st->flash.program_busy);
+    }
+}
+
+/* A data byte from the host. */
+static void sim_qspi_byte_in(sim_qspi_state_t *st, uint8_t b)
+{
+    uint32_t page;
+
+    if (st->garbage || !st->present || st->busy_left > 0u) {
+        return;
+    }
+    if (st->op == 0x01u) {
+        sim_qspi_status_in(st, b);
+    } else if (st->op == 0x02u && sim_qspi_wel(st)) {
+        /* NOR: programming only clears bits; the address wraps in the page. */
+        page = st->addr & ~(SIM_QSPI_PAGE - 1u);
+        st->flash.data[st->addr & (st->flash.size - 1u)] &= b;
+        st->addr = page | ((st->addr + 1u) & (SIM_QSPI_PAGE - 1u));
+    }
+}
+
+/* A data byte to the host. */
+static uint8_t sim_qspi_byte_out(sim_qspi_state_t *st)
+{
+    uint8_t b = 0xFFu;
+
+    if (st->garbage || !st->present) {
+        return b;
+    }
+    switch (st->op) {
+    case 0x05u:
+        b = st->status[0];
+        break;
+    case 0x35u:
+        b = st->sr2;
+        break;
+    case 0x9Fu:
+        b = (st->addr < 3u) ? (uint8_t)(st->flash.jedec_id >> (16u - 8u * st->addr)) : 0u;
+        st->addr++;
+        break;
+    case 0x03u:
+    case 0x0Bu:
+    case 0xEBu:
+        if (st->busy_left == 0u) {
+            b = st->flash.data[st->addr & (st->flash.size - 1u)];
+        }
+        st->addr++;
+        break;
+    default:
+        break;
+    }
+    return b;
+}
+
+/* The flash sees the instruction (and address): immediate effects. */
+static void sim_qspi_decode(sim_qspi_state_t *st, uint32_t ccr)
+{
+    uint8_t op = (uint8_t)reg_field_get(ccr, QUADSPI_CCR_INSTRUCTION);
+    bool reset_enabled = st->reset_enabled;
+
+    st->op = op;
+    st->nstatus = 0;
+    st->counts[op]++;
+    st->garbage = !sim_qspi_format_ok(st, ccr);
+    if (st->garbage) {
+        st->errors++;
+    }
+    if (st->garbage || !st->present) {
+        return;
+    }
+    st->reset_enabled = false;
+    if (op == 0x05u) {
+        st->status[0] = sim_qspi_status(st);
+        return;
+    }
+    if (st->reset_left > 0u) {
+        /* Still resetting: nothing is heard. */
+        st->garbage = true;
+        return;
+    }
+    if (st->busy_left > 0u && op != 0x35u) {
+        return;
+    }
+    switch (op) {
+    case 0x06u:
+        if ((st->faults & SIM_QSPI_FAULT_NO_WEL) != 0u) {
+            st->faults &= ~SIM_QSPI_FAULT_NO_WEL;
+        } else {
+            st->sr1 |= SIM_QSPI_SR1_WEL;
+        }
+        break;
+    case 0x04u:
+        st->sr1 &= (uint8_t)~SIM_QSPI_SR1_WEL;
+        break;
+    case 0x66u:
+        st->reset_enabled = true;
+        break;
+    case 0x99u:
+        if (reset_enabled) {
+            st->sr1 &= (uint8_t)~SIM_QSPI_SR1_WEL;
+            st->busy_left = 0;
+            st->reset_left = SIM_QSPI_RESET_READS;
+        }
+        break;
+    case 0x20u:
+        if (sim_qspi_wel(st)) {
+            sim_qspi_erase(st, st->addr, 4096u);
+        }
+        break;
+    case 0xD8u:
+        if (sim_qspi_wel(st)) {
+            sim_qspi_erase(st, st->addr, 65536u);
+        }
+        break;
+    case 0x60u:
+    case 0xC7u:
+        if (sim_qspi_wel(st)) {
+            sim_qspi_erase(st, 0u, st->flash.size);
+        }
+        break;
+    case 0x9Fu:
+        st->addr = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* QUADSPI                                                                  */
+/* ------------------------------------------------------------------------ */
+
+static void sim_qspi_unmap(sim_qspi_state_t *st)
+{
+    if (st->mapped) {
+        st->mapped = false;
+        memset((void *)stm32_host_QSPIMEM.B, 0, sim_qspi_map_size(sim_qspi_regs_of(), st));
+    }
+}
+
+static void sim_qspi_stop(quadspi_regs_t *r, sim_qspi_state_t *st)
+{
+    st->active = false;
+    st->waiting = false;
+    st->fifo_n = 0;
+    st->fifo_head = 0;
+    r->SR &= ~QUADSPI_SR_BUSY;
+    sim_qspi_level(r, st);
+    sim_dma_release(SIM_DREQ_QUADSPI);
+    sim_qspi_unmap(st);
+}
+
+static void sim_qspi_complete(quadspi_regs_t *r, sim_qspi_state_t *st)
+{
+    if (!st->rx) {
+        sim_qspi_finish(st);
+    }
+    st->active = false;
+    r->SR = (r->SR & ~QUADSPI_SR_BUSY) | QUADSPI_SR_TCF;
+    sim_dma_release(SIM_DREQ_QUADSPI);
+    sim_qspi_irq(r);
+}
+
+/* Indirect read: fill the FIFO and hand it to the DMA, if enabled. */
+static void sim_qspi_pump_rx(quadspi_regs_t *r, sim_qspi_state_t *st)
+{
+    uint32_t n;
+
+    while (st->active) {
+        while (st->left > 0u && st->fifo_n < SIM_QSPI_FIFO) {
+            st->fifo[(st->fifo_head + st->fifo_n) % SIM_QSPI_FIFO] = sim_qspi_byte_out(st);
+            st->fifo_n++;
+            st->left--;
+        }
+        sim_qspi_level(r, st);
+        if (st->left == 0u) {
+            /* All received: complete, with the tail still in the FIFO. */
+            sim_qspi_complete(r, st);
+            break;
+        }
+        n = st->fifo_n;
+        if ((r->CR & QUADSPI_CR_DMAEN) == 0u || n < 4u) {
+            break;
+        }
+        sim_dma_request(SIM_DREQ_QUADSPI);
+        if (st->fifo_n == n) {
+            break;
+        }
+    }
+}
+
+/* Indirect write: one DMA request per FIFO word until the data are in. */
+static void sim_qspi_pump_tx(quadspi_regs_t *r, sim_qspi_state_t *st)
+{
+    uint32_t before;
+
+    while (st->active && st->left > 0u && (r->CR & QUADSPI_CR_DMAEN) != 0u) {
+        before = st->left;
+        sim_dma_request(SIM_DREQ_QUADSPI);
+        if (st->left == before) {
+            break;
+        }
+    }
+}
+
+static void sim_qspi_pump(quadspi_regs_t *r)
+{
+    sim_qspi_state_t *st = &sim_qspi_state;
+
+    if (st->pumping || !st->active) {
+        return;
+    }
+    st->pumping = true;
+    if (st->rx) {
+        sim_qspi_pump_rx(r, st);
+    } else {
+        sim_qspi_pump_tx(r, st);
+    }
+    st->pumping = false;
+}
+
+/* Automatic status polling, all rounds at once. */
+static void sim_qspi_poll(quadspi_regs_t *r, sim_qspi_state_t *st, uint32_t ccr)
+{
+    uint32_t mask = r->PSMKR & 0xFFu;
+    uint32_t match = r->PSMAR & 0xFFu;
+    uint32_t s;
+    uint32_t i;
+    bool hit;
+
+    r->SR |= QUADSPI_SR_BUSY;
+    for (i = 0; i < SIM_QSPI_POLL_ROUNDS; i++) {
+        sim_qspi_decode(st, ccr);
+        s = (st->garbage || !st->present) ? 0xFFu
+            : (st->op == 0x05u) ? st->status[0] : sim_qspi_byte_out(st);
+        if ((r->CR & QUADSPI_CR_PMM) != 0u) {
+            hit = (~(s ^ match) & mask) != 0u;
+        } else {
+            hit = ((s ^ match) & mask) == 0u;
+        }
+        if (hit) {
+            r->SR |= QUADSPI_SR_SMF;
+            st->fifo[0] = (uint8_t)s;
+            st->fifo_head = 0;
+            st->fifo_n = 1;
+            if ((r->CR & QUADSPI_CR_APMS) != 0u) {
+                r->SR &= ~QUADSPI_SR_BUSY;
+                st->active = false;
+            }
+            sim_qspi_level(r, st);
+            sim_qspi_irq(r);
+            return;
+        }
+    }
+    /* No match: the QUADSPI keeps polling until aborted. */
+    st->active = true;
+    st->rx = true;
+    st->left = 0xFFFFFFFFu;
+}
+
+/* Memory-mapped mode: the window shows the flash if the read is understood. */
+static void sim_qspi_map(quadspi_regs_t *r, sim_qspi_state_t *st, uint32_t ccr)
+{
+    uint32_t size = sim_qspi_map_size(r, st);
+    uint8_t op = (uint8_t)reg_field_get(ccr, QUADSPI_CCR_INSTRUCTION);
+    uint32_t format = sim_qspi_format(op);
+
+    st->mapped = true;
+    r->SR |= QUADSPI_SR_BUSY;
+    st->counts[op]++;
+    if (!sim_qspi_format_ok(st, ccr) ||
+        (format != SIM_QSPI_FMT_ADDR_READ && format != SIM_QSPI_FMT_QUAD_READ)) {
+        st->errors++;
+        memset((void *)stm32_host_QSPIMEM.B, 0xFF, size);
+        return;
+    }
+    if (!st->present || st->busy_left > 0u || st->reset_left > 0u) {
+        memset((void *)stm32_host_QSPIMEM.B, 0xFF, size);
+        return;
+    }
+    memcpy((void *)stm32_host_QSPIMEM.B, st->flash.data, size);
+}
+
+/* Start the command configured in CCR (and AR). */
+static void sim_qspi_start(quadspi_regs_t *r, sim_qspi_state_t *st)
+{
+    uint32_t ccr = r->CCR;
+    uint32_t fmode = reg_field_get(ccr, QUADSPI_CCR_FMODE);
+    uint32_t ab;
+    uint32_t absize;
+    uint32_t i;
+
+    st->waiting = false;
+    st->active = true;
+    st->rx = (fmode == QUADSPI_FMODE_READ);
+    st->addr = r->AR;
+    st->left = (reg_field_get(ccr, QUADSPI_CCR_DMODE) != 0u) ? r->DLR + 1u : 0u;
+    st->fifo_head = 0;
+    st->fifo_n = 0;
+    r->SR |= QUADSPI_SR_BUSY;
+    if (fmode == QUADSPI_FMODE_POLL) {
+        sim_qspi_poll(r, st, ccr);
+        return;
+    }
+    sim_qspi_decode(st, ccr);
+    if (reg_field_get(ccr, QUADSPI_CCR_ABMODE) != 0u) {
+        ab = r->ABR;
+        absize = reg_field_get(ccr, QUADSPI_CCR_ABSIZE) + 1u;
+        for (i = absize; i > 0u; i--) {
+            sim_qspi_byte_in(st, (uint8_t)(ab >> (8u * (i - 1u))));
+        }
+    }
+    if (st->left == 0u) {
+        sim_qspi_complete(r, st);
+        return;
+    }
+    sim_qspi_pump(r);
+}
+
+/* CCR written: start now, or wait for the address or the first data. */
+static void sim_qspi_ccr(quadspi_regs_t *r, sim_qspi_state_t *st, uint32_t ccr)
+{
+    uint32_t fmode = reg_field_get(ccr, QUADSPI_CCR_FMODE);
+    bool addr = reg_field_get(ccr, QUADSPI_CCR_ADMODE) != 0u;
+    bool data = reg_field_get(ccr, QUADSPI_CCR_DMODE) != 0u;
+
+    if ((r->CR & QUADSPI_CR_EN) == 0u || st->active || st->mapped) {
+        return;
+    }
+    if (fmode == QUADSPI_FMODE_MAP) {
+        sim_qspi_map(r, st, ccr);
+        return;
+    }
+    if (addr || (fmode == QUADSPI_FMODE_WRITE && data)) {
+        st->waiting = true;
+        return;
+    }
+    sim_qspi_start(r, st);
+}
+
+static void sim_qspi_dr_write(quadspi_regs_t *r, sim_qspi_state_t *st, uint32_t val)
+{
+    uint32_t i;
+
+    if (st->waiting && !reg_field_get(r->CCR, QUADSPI_CCR_ADMODE) &&
+        reg_field_get(r->CCR, QUADSPI_CCR_FMODE) == QUADSPI_FMODE_WRITE) {
+        sim_qspi_start(r, st);
+    }
+    if (!st->active || st->rx) {
+        return;
+    }
+    /* A word write carries four bytes; past the length they are dropped. */
+    for (i = 0; i < 4u && st->left > 0u; i++) {
+        sim_qspi_byte_in(st, (uint8_t)(val >> (8u * i)));
+        st->left--;
+    }
+    if (st->left == 0u) {
+        sim_qspi_complete(r, st);
+    }
+}
+
+static uint32_t sim_qspi_dr_read(quadspi_regs_t *r, sim_qspi_state_t *st)
+{
+    uint32_t val = 0;
+    uint32_t i;
+
+    for (i = 0; i < 4u && st->fifo_n > 0u; i++) {
+        val |= (uint32_t)st->fifo[st->fifo_head] << (8u * i);
+        st->fifo_head = (st->fifo_head + 1u) % SIM_QSPI_FIFO;
+        st->fifo_n--;
+    }
+    sim_qspi_level(r, st);
+    if (!st->pumping && st->active && st->left != 0xFFFFFFFFu) {
+        sim_qspi_pump(r);
+    }
+    return val;
+}
+
+static void sim_qspi_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    quadspi_regs_t *r = p->regs;
+    sim_qspi_state_t *st = &sim_qspi_state;
+
+    (void)old;
+    switch (off) {
+    case SIM_QSPI_OFF(CR):
+        if ((val & QUADSPI_CR_ABORT) != 0u || (val & QUADSPI_CR_EN) == 0u) {
+            sim_qspi_stop(r, st);
+        } else {
+            sim_qspi_pump(r);
+            sim_qspi_irq(r);
+        }
+        break;
+    case SIM_QSPI_OFF(FCR):
+        r->SR &= ~(val & QUADSPI_FCR_ALL);
+        break;
+    case SIM_QSPI_OFF(CCR):
+        sim_qspi_ccr(r, st, val);
+        break;
+    case SIM_QSPI_OFF(AR):
+        if (st->waiting && reg_field_get(r->CCR, QUADSPI_CCR_ADMODE) != 0u) {
+            sim_qspi_start(r, st);
+        }
+        break;
+    case SIM_QSPI_OFF(DR):
+        sim_qspi_dr_write(r, st, val);
+        break;
+    default:
+        break;
+    }
+}
+
+static uint32_t sim_qspi_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    if (off == SIM_QSPI_OFF(DR)) {
+        return sim_qspi_dr_read(p->regs, &sim_qspi_state);
+    }
+    return val;
+}
+
+static void sim_qspi_reset(sim_periph_t *p)
+{
+    (void)p;
+    memset(&sim_qspi_state, 0, sizeof(sim_qspi_state));
+}
+
+const sim_model_t sim_model_qspi = {
+    .regs = sim_qspi_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_qspi_regs),
+    .write = sim_qspi_write,
+    .read = sim_qspi_read,
+    .reset = sim_qspi_reset,
+};
+
+void sim_qspi_attach(quadspi_regs_t *qspi, const sim_qspi_flash_t *flash)
+{
+    sim_qspi_state_t *st = &sim_qspi_state;
+
+    (void)qspi;
+    st->present = (flash != NULL);
+    if (flash != NULL) {
+        st->flash = *flash;
+        st->sr1 = flash->sr1 & SIM_QSPI_SR1_QE;
+        st->sr2 = flash->sr2 & SIM_QSPI_SR2_QE;
+    }
+    st->busy_left = 0;
+    st->reset_left = 0;
+    st->reset_enabled = false;
+}
+
+void sim_qspi_fault(quadspi_regs_t *qspi, uint32_t faults)
+{
+    (void)qspi;
+    sim_qspi_state.faults |= faults;
+}
+
+uint32_t sim_qspi_commands(quadspi_regs_t *qspi, uint8_t op)
+{
+    (void)qspi;
+    return sim_qspi_state.counts[op];
+}
+
+uint32_t sim_qspi_errors(quadspi_regs_t *qspi)
+{
+    (void)qspi;
+    return sim_qspi_state.errors;
+}
+
+uint8_t sim_qspi_status_regs(quadspi_regs_t *qspi, uint8_t *sr2)
+{
+    (void)qspi;
+    if (sr2 != NULL) {
+        *sr2 = sim_qspi_state.sr2;
+    }
+    return sim_qspi_state.sr1;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file    sim_rcc.c
+ * @brief   RCC register model.
+ *
+ * Oscillators and the PLL lock instantly: each READY flag follows its ON
+ * bit, and SWS follows SW on the next CFGR write.  sim_rcc_hse_fail()
+ * models a missing or dead crystal: HSERDY then never sets.
+ */
+#include "sim.h"
+
+static bool sim_rcc_no_hse;
+
+static const sim_reg_t sim_rcc_regs[] = {
+    { .offset = 0x00, .reset = 0x00000083u,     /* CR */
+      .ro = RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY },
+    { .offset = 0x04, .reset = 0x24003010u },   /* PLLCFGR */
+    { .offset = 0x08, .ro = 0x0000000Cu },      /* CFGR: SWS */
+    { .offset = 0x74, .reset = 0x0E000000u },   /* CSR */
+};
+
+static void sim_rcc_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    rcc_regs_t *r = p->regs;
+    uint32_t cr;
+
+    (void)old;
+    (void)val;
+    if (off == 0x00u) {
+        cr = r->CR & ~(RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY);
+        if ((cr & RCC_CR_HSION) != 0u) {
+            cr |= RCC_CR_HSIRDY;
+        }
+        if ((cr & RCC_CR_HSEON) != 0u && !sim_rcc_no_hse) {
+            cr |= RCC_CR_HSERDY;
+        }
+        if ((cr & RCC_CR_PLLON) != 0u) {
+            cr |= RCC_CR_PLLRDY;
+        }
+        r->CR = cr;
+    } else if (off == 0x08u) {
+        r->CFGR = reg_field_set(r->CFGR, RCC_CFGR_SWS, reg_field_get(r->CFGR, RCC_CFGR_SW));
+    }
+}
+
+static void sim_rcc_reset(sim_periph_t *p)
+{
+    (void)p;
+    sim_rcc_no_hse = false;
+}
+
+void sim_rcc_hse_fail(bool fail)
+{
+    sim_rcc_no_hse = fail;
+}
+
+const sim_model_t sim_model_rcc = {
+    .regs = sim_rcc_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_rcc_regs),
+    .write = sim_rcc_write,
+    .reset = sim_rcc_reset,
+};
@@ -0,0 +1,111 @@
+/**
+ * @file    sim_scb.c
+ * @brief   System control block model.
+ *
+ * AIRCR ignores writes without the VECTKEY and reads back VECTKEYSTAT; a
+ * STIR write pends the interrupt it names.
+ *
+ * There is no cache on the host; the cache maintenance registers are
+ * write-only and every operation written to them is logged for the tests
+ * (sim_cache_take()).  CCSIDR describes the 4 KiB, 4-way, 32-byte-line
+ * L1 caches of the STM32F74x for whichever cache CSSELR selects.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_CACHE_LOG   256u
+
+/* WT | WB | RA | WA, 32 sets, 4 ways, 8 words per line. */
+#define SIM_CCSIDR_D    0xF003E019u
+/* RA, 64 sets, 2 ways, 8 words per line (I-cache). */
+#define SIM_CCSIDR_I    0x2007E009u
+
+/* VECTKEYSTAT, PRIGROUP 0. */
+#define SIM_AIRCR_RESET 0xFA050000u
+
+static const sim_reg_t sim_scb_regs[] = {
+#if defined(STM32F7)
+    { .offset = 0x000, .reset = 0x411FC270u, .ro = 0xFFFFFFFFu },   /* CPUID */
+    { .offset = 0x00C, .reset = SIM_AIRCR_RESET },                  /* AIRCR */
+    { .offset = 0x014, .reset = 0x00000200u },                      /* CCR */
+    { .offset = 0x078, .reset = 0x09000003u, .ro = 0xFFFFFFFFu },   /* CLIDR */
+    { .offset = 0x07C, .reset = 0x8303C003u, .ro = 0xFFFFFFFFu },   /* CTR */
+    { .offset = 0x080, .ro = 0xFFFFFFFFu },                         /* CCSIDR */
+#else
+    { .offset = 0x000, .reset = 0x410FC241u, .ro = 0xFFFFFFFFu },   /* CPUID */
+    { .offset = 0x00C, .reset = SIM_AIRCR_RESET },                  /* AIRCR */
+    { .offset = 0x014, .reset = 0x00000200u },                      /* CCR */
+#endif
+    { .offset = 0x200, .sc = 0xFFFFFFFFu },                         /* STIR */
+    { .offset = 0x250, .sc = 0xFFFFFFFFu },                         /* ICIALLU */
+    { .offset = 0x258, .sc = 0xFFFFFFFFu },                         /* ICIMVAU */
+    { .offset = 0x25C, .sc = 0xFFFFFFFFu },                         /* DCIMVAC */
+    { .offset = 0x260, .sc = 0xFFFFFFFFu },                         /* DCISW */
+    { .offset = 0x264, .sc = 0xFFFFFFFFu },                         /* DCCMVAU */
+    { .offset = 0x268, .sc = 0xFFFFFFFFu },                         /* DCCMVAC */
+    { .offset = 0x26C, .sc = 0xFFFFFFFFu },                         /* DCCSW */
+    { .offset = 0x270, .sc = 0xFFFFFFFFu },                         /* DCCIMVAC */
+    { .offset = 0x274, .sc = 0xFFFFFFFFu },                         /* DCCISW */
+};
+
+static sim_cache_op_t sim_cache_log[SIM_CACHE_LOG];
+static size_t sim_cache_len;
+
+static void sim_scb_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    scb_regs_t *scb = p->regs;
+
+    if (off == 0x00Cu) {
+        /* Only PRIGROUP is modelled; the reset requests are ignored. */
+        scb->AIRCR = (reg_field_get(val, SCB_AIRCR_VECTKEY) == SCB_AIRCR_KEY)
+                   ? SIM_AIRCR_RESET | (val & reg_field_mask(SCB_AIRCR_PRIGROUP)) : old;
+        return;
+    }
+    if (off == 0x200u) {
+        sim_irq_raise((irqn_t)(val & 0x1FFu));
+        return;
+    }
+    if (off >= 0x250u && off <= 0x274u && sim_cache_len < SIM_CACHE_LOG) {
+        sim_cache_log[sim_cache_len++] = (sim_cache_op_t){ .reg = (uint16_t)off, .arg = val };
+    }
+}
+
+static uint32_t sim_scb_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+#if defined(STM32F7)
+    const scb_regs_t *scb = p->regs;
+
+    if (off == 0x080u) {
+        return ((scb->CSSELR & 1u) != 0u) ? SIM_CCSIDR_I : SIM_CCSIDR_D;
+    }
+#else
+    (void)p;
+    (void)off;
+#endif
+    return val;
+}
+
+static void sim_scb_reset(sim_periph_t *p)
+{
+    (void)p;
+    sim_cache_len = 0;
+}
+
+size_t sim_cache_take(sim_cache_op_t *buf, size_t max)
+{
+    size_t n = (sim_cache_len < max) ? sim_cache_len : max;
+
+    memcpy(buf, sim_cache_log, n * sizeof(buf[0]));
+    memmove(sim_cache_log, sim_cache_log + n, (sim_cache_len - n) * sizeof(buf[0]));
+    sim_cache_len -= n;
+    return n;
+}
+
+const sim_model_t sim_model_scb = {
+    .regs = sim_scb_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_scb_regs),
+    .write = sim_scb_write,
+    .read = sim_scb_read,
+    .reset = sim_scb_reset,
+};
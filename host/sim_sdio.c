@@ -0,0 +1,688 @@
+/**
+ * @file    sim_sdio.c
+ * @brief   SDIO host model with an SD memory card on the bus.
+ *
+ * Commands complete as soon as CMD is written: the card's response (or
+ * none) is latched and the command flags set at once.  The data path
+ * (DPSM) runs whenever it is enabled and the card has data to send or is
+ * waiting for some: received words are pushed into the FIFO and the DMA
+ * asked for each; transmitted words are pulled from the DMA by requests
+ * and collected into blocks, which the card stores once whole.  At the end
+ * of the transfer DATAEND is set and, the SDIO being the flow controller,
+ * the stream is stopped (sim_dma_flow_end()).  The CPU may equally drain
+ * or fill the FIFO itself.
+ *
+ * Each block is checked against the bus the card expects: the host bus
+ * width must match the one set with ACMD6, and a clock above 25 MHz needs
+ * the card switched to high speed first; otherwise the block fails its
+ * CRC (DCRCFAIL), as it would on a real bus.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_SDIO_OFF(reg)       ((uint32_t)offsetof(sdio_regs_t, reg))
+
+#define SIM_SDIO_CLK_HZ         48000000u
+#define SIM_SDIO_DS_HZ          25000000u
+#define SIM_SDIO_BLOCK          512u
+#define SIM_SDIO_RCA            0xB368u
+#define SIM_SDIO_NO_RESP_CMD    0x3Fu       /* RESPCMD after R2 and R3 */
+
+/* OCR */
+#define SIM_SDIO_OCR            0x00FF8000u
+#define SIM_SDIO_OCR_CCS        REG_BIT(30)
+#define SIM_SDIO_OCR_READY      REG_BIT(31)
+
+/* R1 card status */
+#define SIM_SDIO_OUT_OF_RANGE   REG_BIT(31)
+#define SIM_SDIO_ADDRESS_ERROR  REG_BIT(30)
+#define SIM_SDIO_BLOCK_LEN_ERROR REG_BIT(29)
+#define SIM_SDIO_READY_FOR_DATA REG_BIT(8)
+#define SIM_SDIO_APP_CMD        REG_BIT(5)
+
+/* Card states (CURRENT_STATE) */
+enum {
+    SIM_SD_IDLE = 0,
+    SIM_SD_READY,
+    SIM_SD_IDENT,
+    SIM_SD_STBY,
+    SIM_SD_TRAN,
+    SIM_SD_DATA,
+    SIM_SD_RCV,
+    SIM_SD_PRG,
+};
+
+typedef struct {
+    sim_sdio_card_t card;
+    bool present;
+    uint32_t state;
+    bool app;                   /* Next command is an application command. */
+    uint32_t init_left;         /* ACMD41 rounds still answered busy. */
+    uint32_t busy_left;         /* CMD13 rounds still answered programming. */
+    uint16_t rca;
+    bool wide;
+    bool high_speed;
+    uint32_t faults;
+    uint32_t counts[128];
+    /* Card side of a transfer: bytes it still sends (src) or takes (dst). */
+    const uint8_t *src;
+    uint8_t *dst;
+    uint32_t card_left;
+    bool multi;
+    bool stall;                 /* Read accepted, but no data will follow. */
+    uint8_t status[64];         /* CMD6 switch status. */
+    /* Host data path. */
+    bool dpsm;
+    bool rx;
+    uint32_t block_size;
+    uint32_t fifo[SDIO_FIFO_WORDS];
+    uint32_t fifo_head;
+    uint32_t fifo_n;
+    uint8_t block[SIM_SDIO_BLOCK];
+    uint32_t block_pos;
+    bool pumping;
+} sim_sdio_state_t;
+
+static sim_sdio_state_t sim_sdio_state;
+
+static const sim_reg_t sim_sdio_regs[] = {
+    { .offset = 0x10, .ro = 0xFFFFFFFFu },  /* RESPCMD */
+    { .offset = 0x14, .ro = 0xFFFFFFFFu },  /* RESP1 */
+    { .offset = 0x18, .ro = 0xFFFFFFFFu },
+    { .offset = 0x1C, .ro = 0xFFFFFFFFu },
+    { .offset = 0x20, .ro = 0xFFFFFFFFu },  /* RESP4 */
+    { .offset = 0x30, .ro = 0xFFFFFFFFu },  /* DCOUNT */
+    { .offset = 0x34, .ro = 0xFFFFFFFFu },  /* STA */
+    { .offset = 0x38, .sc = 0xFFFFFFFFu },  /* ICR */
+    { .offset = 0x48, .ro = 0xFFFFFFFFu },  /* FIFOCNT */
+};
+
+static void sim_sdio_irq(sdio_regs_t *r)
+{
+    if ((r->STA & r->MASK) != 0u) {
+        sim_irq_raise(SDIO_IRQn);
+    }
+}
+
+static bool sim_sdio_take_fault(sim_sdio_state_t *st, uint32_t fault)
+{
+    bool hit = (st->faults & fault) != 0u;
+
+    st->faults &= ~fault;
+    return hit;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Data path                                                                */
+/* ------------------------------------------------------------------------ */
+
+static bool sim_sdio_bus_ok(const sdio_regs_t *r, const sim_sdio_state_t *st)
+{
+    uint32_t clkcr = r->CLKCR;
+    uint32_t hz = ((clkcr & SDIO_CLKCR_BYPASS) != 0u)
+                ? SIM_SDIO_CLK_HZ
+                : SIM_SDIO_CLK_HZ / (reg_field_get(clkcr, SDIO_CLKCR_CLKDIV) + 2u);
+    bool wide = reg_field_get(clkcr, SDIO_CLKCR_WIDBUS) == SDIO_WIDBUS_4;
+
+    return (clkcr & SDIO_CLKCR_CLKEN) != 0u && wide == st->wide &&
+           (hz <= SIM_SDIO_DS_HZ || st->high_speed);
+}
+
+static void sim_sdio_stop(sdio_regs_t *r, sim_sdio_state_t *st, uint32_t sta)
+{
+    st->dpsm = false;
+    r->STA |= sta;
+    sim_dma_release(SIM_DREQ_SDIO);
+    if ((sta & SDIO_STA_DATAEND) != 0u) {
+        sim_dma_flow_end(SIM_DREQ_SDIO);
+    }
+    sim_sdio_irq(r);
+}
+
+/* A block crossed the bus: false (and the transfer stopped) if it failed. */
+static bool sim_sdio_block_done(sdio_regs_t *r, sim_sdio_state_t *st)
+{
+    if (sim_sdio_take_fault(st, SIM_SDIO_FAULT_DATA_CRC) || !sim_sdio_bus_ok(r, st)) {
+        sim_sdio_stop(r, st, SDIO_STA_DCRCFAIL);
+        return false;
+    }
+    r->STA |= SDIO_STA_DBCKEND;
+    return true;
+}
+
+/* The card has sent or taken everything the command asked for. */
+static void sim_sdio_card_done(sim_sdio_state_t *st)
+{
+    if (st->multi) {
+        return;
+    }
+    if (st->dst != NULL) {
+        st->state = SIM_SD_PRG;
+        st->busy_left = st->card.write_busy;
+    } else {
+        st->state = SIM_SD_TRAN;
+    }
+    st->src = NULL;
+    st->dst = NULL;
+}
+
+/* Card to FIFO, one word per DMA request, until the FIFO or card stalls. */
+static void sim_sdio_pump_rx(sdio_regs_t *r, sim_sdio_state_t *st)
+{
+    uint32_t word;
+    uint32_t n;
+
+    while (st->dpsm) {
+        if (r->DCOUNT > 0u && st->fifo_n < SDIO_FIFO_WORDS && st->src != NULL &&
+            st->card_left > 0u) {
+            memcpy(&word, st->src, 4u);
+            st->src += 4;
+            st->card_left -= 4u;
+            st->fifo[(st->fifo_head + st->fifo_n) % SDIO_FIFO_WORDS] = word;
+            st->fifo_n++;
+            r->DCOUNT -= 4u;
+            if (st->card_left == 0u) {
+                sim_sdio_card_done(st);
+            }
+            if ((r->DLEN - r->DCOUNT) % st->block_size == 0u && !sim_sdio_block_done(r, st)) {
+                return;
+            }
+        }
+        n = st->fifo_n;
+        if (n > 0u && (r->DCTRL & SDIO_DCTRL_DMAEN) != 0u) {
+            sim_dma_request(SIM_DREQ_SDIO);
+        }
+        if (r->DCOUNT == 0u && st->fifo_n == 0u) {
+            sim_sdio_stop(r, st, SDIO_STA_DATAEND);
+            return;
+        }
+        if (st->fifo_n == n &&
+            (n == SDIO_FIFO_WORDS || r->DCOUNT == 0u || st->src == NULL || st->card_left == 0u)) {
+            return;
+        }
+    }
+}
+
+/* DMA to FIFO: each request moves one word into sim_sdio_tx_word(). */
+static void sim_sdio_pump_tx(sdio_regs_t *r, sim_sdio_state_t *st)
+{
+    uint32_t before;
+
+    while (st->dpsm && r->DCOUNT > 0u && (r->DCTRL & SDIO_DCTRL_DMAEN) != 0u) {
+        before = r->DCOUNT;
+        sim_dma_request(SIM_DREQ_SDIO);
+        if (r->DCOUNT == before) {
+            return;
+        }
+    }
+}
+
+static void sim_sdio_pump(sdio_regs_t *r)
+{
+    sim_sdio_state_t *st = &sim_sdio_state;
+
+    if (st->pumping || !st->dpsm) {
+        return;
+    }
+    st->pumping = true;
+    if (st->rx && st->stall) {
+        st->stall = false;
+        sim_sdio_stop(r, st, SDIO_STA_DTIMEOUT);
+    } else if (st->rx) {
+        sim_sdio_pump_rx(r, st);
+    } else {
+        sim_sdio_pump_tx(r, st);
+    }
+    st->pumping = false;
+}
+
+static void sim_sdio_tx_word(sdio_regs_t *r, uint32_t word)
+{
+    sim_sdio_state_t *st = &sim_sdio_state;
+
+    if (!st->dpsm || st->rx || r->DCOUNT == 0u) {
+        return;
+    }
+    memcpy(&st->block[st->block_pos % SIM_SDIO_BLOCK], &word, 4u);
+    st->block_pos += 4u;
+    r->DCOUNT -= 4u;
+    if (st->block_pos == st->block_size) {
+        st->block_pos = 0;
+        /* A card not receiving answers no CRC status: a failed block too. */
+        if (st->dst == NULL) {
+            sim_sdio_stop(r, st, SDIO_STA_DCRCFAIL);
+            return;
+        }
+        if (!sim_sdio_block_done(r, st)) {
+            /* Nothing programmed; a single block write is over. */
+            if (!st->multi) {
+                st->state = SIM_SD_TRAN;
+                st->dst = NULL;
+            }
+            return;
+        }
+        memcpy(st->dst, st->block, st->block_size);
+        st->dst += st->block_size;
+        st->card_left -= st->block_size;
+        if (st->card_left == 0u) {
+            sim_sdio_card_done(st);
+        }
+    }
+    if (r->DCOUNT == 0u) {
+        sim_sdio_stop(r, st, SDIO_STA_DATAEND);
+    }
+}
+
+static uint32_t sim_sdio_rx_word(sdio_regs_t *r)
+{
+    sim_sdio_state_t *st = &sim_sdio_state;
+    uint32_t word;
+
+    if (st->fifo_n == 0u) {
+        return 0;
+    }
+    word = st->fifo[st->fifo_head];
+    st->fifo_head = (st->fifo_head + 1u) % SDIO_FIFO_WORDS;
+    st->fifo_n--;
+    /* Read by the CPU: keep the card streaming. */
+    sim_sdio_pump(r);
+    return word;
+}
+
+static void sim_sdio_dctrl(sdio_regs_t *r, uint32_t val)
+{
+    sim_sdio_state_t *st = &sim_sdio_state;
+
+    if ((val & SDIO_DCTRL_DTEN) == 0u) {
+        st->dpsm = false;
+        sim_dma_release(SIM_DREQ_SDIO);
+        return;
+    }
+    if (st->dpsm) {
+        return;
+    }
+    st->dpsm = true;
+    st->rx = (val & SDIO_DCTRL_DTDIR) != 0u;
+    st->block_size = 1u << reg_field_get(val, SDIO_DCTRL_DBLOCKSIZE);
+    st->fifo_head = 0;
+    st->fifo_n = 0;
+    st->block_pos = 0;
+    r->DCOUNT = r->DLEN;
+    sim_sdio_pump(r);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Card                                                                     */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t sim_sdio_status(const sim_sdio_state_t *st)
+{
+    return (st->state << 9) | ((st->state != SIM_SD_PRG) ? SIM_SDIO_READY_FOR_DATA : 0u) |
+           (st->app ? SIM_SDIO_APP_CMD : 0u);
+}
+
+static void sim_sdio_csd(const sim_sdio_state_t *st, uint32_t w[4])
+{
+    /* Command classes 0, 2, 4, 5, 7, 8 and 10 (switch); READ_BL_LEN 9. */
+    const uint32_t ccc = (0x5B5u << 20) | (9u << 16);
+    uint32_t c;
+
+    if (st->card.sdsc) {
+        /* CSD 1.0 with C_SIZE_MULT 7: (C_SIZE + 1) * 512 blocks. */
+        c = st->card.blocks / 512u - 1u;
+        w[0] = 0x00000032u;
+        w[1] = ccc | (c >> 2);
+        w[2] = ((c & 3u) << 30) | (7u << 15);
+    } else {
+        /* CSD 2.0: (C_SIZE + 1) * 1024 blocks. */
+        c = st->card.blocks / 1024u - 1u;
+        w[0] = 0x40000032u;
+        w[1] = ccc | (c >> 16);
+        w[2] = (c & 0xFFFFu) << 16;
+    }
+    w[3] = 0;
+}
+
+/* CMD6: function group 1 is the access mode, function 1 high speed. */
+static void sim_sdio_switch(sim_sdio_state_t *st, uint32_t arg)
+{
+    bool hs = !st->card.no_high_speed;
+    uint32_t fn = arg & 0xFu;
+    uint32_t result;
+
+    if (fn == 0xFu) {
+        result = st->high_speed ? 1u : 0u;
+    } else if (fn == 0u || (fn == 1u && hs)) {
+        result = fn;
+    } else {
+        result = 0xFu;
+    }
+    if ((arg & REG_BIT(31)) != 0u && result != 0xFu) {
+        st->high_speed = (result == 1u);
+    }
+    memset(st->status, 0, sizeof(st->status));
+    st->status[1] = 100u;                           /* 100 mA */
+    st->status[13] = hs ? 0x03u : 0x01u;            /* Group 1 support bits */
+    st->status[16] = (uint8_t)result;
+    st->src = st->status;
+    st->card_left = sizeof(st->status);
+    st->multi = false;
+    st->state = SIM_SD_DATA;
+}
+
+static void sim_sdio_respond(sdio_regs_t *r, uint32_t cmd, uint32_t resp)
+{
+    r->RESPCMD = cmd;
+    r->RESP[0] = resp;
+    r->STA |= SDIO_STA_CMDREND;
+}
+
+static void sim_sdio_respond_long(sdio_regs_t *r, const uint32_t w[4])
+{
+    r->RESPCMD = SIM_SDIO_NO_RESP_CMD;
+    memcpy((void *)r->RESP, w, 4u * sizeof(uint32_t));
+    r->STA |= SDIO_STA_CMDREND;
+}
+
+/* R3 has all ones where the CRC would be: the host flags CCRCFAIL. */
+static void sim_sdio_respond_r3(sdio_regs_t *r, uint32_t ocr)
+{
+    r->RESPCMD = SIM_SDIO_NO_RESP_CMD;
+    r->RESP[0] = ocr;
+    r->STA |= SDIO_STA_CCRCFAIL;
+}
+
+static bool sim_sdio_rca_match(const sim_sdio_state_t *st, uint32_t arg)
+{
+    return st->rca != 0u && (arg >> 16) == st->rca;
+}
+
+/* Start a block read or write at card address @p arg; false if refused. */
+static bool sim_sdio_access(sdio_regs_t *r, sim_sdio_state_t *st, uint32_t cmd, uint32_t arg)
+{
+    uint32_t size = st->card.blocks * SIM_SDIO_BLOCK;
+    uint32_t addr = st->card.sdsc ? arg : arg * SIM_SDIO_BLOCK;
+    bool write = (cmd == 24u || cmd == 25u);
+    uint32_t status = sim_sdio_status(st);
+
+    if (addr % SIM_SDIO_BLOCK != 0u) {
+        sim_sdio_respond(r, cmd, status | SIM_SDIO_ADDRESS_ERROR);
+        return false;
+    }
+    if ((!st->card.sdsc && arg >= st->card.blocks) || addr >= size) {
+        sim_sdio_respond(r, cmd, status | SIM_SDIO_OUT_OF_RANGE);
+        return false;
+    }
+    st->multi = (cmd == 18u || cmd == 25u);
+    st->card_left = st->multi ? size - addr : SIM_SDIO_BLOCK;
+    if (write) {
+        st->dst = st->card.data + addr;
+        st->state = SIM_SD_RCV;
+    } else if (sim_sdio_take_fault(st, SIM_SDIO_FAULT_DATA_TIMEOUT)) {
+        st->stall = true;
+        st->state = st->multi ? SIM_SD_DATA : SIM_SD_TRAN;
+    } else {
+        st->src = st->card.data + addr;
+        st->state = SIM_SD_DATA;
+    }
+    sim_sdio_respond(r, cmd, status);
+    return true;
+}
+
+/* Returns false if the card does not answer. */
+static bool sim_sdio_card_cmd(sdio_regs_t *r, sim_sdio_state_t *st, uint32_t key, uint32_t arg)
+{
+    uint32_t status = sim_sdio_status(st);
+    uint32_t w[4];
+
+    switch (key) {
+    case 0u:
+        st->state = SIM_SD_IDLE;
+        st->rca = 0;
+        st->wide = false;
+        st->high_speed = false;
+        st->init_left = st->card.init_busy;
+        st->src = NULL;
+        st->dst = NULL;
+        return true;
+    case 8u:
+        if (st->card.sdsc || st->state != SIM_SD_IDLE) {
+            return false;
+        }
+        sim_sdio_respond(r, key, arg & 0xFFFu);
+        return true;
+    case 55u:
+        if (st->state >= SIM_SD_STBY && !sim_sdio_rca_match(st, arg)) {
+            return false;
+        }
+        st->app = true;
+        sim_sdio_respond(r, key, sim_sdio_status(st));
+        return true;
+    case SIM_SDIO_ACMD(41):
+        if (st->state != SIM_SD_IDLE) {
+            return false;
+        }
+        if (st->init_left > 0u || (!st->card.sdsc && (arg & SIM_SDIO_OCR_CCS) == 0u)) {
+            /* Still powering up; an SDHC card never leaves it without HCS. */
+            if (st->init_left > 0u) {
+                st->init_left--;
+            }
+            sim_sdio_respond_r3(r, SIM_SDIO_OCR);
+            return true;
+        }
+        st->state = SIM_SD_READY;
+        sim_sdio_respond_r3(r, SIM_SDIO_OCR | SIM_SDIO_OCR_READY |
+                               (st->card.sdsc ? 0u : SIM_SDIO_OCR_CCS));
+        return true;
+    case 2u:
+        if (st->state != SIM_SD_READY) {
+            return false;
+        }
+        st->state = SIM_SD_IDENT;
+        w[0] = 0x03534453u;         /* MID 3, OID "SD", PNM "SIM01" */
+        w[1] = 0x53494D30u;
+        w[2] = 0x31100000u;
+        w[3] = 0x0001A200u;
+        sim_sdio_respond_long(r, w);
+        return true;
+    case 3u:
+        if (st->state != SIM_SD_IDENT && st->state != SIM_SD_STBY) {
+            return false;
+        }
+        st->state = SIM_SD_STBY;
+        st->rca = SIM_SDIO_RCA;
+        sim_sdio_respond(r, key, ((uint32_t)st->rca << 16) | (status & 0x1FFFu));
+        return true;
+    case 9u:
+        if (st->state != SIM_SD_STBY || !sim_sdio_rca_match(st, arg)) {
+            return false;
+        }
+        sim_sdio_csd(st, w);
+        sim_sdio_respond_long(r, w);
+        return true;
+    case 7u:
+        if (!sim_sdio_rca_match(st, arg)) {
+            /* Selecting another card deselects this one, silently. */
+            if (st->state == SIM_SD_TRAN || st->state == SIM_SD_PRG) {
+                st->state = SIM_SD_STBY;
+            }
+            return false;
+        }
+        if (st->state != SIM_SD_STBY) {
+            return false;
+        }
+        st->state = SIM_SD_TRAN;
+        sim_sdio_respond(r, key, status);
+        return true;
+    case 13u:
+        if (!sim_sdio_rca_match(st, arg) || st->state < SIM_SD_STBY) {
+            return false;
+        }
+        if (st->state == SIM_SD_PRG && st->busy_left == 0u) {
+            st->state = SIM_SD_TRAN;
+        } else if (st->state == SIM_SD_PRG) {
+            st->busy_left--;
+        }
+        sim_sdio_respond(r, key, sim_sdio_status(st));
+        return true;
+    case SIM_SDIO_ACMD(6):
+        if (st->state != SIM_SD_TRAN || (arg & 3u) == 1u || (arg & 3u) == 3u) {
+            return false;
+        }
+        st->wide = (arg & 3u) == 2u;
+        sim_sdio_respond(r, 6u, status);
+        return true;
+    case 6u:
+        if (st->state != SIM_SD_TRAN) {
+            return false;
+        }
+        sim_sdio_switch(st, arg);
+        sim_sdio_respond(r, key, status);
+        return true;
+    case 16u:
+        if (st->state != SIM_SD_TRAN) {
+            return false;
+        }
+        sim_sdio_respond(r, key, status | ((arg != SIM_SDIO_BLOCK) ? SIM_SDIO_BLOCK_LEN_ERROR : 0u));
+        return true;
+    case 17u:
+    case 18u:
+    case 24u:
+    case 25u:
+        if (st->state != SIM_SD_TRAN) {
+            return false;
+        }
+        (void)sim_sdio_access(r, st, key, arg);
+        return true;
+    case 12u:
+        if (st->state == SIM_SD_DATA) {
+            st->state = SIM_SD_TRAN;
+        } else if (st->state == SIM_SD_RCV) {
+            st->state = SIM_SD_PRG;
+            st->busy_left = st->card.write_busy;
+        } else {
+            return false;
+        }
+        st->src = NULL;
+        st->dst = NULL;
+        st->multi = false;
+        st->stall = false;
+        sim_sdio_respond(r, key, status);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void sim_sdio_command(sdio_regs_t *r, uint32_t val)
+{
+    sim_sdio_state_t *st = &sim_sdio_state;
+    uint32_t idx = reg_field_get(val, SDIO_CMD_CMDINDEX);
+    uint32_t wait = reg_field_get(val, SDIO_CMD_WAITRESP);
+    uint32_t key = st->app ? SIM_SDIO_ACMD(idx) : idx;
+    bool powered = reg_field_get(r->POWER, SDIO_POWER_PWRCTRL) == SDIO_POWER_ON &&
+                   (r->CLKCR & SDIO_CLKCR_CLKEN) != 0u;
+    bool answered = false;
+
+    st->app = false;
+    if (key < STM32_ARRAY_SIZE(st->counts)) {
+        st->counts[key]++;
+    }
+    if (st->present && powered && !sim_sdio_take_fault(st, SIM_SDIO_FAULT_CMD_TIMEOUT)) {
+        answered = sim_sdio_card_cmd(r, st, key, r->ARG);
+    }
+    if (wait == SDIO_RESP_NONE) {
+        r->STA = (r->STA & ~(SDIO_STA_CMDREND | SDIO_STA_CCRCFAIL)) | SDIO_STA_CMDSENT;
+    } else if (!answered) {
+        r->STA |= SDIO_STA_CTIMEOUT;
+    }
+    sim_sdio_irq(r);
+    sim_sdio_pump(r);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Register model                                                           */
+/* ------------------------------------------------------------------------ */
+
+static void sim_sdio_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    sdio_regs_t *r = p->regs;
+
+    (void)old;
+    if (off >= SIM_SDIO_OFF(FIFO)) {
+        sim_sdio_tx_word(r, val);
+        return;
+    }
+    switch (off) {
+    case SIM_SDIO_OFF(CMD):
+        if ((val & SDIO_CMD_CPSMEN) != 0u) {
+            sim_sdio_command(r, val);
+        }
+        break;
+    case SIM_SDIO_OFF(DCTRL):
+        sim_sdio_dctrl(r, val);
+        break;
+    case SIM_SDIO_OFF(ICR):
+        r->STA &= ~(val & SDIO_ICR_STATIC);
+        break;
+    case SIM_SDIO_OFF(MASK):
+        sim_sdio_irq(r);
+        break;
+    default:
+        break;
+    }
+}
+
+static uint32_t sim_sdio_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    if (off >= SIM_SDIO_OFF(FIFO)) {
+        return sim_sdio_rx_word(p->regs);
+    }
+    return val;
+}
+
+static void sim_sdio_reset(sim_periph_t *p)
+{
+    (void)p;
+    memset(&sim_sdio_state, 0, sizeof(sim_sdio_state));
+}
+
+const sim_model_t sim_model_sdio = {
+    .regs = sim_sdio_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_sdio_regs),
+    .write = sim_sdio_write,
+    .read = sim_sdio_read,
+    .reset = sim_sdio_reset,
+};
+
+void sim_sdio_insert(sdio_regs_t *sdio, const sim_sdio_card_t *card)
+{
+    sim_sdio_state_t *st = &sim_sdio_state;
+
+    (void)sdio;
+    st->present = (card != NULL);
+    if (card != NULL) {
+        st->card = *card;
+    }
+    st->state = SIM_SD_IDLE;
+    st->rca = 0;
+    st->app = false;
+    st->wide = false;
+    st->high_speed = false;
+    st->init_left = (card != NULL) ? card->init_busy : 0u;
+    st->src = NULL;
+    st->dst = NULL;
+}
+
+void sim_sdio_fault(sdio_regs_t *sdio, uint32_t faults)
+{
+    (void)sdio;
+    sim_sdio_state.faults |= faults;
+}
+
+uint32_t sim_sdio_commands(sdio_regs_t *sdio, uint32_t cmd)
+{
+    (void)sdio;
+    return (cmd < STM32_ARRAY_SIZE(sim_sdio_state.counts)) ? sim_sdio_state.counts[cmd] : 0u;
+}
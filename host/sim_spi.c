@@ -0,0 +1,162 @@
+/**
+ * @file    sim_spi.c
+ * @brief   SPI master model.
+ *
+ * A DR write by an enabled master shifts one frame out instantly: the
+ * attached device hook (or, by default, a MOSI-to-MISO loopback) supplies
+ * the frame shifted in, which lands in DR with RXNE set.  TXE stays set and
+ * BSY stays clear.  A frame arriving while RXNE is still set is lost and
+ * raises OVR, which clears on a DR read followed by an SR read.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_SPI_COUNT   3u
+
+typedef struct {
+    uint32_t base;
+    irqn_t irqn;
+    sim_dreq_t rx_req;
+    sim_dreq_t tx_req;
+} sim_spi_info_t;
+
+typedef struct {
+    uint16_t rdr;
+    bool ovr_dr_read;
+    uint32_t frames;
+    sim_spi_dev_t dev;
+    void *ctx;
+} sim_spi_state_t;
+
+static const sim_spi_info_t sim_spi_info[SIM_SPI_COUNT] = {
+    { SPI1_BASE, SPI1_IRQn, SIM_DREQ_SPI1_RX, SIM_DREQ_SPI1_TX },
+    { SPI2_BASE, SPI2_IRQn, SIM_DREQ_SPI2_RX, SIM_DREQ_SPI2_TX },
+    { SPI3_BASE, SPI3_IRQn, SIM_DREQ_SPI3_RX, SIM_DREQ_SPI3_TX },
+};
+
+static sim_spi_state_t sim_spi_state[SIM_SPI_COUNT];
+
+static const sim_reg_t sim_spi_regs[] = {
+    { .offset = 0x00 },                                         /* CR1 */
+    { .offset = 0x08, .reset = SPI_SR_TXE,                      /* SR */
+      .ro = ~SPI_SR_CRCERR, .w0c = SPI_SR_CRCERR },
+    { .offset = 0x10, .reset = 0x07u },                         /* CRCPR */
+};
+
+static uint32_t sim_spi_index(const sim_periph_t *p)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_SPI_COUNT; i++) {
+        if (sim_spi_info[i].base == p->base) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void sim_spi_update_irq(sim_periph_t *p)
+{
+    spi_regs_t *spi = p->regs;
+    uint32_t sr = spi->SR;
+    uint32_t cr2 = spi->CR2;
+
+    if (((sr & SPI_SR_TXE) && (cr2 & SPI_CR2_TXEIE)) ||
+        ((sr & SPI_SR_RXNE) && (cr2 & SPI_CR2_RXNEIE)) ||
+        ((sr & (SPI_SR_OVR | SPI_SR_MODF)) && (cr2 & SPI_CR2_ERRIE))) {
+        sim_irq_raise(sim_spi_info[sim_spi_index(p)].irqn);
+    }
+}
+
+static uint32_t sim_spi_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    spi_regs_t *spi = p->regs;
+    uint32_t i = sim_spi_index(p);
+    sim_spi_state_t *st = &sim_spi_state[i];
+
+    if (off == 0x0Cu) {
+        spi->SR &= ~SPI_SR_RXNE;
+        st->ovr_dr_read = (spi->SR & SPI_SR_OVR) != 0u;
+        sim_dma_release(sim_spi_info[i].rx_req);
+        return st->rdr;
+    }
+    if (off == 0x08u && st->ovr_dr_read) {
+        spi->SR &= ~SPI_SR_OVR;
+        st->ovr_dr_read = false;
+    }
+    return val;
+}
+
+static void sim_spi_shift(sim_periph_t *p, uint32_t i, uint16_t mosi)
+{
+    spi_regs_t *spi = p->regs;
+    sim_spi_state_t *st = &sim_spi_state[i];
+    uint16_t mask = (spi->CR1 & SPI_CR1_DFF) ? 0xFFFFu : 0x00FFu;
+    uint16_t miso;
+
+    mosi &= mask;
+    miso = (st->dev != NULL) ? st->dev(st->ctx, mosi) : mosi;
+    st->frames++;
+    if ((spi->SR & SPI_SR_RXNE) != 0u) {
+        spi->SR |= SPI_SR_OVR;
+        return;
+    }
+    st->rdr = miso & mask;
+    spi->DR = st->rdr;
+    spi->SR |= SPI_SR_RXNE;
+}
+
+static void sim_spi_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    spi_regs_t *spi = p->regs;
+    uint32_t i = sim_spi_index(p);
+    const uint32_t on = SPI_CR1_SPE | SPI_CR1_MSTR;
+
+    (void)old;
+    if (off == 0x0Cu) {
+        if ((spi->CR1 & on) == on) {
+            sim_spi_shift(p, i, (uint16_t)val);
+        }
+    }
+    sim_spi_update_irq(p);
+    if (off != 0x0Cu && off != 0x04u) {
+        return;
+    }
+    /* DMA requests follow RXNE/TXE while enabled; receive side first so a
+     * full-duplex pair never overruns. */
+    if ((spi->CR2 & SPI_CR2_RXDMAEN) != 0u && (spi->SR & SPI_SR_RXNE) != 0u) {
+        sim_dma_request(sim_spi_info[i].rx_req);
+    }
+    if ((spi->CR2 & SPI_CR2_TXDMAEN) != 0u && (spi->SR & SPI_SR_TXE) != 0u) {
+        sim_dma_request(sim_spi_info[i].tx_req);
+    }
+}
+
+static void sim_spi_reset(sim_periph_t *p)
+{
+    uint32_t i = sim_spi_index(p);
+
+    memset(&sim_spi_state[i], 0, sizeof(sim_spi_state[i]));
+}
+
+const sim_model_t sim_model_spi = {
+    .regs = sim_spi_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_spi_regs),
+    .write = sim_spi_write,
+    .read = sim_spi_read,
+    .reset = sim_spi_reset,
+};
+
+void sim_spi_attach(spi_regs_t *spi, sim_spi_dev_t dev, void *ctx)
+{
+    sim_spi_state_t *st = &sim_spi_state[sim_spi_index(sim_find(spi))];
+
+    st->dev = dev;
+    st->ctx = ctx;
+}
+
+uint32_t sim_spi_frames(spi_regs_t *spi)
+{
+    return sim_spi_state[sim_spi_index(sim_find(spi))].frames;
+}
@@ -0,0 +1,217 @@
+/**
+ * @file    sim_tim.c
+ * @brief   Timer register model (TIM1..TIM5, TIM8).
+ *
+ * The counter does not run on its own: sim_tim_update() lets update events
+ * elapse and sim_tim_advance() lets counter ticks elapse, flagging compare
+ * matches (CCxIF, and the compare interrupt when CCxIE is set) on the way.
+ * An update (overflow or EGR.UG) loads preloaded compare values
+ * into the active set, sets UIF, raises the update interrupt when UIE is
+ * set, and pulses TRGO when CR2.MMS selects it; TRGO of TIM2, TIM3 and TIM8
+ * reaches the ADC regular trigger inputs.  With UDE set it also asserts the
+ * update DMA request, once per transfer of the DCR burst; each DMAR access
+ * lands on the next register from DCR.DBA.  URS = 1 keeps EGR.UG from
+ * flagging, interrupting or requesting DMA.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+typedef struct {
+    uint32_t base;
+    irqn_t irqn;        /**< Update interrupt. */
+    irqn_t cc_irqn;     /**< Capture/compare interrupt. */
+    int8_t trgo;        /**< ADC_EXTSEL_* of TRGO, or -1. */
+    bool wide;          /**< 32-bit counter. */
+    sim_dreq_t up;      /**< Update DMA request. */
+} sim_tim_info_t;
+
+typedef struct {
+    uint32_t ccr[4];    /**< Active (shadow) compare values. */
+    uint32_t burst;     /**< DMAR transfers done in the current burst. */
+} sim_tim_state_t;
+
+static const sim_tim_info_t sim_tim_info[] = {
+    { TIM1_BASE, TIM1_UP_TIM10_IRQn, TIM1_CC_IRQn, -1, false, SIM_DREQ_TIM1_UP },
+    { TIM2_BASE, TIM2_IRQn, TIM2_IRQn, ADC_EXTSEL_TIM2_TRGO, true, SIM_DREQ_TIM2_UP },
+    { TIM3_BASE, TIM3_IRQn, TIM3_IRQn, ADC_EXTSEL_TIM3_TRGO, false, SIM_DREQ_TIM3_UP },
+    { TIM4_BASE, TIM4_IRQn, TIM4_IRQn, -1, false, SIM_DREQ_TIM4_UP },
+    { TIM5_BASE, TIM5_IRQn, TIM5_IRQn, -1, true, SIM_DREQ_TIM5_UP },
+    { TIM8_BASE, TIM8_UP_TIM13_IRQn, TIM8_CC_IRQn, ADC_EXTSEL_TIM8_TRGO, false,
+      SIM_DREQ_TIM8_UP },
+};
+
+static sim_tim_state_t sim_tim_state[STM32_ARRAY_SIZE(sim_tim_info)];
+
+static const sim_reg_t sim_tim_regs[] = {
+    { .offset = 0x10, .w0c = 0x00001EFFu },     /* SR */
+    { .offset = 0x14, .sc = 0x000000FFu },      /* EGR */
+};
+
+static const sim_tim_info_t *sim_tim_find(const sim_periph_t *p)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(sim_tim_info); i++) {
+        if (sim_tim_info[i].base == p->base) {
+            return &sim_tim_info[i];
+        }
+    }
+    return NULL;
+}
+
+static sim_tim_state_t *sim_tim_st(const sim_tim_info_t *info)
+{
+    return &sim_tim_state[info - sim_tim_info];
+}
+
+static void sim_tim_event(sim_periph_t *p, bool ug)
+{
+    tim_regs_t *tim = p->regs;
+    const sim_tim_info_t *info = sim_tim_find(p);
+    sim_tim_state_t *st = sim_tim_st(info);
+    uint32_t ch;
+
+    tim->CNT = 0;
+    for (ch = 0; ch < 4u; ch++) {
+        st->ccr[ch] = tim->CCR[ch];
+    }
+    if (ug && (tim->CR1 & TIM_CR1_URS) != 0u) {
+        return;
+    }
+    tim->SR |= TIM_SR_UIF;
+    if ((tim->DIER & TIM_DIER_UIE) != 0u) {
+        sim_irq_raise(info->irqn);
+    }
+    if (info->trgo >= 0 && reg_field_get(tim->CR2, TIM_CR2_MMS) == TIM_MMS_UPDATE) {
+        sim_adc_trigger((uint32_t)info->trgo);
+    }
+    if ((tim->DIER & TIM_DIER_UDE) != 0u) {
+        st->burst = 0;
+        sim_dma_request(info->up);
+    }
+}
+
+/* One burst transfer through DMAR; requests the next until DBL + 1 are done. */
+static void sim_tim_dmar(sim_periph_t *p, uint32_t val)
+{
+    tim_regs_t *tim = p->regs;
+    const sim_tim_info_t *info = sim_tim_find(p);
+    sim_tim_state_t *st = sim_tim_st(info);
+    uint32_t reg = reg_field_get(tim->DCR, TIM_DCR_DBA) + st->burst;
+
+    if (reg < TIM_DBA(DMAR)) {
+        ((volatile uint32_t *)tim)[reg] = val;
+    }
+    tim->DMAR = 0;
+    if (++st->burst <= reg_field_get(tim->DCR, TIM_DCR_DBL)) {
+        sim_dma_request(info->up);
+    } else {
+        st->burst = 0;
+    }
+}
+
+static void sim_tim_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    switch (off) {
+    case 0x0Cu:     /* DIER */
+        if ((old & TIM_DIER_UDE) != 0u && (val & TIM_DIER_UDE) == 0u) {
+            sim_tim_st(sim_tim_find(p))->burst = 0;
+            sim_dma_release(sim_tim_find(p)->up);
+        }
+        break;
+    case 0x14u:     /* EGR */
+        if ((val & TIM_EGR_UG) != 0u) {
+            sim_tim_event(p, true);
+        }
+        break;
+    case 0x4Cu:     /* DMAR */
+        sim_tim_dmar(p, val);
+        break;
+    default:
+        break;
+    }
+}
+
+static void sim_tim_reset(sim_periph_t *p)
+{
+    tim_regs_t *tim = p->regs;
+    const sim_tim_info_t *info = sim_tim_find(p);
+
+    tim->ARR = info->wide ? 0xFFFFFFFFu : 0xFFFFu;
+    memset(sim_tim_st(info), 0, sizeof(sim_tim_state_t));
+}
+
+void sim_tim_update(tim_regs_t *tim, uint32_t n)
+{
+    sim_periph_t *p = sim_find(tim);
+
+    while (n-- != 0u) {
+        if ((tim->CR1 & TIM_CR1_CEN) == 0u) {
+            return;
+        }
+        sim_tim_event(p, false);
+    }
+}
+
+/* Output-compare channels with a compare value in [@p lo, @p hi] match. */
+static void sim_tim_match(sim_periph_t *p, uint32_t lo, uint32_t hi)
+{
+    tim_regs_t *tim = p->regs;
+    const sim_tim_info_t *info = sim_tim_find(p);
+    uint32_t ch;
+
+    for (ch = 1; ch <= 4u; ch++) {
+        uint32_t ccmr = (ch <= 2u) ? tim->CCMR1 : tim->CCMR2;
+        uint32_t ccr = sim_tim_compare(tim, ch);
+
+        if (reg_field_get(ccmr, TIM_CCMR_CCS(ch)) != 0u || ccr < lo || ccr > hi) {
+            continue;
+        }
+        tim->SR |= TIM_SR_CCIF(ch);
+        if ((tim->DIER & TIM_DIER_CCIE(ch)) != 0u) {
+            sim_irq_raise(info->cc_irqn);
+        }
+    }
+}
+
+void sim_tim_advance(tim_regs_t *tim, uint64_t ticks)
+{
+    sim_periph_t *p = sim_find(tim);
+
+    while (ticks != 0u && (tim->CR1 & TIM_CR1_CEN) != 0u) {
+        uint32_t cnt = tim->CNT;
+        uint64_t to_wrap = (uint64_t)tim->ARR - cnt + 1u;
+
+        if (ticks < to_wrap) {
+            tim->CNT = cnt + (uint32_t)ticks;
+            sim_tim_match(p, cnt + 1u, tim->CNT);
+            return;
+        }
+        /* Up to ARR, then the overflow reloads 0. */
+        if (cnt != tim->ARR) {
+            sim_tim_match(p, cnt + 1u, tim->ARR);
+        }
+        sim_tim_event(p, false);
+        sim_tim_match(p, 0u, 0u);
+        ticks -= to_wrap;
+    }
+}
+
+uint32_t sim_tim_compare(tim_regs_t *tim, uint32_t ch)
+{
+    const sim_tim_info_t *info = sim_tim_find(sim_find(tim));
+    uint32_t ccmr = (ch <= 2u) ? tim->CCMR1 : tim->CCMR2;
+
+    if ((ccmr & TIM_CCMR_OCPE(ch)) == 0u) {
+        return tim->CCR[ch - 1u];
+    }
+    return sim_tim_st(info)->ccr[ch - 1u];
+}
+
+const sim_model_t sim_model_tim = {
+    .regs = sim_tim_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_tim_regs),
+    .write = sim_tim_write,
+    .reset = sim_tim_reset,
+};
@@ -0,0 +1,191 @@
+/**
+ * @file    sim_usart.c
+ * @brief   USART model.
+ *
+ * Transmission is instantaneous: a DR write is captured in a per-instance
+ * log and TXE/TC stay set.  Received frames land in DR one at a time with
+ * overrun detection; IDLE is raised by sim_usart_idle() after at least one
+ * frame.  Flags follow the hardware clearing rules: RXNE/TC are rc_w0, and
+ * IDLE/ORE/NF/FE/PE clear on an SR read followed by a DR read.
+ */
+#include <string.h>
+
+#include "sim.h"
+
+#define SIM_USART_COUNT     6u
+#define SIM_USART_TX_LOG    4096u
+
+#define SIM_USART_ERRORS    (USART_SR_PE | USART_SR_FE | USART_SR_NF | \
+                             USART_SR_ORE | USART_SR_IDLE)
+
+typedef struct {
+    uint32_t base;
+    irqn_t irqn;
+    sim_dreq_t rx_req;
+    sim_dreq_t tx_req;
+} sim_usart_info_t;
+
+typedef struct {
+    uint8_t rdr;
+    bool sr_read;
+    bool rx_since_idle;
+    size_t tx_len;
+    uint8_t tx_log[SIM_USART_TX_LOG];
+} sim_usart_state_t;
+
+static const sim_usart_info_t sim_usart_info[SIM_USART_COUNT] = {
+    { USART1_BASE, USART1_IRQn, SIM_DREQ_USART1_RX, SIM_DREQ_USART1_TX },
+    { USART2_BASE, USART2_IRQn, SIM_DREQ_USART2_RX, SIM_DREQ_USART2_TX },
+    { USART3_BASE, USART3_IRQn, SIM_DREQ_USART3_RX, SIM_DREQ_USART3_TX },
+    { UART4_BASE,  UART4_IRQn,  SIM_DREQ_UART4_RX,  SIM_DREQ_UART4_TX },
+    { UART5_BASE,  UART5_IRQn,  SIM_DREQ_UART5_RX,  SIM_DREQ_UART5_TX },
+    { USART6_BASE, USART6_IRQn, SIM_DREQ_USART6_RX, SIM_DREQ_USART6_TX },
+};
+
+static sim_usart_state_t sim_usart_state[SIM_USART_COUNT];
+
+static const sim_reg_t sim_usart_regs[] = {
+    { .offset = 0x00, .reset = USART_SR_TXE | USART_SR_TC,     /* SR */
+      .ro = SIM_USART_ERRORS | USART_SR_TXE,
+      .w0c = USART_SR_RXNE | USART_SR_TC | USART_SR_LBD | USART_SR_CTS },
+};
+
+static uint32_t sim_usart_index(const sim_periph_t *p)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_USART_COUNT; i++) {
+        if (sim_usart_info[i].base == p->base) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void sim_usart_update_irq(sim_periph_t *p)
+{
+    usart_regs_t *u = p->regs;
+    uint32_t sr = u->SR;
+    uint32_t cr1 = u->CR1;
+
+    if (((sr & USART_SR_TXE) && (cr1 & USART_CR1_TXEIE)) ||
+        ((sr & USART_SR_TC) && (cr1 & USART_CR1_TCIE)) ||
+        ((sr & (USART_SR_RXNE | USART_SR_ORE)) && (cr1 & USART_CR1_RXNEIE)) ||
+        ((sr & USART_SR_IDLE) && (cr1 & USART_CR1_IDLEIE))) {
+        sim_irq_raise(sim_usart_info[sim_usart_index(p)].irqn);
+    }
+}
+
+static uint32_t sim_usart_read(sim_periph_t *p, uint32_t off, uint32_t val)
+{
+    usart_regs_t *u = p->regs;
+    uint32_t i = sim_usart_index(p);
+    sim_usart_state_t *st = &sim_usart_state[i];
+
+    if (off == 0x00u) {
+        st->sr_read = true;
+        return val;
+    }
+    if (off == 0x04u) {
+        u->SR &= ~USART_SR_RXNE;
+        if (st->sr_read) {
+            u->SR &= ~SIM_USART_ERRORS;
+        }
+        st->sr_read = false;
+        sim_dma_release(sim_usart_info[i].rx_req);
+        return st->rdr;
+    }
+    return val;
+}
+
+static void sim_usart_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    usart_regs_t *u = p->regs;
+    uint32_t i = sim_usart_index(p);
+    sim_usart_state_t *st = &sim_usart_state[i];
+    const uint32_t on = USART_CR1_UE | USART_CR1_TE;
+
+    (void)old;
+    if (off == 0x04u) {
+        if ((u->CR1 & on) == on && st->tx_len < SIM_USART_TX_LOG) {
+            st->tx_log[st->tx_len++] = (uint8_t)val;
+        }
+        u->SR |= USART_SR_TXE | USART_SR_TC;
+        if ((u->CR3 & USART_CR3_DMAT) != 0u) {
+            sim_dma_request(sim_usart_info[i].tx_req);
+        }
+    } else if (off == 0x14u) {
+        if ((val & USART_CR3_DMAT) != 0u && (u->SR & USART_SR_TXE) != 0u) {
+            sim_dma_request(sim_usart_info[i].tx_req);
+        }
+    }
+    sim_usart_update_irq(p);
+}
+
+static void sim_usart_reset(sim_periph_t *p)
+{
+    uint32_t i = sim_usart_index(p);
+
+    memset(&sim_usart_state[i], 0, sizeof(sim_usart_state[i]));
+}
+
+const sim_model_t sim_model_usart = {
+    .regs = sim_usart_regs,
+    .nregs = STM32_ARRAY_SIZE(sim_usart_regs),
+    .write = sim_usart_write,
+    .read = sim_usart_read,
+    .reset = sim_usart_reset,
+};
+
+void sim_usart_rx(usart_regs_t *usart, const uint8_t *data, size_t len)
+{
+    sim_periph_t *p = sim_find(usart);
+    uint32_t i = sim_usart_index(p);
+    sim_usart_state_t *st = &sim_usart_state[i];
+    const uint32_t on = USART_CR1_UE | USART_CR1_RE;
+
+    while (len-- != 0u) {
+        uint8_t byte = *data++;
+
+        if ((usart->CR1 & on) != on) {
+            continue;
+        }
+        st->rx_since_idle = true;
+        if ((usart->SR & USART_SR_RXNE) != 0u) {
+            /* Previous frame not read yet: this one is lost. */
+            usart->SR |= USART_SR_ORE;
+        } else {
+            st->rdr = byte;
+            usart->DR = byte;
+            usart->SR |= USART_SR_RXNE;
+        }
+        sim_usart_update_irq(p);
+        if ((usart->CR3 & USART_CR3_DMAR) != 0u && (usart->SR & USART_SR_RXNE) != 0u) {
+            sim_dma_request(sim_usart_info[i].rx_req);
+        }
+    }
+}
+
+void sim_usart_idle(usart_regs_t *usart)
+{
+    sim_periph_t *p = sim_find(usart);
+    sim_usart_state_t *st = &sim_usart_state[sim_usart_index(p)];
+
+    if (!st->rx_since_idle) {
+        return;
+    }
+    st->rx_since_idle = false;
+    usart->SR |= USART_SR_IDLE;
+    sim_usart_update_irq(p);
+}
+
+size_t sim_usart_tx_take(usart_regs_t *usart, uint8_t *buf, size_t max)
+{
+    sim_usart_state_t *st = &sim_usart_state[sim_usart_index(sim_find(usart))];
+    size_t n = (st->tx_len < max) ? st->tx_len : max;
+
+    memcpy(buf, st->tx_log, n);
+    memmove(st->tx_log, st->tx_log + n, st->tx_len - n);
+    st->tx_len -= n;
+    return n;
+}
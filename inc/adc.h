@@ -0,0 +1,110 @@
+/**
+ * @file    adc.h
+ * @brief   ADC driver: timer-triggered scan with DMA and in-place decimation.
+ *
+ * One ADC converts a regular sequence of up to 16 channels on every trigger
+ * (a timer update event, or software).  The DMA stream moves each result
+ * straight into a circular buffer of two halves; the CPU never reads DR.
+ * When a half fills, the stream interrupt decimates it in place (each run
+ * of @p decim consecutive frames is averaged into one, with rounding) and
+ * hands the averaged frames to the callback while the stream fills the
+ * other half.
+ *
+ * The trigger timer (TIM2, TIM3 or TIM8) is owned by the driver and runs as
+ * a plain timebase with TRGO on update.  Clock frequencies come from
+ * rcc_current(), so apply the clock plan before adc_init().
+ *
+ * A DMA overrun (DR overwritten before the stream read it) is recovered from
+ * the ADC interrupt: the stream restarts at the start of the buffer and
+ * adc_t::overruns counts the event.
+ */
+#ifndef STM32_ADC_H
+#define STM32_ADC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+#define ADC_MAX_CHANNELS    16u     /**< Regular sequence length. */
+#define ADC_MAX_HZ          36000000u
+
+/**
+ * Largest decimation factor the paired-lane kernel takes: 16 twelve-bit
+ * samples plus rounding still fit a 16-bit lane.
+ */
+#define ADC_SWAR_MAX_DECIM  16u
+
+typedef enum {
+    ADC_TRIG_SOFTWARE = 0,  /**< One sequence per adc_start(). */
+    ADC_TRIG_TIM2,
+    ADC_TRIG_TIM3,
+    ADC_TRIG_TIM8,
+} adc_trigger_t;
+
+/**
+ * Decimated frames ready (stream interrupt context): @p frames holds
+ * @p nframes frames of one sample per channel, in sequence order.  The data
+ * stay valid until the stream comes back to this half.
+ */
+typedef void (*adc_cb_t)(void *ctx, const uint16_t *frames, uint32_t nframes);
+
+typedef struct {
+    const uint8_t *channels;    /**< Channel of each rank (0..18). */
+    uint8_t nchannels;          /**< 1..ADC_MAX_CHANNELS */
+    uint8_t smp;                /**< ADC_SMP_*, every channel. */
+    uint8_t res;                /**< ADC_RES_* */
+    adc_trigger_t trigger;
+    uint32_t rate_hz;           /**< Sequence rate (timer triggers). */
+    uint16_t *buf;              /**< 2 * half_frames * nchannels samples. */
+    uint16_t half_frames;       /**< Frames per half; a multiple of decim. */
+    uint16_t decim;             /**< Frames averaged per output; 0 or 1: none. */
+    adc_cb_t cb;
+    void *ctx;
+} adc_config_t;
+
+typedef struct {
+    adc_regs_t *adc;
+    tim_regs_t *tim;            /**< Trigger timer; NULL for software. */
+    dma_stream_t *dma;
+    dma_xfer_t xfer;
+    uint16_t *buf;
+    uint8_t nch;
+    uint16_t half_frames;
+    uint16_t decim;
+    adc_cb_t cb;
+    void *ctx;
+    uint32_t rate_hz;           /**< Sequence rate actually programmed. */
+    uint32_t overruns;
+} adc_t;
+
+/**
+ * Power the ADC, program the sequence, claim a DMA stream and set up the
+ * trigger timer.  DRV_ERR_PARAM if the sequence cannot be converted at
+ * @p cfg->rate_hz with the chosen sample time and resolution.
+ */
+drv_status_t adc_init(adc_t *h, adc_regs_t *adc, const adc_config_t *cfg);
+
+/** Start conversions (start the timer, or convert one sequence). */
+drv_status_t adc_start(adc_t *h);
+
+/** Stop triggers and the stream; adc_start() resumes from the buffer start. */
+void adc_stop(adc_t *h);
+
+/** adc_stop(), then release the stream and power the ADC down. */
+void adc_deinit(adc_t *h);
+
+/** ADC interrupt service (overrun recovery); ADC_IRQHandler calls it. */
+void adc_irq(adc_t *h);
+
+/**
+ * Average every run of @p factor frames of @p nch interleaved channels in
+ * @p buf into one frame, in place, rounding to nearest.  Returns the number
+ * of frames left at the start of @p buf (@p frames / @p factor).
+ */
+uint32_t adc_decimate(uint16_t *buf, uint32_t nch, uint32_t frames, uint32_t factor);
+
+#endif /* STM32_ADC_H */
@@ -0,0 +1,52 @@
+/**
+ * @file    bench.h
+ * @brief   Cycle-count benchmark harness.
+ *
+ * On target the time base is the DWT cycle counter (CYCCNT), so results are
+ * core clock cycles.  The host build falls back to the TSC on x86 and to
+ * CLOCK_MONOTONIC nanoseconds elsewhere; host numbers include the register
+ * simulator and are only meaningful relative to each other.
+ *
+ * A benchmark is a table of bench_case_t.  Each sample times one call of
+ * `run`; the counter read overhead is measured once and subtracted.
+ */
+#ifndef STM32_BENCH_H
+#define STM32_BENCH_H
+
+#include <stdint.h>
+
+#include "stm32.h"
+
+#define BENCH_MAX_SAMPLES   256u
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);    /**< Untimed, once before sampling; may be NULL. */
+    void (*run)(void);      /**< Timed body. */
+} bench_case_t;
+
+typedef struct {
+    uint32_t min;
+    uint32_t median;
+    uint32_t max;
+} bench_result_t;
+
+/** Enable the cycle counter and calibrate the read overhead. */
+void bench_init(void);
+
+/** Current cycle count (wraps; use unsigned differences). */
+uint32_t bench_cycles(void);
+
+/** Take @p samples (<= BENCH_MAX_SAMPLES) timings of @p c. */
+void bench_run(const bench_case_t *c, uint32_t samples, bench_result_t *out);
+
+/** Run and report every case of a table. */
+void bench_run_table(const bench_case_t *cases, uint32_t count, uint32_t samples);
+
+/**
+ * Output hook for reports, one line per call.  The default writes to stdout
+ * on the host and discards output on target; override to route it to a UART.
+ */
+void bench_puts(const char *line);
+
+#endif /* STM32_BENCH_H */
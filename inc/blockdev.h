@@ -0,0 +1,67 @@
+/**
+ * @file    blockdev.h
+ * @brief   Block device interface: fixed-size blocks read and written by
+ *          number, for file systems on top of storage drivers.
+ *
+ * A driver fills a blockdev_t (ops, its handle as ctx and the geometry)
+ * and the file system only sees that.  The calls map one to one onto a
+ * FatFs diskio layer:
+ *
+ *     disk_read(pdrv, buf, sector, n)   blockdev_read(bd, sector, buf, n)
+ *     disk_write(pdrv, buf, sector, n)  blockdev_write(bd, sector, buf, n)
+ *     CTRL_SYNC                         blockdev_sync(bd)
+ *     GET_SECTOR_COUNT / GET_SECTOR_SIZE  bd->block_count / bd->block_size
+ *
+ * with any status other than DRV_OK reported as RES_ERROR.  Calls are
+ * blocking and thread mode only; a device is not reentrant.
+ */
+#ifndef STM32_BLOCKDEV_H
+#define STM32_BLOCKDEV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "status.h"
+
+typedef struct {
+    drv_status_t (*read)(void *ctx, uint32_t block, void *buf, uint32_t count);
+    drv_status_t (*write)(void *ctx, uint32_t block, const void *buf, uint32_t count);
+    /** Wait until written data are stored; may be NULL. */
+    drv_status_t (*sync)(void *ctx);
+} blockdev_ops_t;
+
+typedef struct {
+    const blockdev_ops_t *ops;
+    void *ctx;
+    uint32_t block_count;
+    uint32_t block_size;        /**< Bytes per block. */
+} blockdev_t;
+
+/* Range checked here, so drivers see only blocks that exist. */
+STM32_INLINE drv_status_t blockdev_read(const blockdev_t *bd, uint32_t block, void *buf,
+                                        uint32_t count)
+{
+    if (buf == NULL || count == 0u || block >= bd->block_count ||
+        count > bd->block_count - block) {
+        return DRV_ERR_PARAM;
+    }
+    return bd->ops->read(bd->ctx, block, buf, count);
+}
+
+STM32_INLINE drv_status_t blockdev_write(const blockdev_t *bd, uint32_t block,
+                                         const void *buf, uint32_t count)
+{
+    if (buf == NULL || count == 0u || block >= bd->block_count ||
+        count > bd->block_count - block) {
+        return DRV_ERR_PARAM;
+    }
+    return bd->ops->write(bd->ctx, block, buf, count);
+}
+
+STM32_INLINE drv_status_t blockdev_sync(const blockdev_t *bd)
+{
+    return (bd->ops->sync != NULL) ? bd->ops->sync(bd->ctx) : DRV_OK;
+}
+
+#endif /* STM32_BLOCKDEV_H */
@@ -0,0 +1,75 @@
+/**
+ * @file    cache.h
+ * @brief   Flash accelerator and L1 cache enable, cache maintenance by range.
+ *
+ * cache_init() turns on whatever the family has for running from flash at
+ * speed: prefetch plus the instruction and data caches of the flash
+ * interface on F4; prefetch, the ART accelerator and the Cortex-M7 L1
+ * instruction and data caches on F7.  Call it once the flash wait states
+ * are set (rcc_apply()) and before the first DMA transfer.
+ *
+ * The range helpers keep DMA buffers coherent with the F7 data cache:
+ * clean before a stream reads memory the CPU wrote, invalidate before and
+ * after a stream writes memory the CPU will read.  The DMA engine
+ * (dma_submit() and the stream interrupt) calls them itself, so drivers
+ * only need them for memory a stream touches outside a descriptor.  On F4
+ * they compile to nothing.
+ *
+ * Buffers written by DMA should be CACHE_ALIGNED and a multiple of
+ * STM32_CACHE_LINE long: invalidation works on whole lines, and a line
+ * shared with other data is cleaned (written back) first so those data
+ * survive, which can overwrite what the stream stored there.
+ */
+#ifndef STM32_CACHE_H
+#define STM32_CACHE_H
+
+#include <stddef.h>
+
+#include "stm32.h"
+
+/** Align a DMA buffer to a cache line. */
+#define CACHE_ALIGNED           STM32_ALIGNED(STM32_CACHE_LINE)
+
+/** @p n rounded up to whole cache lines. */
+#define CACHE_ROUND(n)          (((n) + STM32_CACHE_LINE - 1u) & ~(STM32_CACHE_LINE - 1u))
+
+/** Enable prefetch, flash caches / ART and (F7) the L1 I- and D-caches. */
+void cache_init(void);
+
+#if STM32_HAS_DCACHE
+
+/** Write back dirty lines covering [p, p + len). */
+void cache_clean(const void *p, size_t len);
+
+/**
+ * Discard lines covering [p, p + len).  Partially covered lines at either
+ * end are cleaned and invalidated instead, so neighbouring data are kept.
+ */
+void cache_invalidate(void *p, size_t len);
+
+/** Write back and discard lines covering [p, p + len). */
+void cache_clean_invalidate(const void *p, size_t len);
+
+#else
+
+STM32_INLINE void cache_clean(const void *p, size_t len)
+{
+    (void)p;
+    (void)len;
+}
+
+STM32_INLINE void cache_invalidate(void *p, size_t len)
+{
+    (void)p;
+    (void)len;
+}
+
+STM32_INLINE void cache_clean_invalidate(const void *p, size_t len)
+{
+    (void)p;
+    (void)len;
+}
+
+#endif /* STM32_HAS_DCACHE */
+
+#endif /* STM32_CACHE_H */
@@ -0,0 +1,207 @@
+/**
+ * @file    can.h
+ * @brief   bxCAN driver: compiled acceptance filters, interrupt-drained
+ *          receive queue and priority-ordered transmit.
+ *
+ * Filtering.  can_filters_set() takes the wanted identifiers as
+ * (id, mask) pairs and compiles them into as few hardware filter banks as
+ * possible: standard identifiers go four to a bank in 16-bit list mode and
+ * standard masks two to a bank in 16-bit mask mode, extended identifiers two
+ * to a bank in 32-bit list mode and extended masks one to a bank; spare
+ * slots of a bank take an exact standard identifier.  Entries another entry
+ * already covers are dropped.  If the result does not fit the instance's
+ * CAN_BANKS_PER_PORT banks, the two entries whose merged mask keeps the most
+ * identifier bits are merged, repeatedly, until it does; frames accepted by
+ * a merged filter are checked against the list in the interrupt and
+ * dropped if nothing in it wants them.  Every other frame costs the CPU no
+ * filtering at all: the filter match index in the receive mailbox maps
+ * straight to the entry, reported in can_frame_t.filter.
+ *
+ * Receive.  The FIFO interrupts drain every pending mailbox of their FIFO
+ * into a lock-free single-producer/single-consumer frame queue, so the
+ * three-deep hardware FIFOs stay empty between bursts; can_recv() takes
+ * frames out from thread context.  CANx_RX0 and CANx_RX1 must run at the
+ * same priority (they share the producer side of the queue).
+ *
+ * Transmit.  can_send() queues frames in a binary heap ordered like bus
+ * arbitration (lowest identifier first, stable among equal identifiers).
+ * The heap top goes into any empty mailbox at once and the transmit
+ * interrupt refills the mailboxes as they empty, so all three stay loaded
+ * while frames are queued.  A frame that outranks everything in the full
+ * mailboxes has the lowest-priority mailbox aborted and requeued, so a
+ * high-priority frame never waits behind more than the frames already on
+ * the wire.  Frames with the same identifier are never in two mailboxes
+ * at once, which keeps them in order.
+ *
+ * F4 and F7 parts have bxCAN; FDCAN (H7, G4) is a different peripheral and
+ * not covered here.  The controller recovers from bus-off by itself
+ * (MCR.ABOM).
+ */
+#ifndef STM32_CAN_H
+#define STM32_CAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "stm32.h"
+
+#define CAN_GPIO_AF         9u          /**< CAN1/CAN2 RX/TX alternate function. */
+
+#define CAN_FRAME_EXT       0x01u       /**< 29-bit identifier. */
+#define CAN_FRAME_RTR       0x02u       /**< Remote frame. */
+
+#define CAN_STD_ID_MASK     0x000007FFu
+#define CAN_EXT_ID_MASK     0x1FFFFFFFu
+#define CAN_MASK_EXACT      0xFFFFFFFFu /**< Match the identifier exactly. */
+
+/** Filter banks per instance: CAN1 owns 0..13, CAN2 14..27. */
+#define CAN_BANKS_PER_PORT  (CAN_FILTER_BANKS / 2u)
+/** Filter numbers per FIFO: every bank in 16-bit list mode. */
+#define CAN_FMI_MAX         (CAN_BANKS_PER_PORT * 4u)
+#define CAN_FILTERS_MAX     64u
+/** can_filter_plan_t.map flag: the element is merged, check in software. */
+#define CAN_FMI_CHECK       0x80u
+
+typedef struct {
+    uint32_t id;
+    uint8_t len;                /**< Data bytes, 0..8 (DLC for remote frames). */
+    uint8_t flags;              /**< CAN_FRAME_EXT, CAN_FRAME_RTR. */
+    uint8_t filter;             /**< Received: index of the accepting entry. */
+    uint8_t fifo;               /**< Received: hardware FIFO. */
+    uint8_t data[8];
+} can_frame_t;
+
+/** Frames wanted: identifiers with (frame id & mask) == (id & mask). */
+typedef struct {
+    uint32_t id;
+    uint32_t mask;              /**< CAN_MASK_EXACT for one identifier. */
+    uint8_t flags;              /**< CAN_FRAME_EXT; CAN_FRAME_RTR: remote frames
+                                     instead of data frames. */
+    uint8_t fifo;               /**< Receive FIFO 0 or 1. */
+} can_filter_t;
+
+/** Banks compiled from a filter list, relative to the instance's first. */
+typedef struct {
+    uint8_t banks;              /**< Banks used. */
+    uint8_t count[CAN_RX_FIFOS]; /**< Filter numbers used per FIFO. */
+    uint16_t fm1r;              /**< List mode, bit per bank. */
+    uint16_t fs1r;              /**< 32-bit scale, bit per bank. */
+    uint16_t ffa1r;             /**< FIFO 1, bit per bank. */
+    uint32_t fr[CAN_BANKS_PER_PORT][2];
+    /** Filter number to entry index, or'ed with CAN_FMI_CHECK. */
+    uint8_t map[CAN_RX_FIFOS][CAN_FMI_MAX];
+} can_filter_plan_t;
+
+/** Driver private: one queued frame. */
+typedef struct {
+    uint32_t key;               /**< TIR image: arbitration order. */
+    uint32_t seq;               /**< Queueing order among equal keys. */
+    can_frame_t frame;
+} can_tx_entry_t;
+
+typedef struct {
+    can_regs_t *can;
+    uint8_t first_bank;
+    /* Receive queue: the FIFO interrupts produce, can_recv() consumes. */
+    can_frame_t *rx_buf;
+    uint32_t rx_mask;
+    volatile uint32_t rx_head;
+    volatile uint32_t rx_tail;
+    /* Transmit heap and what each mailbox holds. */
+    can_tx_entry_t *txq;
+    uint16_t txq_size;
+    uint16_t txq_len;
+    uint32_t tx_seq;
+    can_tx_entry_t mailbox[CAN_TX_MAILBOXES];
+    uint8_t mb_busy;            /**< Mailboxes loaded, bit per mailbox. */
+    uint8_t mb_abort;           /**< Abort requested, bit per mailbox. */
+    /* Acceptance filters in use. */
+    const can_filter_t *filters;
+    uint8_t nfilters;
+    uint8_t map[CAN_RX_FIFOS][CAN_FMI_MAX];
+    /* Counters since can_init(). */
+    uint32_t rx_frames;         /**< Queued for can_recv(). */
+    uint32_t rx_dropped;        /**< Lost: receive queue full. */
+    uint32_t rx_overruns;       /**< Lost: hardware FIFO overrun. */
+    uint32_t rx_rejected;       /**< Accepted by a merged filter, not wanted. */
+    uint32_t tx_frames;         /**< Sent. */
+    uint32_t tx_requeued;       /**< Aborted for a higher-priority frame. */
+    uint32_t errors;            /**< Error interrupts. */
+    uint32_t esr;               /**< ESR at the last error interrupt. */
+} can_t;
+
+typedef struct {
+    uint32_t bitrate;           /**< Bits per second. */
+    uint16_t sample_permille;   /**< Sample point; 0: 875. */
+    bool loopback;              /**< Receive own frames (BTR.LBKM). */
+    bool silent;                /**< Never drive the bus (BTR.SILM). */
+    can_frame_t *rx_buf;        /**< Receive queue storage. */
+    uint32_t rx_size;           /**< Frames; a power of two. */
+    can_tx_entry_t *tx_buf;     /**< Transmit queue storage. */
+    uint16_t tx_size;           /**< Frames queued or in mailboxes, at most. */
+} can_config_t;
+
+/**
+ * BTR value for @p bitrate from a @p pclk_hz kernel clock: the most time
+ * quanta (8..25) that divide the clock exactly, with the sample point
+ * nearest @p sample_permille.  DRV_ERR_PARAM if no exact prescaler exists.
+ */
+drv_status_t can_timing(uint32_t pclk_hz, uint32_t bitrate, uint32_t sample_permille,
+                        uint32_t *btr);
+
+/**
+ * Compile @p n entries of @p filters into at most @p max_banks banks, as
+ * described above.  DRV_ERR_PARAM for a bad entry (identifier wider than
+ * its format, FIFO above 1, more than CAN_FILTERS_MAX entries); DRV_ERR_NORES
+ * if even merging cannot make them fit (standard and extended entries, and
+ * those of different FIFOs, never merge).
+ */
+drv_status_t can_filter_compile(const can_filter_t *filters, size_t n, uint32_t max_banks,
+                                can_filter_plan_t *plan);
+
+/**
+ * Enable the instance (CAN2 needs the CAN1 clock too, for the filters),
+ * program the bit timing from the current PCLK1 and join the bus.  No
+ * frame is received until can_filters_set().  DRV_ERR_TIMEOUT if the
+ * controller does not acknowledge a mode change.
+ */
+drv_status_t can_init(can_t *h, can_regs_t *can, const can_config_t *cfg);
+
+/** Leave the bus (sleep mode); queued frames are dropped. */
+void can_deinit(can_t *h);
+
+/**
+ * Compile @p filters and load them into the instance's banks, replacing
+ * the previous set.  @p filters must stay valid while in use: merged
+ * filters are checked against it.  Frames already received are drained
+ * first, so their filter index refers to the list they were accepted by.
+ */
+drv_status_t can_filters_set(can_t *h, const can_filter_t *filters, size_t n);
+
+/**
+ * Queue @p f for transmission.  DRV_ERR_NORES when tx_size frames are
+ * already queued or in mailboxes; DRV_ERR_PARAM for a bad frame.  Callable
+ * from interrupts that do not preempt CANx_TX.
+ */
+drv_status_t can_send(can_t *h, const can_frame_t *f);
+
+/** Take the oldest received frame; false if the queue is empty. */
+bool can_recv(can_t *h, can_frame_t *f);
+
+/** Frames waiting in the receive queue. */
+STM32_INLINE uint32_t can_rx_count(const can_t *h)
+{
+    return stm32_load_acquire(&h->rx_head) - stm32_load_acquire(&h->rx_tail);
+}
+
+/** Frames queued or in mailboxes, not yet sent. */
+uint32_t can_tx_pending(const can_t *h);
+
+/** Interrupt service; the CANx_TX/RX0/RX1/SCE handlers call them. */
+void can_tx_irq(can_t *h);
+void can_rx_irq(can_t *h, uint32_t fifo);
+void can_sce_irq(can_t *h);
+
+#endif /* STM32_CAN_H */
@@ -0,0 +1,133 @@
+/**
+ * @file    compiler.h
+ * @brief   Toolchain abstraction: inlining, attributes and memory barriers.
+ *
+ * Everything here must be usable from both the arm-none-eabi build and the
+ * host (Linux) build.  GCC and Clang are the only supported compilers.
+ */
+#ifndef STM32_COMPILER_H
+#define STM32_COMPILER_H
+
+#include <stdint.h>
+
+#define STM32_INLINE        static inline __attribute__((always_inline))
+#define STM32_NOINLINE      __attribute__((noinline))
+#define STM32_WEAK          __attribute__((weak))
+#define STM32_UNUSED        __attribute__((unused))
+#define STM32_ALIGNED(n)    __attribute__((aligned(n)))
+#define STM32_PACKED        __attribute__((packed))
+#define STM32_SECTION(s)    __attribute__((section(s)))
+
+/*
+ * Placement in zero-wait-state memory, resolved by the linker scripts in
+ * ld/.  STM32_RAMFUNC runs a function from RAM (F4: SRAM, since the CCM is
+ * data-only; F7: ITCM RAM), copied there at startup; it is a long call so
+ * flash code can reach it.  STM32_FASTDATA (initialised) and STM32_FASTBSS
+ * (zeroed) put data in core-coupled memory (F4: CCM; F7: DTCM).  On the
+ * host they are plain functions and variables.
+ */
+#if defined(__arm__)
+#define STM32_RAMFUNC       __attribute__((section(".ramfunc"), noinline, long_call))
+#define STM32_FASTDATA      STM32_SECTION(".fastdata")
+#define STM32_FASTBSS       STM32_SECTION(".fastbss")
+#else
+#define STM32_RAMFUNC       STM32_NOINLINE
+#define STM32_FASTDATA
+#define STM32_FASTBSS
+#endif
+
+#define STM32_LIKELY(x)     __builtin_expect(!!(x), 1)
+#define STM32_UNLIKELY(x)   __builtin_expect(!!(x), 0)
+
+#define STM32_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/** Compile-time assertion usable at file and block scope. */
+#define STM32_STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+
+#if defined(__arm__)
+
+STM32_INLINE void stm32_dmb(void) { __asm volatile ("dmb 0xF" ::: "memory"); }
+STM32_INLINE void stm32_dsb(void) { __asm volatile ("dsb 0xF" ::: "memory"); }
+STM32_INLINE void stm32_isb(void) { __asm volatile ("isb 0xF" ::: "memory"); }
+
+#else /* host */
+
+STM32_INLINE void stm32_dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+STM32_INLINE void stm32_dsb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+STM32_INLINE void stm32_isb(void) { __asm volatile ("" ::: "memory"); }
+
+#endif /* __arm__ */
+
+/** Prevent the compiler (not the CPU) from reordering memory accesses. */
+#define STM32_COMPILER_BARRIER()    __asm volatile ("" ::: "memory")
+
+/*
+ * Single-word publish/consume between contexts (ISR vs. thread, DMA, or host
+ * threads in tests).  Both are one aligned 32-bit access plus a barrier: no
+ * exclusive monitors, no interrupt masking.
+ */
+#if defined(__arm__)
+
+STM32_INLINE uint32_t stm32_load_acquire(const volatile uint32_t *p)
+{
+    uint32_t v = *p;
+    stm32_dmb();
+    return v;
+}
+
+STM32_INLINE void stm32_store_release(volatile uint32_t *p, uint32_t v)
+{
+    stm32_dmb();
+    *p = v;
+}
+
+#else /* host */
+
+STM32_INLINE uint32_t stm32_load_acquire(const volatile uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+STM32_INLINE void stm32_store_release(volatile uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+#endif /* __arm__ */
+
+/*
+ * Short critical sections (a few list pointer updates) shared between thread
+ * mode and interrupt handlers.  The host build has no interrupts to mask.
+ */
+#if defined(__arm__)
+
+STM32_INLINE uint32_t stm32_irq_save(void)
+{
+    uint32_t primask;
+
+    __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory");
+    return primask;
+}
+
+STM32_INLINE void stm32_irq_restore(uint32_t primask)
+{
+    __asm volatile ("msr primask, %0" :: "r" (primask) : "memory");
+}
+
+#else /* host */
+
+STM32_INLINE uint32_t stm32_irq_save(void)
+{
+    STM32_COMPILER_BARRIER();
+    return 0u;
+}
+
+STM32_INLINE void stm32_irq_restore(uint32_t primask)
+{
+    (void)primask;
+    STM32_COMPILER_BARRIER();
+}
+
+#endif /* __arm__ */
+
+#endif /* STM32_COMPILER_H */
@@ -0,0 +1,114 @@
+/**
+ * @file    crc.h
+ * @brief   32-bit CRC: hardware unit with DMA feed, slicing-by-8 fallback.
+ *
+ * A CRC is described by a crc_spec_t (polynomial, preset, final XOR and bit
+ * order).  crc_compute() runs it on the CRC unit when the unit can do the
+ * spec, feeding it one word per store, and in software otherwise.  The F4
+ * unit has a fixed polynomial (0x04C11DB7) and preset (0xFFFFFFFF); reflected
+ * and byte-order specs on that polynomial still go through it, with the
+ * words bit- or byte-reversed by the CPU on the way in.  The F7 unit takes
+ * any 32-bit polynomial and preset.
+ *
+ * crc_compute_dma() hands large word-aligned blocks to a memory-to-memory
+ * DMA stream that writes them straight into the unit while the CPU does
+ * other work.  The DMA cannot reverse bits, so it serves CRC_ORDER_WORD
+ * specs on both families and CRC_ORDER_LSB on F7 (whose unit reverses
+ * input and output itself).  CRC_ORDER_WORD with the F4 defaults is
+ * crc_spec_stm32, the checksum the unit produces natively and image tools
+ * such as `srec_cat -STM32` generate, which makes it the cheapest choice
+ * for flash image checks.
+ *
+ * The software engine processes 8 bytes per step with eight 256-entry
+ * tables (8 KiB, caller-supplied so it can live wherever memory allows);
+ * without a table it falls back to a bit loop.  The host build without the
+ * register simulator always uses it.
+ *
+ * There is one CRC unit: while a DMA computation runs, crc_compute() on any
+ * handle uses software (or returns DRV_ERR_BUSY without a table).
+ */
+#ifndef STM32_CRC_H
+#define STM32_CRC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+/** Below this many bytes crc_compute_dma() computes in place. */
+#define CRC_DMA_MIN_BYTES   256u
+
+typedef enum {
+    CRC_ORDER_MSB = 0,      /**< Bytes MSB first (CRC-32/MPEG-2, CRC-32/BZIP2). */
+    CRC_ORDER_LSB,          /**< Reflected input and result (CRC-32, CRC-32C). */
+    CRC_ORDER_WORD,         /**< Little-endian words MSB first; length a multiple of 4. */
+} crc_order_t;
+
+typedef struct {
+    uint32_t poly;          /**< Normal (MSB-first) form, x^32 implied. */
+    uint32_t init;          /**< Register preset, unreflected. */
+    uint32_t xorout;        /**< XORed into the final value. */
+    crc_order_t order;
+} crc_spec_t;
+
+extern const crc_spec_t crc_spec_crc32;     /**< zlib, Ethernet, PNG. */
+extern const crc_spec_t crc_spec_crc32c;    /**< Castagnoli (iSCSI, ext4). */
+extern const crc_spec_t crc_spec_mpeg2;
+extern const crc_spec_t crc_spec_stm32;     /**< MPEG-2 over words: the unit's own. */
+
+/** Slicing-by-8 lookup tables for one polynomial and bit order. */
+typedef struct {
+    uint32_t t[8][256];
+} crc_table_t;
+
+/** DMA computation finished (stream interrupt context). */
+typedef void (*crc_done_cb_t)(void *ctx, drv_status_t status, uint32_t crc);
+
+typedef struct {
+    crc_spec_t spec;
+    const crc_table_t *table;   /**< NULL: bitwise software path. */
+    bool hw;                    /**< The unit can compute the spec. */
+    dma_stream_t *dma;          /**< NULL: no DMA feed. */
+    dma_xfer_t xfer[2];         /**< Chunks alternate between the two. */
+    const uint8_t *next;        /**< Next chunk to feed. */
+    uint32_t words_left;
+    const uint8_t *tail;        /**< Bytes after the last whole word. */
+    uint8_t tail_len;
+    uint8_t chunk;
+    crc_done_cb_t cb;
+    void *ctx;
+} crc_t;
+
+/**
+ * Set up @p h for @p spec.  @p table, if not NULL, is filled here and must
+ * stay valid; it may be shared by handles with the same polynomial and bit
+ * order.  @p use_dma claims a memory-to-memory stream (DMA2) when the spec
+ * can be fed by DMA.  Enables the CRC unit clock.
+ */
+drv_status_t crc_init(crc_t *h, const crc_spec_t *spec, crc_table_t *table, bool use_dma);
+
+/** Release the DMA stream. */
+void crc_deinit(crc_t *h);
+
+/** CRC of @p len bytes at @p data, on the unit when possible. */
+drv_status_t crc_compute(crc_t *h, const void *data, size_t len, uint32_t *out);
+
+/** CRC of @p len bytes at @p data in software only. */
+uint32_t crc_compute_sw(const crc_t *h, const void *data, size_t len);
+
+/**
+ * Start a DMA computation of @p len bytes at @p data; @p cb gets the result.
+ * Blocks the stream cannot take (short, unaligned, or a spec the DMA cannot
+ * feed) are computed in place and @p cb runs before this returns.
+ * DRV_ERR_BUSY while another DMA computation runs.
+ */
+drv_status_t crc_compute_dma(crc_t *h, const void *data, size_t len,
+                             crc_done_cb_t cb, void *ctx);
+
+/** True while a DMA computation owns the unit. */
+bool crc_busy(void);
+
+#endif /* STM32_CRC_H */
@@ -0,0 +1,165 @@
+/**
+ * @file    dma.h
+ * @brief   DMA stream allocator and transfer engine (DMA1/DMA2).
+ *
+ * Drivers ask for a stream by request line (dma_alloc()); the allocator
+ * walks the stream/channel routes of RM0090 tables 42/43 and hands out the
+ * first free one, so two drivers can never program the same stream.
+ *
+ * A stream is configured once (direction, data sizes, increment, mode) and
+ * then fed transfer descriptors.  Descriptors submitted while the stream is
+ * busy are queued and started from the transfer-complete interrupt, and
+ * their callbacks run in submission order.  Circular and double-buffer
+ * transfers never complete: their callback sees every half/full event
+ * until dma_abort().
+ *
+ * On parts with a data cache the engine keeps descriptor buffers coherent:
+ * dma_submit() cleans what the stream will read and invalidates what it
+ * will write, and the interrupt invalidates each filled half/buffer again
+ * before the callback runs.  See cache.h for buffer alignment.
+ *
+ * The stream interrupt handlers are provided here and dispatch to the
+ * owning stream.  Allocation is thread mode only.
+ */
+#ifndef STM32_DMA_H
+#define STM32_DMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "stm32.h"
+
+/** Peripheral request lines (RM0090 tables 42 and 43). */
+typedef enum {
+    DMA_REQ_MEM = 0,        /**< Memory-to-memory (DMA2 only, any stream). */
+    DMA_REQ_USART1_RX,
+    DMA_REQ_USART1_TX,
+    DMA_REQ_USART2_RX,
+    DMA_REQ_USART2_TX,
+    DMA_REQ_USART3_RX,
+    DMA_REQ_USART3_TX,
+    DMA_REQ_UART4_RX,
+    DMA_REQ_UART4_TX,
+    DMA_REQ_UART5_RX,
+    DMA_REQ_UART5_TX,
+    DMA_REQ_USART6_RX,
+    DMA_REQ_USART6_TX,
+    DMA_REQ_SPI1_RX,
+    DMA_REQ_SPI1_TX,
+    DMA_REQ_SPI2_RX,
+    DMA_REQ_SPI2_TX,
+    DMA_REQ_SPI3_RX,
+    DMA_REQ_SPI3_TX,
+    DMA_REQ_I2C1_RX,
+    DMA_REQ_I2C1_TX,
+    DMA_REQ_I2C2_RX,
+    DMA_REQ_I2C2_TX,
+    DMA_REQ_I2C3_RX,
+    DMA_REQ_I2C3_TX,
+    DMA_REQ_ADC1,
+    DMA_REQ_ADC2,
+    DMA_REQ_ADC3,
+    DMA_REQ_TIM1_UP,
+    DMA_REQ_TIM2_UP,
+    DMA_REQ_TIM3_UP,
+    DMA_REQ_TIM4_UP,
+    DMA_REQ_TIM5_UP,
+    DMA_REQ_TIM8_UP,
+    DMA_REQ_SDIO,
+    DMA_REQ_QUADSPI,
+    DMA_REQ_COUNT
+} dma_req_t;
+
+/**
+ * Transfer event callback, called from the stream interrupt.  @p events is
+ * a mask of DMA_FLAG_HTIF / DMA_FLAG_TCIF / DMA_FLAG_TEIF / DMA_FLAG_DMEIF.
+ */
+typedef void (*dma_cb_t)(void *ctx, uint32_t events);
+
+typedef struct {
+    uint8_t dir;            /**< DMA_DIR_P2M / M2P / M2M. */
+    uint8_t psize;          /**< DMA_SIZE_* of the peripheral (M2M: source) side. */
+    uint8_t msize;          /**< DMA_SIZE_* of the memory (M2M: destination) side. */
+    uint8_t priority;       /**< 0 (low) .. 3 (very high). */
+    bool pinc;
+    bool minc;
+    bool circular;          /**< Restart automatically; never completes. */
+    bool half;              /**< Also report half-transfer events. */
+    bool fifo;              /**< FIFO mode (forced for M2M and size packing). */
+    uint8_t burst;          /**< DMA_BURST_* on both sides; forces FIFO mode.
+                                 A burst of either size must fit the 16-byte
+                                 FIFO, and must not cross a 1 KiB boundary. */
+    bool pfctrl;            /**< The peripheral ends the transfer (SDIO); the
+                                 descriptor count is then only an upper bound
+                                 used for cache maintenance.  Not circular. */
+} dma_config_t;
+
+typedef struct dma_xfer dma_xfer_t;
+
+/**
+ * One transfer.  The descriptor is owned by the engine from dma_submit()
+ * until its callback has run (or dma_abort()) and must stay valid until then.
+ */
+struct dma_xfer {
+    uint32_t periph;        /**< Peripheral (M2M: source) bus address, REG_ADDR(). */
+    void *mem0;             /**< Memory (M2M: destination) buffer. */
+    void *mem1;             /**< Second buffer: enables double-buffer mode. */
+    uint16_t count;         /**< Data items in peripheral size units. */
+    dma_cb_t cb;
+    void *ctx;
+    dma_xfer_t *next;       /**< Engine private: queue link. */
+};
+
+typedef struct {
+    dma_regs_t *dma;
+    dma_stream_regs_t *regs;
+    irqn_t irqn;
+    uint8_t ctrl;           /**< 0 = DMA1, 1 = DMA2. */
+    uint8_t stream;
+    uint8_t channel;
+    bool used;
+    uint32_t cr;            /**< Configured SxCR without EN, DBM and CT. */
+    uint32_t fcr;
+    dma_xfer_t *head;       /**< Transfer on the stream; NULL when idle. */
+    dma_xfer_t *tail;
+} dma_stream_t;
+
+/**
+ * Allocate a free stream routed to @p req and enable its controller clock.
+ * Returns DRV_ERR_NORES when every candidate stream is taken.
+ */
+drv_status_t dma_alloc(dma_req_t req, dma_stream_t **out);
+
+/** Abort any transfer and return the stream to the pool. */
+void dma_free(dma_stream_t *s);
+
+/** Set the transfer parameters; the stream must be idle. */
+drv_status_t dma_configure(dma_stream_t *s, const dma_config_t *cfg);
+
+/**
+ * Queue @p x; it starts at once if the stream is idle.  Callable from thread
+ * mode and from a transfer callback (to chain the next transfer).
+ */
+drv_status_t dma_submit(dma_stream_t *s, dma_xfer_t *x);
+
+/** Stop the stream and drop every queued transfer without callbacks. */
+void dma_abort(dma_stream_t *s);
+
+/** Items left in the running transfer (NDTR). */
+uint32_t dma_remaining(const dma_stream_t *s);
+
+/** Double-buffer mode: buffer the DMA is currently filling/draining (0 or 1). */
+uint32_t dma_current_target(const dma_stream_t *s);
+
+/** Pending interrupt flags of the stream (DMA_FLAG_*). */
+uint32_t dma_flags(const dma_stream_t *s);
+
+/** Clear interrupt flags of the stream. */
+void dma_clear(const dma_stream_t *s, uint32_t flags);
+
+/** Service the interrupt of stream @p stream on controller @p dma. */
+void dma_irq(dma_regs_t *dma, uint32_t stream);
+
+#endif /* STM32_DMA_H */
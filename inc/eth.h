@@ -0,0 +1,231 @@
+/**
+ * @file    eth.h
+ * @brief   Ethernet MAC driver: DMA descriptor rings over a packet buffer
+ *          pool, checksum offload and interrupt coalescing.
+ *
+ * Buffers.  Frames live in fixed-size packet buffers (eth_pbuf_t) taken
+ * from an eth_pool_t.  Every receive descriptor points straight at a pool
+ * buffer, so a received frame is handed up in the buffer the DMA wrote it
+ * to: eth_recv() gives the buffer to the caller and puts a fresh one from
+ * the pool in its descriptor.  eth_send() likewise points transmit
+ * descriptors at the caller's buffers (one per segment of a chain, so a
+ * header and a payload can go out without being joined) and returns them
+ * to the pool once sent.  The driver never copies frame data.
+ *
+ * Ownership.  A descriptor belongs to the DMA while its OWN bit is set and
+ * to the driver otherwise; each side only touches descriptors it owns.
+ * The rings are worked from thread context only (eth_recv(), eth_send(),
+ * eth_tx_reclaim()); the interrupt reads and acknowledges the DMA status,
+ * nothing else, so no lock is needed.  On F7 the descriptors and buffers
+ * are kept coherent with the data cache by the driver; descriptor arrays
+ * must be ETH_DESC_ALIGNED (one descriptor per cache line).
+ *
+ * Checksum offload.  With csum_offload the MAC inserts the IPv4 header and
+ * TCP/UDP/ICMP checksums of outgoing frames (pseudo-header included; leave
+ * the fields zero) and verifies those of incoming ones: frames that fail
+ * are dropped by the hardware, frames that pass carry ETH_RX_CSUM_OK so the
+ * stack can skip its own check.  Both need store-and-forward in the FIFOs,
+ * which the driver selects.
+ *
+ * Interrupt coalescing.  Receive descriptors raise the receive interrupt
+ * only every rx_coalesce frames (RDES1.DIC on the others); the receive
+ * watchdog (DMARSWTR) raises it rx_timeout_us after a frame that did not,
+ * so a lone frame is never left waiting.  Transmit descriptors request a
+ * completion interrupt every tx_coalesce frames, and the
+ * buffer-unavailable interrupt fires once the DMA has drained the ring.
+ *
+ * Frames are at most ETH_FRAME_MAX bytes, so every frame fits one receive
+ * buffer; the FCS is stripped on receive and appended on transmit.  The
+ * PHY is reached over MDIO at phy_addr and must follow the IEEE 802.3
+ * clause 22 register set; eth_link_poll() takes speed and duplex from the
+ * auto-negotiation result.
+ */
+#ifndef STM32_ETH_H
+#define STM32_ETH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "status.h"
+#include "stm32.h"
+
+#define ETH_GPIO_AF         11u         /**< MII/RMII and MDIO alternate function. */
+
+#define ETH_PBUF_SIZE       1536u       /**< Buffer bytes; whole cache lines. */
+#define ETH_FRAME_MAX       1522u       /**< Without FCS, VLAN tag included. */
+#define ETH_HEADER_LEN      14u
+#define ETH_RX_TIMEOUT_US   100u        /**< Default receive watchdog. */
+
+/* IEEE 802.3 clause 22 PHY registers used by the driver */
+#define ETH_PHY_BMCR        0u
+#define ETH_PHY_BMSR        1u
+#define ETH_PHY_ANAR        4u
+#define ETH_PHY_ANLPAR      5u
+
+#define ETH_BMCR_RESET      0x8000u
+#define ETH_BMSR_LINK       0x0004u     /**< Latched low: read twice for the current state. */
+#define ETH_BMSR_ANC        0x0020u     /**< Auto-negotiation complete. */
+#define ETH_AN_10HD         0x0020u     /**< ANAR/ANLPAR abilities. */
+#define ETH_AN_10FD         0x0040u
+#define ETH_AN_100HD        0x0080u
+#define ETH_AN_100FD        0x0100u
+
+/** Descriptor array alignment: one descriptor per cache line. */
+#define ETH_DESC_ALIGNED    CACHE_ALIGNED
+
+/* eth_pbuf_t.flags on receive */
+#define ETH_RX_IPV4         0x0001u     /**< IPv4 frame. */
+#define ETH_RX_CSUM_OK      0x0002u     /**< Header and TCP/UDP/ICMP checksums verified. */
+
+/* Events passed to eth_config_t.event */
+#define ETH_EVENT_RX        0x01u       /**< Frames to eth_recv(). */
+#define ETH_EVENT_TX        0x02u       /**< Sent descriptors to eth_tx_reclaim(). */
+#define ETH_EVENT_RX_STALL  0x04u       /**< Receive ring was full: frames were lost. */
+#define ETH_EVENT_ERROR     0x08u       /**< DMA bus error: the DMA has stopped. */
+
+/** Packet buffer. */
+typedef struct eth_pbuf {
+    struct eth_pbuf *next;      /**< Next segment of a transmit chain; free list link. */
+    uint8_t *data;              /**< ETH_PBUF_SIZE bytes, cache-line aligned. */
+    uint16_t len;               /**< Bytes used. */
+    uint16_t flags;             /**< Received: ETH_RX_*. */
+} eth_pbuf_t;
+
+typedef struct {
+    eth_pbuf_t *free;
+    uint16_t size;              /**< Buffers in the pool. */
+    uint16_t avail;             /**< Buffers free. */
+    uint16_t min_avail;         /**< Lowest avail seen. */
+} eth_pool_t;
+
+/** Statically allocate a pool of @p n buffers named @p name; ETH_POOL_INIT() it. */
+#define ETH_POOL_DEFINE(name, n)                                            \
+    static eth_pbuf_t name##_pbufs[n];                                      \
+    static uint8_t name##_data[(n) * ETH_PBUF_SIZE] CACHE_ALIGNED;          \
+    static eth_pool_t name
+
+#define ETH_POOL_INIT(name)                                                 \
+    eth_pool_init(&(name), name##_pbufs, name##_data, STM32_ARRAY_SIZE(name##_pbufs))
+
+typedef struct eth eth_t;
+
+typedef void (*eth_event_t)(eth_t *h, uint32_t events);
+
+typedef struct {
+    uint8_t mac[6];
+    bool rmii;                  /**< RMII instead of MII (SYSCFG_PMC). */
+    uint8_t phy_addr;
+    bool promiscuous;
+    bool all_multicast;
+    bool csum_offload;
+    eth_pool_t *pool;
+    eth_dma_desc_t *rx_desc;    /**< rx_count descriptors, ETH_DESC_ALIGNED. */
+    eth_pbuf_t **rx_pbuf;       /**< rx_count entries. */
+    uint16_t rx_count;
+    eth_dma_desc_t *tx_desc;    /**< tx_count descriptors, ETH_DESC_ALIGNED. */
+    eth_pbuf_t **tx_pbuf;       /**< tx_count entries. */
+    uint16_t tx_count;
+    uint8_t rx_coalesce;        /**< Frames per receive interrupt; 0: 1. */
+    uint16_t rx_timeout_us;     /**< Receive watchdog; 0: ETH_RX_TIMEOUT_US. */
+    uint8_t tx_coalesce;        /**< Frames per transmit interrupt; 0: 1. */
+    eth_event_t event;          /**< From the ETH interrupt; may be NULL. */
+    void *ctx;
+} eth_config_t;
+
+struct eth {
+    eth_regs_t *eth;
+    eth_pool_t *pool;
+    eth_event_t event;
+    void *ctx;
+    uint8_t phy_addr;
+    uint8_t mdc_div;            /**< MACMIIAR.CR. */
+    bool csum;
+    /* Receive ring: rx_next is the oldest descriptor handed to the DMA. */
+    eth_dma_desc_t *rx_desc;
+    eth_pbuf_t **rx_pbuf;
+    uint16_t rx_count;
+    uint16_t rx_next;
+    /* Transmit ring: tx_head is the next free descriptor, tx_tail the oldest in use. */
+    eth_dma_desc_t *tx_desc;
+    eth_pbuf_t **tx_pbuf;       /**< Chain to free, at its last descriptor. */
+    uint16_t tx_count;
+    uint16_t tx_head;
+    uint16_t tx_tail;
+    uint16_t tx_used;
+    uint8_t tx_coalesce;
+    uint8_t tx_since_ic;        /**< Frames queued since the last IC request. */
+    /* Link, from eth_link_poll(). */
+    bool link;
+    bool fast;                  /**< 100 Mbit/s. */
+    bool full_duplex;
+    volatile uint32_t events;   /**< ETH_EVENT_* seen by the interrupt, or'ed. */
+    /* Counters since eth_init(). */
+    uint32_t irqs;
+    uint32_t rx_frames;         /**< Handed up by eth_recv(). */
+    uint32_t rx_errors;         /**< Dropped: error reported by the MAC. */
+    uint32_t rx_nobuf;          /**< Dropped: pool empty, buffer reused. */
+    uint32_t rx_stalls;         /**< Receive ring full (RBUS). */
+    uint32_t tx_frames;         /**< Sent and reclaimed. */
+    uint32_t tx_errors;
+};
+
+/**
+ * Set up @p pool over @p n buffer headers and @p n * ETH_PBUF_SIZE bytes of
+ * @p storage (cache-line aligned).
+ */
+drv_status_t eth_pool_init(eth_pool_t *pool, eth_pbuf_t *pbufs, uint8_t *storage, uint32_t n);
+
+/** Take a buffer (len 0, no next); NULL if the pool is empty.  Any context. */
+eth_pbuf_t *eth_pbuf_alloc(eth_pool_t *pool);
+
+/** Return @p p and every buffer chained after it to the pool.  Any context. */
+void eth_pbuf_free(eth_pool_t *pool, eth_pbuf_t *p);
+
+/**
+ * Enable the MAC, fill the receive ring from the pool and start both DMA
+ * directions at 100 Mbit/s full duplex (eth_link_poll() corrects it).
+ * DRV_ERR_PARAM for a bad configuration or HCLK below 25 MHz;
+ * DRV_ERR_NORES if the pool cannot fill the receive ring;
+ * DRV_ERR_TIMEOUT if the DMA reset does not complete (no PHY clock).
+ */
+drv_status_t eth_init(eth_t *h, const eth_config_t *cfg);
+
+/** Stop both directions and return every ring buffer to the pool. */
+void eth_deinit(eth_t *h);
+
+/**
+ * Next received frame, or NULL.  The buffer is the caller's: give it
+ * back with eth_pbuf_free().  Frames with errors are dropped here, as are
+ * frames arriving while the pool is empty (their buffer stays in the ring).
+ */
+eth_pbuf_t *eth_recv(eth_t *h);
+
+/**
+ * Queue the frame in @p p (chained segments with non-zero len, ETH_FRAME_MAX
+ * bytes at most in all) for transmission; the driver owns the chain from
+ * now and frees it to the pool once sent.  DRV_ERR_NORES if the ring has
+ * too few free descriptors (after reclaiming), DRV_ERR_PARAM for a bad
+ * chain; the caller keeps the chain on error.
+ */
+drv_status_t eth_send(eth_t *h, eth_pbuf_t *p);
+
+/** Free the buffers of sent frames; returns the number of frames. */
+uint32_t eth_tx_reclaim(eth_t *h);
+
+/** Read PHY register @p reg over MDIO.  DRV_ERR_TIMEOUT if the MAC stays busy. */
+drv_status_t eth_phy_read(eth_t *h, uint32_t reg, uint16_t *val);
+
+drv_status_t eth_phy_write(eth_t *h, uint32_t reg, uint16_t val);
+
+/**
+ * Read the PHY link state; once auto-negotiation is complete, set the MAC
+ * speed and duplex to the best mode both ends advertise.  True if the
+ * link is up.
+ */
+bool eth_link_poll(eth_t *h);
+
+/** Interrupt service; ETH_IRQHandler calls it for the initialised instance. */
+void eth_irq(eth_t *h);
+
+#endif /* STM32_ETH_H */
@@ -0,0 +1,99 @@
+/**
+ * @file    flash.h
+ * @brief   Internal flash programming and sector erase.
+ *
+ * Programming uses the widest parallelism the supply allows: 32-bit words
+ * from 2.7 V, 64-bit double words with the 8-9 V VPP supply applied (both
+ * families; the F4/F7 flash interface has no wider flash-word mode).  Lower
+ * supplies need byte or half-word stores and are not supported.  Erase
+ * uses the same parallelism, which also sets its speed.
+ *
+ * While the array is being programmed or erased, any read from flash
+ * stalls the bus until the operation finishes.  The store-and-wait loops
+ * therefore run from RAM (STM32_RAMFUNC): the CPU waits on the status
+ * register instead of on a stalled fetch, and interrupt handlers that live
+ * in RAM keep running.  Handlers in flash still stall while an erase runs,
+ * for up to a few seconds on the large sectors; plan erases accordingly.
+ *
+ * Flash can only clear bits: programming data that would need a 1 where a
+ * 0 is stored fails verification with DRV_ERR_HW.  Erase first.  After each
+ * operation the flash caches (F4 data and instruction caches, F7 ART and
+ * L1 data cache lines) are flushed, so reads see the new contents.  Code
+ * rewritten in place needs its own instruction cache maintenance before it
+ * runs (or a reset).
+ *
+ * Addresses are bus addresses (FLASH_MEM_BASE + offset); read the array
+ * through flash_ptr(), which also works on the host, where the register
+ * simulator emulates the array with flash semantics.  CR is unlocked for
+ * each operation and locked again afterwards.  Not reentrant.
+ */
+#ifndef STM32_FLASH_H
+#define STM32_FLASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "stm32.h"
+
+/**
+ * Select the parallelism for a supply of @p vdd_mv (0: 3300), with or
+ * without VPP.  DRV_ERR_PARAM below 2.7 V without VPP.
+ */
+drv_status_t flash_init(uint32_t vdd_mv, bool vpp);
+
+/** Bytes per program operation: 4 (x32) or 8 (x64); 0 before flash_init(). */
+uint32_t flash_unit(void);
+
+/** Sector holding @p addr, or FLASH_SECTOR_COUNT outside the array. */
+uint32_t flash_sector_of(uint32_t addr);
+
+/** Bus address of the first byte of @p sector. */
+uint32_t flash_sector_base(uint32_t sector);
+
+/** Size of @p sector in bytes. */
+uint32_t flash_sector_size(uint32_t sector);
+
+/** The array at @p addr, for reading. */
+const void *flash_ptr(uint32_t addr);
+
+/** Erase @p sector to all ones. */
+drv_status_t flash_erase_sector(uint32_t sector);
+
+/** Erase every sector overlapping [@p addr, @p addr + @p len). */
+drv_status_t flash_erase(uint32_t addr, uint32_t len);
+
+/**
+ * Program @p len bytes of @p data at @p addr and verify them.  @p addr and
+ * @p len must be multiples of flash_unit(); @p data may have any alignment.
+ * DRV_ERR_HW if the interface reports an error (write protection,
+ * sequence) or the read-back differs.
+ */
+drv_status_t flash_program(uint32_t addr, const void *data, size_t len);
+
+/**
+ * Streaming writer: takes data in pieces of any length and programs whole
+ * units as they fill, keeping a partial unit until more data or
+ * flash_writer_close().
+ */
+typedef struct {
+    uint32_t addr;          /**< Where buf goes. */
+    uint32_t end;           /**< End of the region. */
+    uint8_t buf[8];         /**< Partial unit. */
+    uint8_t fill;           /**< Bytes in buf. */
+} flash_writer_t;
+
+/**
+ * Start writing at @p addr (a multiple of flash_unit()), at most @p len
+ * bytes.  The region must be erased beforehand.
+ */
+drv_status_t flash_writer_open(flash_writer_t *w, uint32_t addr, uint32_t len);
+
+/** Append @p len bytes; DRV_ERR_PARAM (nothing written) past the region. */
+drv_status_t flash_writer_write(flash_writer_t *w, const void *data, size_t len);
+
+/** Program the partial unit, padded with 0xFF (the erased value). */
+drv_status_t flash_writer_close(flash_writer_t *w);
+
+#endif /* STM32_FLASH_H */
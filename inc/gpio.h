@@ -0,0 +1,116 @@
+/**
+ * @file    gpio.h
+ * @brief   GPIO driver: atomic port operations and pin groups.
+ *
+ * Every output operation is a single store to BSRR, which sets and resets
+ * any combination of the 16 pins of a port atomically with respect to
+ * interrupts and other bus masters; ODR is never read-modified-written.
+ * The only exception is toggle, which has to read ODR first: the store is
+ * still atomic, but a concurrent change to the same pins between the read
+ * and the store is lost.
+ *
+ * On Cortex-M4 parts single-pin write and read go through the bit-band
+ * alias of ODR/IDR: one store or load, no shift and no branch on the level.
+ * Elsewhere (F7, host) they fall back to BSRR / IDR.
+ *
+ * A pin group is a contiguous run of pins of one port (e.g. a parallel
+ * data bus) written or read as one value.
+ */
+#ifndef STM32_GPIO_H
+#define STM32_GPIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "stm32.h"
+
+#if STM32_HAS_BITBAND && !defined(STM32_HOST)
+#define GPIO_USE_BITBAND    1
+#else
+#define GPIO_USE_BITBAND    0
+#endif
+
+#define GPIO_PIN(n)         ((uint16_t)(1u << (n)))
+
+typedef struct {
+    uint8_t mode;       /**< GPIO_MODE_* */
+    uint8_t otype;      /**< GPIO_OTYPE_* */
+    uint8_t speed;      /**< GPIO_SPEED_* */
+    uint8_t pull;       /**< GPIO_PULL_* */
+    uint8_t af;         /**< Alternate function 0..15 (GPIO_MODE_AF only). */
+} gpio_config_t;
+
+typedef struct {
+    gpio_regs_t *port;
+    uint16_t mask;      /**< Pins of the group, in port bit positions. */
+    uint8_t shift;      /**< Lowest pin of the group. */
+} gpio_group_t;
+
+/** Enable the port clock and apply @p cfg to every pin in @p pins. */
+drv_status_t gpio_configure(gpio_regs_t *port, uint16_t pins, const gpio_config_t *cfg);
+
+/** Describe @p width contiguous pins starting at @p first. */
+drv_status_t gpio_group_init(gpio_group_t *g, gpio_regs_t *port, uint8_t first, uint8_t width);
+
+STM32_INLINE void gpio_set(gpio_regs_t *port, uint16_t pins)
+{
+    REG_WRITE(port->BSRR, pins);
+}
+
+STM32_INLINE void gpio_clear(gpio_regs_t *port, uint16_t pins)
+{
+    REG_WRITE(port->BSRR, (uint32_t)pins << 16);
+}
+
+/** Drive @p pins to the matching bits of @p value; other pins are untouched. */
+STM32_INLINE void gpio_write_masked(gpio_regs_t *port, uint16_t pins, uint16_t value)
+{
+    REG_WRITE(port->BSRR, ((uint32_t)(pins & (uint16_t)~value) << 16) | (pins & value));
+}
+
+/** Invert @p pins (one ODR read, one BSRR store). */
+STM32_INLINE void gpio_toggle(gpio_regs_t *port, uint16_t pins)
+{
+    uint32_t odr = REG_READ(port->ODR);
+
+    REG_WRITE(port->BSRR, ((odr & pins) << 16) | (~odr & pins));
+}
+
+/** Whole-port input levels. */
+STM32_INLINE uint16_t gpio_read(gpio_regs_t *port)
+{
+    return (uint16_t)REG_READ(port->IDR);
+}
+
+STM32_INLINE void gpio_pin_write(gpio_regs_t *port, uint32_t pin, bool level)
+{
+#if GPIO_USE_BITBAND
+    STM32_BB_PERIPH(port->ODR, pin) = level;
+#else
+    /* Set bit n or reset bit n + 16, without a branch. */
+    REG_WRITE(port->BSRR, 1u << (pin + (level ? 0u : 16u)));
+#endif
+}
+
+STM32_INLINE bool gpio_pin_read(gpio_regs_t *port, uint32_t pin)
+{
+#if GPIO_USE_BITBAND
+    return STM32_BB_PERIPH(port->IDR, pin) != 0u;
+#else
+    return ((REG_READ(port->IDR) >> pin) & 1u) != 0u;
+#endif
+}
+
+/** Drive the group to @p value (bit 0 = lowest pin) in one store. */
+STM32_INLINE void gpio_group_write(const gpio_group_t *g, uint16_t value)
+{
+    gpio_write_masked(g->port, g->mask, (uint16_t)(value << g->shift));
+}
+
+STM32_INLINE uint16_t gpio_group_read(const gpio_group_t *g)
+{
+    return (uint16_t)((REG_READ(g->port->IDR) & g->mask) >> g->shift);
+}
+
+#endif /* STM32_GPIO_H */
@@ -0,0 +1,113 @@
+/**
+ * @file    i2c.h
+ * @brief   I2C master driver: queued, interrupt/DMA-driven transactions.
+ *
+ * A transaction is the usual register access: START, address + W, the
+ * register (or memory) address, optional payload, then a repeated START,
+ * address + R and the read data, then STOP.  Any of the three parts may be
+ * empty; with all three empty it is an address probe (ACK polling).
+ *
+ * Transactions are queued with i2c_submit() and run entirely from the event
+ * and error interrupts: the register address bytes are written from the
+ * event handler, payloads and read data move by DMA, and the next queued
+ * transaction starts from the completion of the previous one.  Nothing
+ * ever waits for the bus.
+ *
+ * A NACK from the target ends the transaction with DRV_ERR_NACK.  Bus errors
+ * and lost arbitration end it with DRV_ERR_HW and reset the interface.  A bus
+ * found busy before a START (typically a target reset mid-read that still
+ * holds SDA low) is recovered by clocking SCL by hand until SDA is released
+ * and generating a STOP, then the transaction proceeds.
+ */
+#ifndef STM32_I2C_H
+#define STM32_I2C_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+#define I2C_GPIO_AF         4u          /**< SCL/SDA alternate function. */
+#define I2C_STANDARD_HZ     100000u
+#define I2C_FAST_HZ         400000u
+#define I2C_RECOVERY_CLOCKS 9u          /**< SCL pulses before giving up. */
+
+typedef struct i2c_xfer i2c_xfer_t;
+
+/** Transaction done (called from interrupt context). */
+typedef void (*i2c_done_cb_t)(void *ctx, i2c_xfer_t *x, drv_status_t status);
+
+struct i2c_xfer {
+    uint8_t addr;           /**< 7-bit target address. */
+    uint8_t reg_len;        /**< Register address bytes, 0..4. */
+    uint32_t reg;           /**< Register address, sent MSB first. */
+    const uint8_t *tx;      /**< Payload written after the register address. */
+    uint16_t tx_len;
+    uint8_t *rx;            /**< Read after a repeated START. */
+    uint16_t rx_len;
+    i2c_done_cb_t cb;
+    void *ctx;
+    i2c_xfer_t *next;       /**< Driver private: queue link. */
+};
+
+typedef struct {
+    i2c_regs_t *i2c;
+    dma_stream_t *rx;
+    dma_stream_t *tx;
+    dma_xfer_t rxd;
+    dma_xfer_t txd;
+    i2c_xfer_t *head;       /**< Running transaction; NULL when idle. */
+    i2c_xfer_t *tail;
+    uint8_t state;          /**< Driver private: transaction phase. */
+    uint8_t reg_left;       /**< Register address bytes still to send. */
+    gpio_regs_t *scl_port;
+    gpio_regs_t *sda_port;
+    uint8_t scl_pin;
+    uint8_t sda_pin;
+    uint32_t cr2;           /**< Timing registers, reloaded after a reset. */
+    uint32_t ccr;
+    uint32_t trise;
+    uint32_t spins;         /**< Delay loop for half an SCL period at 100 kHz. */
+    uint32_t recoveries;    /**< Bus recoveries since i2c_init(). */
+} i2c_bus_t;
+
+typedef struct {
+    uint32_t speed_hz;      /**< SCL rate, at most I2C_FAST_HZ. */
+    gpio_regs_t *scl_port;
+    uint8_t scl_pin;
+    gpio_regs_t *sda_port;
+    uint8_t sda_pin;
+} i2c_config_t;
+
+/**
+ * Enable the I2C clock, claim the DMA streams, switch the pins to the I2C
+ * alternate function (open drain, external pull-ups) and program the timing
+ * for @p cfg->speed_hz from the current PCLK1.
+ */
+drv_status_t i2c_init(i2c_bus_t *bus, i2c_regs_t *i2c, const i2c_config_t *cfg);
+
+/** Release the DMA streams and disable the instance; the queue is dropped. */
+void i2c_deinit(i2c_bus_t *bus);
+
+/** Queue a transaction; it starts immediately if the bus is idle. */
+drv_status_t i2c_submit(i2c_bus_t *bus, i2c_xfer_t *x);
+
+/** True while transactions are queued or running. */
+bool i2c_busy(const i2c_bus_t *bus);
+
+/**
+ * Free a bus held low by a target: clock SCL up to I2C_RECOVERY_CLOCKS times
+ * until SDA reads high, generate a STOP by hand and reset the interface.
+ * Busy-waits for roughly 100 us; the driver calls it itself when needed.
+ * DRV_ERR_HW if SDA is still low.
+ */
+drv_status_t i2c_recover(i2c_bus_t *bus);
+
+/** Event and error interrupt service; the I2Cx_EV/ER handlers call them. */
+void i2c_ev_irq(i2c_bus_t *bus);
+void i2c_er_irq(i2c_bus_t *bus);
+
+#endif /* STM32_I2C_H */
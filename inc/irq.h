@@ -0,0 +1,104 @@
+/**
+ * @file    irq.h
+ * @brief   NVIC priorities and the RAM vector table.
+ *
+ * irq_init() copies the boot vector table into RAM and points VTOR at the
+ * copy.  irq_set_handler() then patches an entry in place, so the core
+ * vectors straight to the registered function: there is no common
+ * dispatcher looking up a handler pointer on every interrupt.  Handlers
+ * that a driver defines under its CMSIS name (DMA1_Stream0_IRQHandler, ...)
+ * come along from the boot table unchanged.
+ *
+ * The table lives in section .ram_vectors, which the linker scripts in ld/
+ * put in DTCM on F7 (zero-wait-state vector fetches next to the stack
+ * pushes) and at the start of SRAM on F4.  The F4 CCM cannot
+ * hold it: the core fetches vectors below 0x20000000 over the I-code bus,
+ * which CCM is not connected to.
+ *
+ * Priorities are split by the grouping into a preemption level and a
+ * sub-priority.  Only the preemption level decides whether one handler
+ * interrupts another; the sub-priority orders handlers that are pending
+ * together.  Give high-rate, short handlers (DMA streams, ADC, PWM updates)
+ * the lower preemption numbers and bookkeeping handlers (USART idle, I2C
+ * errors, timer wheels) the higher ones, so a long bookkeeping handler
+ * never delays a sample.  The same scheme applies to the system handlers
+ * (SVCall_IRQn .. SysTick_IRQn).
+ *
+ * With the register simulator, an enabled interrupt raised by a model (or
+ * through STIR/ISPR) runs its RAM table entry synchronously, honouring
+ * preemption levels, so registration and priority logic can be tested on
+ * the host.
+ */
+#ifndef STM32_IRQ_H
+#define STM32_IRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "status.h"
+#include "stm32.h"
+
+/** Vector table entries: 16 core exceptions, then the peripheral lines. */
+#define IRQ_VECTORS         (16u + STM32_IRQ_COUNT)
+
+/** Preemption bits irq_init() configures: 4 levels, 4 sub-priorities each. */
+#define IRQ_PREEMPT_BITS_DEFAULT    2u
+
+typedef void (*irq_handler_t)(void);
+
+/**
+ * Copy @p boot (IRQ_VECTORS entries; NULL: the table VTOR points at) into
+ * the RAM table, switch VTOR to it and set @p preempt_bits (0..4) of
+ * preemption level.  Interrupts are masked for the switch.
+ */
+drv_status_t irq_init(const irq_handler_t *boot, uint32_t preempt_bits);
+
+/** The RAM vector table (entry 16 + n is interrupt n). */
+const irq_handler_t *irq_vector_table(void);
+
+/**
+ * Install @p handler for @p irqn (peripheral or system handler) and return
+ * the previous one.  The line's enable state is not changed.
+ */
+irq_handler_t irq_set_handler(irqn_t irqn, irq_handler_t handler);
+
+/** Set the number of preemption bits (0..NVIC_PRIO_BITS). */
+drv_status_t irq_set_grouping(uint32_t preempt_bits);
+
+/** Preemption bits of the current grouping. */
+uint32_t irq_grouping(void);
+
+/**
+ * Give @p irqn preemption level @p preempt and sub-priority @p sub under the
+ * current grouping.  Lower numbers win.  NMI and HardFault are fixed.
+ */
+drv_status_t irq_set_priority(irqn_t irqn, uint32_t preempt, uint32_t sub);
+
+/** Raw priority byte of @p irqn (implemented bits at the top). */
+uint8_t irq_priority(irqn_t irqn);
+
+void irq_enable(irqn_t irqn);
+void irq_disable(irqn_t irqn);
+bool irq_enabled(irqn_t irqn);
+void irq_set_pending(irqn_t irqn);
+void irq_clear_pending(irqn_t irqn);
+bool irq_pending(irqn_t irqn);
+bool irq_active(irqn_t irqn);
+
+/** Pend @p irqn through the software trigger register (privileged only). */
+void irq_trigger(irqn_t irqn);
+
+/**
+ * Time @p samples (<= BENCH_MAX_SAMPLES) software-triggered entries into
+ * spare line @p irqn: cycles from the STIR store to the first instruction
+ * of the handler, less the counter read overhead.  The line's handler and
+ * enable state are restored afterwards.  Needs bench_init() and interrupts
+ * unmasked; DRV_ERR_TIMEOUT if the handler never runs.
+ */
+drv_status_t irq_measure_latency(irqn_t irqn, uint32_t samples, bench_result_t *out);
+
+/** Default table entry: an interrupt nobody handles.  Weak; spins. */
+void irq_unhandled(void);
+
+#endif /* STM32_IRQ_H */
@@ -0,0 +1,106 @@
+/**
+ * @file    memdma.h
+ * @brief   memcpy/memset offloaded to a memory-to-memory DMA stream.
+ *
+ * A memdma_t owns one DMA2 stream.  memdma_copy() and memdma_set() hand
+ * blocks at or above the handle's thresholds to the stream and return at
+ * once; the callback (or memdma_poll()/memdma_wait()) reports completion.
+ * Smaller blocks are done inline and the callback runs before the call
+ * returns, so callers need only one code path.
+ *
+ * The CPU does the few bytes that bring the destination to a 16-byte
+ * boundary and the tail.  When the source then lines up too, the stream
+ * moves four-word bursts; a source with the same word alignment goes in
+ * single words; any other source is read in bytes and packed into words
+ * by the stream FIFO.  Blocks longer than one transfer (NDTR) are chained
+ * from the completion interrupt.  The stream runs at low priority so
+ * peripheral streams on DMA2 keep their latency.
+ *
+ * The DMA engine keeps the F7 data cache coherent (dma.h); buffers should
+ * still follow cache.h if the CPU touches neighbouring data meanwhile.
+ * Buffers and the handle itself (memset reads its pattern from it) must be
+ * reachable by DMA2: not in the F4 CCM.  Source and destination must not
+ * overlap.  The host build without the register simulator runs everything
+ * inline.  The DMA2D of the F429/F7 parts is not used: this tree has no
+ * driver for it, and the streams exist on every part.
+ */
+#ifndef STM32_MEMDMA_H
+#define STM32_MEMDMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+/*
+ * Default crossovers in bytes.  Starting a stream and taking its interrupt
+ * costs some 400 core cycles on F4 and 600 on F7 (cache maintenance
+ * included), against about 0.4 (F4) and 0.3 (F7) cycles per byte for an
+ * inline word copy and roughly half that for a fill.  The bench rows
+ * memcpy_* / memdma_* time both paths; adjust copy_min/set_min per
+ * handle to what they show for the memory and toolchain in use.
+ */
+#if defined(STM32F7)
+#define MEMDMA_COPY_MIN_BYTES   2048u
+#define MEMDMA_SET_MIN_BYTES    4096u
+#else
+#define MEMDMA_COPY_MIN_BYTES   1024u
+#define MEMDMA_SET_MIN_BYTES    2048u
+#endif
+
+/** Operation finished (stream interrupt context, or the caller's). */
+typedef void (*memdma_cb_t)(void *ctx, drv_status_t status);
+
+typedef struct {
+    dma_stream_t *dma;          /**< NULL: everything inline. */
+    size_t copy_min;            /**< memdma_copy() threshold. */
+    size_t set_min;             /**< memdma_set() threshold. */
+    dma_xfer_t xfer;
+    uint8_t *dst;               /**< Next chunk. */
+    const uint8_t *src;         /**< NULL for a fill. */
+    size_t left;                /**< Bytes still to hand to the stream. */
+    uint32_t pattern;           /**< Fill word (stream source). */
+    uint32_t chunk;             /**< Source items per transfer. */
+    uint8_t shift;              /**< log2 of the source item size. */
+    volatile bool busy;
+    volatile drv_status_t status;   /**< Result of the last operation. */
+    memdma_cb_t cb;
+    void *ctx;
+} memdma_t;
+
+/**
+ * Claim a memory-to-memory stream for @p m and set the default
+ * thresholds.  DRV_ERR_NORES when no stream is free; @p m then works
+ * inline.
+ */
+drv_status_t memdma_init(memdma_t *m);
+
+/** Release the stream; an operation in flight is abandoned. */
+void memdma_deinit(memdma_t *m);
+
+/**
+ * Copy @p len bytes from @p src to @p dst.  @p cb (may be NULL) runs when
+ * the copy is complete.  DRV_ERR_BUSY while the previous operation on @p m
+ * is running.
+ */
+drv_status_t memdma_copy(memdma_t *m, void *dst, const void *src, size_t len,
+                         memdma_cb_t cb, void *ctx);
+
+/** Fill @p len bytes at @p dst with @p value; see memdma_copy(). */
+drv_status_t memdma_set(memdma_t *m, void *dst, uint8_t value, size_t len,
+                        memdma_cb_t cb, void *ctx);
+
+/**
+ * Whether an operation is still running.  Finishes one whose stream has
+ * completed but whose interrupt has not been taken (masked, or the line
+ * not enabled), so polling works without the interrupt.
+ */
+bool memdma_poll(memdma_t *m);
+
+/** Spin until the running operation ends; its status. */
+drv_status_t memdma_wait(memdma_t *m);
+
+#endif /* STM32_MEMDMA_H */
@@ -0,0 +1,95 @@
+/**
+ * @file    pwm.h
+ * @brief   Multi-channel PWM on a timer, duty cycles streamed by DMA burst.
+ *
+ * Channels 1..n of one timer (TIM1..TIM5, TIM8) run edge-aligned PWM mode 1
+ * at a common frequency with compare preload on.  A waveform is a table of
+ * frames, one duty value (in timer ticks, 0..period) per channel.  On every
+ * update event the timer raises one DMA request and the DCR burst writes the
+ * next frame through DMAR into CCR1..CCRn; the CPU touches no register
+ * while a waveform plays.
+ *
+ * The burst written at update k sits in the preload registers until update
+ * k + 1, so pwm_start() primes the first two frames itself: frame 0 is
+ * already on the outputs in the first period and frame i in period i.
+ *
+ * Looping waveforms never end; the callback reports each half of the table
+ * once the DMA has moved it, so a streaming producer can refill it.  A
+ * one-shot waveform calls back once when the last frame has been loaded;
+ * that frame then stays on the outputs until pwm_stop() or pwm_set().
+ *
+ * Pin setup is the caller's: the CHx pins go to the timer's alternate
+ * function (AF1 for TIM1/TIM2, AF2 for TIM3..TIM5, AF3 for TIM8).  Clock
+ * frequencies come from rcc_current(), so apply the clock plan first.
+ */
+#ifndef STM32_PWM_H
+#define STM32_PWM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+#define PWM_MAX_CHANNELS    4u
+
+/**
+ * Waveform progress (stream interrupt context): frames [@p frame,
+ * @p frame + @p nframes) of the table have been loaded and may be rewritten.
+ */
+typedef void (*pwm_cb_t)(void *ctx, uint32_t frame, uint32_t nframes);
+
+typedef struct {
+    uint32_t freq_hz;           /**< PWM frequency. */
+    uint8_t nchannels;          /**< Channels 1..nchannels, 1..PWM_MAX_CHANNELS. */
+    bool active_low;            /**< Invert every output. */
+    pwm_cb_t cb;
+    void *ctx;
+} pwm_config_t;
+
+typedef struct {
+    tim_regs_t *tim;
+    dma_stream_t *dma;
+    dma_xfer_t xfer;
+    uint8_t nch;
+    bool advanced;              /**< TIM1/TIM8: main output enable needed. */
+    bool loop;
+    uint16_t nframes;
+    uint32_t period;            /**< Ticks per period: a duty of 100 %. */
+    uint32_t freq_hz;           /**< Frequency actually programmed. */
+    pwm_cb_t cb;
+    void *ctx;
+} pwm_t;
+
+/**
+ * Clock the timer, program prescaler and period for @p cfg->freq_hz, set the
+ * channels to PWM with preload and claim the update DMA stream.  Outputs are
+ * enabled at 0 % duty with the counter stopped.  DRV_ERR_PARAM if the
+ * frequency gives fewer than 2 or more than 65535 ticks per period at any
+ * prescaler.
+ */
+drv_status_t pwm_init(pwm_t *h, tim_regs_t *tim, const pwm_config_t *cfg);
+
+/**
+ * Play @p nframes frames of @p table (nchannels values each) from the
+ * first period, once or in a loop.  @p table must stay valid until the
+ * waveform ends or pwm_stop().  Looping needs an even frame count (the
+ * callback reports halves) and at least two frames.
+ */
+drv_status_t pwm_start(pwm_t *h, const uint16_t *table, uint16_t nframes, bool loop);
+
+/**
+ * Set a steady duty per channel (@p duty holds nchannels values), effective
+ * from the next period; starts the counter if needed.  Stops a waveform.
+ */
+void pwm_set(pwm_t *h, const uint16_t *duty);
+
+/** Stop the counter and the stream; outputs go inactive (0 % duty). */
+void pwm_stop(pwm_t *h);
+
+/** pwm_stop(), then disable the outputs and release the stream. */
+void pwm_deinit(pwm_t *h);
+
+#endif /* STM32_PWM_H */
@@ -0,0 +1,123 @@
+/**
+ * @file    qspi.h
+ * @brief   Serial NOR flash on the QUADSPI: execute-in-place reads through
+ *          the memory-mapped bank, DMA page programs and sector erase.
+ *
+ * Between operations the flash is memory-mapped: it reads at QSPIMEM_BASE
+ * (0x90000000) with the quad I/O fast read command (0xEB, 1-4-4: opcode on
+ * one line, address, mode byte and data on four), so code can run from it
+ * and assets are plain const data, fetched by the QUADSPI as the CPU reads
+ * them with no command setup per access.  qspi_ptr() gives the address of
+ * a flash offset; qspi_read() copies from there.
+ *
+ * qspi_write() and qspi_erase() leave memory-mapped mode for the duration
+ * of the operation (nothing may read the bank meanwhile: no code or data
+ * used during the call may live there) and map the flash again before
+ * returning.  Pages are programmed with one DMA transfer each into the
+ * FIFO, on DMA2 stream 7, the QUADSPI's only route: call qspi_init()
+ * before memdma_init(), which takes the highest free stream.  The
+ * flash's busy time (write enable latch, then the write in progress bit)
+ * is waited for with the QUADSPI's automatic status polling, which reads
+ * the status register in hardware until it matches, so the bus carries
+ * one status read per poll interval rather than a stream of commands from
+ * the CPU.  Written ranges are invalidated in the F7 data cache
+ * afterwards; code rewritten in place needs its own instruction cache
+ * maintenance.
+ *
+ * The command set is the common JEDEC one (0x06, 0x05, 0x02, 0x20, 0xD8,
+ * 0xC7, 0x9F, 0x66/0x99) with three address bytes, for flash of up to
+ * 16 MiB.  How the quad lines are enabled differs per vendor (qspi_qe_t);
+ * the non-volatile enable bit is only written when not already set.
+ * Operations block the caller and are thread mode only; completion is
+ * polled, the QUADSPI interrupt is not used.  Pins (CLK, BK1_NCS and
+ * BK1_IO0..3, very high speed) are the application's to set to their
+ * alternate function, AF9 or AF10 depending on the pin.
+ */
+#ifndef STM32_QSPI_H
+#define STM32_QSPI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+#define QSPI_PAGE_SIZE      256u
+#define QSPI_SECTOR_SIZE    4096u       /**< Smallest erase unit (0x20). */
+#define QSPI_BLOCK_SIZE     65536u      /**< Block erase unit (0xD8). */
+
+#define QSPI_MAX_HZ         80000000u   /**< Default clock limit. */
+#define QSPI_DUMMY_CYCLES   4u          /**< Default 0xEB dummy cycles after the mode byte. */
+
+/** Where the flash keeps its quad enable (QE) bit. */
+typedef enum {
+    QSPI_QE_NONE = 0,       /**< None: quad always available (Micron) or set at the factory. */
+    QSPI_QE_SR2_BIT1,       /**< Status register 2 bit 1 (Winbond, GigaDevice). */
+    QSPI_QE_SR1_BIT6,       /**< Status register 1 bit 6 (Macronix, ISSI). */
+} qspi_qe_t;
+
+typedef struct {
+    uint8_t size_log2;      /**< Flash size 2^n bytes, 16 .. 24. */
+    uint32_t max_hz;        /**< Flash clock limit; 0: QSPI_MAX_HZ. */
+    uint8_t dummy_cycles;   /**< 0: QSPI_DUMMY_CYCLES. */
+    qspi_qe_t qe;
+    uint8_t dma_priority;   /**< 0 (low) .. 3 (very high). */
+} qspi_config_t;
+
+typedef struct {
+    quadspi_regs_t *qspi;
+    dma_stream_t *dma;
+    dma_xfer_t xfer;
+    uint8_t dma_priority;
+    uint32_t size;              /**< Bytes. */
+    uint32_t jedec_id;          /**< Manufacturer, type, capacity (0x9F), first in bits 23:16. */
+    uint32_t clock_hz;
+    uint32_t map_ccr;           /**< CCR of the memory-mapped read. */
+    bool mapped;
+    volatile bool dma_busy;
+    volatile bool dma_error;
+    /* Counters since qspi_init(). */
+    uint32_t pages;             /**< Page programs. */
+    uint32_t erases;
+    uint32_t polls;             /**< Automatic status polling runs. */
+    uint32_t timeouts;
+    /** One page, padded to whole words with 0xFF (which programs nothing). */
+    uint8_t page[QSPI_PAGE_SIZE] CACHE_ALIGNED;
+} qspi_t;
+
+/**
+ * Reset the flash, check that one answers and map it.  DRV_ERR_PARAM for a
+ * bad configuration; DRV_ERR_NORES if the DMA stream is taken; DRV_ERR_HW
+ * if the JEDEC ID reads all zeros or all ones; DRV_ERR_TIMEOUT if the
+ * flash stays busy, as a missing one does on pulled-up lines.
+ */
+drv_status_t qspi_init(qspi_t *h, const qspi_config_t *cfg);
+
+/** Unmap, stop the interface and free the DMA stream. */
+void qspi_deinit(qspi_t *h);
+
+/** Flash offset @p addr in the memory-mapped bank, for reading or execution. */
+const void *qspi_ptr(const qspi_t *h, uint32_t addr);
+
+/** Copy @p len bytes from flash offset @p addr; DRV_ERR_PARAM outside the flash. */
+drv_status_t qspi_read(qspi_t *h, uint32_t addr, void *buf, size_t len);
+
+/**
+ * Program @p len bytes at flash offset @p addr, page by page.  NOR flash
+ * only clears bits: erase first.  DRV_ERR_PARAM outside the flash;
+ * DRV_ERR_TIMEOUT if the flash does not finish; DRV_ERR_HW on a transfer
+ * error.
+ */
+drv_status_t qspi_write(qspi_t *h, uint32_t addr, const void *buf, size_t len);
+
+/**
+ * Erase [addr, addr + len), both QSPI_SECTOR_SIZE aligned: whole blocks
+ * where aligned, sectors elsewhere, and the whole chip for the whole
+ * range.  Errors as qspi_write().
+ */
+drv_status_t qspi_erase(qspi_t *h, uint32_t addr, uint32_t len);
+
+#endif /* STM32_QSPI_H */
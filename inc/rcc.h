@@ -0,0 +1,133 @@
+/**
+ * @file    rcc.h
+ * @brief   Clock tree solver and switch sequence.
+ *
+ * rcc_solve() is a pure function: from the oscillator frequency and the
+ * frequency limits it picks PLL M/N/P/Q for the highest legal SYSCLK (with
+ * an exact 48 MHz PLL48CK when USB/SDIO need it), the AHB/APB prescalers
+ * and the flash wait states.  rcc_apply() then programs the result in the
+ * order the reference manual requires: wait states up before the clock
+ * goes up, PLL reconfigured only while not in use, wait states down only
+ * after the clock came down.
+ *
+ * C has no constexpr, so the compile-time half is a set of macros: a board
+ * with a fixed clock plan can check it with RCC_PLL_VALID() and derive
+ * frequencies and wait states in constant expressions.
+ *
+ * Limits are those of the parts without over-drive: 168 MHz on F4 and
+ * 180 MHz on F7 (both at voltage scale 1, the reset default).
+ */
+#ifndef STM32_RCC_H
+#define STM32_RCC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "stm32.h"
+
+#define RCC_HSI_HZ              16000000u
+
+#if defined(STM32F7)
+#define RCC_SYSCLK_MAX_HZ       180000000u
+#define RCC_APB1_MAX_HZ         45000000u
+#define RCC_APB2_MAX_HZ         90000000u
+#else
+#define RCC_SYSCLK_MAX_HZ       168000000u
+#define RCC_APB1_MAX_HZ         42000000u
+#define RCC_APB2_MAX_HZ         84000000u
+#endif
+
+/* PLL limits (RM0090 section 7.3.2 / RM0385 section 5.3.2). */
+#define RCC_PLLM_MIN            2u
+#define RCC_PLLM_MAX            63u
+#define RCC_PLLN_MIN            50u
+#define RCC_PLLN_MAX            432u
+#define RCC_PLLQ_MIN            2u
+#define RCC_PLLQ_MAX            15u
+#define RCC_VCO_IN_MIN_HZ       1000000u
+#define RCC_VCO_IN_MAX_HZ       2000000u
+#define RCC_VCO_OUT_MIN_HZ      100000000u
+#define RCC_VCO_OUT_MAX_HZ      432000000u
+#define RCC_PLL48_HZ            48000000u
+
+/* Compile-time helpers for a fixed plan (all arguments constants). */
+#define RCC_PLL_VCO(fin, m, n)          ((uint32_t)((uint64_t)(fin) * (n) / (m)))
+#define RCC_PLL_SYSCLK(fin, m, n, p)    (RCC_PLL_VCO(fin, m, n) / (p))
+#define RCC_PLL_48CK(fin, m, n, q)      (RCC_PLL_VCO(fin, m, n) / (q))
+
+#define RCC_PLL_VALID(fin, m, n, p, q)                                      \
+    ((m) >= RCC_PLLM_MIN && (m) <= RCC_PLLM_MAX &&                          \
+     (n) >= RCC_PLLN_MIN && (n) <= RCC_PLLN_MAX &&                          \
+     ((p) == 2u || (p) == 4u || (p) == 6u || (p) == 8u) &&                  \
+     (q) >= RCC_PLLQ_MIN && (q) <= RCC_PLLQ_MAX &&                          \
+     (fin) / (m) >= RCC_VCO_IN_MIN_HZ && (fin) / (m) <= RCC_VCO_IN_MAX_HZ && \
+     RCC_PLL_VCO(fin, m, n) >= RCC_VCO_OUT_MIN_HZ &&                        \
+     RCC_PLL_VCO(fin, m, n) <= RCC_VCO_OUT_MAX_HZ &&                        \
+     RCC_PLL_SYSCLK(fin, m, n, p) <= RCC_SYSCLK_MAX_HZ &&                   \
+     RCC_PLL_48CK(fin, m, n, q) <= RCC_PLL48_HZ)
+
+/** HCLK per flash wait state for a supply voltage in mV (RM0090 table 10). */
+#define RCC_WS_STEP_HZ(mv)                                                  \
+    ((mv) >= 2700u ? 30000000u : (mv) >= 2400u ? 24000000u :                \
+     (mv) >= 2100u ? 22000000u : 20000000u)
+
+/** Flash wait states needed at @p hclk and @p mv. */
+#define RCC_FLASH_LATENCY(hclk, mv)     (((hclk) - 1u) / RCC_WS_STEP_HZ(mv))
+
+typedef struct {
+    uint32_t hse_hz;        /**< Crystal/clock on OSC_IN; 0 runs the PLL from HSI. */
+    bool hse_bypass;        /**< External clock instead of a crystal. */
+    uint32_t sysclk_max_hz; /**< 0: RCC_SYSCLK_MAX_HZ. */
+    uint32_t apb1_max_hz;   /**< 0: RCC_APB1_MAX_HZ. */
+    uint32_t apb2_max_hz;   /**< 0: RCC_APB2_MAX_HZ. */
+    uint16_t vdd_mv;        /**< Supply voltage; 0: 3300. */
+    bool need_48mhz;        /**< USB/SDIO/RNG need exactly 48 MHz on PLLQ. */
+} rcc_request_t;
+
+typedef struct {
+    uint32_t src_hz;        /**< PLL input frequency. */
+    bool hse;
+    bool hse_bypass;
+    uint8_t pllm;
+    uint16_t plln;
+    uint8_t pllp;           /**< Division factor 2/4/6/8. */
+    uint8_t pllq;
+    uint16_t hpre;          /**< AHB divider 1..512. */
+    uint8_t ppre1;          /**< APB1 divider 1..16. */
+    uint8_t ppre2;          /**< APB2 divider 1..16. */
+    uint8_t latency;        /**< Flash wait states. */
+    uint32_t sysclk_hz;
+    uint32_t hclk_hz;
+    uint32_t pclk1_hz;
+    uint32_t pclk2_hz;
+    uint32_t pll48_hz;
+} rcc_plan_t;
+
+/**
+ * Compute the fastest plan within the limits of @p req.  Returns
+ * DRV_ERR_PARAM when the oscillator cannot reach a valid VCO input or no
+ * exact 48 MHz is possible with need_48mhz set.
+ */
+drv_status_t rcc_solve(const rcc_request_t *req, rcc_plan_t *plan);
+
+/**
+ * Switch the clock tree to @p plan.  Returns DRV_ERR_TIMEOUT if HSE or the
+ * PLL does not become ready; the system then keeps running from HSI.
+ */
+drv_status_t rcc_apply(const rcc_plan_t *plan);
+
+/** Plan last applied (reset state: HSI, 16 MHz everywhere). */
+const rcc_plan_t *rcc_current(void);
+
+/**
+ * Record @p plan (NULL: the reset state) as applied without touching the
+ * clock tree.  For a switch made before .data was initialised, which
+ * overwrote what rcc_apply() recorded; see startup_clock_init().
+ */
+void rcc_set_current(const rcc_plan_t *plan);
+
+/** Timer kernel clock on APB1/APB2: twice PCLK when the APB divider is not 1. */
+uint32_t rcc_timer_clock(const rcc_plan_t *plan, bool apb2);
+
+#endif /* STM32_RCC_H */
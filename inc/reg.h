@@ -0,0 +1,142 @@
+/**
+ * @file    reg.h
+ * @brief   Zero-overhead register access layer.
+ *
+ * Registers are declared as `volatile uint32_t` members of typed peripheral
+ * structs (see regs/).  Single-bit flags are plain masks built with
+ * REG_BIT(); multi-bit fields are described by a reg_field_t descriptor
+ * built with REG_FIELD().  Descriptors are compound literals with constant
+ * members, so after inlining the compiler folds every mask and shift and a
+ * field write turns into one load, one BFI (or AND/ORR pair) and one store:
+ *
+ *     REG_FIELD_WRITE(USART2->CR2, USART_CR2_STOP, 2u);
+ *
+ * All driver code accesses registers through the REG_* macros only.  This is
+ * the single choke point that lets the host build back peripherals with
+ * something other than real hardware: with STM32_SIM defined, REG_READ and
+ * REG_WRITE call into the register simulator (host/sim.h).
+ */
+#ifndef STM32_REG_H
+#define STM32_REG_H
+
+#include <stdint.h>
+
+#include "compiler.h"
+
+/** Multi-bit register field descriptor. */
+typedef struct {
+    uint8_t pos;    /**< LSB position of the field. */
+    uint8_t width;  /**< Field width in bits (1..32). */
+} reg_field_t;
+
+/** Mask with bit @p n set; usable in constant expressions. */
+#define REG_BIT(n)              (1u << (n))
+
+/** Mask of @p width bits starting at @p pos; usable in constant expressions. */
+#define REG_MASK(pos, width) \
+    ((((width) >= 32u) ? 0xFFFFFFFFu : ((1u << (width)) - 1u)) << (pos))
+
+/** Field descriptor for @p width bits starting at @p pos. */
+#define REG_FIELD(pos, width)   ((reg_field_t){ (uint8_t)(pos), (uint8_t)(width) })
+
+/** Mask of the bits covered by @p f. */
+STM32_INLINE uint32_t reg_field_mask(reg_field_t f)
+{
+    return REG_MASK((uint32_t)f.pos, (uint32_t)f.width);
+}
+
+/** Extract field @p f from register value @p v. */
+STM32_INLINE uint32_t reg_field_get(uint32_t v, reg_field_t f)
+{
+    return (v & reg_field_mask(f)) >> f.pos;
+}
+
+/** Shift @p x into the position of field @p f; excess bits are dropped. */
+STM32_INLINE uint32_t reg_field_prep(reg_field_t f, uint32_t x)
+{
+    return (x << f.pos) & reg_field_mask(f);
+}
+
+/** Replace field @p f of register value @p v with @p x. */
+STM32_INLINE uint32_t reg_field_set(uint32_t v, reg_field_t f, uint32_t x)
+{
+    return (v & ~reg_field_mask(f)) | reg_field_prep(f, x);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Raw accessors                                                            */
+/* ------------------------------------------------------------------------ */
+
+#if defined(STM32_SIM)
+
+/* Host simulator: every access is routed through the register models. */
+uint32_t sim_read32(const volatile uint32_t *reg);
+void sim_write32(volatile uint32_t *reg, uint32_t val);
+
+#define REG_READ(reg)               sim_read32(&(reg))
+#define REG_WRITE(reg, val)         sim_write32(&(reg), (uint32_t)(val))
+
+#else
+
+/** Single volatile load of register lvalue @p reg. */
+#define REG_READ(reg)               (reg)
+
+/** Single volatile store of @p val to register lvalue @p reg. */
+#define REG_WRITE(reg, val)         ((reg) = (uint32_t)(val))
+
+#endif /* STM32_SIM */
+
+/* ------------------------------------------------------------------------ */
+/* Bus addresses                                                            */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Address registers (DMA PAR/MxAR, descriptor pointers, ...) hold 32-bit bus
+ * addresses.  REG_ADDR converts a pointer to the value to program and
+ * REG_PTR converts it back.  On target both are casts; the simulator maps
+ * 64-bit host pointers into a 32-bit bus space of its own.
+ */
+#if defined(STM32_SIM)
+
+uint32_t sim_bus_addr(const volatile void *ptr);
+void *sim_bus_ptr(uint32_t addr);
+
+#define REG_ADDR(ptr)               sim_bus_addr(ptr)
+#define REG_PTR(addr)               sim_bus_ptr(addr)
+
+#else
+
+#define REG_ADDR(ptr)               ((uint32_t)(uintptr_t)(ptr))
+#define REG_PTR(addr)               ((void *)(uintptr_t)(addr))
+
+#endif /* STM32_SIM */
+
+/* ------------------------------------------------------------------------ */
+/* Composite accessors (built on REG_READ/REG_WRITE only)                   */
+/* ------------------------------------------------------------------------ */
+
+/** Read-modify-write: clear @p clr, then set @p set. One load, one store. */
+#define REG_MODIFY(reg, clr, set) \
+    REG_WRITE(reg, (REG_READ(reg) & ~(uint32_t)(clr)) | (uint32_t)(set))
+
+#define REG_SET_BITS(reg, msk)      REG_MODIFY(reg, 0u, msk)
+#define REG_CLR_BITS(reg, msk)      REG_MODIFY(reg, msk, 0u)
+
+/** Non-zero if any bit of @p msk is set in @p reg. */
+#define REG_TEST_BITS(reg, msk)     ((REG_READ(reg) & (uint32_t)(msk)) != 0u)
+
+#define REG_FIELD_READ(reg, f)      reg_field_get(REG_READ(reg), f)
+
+#define REG_FIELD_WRITE(reg, f, x) \
+    REG_MODIFY(reg, reg_field_mask(f), reg_field_prep(f, x))
+
+/* ------------------------------------------------------------------------ */
+/* Layout checks                                                            */
+/* ------------------------------------------------------------------------ */
+
+/** Assert at compile time that @p member sits at byte offset @p off. */
+#define REG_LAYOUT_CHECK(type, member, off) \
+    STM32_STATIC_ASSERT(__builtin_offsetof(type, member) == (off), \
+                        #type "." #member " is not at offset " #off)
+
+#endif /* STM32_REG_H */
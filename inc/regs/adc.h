@@ -0,0 +1,120 @@
+/**
+ * @file    regs/adc.h
+ * @brief   ADC register layout (RM0090 section 13.13).
+ */
+#ifndef STM32_REGS_ADC_H
+#define STM32_REGS_ADC_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t SR;       /**< 0x00 Status. */
+    volatile uint32_t CR1;      /**< 0x04 Control 1. */
+    volatile uint32_t CR2;      /**< 0x08 Control 2. */
+    volatile uint32_t SMPR1;    /**< 0x0C Sample time, channels 10..18. */
+    volatile uint32_t SMPR2;    /**< 0x10 Sample time, channels 0..9. */
+    volatile uint32_t JOFR[4];  /**< 0x14 Injected channel offsets. */
+    volatile uint32_t HTR;      /**< 0x24 Watchdog high threshold. */
+    volatile uint32_t LTR;      /**< 0x28 Watchdog low threshold. */
+    volatile uint32_t SQR1;     /**< 0x2C Regular sequence 13..16, length. */
+    volatile uint32_t SQR2;     /**< 0x30 Regular sequence 7..12. */
+    volatile uint32_t SQR3;     /**< 0x34 Regular sequence 1..6. */
+    volatile uint32_t JSQR;     /**< 0x38 Injected sequence. */
+    volatile uint32_t JDR[4];   /**< 0x3C Injected data. */
+    volatile uint32_t DR;       /**< 0x4C Regular data. */
+} adc_regs_t;
+
+typedef struct {
+    volatile uint32_t CSR;      /**< 0x00 Common status. */
+    volatile uint32_t CCR;      /**< 0x04 Common control. */
+    volatile uint32_t CDR;      /**< 0x08 Common regular data (dual/triple). */
+} adc_common_regs_t;
+
+REG_LAYOUT_CHECK(adc_regs_t, SQR1, 0x2C);
+REG_LAYOUT_CHECK(adc_regs_t, DR, 0x4C);
+
+#define ADC1_BASE       (APB2PERIPH_BASE + 0x2000u)
+#define ADC2_BASE       (APB2PERIPH_BASE + 0x2100u)
+#define ADC3_BASE       (APB2PERIPH_BASE + 0x2200u)
+#define ADC_COMMON_BASE (APB2PERIPH_BASE + 0x2300u)
+
+#define ADC1            STM32_PERIPH(adc_regs_t, ADC1)
+#define ADC2            STM32_PERIPH(adc_regs_t, ADC2)
+#define ADC3            STM32_PERIPH(adc_regs_t, ADC3)
+#define ADC_COMMON      STM32_PERIPH(adc_common_regs_t, ADC_COMMON)
+
+/* SR */
+#define ADC_SR_AWD          REG_BIT(0)
+#define ADC_SR_EOC          REG_BIT(1)
+#define ADC_SR_JEOC         REG_BIT(2)
+#define ADC_SR_JSTRT        REG_BIT(3)
+#define ADC_SR_STRT         REG_BIT(4)
+#define ADC_SR_OVR          REG_BIT(5)
+
+/* CR1 */
+#define ADC_CR1_EOCIE       REG_BIT(5)
+#define ADC_CR1_SCAN        REG_BIT(8)
+#define ADC_CR1_RES         REG_FIELD(24u, 2u)  /**< 12/10/8/6 bits. */
+#define ADC_CR1_OVRIE       REG_BIT(26)
+
+/* CR2 */
+#define ADC_CR2_ADON        REG_BIT(0)
+#define ADC_CR2_CONT        REG_BIT(1)
+#define ADC_CR2_DMA         REG_BIT(8)
+#define ADC_CR2_DDS         REG_BIT(9)
+#define ADC_CR2_EOCS        REG_BIT(10)
+#define ADC_CR2_ALIGN       REG_BIT(11)
+#define ADC_CR2_JSWSTART    REG_BIT(22)
+#define ADC_CR2_EXTSEL      REG_FIELD(24u, 4u)
+#define ADC_CR2_EXTEN       REG_FIELD(28u, 2u)
+#define ADC_CR2_SWSTART     REG_BIT(30)
+
+/* SMPRx: 3 bits per channel. */
+#define ADC_SMPR_SMP(ch)    REG_FIELD(((ch) % 10u) * 3u, 3u)
+
+/* SQRx: 5 bits per rank. */
+#define ADC_SQR_SQ(rank)    REG_FIELD(((rank) % 6u) * 5u, 5u)  /**< rank 0-based */
+#define ADC_SQR1_L          REG_FIELD(20u, 4u)                  /**< Length - 1. */
+
+/* CCR */
+#define ADC_CCR_ADCPRE      REG_FIELD(16u, 2u)  /**< PCLK2 / 2, 4, 6, 8. */
+
+/* EXTSEL: regular group trigger sources. */
+#define ADC_EXTSEL_TIM1_CC1     0u
+#define ADC_EXTSEL_TIM1_CC2     1u
+#define ADC_EXTSEL_TIM1_CC3     2u
+#define ADC_EXTSEL_TIM2_CC2     3u
+#define ADC_EXTSEL_TIM2_CC3     4u
+#define ADC_EXTSEL_TIM2_CC4     5u
+#define ADC_EXTSEL_TIM2_TRGO    6u
+#define ADC_EXTSEL_TIM3_CC1     7u
+#define ADC_EXTSEL_TIM3_TRGO    8u
+#define ADC_EXTSEL_TIM4_CC4     9u
+#define ADC_EXTSEL_TIM5_CC1     10u
+#define ADC_EXTSEL_TIM5_CC2     11u
+#define ADC_EXTSEL_TIM5_CC3     12u
+#define ADC_EXTSEL_TIM8_CC1     13u
+#define ADC_EXTSEL_TIM8_TRGO    14u
+#define ADC_EXTSEL_EXTI11       15u
+
+#define ADC_EXTEN_OFF           0u
+#define ADC_EXTEN_RISING        1u
+#define ADC_EXTEN_FALLING       2u
+#define ADC_EXTEN_BOTH          3u
+
+/* Sample time codes: 3, 15, 28, 56, 84, 112, 144, 480 ADCCLK cycles. */
+#define ADC_SMP_3               0u
+#define ADC_SMP_15              1u
+#define ADC_SMP_28              2u
+#define ADC_SMP_56              3u
+#define ADC_SMP_84              4u
+#define ADC_SMP_112             5u
+#define ADC_SMP_144             6u
+#define ADC_SMP_480             7u
+
+#define ADC_RES_12              0u
+#define ADC_RES_10              1u
+#define ADC_RES_8               2u
+#define ADC_RES_6               3u
+
+#endif /* STM32_REGS_ADC_H */
@@ -0,0 +1,169 @@
+/**
+ * @file    regs/can.h
+ * @brief   bxCAN register layout (RM0090 section 32.9).
+ *
+ * The acceptance filter banks are shared by CAN1 and CAN2 and live in the
+ * CAN1 block only; FMR.CAN2SB splits them between the two instances.
+ */
+#ifndef STM32_REGS_CAN_H
+#define STM32_REGS_CAN_H
+
+#include "reg.h"
+
+#define CAN_TX_MAILBOXES    3u
+#define CAN_RX_FIFOS        2u
+#define CAN_RX_FIFO_DEPTH   3u
+#define CAN_FILTER_BANKS    28u
+
+typedef struct {
+    volatile uint32_t TIR;      /**< Identifier and TXRQ. */
+    volatile uint32_t TDTR;     /**< Length and time stamp. */
+    volatile uint32_t TDLR;     /**< Data bytes 0..3. */
+    volatile uint32_t TDHR;     /**< Data bytes 4..7. */
+} can_tx_mailbox_t;
+
+typedef struct {
+    volatile uint32_t RIR;      /**< Identifier. */
+    volatile uint32_t RDTR;     /**< Length, filter match index, time stamp. */
+    volatile uint32_t RDLR;
+    volatile uint32_t RDHR;
+} can_rx_mailbox_t;
+
+typedef struct {
+    volatile uint32_t FR1;
+    volatile uint32_t FR2;
+} can_filter_bank_t;
+
+typedef struct {
+    volatile uint32_t MCR;      /**< 0x000 Master control. */
+    volatile uint32_t MSR;      /**< 0x004 Master status. */
+    volatile uint32_t TSR;      /**< 0x008 Transmit status. */
+    volatile uint32_t RF0R;     /**< 0x00C Receive FIFO 0. */
+    volatile uint32_t RF1R;     /**< 0x010 Receive FIFO 1. */
+    volatile uint32_t IER;      /**< 0x014 Interrupt enable. */
+    volatile uint32_t ESR;      /**< 0x018 Error status. */
+    volatile uint32_t BTR;      /**< 0x01C Bit timing. */
+    uint32_t RESERVED0[88];
+    can_tx_mailbox_t TX[CAN_TX_MAILBOXES];  /**< 0x180 */
+    can_rx_mailbox_t RX[CAN_RX_FIFOS];      /**< 0x1B0 */
+    uint32_t RESERVED1[12];
+    volatile uint32_t FMR;      /**< 0x200 Filter master. */
+    volatile uint32_t FM1R;     /**< 0x204 Filter mode (1: list). */
+    uint32_t RESERVED2;
+    volatile uint32_t FS1R;     /**< 0x20C Filter scale (1: 32-bit). */
+    uint32_t RESERVED3;
+    volatile uint32_t FFA1R;    /**< 0x214 Filter FIFO assignment. */
+    uint32_t RESERVED4;
+    volatile uint32_t FA1R;     /**< 0x21C Filter activation. */
+    uint32_t RESERVED5[8];
+    can_filter_bank_t FB[CAN_FILTER_BANKS];  /**< 0x240 */
+} can_regs_t;
+
+REG_LAYOUT_CHECK(can_regs_t, BTR, 0x01C);
+REG_LAYOUT_CHECK(can_regs_t, TX, 0x180);
+REG_LAYOUT_CHECK(can_regs_t, RX, 0x1B0);
+REG_LAYOUT_CHECK(can_regs_t, FMR, 0x200);
+REG_LAYOUT_CHECK(can_regs_t, FA1R, 0x21C);
+REG_LAYOUT_CHECK(can_regs_t, FB, 0x240);
+
+#define CAN1_BASE   (APB1PERIPH_BASE + 0x6400u)
+#define CAN2_BASE   (APB1PERIPH_BASE + 0x6800u)
+
+#define CAN1        STM32_PERIPH(can_regs_t, CAN1)
+#define CAN2        STM32_PERIPH(can_regs_t, CAN2)
+
+/* MCR */
+#define CAN_MCR_INRQ        REG_BIT(0)
+#define CAN_MCR_SLEEP       REG_BIT(1)
+#define CAN_MCR_TXFP        REG_BIT(2)      /**< 1: mailboxes in request order. */
+#define CAN_MCR_RFLM        REG_BIT(3)
+#define CAN_MCR_NART        REG_BIT(4)
+#define CAN_MCR_AWUM        REG_BIT(5)
+#define CAN_MCR_ABOM        REG_BIT(6)
+#define CAN_MCR_TTCM        REG_BIT(7)
+#define CAN_MCR_RESET       REG_BIT(15)
+#define CAN_MCR_DBF         REG_BIT(16)
+
+/* MSR */
+#define CAN_MSR_INAK        REG_BIT(0)
+#define CAN_MSR_SLAK        REG_BIT(1)
+#define CAN_MSR_ERRI        REG_BIT(2)
+#define CAN_MSR_WKUI        REG_BIT(3)
+#define CAN_MSR_SLAKI       REG_BIT(4)
+#define CAN_MSR_TXM         REG_BIT(8)
+#define CAN_MSR_RXM         REG_BIT(9)
+#define CAN_MSR_SAMP        REG_BIT(10)
+#define CAN_MSR_RX          REG_BIT(11)
+
+/* TSR: per-mailbox flags at bit 8 * n, then common fields. */
+#define CAN_TSR_RQCP(n)     REG_BIT(8u * (n))
+#define CAN_TSR_TXOK(n)     REG_BIT(8u * (n) + 1u)
+#define CAN_TSR_ALST(n)     REG_BIT(8u * (n) + 2u)
+#define CAN_TSR_TERR(n)     REG_BIT(8u * (n) + 3u)
+#define CAN_TSR_ABRQ(n)     REG_BIT(8u * (n) + 7u)
+#define CAN_TSR_CODE        REG_FIELD(24u, 2u)
+#define CAN_TSR_TME(n)      REG_BIT(26u + (n))
+#define CAN_TSR_TME_ALL     (CAN_TSR_TME(0) | CAN_TSR_TME(1) | CAN_TSR_TME(2))
+#define CAN_TSR_LOW(n)      REG_BIT(29u + (n))
+
+/* RF0R / RF1R */
+#define CAN_RFR_FMP         REG_FIELD(0u, 2u)
+#define CAN_RFR_FULL        REG_BIT(3)
+#define CAN_RFR_FOVR        REG_BIT(4)
+#define CAN_RFR_RFOM        REG_BIT(5)
+
+/* IER */
+#define CAN_IER_TMEIE       REG_BIT(0)
+#define CAN_IER_FMPIE0      REG_BIT(1)
+#define CAN_IER_FFIE0       REG_BIT(2)
+#define CAN_IER_FOVIE0      REG_BIT(3)
+#define CAN_IER_FMPIE1      REG_BIT(4)
+#define CAN_IER_FFIE1       REG_BIT(5)
+#define CAN_IER_FOVIE1      REG_BIT(6)
+#define CAN_IER_EWGIE       REG_BIT(8)
+#define CAN_IER_EPVIE       REG_BIT(9)
+#define CAN_IER_BOFIE       REG_BIT(10)
+#define CAN_IER_LECIE       REG_BIT(11)
+#define CAN_IER_ERRIE       REG_BIT(15)
+#define CAN_IER_WKUIE       REG_BIT(16)
+#define CAN_IER_SLKIE       REG_BIT(17)
+
+/* ESR */
+#define CAN_ESR_EWGF        REG_BIT(0)
+#define CAN_ESR_EPVF        REG_BIT(1)
+#define CAN_ESR_BOFF        REG_BIT(2)
+#define CAN_ESR_LEC         REG_FIELD(4u, 3u)
+#define CAN_ESR_TEC         REG_FIELD(16u, 8u)
+#define CAN_ESR_REC         REG_FIELD(24u, 8u)
+
+/* BTR: t_q = (BRP + 1) / f_pclk1, bit = (1 + TS1 + 1 + TS2 + 1) t_q. */
+#define CAN_BTR_BRP         REG_FIELD(0u, 10u)
+#define CAN_BTR_TS1         REG_FIELD(16u, 4u)
+#define CAN_BTR_TS2         REG_FIELD(20u, 3u)
+#define CAN_BTR_SJW         REG_FIELD(24u, 2u)
+#define CAN_BTR_LBKM        REG_BIT(30)
+#define CAN_BTR_SILM        REG_BIT(31)
+
+/* TIR / RIR, and the 32-bit filter format */
+#define CAN_IR_TXRQ         REG_BIT(0)
+#define CAN_IR_RTR          REG_BIT(1)
+#define CAN_IR_IDE          REG_BIT(2)
+#define CAN_IR_EXID         REG_FIELD(3u, 29u)
+#define CAN_IR_STID         REG_FIELD(21u, 11u)
+
+/* 16-bit filter format: STID[10:0], RTR, IDE, EXID[17:15] */
+#define CAN_F16_RTR         REG_BIT(4)
+#define CAN_F16_IDE         REG_BIT(3)
+#define CAN_F16_STID_SHIFT  5u
+
+/* TDTR / RDTR */
+#define CAN_DTR_DLC         REG_FIELD(0u, 4u)
+#define CAN_DTR_TGT         REG_BIT(8)
+#define CAN_DTR_FMI         REG_FIELD(8u, 8u)
+#define CAN_DTR_TIME        REG_FIELD(16u, 16u)
+
+/* FMR */
+#define CAN_FMR_FINIT       REG_BIT(0)
+#define CAN_FMR_CAN2SB      REG_FIELD(8u, 6u)
+
+#endif /* STM32_REGS_CAN_H */
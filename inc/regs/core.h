@@ -0,0 +1,152 @@
+/**
+ * @file    regs/core.h
+ * @brief   Cortex-M4/M7 system peripherals (ARMv7-M ARM, chapter C1).
+ */
+#ifndef STM32_REGS_CORE_H
+#define STM32_REGS_CORE_H
+
+#include "reg.h"
+
+/* ------------------------------------------------------------------------ */
+/* DWT: data watchpoint and trace                                           */
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    volatile uint32_t CTRL;         /**< 0x000 Control. */
+    volatile uint32_t CYCCNT;       /**< 0x004 Cycle count. */
+    volatile uint32_t CPICNT;       /**< 0x008 CPI count. */
+    volatile uint32_t EXCCNT;       /**< 0x00C Exception overhead count. */
+    volatile uint32_t SLEEPCNT;     /**< 0x010 Sleep count. */
+    volatile uint32_t LSUCNT;       /**< 0x014 LSU count. */
+    volatile uint32_t FOLDCNT;      /**< 0x018 Folded instruction count. */
+    volatile uint32_t PCSR;         /**< 0x01C Program counter sample. */
+    uint32_t          RESERVED0[996];
+    volatile uint32_t LAR;          /**< 0xFB0 Lock access (Cortex-M7). */
+    volatile uint32_t LSR;          /**< 0xFB4 Lock status. */
+} dwt_regs_t;
+
+REG_LAYOUT_CHECK(dwt_regs_t, LAR, 0xFB0);
+
+#define DWT_BASE            0xE0001000u
+#define DWT                 STM32_PERIPH(dwt_regs_t, DWT)
+
+#define DWT_CTRL_CYCCNTENA  REG_BIT(0)
+#define DWT_CTRL_NOCYCCNT   REG_BIT(25)
+#define DWT_LAR_UNLOCK      0xC5ACCE55u
+
+/* ------------------------------------------------------------------------ */
+/* CoreDebug                                                                */
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    volatile uint32_t DHCSR;        /**< 0x00 Debug halting control/status. */
+    volatile uint32_t DCRSR;        /**< 0x04 Debug core register selector. */
+    volatile uint32_t DCRDR;        /**< 0x08 Debug core register data. */
+    volatile uint32_t DEMCR;        /**< 0x0C Debug exception and monitor control. */
+} coredebug_regs_t;
+
+#define COREDEBUG_BASE      0xE000EDF0u
+#define COREDEBUG           STM32_PERIPH(coredebug_regs_t, COREDEBUG)
+
+#define COREDEBUG_DEMCR_TRCENA  REG_BIT(24)
+
+/* ------------------------------------------------------------------------ */
+/* SCB: system control block, including the Cortex-M7 cache maintenance     */
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    volatile uint32_t CPUID;        /**< 0x000 CPU identification. */
+    volatile uint32_t ICSR;         /**< 0x004 Interrupt control and state. */
+    volatile uint32_t VTOR;         /**< 0x008 Vector table offset. */
+    volatile uint32_t AIRCR;        /**< 0x00C Application interrupt and reset control. */
+    volatile uint32_t SCR;          /**< 0x010 System control. */
+    volatile uint32_t CCR;          /**< 0x014 Configuration and control. */
+    volatile uint32_t SHPR[3];      /**< 0x018 System handler priorities (4..15). */
+    volatile uint32_t SHCSR;        /**< 0x024 System handler control and state. */
+    volatile uint32_t CFSR;         /**< 0x028 Configurable fault status. */
+    volatile uint32_t HFSR;         /**< 0x02C HardFault status. */
+    volatile uint32_t DFSR;         /**< 0x030 Debug fault status. */
+    volatile uint32_t MMFAR;        /**< 0x034 MemManage fault address. */
+    volatile uint32_t BFAR;         /**< 0x038 BusFault address. */
+    volatile uint32_t AFSR;         /**< 0x03C Auxiliary fault status. */
+    uint32_t          RESERVED0[14];
+    volatile uint32_t CLIDR;        /**< 0x078 Cache level ID (Cortex-M7). */
+    volatile uint32_t CTR;          /**< 0x07C Cache type. */
+    volatile uint32_t CCSIDR;       /**< 0x080 Cache size ID. */
+    volatile uint32_t CSSELR;       /**< 0x084 Cache size selection. */
+    volatile uint32_t CPACR;        /**< 0x088 Coprocessor access control. */
+    uint32_t          RESERVED1[93];
+    volatile uint32_t STIR;         /**< 0x200 Software triggered interrupt. */
+    uint32_t          RESERVED2[19];
+    volatile uint32_t ICIALLU;      /**< 0x250 I-cache invalidate all. */
+    uint32_t          RESERVED3;
+    volatile uint32_t ICIMVAU;      /**< 0x258 I-cache invalidate by address. */
+    volatile uint32_t DCIMVAC;      /**< 0x25C D-cache invalidate by address. */
+    volatile uint32_t DCISW;        /**< 0x260 D-cache invalidate by set/way. */
+    volatile uint32_t DCCMVAU;      /**< 0x264 D-cache clean by address to PoU. */
+    volatile uint32_t DCCMVAC;      /**< 0x268 D-cache clean by address. */
+    volatile uint32_t DCCSW;        /**< 0x26C D-cache clean by set/way. */
+    volatile uint32_t DCCIMVAC;     /**< 0x270 D-cache clean and invalidate by address. */
+    volatile uint32_t DCCISW;       /**< 0x274 D-cache clean and invalidate by set/way. */
+} scb_regs_t;
+
+REG_LAYOUT_CHECK(scb_regs_t, CCR, 0x014);
+REG_LAYOUT_CHECK(scb_regs_t, CLIDR, 0x078);
+REG_LAYOUT_CHECK(scb_regs_t, CPACR, 0x088);
+REG_LAYOUT_CHECK(scb_regs_t, STIR, 0x200);
+REG_LAYOUT_CHECK(scb_regs_t, ICIALLU, 0x250);
+REG_LAYOUT_CHECK(scb_regs_t, DCCISW, 0x274);
+
+#define SCB_BASE            0xE000ED00u
+#define SCB                 STM32_PERIPH(scb_regs_t, SCB)
+
+#define SCB_ICSR_VECTACTIVE REG_FIELD(0u, 9u)
+#define SCB_ICSR_PENDSTSET  REG_BIT(26)
+#define SCB_ICSR_PENDSVSET  REG_BIT(28)
+
+#define SCB_AIRCR_PRIGROUP  REG_FIELD(8u, 3u)
+#define SCB_AIRCR_VECTKEY   REG_FIELD(16u, 16u)
+#define SCB_AIRCR_KEY       0x05FAu
+
+#define SCB_CCR_DC          REG_BIT(16)
+#define SCB_CCR_IC          REG_BIT(17)
+
+#define SCB_CPACR_CP10      REG_FIELD(20u, 2u)      /**< FPU access (with CP11). */
+#define SCB_CPACR_CP11      REG_FIELD(22u, 2u)
+#define SCB_CPACR_FULL      3u
+
+#define SCB_CCSIDR_ASSOC    REG_FIELD(3u, 10u)      /**< Ways - 1. */
+#define SCB_CCSIDR_NUMSETS  REG_FIELD(13u, 15u)     /**< Sets - 1. */
+
+/* Set/way operand for the 4-way, 32-byte-line Cortex-M7 data cache. */
+#define SCB_DCSW(set, way)  (((uint32_t)(set) << 5) | ((uint32_t)(way) << 30))
+
+/* ------------------------------------------------------------------------ */
+/* NVIC: nested vectored interrupt controller                               */
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    volatile uint32_t ISER[8];      /**< 0x000 Set-enable. */
+    uint32_t          RESERVED0[24];
+    volatile uint32_t ICER[8];      /**< 0x080 Clear-enable. */
+    uint32_t          RESERVED1[24];
+    volatile uint32_t ISPR[8];      /**< 0x100 Set-pending. */
+    uint32_t          RESERVED2[24];
+    volatile uint32_t ICPR[8];      /**< 0x180 Clear-pending. */
+    uint32_t          RESERVED3[24];
+    volatile uint32_t IABR[8];      /**< 0x200 Active bit. */
+    uint32_t          RESERVED4[56];
+    volatile uint32_t IPR[60];      /**< 0x300 Priorities, one byte per interrupt. */
+} nvic_regs_t;
+
+REG_LAYOUT_CHECK(nvic_regs_t, ICER, 0x080);
+REG_LAYOUT_CHECK(nvic_regs_t, IABR, 0x200);
+REG_LAYOUT_CHECK(nvic_regs_t, IPR, 0x300);
+
+#define NVIC_BASE           0xE000E100u
+#define NVIC                STM32_PERIPH(nvic_regs_t, NVIC)
+
+/* Priority bits implemented by the STM32F4/F7 NVIC (the top of each byte). */
+#define NVIC_PRIO_BITS      4u
+
+#endif /* STM32_REGS_CORE_H */
@@ -0,0 +1,50 @@
+/**
+ * @file    regs/crc.h
+ * @brief   CRC calculation unit register layout (RM0090 section 4.4,
+ *          RM0385 section 7.4).
+ *
+ * The F4 unit computes only CRC-32/MPEG-2 over 32-bit words (fixed
+ * polynomial, reset value 0xFFFFFFFF).  The F7 unit adds a programmable
+ * polynomial and initial value and bit reversal of input and output.
+ */
+#ifndef STM32_REGS_CRC_H
+#define STM32_REGS_CRC_H
+
+#include "reg.h"
+
+#if defined(STM32F7)
+#define CRC_PROGRAMMABLE    1
+#else
+#define CRC_PROGRAMMABLE    0
+#endif
+
+typedef struct {
+    volatile uint32_t DR;       /**< 0x00 Data (write: input, read: CRC). */
+    volatile uint32_t IDR;      /**< 0x04 Independent data. */
+    volatile uint32_t CR;       /**< 0x08 Control. */
+    uint32_t RESERVED0;
+    volatile uint32_t INIT;     /**< 0x10 Initial value (F7). */
+    volatile uint32_t POL;      /**< 0x14 Polynomial (F7). */
+} crc_regs_t;
+
+REG_LAYOUT_CHECK(crc_regs_t, CR, 0x08);
+REG_LAYOUT_CHECK(crc_regs_t, POL, 0x14);
+
+#define CRC_BASE            (AHB1PERIPH_BASE + 0x3000u)
+#define CRC                 STM32_PERIPH(crc_regs_t, CRC)
+
+#define CRC_POLY_DEFAULT    0x04C11DB7u
+#define CRC_INIT_DEFAULT    0xFFFFFFFFu
+
+/* CR */
+#define CRC_CR_RESET        REG_BIT(0)
+#define CRC_CR_POLYSIZE     REG_FIELD(3u, 2u)   /**< F7: 0 = 32-bit. */
+#define CRC_CR_REV_IN       REG_FIELD(5u, 2u)   /**< F7: CRC_REV_IN_* */
+#define CRC_CR_REV_OUT      REG_BIT(7)          /**< F7: bit-reverse DR reads. */
+
+#define CRC_REV_IN_NONE     0u
+#define CRC_REV_IN_BYTE     1u
+#define CRC_REV_IN_HALFWORD 2u
+#define CRC_REV_IN_WORD     3u
+
+#endif /* STM32_REGS_CRC_H */
@@ -0,0 +1,92 @@
+/**
+ * @file    regs/dma.h
+ * @brief   DMA controller register layout (RM0090 section 10.5).
+ */
+#ifndef STM32_REGS_DMA_H
+#define STM32_REGS_DMA_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t CR;       /**< 0x00 Configuration. */
+    volatile uint32_t NDTR;     /**< 0x04 Number of data items. */
+    volatile uint32_t PAR;      /**< 0x08 Peripheral address. */
+    volatile uint32_t M0AR;     /**< 0x0C Memory 0 address. */
+    volatile uint32_t M1AR;     /**< 0x10 Memory 1 address. */
+    volatile uint32_t FCR;      /**< 0x14 FIFO control. */
+} dma_stream_regs_t;
+
+typedef struct {
+    volatile uint32_t LISR;     /**< 0x00 Low interrupt status (streams 0..3). */
+    volatile uint32_t HISR;     /**< 0x04 High interrupt status (streams 4..7). */
+    volatile uint32_t LIFCR;    /**< 0x08 Low interrupt flag clear. */
+    volatile uint32_t HIFCR;    /**< 0x0C High interrupt flag clear. */
+    dma_stream_regs_t S[8];     /**< 0x10 + 0x18 * n */
+} dma_regs_t;
+
+REG_LAYOUT_CHECK(dma_regs_t, S, 0x10);
+REG_LAYOUT_CHECK(dma_regs_t, S[7].FCR, 0xCC);
+
+#define DMA1_BASE   (AHB1PERIPH_BASE + 0x6000u)
+#define DMA2_BASE   (AHB1PERIPH_BASE + 0x6400u)
+
+#define DMA1        STM32_PERIPH(dma_regs_t, DMA1)
+#define DMA2        STM32_PERIPH(dma_regs_t, DMA2)
+
+/*
+ * Interrupt flags of stream s live in LISR/HISR (s < 4 / s >= 4) at bit
+ * DMA_ISR_SHIFT(s); the same layout is used by LIFCR/HIFCR.
+ */
+#define DMA_ISR_SHIFT(s)    ((((s) & 2u) << 3) + (((s) & 1u) * 6u))
+
+#define DMA_FLAG_FEIF       REG_BIT(0)
+#define DMA_FLAG_DMEIF      REG_BIT(2)
+#define DMA_FLAG_TEIF       REG_BIT(3)
+#define DMA_FLAG_HTIF       REG_BIT(4)
+#define DMA_FLAG_TCIF       REG_BIT(5)
+#define DMA_FLAG_ALL        (DMA_FLAG_FEIF | DMA_FLAG_DMEIF | DMA_FLAG_TEIF | \
+                             DMA_FLAG_HTIF | DMA_FLAG_TCIF)
+
+/* SxCR */
+#define DMA_SCR_EN          REG_BIT(0)
+#define DMA_SCR_DMEIE       REG_BIT(1)
+#define DMA_SCR_TEIE        REG_BIT(2)
+#define DMA_SCR_HTIE        REG_BIT(3)
+#define DMA_SCR_TCIE        REG_BIT(4)
+#define DMA_SCR_PFCTRL      REG_BIT(5)
+#define DMA_SCR_DIR         REG_FIELD(6u, 2u)
+#define DMA_SCR_CIRC        REG_BIT(8)
+#define DMA_SCR_PINC        REG_BIT(9)
+#define DMA_SCR_MINC        REG_BIT(10)
+#define DMA_SCR_PSIZE       REG_FIELD(11u, 2u)
+#define DMA_SCR_MSIZE       REG_FIELD(13u, 2u)
+#define DMA_SCR_PINCOS      REG_BIT(15)
+#define DMA_SCR_PL          REG_FIELD(16u, 2u)
+#define DMA_SCR_DBM         REG_BIT(18)
+#define DMA_SCR_CT          REG_BIT(19)
+#define DMA_SCR_PBURST      REG_FIELD(21u, 2u)
+#define DMA_SCR_MBURST      REG_FIELD(23u, 2u)
+#define DMA_SCR_CHSEL       REG_FIELD(25u, 3u)
+
+#define DMA_DIR_P2M         0u
+#define DMA_DIR_M2P         1u
+#define DMA_DIR_M2M         2u
+
+#define DMA_SIZE_BYTE       0u
+#define DMA_SIZE_HALFWORD   1u
+#define DMA_SIZE_WORD       2u
+
+#define DMA_BURST_SINGLE    0u
+#define DMA_BURST_INCR4     1u
+#define DMA_BURST_INCR8     2u
+#define DMA_BURST_INCR16    3u
+
+/* SxFCR */
+#define DMA_SFCR_FTH        REG_FIELD(0u, 2u)
+#define DMA_SFCR_DMDIS      REG_BIT(2)
+#define DMA_SFCR_FS         REG_FIELD(3u, 3u)
+#define DMA_SFCR_FEIE       REG_BIT(7)
+
+#define DMA_FTH_FULL        3u
+
+#endif /* STM32_REGS_DMA_H */
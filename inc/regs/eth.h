@@ -0,0 +1,263 @@
+/**
+ * @file    regs/eth.h
+ * @brief   Ethernet MAC and DMA register layout and DMA descriptor format
+ *          (RM0090 section 33.8, RM0385 section 38.8).
+ *
+ * The DMA moves frames between the MAC FIFOs and memory through rings of
+ * descriptors that software and the DMA hand back and forth with the OWN
+ * bit.  Descriptors here are the enhanced (eight-word) format, selected
+ * with DMABMR.EDFE, which carries the receive checksum status in RDES4;
+ * at eight words one descriptor fills exactly one Cortex-M7 cache line.
+ */
+#ifndef STM32_REGS_ETH_H
+#define STM32_REGS_ETH_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t MACCR;    /**< 0x000 MAC configuration. */
+    volatile uint32_t MACFFR;   /**< 0x004 Frame filter. */
+    volatile uint32_t MACHTHR;  /**< 0x008 Hash table high. */
+    volatile uint32_t MACHTLR;  /**< 0x00C Hash table low. */
+    volatile uint32_t MACMIIAR; /**< 0x010 MII (MDIO) address. */
+    volatile uint32_t MACMIIDR; /**< 0x014 MII (MDIO) data. */
+    volatile uint32_t MACFCR;   /**< 0x018 Flow control. */
+    volatile uint32_t MACVLANTR; /**< 0x01C VLAN tag. */
+    uint32_t RESERVED0[2];
+    volatile uint32_t MACRWUFFR; /**< 0x028 Remote wakeup frame filter. */
+    volatile uint32_t MACPMTCSR; /**< 0x02C PMT control and status. */
+    uint32_t RESERVED1;
+    volatile uint32_t MACDBGR;  /**< 0x034 Debug. */
+    volatile uint32_t MACSR;    /**< 0x038 Interrupt status. */
+    volatile uint32_t MACIMR;   /**< 0x03C Interrupt mask. */
+    volatile uint32_t MACA0HR;  /**< 0x040 Address 0 high. */
+    volatile uint32_t MACA0LR;  /**< 0x044 Address 0 low. */
+    volatile uint32_t MACA[6];  /**< 0x048 Addresses 1..3, high/low pairs. */
+    uint32_t RESERVED2[40];
+    volatile uint32_t MMCCR;    /**< 0x100 MMC control. */
+    volatile uint32_t MMCRIR;   /**< 0x104 MMC receive interrupt. */
+    volatile uint32_t MMCTIR;   /**< 0x108 MMC transmit interrupt. */
+    volatile uint32_t MMCRIMR;  /**< 0x10C MMC receive interrupt mask. */
+    volatile uint32_t MMCTIMR;  /**< 0x110 MMC transmit interrupt mask. */
+    uint32_t RESERVED3[14];
+    volatile uint32_t MMCTGFSCCR;   /**< 0x14C Good frames after one collision. */
+    volatile uint32_t MMCTGFMSCCR;  /**< 0x150 Good frames after collisions. */
+    uint32_t RESERVED4[5];
+    volatile uint32_t MMCTGFCR;     /**< 0x168 Good frames transmitted. */
+    uint32_t RESERVED5[10];
+    volatile uint32_t MMCRFCECR;    /**< 0x194 Received with CRC error. */
+    volatile uint32_t MMCRFAECR;    /**< 0x198 Received with alignment error. */
+    uint32_t RESERVED6[10];
+    volatile uint32_t MMCRGUFCR;    /**< 0x1C4 Good unicast frames received. */
+    uint32_t RESERVED7[334];
+    volatile uint32_t PTP[12];  /**< 0x700 Time stamping (not used). */
+    uint32_t RESERVED8[564];
+    volatile uint32_t DMABMR;   /**< 0x1000 DMA bus mode. */
+    volatile uint32_t DMATPDR;  /**< 0x1004 Transmit poll demand. */
+    volatile uint32_t DMARPDR;  /**< 0x1008 Receive poll demand. */
+    volatile uint32_t DMARDLAR; /**< 0x100C Receive descriptor list address. */
+    volatile uint32_t DMATDLAR; /**< 0x1010 Transmit descriptor list address. */
+    volatile uint32_t DMASR;    /**< 0x1014 DMA status. */
+    volatile uint32_t DMAOMR;   /**< 0x1018 Operation mode. */
+    volatile uint32_t DMAIER;   /**< 0x101C Interrupt enable. */
+    volatile uint32_t DMAMFBOCR; /**< 0x1020 Missed frame and overflow counters. */
+    volatile uint32_t DMARSWTR; /**< 0x1024 Receive status watchdog timer. */
+    uint32_t RESERVED9[8];
+    volatile uint32_t DMACHTDR; /**< 0x1048 Current transmit descriptor. */
+    volatile uint32_t DMACHRDR; /**< 0x104C Current receive descriptor. */
+    volatile uint32_t DMACHTBAR; /**< 0x1050 Current transmit buffer. */
+    volatile uint32_t DMACHRBAR; /**< 0x1054 Current receive buffer. */
+} eth_regs_t;
+
+REG_LAYOUT_CHECK(eth_regs_t, MACA0HR, 0x040);
+REG_LAYOUT_CHECK(eth_regs_t, MMCCR, 0x100);
+REG_LAYOUT_CHECK(eth_regs_t, MMCTGFCR, 0x168);
+REG_LAYOUT_CHECK(eth_regs_t, MMCRGUFCR, 0x1C4);
+REG_LAYOUT_CHECK(eth_regs_t, PTP, 0x700);
+REG_LAYOUT_CHECK(eth_regs_t, DMABMR, 0x1000);
+REG_LAYOUT_CHECK(eth_regs_t, DMARSWTR, 0x1024);
+REG_LAYOUT_CHECK(eth_regs_t, DMACHRBAR, 0x1054);
+
+#define ETH_BASE            (AHB1PERIPH_BASE + 0x8000u)
+#define ETH                 STM32_PERIPH(eth_regs_t, ETH)
+
+/** Enhanced DMA descriptor (transmit and receive share the layout). */
+typedef struct {
+    volatile uint32_t des0;     /**< Status and control; OWN. */
+    volatile uint32_t des1;     /**< Buffer sizes and control. */
+    volatile uint32_t des2;     /**< Buffer 1 address. */
+    volatile uint32_t des3;     /**< Buffer 2 / next descriptor address. */
+    volatile uint32_t des4;     /**< Receive: extended status. */
+    uint32_t des5;
+    volatile uint32_t des6;     /**< Time stamp low. */
+    volatile uint32_t des7;     /**< Time stamp high. */
+} eth_dma_desc_t;
+
+/* MACCR */
+#define ETH_MACCR_RE        REG_BIT(2)
+#define ETH_MACCR_TE        REG_BIT(3)
+#define ETH_MACCR_APCS      REG_BIT(7)          /**< Strip pad/FCS of length frames. */
+#define ETH_MACCR_RD        REG_BIT(9)          /**< Retry disable. */
+#define ETH_MACCR_IPCO      REG_BIT(10)         /**< Receive checksum offload. */
+#define ETH_MACCR_DM        REG_BIT(11)         /**< Full duplex. */
+#define ETH_MACCR_LM        REG_BIT(12)         /**< Loopback. */
+#define ETH_MACCR_ROD       REG_BIT(13)
+#define ETH_MACCR_FES       REG_BIT(14)         /**< 100 Mbit/s. */
+#define ETH_MACCR_CSD       REG_BIT(16)
+#define ETH_MACCR_IFG       REG_FIELD(17u, 3u)
+#define ETH_MACCR_JD        REG_BIT(22)
+#define ETH_MACCR_WD        REG_BIT(23)
+#define ETH_MACCR_CSTF      REG_BIT(25)         /**< Strip FCS of type frames. */
+
+/* MACFFR */
+#define ETH_MACFFR_PM       REG_BIT(0)          /**< Promiscuous. */
+#define ETH_MACFFR_HU       REG_BIT(1)
+#define ETH_MACFFR_HM       REG_BIT(2)
+#define ETH_MACFFR_DAIF     REG_BIT(3)
+#define ETH_MACFFR_PAM      REG_BIT(4)          /**< Pass all multicast. */
+#define ETH_MACFFR_BFD      REG_BIT(5)          /**< Broadcast frames disable. */
+#define ETH_MACFFR_RA       REG_BIT(31)         /**< Receive all. */
+
+/* MACMIIAR */
+#define ETH_MACMIIAR_MB     REG_BIT(0)          /**< Busy; set to start. */
+#define ETH_MACMIIAR_MW     REG_BIT(1)          /**< Write. */
+#define ETH_MACMIIAR_CR     REG_FIELD(2u, 3u)   /**< MDC clock range: ETH_MDC_DIV_* */
+#define ETH_MACMIIAR_MR     REG_FIELD(6u, 5u)   /**< PHY register. */
+#define ETH_MACMIIAR_PA     REG_FIELD(11u, 5u)  /**< PHY address. */
+
+#define ETH_MDC_DIV_42      0u                  /**< HCLK 60..100 MHz. */
+#define ETH_MDC_DIV_62      1u                  /**< HCLK 100..150 MHz. */
+#define ETH_MDC_DIV_16      2u                  /**< HCLK 20..35 MHz. */
+#define ETH_MDC_DIV_26      3u                  /**< HCLK 35..60 MHz. */
+#define ETH_MDC_DIV_102     4u                  /**< HCLK 150..216 MHz. */
+
+/* MACIMR */
+#define ETH_MACIMR_PMTIM    REG_BIT(3)
+#define ETH_MACIMR_TSTIM    REG_BIT(9)
+
+/* MMCRIMR / MMCTIMR: counter half-full interrupts */
+#define ETH_MMCRIMR_ALL     (REG_BIT(5) | REG_BIT(6) | REG_BIT(17))
+#define ETH_MMCTIMR_ALL     (REG_BIT(14) | REG_BIT(15) | REG_BIT(21))
+
+/* MACA0HR */
+#define ETH_MACA0HR_MO      REG_BIT(31)         /**< Always 1. */
+
+/* DMABMR */
+#define ETH_DMABMR_SR       REG_BIT(0)          /**< Software reset; self-clearing. */
+#define ETH_DMABMR_DSL      REG_FIELD(2u, 5u)   /**< Words skipped between ring descriptors. */
+#define ETH_DMABMR_EDFE     REG_BIT(7)          /**< Enhanced descriptors. */
+#define ETH_DMABMR_PBL      REG_FIELD(8u, 6u)   /**< Programmable burst length. */
+#define ETH_DMABMR_FB       REG_BIT(16)         /**< Fixed burst. */
+#define ETH_DMABMR_RDP      REG_FIELD(17u, 6u)  /**< Receive burst length (USP). */
+#define ETH_DMABMR_USP      REG_BIT(23)
+#define ETH_DMABMR_AAB      REG_BIT(25)         /**< Address-aligned beats. */
+
+/* DMASR (rc_w1 status bits) and DMAIER (same positions) */
+#define ETH_DMA_TS          REG_BIT(0)          /**< Transmit (IC descriptor sent). */
+#define ETH_DMA_TPSS        REG_BIT(1)          /**< Transmit process stopped. */
+#define ETH_DMA_TBUS        REG_BIT(2)          /**< Transmit buffer unavailable. */
+#define ETH_DMA_TJTS        REG_BIT(3)
+#define ETH_DMA_ROS         REG_BIT(4)          /**< Receive FIFO overflow. */
+#define ETH_DMA_TUS         REG_BIT(5)          /**< Transmit underflow. */
+#define ETH_DMA_RS          REG_BIT(6)          /**< Receive. */
+#define ETH_DMA_RBUS        REG_BIT(7)          /**< Receive buffer unavailable. */
+#define ETH_DMA_RPSS        REG_BIT(8)
+#define ETH_DMA_RWTS        REG_BIT(9)          /**< Frame longer than 2048 bytes. */
+#define ETH_DMA_ETS         REG_BIT(10)
+#define ETH_DMA_FBES        REG_BIT(13)         /**< Fatal bus error. */
+#define ETH_DMA_ERS         REG_BIT(14)
+#define ETH_DMA_AIS         REG_BIT(15)         /**< Abnormal summary. */
+#define ETH_DMA_NIS         REG_BIT(16)         /**< Normal summary. */
+#define ETH_DMASR_RPS       REG_FIELD(17u, 3u)  /**< Receive process state. */
+#define ETH_DMASR_TPS       REG_FIELD(20u, 3u)  /**< Transmit process state. */
+#define ETH_DMASR_EBS       REG_FIELD(23u, 3u)
+
+#define ETH_DMA_PS_STOPPED  0u
+#define ETH_DMA_RPS_SUSPENDED 4u                /**< Receive: no owned descriptor. */
+#define ETH_DMA_TPS_SUSPENDED 6u                /**< Transmit: no owned descriptor. */
+
+/* DMAOMR */
+#define ETH_DMAOMR_SR       REG_BIT(1)          /**< Start receive. */
+#define ETH_DMAOMR_OSF      REG_BIT(2)          /**< Operate on second frame. */
+#define ETH_DMAOMR_FEF      REG_BIT(7)          /**< Forward error frames. */
+#define ETH_DMAOMR_ST       REG_BIT(13)         /**< Start transmit. */
+#define ETH_DMAOMR_FTF      REG_BIT(20)         /**< Flush transmit FIFO; self-clearing. */
+#define ETH_DMAOMR_TSF      REG_BIT(21)         /**< Transmit store and forward. */
+#define ETH_DMAOMR_RSF      REG_BIT(25)         /**< Receive store and forward. */
+#define ETH_DMAOMR_DTCEFD   REG_BIT(26)         /**< Keep frames with checksum errors. */
+
+/* DMAMFBOCR */
+#define ETH_DMAMFBOCR_MFC   REG_FIELD(0u, 16u)  /**< Frames missed: no descriptor. */
+#define ETH_DMAMFBOCR_MFA   REG_FIELD(17u, 11u) /**< Frames missed: FIFO overflow. */
+
+/* DMARSWTR */
+#define ETH_DMARSWTR_RSWTC  REG_FIELD(0u, 8u)   /**< Units of 256 HCLK cycles. */
+#define ETH_RSWT_CYCLES     256u
+
+/* TDES0 */
+#define ETH_TDES0_DB        REG_BIT(0)          /**< Deferred. */
+#define ETH_TDES0_UF        REG_BIT(1)          /**< Underflow error. */
+#define ETH_TDES0_EC        REG_BIT(8)          /**< Excessive collisions. */
+#define ETH_TDES0_LCO       REG_BIT(9)          /**< Late collision. */
+#define ETH_TDES0_NC        REG_BIT(10)         /**< No carrier. */
+#define ETH_TDES0_LCA       REG_BIT(11)         /**< Loss of carrier. */
+#define ETH_TDES0_IPE       REG_BIT(12)         /**< IP payload error (checksum insertion). */
+#define ETH_TDES0_IHE       REG_BIT(16)         /**< IP header error. */
+#define ETH_TDES0_ES        REG_BIT(15)         /**< Error summary. */
+#define ETH_TDES0_TCH       REG_BIT(20)         /**< des3 is the next descriptor. */
+#define ETH_TDES0_TER       REG_BIT(21)         /**< Last descriptor of the ring. */
+#define ETH_TDES0_CIC       REG_FIELD(22u, 2u)  /**< Checksum insertion: ETH_CIC_* */
+#define ETH_TDES0_DC        REG_BIT(27)         /**< Disable CRC. */
+#define ETH_TDES0_FS        REG_BIT(28)         /**< First segment. */
+#define ETH_TDES0_LS        REG_BIT(29)         /**< Last segment. */
+#define ETH_TDES0_IC        REG_BIT(30)         /**< Interrupt (TS) on completion. */
+#define ETH_DES0_OWN        REG_BIT(31)         /**< Owned by the DMA. */
+
+#define ETH_CIC_NONE        0u
+#define ETH_CIC_IP_HEADER   1u
+#define ETH_CIC_IP_PAYLOAD  2u                  /**< Header and payload, pseudo-header in frame. */
+#define ETH_CIC_FULL        3u                  /**< Header and payload, pseudo-header computed. */
+
+/* TDES1 */
+#define ETH_TDES1_TBS1      REG_FIELD(0u, 13u)
+#define ETH_TDES1_TBS2      REG_FIELD(16u, 13u)
+
+/* RDES0 */
+#define ETH_RDES0_ESA       REG_BIT(0)          /**< Extended status in RDES4. */
+#define ETH_RDES0_CE        REG_BIT(1)          /**< CRC error. */
+#define ETH_RDES0_DBE       REG_BIT(2)          /**< Dribble bit error. */
+#define ETH_RDES0_RE        REG_BIT(3)          /**< Receive error. */
+#define ETH_RDES0_RWT       REG_BIT(4)          /**< Watchdog timeout. */
+#define ETH_RDES0_FT        REG_BIT(5)          /**< Type frame. */
+#define ETH_RDES0_LCO       REG_BIT(6)          /**< Late collision. */
+#define ETH_RDES0_IPHCE     REG_BIT(7)          /**< IP header checksum error. */
+#define ETH_RDES0_LS        REG_BIT(8)          /**< Last descriptor of the frame. */
+#define ETH_RDES0_FS        REG_BIT(9)          /**< First descriptor of the frame. */
+#define ETH_RDES0_VLAN      REG_BIT(10)
+#define ETH_RDES0_OE        REG_BIT(11)         /**< Overflow error. */
+#define ETH_RDES0_LE        REG_BIT(12)         /**< Length error. */
+#define ETH_RDES0_DE        REG_BIT(14)         /**< Descriptor error. */
+#define ETH_RDES0_ES        REG_BIT(15)         /**< Error summary. */
+#define ETH_RDES0_FL        REG_FIELD(16u, 14u) /**< Frame length, FCS included if not stripped. */
+
+/* RDES1 */
+#define ETH_RDES1_RBS1      REG_FIELD(0u, 13u)
+#define ETH_RDES1_RCH       REG_BIT(14)         /**< des3 is the next descriptor. */
+#define ETH_RDES1_RER       REG_BIT(15)         /**< Last descriptor of the ring. */
+#define ETH_RDES1_RBS2      REG_FIELD(16u, 13u)
+#define ETH_RDES1_DIC       REG_BIT(31)         /**< No RS on completion (watchdog instead). */
+
+/* RDES4 */
+#define ETH_RDES4_IPPT      REG_FIELD(0u, 3u)   /**< Payload type: ETH_IPPT_* */
+#define ETH_RDES4_IPHE      REG_BIT(3)          /**< IP header error. */
+#define ETH_RDES4_IPPE      REG_BIT(4)          /**< TCP/UDP/ICMP checksum error. */
+#define ETH_RDES4_IPCB      REG_BIT(5)          /**< Checksum engine bypassed. */
+#define ETH_RDES4_IPV4PR    REG_BIT(6)
+#define ETH_RDES4_IPV6PR    REG_BIT(7)
+
+#define ETH_IPPT_UNKNOWN    0u
+#define ETH_IPPT_UDP        1u
+#define ETH_IPPT_TCP        2u
+#define ETH_IPPT_ICMP       3u
+
+#endif /* STM32_REGS_ETH_H */
@@ -0,0 +1,114 @@
+/**
+ * @file    regs/flash.h
+ * @brief   Embedded flash interface register layout (RM0090 section 3.9) and
+ *          sector map.
+ */
+#ifndef STM32_REGS_FLASH_H
+#define STM32_REGS_FLASH_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t ACR;      /**< 0x00 Access control. */
+    volatile uint32_t KEYR;     /**< 0x04 Key. */
+    volatile uint32_t OPTKEYR;  /**< 0x08 Option key. */
+    volatile uint32_t SR;       /**< 0x0C Status. */
+    volatile uint32_t CR;       /**< 0x10 Control. */
+    volatile uint32_t OPTCR;    /**< 0x14 Option control. */
+    volatile uint32_t OPTCR1;   /**< 0x18 Option control 1 (dual bank parts). */
+} flash_regs_t;
+
+REG_LAYOUT_CHECK(flash_regs_t, SR, 0x0C);
+REG_LAYOUT_CHECK(flash_regs_t, OPTCR1, 0x18);
+
+#define FLASH_BASE      (AHB1PERIPH_BASE + 0x3C00u)
+#define FLASH           STM32_PERIPH(flash_regs_t, FLASH)
+
+/* ACR */
+#define FLASH_ACR_LATENCY   REG_FIELD(0u, 4u)
+#define FLASH_ACR_PRFTEN    REG_BIT(8)
+#if defined(STM32F7)
+#define FLASH_ACR_ARTEN     REG_BIT(9)
+#define FLASH_ACR_ARTRST    REG_BIT(11)
+#else
+#define FLASH_ACR_ICEN      REG_BIT(9)
+#define FLASH_ACR_DCEN      REG_BIT(10)
+#define FLASH_ACR_ICRST     REG_BIT(11)
+#define FLASH_ACR_DCRST     REG_BIT(12)
+#endif
+
+/* KEYR: the two keys unlocking CR, in this order. */
+#define FLASH_KEY1          0x45670123u
+#define FLASH_KEY2          0xCDEF89ABu
+
+/* SR */
+#define FLASH_SR_EOP        REG_BIT(0)
+#define FLASH_SR_OPERR      REG_BIT(1)
+#define FLASH_SR_WRPERR     REG_BIT(4)
+#define FLASH_SR_PGAERR     REG_BIT(5)
+#define FLASH_SR_PGPERR     REG_BIT(6)
+#if defined(STM32F7)
+#define FLASH_SR_ERSERR     REG_BIT(7)
+#define FLASH_SR_ERRORS     (FLASH_SR_OPERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | \
+                             FLASH_SR_PGPERR | FLASH_SR_ERSERR)
+#else
+#define FLASH_SR_PGSERR     REG_BIT(7)
+#define FLASH_SR_ERRORS     (FLASH_SR_OPERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | \
+                             FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+#endif
+#define FLASH_SR_BSY        REG_BIT(16)
+
+/* CR */
+#define FLASH_CR_PG         REG_BIT(0)
+#define FLASH_CR_SER        REG_BIT(1)
+#define FLASH_CR_MER        REG_BIT(2)
+#if defined(STM32F7)
+#define FLASH_CR_SNB        REG_FIELD(3u, 4u)
+#else
+#define FLASH_CR_SNB        REG_FIELD(3u, 5u)   /**< Bit 7: bank 2 on F42x/F43x. */
+#endif
+#define FLASH_CR_PSIZE      REG_FIELD(8u, 2u)
+#define FLASH_CR_STRT       REG_BIT(16)
+#define FLASH_CR_EOPIE      REG_BIT(24)
+#define FLASH_CR_ERRIE      REG_BIT(25)
+#define FLASH_CR_LOCK       REG_BIT(31)
+
+/* CR.PSIZE: program parallelism, the access size of each program store. */
+#define FLASH_PSIZE_X8      0u
+#define FLASH_PSIZE_X16     1u
+#define FLASH_PSIZE_X32     2u
+#define FLASH_PSIZE_X64     3u
+
+/*
+ * Sector layout of the 1 MiB single-bank parts.  Both families have four
+ * sectors of one unit (F4: 16 KiB, F7: 32 KiB), one of four units, then
+ * sectors of eight units.
+ */
+#if defined(STM32F7)
+#define FLASH_SECTOR_UNIT   0x8000u
+#define FLASH_SECTOR_COUNT  8u
+#else
+#define FLASH_SECTOR_UNIT   0x4000u
+#define FLASH_SECTOR_COUNT  12u
+#endif
+
+/** Offset of sector @p n from FLASH_MEM_BASE. */
+#define FLASH_SECTOR_OFFSET(n) \
+    ((n) < 5u ? (n) * FLASH_SECTOR_UNIT : ((n) - 4u) * 8u * FLASH_SECTOR_UNIT)
+
+/** Size of sector @p n in bytes. */
+#define FLASH_SECTOR_SIZE(n) \
+    ((n) < 4u ? FLASH_SECTOR_UNIT : (n) == 4u ? 4u * FLASH_SECTOR_UNIT : 8u * FLASH_SECTOR_UNIT)
+
+/*
+ * The memory array itself, as words.  Drivers reach it through FLASHMEM so
+ * that the host build has a stand-in to program (host/sim_flash.c).
+ */
+typedef struct {
+    volatile uint32_t W[FLASH_MEM_SIZE / 4u];
+} flash_mem_t;
+
+#define FLASHMEM_BASE   FLASH_MEM_BASE
+#define FLASHMEM        STM32_PERIPH(flash_mem_t, FLASHMEM)
+
+#endif /* STM32_REGS_FLASH_H */
@@ -0,0 +1,78 @@
+/**
+ * @file    regs/gpio.h
+ * @brief   GPIO register layout (RM0090 section 8.4).
+ */
+#ifndef STM32_REGS_GPIO_H
+#define STM32_REGS_GPIO_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t MODER;    /**< 0x00 Mode. */
+    volatile uint32_t OTYPER;   /**< 0x04 Output type. */
+    volatile uint32_t OSPEEDR;  /**< 0x08 Output speed. */
+    volatile uint32_t PUPDR;    /**< 0x0C Pull-up/pull-down. */
+    volatile uint32_t IDR;      /**< 0x10 Input data (read-only). */
+    volatile uint32_t ODR;      /**< 0x14 Output data. */
+    volatile uint32_t BSRR;     /**< 0x18 Bit set/reset (write-only). */
+    volatile uint32_t LCKR;     /**< 0x1C Configuration lock. */
+    volatile uint32_t AFR[2];   /**< 0x20 Alternate function low/high. */
+} gpio_regs_t;
+
+REG_LAYOUT_CHECK(gpio_regs_t, BSRR, 0x18);
+REG_LAYOUT_CHECK(gpio_regs_t, AFR, 0x20);
+
+#define GPIOA_BASE  (AHB1PERIPH_BASE + 0x0000u)
+#define GPIOB_BASE  (AHB1PERIPH_BASE + 0x0400u)
+#define GPIOC_BASE  (AHB1PERIPH_BASE + 0x0800u)
+#define GPIOD_BASE  (AHB1PERIPH_BASE + 0x0C00u)
+#define GPIOE_BASE  (AHB1PERIPH_BASE + 0x1000u)
+#define GPIOF_BASE  (AHB1PERIPH_BASE + 0x1400u)
+#define GPIOG_BASE  (AHB1PERIPH_BASE + 0x1800u)
+#define GPIOH_BASE  (AHB1PERIPH_BASE + 0x1C00u)
+#define GPIOI_BASE  (AHB1PERIPH_BASE + 0x2000u)
+
+#define GPIOA       STM32_PERIPH(gpio_regs_t, GPIOA)
+#define GPIOB       STM32_PERIPH(gpio_regs_t, GPIOB)
+#define GPIOC       STM32_PERIPH(gpio_regs_t, GPIOC)
+#define GPIOD       STM32_PERIPH(gpio_regs_t, GPIOD)
+#define GPIOE       STM32_PERIPH(gpio_regs_t, GPIOE)
+#define GPIOF       STM32_PERIPH(gpio_regs_t, GPIOF)
+#define GPIOG       STM32_PERIPH(gpio_regs_t, GPIOG)
+#define GPIOH       STM32_PERIPH(gpio_regs_t, GPIOH)
+#define GPIOI       STM32_PERIPH(gpio_regs_t, GPIOI)
+
+/* Per-pin fields; n is the pin number 0..15. */
+#define GPIO_MODER_MODE(n)      REG_FIELD(2u * (n), 2u)
+#define GPIO_OTYPER_OT(n)       REG_BIT(n)
+#define GPIO_OSPEEDR_SPEED(n)   REG_FIELD(2u * (n), 2u)
+#define GPIO_PUPDR_PUPD(n)      REG_FIELD(2u * (n), 2u)
+#define GPIO_AFR_AF(n)          REG_FIELD(4u * ((n) & 7u), 4u)
+
+#define GPIO_BSRR_BS(n)         REG_BIT(n)
+#define GPIO_BSRR_BR(n)         REG_BIT((n) + 16u)
+
+#define GPIO_LCKR_LCKK          REG_BIT(16)
+
+/* MODER values. */
+#define GPIO_MODE_INPUT         0u
+#define GPIO_MODE_OUTPUT        1u
+#define GPIO_MODE_AF            2u
+#define GPIO_MODE_ANALOG        3u
+
+/* OTYPER values. */
+#define GPIO_OTYPE_PUSHPULL     0u
+#define GPIO_OTYPE_OPENDRAIN    1u
+
+/* OSPEEDR values. */
+#define GPIO_SPEED_LOW          0u
+#define GPIO_SPEED_MEDIUM       1u
+#define GPIO_SPEED_HIGH         2u
+#define GPIO_SPEED_VERY_HIGH    3u
+
+/* PUPDR values. */
+#define GPIO_PULL_NONE          0u
+#define GPIO_PULL_UP            1u
+#define GPIO_PULL_DOWN          2u
+
+#endif /* STM32_REGS_GPIO_H */
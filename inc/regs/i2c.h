@@ -0,0 +1,86 @@
+/**
+ * @file    regs/i2c.h
+ * @brief   I2C register layout (RM0090 section 27.6).
+ */
+#ifndef STM32_REGS_I2C_H
+#define STM32_REGS_I2C_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t CR1;      /**< 0x00 Control 1. */
+    volatile uint32_t CR2;      /**< 0x04 Control 2. */
+    volatile uint32_t OAR1;     /**< 0x08 Own address 1. */
+    volatile uint32_t OAR2;     /**< 0x0C Own address 2. */
+    volatile uint32_t DR;       /**< 0x10 Data. */
+    volatile uint32_t SR1;      /**< 0x14 Status 1. */
+    volatile uint32_t SR2;      /**< 0x18 Status 2. */
+    volatile uint32_t CCR;      /**< 0x1C Clock control. */
+    volatile uint32_t TRISE;    /**< 0x20 Maximum rise time. */
+    volatile uint32_t FLTR;     /**< 0x24 Noise filter. */
+} i2c_regs_t;
+
+REG_LAYOUT_CHECK(i2c_regs_t, DR, 0x10);
+REG_LAYOUT_CHECK(i2c_regs_t, FLTR, 0x24);
+
+#define I2C1_BASE   (APB1PERIPH_BASE + 0x5400u)
+#define I2C2_BASE   (APB1PERIPH_BASE + 0x5800u)
+#define I2C3_BASE   (APB1PERIPH_BASE + 0x5C00u)
+
+#define I2C1        STM32_PERIPH(i2c_regs_t, I2C1)
+#define I2C2        STM32_PERIPH(i2c_regs_t, I2C2)
+#define I2C3        STM32_PERIPH(i2c_regs_t, I2C3)
+
+/* CR1 */
+#define I2C_CR1_PE          REG_BIT(0)
+#define I2C_CR1_SMBUS       REG_BIT(1)
+#define I2C_CR1_ENGC        REG_BIT(6)
+#define I2C_CR1_NOSTRETCH   REG_BIT(7)
+#define I2C_CR1_START       REG_BIT(8)
+#define I2C_CR1_STOP        REG_BIT(9)
+#define I2C_CR1_ACK         REG_BIT(10)
+#define I2C_CR1_POS         REG_BIT(11)
+#define I2C_CR1_SWRST       REG_BIT(15)
+
+/* CR2 */
+#define I2C_CR2_FREQ        REG_FIELD(0u, 6u)   /**< PCLK1 in MHz, 2..50. */
+#define I2C_CR2_ITERREN     REG_BIT(8)
+#define I2C_CR2_ITEVTEN     REG_BIT(9)
+#define I2C_CR2_ITBUFEN     REG_BIT(10)
+#define I2C_CR2_DMAEN       REG_BIT(11)
+#define I2C_CR2_LAST        REG_BIT(12)     /**< NACK after the last DMA byte. */
+
+/* SR1 */
+#define I2C_SR1_SB          REG_BIT(0)
+#define I2C_SR1_ADDR        REG_BIT(1)
+#define I2C_SR1_BTF         REG_BIT(2)
+#define I2C_SR1_ADD10       REG_BIT(3)
+#define I2C_SR1_STOPF       REG_BIT(4)
+#define I2C_SR1_RXNE        REG_BIT(6)
+#define I2C_SR1_TXE         REG_BIT(7)
+#define I2C_SR1_BERR        REG_BIT(8)
+#define I2C_SR1_ARLO        REG_BIT(9)
+#define I2C_SR1_AF          REG_BIT(10)
+#define I2C_SR1_OVR         REG_BIT(11)
+#define I2C_SR1_PECERR      REG_BIT(12)
+#define I2C_SR1_TIMEOUT     REG_BIT(14)
+#define I2C_SR1_SMBALERT    REG_BIT(15)
+
+/** Error flags (rc_w0) reported through the error interrupt. */
+#define I2C_SR1_ERRORS      (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | \
+                             I2C_SR1_PECERR | I2C_SR1_TIMEOUT | I2C_SR1_SMBALERT)
+
+/* SR2 */
+#define I2C_SR2_MSL         REG_BIT(0)
+#define I2C_SR2_BUSY        REG_BIT(1)
+#define I2C_SR2_TRA         REG_BIT(2)
+
+/* CCR */
+#define I2C_CCR_CCR         REG_FIELD(0u, 12u)
+#define I2C_CCR_DUTY        REG_BIT(14)
+#define I2C_CCR_FS          REG_BIT(15)
+
+/* TRISE */
+#define I2C_TRISE_TRISE     REG_FIELD(0u, 6u)
+
+#endif /* STM32_REGS_I2C_H */
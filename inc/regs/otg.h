@@ -0,0 +1,212 @@
+/**
+ * @file    regs/otg.h
+ * @brief   USB OTG full-speed core register layout, device mode only
+ *          (RM0090 section 34.16, RM0385 section 32.15).
+ *
+ * The core has no packet memory visible to the CPU: packets go through one
+ * shared receive FIFO and one transmit FIFO per IN endpoint, all carved out
+ * of OTG_FS_FIFO_WORDS words of FIFO RAM and accessed a word at a time
+ * through the per-endpoint FIFO windows at 0x1000 * (n + 1).
+ */
+#ifndef STM32_REGS_OTG_H
+#define STM32_REGS_OTG_H
+
+#include "reg.h"
+
+#if defined(STM32F7)
+#define OTG_FS_EP_COUNT     6u          /**< Endpoints per direction, EP0 included. */
+#else
+#define OTG_FS_EP_COUNT     4u
+#endif
+#define OTG_FS_FIFO_WORDS   320u        /**< 1.25 KiB FIFO RAM. */
+
+/** Endpoint register block; the same layout serves IN (0x900) and OUT (0xB00). */
+typedef struct {
+    volatile uint32_t CTL;      /**< DIEPCTL / DOEPCTL */
+    uint32_t RESERVED0;
+    volatile uint32_t INT;      /**< DIEPINT / DOEPINT */
+    uint32_t RESERVED1;
+    volatile uint32_t TSIZ;     /**< DIEPTSIZ / DOEPTSIZ */
+    uint32_t RESERVED2;
+    volatile uint32_t TXFSTS;   /**< DTXFSTS (IN endpoints only) */
+    uint32_t RESERVED3;
+} otg_ep_regs_t;
+
+typedef struct {
+    volatile uint32_t GOTGCTL;  /**< 0x000 OTG control and status. */
+    volatile uint32_t GOTGINT;  /**< 0x004 OTG interrupt. */
+    volatile uint32_t GAHBCFG;  /**< 0x008 AHB configuration. */
+    volatile uint32_t GUSBCFG;  /**< 0x00C USB configuration. */
+    volatile uint32_t GRSTCTL;  /**< 0x010 Reset. */
+    volatile uint32_t GINTSTS;  /**< 0x014 Core interrupt. */
+    volatile uint32_t GINTMSK;  /**< 0x018 Interrupt mask. */
+    volatile uint32_t GRXSTSR;  /**< 0x01C Receive status debug read. */
+    volatile uint32_t GRXSTSP;  /**< 0x020 Receive status read and pop. */
+    volatile uint32_t GRXFSIZ;  /**< 0x024 Receive FIFO size. */
+    volatile uint32_t DIEPTXF0; /**< 0x028 EP0 transmit FIFO size. */
+    volatile uint32_t HNPTXSTS; /**< 0x02C Host only. */
+    uint32_t RESERVED0[2];
+    volatile uint32_t GCCFG;    /**< 0x038 General core configuration. */
+    volatile uint32_t CID;      /**< 0x03C Core ID. */
+    uint32_t RESERVED1[48];
+    volatile uint32_t HPTXFSIZ; /**< 0x100 Host only. */
+    volatile uint32_t DIEPTXF[15];  /**< 0x104 EP1.. transmit FIFO sizes. */
+    uint32_t RESERVED2[432];
+    volatile uint32_t DCFG;     /**< 0x800 Device configuration. */
+    volatile uint32_t DCTL;     /**< 0x804 Device control. */
+    volatile uint32_t DSTS;     /**< 0x808 Device status. */
+    uint32_t RESERVED3;
+    volatile uint32_t DIEPMSK;  /**< 0x810 IN endpoint interrupt mask. */
+    volatile uint32_t DOEPMSK;  /**< 0x814 OUT endpoint interrupt mask. */
+    volatile uint32_t DAINT;    /**< 0x818 Endpoint interrupts: IN 15:0, OUT 31:16. */
+    volatile uint32_t DAINTMSK; /**< 0x81C */
+    uint32_t RESERVED4[2];
+    volatile uint32_t DVBUSDIS; /**< 0x828 */
+    volatile uint32_t DVBUSPULSE; /**< 0x82C */
+    uint32_t RESERVED5;
+    volatile uint32_t DIEPEMPMSK;   /**< 0x834 TX FIFO empty interrupt mask. */
+    uint32_t RESERVED6[50];
+    otg_ep_regs_t IEP[16];      /**< 0x900 */
+    otg_ep_regs_t OEP[16];      /**< 0xB00 */
+    uint32_t RESERVED7[64];
+    volatile uint32_t PCGCCTL;  /**< 0xE00 Power and clock gating. */
+    uint32_t RESERVED8[127];
+    /** 0x1000 FIFO windows: write pushes to IN FIFO n, read pops the RX FIFO. */
+    volatile uint32_t FIFO[OTG_FS_EP_COUNT][1024];
+} otg_regs_t;
+
+REG_LAYOUT_CHECK(otg_regs_t, GCCFG, 0x038);
+REG_LAYOUT_CHECK(otg_regs_t, DIEPTXF, 0x104);
+REG_LAYOUT_CHECK(otg_regs_t, DCFG, 0x800);
+REG_LAYOUT_CHECK(otg_regs_t, DIEPEMPMSK, 0x834);
+REG_LAYOUT_CHECK(otg_regs_t, IEP, 0x900);
+REG_LAYOUT_CHECK(otg_regs_t, OEP, 0xB00);
+REG_LAYOUT_CHECK(otg_regs_t, PCGCCTL, 0xE00);
+REG_LAYOUT_CHECK(otg_regs_t, FIFO, 0x1000);
+
+#define OTG_FS_BASE         (AHB2PERIPH_BASE + 0x0000u)
+#define OTG_FS              STM32_PERIPH(otg_regs_t, OTG_FS)
+
+/* GOTGCTL */
+#define OTG_GOTGCTL_BVALOEN     REG_BIT(6)      /**< F7: override B-session valid. */
+#define OTG_GOTGCTL_BVALOVAL    REG_BIT(7)
+
+/* GAHBCFG */
+#define OTG_GAHBCFG_GINT        REG_BIT(0)
+#define OTG_GAHBCFG_TXFELVL     REG_BIT(7)      /**< TXFE: 0 half empty, 1 empty. */
+
+/* GUSBCFG */
+#define OTG_GUSBCFG_PHYSEL      REG_BIT(6)
+#define OTG_GUSBCFG_TRDT        REG_FIELD(10u, 4u)
+#define OTG_GUSBCFG_FHMOD       REG_BIT(29)
+#define OTG_GUSBCFG_FDMOD       REG_BIT(30)
+
+/* GRSTCTL */
+#define OTG_GRSTCTL_CSRST       REG_BIT(0)
+#define OTG_GRSTCTL_RXFFLSH     REG_BIT(4)
+#define OTG_GRSTCTL_TXFFLSH     REG_BIT(5)
+#define OTG_GRSTCTL_TXFNUM      REG_FIELD(6u, 5u)
+#define OTG_GRSTCTL_TXFNUM_ALL  0x10u
+#define OTG_GRSTCTL_AHBIDL      REG_BIT(31)
+
+/* GINTSTS / GINTMSK */
+#define OTG_GINT_CMOD           REG_BIT(0)      /**< 1: host mode. */
+#define OTG_GINT_MMIS           REG_BIT(1)
+#define OTG_GINT_OTGINT         REG_BIT(2)
+#define OTG_GINT_SOF            REG_BIT(3)
+#define OTG_GINT_RXFLVL         REG_BIT(4)
+#define OTG_GINT_ESUSP          REG_BIT(10)
+#define OTG_GINT_USBSUSP        REG_BIT(11)
+#define OTG_GINT_USBRST         REG_BIT(12)
+#define OTG_GINT_ENUMDNE        REG_BIT(13)
+#define OTG_GINT_IEPINT         REG_BIT(18)
+#define OTG_GINT_OEPINT         REG_BIT(19)
+#define OTG_GINT_SRQINT         REG_BIT(30)
+#define OTG_GINT_WKUPINT        REG_BIT(31)
+
+/* GRXSTSR / GRXSTSP */
+#define OTG_GRXSTS_EPNUM        REG_FIELD(0u, 4u)
+#define OTG_GRXSTS_BCNT         REG_FIELD(4u, 11u)
+#define OTG_GRXSTS_DPID         REG_FIELD(15u, 2u)
+#define OTG_GRXSTS_PKTSTS       REG_FIELD(17u, 4u)
+#define OTG_PKTSTS_GONAK        1u      /**< Global OUT NAK effective. */
+#define OTG_PKTSTS_OUT_DATA     2u      /**< OUT packet; BCNT bytes follow. */
+#define OTG_PKTSTS_OUT_DONE     3u      /**< OUT transfer complete. */
+#define OTG_PKTSTS_SETUP_DONE   4u      /**< SETUP stage complete. */
+#define OTG_PKTSTS_SETUP_DATA   6u      /**< SETUP packet; 8 bytes follow. */
+
+/* GRXFSIZ: depth in words; DIEPTXFn: start address and depth in words */
+#define OTG_GRXFSIZ_RXFD        REG_FIELD(0u, 16u)
+#define OTG_TXF_START           REG_FIELD(0u, 16u)
+#define OTG_TXF_DEPTH           REG_FIELD(16u, 16u)
+
+/* GCCFG */
+#define OTG_GCCFG_PWRDWN        REG_BIT(16)     /**< Transceiver on. */
+#if defined(STM32F7)
+#define OTG_GCCFG_VBDEN         REG_BIT(21)     /**< VBUS detection enable. */
+#else
+#define OTG_GCCFG_VBUSBSEN      REG_BIT(19)
+#define OTG_GCCFG_NOVBUSSENS    REG_BIT(21)
+#endif
+
+/* DCFG */
+#define OTG_DCFG_DSPD           REG_FIELD(0u, 2u)
+#define OTG_DCFG_DSPD_FS        3u
+#define OTG_DCFG_DAD            REG_FIELD(4u, 7u)
+#define OTG_DCFG_PFIVL          REG_FIELD(11u, 2u)
+
+/* DCTL */
+#define OTG_DCTL_RWUSIG         REG_BIT(0)
+#define OTG_DCTL_SDIS           REG_BIT(1)      /**< Soft disconnect (D+ pull-up off). */
+#define OTG_DCTL_SGINAK         REG_BIT(7)
+#define OTG_DCTL_CGINAK         REG_BIT(8)
+#define OTG_DCTL_SGONAK         REG_BIT(9)
+#define OTG_DCTL_CGONAK         REG_BIT(10)
+
+/* DSTS */
+#define OTG_DSTS_SUSPSTS        REG_BIT(0)
+#define OTG_DSTS_ENUMSPD        REG_FIELD(1u, 2u)
+#define OTG_DSTS_FNSOF          REG_FIELD(8u, 14u)
+
+/* DAINT / DAINTMSK */
+#define OTG_DAINT_IEP(n)        REG_BIT(n)
+#define OTG_DAINT_OEP(n)        REG_BIT(16u + (n))
+
+/* DIEPCTL / DOEPCTL */
+#define OTG_EPCTL_MPSIZ         REG_FIELD(0u, 11u)
+#define OTG_EPCTL_MPSIZ_EP0     REG_FIELD(0u, 2u)   /**< 0: 64, 1: 32, 2: 16, 3: 8. */
+#define OTG_EPCTL_USBAEP        REG_BIT(15)
+#define OTG_EPCTL_DPID          REG_BIT(16)
+#define OTG_EPCTL_NAKSTS        REG_BIT(17)
+#define OTG_EPCTL_EPTYP         REG_FIELD(18u, 2u)
+#define OTG_EPCTL_SNPM          REG_BIT(20)
+#define OTG_EPCTL_STALL         REG_BIT(21)
+#define OTG_EPCTL_TXFNUM        REG_FIELD(22u, 4u)
+#define OTG_EPCTL_CNAK          REG_BIT(26)
+#define OTG_EPCTL_SNAK          REG_BIT(27)
+#define OTG_EPCTL_SD0PID        REG_BIT(28)
+#define OTG_EPCTL_SODDFRM       REG_BIT(29)
+#define OTG_EPCTL_EPDIS         REG_BIT(30)
+#define OTG_EPCTL_EPENA         REG_BIT(31)
+
+/* DIEPINT / DOEPINT (and DIEPMSK / DOEPMSK) */
+#define OTG_EPINT_XFRC          REG_BIT(0)
+#define OTG_EPINT_EPDISD        REG_BIT(1)
+#define OTG_EPINT_TOC           REG_BIT(3)      /**< IN: timeout (control). */
+#define OTG_EPINT_STUP          REG_BIT(3)      /**< OUT: SETUP stage done. */
+#define OTG_EPINT_OTEPDIS       REG_BIT(4)
+#define OTG_EPINT_INEPNE        REG_BIT(6)
+#define OTG_EPINT_B2BSTUP       REG_BIT(6)
+#define OTG_EPINT_TXFE          REG_BIT(7)      /**< IN: FIFO empty (level, read-only). */
+
+/* DIEPTSIZ / DOEPTSIZ */
+#define OTG_TSIZ_XFRSIZ         REG_FIELD(0u, 19u)
+#define OTG_TSIZ_PKTCNT         REG_FIELD(19u, 10u)
+#define OTG_TSIZ_XFRSIZ_EP0     REG_FIELD(0u, 7u)
+#define OTG_TSIZ_PKTCNT_EP0     REG_FIELD(19u, 2u)
+#define OTG_TSIZ_STUPCNT        REG_FIELD(29u, 2u)
+
+/* DTXFSTS */
+#define OTG_TXFSTS_INEPTFSAV    REG_FIELD(0u, 16u)
+
+#endif /* STM32_REGS_OTG_H */
@@ -0,0 +1,111 @@
+/**
+ * @file    regs/quadspi.h
+ * @brief   Quad-SPI interface register layout (RM0390 section 12.5, RM0385
+ *          section 13.5) and its memory-mapped bank.
+ *
+ * The QUADSPI is on the F446/F469/F479 and on every F7 part, with the same
+ * register map; the F7 has a 32-byte FIFO where the F4 has 16, which only
+ * widens FLEVEL and FTHRES.  It is clocked from HCLK.
+ */
+#ifndef STM32_REGS_QUADSPI_H
+#define STM32_REGS_QUADSPI_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t CR;       /**< 0x00 Control. */
+    volatile uint32_t DCR;      /**< 0x04 Device configuration. */
+    volatile uint32_t SR;       /**< 0x08 Status. */
+    volatile uint32_t FCR;      /**< 0x0C Flag clear. */
+    volatile uint32_t DLR;      /**< 0x10 Data length - 1. */
+    volatile uint32_t CCR;      /**< 0x14 Communication configuration. */
+    volatile uint32_t AR;       /**< 0x18 Address. */
+    volatile uint32_t ABR;      /**< 0x1C Alternate bytes, sent from the top. */
+    volatile uint32_t DR;       /**< 0x20 Data FIFO. */
+    volatile uint32_t PSMKR;    /**< 0x24 Status polling mask. */
+    volatile uint32_t PSMAR;    /**< 0x28 Status polling match. */
+    volatile uint32_t PIR;      /**< 0x2C Polling interval, clock cycles. */
+    volatile uint32_t LPTR;     /**< 0x30 Memory-mapped low-power timeout. */
+} quadspi_regs_t;
+
+REG_LAYOUT_CHECK(quadspi_regs_t, DR, 0x20);
+REG_LAYOUT_CHECK(quadspi_regs_t, LPTR, 0x30);
+
+#define QUADSPI_BASE        0xA0001000u
+#define QUADSPI             STM32_PERIPH(quadspi_regs_t, QUADSPI)
+
+/* CR */
+#define QUADSPI_CR_EN       REG_BIT(0)
+#define QUADSPI_CR_ABORT    REG_BIT(1)
+#define QUADSPI_CR_DMAEN    REG_BIT(2)
+#define QUADSPI_CR_TCEN     REG_BIT(3)          /**< Memory-mapped: release CS after LPTR. */
+#define QUADSPI_CR_SSHIFT   REG_BIT(4)          /**< Sample half a clock later. */
+#define QUADSPI_CR_DFM      REG_BIT(6)
+#define QUADSPI_CR_FSEL     REG_BIT(7)
+#define QUADSPI_CR_FTHRES   REG_FIELD(8u, 4u)   /**< FIFO threshold - 1. */
+#define QUADSPI_CR_TEIE     REG_BIT(16)
+#define QUADSPI_CR_TCIE     REG_BIT(17)
+#define QUADSPI_CR_FTIE     REG_BIT(18)
+#define QUADSPI_CR_SMIE     REG_BIT(19)
+#define QUADSPI_CR_TOIE     REG_BIT(20)
+#define QUADSPI_CR_APMS     REG_BIT(22)         /**< Stop auto-polling at the first match. */
+#define QUADSPI_CR_PMM      REG_BIT(23)         /**< Match any masked bit, not all. */
+#define QUADSPI_CR_PRESCALER REG_FIELD(24u, 8u) /**< Clock HCLK / (PRESCALER + 1). */
+
+/* DCR */
+#define QUADSPI_DCR_CKMODE  REG_BIT(0)          /**< Clock idles high (mode 3). */
+#define QUADSPI_DCR_CSHT    REG_FIELD(8u, 3u)   /**< CS high time - 1, clock cycles. */
+#define QUADSPI_DCR_FSIZE   REG_FIELD(16u, 5u)  /**< Flash size 2^(FSIZE + 1) bytes. */
+
+/* SR and FCR */
+#define QUADSPI_SR_TEF      REG_BIT(0)
+#define QUADSPI_SR_TCF      REG_BIT(1)
+#define QUADSPI_SR_FTF      REG_BIT(2)
+#define QUADSPI_SR_SMF      REG_BIT(3)
+#define QUADSPI_SR_TOF      REG_BIT(4)
+#define QUADSPI_SR_BUSY     REG_BIT(5)
+#define QUADSPI_SR_FLEVEL   REG_FIELD(8u, 6u)   /**< Bytes in the FIFO (bit 13 F7 only). */
+
+#define QUADSPI_FCR_ALL     (QUADSPI_SR_TEF | QUADSPI_SR_TCF | QUADSPI_SR_SMF | QUADSPI_SR_TOF)
+
+/* CCR */
+#define QUADSPI_CCR_INSTRUCTION REG_FIELD(0u, 8u)
+#define QUADSPI_CCR_IMODE   REG_FIELD(8u, 2u)   /**< QUADSPI_LINES_* */
+#define QUADSPI_CCR_ADMODE  REG_FIELD(10u, 2u)  /**< QUADSPI_LINES_* */
+#define QUADSPI_CCR_ADSIZE  REG_FIELD(12u, 2u)  /**< Bytes - 1. */
+#define QUADSPI_CCR_ABMODE  REG_FIELD(14u, 2u)  /**< QUADSPI_LINES_* */
+#define QUADSPI_CCR_ABSIZE  REG_FIELD(16u, 2u)  /**< Bytes - 1. */
+#define QUADSPI_CCR_DCYC    REG_FIELD(18u, 5u)  /**< Dummy cycles. */
+#define QUADSPI_CCR_DMODE   REG_FIELD(24u, 2u)  /**< QUADSPI_LINES_* */
+#define QUADSPI_CCR_FMODE   REG_FIELD(26u, 2u)  /**< QUADSPI_FMODE_* */
+#define QUADSPI_CCR_SIOO    REG_BIT(28)
+#define QUADSPI_CCR_DHHC    REG_BIT(30)
+#define QUADSPI_CCR_DDRM    REG_BIT(31)
+
+/* Phase modes: absent, or on 1, 2 or 4 lines. */
+#define QUADSPI_LINES_NONE  0u
+#define QUADSPI_LINES_1     1u
+#define QUADSPI_LINES_2     2u
+#define QUADSPI_LINES_4     3u
+
+#define QUADSPI_FMODE_WRITE 0u                  /**< Indirect write. */
+#define QUADSPI_FMODE_READ  1u                  /**< Indirect read. */
+#define QUADSPI_FMODE_POLL  2u                  /**< Automatic status polling. */
+#define QUADSPI_FMODE_MAP   3u                  /**< Memory-mapped. */
+
+/*
+ * Memory-mapped bank: while CCR.FMODE is QUADSPI_FMODE_MAP the flash reads
+ * here, first byte at QSPIMEM_BASE; outside that mode, or past the FSIZE
+ * the DCR gives, an access is a bus error.  The bank is 256 MiB; the
+ * stand-in covers the 16 MiB that three address bytes reach.
+ */
+#define QSPIMEM_BASE        0x90000000u
+#define QSPIMEM_SIZE        0x01000000u
+
+typedef struct {
+    volatile uint8_t B[QSPIMEM_SIZE];
+} qspi_mem_t;
+
+#define QSPIMEM             STM32_PERIPH(qspi_mem_t, QSPIMEM)
+
+#endif /* STM32_REGS_QUADSPI_H */
@@ -0,0 +1,129 @@
+/**
+ * @file    regs/rcc.h
+ * @brief   Reset and clock control register layout (RM0090 section 7.3).
+ */
+#ifndef STM32_REGS_RCC_H
+#define STM32_REGS_RCC_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t CR;           /**< 0x00 Clock control. */
+    volatile uint32_t PLLCFGR;      /**< 0x04 PLL configuration. */
+    volatile uint32_t CFGR;         /**< 0x08 Clock configuration. */
+    volatile uint32_t CIR;          /**< 0x0C Clock interrupt. */
+    volatile uint32_t AHB1RSTR;     /**< 0x10 */
+    volatile uint32_t AHB2RSTR;     /**< 0x14 */
+    volatile uint32_t AHB3RSTR;     /**< 0x18 */
+    uint32_t          RESERVED0;
+    volatile uint32_t APB1RSTR;     /**< 0x20 */
+    volatile uint32_t APB2RSTR;     /**< 0x24 */
+    uint32_t          RESERVED1[2];
+    volatile uint32_t AHB1ENR;      /**< 0x30 */
+    volatile uint32_t AHB2ENR;      /**< 0x34 */
+    volatile uint32_t AHB3ENR;      /**< 0x38 */
+    uint32_t          RESERVED2;
+    volatile uint32_t APB1ENR;      /**< 0x40 */
+    volatile uint32_t APB2ENR;      /**< 0x44 */
+    uint32_t          RESERVED3[2];
+    volatile uint32_t AHB1LPENR;    /**< 0x50 */
+    volatile uint32_t AHB2LPENR;    /**< 0x54 */
+    volatile uint32_t AHB3LPENR;    /**< 0x58 */
+    uint32_t          RESERVED4;
+    volatile uint32_t APB1LPENR;    /**< 0x60 */
+    volatile uint32_t APB2LPENR;    /**< 0x64 */
+    uint32_t          RESERVED5[2];
+    volatile uint32_t BDCR;         /**< 0x70 Backup domain control. */
+    volatile uint32_t CSR;          /**< 0x74 Control/status. */
+    uint32_t          RESERVED6[2];
+    volatile uint32_t SSCGR;        /**< 0x80 Spread spectrum. */
+    volatile uint32_t PLLI2SCFGR;   /**< 0x84 */
+    volatile uint32_t PLLSAICFGR;   /**< 0x88 */
+    volatile uint32_t DCKCFGR;      /**< 0x8C Dedicated clocks. */
+} rcc_regs_t;
+
+REG_LAYOUT_CHECK(rcc_regs_t, AHB1ENR, 0x30);
+REG_LAYOUT_CHECK(rcc_regs_t, APB1ENR, 0x40);
+REG_LAYOUT_CHECK(rcc_regs_t, BDCR, 0x70);
+REG_LAYOUT_CHECK(rcc_regs_t, DCKCFGR, 0x8C);
+
+#define RCC_BASE    (AHB1PERIPH_BASE + 0x3800u)
+#define RCC         STM32_PERIPH(rcc_regs_t, RCC)
+
+/* CR */
+#define RCC_CR_HSION            REG_BIT(0)
+#define RCC_CR_HSIRDY           REG_BIT(1)
+#define RCC_CR_HSEON            REG_BIT(16)
+#define RCC_CR_HSERDY           REG_BIT(17)
+#define RCC_CR_HSEBYP           REG_BIT(18)
+#define RCC_CR_CSSON            REG_BIT(19)
+#define RCC_CR_PLLON            REG_BIT(24)
+#define RCC_CR_PLLRDY           REG_BIT(25)
+
+/* PLLCFGR */
+#define RCC_PLLCFGR_PLLM        REG_FIELD(0u, 6u)
+#define RCC_PLLCFGR_PLLN        REG_FIELD(6u, 9u)
+#define RCC_PLLCFGR_PLLP        REG_FIELD(16u, 2u)
+#define RCC_PLLCFGR_PLLSRC      REG_BIT(22)
+#define RCC_PLLCFGR_PLLQ        REG_FIELD(24u, 4u)
+
+/* CFGR */
+#define RCC_CFGR_SW             REG_FIELD(0u, 2u)
+#define RCC_CFGR_SWS            REG_FIELD(2u, 2u)
+#define RCC_CFGR_HPRE           REG_FIELD(4u, 4u)
+#define RCC_CFGR_PPRE1          REG_FIELD(10u, 3u)
+#define RCC_CFGR_PPRE2          REG_FIELD(13u, 3u)
+
+#define RCC_CFGR_SW_HSI         0u
+#define RCC_CFGR_SW_HSE         1u
+#define RCC_CFGR_SW_PLL         2u
+
+/* AHB1RSTR */
+#define RCC_AHB1RSTR_ETHMACRST  REG_BIT(25)
+
+/* AHB1ENR */
+#define RCC_AHB1ENR_GPIOEN(n)   REG_BIT(n)      /**< n = 0 (A) .. 8 (I) */
+#define RCC_AHB1ENR_CRCEN       REG_BIT(12)
+#define RCC_AHB1ENR_DMA1EN      REG_BIT(21)
+#define RCC_AHB1ENR_DMA2EN      REG_BIT(22)
+#define RCC_AHB1ENR_ETHMACEN    REG_BIT(25)
+#define RCC_AHB1ENR_ETHMACTXEN  REG_BIT(26)
+#define RCC_AHB1ENR_ETHMACRXEN  REG_BIT(27)
+
+/* AHB2ENR */
+#define RCC_AHB2ENR_OTGFSEN     REG_BIT(7)
+
+/* AHB3ENR */
+#define RCC_AHB3ENR_QSPIEN      REG_BIT(1)
+
+/* APB1ENR */
+#define RCC_APB1ENR_TIM2EN      REG_BIT(0)
+#define RCC_APB1ENR_TIM3EN      REG_BIT(1)
+#define RCC_APB1ENR_TIM4EN      REG_BIT(2)
+#define RCC_APB1ENR_TIM5EN      REG_BIT(3)
+#define RCC_APB1ENR_SPI2EN      REG_BIT(14)
+#define RCC_APB1ENR_SPI3EN      REG_BIT(15)
+#define RCC_APB1ENR_USART2EN    REG_BIT(17)
+#define RCC_APB1ENR_USART3EN    REG_BIT(18)
+#define RCC_APB1ENR_UART4EN     REG_BIT(19)
+#define RCC_APB1ENR_UART5EN     REG_BIT(20)
+#define RCC_APB1ENR_I2C1EN      REG_BIT(21)
+#define RCC_APB1ENR_I2C2EN      REG_BIT(22)
+#define RCC_APB1ENR_I2C3EN      REG_BIT(23)
+#define RCC_APB1ENR_CAN1EN      REG_BIT(25)
+#define RCC_APB1ENR_CAN2EN      REG_BIT(26)
+#define RCC_APB1ENR_PWREN       REG_BIT(28)
+
+/* APB2ENR */
+#define RCC_APB2ENR_TIM1EN      REG_BIT(0)
+#define RCC_APB2ENR_TIM8EN      REG_BIT(1)
+#define RCC_APB2ENR_USART1EN    REG_BIT(4)
+#define RCC_APB2ENR_USART6EN    REG_BIT(5)
+#define RCC_APB2ENR_ADC1EN      REG_BIT(8)
+#define RCC_APB2ENR_ADC2EN      REG_BIT(9)
+#define RCC_APB2ENR_ADC3EN      REG_BIT(10)
+#define RCC_APB2ENR_SDIOEN      REG_BIT(11)
+#define RCC_APB2ENR_SPI1EN      REG_BIT(12)
+#define RCC_APB2ENR_SYSCFGEN    REG_BIT(14)
+
+#endif /* STM32_REGS_RCC_H */
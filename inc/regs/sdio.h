@@ -0,0 +1,109 @@
+/**
+ * @file    regs/sdio.h
+ * @brief   SD/SDIO/MMC host interface register layout (RM0090 section 31.9,
+ *          RM0385 section 35.8).
+ *
+ * The F7 SDMMC1 is the F4 SDIO at the same address with the same register
+ * map; it only drops the SDIO-card-specific bits this tree does not use
+ * (start bit errors, CE-ATA).  Both are called SDIO here.  SDIOCLK is the
+ * 48 MHz PLL48CK on either family.
+ */
+#ifndef STM32_REGS_SDIO_H
+#define STM32_REGS_SDIO_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t POWER;    /**< 0x00 Power control. */
+    volatile uint32_t CLKCR;    /**< 0x04 Clock control. */
+    volatile uint32_t ARG;      /**< 0x08 Command argument. */
+    volatile uint32_t CMD;      /**< 0x0C Command. */
+    volatile uint32_t RESPCMD;  /**< 0x10 Index of the last response. */
+    volatile uint32_t RESP[4];  /**< 0x14 Response; RESP[0] holds bits 127:96 of a long one. */
+    volatile uint32_t DTIMER;   /**< 0x24 Data timeout, in bus clock cycles. */
+    volatile uint32_t DLEN;     /**< 0x28 Data length, bytes. */
+    volatile uint32_t DCTRL;    /**< 0x2C Data control. */
+    volatile uint32_t DCOUNT;   /**< 0x30 Data bytes left. */
+    volatile uint32_t STA;      /**< 0x34 Status. */
+    volatile uint32_t ICR;      /**< 0x38 Interrupt clear. */
+    volatile uint32_t MASK;     /**< 0x3C Interrupt mask. */
+    uint32_t RESERVED0[2];
+    volatile uint32_t FIFOCNT;  /**< 0x48 Words left to move through the FIFO. */
+    uint32_t RESERVED1[13];
+    volatile uint32_t FIFO[32]; /**< 0x80 Data FIFO; any word of the window. */
+} sdio_regs_t;
+
+REG_LAYOUT_CHECK(sdio_regs_t, RESPCMD, 0x10);
+REG_LAYOUT_CHECK(sdio_regs_t, DTIMER, 0x24);
+REG_LAYOUT_CHECK(sdio_regs_t, MASK, 0x3C);
+REG_LAYOUT_CHECK(sdio_regs_t, FIFOCNT, 0x48);
+REG_LAYOUT_CHECK(sdio_regs_t, FIFO, 0x80);
+
+#define SDIO_BASE           (APB2PERIPH_BASE + 0x2C00u)
+#define SDIO                STM32_PERIPH(sdio_regs_t, SDIO)
+
+#define SDIO_FIFO_WORDS     32u
+
+/* POWER */
+#define SDIO_POWER_PWRCTRL  REG_FIELD(0u, 2u)
+#define SDIO_POWER_ON       3u
+
+/* CLKCR: bus clock SDIOCLK / (CLKDIV + 2), or SDIOCLK with BYPASS */
+#define SDIO_CLKCR_CLKDIV   REG_FIELD(0u, 8u)
+#define SDIO_CLKCR_CLKEN    REG_BIT(8)
+#define SDIO_CLKCR_PWRSAV   REG_BIT(9)
+#define SDIO_CLKCR_BYPASS   REG_BIT(10)
+#define SDIO_CLKCR_WIDBUS   REG_FIELD(11u, 2u)  /**< SDIO_WIDBUS_* */
+#define SDIO_CLKCR_NEGEDGE  REG_BIT(13)
+#define SDIO_CLKCR_HWFC_EN  REG_BIT(14)
+
+#define SDIO_WIDBUS_1       0u
+#define SDIO_WIDBUS_4       1u
+#define SDIO_WIDBUS_8       2u
+
+/* CMD */
+#define SDIO_CMD_CMDINDEX   REG_FIELD(0u, 6u)
+#define SDIO_CMD_WAITRESP   REG_FIELD(6u, 2u)   /**< SDIO_RESP_* */
+#define SDIO_CMD_WAITINT    REG_BIT(8)
+#define SDIO_CMD_WAITPEND   REG_BIT(9)
+#define SDIO_CMD_CPSMEN     REG_BIT(10)
+
+#define SDIO_RESP_NONE      0u
+#define SDIO_RESP_SHORT     1u
+#define SDIO_RESP_LONG      3u
+
+/* DCTRL */
+#define SDIO_DCTRL_DTEN     REG_BIT(0)
+#define SDIO_DCTRL_DTDIR    REG_BIT(1)          /**< Card to controller. */
+#define SDIO_DCTRL_DTMODE   REG_BIT(2)          /**< Stream instead of blocks. */
+#define SDIO_DCTRL_DMAEN    REG_BIT(3)
+#define SDIO_DCTRL_DBLOCKSIZE REG_FIELD(4u, 4u) /**< log2 of the block size. */
+
+/* STA, ICR (bits 0..10 are clearable) and MASK */
+#define SDIO_STA_CCRCFAIL   REG_BIT(0)
+#define SDIO_STA_DCRCFAIL   REG_BIT(1)
+#define SDIO_STA_CTIMEOUT   REG_BIT(2)
+#define SDIO_STA_DTIMEOUT   REG_BIT(3)
+#define SDIO_STA_TXUNDERR   REG_BIT(4)
+#define SDIO_STA_RXOVERR    REG_BIT(5)
+#define SDIO_STA_CMDREND    REG_BIT(6)
+#define SDIO_STA_CMDSENT    REG_BIT(7)
+#define SDIO_STA_DATAEND    REG_BIT(8)
+#define SDIO_STA_STBITERR   REG_BIT(9)          /**< F4 only. */
+#define SDIO_STA_DBCKEND    REG_BIT(10)
+#define SDIO_STA_CMDACT     REG_BIT(11)
+#define SDIO_STA_TXACT      REG_BIT(12)
+#define SDIO_STA_RXACT      REG_BIT(13)
+#define SDIO_STA_TXFIFOHE   REG_BIT(14)
+#define SDIO_STA_RXFIFOHF   REG_BIT(15)
+#define SDIO_STA_TXFIFOF    REG_BIT(16)
+#define SDIO_STA_RXFIFOF    REG_BIT(17)
+#define SDIO_STA_TXFIFOE    REG_BIT(18)
+#define SDIO_STA_RXFIFOE    REG_BIT(19)
+#define SDIO_STA_TXDAVL     REG_BIT(20)
+#define SDIO_STA_RXDAVL     REG_BIT(21)
+#define SDIO_STA_SDIOIT     REG_BIT(22)
+
+#define SDIO_ICR_STATIC     (REG_MASK(0u, 11u) | SDIO_STA_SDIOIT)
+
+#endif /* STM32_REGS_SDIO_H */
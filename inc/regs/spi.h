@@ -0,0 +1,69 @@
+/**
+ * @file    regs/spi.h
+ * @brief   SPI register layout (RM0090 section 28.5).
+ */
+#ifndef STM32_REGS_SPI_H
+#define STM32_REGS_SPI_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t CR1;      /**< 0x00 Control 1. */
+    volatile uint32_t CR2;      /**< 0x04 Control 2. */
+    volatile uint32_t SR;       /**< 0x08 Status. */
+    volatile uint32_t DR;       /**< 0x0C Data. */
+    volatile uint32_t CRCPR;    /**< 0x10 CRC polynomial. */
+    volatile uint32_t RXCRCR;   /**< 0x14 RX CRC. */
+    volatile uint32_t TXCRCR;   /**< 0x18 TX CRC. */
+    volatile uint32_t I2SCFGR;  /**< 0x1C I2S configuration. */
+    volatile uint32_t I2SPR;    /**< 0x20 I2S prescaler. */
+} spi_regs_t;
+
+REG_LAYOUT_CHECK(spi_regs_t, DR, 0x0C);
+REG_LAYOUT_CHECK(spi_regs_t, I2SPR, 0x20);
+
+#define SPI1_BASE   (APB2PERIPH_BASE + 0x3000u)
+#define SPI2_BASE   (APB1PERIPH_BASE + 0x3800u)
+#define SPI3_BASE   (APB1PERIPH_BASE + 0x3C00u)
+
+#define SPI1        STM32_PERIPH(spi_regs_t, SPI1)
+#define SPI2        STM32_PERIPH(spi_regs_t, SPI2)
+#define SPI3        STM32_PERIPH(spi_regs_t, SPI3)
+
+/* CR1 */
+#define SPI_CR1_CPHA        REG_BIT(0)
+#define SPI_CR1_CPOL        REG_BIT(1)
+#define SPI_CR1_MSTR        REG_BIT(2)
+#define SPI_CR1_BR          REG_FIELD(3u, 3u)   /**< f_pclk / 2^(BR+1) */
+#define SPI_CR1_SPE         REG_BIT(6)
+#define SPI_CR1_LSBFIRST    REG_BIT(7)
+#define SPI_CR1_SSI         REG_BIT(8)
+#define SPI_CR1_SSM         REG_BIT(9)
+#define SPI_CR1_RXONLY      REG_BIT(10)
+#define SPI_CR1_DFF         REG_BIT(11)
+#define SPI_CR1_CRCNEXT     REG_BIT(12)
+#define SPI_CR1_CRCEN       REG_BIT(13)
+#define SPI_CR1_BIDIOE      REG_BIT(14)
+#define SPI_CR1_BIDIMODE    REG_BIT(15)
+
+/* CR2 */
+#define SPI_CR2_RXDMAEN     REG_BIT(0)
+#define SPI_CR2_TXDMAEN     REG_BIT(1)
+#define SPI_CR2_SSOE        REG_BIT(2)
+#define SPI_CR2_FRF         REG_BIT(4)
+#define SPI_CR2_ERRIE       REG_BIT(5)
+#define SPI_CR2_RXNEIE      REG_BIT(6)
+#define SPI_CR2_TXEIE       REG_BIT(7)
+
+/* SR */
+#define SPI_SR_RXNE         REG_BIT(0)
+#define SPI_SR_TXE          REG_BIT(1)
+#define SPI_SR_CHSIDE       REG_BIT(2)
+#define SPI_SR_UDR          REG_BIT(3)
+#define SPI_SR_CRCERR       REG_BIT(4)
+#define SPI_SR_MODF         REG_BIT(5)
+#define SPI_SR_OVR          REG_BIT(6)
+#define SPI_SR_BSY          REG_BIT(7)
+#define SPI_SR_FRE          REG_BIT(8)
+
+#endif /* STM32_REGS_SPI_H */
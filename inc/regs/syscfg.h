@@ -0,0 +1,32 @@
+/**
+ * @file    regs/syscfg.h
+ * @brief   System configuration controller register layout (RM0090
+ *          section 9.2, RM0385 section 7.2).
+ */
+#ifndef STM32_REGS_SYSCFG_H
+#define STM32_REGS_SYSCFG_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t MEMRMP;   /**< 0x00 Memory remap. */
+    volatile uint32_t PMC;      /**< 0x04 Peripheral mode configuration. */
+    volatile uint32_t EXTICR[4]; /**< 0x08 External interrupt sources. */
+    uint32_t RESERVED0[2];
+    volatile uint32_t CMPCR;    /**< 0x20 Compensation cell control. */
+} syscfg_regs_t;
+
+REG_LAYOUT_CHECK(syscfg_regs_t, PMC, 0x04);
+REG_LAYOUT_CHECK(syscfg_regs_t, CMPCR, 0x20);
+
+#define SYSCFG_BASE         (APB2PERIPH_BASE + 0x3800u)
+#define SYSCFG              STM32_PERIPH(syscfg_regs_t, SYSCFG)
+
+/* PMC */
+#define SYSCFG_PMC_MII_RMII_SEL REG_BIT(23)     /**< Ethernet RMII; set with the MAC in reset. */
+
+/* CMPCR */
+#define SYSCFG_CMPCR_CMP_PD     REG_BIT(0)
+#define SYSCFG_CMPCR_READY      REG_BIT(8)
+
+#endif /* STM32_REGS_SYSCFG_H */
@@ -0,0 +1,111 @@
+/**
+ * @file    regs/tim.h
+ * @brief   Advanced and general-purpose timer register layout
+ *          (RM0090 sections 17.4 and 18.4).
+ */
+#ifndef STM32_REGS_TIM_H
+#define STM32_REGS_TIM_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t CR1;      /**< 0x00 Control 1. */
+    volatile uint32_t CR2;      /**< 0x04 Control 2. */
+    volatile uint32_t SMCR;     /**< 0x08 Slave mode control. */
+    volatile uint32_t DIER;     /**< 0x0C DMA/interrupt enable. */
+    volatile uint32_t SR;       /**< 0x10 Status. */
+    volatile uint32_t EGR;      /**< 0x14 Event generation. */
+    volatile uint32_t CCMR1;    /**< 0x18 Capture/compare mode 1. */
+    volatile uint32_t CCMR2;    /**< 0x1C Capture/compare mode 2. */
+    volatile uint32_t CCER;     /**< 0x20 Capture/compare enable. */
+    volatile uint32_t CNT;      /**< 0x24 Counter. */
+    volatile uint32_t PSC;      /**< 0x28 Prescaler. */
+    volatile uint32_t ARR;      /**< 0x2C Auto-reload. */
+    volatile uint32_t RCR;      /**< 0x30 Repetition counter (TIM1/TIM8). */
+    volatile uint32_t CCR[4];   /**< 0x34 Capture/compare 1..4. */
+    volatile uint32_t BDTR;     /**< 0x44 Break and dead-time (TIM1/TIM8). */
+    volatile uint32_t DCR;      /**< 0x48 DMA control. */
+    volatile uint32_t DMAR;     /**< 0x4C DMA address for burst. */
+    volatile uint32_t OR;       /**< 0x50 Option (TIM2/TIM5). */
+} tim_regs_t;
+
+REG_LAYOUT_CHECK(tim_regs_t, CNT, 0x24);
+REG_LAYOUT_CHECK(tim_regs_t, CCR[0], 0x34);
+REG_LAYOUT_CHECK(tim_regs_t, DMAR, 0x4C);
+
+#define TIM2_BASE       (APB1PERIPH_BASE + 0x0000u)
+#define TIM3_BASE       (APB1PERIPH_BASE + 0x0400u)
+#define TIM4_BASE       (APB1PERIPH_BASE + 0x0800u)
+#define TIM5_BASE       (APB1PERIPH_BASE + 0x0C00u)
+#define TIM1_BASE       (APB2PERIPH_BASE + 0x0000u)
+#define TIM8_BASE       (APB2PERIPH_BASE + 0x0400u)
+
+#define TIM1            STM32_PERIPH(tim_regs_t, TIM1)
+#define TIM2            STM32_PERIPH(tim_regs_t, TIM2)
+#define TIM3            STM32_PERIPH(tim_regs_t, TIM3)
+#define TIM4            STM32_PERIPH(tim_regs_t, TIM4)
+#define TIM5            STM32_PERIPH(tim_regs_t, TIM5)
+#define TIM8            STM32_PERIPH(tim_regs_t, TIM8)
+
+/* CR1 */
+#define TIM_CR1_CEN         REG_BIT(0)
+#define TIM_CR1_UDIS        REG_BIT(1)
+#define TIM_CR1_URS         REG_BIT(2)
+#define TIM_CR1_OPM         REG_BIT(3)
+#define TIM_CR1_DIR         REG_BIT(4)
+#define TIM_CR1_CMS         REG_FIELD(5u, 2u)
+#define TIM_CR1_ARPE        REG_BIT(7)
+#define TIM_CR1_CKD         REG_FIELD(8u, 2u)
+
+/* CR2 */
+#define TIM_CR2_MMS         REG_FIELD(4u, 3u)
+
+#define TIM_MMS_RESET       0u
+#define TIM_MMS_ENABLE      1u
+#define TIM_MMS_UPDATE      2u
+
+/* DIER */
+#define TIM_DIER_UIE        REG_BIT(0)
+#define TIM_DIER_CCIE(n)    REG_BIT(n)          /**< n = 1..4 */
+#define TIM_DIER_UDE        REG_BIT(8)
+#define TIM_DIER_CCDE(n)    REG_BIT(8u + (n))   /**< n = 1..4 */
+
+/* SR */
+#define TIM_SR_UIF          REG_BIT(0)
+#define TIM_SR_CCIF(n)      REG_BIT(n)          /**< n = 1..4 */
+
+/* EGR */
+#define TIM_EGR_UG          REG_BIT(0)
+
+/* CCMR1/CCMR2, output compare: channel n (1..4) lives in CCMR((n - 1) / 2) */
+#define TIM_CCMR_CCS(n)     REG_FIELD(8u * (((n) - 1u) & 1u), 2u)
+#define TIM_CCMR_OCFE(n)    REG_BIT(8u * (((n) - 1u) & 1u) + 2u)
+#define TIM_CCMR_OCPE(n)    REG_BIT(8u * (((n) - 1u) & 1u) + 3u)
+#define TIM_CCMR_OCM(n)     REG_FIELD(8u * (((n) - 1u) & 1u) + 4u, 3u)
+
+#define TIM_OCM_FROZEN      0u
+#define TIM_OCM_FORCE_LOW   4u
+#define TIM_OCM_FORCE_HIGH  5u
+#define TIM_OCM_PWM1        6u      /**< Active while CNT < CCR. */
+#define TIM_OCM_PWM2        7u
+
+/* CCER */
+#define TIM_CCER_CCE(n)     REG_BIT(4u * ((n) - 1u))        /**< n = 1..4 */
+#define TIM_CCER_CCP(n)     REG_BIT(4u * ((n) - 1u) + 1u)
+#define TIM_CCER_CCNE(n)    REG_BIT(4u * ((n) - 1u) + 2u)   /**< n = 1..3, TIM1/TIM8 */
+
+/* BDTR (TIM1/TIM8) */
+#define TIM_BDTR_DTG        REG_FIELD(0u, 8u)
+#define TIM_BDTR_OSSI       REG_BIT(10)
+#define TIM_BDTR_OSSR       REG_BIT(11)
+#define TIM_BDTR_AOE        REG_BIT(14)
+#define TIM_BDTR_MOE        REG_BIT(15)
+
+/* DCR: burst of DBL + 1 transfers through DMAR, starting at register DBA */
+#define TIM_DCR_DBA         REG_FIELD(0u, 5u)   /**< Register offset / 4. */
+#define TIM_DCR_DBL         REG_FIELD(8u, 5u)   /**< Transfers - 1. */
+
+/** DCR.DBA of a register, e.g. TIM_DBA(CCR[0]). */
+#define TIM_DBA(reg)        ((uint32_t)__builtin_offsetof(tim_regs_t, reg) / 4u)
+
+#endif /* STM32_REGS_TIM_H */
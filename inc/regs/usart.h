@@ -0,0 +1,78 @@
+/**
+ * @file    regs/usart.h
+ * @brief   USART register layout (RM0090 section 30.6).
+ */
+#ifndef STM32_REGS_USART_H
+#define STM32_REGS_USART_H
+
+#include "reg.h"
+
+typedef struct {
+    volatile uint32_t SR;       /**< 0x00 Status. */
+    volatile uint32_t DR;       /**< 0x04 Data. */
+    volatile uint32_t BRR;      /**< 0x08 Baud rate. */
+    volatile uint32_t CR1;      /**< 0x0C Control 1. */
+    volatile uint32_t CR2;      /**< 0x10 Control 2. */
+    volatile uint32_t CR3;      /**< 0x14 Control 3. */
+    volatile uint32_t GTPR;     /**< 0x18 Guard time and prescaler. */
+} usart_regs_t;
+
+REG_LAYOUT_CHECK(usart_regs_t, CR1, 0x0C);
+REG_LAYOUT_CHECK(usart_regs_t, GTPR, 0x18);
+
+#define USART1_BASE (APB2PERIPH_BASE + 0x1000u)
+#define USART6_BASE (APB2PERIPH_BASE + 0x1400u)
+#define USART2_BASE (APB1PERIPH_BASE + 0x4400u)
+#define USART3_BASE (APB1PERIPH_BASE + 0x4800u)
+#define UART4_BASE  (APB1PERIPH_BASE + 0x4C00u)
+#define UART5_BASE  (APB1PERIPH_BASE + 0x5000u)
+
+#define USART1      STM32_PERIPH(usart_regs_t, USART1)
+#define USART2      STM32_PERIPH(usart_regs_t, USART2)
+#define USART3      STM32_PERIPH(usart_regs_t, USART3)
+#define UART4       STM32_PERIPH(usart_regs_t, UART4)
+#define UART5       STM32_PERIPH(usart_regs_t, UART5)
+#define USART6      STM32_PERIPH(usart_regs_t, USART6)
+
+/* SR */
+#define USART_SR_PE         REG_BIT(0)
+#define USART_SR_FE         REG_BIT(1)
+#define USART_SR_NF         REG_BIT(2)
+#define USART_SR_ORE        REG_BIT(3)
+#define USART_SR_IDLE       REG_BIT(4)
+#define USART_SR_RXNE       REG_BIT(5)
+#define USART_SR_TC         REG_BIT(6)
+#define USART_SR_TXE        REG_BIT(7)
+#define USART_SR_LBD        REG_BIT(8)
+#define USART_SR_CTS        REG_BIT(9)
+
+/* BRR */
+#define USART_BRR_FRACTION  REG_FIELD(0u, 4u)
+#define USART_BRR_MANTISSA  REG_FIELD(4u, 12u)
+
+/* CR1 */
+#define USART_CR1_SBK       REG_BIT(0)
+#define USART_CR1_RWU       REG_BIT(1)
+#define USART_CR1_RE        REG_BIT(2)
+#define USART_CR1_TE        REG_BIT(3)
+#define USART_CR1_IDLEIE    REG_BIT(4)
+#define USART_CR1_RXNEIE    REG_BIT(5)
+#define USART_CR1_TCIE      REG_BIT(6)
+#define USART_CR1_TXEIE     REG_BIT(7)
+#define USART_CR1_PEIE      REG_BIT(8)
+#define USART_CR1_PS        REG_BIT(9)
+#define USART_CR1_PCE       REG_BIT(10)
+#define USART_CR1_M         REG_BIT(12)
+#define USART_CR1_UE        REG_BIT(13)
+#define USART_CR1_OVER8     REG_BIT(15)
+
+/* CR2 */
+#define USART_CR2_STOP      REG_FIELD(12u, 2u)
+
+/* CR3 */
+#define USART_CR3_EIE       REG_BIT(0)
+#define USART_CR3_DMAR      REG_BIT(6)
+#define USART_CR3_DMAT      REG_BIT(7)
+#define USART_CR3_ONEBIT    REG_BIT(11)
+
+#endif /* STM32_REGS_USART_H */
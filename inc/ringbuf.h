@@ -0,0 +1,130 @@
+/**
+ * @file    ringbuf.h
+ * @brief   Lock-free single-producer/single-consumer byte ring buffer.
+ *
+ * One context produces (e.g. an ISR), one consumes (e.g. the main loop).
+ * The producer owns `head`, the consumer owns `tail`; both are free-running
+ * 32-bit counters masked on access, so full and empty need no spare slot.
+ * Each index is published with a single aligned store after a barrier and
+ * read with a single aligned load followed by a barrier; interrupts are never
+ * masked.  Capacity must be a power of two.
+ *
+ * The span API gives direct access to the largest contiguous readable or
+ * writable region, so DMA and FIFO copies can target the storage without an
+ * intermediate buffer:
+ *
+ *     uint8_t *dst;
+ *     uint32_t n = ringbuf_write_span(&rb, &dst);
+ *     n = fill(dst, n);
+ *     ringbuf_write_commit(&rb, n);
+ */
+#ifndef STM32_RINGBUF_H
+#define STM32_RINGBUF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "status.h"
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t mask;              /**< Capacity - 1. */
+    volatile uint32_t head;     /**< Written by the producer only. */
+    volatile uint32_t tail;     /**< Written by the consumer only. */
+} ringbuf_t;
+
+/** Statically allocate storage and a ring buffer named @p name. */
+#define RINGBUF_DEFINE(name, size)                                          \
+    STM32_STATIC_ASSERT(((size) & ((size) - 1u)) == 0u && (size) != 0u,     \
+                        "ring buffer size must be a power of two");         \
+    static uint8_t name##_storage[size];                                    \
+    static ringbuf_t name = { name##_storage, (size) - 1u, 0u, 0u }
+
+/** Initialise @p rb over @p storage; @p size must be a power of two. */
+drv_status_t ringbuf_init(ringbuf_t *rb, uint8_t *storage, uint32_t size);
+
+/** Copy in up to @p len bytes (producer); returns the number written. */
+uint32_t ringbuf_write(ringbuf_t *rb, const void *data, uint32_t len);
+
+/** Copy out up to @p len bytes (consumer); returns the number read. */
+uint32_t ringbuf_read(ringbuf_t *rb, void *data, uint32_t len);
+
+STM32_INLINE uint32_t ringbuf_capacity(const ringbuf_t *rb)
+{
+    return rb->mask + 1u;
+}
+
+/** Bytes readable; exact for the consumer, a lower bound for the producer. */
+STM32_INLINE uint32_t ringbuf_count(const ringbuf_t *rb)
+{
+    return stm32_load_acquire(&rb->head) - stm32_load_acquire(&rb->tail);
+}
+
+/** Bytes writable; exact for the producer, a lower bound for the consumer. */
+STM32_INLINE uint32_t ringbuf_free(const ringbuf_t *rb)
+{
+    return ringbuf_capacity(rb) - ringbuf_count(rb);
+}
+
+STM32_INLINE bool ringbuf_push(ringbuf_t *rb, uint8_t byte)
+{
+    uint32_t head = rb->head;
+
+    if (head - stm32_load_acquire(&rb->tail) > rb->mask) {
+        return false;
+    }
+    rb->buf[head & rb->mask] = byte;
+    stm32_store_release(&rb->head, head + 1u);
+    return true;
+}
+
+STM32_INLINE bool ringbuf_pop(ringbuf_t *rb, uint8_t *byte)
+{
+    uint32_t tail = rb->tail;
+
+    if (stm32_load_acquire(&rb->head) == tail) {
+        return false;
+    }
+    *byte = rb->buf[tail & rb->mask];
+    stm32_store_release(&rb->tail, tail + 1u);
+    return true;
+}
+
+/** Largest contiguous writable region (producer); returns its length. */
+STM32_INLINE uint32_t ringbuf_write_span(ringbuf_t *rb, uint8_t **ptr)
+{
+    uint32_t head = rb->head;
+    uint32_t idx = head & rb->mask;
+    uint32_t free = ringbuf_capacity(rb) - (head - stm32_load_acquire(&rb->tail));
+    uint32_t contig = ringbuf_capacity(rb) - idx;
+
+    *ptr = &rb->buf[idx];
+    return (free < contig) ? free : contig;
+}
+
+/** Publish @p len bytes written through ringbuf_write_span(). */
+STM32_INLINE void ringbuf_write_commit(ringbuf_t *rb, uint32_t len)
+{
+    stm32_store_release(&rb->head, rb->head + len);
+}
+
+/** Largest contiguous readable region (consumer); returns its length. */
+STM32_INLINE uint32_t ringbuf_read_span(ringbuf_t *rb, const uint8_t **ptr)
+{
+    uint32_t tail = rb->tail;
+    uint32_t idx = tail & rb->mask;
+    uint32_t used = stm32_load_acquire(&rb->head) - tail;
+    uint32_t contig = ringbuf_capacity(rb) - idx;
+
+    *ptr = &rb->buf[idx];
+    return (used < contig) ? used : contig;
+}
+
+/** Release @p len bytes consumed through ringbuf_read_span(). */
+STM32_INLINE void ringbuf_read_commit(ringbuf_t *rb, uint32_t len)
+{
+    stm32_store_release(&rb->tail, rb->tail + len);
+}
+
+#endif /* STM32_RINGBUF_H */
@@ -0,0 +1,121 @@
+/**
+ * @file    sdio.h
+ * @brief   SD memory card driver on the SDIO/SDMMC host: 4-bit bus,
+ *          high-speed mode and multi-block DMA transfers.
+ *
+ * sdio_init() identifies the card (SD 1.x standard capacity or SD 2.0
+ * SDHC/SDXC), selects it, widens the bus to four data lines and, when the
+ * card supports it, switches it to high-speed mode (CMD6) and the bus
+ * clock from 24 MHz to the full 48 MHz SDIOCLK.  The card is then a
+ * plain array of 512-byte blocks: sdio_read() and sdio_write() move any
+ * run of them with one CMD18/CMD25 per SDIO_MULTI_MAX blocks (CMD17/CMD24
+ * for a single block), so the card's own per-command overhead is paid
+ * once per run rather than once per block.
+ *
+ * Data go through DMA2 stream 3 or 6 with the SDIO as flow controller:
+ * the SDIO counts the bytes (DLEN) and tells the stream when the transfer
+ * is over, so a stopped transfer never leaves the stream mid-count.
+ * Word-sized four-beat bursts keep the FIFO from overrunning at 48 MHz.
+ * Buffers that are not SDIO_DMA_ALIGN aligned go block by block through
+ * a bounce buffer in the handle, so any buffer works and aligned ones are
+ * never copied.
+ *
+ * Transfers block the caller.  Completion is signalled by the SDIO and DMA
+ * interrupts (SDIO_IRQHandler is provided here) and also polled, so the
+ * driver works with both interrupt lines left disabled in the NVIC.
+ * After a write the card keeps programming in the background; the next
+ * command, or sdio_sync(), waits for it by polling the card status.
+ *
+ * sdio_blockdev() exposes the card as a blockdev_t for a file system.
+ * Pins (CK, CMD, D0..D3, pulled up except CK) are the application's to
+ * set to SDIO_GPIO_AF; the driver needs the 48 MHz PLL48CK running
+ * (rcc_request_t.need_48mhz).
+ */
+#ifndef STM32_SDIO_H
+#define STM32_SDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "blockdev.h"
+#include "cache.h"
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+#define SDIO_GPIO_AF        12u
+
+#define SDIO_BLOCK_SIZE     512u
+#define SDIO_MULTI_MAX      256u        /**< Blocks per multi-block command. */
+#define SDIO_DMA_ALIGN      STM32_CACHE_LINE
+
+#define SDIO_INIT_HZ        400000u     /**< Identification clock limit. */
+#define SDIO_DS_HZ          25000000u   /**< Default speed limit. */
+#define SDIO_HS_HZ          50000000u   /**< High speed limit. */
+
+typedef struct {
+    uint8_t bus_width;          /**< 1 or 4 data lines; 0: 4. */
+    bool default_speed;         /**< Do not switch the card to high speed. */
+    uint8_t dma_priority;       /**< 0 (low) .. 3 (very high). */
+} sdio_config_t;
+
+typedef struct {
+    sdio_regs_t *sdio;
+    dma_stream_t *dma;
+    dma_xfer_t xfer;
+    uint8_t dma_priority;
+    /* Card, from sdio_init(). */
+    uint32_t cid[4];
+    uint32_t rca;               /**< Relative card address, in bits 31:16. */
+    uint32_t blocks;            /**< Capacity in SDIO_BLOCK_SIZE blocks. */
+    bool sdhc;                  /**< Block (not byte) addressing. */
+    bool wide;                  /**< 4-bit bus. */
+    bool high_speed;
+    uint32_t bus_hz;
+    uint32_t dtimer;            /**< Data timeout in bus clock cycles. */
+    bool programming;           /**< A write may still be in progress on the card. */
+    /* Transfer in flight; data_* from the SDIO interrupt, dma_* from the stream's. */
+    volatile bool data_busy;
+    volatile uint32_t data_errors;  /**< SDIO_STA_* error flags. */
+    volatile bool dma_busy;
+    volatile bool dma_error;
+    /* Counters since sdio_init(). */
+    uint32_t irqs;
+    uint32_t commands;          /**< Data transfer commands issued. */
+    uint32_t crc_errors;
+    uint32_t timeouts;
+    uint8_t bounce[SDIO_BLOCK_SIZE] CACHE_ALIGNED;
+} sdio_t;
+
+/**
+ * Power the interface, identify and select the card and bring it to the
+ * configured bus width and speed.  DRV_ERR_PARAM for a bad configuration
+ * or no 48 MHz clock; DRV_ERR_NORES if no DMA stream is free;
+ * DRV_ERR_TIMEOUT if no card answers; DRV_ERR_HW for a card that is not
+ * a usable SD memory card.
+ */
+drv_status_t sdio_init(sdio_t *h, const sdio_config_t *cfg);
+
+/** Deselect the card, stop the bus clock and free the DMA stream. */
+void sdio_deinit(sdio_t *h);
+
+/**
+ * Read @p count blocks from @p block on into @p buf.  DRV_ERR_PARAM for a
+ * range outside the card; DRV_ERR_HW for a CRC error or an error reported
+ * by the card; DRV_ERR_TIMEOUT if the card stops answering.
+ */
+drv_status_t sdio_read(sdio_t *h, uint32_t block, void *buf, uint32_t count);
+
+/** Write @p count blocks from @p buf to @p block on; errors as sdio_read(). */
+drv_status_t sdio_write(sdio_t *h, uint32_t block, const void *buf, uint32_t count);
+
+/** Wait until the card has finished programming written blocks. */
+drv_status_t sdio_sync(sdio_t *h);
+
+/** Describe the card behind @p h as block device @p bd. */
+void sdio_blockdev(sdio_t *h, blockdev_t *bd);
+
+/** Interrupt service; SDIO_IRQHandler calls it for the initialised instance. */
+void sdio_irq(sdio_t *h);
+
+#endif /* STM32_SDIO_H */
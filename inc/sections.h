@@ -0,0 +1,72 @@
+/**
+ * @file    sections.h
+ * @brief   Startup initialisation of RAM sections from the linker tables.
+ *
+ * The linker scripts in ld/ emit a copy table ({ load, start, end } for
+ * .ramfunc, .fastdata and .data) and a zero table ({ start, end } for
+ * .fastbss and .bss).  sections_init() walks both; it must run before any
+ * code that reads initialised data or calls an STM32_RAMFUNC, and must not
+ * use either itself.  Section bounds are word aligned by the scripts.
+ *
+ * Copies and clears move four words per LDM/STM pair on target.  The
+ * largest DMA-reachable zero entry of at least SECTIONS_DMA_MIN_BYTES is
+ * cleared by a DMA2 memory-to-memory stream instead, in parallel with the
+ * CPU work on the other entries; DMA2 is back in its reset state when
+ * sections_run() returns.  The F4 CCM (.fastbss there) is not reachable by
+ * DMA and is always cleared by the CPU.
+ */
+#ifndef STM32_SECTIONS_H
+#define STM32_SECTIONS_H
+
+#include <stdint.h>
+
+#include "stm32.h"
+
+/*
+ * Smallest zero entry handed to DMA; 0 disables the DMA clear.  Below a few
+ * KiB the stream setup and the wait cost more than the overlap saves.  The
+ * plain host build has no DMA model, so the CPU does everything there.
+ */
+#ifndef SECTIONS_DMA_MIN_BYTES
+#if defined(STM32_HOST) && !defined(STM32_SIM)
+#define SECTIONS_DMA_MIN_BYTES  0u
+#else
+#define SECTIONS_DMA_MIN_BYTES  4096u
+#endif
+#endif
+
+/** DMA2 stream used for the clear; free again once sections_run() returns. */
+#ifndef SECTIONS_DMA_STREAM
+#define SECTIONS_DMA_STREAM     7u
+#endif
+
+typedef struct {
+    const uint32_t *load;   /**< Image in flash. */
+    uint32_t *start;        /**< Run address. */
+    uint32_t *end;
+} sections_copy_t;
+
+typedef struct {
+    uint32_t *start;
+    uint32_t *end;
+} sections_zero_t;
+
+/** Copy every entry of [@p first, @p last) to its run address. */
+void sections_copy(const sections_copy_t *first, const sections_copy_t *last);
+
+/** Clear every entry of [@p first, @p last). */
+void sections_zero(const sections_zero_t *first, const sections_zero_t *last);
+
+/**
+ * Copy [@p copy, @p copy_end) and clear [@p zero, @p zero_end), handing the
+ * largest clear to DMA when SECTIONS_DMA_MIN_BYTES allows.
+ */
+void sections_run(const sections_copy_t *copy, const sections_copy_t *copy_end,
+                  const sections_zero_t *zero, const sections_zero_t *zero_end);
+
+#if !defined(STM32_HOST)
+/** Walk the linker's copy and zero tables with sections_run(). */
+void sections_init(void);
+#endif
+
+#endif /* STM32_SECTIONS_H */
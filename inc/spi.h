@@ -0,0 +1,113 @@
+/**
+ * @file    spi.h
+ * @brief   SPI master driver: queued full-duplex DMA transactions.
+ *
+ * A bus owns one SPI instance and an RX/TX stream pair from the DMA
+ * allocator.  Devices on the bus differ in chip select pin, clock and frame
+ * format.  A transaction is CS assert, one or more segments (e.g. command
+ * then payload), CS release.  Transactions are queued with spi_submit() and
+ * run back-to-back from the RX DMA complete interrupt: the CPU touches the
+ * bus once per segment, never per frame.
+ *
+ * Segments always run full duplex.  A NULL tx buffer clocks out the fill
+ * frame, a NULL rx buffer discards what comes in.  With 16-bit frames and
+ * word-aligned buffers the memory side of the DMA moves 32-bit words (two
+ * frames per bus access) through the stream FIFO.
+ */
+#ifndef STM32_SPI_H
+#define STM32_SPI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "status.h"
+#include "stm32.h"
+
+typedef struct spi_bus spi_bus_t;
+
+typedef struct {
+    spi_bus_t *bus;
+    gpio_regs_t *cs_port;   /**< NULL: no chip select managed by the driver. */
+    uint8_t cs_pin;
+    uint8_t mode;           /**< SPI mode 0..3 (CPOL << 1 | CPHA). */
+    bool frame16;           /**< 16-bit frames instead of 8-bit. */
+    bool lsb_first;
+    uint32_t max_hz;        /**< Highest SCK the device accepts. */
+    uint32_t cr1;           /**< Driver private: derived CR1. */
+} spi_dev_t;
+
+/** One full-duplex run; @p len counts frames (bytes or half-words). */
+typedef struct {
+    const void *tx;         /**< NULL: send the fill frame. */
+    void *rx;               /**< NULL: discard received frames. */
+    uint16_t len;
+} spi_seg_t;
+
+typedef struct spi_xfer spi_xfer_t;
+
+/** Transaction done (called from the DMA interrupt). */
+typedef void (*spi_done_cb_t)(void *ctx, spi_xfer_t *x, drv_status_t status);
+
+#define SPI_XFER_KEEP_CS    0x01u   /**< Leave CS asserted for the next transaction. */
+
+struct spi_xfer {
+    spi_dev_t *dev;
+    const spi_seg_t *segs;
+    uint8_t nsegs;
+    uint8_t flags;          /**< SPI_XFER_* */
+    spi_done_cb_t cb;
+    void *ctx;
+    spi_xfer_t *next;       /**< Driver private: queue link. */
+};
+
+struct spi_bus {
+    spi_regs_t *spi;
+    uint32_t pclk_hz;
+    dma_stream_t *rx;
+    dma_stream_t *tx;
+    dma_xfer_t rxd;
+    dma_xfer_t txd;
+    spi_xfer_t *head;       /**< Running transaction; NULL when idle. */
+    spi_xfer_t *tail;
+    uint8_t seg;            /**< Segment of head in flight. */
+    const spi_dev_t *cur;   /**< Device CR1 is programmed for. */
+    const spi_dev_t *cs;    /**< Device whose CS is held asserted. */
+    uint16_t fill;          /**< Frame sent for segments without tx data. */
+    uint16_t sink;          /**< Landing spot for discarded frames. */
+};
+
+typedef struct {
+    uint32_t pclk_hz;       /**< Clock of the APB bus the SPI sits on. */
+    uint16_t fill;          /**< Fill frame (typically 0xFF or 0xFFFF). */
+} spi_config_t;
+
+/**
+ * Enable the SPI clock, allocate the DMA streams and configure the instance
+ * as master with software slave management.
+ */
+drv_status_t spi_init(spi_bus_t *bus, spi_regs_t *spi, const spi_config_t *cfg);
+
+/** Release the DMA streams and disable the instance. */
+void spi_deinit(spi_bus_t *bus);
+
+/**
+ * Bind @p dev to @p bus: pick the fastest prescaler not above max_hz and
+ * drive the CS pin high as an output.
+ */
+drv_status_t spi_dev_init(spi_dev_t *dev, spi_bus_t *bus);
+
+/** Queue a transaction; it starts immediately if the bus is idle. */
+drv_status_t spi_submit(spi_xfer_t *x);
+
+/** True while transactions are queued or running. */
+bool spi_busy(const spi_bus_t *bus);
+
+/**
+ * Polled single-frame exchange for short register accesses outside the
+ * queue; the bus must be idle and CS is the caller's business.
+ */
+uint16_t spi_exchange(spi_bus_t *bus, const spi_dev_t *dev, uint16_t frame);
+
+#endif /* STM32_SPI_H */
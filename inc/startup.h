@@ -0,0 +1,58 @@
+/**
+ * @file    startup.h
+ * @brief   Reset handler, boot vector table and boot timing.
+ *
+ * src/startup.c is linked into firmware images only (stm32_add_firmware()
+ * in CMakeLists.txt).  Reset_Handler, in order:
+ *
+ *  1. enables the FPU and starts the DWT cycle counter;
+ *  2. calls startup_clock_init(), so that everything after it runs at the
+ *     final clock instead of the 16 MHz HSI;
+ *  3. runs sections_init(): four-word LDM/STM copies and clears, with the
+ *     largest clear done by DMA alongside (sections.h);
+ *  4. runs the static constructors, then main().
+ *
+ * The cycles spent in each step are kept for startup_timing().  Counts are
+ * core clock cycles, so the part before the clock switch counts HSI cycles.
+ *
+ * The boot vector table (.isr_vector) names every handler weakly after
+ * CMSIS (WWDG_IRQHandler, ...), all defaulting to Default_Handler, which
+ * calls irq_unhandled().  irq_init() copies it to RAM.
+ */
+#ifndef STM32_STARTUP_H
+#define STM32_STARTUP_H
+
+#include <stdint.h>
+
+#include "irq.h"
+#include "rcc.h"
+
+typedef struct {
+    uint32_t clock;         /**< startup_clock_init(). */
+    uint32_t sections;      /**< Section copy and clear. */
+    uint32_t ctors;         /**< Static constructors. */
+    uint32_t total;         /**< Reset_Handler entry to main(). */
+} startup_timing_t;
+
+/**
+ * Clock setup hook, weak; the default returns NULL and leaves the reset
+ * clock.  It runs before .data and .bss are initialised: it may use its
+ * stack, registers and const data only, and anything it stores in static
+ * storage (including what rcc_apply() records) is overwritten afterwards.
+ * Return the plan it applied, which must be const, or NULL; Reset_Handler
+ * hands it to rcc_set_current() once RAM is set up.
+ */
+const rcc_plan_t *startup_clock_init(void);
+
+/** Boot vector table in flash (.isr_vector), where VTOR points at reset. */
+extern const irq_handler_t startup_vectors[IRQ_VECTORS];
+
+/** Cycle counts of the last boot. */
+const startup_timing_t *startup_timing(void);
+
+void Reset_Handler(void);
+
+/** Target of every handler nobody defines; calls irq_unhandled(). */
+void Default_Handler(void);
+
+#endif /* STM32_STARTUP_H */
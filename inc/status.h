@@ -0,0 +1,18 @@
+/**
+ * @file    status.h
+ * @brief   Driver return codes.
+ */
+#ifndef STM32_STATUS_H
+#define STM32_STATUS_H
+
+typedef enum {
+    DRV_OK = 0,
+    DRV_ERR_PARAM,      /**< Invalid argument or configuration. */
+    DRV_ERR_BUSY,       /**< Resource already in use or operation in flight. */
+    DRV_ERR_TIMEOUT,    /**< Hardware did not respond in time. */
+    DRV_ERR_HW,         /**< Hardware reported an error. */
+    DRV_ERR_NORES,      /**< No free resource (stream, slot, buffer). */
+    DRV_ERR_NACK,       /**< Addressed device did not acknowledge. */
+} drv_status_t;
+
+#endif /* STM32_STATUS_H */
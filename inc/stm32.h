@@ -0,0 +1,297 @@
+/**
+ * @file    stm32.h
+ * @brief   Device selection, memory map and peripheral instances.
+ *
+ * Select the family with -DSTM32F4 or -DSTM32F7 (STM32F4 is the default).
+ * When built for a non-ARM host, STM32_HOST is defined and every peripheral
+ * instance resolves to a plain RAM struct provided by host/periph_ram.c
+ * instead of its bus address.
+ */
+#ifndef STM32_H
+#define STM32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "reg.h"
+
+#if !defined(STM32F4) && !defined(STM32F7)
+#define STM32F4 1
+#endif
+
+#if !defined(STM32_HOST) && !defined(__arm__)
+#define STM32_HOST 1
+#endif
+
+/* ------------------------------------------------------------------------ */
+/* Memory map                                                               */
+/* ------------------------------------------------------------------------ */
+
+#define FLASH_MEM_BASE      0x08000000u
+#define FLASH_MEM_SIZE      0x00100000u
+#define SRAM1_BASE          0x20000000u
+#if defined(STM32F7)
+#define ITCMRAM_BASE        0x00000000u
+#define ITCMRAM_SIZE        0x00004000u
+#define DTCMRAM_BASE        0x20000000u
+#define DTCMRAM_SIZE        0x00010000u
+#else
+#define CCMRAM_BASE         0x10000000u
+#define CCMRAM_SIZE         0x00010000u
+#endif
+#define PERIPH_BASE         0x40000000u
+
+#define APB1PERIPH_BASE     (PERIPH_BASE + 0x00000000u)
+#define APB2PERIPH_BASE     (PERIPH_BASE + 0x00010000u)
+#define AHB1PERIPH_BASE     (PERIPH_BASE + 0x00020000u)
+#define AHB2PERIPH_BASE     (PERIPH_BASE + 0x10000000u)
+
+/*
+ * Bit-band aliases: every bit of the first MiB of SRAM and of the peripheral
+ * space is also a word in the alias region, so a single load/store reads or
+ * writes one bit without a read-modify-write in software.  Cortex-M4 only;
+ * the Cortex-M7 of the F7 parts has no bit-banding.
+ */
+#if defined(STM32F4)
+#define STM32_HAS_BITBAND   1
+#define SRAM_BB_BASE        0x22000000u
+#define PERIPH_BB_BASE      0x42000000u
+
+/** Alias word of bit @p bit of peripheral register @p reg (target only). */
+#define STM32_BB_PERIPH(reg, bit)                                           \
+    (*(volatile uint32_t *)(PERIPH_BB_BASE +                                \
+                            ((uint32_t)(uintptr_t)&(reg) - PERIPH_BASE) * 32u + (bit) * 4u))
+#else
+#define STM32_HAS_BITBAND   0
+#endif
+
+/*
+ * Core-coupled data memory (STM32_FASTDATA / STM32_FASTBSS): the F4 CCM is
+ * on the CPU D-bus only, so DMA cannot reach it and it must not hold DMA
+ * buffers; the F7 DTCM is reachable by DMA through the AHB slave port and
+ * is never cached, so DMA buffers there need no cache maintenance.
+ */
+#if defined(STM32F7)
+#define STM32_FASTDATA_DMA  1
+#else
+#define STM32_FASTDATA_DMA  0
+#endif
+
+/*
+ * L1 caches: the Cortex-M7 of the F7 parts has an instruction and a data
+ * cache (32-byte lines) that DMA does not see, so buffers shared with a
+ * DMA stream need explicit maintenance.  The F4 flash interface caches
+ * only hold flash contents and need none.
+ */
+#if defined(STM32F7)
+#define STM32_HAS_DCACHE    1
+#else
+#define STM32_HAS_DCACHE    0
+#endif
+#define STM32_CACHE_LINE    32u
+
+/* ------------------------------------------------------------------------ */
+/* Interrupt numbers (STM32F405/407/415/417/427/429/437/439)                 */
+/* ------------------------------------------------------------------------ */
+
+typedef enum {
+    NonMaskableInt_IRQn     = -14,
+    HardFault_IRQn          = -13,
+    MemoryManagement_IRQn   = -12,
+    BusFault_IRQn           = -11,
+    UsageFault_IRQn         = -10,
+    SVCall_IRQn             = -5,
+    DebugMonitor_IRQn       = -4,
+    PendSV_IRQn             = -2,
+    SysTick_IRQn            = -1,
+    WWDG_IRQn               = 0,
+    PVD_IRQn                = 1,
+    TAMP_STAMP_IRQn         = 2,
+    RTC_WKUP_IRQn           = 3,
+    FLASH_IRQn              = 4,
+    RCC_IRQn                = 5,
+    EXTI0_IRQn              = 6,
+    EXTI1_IRQn              = 7,
+    EXTI2_IRQn              = 8,
+    EXTI3_IRQn              = 9,
+    EXTI4_IRQn              = 10,
+    DMA1_Stream0_IRQn       = 11,
+    DMA1_Stream1_IRQn       = 12,
+    DMA1_Stream2_IRQn       = 13,
+    DMA1_Stream3_IRQn       = 14,
+    DMA1_Stream4_IRQn       = 15,
+    DMA1_Stream5_IRQn       = 16,
+    DMA1_Stream6_IRQn       = 17,
+    ADC_IRQn                = 18,
+    CAN1_TX_IRQn            = 19,
+    CAN1_RX0_IRQn           = 20,
+    CAN1_RX1_IRQn           = 21,
+    CAN1_SCE_IRQn           = 22,
+    EXTI9_5_IRQn            = 23,
+    TIM1_BRK_TIM9_IRQn      = 24,
+    TIM1_UP_TIM10_IRQn      = 25,
+    TIM1_TRG_COM_TIM11_IRQn = 26,
+    TIM1_CC_IRQn            = 27,
+    TIM2_IRQn               = 28,
+    TIM3_IRQn               = 29,
+    TIM4_IRQn               = 30,
+    I2C1_EV_IRQn            = 31,
+    I2C1_ER_IRQn            = 32,
+    I2C2_EV_IRQn            = 33,
+    I2C2_ER_IRQn            = 34,
+    SPI1_IRQn               = 35,
+    SPI2_IRQn               = 36,
+    USART1_IRQn             = 37,
+    USART2_IRQn             = 38,
+    USART3_IRQn             = 39,
+    EXTI15_10_IRQn          = 40,
+    RTC_Alarm_IRQn          = 41,
+    OTG_FS_WKUP_IRQn        = 42,
+    TIM8_BRK_TIM12_IRQn     = 43,
+    TIM8_UP_TIM13_IRQn      = 44,
+    TIM8_TRG_COM_TIM14_IRQn = 45,
+    TIM8_CC_IRQn            = 46,
+    DMA1_Stream7_IRQn       = 47,
+    FSMC_IRQn               = 48,
+    SDIO_IRQn               = 49,
+    TIM5_IRQn               = 50,
+    SPI3_IRQn               = 51,
+    UART4_IRQn              = 52,
+    UART5_IRQn              = 53,
+    TIM6_DAC_IRQn           = 54,
+    TIM7_IRQn               = 55,
+    DMA2_Stream0_IRQn       = 56,
+    DMA2_Stream1_IRQn       = 57,
+    DMA2_Stream2_IRQn       = 58,
+    DMA2_Stream3_IRQn       = 59,
+    DMA2_Stream4_IRQn       = 60,
+    ETH_IRQn                = 61,
+    ETH_WKUP_IRQn           = 62,
+    CAN2_TX_IRQn            = 63,
+    CAN2_RX0_IRQn           = 64,
+    CAN2_RX1_IRQn           = 65,
+    CAN2_SCE_IRQn           = 66,
+    OTG_FS_IRQn             = 67,
+    DMA2_Stream5_IRQn       = 68,
+    DMA2_Stream6_IRQn       = 69,
+    DMA2_Stream7_IRQn       = 70,
+    USART6_IRQn             = 71,
+    I2C3_EV_IRQn            = 72,
+    I2C3_ER_IRQn            = 73,
+    OTG_HS_EP1_OUT_IRQn     = 74,
+    OTG_HS_EP1_IN_IRQn      = 75,
+    OTG_HS_WKUP_IRQn        = 76,
+    OTG_HS_IRQn             = 77,
+    DCMI_IRQn               = 78,
+    HASH_RNG_IRQn           = 80,
+    FPU_IRQn                = 81,
+    UART7_IRQn              = 82,
+    UART8_IRQn              = 83,
+    SPI4_IRQn               = 84,
+    SPI5_IRQn               = 85,
+    SPI6_IRQn               = 86,
+    SAI1_IRQn               = 87,
+    LTDC_IRQn               = 88,
+    LTDC_ER_IRQn            = 89,
+    DMA2D_IRQn              = 90,
+    QUADSPI_IRQn            = 92,
+} irqn_t;
+
+#define STM32_IRQ_COUNT     96
+
+/* ------------------------------------------------------------------------ */
+/* Instance access                                                          */
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Resolve peripheral @p name of register struct @p type.  On target this is a
+ * cast of NAME_BASE; on the host it is the address of the RAM stand-in.
+ */
+#if defined(STM32_HOST)
+#define STM32_PERIPH(type, name)    (&stm32_host_##name)
+#else
+#define STM32_PERIPH(type, name)    ((type *)(name##_BASE))
+#endif
+
+#include "regs/core.h"
+#include "regs/rcc.h"
+#include "regs/flash.h"
+#include "regs/gpio.h"
+#include "regs/usart.h"
+#include "regs/spi.h"
+#include "regs/i2c.h"
+#include "regs/dma.h"
+#include "regs/tim.h"
+#include "regs/adc.h"
+#include "regs/crc.h"
+#include "regs/can.h"
+#include "regs/otg.h"
+#include "regs/syscfg.h"
+#include "regs/eth.h"
+#include "regs/sdio.h"
+#include "regs/quadspi.h"
+
+/**
+ * Every peripheral instance known to the tree: X(name, type, kind).
+ * The host build expands this list to allocate the RAM stand-ins; @p kind
+ * selects the register model used by the host simulator.
+ */
+#define STM32_PERIPH_LIST(X)            \
+    X(DWT,   dwt_regs_t,  core)         \
+    X(COREDEBUG, coredebug_regs_t, core) \
+    X(SCB,   scb_regs_t,  scb)          \
+    X(NVIC,  nvic_regs_t, nvic)         \
+    X(RCC,   rcc_regs_t,  rcc)          \
+    X(FLASH, flash_regs_t, flash)       \
+    X(FLASHMEM, flash_mem_t, flashmem)  \
+    X(GPIOA, gpio_regs_t, gpio)         \
+    X(GPIOB, gpio_regs_t, gpio)         \
+    X(GPIOC, gpio_regs_t, gpio)         \
+    X(GPIOD, gpio_regs_t, gpio)         \
+    X(GPIOE, gpio_regs_t, gpio)         \
+    X(GPIOF, gpio_regs_t, gpio)         \
+    X(GPIOG, gpio_regs_t, gpio)         \
+    X(GPIOH, gpio_regs_t, gpio)         \
+    X(GPIOI, gpio_regs_t, gpio)         \
+    X(USART1, usart_regs_t, usart)      \
+    X(USART2, usart_regs_t, usart)      \
+    X(USART3, usart_regs_t, usart)      \
+    X(UART4, usart_regs_t, usart)       \
+    X(UART5, usart_regs_t, usart)       \
+    X(USART6, usart_regs_t, usart)      \
+    X(SPI1,  spi_regs_t,  spi)          \
+    X(SPI2,  spi_regs_t,  spi)          \
+    X(SPI3,  spi_regs_t,  spi)          \
+    X(I2C1,  i2c_regs_t,  i2c)          \
+    X(I2C2,  i2c_regs_t,  i2c)          \
+    X(I2C3,  i2c_regs_t,  i2c)          \
+    X(DMA1,  dma_regs_t,  dma)          \
+    X(DMA2,  dma_regs_t,  dma)          \
+    X(TIM1,  tim_regs_t,  tim)          \
+    X(TIM2,  tim_regs_t,  tim)          \
+    X(TIM3,  tim_regs_t,  tim)          \
+    X(TIM4,  tim_regs_t,  tim)          \
+    X(TIM5,  tim_regs_t,  tim)          \
+    X(TIM8,  tim_regs_t,  tim)          \
+    X(ADC1,  adc_regs_t,  adc)          \
+    X(ADC2,  adc_regs_t,  adc)          \
+    X(ADC3,  adc_regs_t,  adc)          \
+    X(ADC_COMMON, adc_common_regs_t, core) \
+    X(CRC,   crc_regs_t,  crc)          \
+    X(CAN1,  can_regs_t,  can)          \
+    X(CAN2,  can_regs_t,  can)          \
+    X(OTG_FS, otg_regs_t, otg)         \
+    X(SYSCFG, syscfg_regs_t, core)      \
+    X(ETH,   eth_regs_t,  eth)          \
+    X(SDIO,  sdio_regs_t, sdio)         \
+    X(QUADSPI, quadspi_regs_t, qspi)    \
+    X(QSPIMEM, qspi_mem_t, core)
+
+#if defined(STM32_HOST)
+#define STM32_HOST_DECLARE(name, type, kind) extern type stm32_host_##name;
+STM32_PERIPH_LIST(STM32_HOST_DECLARE)
+#undef STM32_HOST_DECLARE
+#endif
+
+#endif /* STM32_H */
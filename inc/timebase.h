@@ -0,0 +1,106 @@
+/**
+ * @file    timebase.h
+ * @brief   Tickless 64-bit monotonic time and software timers.
+ *
+ * A 32-bit timer (TIM2 or TIM5) free-runs at the tick rate.  Its only
+ * periodic interrupts are the two half-period events (overflow, and
+ * channel 2 matching at 0x80000000), which advance an epoch counter of
+ * elapsed half periods: at 1 MHz that is one interrupt every 36 minutes
+ * instead of a 1 kHz tick.
+ *
+ * timebase_now() combines the epoch and the counter without locking.  The
+ * epoch's low bit must equal the counter's top bit; when it does not, the
+ * half-period interrupt is pending and the epoch is one behind, so the
+ * reader corrects its copy.  This is exact from any context (thread,
+ * interrupt of any priority, interrupts masked) as long as the time-base
+ * interrupt is served within half a counter period.
+ *
+ * Software timers sit in a timing wheel of TIMEBASE_WHEEL_SLOTS slots of
+ * 2^TIMEBASE_SLOT_SHIFT ticks, with a non-empty-slot bitmap; timers beyond
+ * the wheel's horizon wait in a sorted list and move into the wheel as it
+ * turns.  Nothing ticks: channel 1 is programmed to the earliest deadline,
+ * and its interrupt expires timers, runs their callbacks and reprograms it.
+ *
+ * The interrupt handler of the chosen timer is provided here.  Enable its
+ * line (TIM2_IRQn / TIM5_IRQn) at a high priority: callbacks run in it, so
+ * keep them short.  Timers may be started and stopped from any context.
+ * Clock frequencies come from rcc_current(), so apply the clock plan first.
+ */
+#ifndef STM32_TIMEBASE_H
+#define STM32_TIMEBASE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "stm32.h"
+
+/** Wheel slots (a power of two, at most 64) and slot width in ticks. */
+#define TIMEBASE_WHEEL_SLOTS    64u
+#define TIMEBASE_SLOT_SHIFT     12u
+
+typedef struct timebase_timer timebase_timer_t;
+
+/** Expiry callback (time-base interrupt context); may restart @p t. */
+typedef void (*timebase_cb_t)(timebase_timer_t *t, void *ctx);
+
+struct timebase_timer {
+    timebase_timer_t *next;
+    timebase_timer_t *prev;
+    timebase_timer_t **list;    /**< List holding the timer; NULL: idle. */
+    uint64_t deadline;          /**< Absolute time in ticks. */
+    uint32_t period;            /**< Reload in ticks; 0: one-shot. */
+    timebase_cb_t cb;
+    void *ctx;
+};
+
+/**
+ * Start @p tim (TIM2 or TIM5) counting at @p hz (0: the timer clock) from
+ * time 0.  DRV_ERR_PARAM if @p hz does not divide down from the timer
+ * clock within the 16-bit prescaler; timebase_hz() gives the exact rate.
+ */
+drv_status_t timebase_init(tim_regs_t *tim, uint32_t hz);
+
+/** Stop the timer.  Pending timers are dropped without callbacks. */
+void timebase_deinit(void);
+
+/** Tick rate in Hz. */
+uint32_t timebase_hz(void);
+
+/** Interrupt line of the timer in use. */
+irqn_t timebase_irqn(void);
+
+/** Ticks since timebase_init(); monotonic, lock-free, any context. */
+uint64_t timebase_now(void);
+
+/** Ticks in @p us microseconds, rounded up. */
+uint64_t timebase_us(uint64_t us);
+
+/** Nanoseconds in @p ticks, rounded down. */
+uint64_t timebase_ns(uint64_t ticks);
+
+void timebase_timer_init(timebase_timer_t *t, timebase_cb_t cb, void *ctx);
+
+/**
+ * Arm @p t for absolute time @p deadline, then every @p period ticks if
+ * non-zero.  A running timer is re-armed.  A deadline already past expires
+ * on the next time-base interrupt, which is pended.
+ */
+drv_status_t timebase_timer_start(timebase_timer_t *t, uint64_t deadline, uint32_t period);
+
+/** timebase_timer_start() @p delay ticks from now. */
+drv_status_t timebase_timer_after(timebase_timer_t *t, uint64_t delay, uint32_t period);
+
+/** Disarm @p t; false if it was not pending. */
+bool timebase_timer_stop(timebase_timer_t *t);
+
+/** Whether @p t is armed (or expired with its callback still to run). */
+bool timebase_timer_pending(const timebase_timer_t *t);
+
+/** Earliest armed deadline, or UINT64_MAX. */
+uint64_t timebase_next_deadline(void);
+
+/** Interrupt service: epoch update, expiry and compare reprogramming. */
+void timebase_irq(void);
+
+#endif /* STM32_TIMEBASE_H */
@@ -0,0 +1,97 @@
+/**
+ * @file    usart.h
+ * @brief   USART driver: polled transmit and DMA circular receive.
+ *
+ * DMA receive runs the stream in circular mode over a caller-supplied
+ * buffer.  The CPU is only involved on half-transfer, transfer-complete and
+ * IDLE-line events; each event hands the newly received bytes to the
+ * application as one or two spans pointing straight into the buffer.  A span
+ * stays valid until the DMA wraps around onto it again, i.e. for roughly
+ * half a buffer's worth of line time.
+ *
+ * Interrupt-driven transmit goes through a lock-free ring buffer: thread
+ * mode queues bytes, the TXE interrupt drains them.
+ */
+#ifndef STM32_USART_H
+#define STM32_USART_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dma.h"
+#include "ringbuf.h"
+#include "status.h"
+#include "stm32.h"
+
+typedef struct {
+    uint32_t pclk_hz;   /**< Clock of the APB bus the USART sits on. */
+    uint32_t baud;
+} usart_config_t;
+
+/**
+ * Receive callback.  @p data points into the DMA buffer; called from
+ * interrupt context.
+ */
+typedef void (*usart_rx_cb_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;            /**< Buffer size in bytes, at most 65535. */
+    usart_rx_cb_t cb;
+    void *ctx;
+} usart_dma_rx_config_t;
+
+typedef struct {
+    usart_regs_t *usart;
+    dma_stream_t *dma;      /**< Stream allocated for the RX request. */
+    dma_xfer_t xfer;
+    uint8_t *buf;
+    size_t size;
+    size_t tail;            /**< First byte not yet handed to the callback. */
+    usart_rx_cb_t cb;
+    void *ctx;
+} usart_dma_rx_t;
+
+typedef struct {
+    usart_regs_t *usart;
+    ringbuf_t rb;
+} usart_txq_t;
+
+/** Enable the USART clock, program the baud rate and enable TX and RX. */
+drv_status_t usart_init(usart_regs_t *usart, const usart_config_t *cfg);
+
+/** Blocking single byte transmit. */
+void usart_write_byte(usart_regs_t *usart, uint8_t byte);
+
+/** Blocking transmit of @p len bytes. */
+void usart_write(usart_regs_t *usart, const uint8_t *data, size_t len);
+
+/** Set up an interrupt-driven transmit queue over @p storage (power of two). */
+drv_status_t usart_txq_init(usart_txq_t *q, usart_regs_t *usart,
+                            uint8_t *storage, uint32_t size);
+
+/**
+ * Queue up to @p len bytes without blocking; returns the number queued.
+ * Thread mode only (single producer).
+ */
+uint32_t usart_txq_write(usart_txq_t *q, const uint8_t *data, uint32_t len);
+
+/** Call from the USART interrupt handler (TXE). */
+void usart_txq_irq(usart_txq_t *q);
+
+/**
+ * Start circular DMA reception on an initialised USART.  The stream comes
+ * from the DMA allocator (DRV_ERR_NORES if none is free); its interrupt is
+ * serviced by dma_irq().
+ */
+drv_status_t usart_dma_rx_start(usart_dma_rx_t *rx, usart_regs_t *usart,
+                                const usart_dma_rx_config_t *cfg);
+
+/** Stop reception and release the stream; received bytes are delivered first. */
+void usart_dma_rx_stop(usart_dma_rx_t *rx);
+
+/** Call from the USART interrupt handler (IDLE line). */
+void usart_dma_rx_usart_irq(usart_dma_rx_t *rx);
+
+#endif /* STM32_USART_H */
@@ -0,0 +1,242 @@
+/**
+ * @file    usb.h
+ * @brief   USB full-speed device core on OTG_FS: enumeration, endpoint 0
+ *          and FIFO access for class drivers.
+ *
+ * The core answers the standard requests itself (descriptors, address,
+ * configuration, endpoint halt) from the descriptors in usb_config_t and
+ * hands class and vendor requests, configuration changes and the data
+ * endpoints to a usb_class_t.
+ *
+ * The OTG core has no packet memory the CPU can address: every packet goes
+ * through a FIFO that is read or written a word at a time.  The class
+ * callbacks therefore move data themselves, straight between the FIFO and
+ * their own buffers: usb_ep_read_ring() pops an OUT packet into the free
+ * space of a ring buffer and usb_ep_write_ring() pushes IN packets from
+ * its used space, wrap-around included, so a byte is copied exactly once
+ * between the application's buffer and the wire.  Unaligned buffers cost
+ * nothing on Cortex-M (word loads and stores may be unaligned).
+ *
+ * FIFO RAM (OTG_FS_FIFO_WORDS) is split once at usb_init(): the receive
+ * FIFO, shared by all OUT endpoints, defaults to room for two maximum-size
+ * packets plus SETUP and status entries, so the host can send the next
+ * packet while the CPU empties the last one; class IN endpoints get what
+ * usb_config_t.tx_fifo_words asks for, typically two packets, and are
+ * refilled from the FIFO-half-empty interrupt (GAHBCFG.TXFELVL = 0) while
+ * the other packet is on the wire.
+ *
+ * All callbacks run in the OTG_FS interrupt.  Only OTG_FS in device mode
+ * is covered; OTG_HS and host mode are not.
+ */
+#ifndef STM32_USB_H
+#define STM32_USB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ringbuf.h"
+#include "status.h"
+#include "stm32.h"
+
+#define USB_GPIO_AF         10u         /**< PA11 (DM) / PA12 (DP) alternate function. */
+
+#define USB_EP_COUNT        OTG_FS_EP_COUNT
+#define USB_EP_IN           0x80u       /**< Direction bit of an endpoint address. */
+#define USB_EP0_MPS         64u
+#define USB_EP0_BUF         128u        /**< Longest control OUT data stage and string. */
+#define USB_FS_MPS_MAX      64u         /**< Bulk and interrupt packets at full speed. */
+
+/** Default receive FIFO: (5 x control + 8) + 2 x (packet + status) + 2 x OUT + 1 words. */
+#define USB_RX_FIFO_WORDS   (13u + 2u * (USB_FS_MPS_MAX / 4u + 1u) + 2u * USB_EP_COUNT + 1u)
+#define USB_EP0_FIFO_WORDS  16u         /**< Also the minimum of any IN FIFO. */
+
+/* bmRequestType */
+#define USB_REQ_DIR_IN          0x80u
+#define USB_REQ_TYPE_MASK       0x60u
+#define USB_REQ_TYPE_STANDARD   0x00u
+#define USB_REQ_TYPE_CLASS      0x20u
+#define USB_REQ_TYPE_VENDOR     0x40u
+#define USB_REQ_RECIP_MASK      0x1Fu
+#define USB_REQ_RECIP_DEVICE    0x00u
+#define USB_REQ_RECIP_INTERFACE 0x01u
+#define USB_REQ_RECIP_ENDPOINT  0x02u
+
+/* Standard bRequest */
+#define USB_REQ_GET_STATUS          0u
+#define USB_REQ_CLEAR_FEATURE       1u
+#define USB_REQ_SET_FEATURE         3u
+#define USB_REQ_SET_ADDRESS         5u
+#define USB_REQ_GET_DESCRIPTOR      6u
+#define USB_REQ_SET_DESCRIPTOR      7u
+#define USB_REQ_GET_CONFIGURATION   8u
+#define USB_REQ_SET_CONFIGURATION   9u
+#define USB_REQ_GET_INTERFACE       10u
+#define USB_REQ_SET_INTERFACE       11u
+
+#define USB_FEATURE_ENDPOINT_HALT   0u
+#define USB_FEATURE_REMOTE_WAKEUP   1u
+
+/* Descriptor types */
+#define USB_DESC_DEVICE             1u
+#define USB_DESC_CONFIG             2u
+#define USB_DESC_STRING             3u
+#define USB_DESC_INTERFACE          4u
+#define USB_DESC_ENDPOINT           5u
+#define USB_DESC_DEVICE_QUALIFIER   6u
+
+/* Endpoint types (bmAttributes, DIEPCTL.EPTYP) */
+#define USB_EP_CONTROL      0u
+#define USB_EP_ISO          1u
+#define USB_EP_BULK         2u
+#define USB_EP_INTERRUPT    3u
+
+typedef struct {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} usb_setup_t;
+
+typedef enum {
+    USB_STATE_DETACHED = 0,
+    USB_STATE_DEFAULT,          /**< Reset, address 0. */
+    USB_STATE_ADDRESS,
+    USB_STATE_CONFIGURED,
+} usb_state_t;
+
+typedef struct usb_dev usb_dev_t;
+
+/** Class driver hooks; any may be NULL.  All run in the OTG_FS interrupt. */
+typedef struct {
+    /**
+     * Configuration @p config (bConfigurationValue) selected: open its
+     * endpoints with usb_ep_open().  0: deconfigured by SET_CONFIGURATION
+     * or a bus reset; the core has closed the endpoints already.
+     * Anything but DRV_OK stalls the request.
+     */
+    drv_status_t (*configure)(usb_dev_t *d, uint8_t config);
+    /**
+     * Class or vendor request, or a standard one the core does not handle.
+     * Device-to-host: point *@p data at the reply and set *@p len (sent up
+     * to wLength).  Host-to-device with data: the data stage is passed to
+     * ctrl_out() before the status stage.  Anything but DRV_OK stalls.
+     */
+    drv_status_t (*setup)(usb_dev_t *d, const usb_setup_t *req, const uint8_t **data,
+                          uint16_t *len);
+    /** Data stage of a host-to-device request accepted by setup(). */
+    void (*ctrl_out)(usb_dev_t *d, const usb_setup_t *req, const uint8_t *data, uint16_t len);
+    /**
+     * OUT packet of @p len bytes for endpoint @p ep at the head of the
+     * receive FIFO: take it with usb_ep_read() or usb_ep_read_ring(); what
+     * is not taken is discarded.
+     */
+    void (*rx)(usb_dev_t *d, uint8_t ep, uint32_t len);
+    /** OUT transfer armed with usb_ep_out_arm() complete (all packets, or a short one). */
+    void (*rx_done)(usb_dev_t *d, uint8_t ep);
+    /** Transmit FIFO of @p ep half empty while usb_ep_in_start() data is unwritten. */
+    void (*tx_space)(usb_dev_t *d, uint8_t ep);
+    /** IN transfer on @p ep sent. */
+    void (*tx_done)(usb_dev_t *d, uint8_t ep);
+} usb_class_t;
+
+typedef struct {
+    const usb_class_t *cls;
+    void *ctx;                  /**< For the class: usb_dev_t.ctx. */
+    const uint8_t *device_desc; /**< 18 bytes. */
+    const uint8_t *config_desc; /**< wTotalLength bytes; one configuration. */
+    /** String descriptors 1..nstrings as ASCII; string 0 is US English. */
+    const char *const *strings;
+    uint8_t nstrings;
+    uint16_t rx_fifo_words;     /**< 0: USB_RX_FIFO_WORDS. */
+    /** IN FIFO per endpoint; 0: none (EP0: USB_EP0_FIFO_WORDS). */
+    uint16_t tx_fifo_words[USB_EP_COUNT];
+} usb_config_t;
+
+struct usb_dev {
+    otg_regs_t *otg;
+    const usb_config_t *cfg;
+    void *ctx;
+    volatile usb_state_t state;
+    volatile bool suspended;
+    uint8_t config;             /**< Current bConfigurationValue, 0: none. */
+    /* Endpoint 0 */
+    uint8_t ep0_stage;
+    bool ep0_zlp;               /**< Data stage must end with a zero-length packet. */
+    uint16_t ep0_left;
+    uint16_t ep0_rx_len;
+    const uint8_t *ep0_data;
+    usb_setup_t setup;
+    uint32_t setup_raw[2];
+    uint8_t ep0_buf[USB_EP0_BUF];
+    /* Data endpoints */
+    uint16_t mps_in[USB_EP_COUNT];
+    uint16_t mps_out[USB_EP_COUNT];
+    uint32_t in_left[USB_EP_COUNT]; /**< IN transfer bytes not yet in the FIFO. */
+    uint32_t empmsk;            /**< DIEPEMPMSK shadow. */
+    uint32_t rx_left;           /**< Bytes of the current OUT packet still in the FIFO. */
+    /* Counters since usb_init(). */
+    uint32_t resets;            /**< Bus resets. */
+    uint32_t rx_dropped;        /**< OUT bytes discarded: not taken, or no room. */
+};
+
+/**
+ * Enable OTG_FS, reset the core, split the FIFO RAM and pull D+ up.
+ * DRV_ERR_PARAM without an exact 48 MHz PLL48CK, with HCLK below 14.2 MHz
+ * (USB turnaround) or a bad configuration; DRV_ERR_NORES if the FIFOs do
+ * not fit; DRV_ERR_TIMEOUT if the core reset does not complete.
+ */
+drv_status_t usb_init(usb_dev_t *d, const usb_config_t *cfg);
+
+/** Detach from the bus and power the transceiver down. */
+void usb_deinit(usb_dev_t *d);
+
+/**
+ * Activate endpoint @p addr (USB_EP_IN for IN) of @p type with packets of
+ * up to @p mps bytes; from usb_class_t.configure().  DRV_ERR_NORES if an
+ * IN endpoint has no FIFO for a packet.
+ */
+drv_status_t usb_ep_open(usb_dev_t *d, uint8_t addr, uint32_t type, uint32_t mps);
+
+/** Deactivate endpoint @p addr; a transfer in progress is dropped. */
+void usb_ep_close(usb_dev_t *d, uint8_t addr);
+
+/** Set or clear the halt (STALL) of endpoint @p addr; clearing resets the toggle to DATA0. */
+void usb_ep_stall(usb_dev_t *d, uint8_t addr, bool stall);
+
+bool usb_ep_stalled(const usb_dev_t *d, uint8_t addr);
+
+/** Accept up to @p packets maximum-size packets on OUT endpoint @p ep (1..1023). */
+void usb_ep_out_arm(usb_dev_t *d, uint8_t ep, uint32_t packets);
+
+/**
+ * Start an IN transfer of @p len bytes on endpoint @p ep; 0 sends a
+ * zero-length packet.  The data goes in with usb_ep_write() or
+ * usb_ep_write_ring(), now or from tx_space().
+ */
+void usb_ep_in_start(usb_dev_t *d, uint8_t ep, uint32_t len);
+
+/** Write one packet of @p len bytes (at most the endpoint's MPS); false if the FIFO is short. */
+bool usb_ep_write(usb_dev_t *d, uint8_t ep, const void *data, uint32_t len);
+
+/**
+ * Write whole packets of the transfer in progress on @p ep from the used
+ * space of @p rb into the FIFO, as many as fit; returns the bytes written.
+ * @p rb must hold the rest of the transfer.
+ */
+uint32_t usb_ep_write_ring(usb_dev_t *d, uint8_t ep, ringbuf_t *rb);
+
+/** From rx(): take up to @p len bytes of the current OUT packet. */
+uint32_t usb_ep_read(usb_dev_t *d, void *data, uint32_t len);
+
+/**
+ * From rx(): take up to @p len bytes of the current OUT packet into the
+ * free space of @p rb; bytes that do not fit are dropped.
+ */
+uint32_t usb_ep_read_ring(usb_dev_t *d, ringbuf_t *rb, uint32_t len);
+
+/** Interrupt service; OTG_FS_IRQHandler calls it for the initialised device. */
+void usb_irq(usb_dev_t *d);
+
+#endif /* STM32_USB_H */
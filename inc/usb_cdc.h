@@ -0,0 +1,127 @@
+/**
+ * @file    usb_cdc.h
+ * @brief   USB CDC-ACM (virtual serial port) class on the USB device core.
+ *
+ * Bulk data goes straight between the OTG FIFOs and two application ring
+ * buffers (see usb.h): OUT packets are popped into the receive ring from
+ * the interrupt and IN packets pushed from the transmit ring, with no
+ * intermediate packet buffer.
+ *
+ * Receive.  The OUT endpoint is armed for as many whole packets as the
+ * receive ring has room for; once they are in, it NAKs until usb_cdc_read()
+ * (or usb_cdc_rx_kick()) frees space again.  Flow control is the host's
+ * NAK retry, so nothing is ever dropped.
+ *
+ * Transmit.  usb_cdc_write() queues into the transmit ring and, if the IN
+ * endpoint is idle, starts a transfer of everything queued: the first two
+ * packets go into the FIFO at once and the rest follow from the
+ * half-empty interrupt while the host reads the others.  A transfer that
+ * ends on a packet boundary with nothing more queued is closed with a
+ * zero-length packet.
+ *
+ * Line coding and control line state are recorded for the application and
+ * have no other effect.
+ */
+#ifndef STM32_USB_CDC_H
+#define STM32_USB_CDC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ringbuf.h"
+#include "status.h"
+#include "usb.h"
+
+#define USB_CDC_EP_DATA_OUT     0x01u
+#define USB_CDC_EP_DATA_IN      0x81u
+#define USB_CDC_EP_NOTIFY       0x82u
+#define USB_CDC_DATA_MPS        64u
+#define USB_CDC_NOTIFY_MPS      16u
+#define USB_CDC_TX_FIFO_WORDS   (2u * USB_CDC_DATA_MPS / 4u)  /**< Two packets. */
+
+/* Class requests (PSTN subclass) */
+#define USB_CDC_SET_LINE_CODING         0x20u
+#define USB_CDC_GET_LINE_CODING         0x21u
+#define USB_CDC_SET_CONTROL_LINE_STATE  0x22u
+#define USB_CDC_SEND_BREAK              0x23u
+
+/* SET_CONTROL_LINE_STATE wValue */
+#define USB_CDC_LINE_DTR        0x01u
+#define USB_CDC_LINE_RTS        0x02u
+
+typedef struct {
+    uint32_t baud;
+    uint8_t stop_bits;          /**< 0: 1, 1: 1.5, 2: 2. */
+    uint8_t parity;             /**< 0: none, 1: odd, 2: even, 3: mark, 4: space. */
+    uint8_t data_bits;
+} usb_cdc_line_coding_t;
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcd_device;
+    const char *manufacturer;   /**< String descriptors, ASCII; may be NULL. */
+    const char *product;
+    const char *serial;
+    ringbuf_t *rx;              /**< Host to device; at least one packet. */
+    ringbuf_t *tx;              /**< Device to host. */
+} usb_cdc_config_t;
+
+typedef struct {
+    usb_dev_t usb;
+    usb_config_t usb_cfg;
+    uint8_t device_desc[18];
+    const char *strings[3];
+    ringbuf_t *rx;
+    ringbuf_t *tx;
+    usb_cdc_line_coding_t coding;
+    volatile uint8_t lines;     /**< USB_CDC_LINE_DTR, USB_CDC_LINE_RTS. */
+    volatile bool rx_armed;     /**< OUT transfer armed. */
+    volatile bool tx_busy;      /**< IN transfer in progress. */
+    uint32_t tx_len;            /**< Bytes of the IN transfer in progress. */
+    /* Counters since usb_cdc_init(). */
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+} usb_cdc_t;
+
+/**
+ * Build the descriptors and bring up the USB device (usb_init()).  Errors
+ * as usb_init(); DRV_ERR_PARAM also for missing or too small rings.
+ */
+drv_status_t usb_cdc_init(usb_cdc_t *c, const usb_cdc_config_t *cfg);
+
+void usb_cdc_deinit(usb_cdc_t *c);
+
+/** The host has selected the configuration. */
+STM32_INLINE bool usb_cdc_configured(const usb_cdc_t *c)
+{
+    return c->usb.state == USB_STATE_CONFIGURED;
+}
+
+/**
+ * Queue up to @p len bytes for the host and start sending; returns the
+ * number queued (less if the transmit ring is full).  Thread context.
+ */
+uint32_t usb_cdc_write(usb_cdc_t *c, const void *data, uint32_t len);
+
+/** Take up to @p len received bytes; re-arms reception. Thread context. */
+uint32_t usb_cdc_read(usb_cdc_t *c, void *data, uint32_t len);
+
+/** Start sending what was written into the transmit ring directly. */
+void usb_cdc_tx_kick(usb_cdc_t *c);
+
+/** Re-arm reception after consuming from the receive ring directly. */
+void usb_cdc_rx_kick(usb_cdc_t *c);
+
+STM32_INLINE const usb_cdc_line_coding_t *usb_cdc_line_coding(const usb_cdc_t *c)
+{
+    return &c->coding;
+}
+
+/** Control lines from the host: USB_CDC_LINE_DTR, USB_CDC_LINE_RTS. */
+STM32_INLINE uint8_t usb_cdc_lines(const usb_cdc_t *c)
+{
+    return c->lines;
+}
+
+#endif /* STM32_USB_CDC_H */
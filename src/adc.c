@@ -0,0 +1,427 @@
+/**
+ * @file    adc.c
+ * @brief   ADC driver: timer-triggered scan with DMA and in-place decimation.
+ */
+#include <string.h>
+
+#include "adc.h"
+#include "rcc.h"
+
+typedef struct {
+    adc_regs_t *adc;
+    uint32_t en;
+    dma_req_t req;
+} adc_hw_t;
+
+typedef struct {
+    tim_regs_t *tim;
+    bool apb2;
+    uint32_t en;
+    uint8_t extsel;
+} adc_trig_hw_t;
+
+static const adc_hw_t adc_hw[] = {
+    { ADC1, RCC_APB2ENR_ADC1EN, DMA_REQ_ADC1 },
+    { ADC2, RCC_APB2ENR_ADC2EN, DMA_REQ_ADC2 },
+    { ADC3, RCC_APB2ENR_ADC3EN, DMA_REQ_ADC3 },
+};
+
+/* Indexed by adc_trigger_t; TRGO of these timers is wired to EXTSEL. */
+static const adc_trig_hw_t adc_trig_hw[] = {
+    [ADC_TRIG_TIM2] = { TIM2, false, RCC_APB1ENR_TIM2EN, ADC_EXTSEL_TIM2_TRGO },
+    [ADC_TRIG_TIM3] = { TIM3, false, RCC_APB1ENR_TIM3EN, ADC_EXTSEL_TIM3_TRGO },
+    [ADC_TRIG_TIM8] = { TIM8, true,  RCC_APB2ENR_TIM8EN, ADC_EXTSEL_TIM8_TRGO },
+};
+
+/* Sampling time of each ADC_SMP_* code, in ADCCLK cycles. */
+static const uint16_t adc_smp_cycles[8] = { 3, 15, 28, 56, 84, 112, 144, 480 };
+
+/* Handles by instance, for the shared ADC interrupt. */
+static adc_t *adc_handles[STM32_ARRAY_SIZE(adc_hw)];
+
+static void adc_dma_event(void *ctx, uint32_t events);
+
+static size_t adc_hw_index(const adc_regs_t *adc)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(adc_hw); i++) {
+        if (adc_hw[i].adc == adc) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* Smallest of the /2, /4, /6, /8 prescalers that keeps ADCCLK legal. */
+static uint32_t adc_clock(uint32_t pclk2, uint32_t *pre)
+{
+    uint32_t p;
+
+    for (p = 0; p < 3u; p++) {
+        if (pclk2 / (2u * (p + 1u)) <= ADC_MAX_HZ) {
+            break;
+        }
+    }
+    *pre = p;
+    return pclk2 / (2u * (p + 1u));
+}
+
+static drv_status_t adc_timer_init(adc_t *h, const adc_trig_hw_t *t, uint32_t rate_hz)
+{
+    uint32_t clk = rcc_timer_clock(rcc_current(), t->apb2);
+    uint32_t ticks;
+    uint32_t psc;
+    uint32_t arr;
+
+    if (rate_hz == 0u || clk / rate_hz < 2u) {
+        return DRV_ERR_PARAM;
+    }
+    ticks = (clk + rate_hz / 2u) / rate_hz;
+    psc = (ticks - 1u) / 0x10000u;
+    arr = (ticks + psc / 2u) / (psc + 1u) - 1u;
+    if (psc > 0xFFFFu) {
+        return DRV_ERR_PARAM;
+    }
+
+    if (t->apb2) {
+        REG_SET_BITS(RCC->APB2ENR, t->en);
+    } else {
+        REG_SET_BITS(RCC->APB1ENR, t->en);
+    }
+    REG_WRITE(t->tim->CR1, 0u);
+    REG_WRITE(t->tim->PSC, psc);
+    REG_WRITE(t->tim->ARR, arr);
+    REG_WRITE(t->tim->CR2, reg_field_prep(TIM_CR2_MMS, TIM_MMS_UPDATE));
+    /* Load PSC now; the ADC is not listening to TRGO yet. */
+    REG_WRITE(t->tim->EGR, TIM_EGR_UG);
+    REG_WRITE(t->tim->SR, 0u);
+
+    h->tim = t->tim;
+    h->rate_hz = clk / ((psc + 1u) * (arr + 1u));
+    return DRV_OK;
+}
+
+static void adc_sequence_init(adc_regs_t *adc, const adc_config_t *cfg)
+{
+    uint32_t sqr[3] = { 0 };
+    uint32_t smpr1 = 0;
+    uint32_t smpr2 = 0;
+    uint32_t ch;
+    uint32_t r;
+
+    for (ch = 0; ch < 19u; ch++) {
+        if (ch < 10u) {
+            smpr2 = reg_field_set(smpr2, ADC_SMPR_SMP(ch), cfg->smp);
+        } else {
+            smpr1 = reg_field_set(smpr1, ADC_SMPR_SMP(ch), cfg->smp);
+        }
+    }
+    for (r = 0; r < cfg->nchannels; r++) {
+        /* sqr[0] = SQR3 (ranks 1..6), sqr[2] = SQR1 (ranks 13..16). */
+        sqr[r / 6u] = reg_field_set(sqr[r / 6u], ADC_SQR_SQ(r), cfg->channels[r]);
+    }
+    sqr[2] = reg_field_set(sqr[2], ADC_SQR1_L, cfg->nchannels - 1u);
+
+    REG_WRITE(adc->SMPR1, smpr1);
+    REG_WRITE(adc->SMPR2, smpr2);
+    REG_WRITE(adc->SQR3, sqr[0]);
+    REG_WRITE(adc->SQR2, sqr[1]);
+    REG_WRITE(adc->SQR1, sqr[2]);
+}
+
+drv_status_t adc_init(adc_t *h, adc_regs_t *adc, const adc_config_t *cfg)
+{
+    const dma_config_t dcfg = {
+        .dir = DMA_DIR_P2M, .psize = DMA_SIZE_HALFWORD, .msize = DMA_SIZE_HALFWORD,
+        .priority = 3u, .minc = true, .circular = true, .half = true,
+    };
+    size_t idx = adc_hw_index(adc);
+    uint32_t decim;
+    uint32_t adcclk;
+    uint32_t pre;
+    uint32_t cycles;
+    uint32_t i;
+    drv_status_t rc;
+
+    if (h == NULL || cfg == NULL || idx == STM32_ARRAY_SIZE(adc_hw) ||
+        cfg->channels == NULL || cfg->nchannels == 0u ||
+        cfg->nchannels > ADC_MAX_CHANNELS || cfg->smp > ADC_SMP_480 ||
+        cfg->res > ADC_RES_6 || cfg->trigger > ADC_TRIG_TIM8 ||
+        cfg->buf == NULL || cfg->half_frames == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    decim = (cfg->decim > 1u) ? cfg->decim : 1u;
+    if (cfg->half_frames % decim != 0u ||
+        2u * (uint32_t)cfg->half_frames * cfg->nchannels > 0xFFFFu) {
+        return DRV_ERR_PARAM;
+    }
+    for (i = 0; i < cfg->nchannels; i++) {
+        if (cfg->channels[i] > 18u) {
+            return DRV_ERR_PARAM;
+        }
+    }
+
+    /* The whole sequence must fit in one trigger period. */
+    adcclk = adc_clock(rcc_current()->pclk2_hz, &pre);
+    cycles = (adc_smp_cycles[cfg->smp] + 12u - 2u * cfg->res) * cfg->nchannels;
+    if (cfg->trigger != ADC_TRIG_SOFTWARE &&
+        (uint64_t)cfg->rate_hz * cycles > adcclk) {
+        return DRV_ERR_PARAM;
+    }
+
+    rc = dma_alloc(adc_hw[idx].req, &h->dma);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    (void)dma_configure(h->dma, &dcfg);
+
+    h->adc = adc;
+    h->tim = NULL;
+    h->buf = cfg->buf;
+    h->nch = cfg->nchannels;
+    h->half_frames = cfg->half_frames;
+    h->decim = (uint16_t)decim;
+    h->cb = cfg->cb;
+    h->ctx = cfg->ctx;
+    h->rate_hz = 0;
+    h->overruns = 0;
+    if (cfg->trigger != ADC_TRIG_SOFTWARE) {
+        rc = adc_timer_init(h, &adc_trig_hw[cfg->trigger], cfg->rate_hz);
+        if (rc != DRV_OK) {
+            dma_free(h->dma);
+            return rc;
+        }
+    }
+
+    REG_SET_BITS(RCC->APB2ENR, adc_hw[idx].en);
+    REG_FIELD_WRITE(ADC_COMMON->CCR, ADC_CCR_ADCPRE, pre);
+    REG_WRITE(adc->CR2, 0u);
+    REG_WRITE(adc->CR1, (cfg->nchannels > 1u ? ADC_CR1_SCAN : 0u) |
+                        reg_field_prep(ADC_CR1_RES, cfg->res));
+    adc_sequence_init(adc, cfg);
+    /* DDS keeps requests coming after the stream wraps (circular mode). */
+    REG_WRITE(adc->CR2, ADC_CR2_ADON | ADC_CR2_DDS |
+                        reg_field_prep(ADC_CR2_EXTSEL,
+                                       (cfg->trigger != ADC_TRIG_SOFTWARE) ?
+                                       adc_trig_hw[cfg->trigger].extsel : 0u));
+    adc_handles[idx] = h;
+    return DRV_OK;
+}
+
+/* (Re)start the stream at the buffer start and re-arm the ADC requests. */
+static drv_status_t adc_dma_start(adc_t *h)
+{
+    drv_status_t rc;
+
+    h->xfer = (dma_xfer_t){
+        .periph = REG_ADDR(&h->adc->DR),
+        .mem0 = h->buf,
+        .count = (uint16_t)(2u * h->half_frames * h->nch),
+        .cb = adc_dma_event,
+        .ctx = h,
+    };
+    rc = dma_submit(h->dma, &h->xfer);
+    if (rc == DRV_OK) {
+        REG_SET_BITS(h->adc->CR2, ADC_CR2_DMA);
+    }
+    return rc;
+}
+
+static void adc_dma_stop(adc_t *h)
+{
+    /* Clearing CR2.DMA is what unblocks requests after an overrun. */
+    REG_CLR_BITS(h->adc->CR2, ADC_CR2_DMA);
+    dma_abort(h->dma);
+    /* Drop a result the stream never collected so it cannot flag OVR. */
+    (void)REG_READ(h->adc->DR);
+    REG_CLR_BITS(h->adc->SR, ADC_SR_OVR | ADC_SR_EOC | ADC_SR_STRT);
+}
+
+drv_status_t adc_start(adc_t *h)
+{
+    drv_status_t rc = adc_dma_start(h);
+
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_SET_BITS(h->adc->CR1, ADC_CR1_OVRIE);
+    if (h->tim == NULL) {
+        REG_SET_BITS(h->adc->CR2, ADC_CR2_SWSTART);
+        return DRV_OK;
+    }
+    REG_FIELD_WRITE(h->adc->CR2, ADC_CR2_EXTEN, ADC_EXTEN_RISING);
+    REG_WRITE(h->tim->CNT, 0u);
+    REG_SET_BITS(h->tim->CR1, TIM_CR1_CEN);
+    return DRV_OK;
+}
+
+void adc_stop(adc_t *h)
+{
+    if (h->tim != NULL) {
+        REG_CLR_BITS(h->tim->CR1, TIM_CR1_CEN);
+    }
+    REG_FIELD_WRITE(h->adc->CR2, ADC_CR2_EXTEN, ADC_EXTEN_OFF);
+    REG_CLR_BITS(h->adc->CR1, ADC_CR1_OVRIE);
+    adc_dma_stop(h);
+}
+
+void adc_deinit(adc_t *h)
+{
+    adc_stop(h);
+    dma_free(h->dma);
+    REG_WRITE(h->adc->CR2, 0u);
+    adc_handles[adc_hw_index(h->adc)] = NULL;
+}
+
+static void adc_recover(adc_t *h)
+{
+    h->overruns++;
+    adc_dma_stop(h);
+    (void)adc_dma_start(h);
+}
+
+void adc_irq(adc_t *h)
+{
+    if (REG_TEST_BITS(h->adc->SR, ADC_SR_OVR)) {
+        adc_recover(h);
+    }
+}
+
+void ADC_IRQHandler(void);
+void ADC_IRQHandler(void)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(adc_handles); i++) {
+        if (adc_handles[i] != NULL) {
+            adc_irq(adc_handles[i]);
+        }
+    }
+}
+
+static void adc_half(adc_t *h, uint32_t half)
+{
+    uint16_t *p = h->buf + half * h->half_frames * h->nch;
+    uint32_t n = adc_decimate(p, h->nch, h->half_frames, h->decim);
+
+    if (h->cb != NULL) {
+        h->cb(h->ctx, p, n);
+    }
+}
+
+static void adc_dma_event(void *ctx, uint32_t events)
+{
+    adc_t *h = ctx;
+
+    if ((events & (DMA_FLAG_TEIF | DMA_FLAG_DMEIF)) != 0u) {
+        adc_recover(h);
+        return;
+    }
+    if ((events & DMA_FLAG_HTIF) != 0u) {
+        adc_half(h, 0);
+    }
+    if ((events & DMA_FLAG_TCIF) != 0u) {
+        adc_half(h, 1);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Decimation kernels                                                       */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Two channels per 32-bit word: one load, one add and one store serve two
+ * samples, like a 16-bit SIMD add, but in plain C so it needs no intrinsics
+ * and is the same code on the host.  No lane can carry into its neighbour
+ * while factor <= ADC_SWAR_MAX_DECIM.  Words go through memcpy, which
+ * compilers turn into single (unaligned-capable) loads and stores.
+ */
+static void adc_decimate_pairs(uint16_t *buf, uint32_t nch, uint32_t out, uint32_t factor)
+{
+    const uint32_t words = nch / 2u;
+    const uint32_t round = (factor / 2u) * 0x00010001u;
+    uint32_t acc[ADC_MAX_CHANNELS / 2u];
+    const uint16_t *src = buf;
+    uint16_t *dst = buf;
+    uint32_t shift = 0;
+    bool pow2;
+    uint32_t o;
+    uint32_t f;
+    uint32_t k;
+
+    while ((1u << shift) < factor) {
+        shift++;
+    }
+    pow2 = (1u << shift) == factor;
+    for (o = 0; o < out; o++) {
+        for (k = 0; k < words; k++) {
+            acc[k] = round;
+        }
+        for (f = 0; f < factor; f++) {
+            for (k = 0; k < words; k++) {
+                uint32_t v;
+
+                memcpy(&v, src + 2u * k, sizeof(v));
+                acc[k] += v;
+            }
+            src += nch;
+        }
+        for (k = 0; k < words; k++) {
+            uint32_t v;
+
+            if (pow2) {
+                /* Both lanes at once; bits shifted across the lane
+                 * boundary are masked off. */
+                v = (acc[k] >> shift) & ((0xFFFFu >> shift) * 0x00010001u);
+            } else {
+                v = ((acc[k] & 0xFFFFu) / factor) | (((acc[k] >> 16) / factor) << 16);
+            }
+            memcpy(dst + 2u * k, &v, sizeof(v));
+        }
+        dst += nch;
+    }
+}
+
+static void adc_decimate_scalar(uint16_t *buf, uint32_t nch, uint32_t out, uint32_t factor)
+{
+    uint32_t acc[ADC_MAX_CHANNELS];
+    const uint16_t *src = buf;
+    uint16_t *dst = buf;
+    uint32_t o;
+    uint32_t f;
+    uint32_t c;
+
+    for (o = 0; o < out; o++) {
+        for (c = 0; c < nch; c++) {
+            acc[c] = factor / 2u;
+        }
+        for (f = 0; f < factor; f++) {
+            for (c = 0; c < nch; c++) {
+                acc[c] += src[c];
+            }
+            src += nch;
+        }
+        for (c = 0; c < nch; c++) {
+            dst[c] = (uint16_t)(acc[c] / factor);
+        }
+        dst += nch;
+    }
+}
+
+uint32_t adc_decimate(uint16_t *buf, uint32_t nch, uint32_t frames, uint32_t factor)
+{
+    uint32_t out;
+
+    if (factor <= 1u || nch == 0u || nch > ADC_MAX_CHANNELS) {
+        return frames;
+    }
+    out = frames / factor;
+    /* Output frame o only overwrites input already consumed. */
+    if ((nch & 1u) == 0u && factor <= ADC_SWAR_MAX_DECIM) {
+        adc_decimate_pairs(buf, nch, out, factor);
+    } else {
+        adc_decimate_scalar(buf, nch, out, factor);
+    }
+    return out;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file    bench.c
+ * @brief   Cycle-count benchmark harness.
+ */
+#include <stdio.h>
+
+#include "bench.h"
+
+#if defined(STM32_HOST) && !defined(__x86_64__) && !defined(__i386__)
+#include <time.h>
+#endif
+
+static uint32_t bench_overhead;
+static uint32_t bench_samples[BENCH_MAX_SAMPLES];
+
+uint32_t bench_cycles(void)
+{
+#if !defined(STM32_HOST)
+    return REG_READ(DWT->CYCCNT);
+#elif defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+#endif
+}
+
+void bench_init(void)
+{
+    uint32_t i;
+    uint32_t t0;
+    uint32_t d;
+
+#if !defined(STM32_HOST)
+    REG_SET_BITS(COREDEBUG->DEMCR, COREDEBUG_DEMCR_TRCENA);
+#if defined(STM32F7)
+    REG_WRITE(DWT->LAR, DWT_LAR_UNLOCK);
+#endif
+    REG_WRITE(DWT->CYCCNT, 0u);
+    REG_SET_BITS(DWT->CTRL, DWT_CTRL_CYCCNTENA);
+#endif
+
+    bench_overhead = UINT32_MAX;
+    for (i = 0; i < 64u; i++) {
+        t0 = bench_cycles();
+        d = bench_cycles() - t0;
+        if (d < bench_overhead) {
+            bench_overhead = d;
+        }
+    }
+}
+
+static void bench_sort(uint32_t *v, uint32_t n)
+{
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 1; i < n; i++) {
+        uint32_t x = v[i];
+
+        for (j = i; j > 0u && v[j - 1u] > x; j--) {
+            v[j] = v[j - 1u];
+        }
+        v[j] = x;
+    }
+}
+
+void bench_run(const bench_case_t *c, uint32_t samples, bench_result_t *out)
+{
+    uint32_t i;
+
+    if (samples == 0u || samples > BENCH_MAX_SAMPLES) {
+        samples = BENCH_MAX_SAMPLES;
+    }
+    if (c->setup != NULL) {
+        c->setup();
+    }
+    /* One untimed call warms caches and branch predictors. */
+    c->run();
+    for (i = 0; i < samples; i++) {
+        uint32_t t0 = bench_cycles();
+        uint32_t d;
+
+        c->run();
+        d = bench_cycles() - t0;
+        bench_samples[i] = (d > bench_overhead) ? d - bench_overhead : 0u;
+    }
+    bench_sort(bench_samples, samples);
+    out->min = bench_samples[0];
+    out->median = bench_samples[samples / 2u];
+    out->max = bench_samples[samples - 1u];
+}
+
+void bench_run_table(const bench_case_t *cases, uint32_t count, uint32_t samples)
+{
+    char line[96];
+    bench_result_t r;
+    uint32_t i;
+
+    snprintf(line, sizeof(line), "%-28s %10s %10s %10s", "benchmark", "min", "median", "max");
+    bench_puts(line);
+    for (i = 0; i < count; i++) {
+        bench_run(&cases[i], samples, &r);
+        snprintf(line, sizeof(line), "%-28s %10lu %10lu %10lu", cases[i].name,
+                 (unsigned long)r.min, (unsigned long)r.median, (unsigned long)r.max);
+        bench_puts(line);
+    }
+}
+
+STM32_WEAK void bench_puts(const char *line)
+{
+#if defined(STM32_HOST)
+    puts(line);
+#else
+    (void)line;
+#endif
+}
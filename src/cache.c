@@ -0,0 +1,146 @@
+/**
+ * @file    cache.c
+ * @brief   Flash accelerator and L1 cache enable, cache maintenance by range.
+ */
+#include "cache.h"
+
+#if defined(STM32F7)
+
+/*
+ * The ART accelerator serves fetches over the ITCM flash interface
+ * (0x00200000); code linked at 0x08000000 goes over AXI and is served by
+ * the L1 I-cache instead.  Both are enabled so either link address runs
+ * at full speed.  The ART may only be reset while it is disabled.
+ */
+static void cache_flash_init(void)
+{
+    uint32_t acr = REG_READ(FLASH->ACR) & ~(FLASH_ACR_ARTEN | FLASH_ACR_PRFTEN);
+
+    REG_WRITE(FLASH->ACR, acr);
+    REG_WRITE(FLASH->ACR, acr | FLASH_ACR_ARTRST);
+    REG_WRITE(FLASH->ACR, acr);
+    REG_WRITE(FLASH->ACR, acr | FLASH_ACR_ARTEN | FLASH_ACR_PRFTEN);
+}
+
+static void cache_icache_init(void)
+{
+    if (REG_TEST_BITS(SCB->CCR, SCB_CCR_IC)) {
+        return;
+    }
+    stm32_dsb();
+    stm32_isb();
+    REG_WRITE(SCB->ICIALLU, 0u);
+    stm32_dsb();
+    stm32_isb();
+    REG_SET_BITS(SCB->CCR, SCB_CCR_IC);
+    stm32_dsb();
+    stm32_isb();
+}
+
+static void cache_dcache_init(void)
+{
+    uint32_t ccsidr;
+    uint32_t set;
+    uint32_t way;
+
+    if (REG_TEST_BITS(SCB->CCR, SCB_CCR_DC)) {
+        return;
+    }
+    /* Contents are undefined out of reset: invalidate every line first. */
+    REG_WRITE(SCB->CSSELR, 0u);
+    stm32_dsb();
+    ccsidr = REG_READ(SCB->CCSIDR);
+    for (set = 0; set <= reg_field_get(ccsidr, SCB_CCSIDR_NUMSETS); set++) {
+        for (way = 0; way <= reg_field_get(ccsidr, SCB_CCSIDR_ASSOC); way++) {
+            REG_WRITE(SCB->DCISW, SCB_DCSW(set, way));
+        }
+    }
+    stm32_dsb();
+    REG_SET_BITS(SCB->CCR, SCB_CCR_DC);
+    stm32_dsb();
+    stm32_isb();
+}
+
+void cache_init(void)
+{
+    cache_flash_init();
+    cache_icache_init();
+    cache_dcache_init();
+}
+
+static void cache_by_line(volatile uint32_t *op, uint32_t start, uint32_t end)
+{
+    uint32_t a;
+
+    for (a = start & ~(STM32_CACHE_LINE - 1u); a < end; a += STM32_CACHE_LINE) {
+        REG_WRITE(*op, a);
+    }
+}
+
+void cache_clean(const void *p, size_t len)
+{
+    uint32_t start = REG_ADDR(p);
+
+    if (len == 0u) {
+        return;
+    }
+    stm32_dsb();
+    cache_by_line(&SCB->DCCMVAC, start, start + (uint32_t)len);
+    stm32_dsb();
+}
+
+void cache_invalidate(void *p, size_t len)
+{
+    const uint32_t mask = STM32_CACHE_LINE - 1u;
+    uint32_t start = REG_ADDR(p);
+    uint32_t end = start + (uint32_t)len;
+
+    if (len == 0u) {
+        return;
+    }
+    stm32_dsb();
+    if ((start & mask) != 0u) {
+        REG_WRITE(SCB->DCCIMVAC, start & ~mask);
+        start = (start & ~mask) + STM32_CACHE_LINE;
+    }
+    if ((end & mask) != 0u && (end & ~mask) >= start) {
+        end &= ~mask;
+        REG_WRITE(SCB->DCCIMVAC, end);
+    }
+    cache_by_line(&SCB->DCIMVAC, start, end);
+    stm32_dsb();
+    stm32_isb();
+}
+
+void cache_clean_invalidate(const void *p, size_t len)
+{
+    uint32_t start = REG_ADDR(p);
+
+    if (len == 0u) {
+        return;
+    }
+    stm32_dsb();
+    cache_by_line(&SCB->DCCIMVAC, start, start + (uint32_t)len);
+    stm32_dsb();
+    stm32_isb();
+}
+
+#else /* STM32F4 */
+
+/*
+ * The F4 flash interface has a 64 x 128-bit instruction cache, an 8 x
+ * 128-bit data cache (literal pools) and prefetch.  The caches may only be
+ * reset while they are disabled.
+ */
+void cache_init(void)
+{
+    uint32_t acr = REG_READ(FLASH->ACR) &
+                   ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN | FLASH_ACR_PRFTEN);
+
+    REG_WRITE(FLASH->ACR, acr);
+    REG_WRITE(FLASH->ACR, acr | FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+    REG_WRITE(FLASH->ACR, acr);
+    REG_WRITE(FLASH->ACR, acr | FLASH_ACR_ICEN | FLASH_ACR_DCEN | FLASH_ACR_PRFTEN);
+}
+
+#endif /* STM32F7 */
@@ -0,0 +1,800 @@
+/**
+ * @file    can.c
+ * @brief   bxCAN driver: compiled acceptance filters, interrupt-drained
+ *          receive queue and priority-ordered transmit.
+ */
+#include <string.h>
+
+#include "can.h"
+#include "rcc.h"
+
+/* Polls of MSR for a mode change (11 recessive bits at 10 kbit/s ~ 1 ms). */
+#define CAN_MODE_TIMEOUT    1000000u
+
+#define CAN_TSR_RQCP_ALL    (CAN_TSR_RQCP(0) | CAN_TSR_RQCP(1) | CAN_TSR_RQCP(2))
+
+/* Filter element classes, in the order their banks are laid out. */
+enum {
+    CAN_CLS_EXT_MASK = 0,   /* 32-bit mask: one per bank. */
+    CAN_CLS_EXT_LIST,       /* 32-bit list: two per bank. */
+    CAN_CLS_STD_MASK,       /* 16-bit mask: two per bank. */
+    CAN_CLS_STD_LIST,       /* 16-bit list: four per bank. */
+    CAN_CLS_COUNT
+};
+
+typedef struct {
+    uint32_t id;
+    uint32_t mask;
+    uint8_t flags;
+    uint8_t fifo;
+    uint8_t entry;          /* Index in the caller's list, or CAN_FMI_CHECK. */
+} can_elem_t;
+
+typedef struct {
+    can_regs_t *can;
+    uint32_t en;
+    uint8_t first_bank;
+} can_hw_t;
+
+static const can_hw_t can_hw[] = {
+    { CAN1, RCC_APB1ENR_CAN1EN, 0u },
+    { CAN2, RCC_APB1ENR_CAN2EN, CAN_BANKS_PER_PORT },
+};
+
+/* Handles by instance, for the interrupt handlers. */
+static can_t *can_handles[STM32_ARRAY_SIZE(can_hw)];
+
+static size_t can_hw_index(const can_regs_t *can)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(can_hw); i++) {
+        if (can_hw[i].can == can) {
+            break;
+        }
+    }
+    return i;
+}
+
+STM32_INLINE uint32_t can_id_mask(uint32_t flags)
+{
+    return ((flags & CAN_FRAME_EXT) != 0u) ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK;
+}
+
+/* TIR/RIR image of an identifier: also its rank in bus arbitration. */
+STM32_INLINE uint32_t can_ir32(uint32_t id, uint32_t flags)
+{
+    uint32_t ir = ((flags & CAN_FRAME_RTR) != 0u) ? CAN_IR_RTR : 0u;
+
+    if ((flags & CAN_FRAME_EXT) != 0u) {
+        return ir | CAN_IR_IDE | (id << 3);
+    }
+    return ir | (id << 21);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Bit timing                                                               */
+/* ------------------------------------------------------------------------ */
+
+drv_status_t can_timing(uint32_t pclk_hz, uint32_t bitrate, uint32_t sample_permille,
+                        uint32_t *btr)
+{
+    uint32_t best_err = UINT32_MAX;
+    uint32_t tq;
+
+    if (bitrate == 0u || btr == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    if (sample_permille == 0u) {
+        sample_permille = 875u;
+    }
+    /* More quanta per bit first: finer sample point and resynchronisation. */
+    for (tq = 25u; tq >= 8u; tq--) {
+        uint32_t brp;
+        uint32_t seg;
+        uint32_t ts2;
+        uint32_t sp;
+        uint32_t err;
+
+        if ((uint64_t)bitrate * tq > pclk_hz || pclk_hz % (bitrate * tq) != 0u) {
+            continue;
+        }
+        brp = pclk_hz / (bitrate * tq);
+        /* Quanta up to the sample point: SYNC_SEG + TS1. */
+        seg = (tq * sample_permille + 500u) / 1000u;
+        if (seg > 17u) {
+            seg = 17u;
+        }
+        if (seg + 8u < tq) {
+            seg = tq - 8u;
+        }
+        if (brp > 1024u || seg < 2u || seg >= tq) {
+            continue;
+        }
+        ts2 = tq - seg;
+        sp = 1000u * seg / tq;
+        err = (sp > sample_permille) ? sp - sample_permille : sample_permille - sp;
+        if (err < best_err) {
+            best_err = err;
+            *btr = reg_field_prep(CAN_BTR_BRP, brp - 1u) |
+                   reg_field_prep(CAN_BTR_TS1, seg - 2u) |
+                   reg_field_prep(CAN_BTR_TS2, ts2 - 1u) |
+                   reg_field_prep(CAN_BTR_SJW, ((ts2 < 4u) ? ts2 : 4u) - 1u);
+        }
+    }
+    return (best_err == UINT32_MAX) ? DRV_ERR_PARAM : DRV_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Filter compiler                                                          */
+/* ------------------------------------------------------------------------ */
+
+/* Whether @p a accepts every frame @p b does (and sends it to the same FIFO). */
+static bool can_elem_covers(const can_elem_t *a, const can_elem_t *b)
+{
+    return a->fifo == b->fifo && a->flags == b->flags &&
+           (a->mask & ~b->mask) == 0u && ((a->id ^ b->id) & a->mask) == 0u;
+}
+
+/* Drop elements another one covers; of identical ones the first stays. */
+static size_t can_elems_reduce(can_elem_t *e, size_t n)
+{
+    size_t i = 0;
+    size_t j;
+
+    while (i < n) {
+        for (j = 0; j < n; j++) {
+            if (j != i && can_elem_covers(&e[j], &e[i]) &&
+                (j < i || !can_elem_covers(&e[i], &e[j]))) {
+                break;
+            }
+        }
+        if (j < n) {
+            memmove(&e[i], &e[i + 1u], (n - i - 1u) * sizeof(e[0]));
+            n--;
+        } else {
+            i++;
+        }
+    }
+    return n;
+}
+
+static uint32_t can_elem_class(const can_elem_t *e)
+{
+    bool exact = (e->mask == can_id_mask(e->flags));
+
+    if ((e->flags & CAN_FRAME_EXT) != 0u) {
+        return exact ? CAN_CLS_EXT_LIST : CAN_CLS_EXT_MASK;
+    }
+    return exact ? CAN_CLS_STD_LIST : CAN_CLS_STD_MASK;
+}
+
+static void can_elems_count(const can_elem_t *e, size_t n, uint32_t fifo,
+                            uint32_t count[CAN_CLS_COUNT])
+{
+    size_t i;
+
+    memset(count, 0, CAN_CLS_COUNT * sizeof(count[0]));
+    for (i = 0; i < n; i++) {
+        if (e[i].fifo == fifo) {
+            count[can_elem_class(&e[i])]++;
+        }
+    }
+}
+
+/*
+ * Banks for @p e packed densely.  The odd slot of a 32-bit list bank or a
+ * 16-bit mask bank takes a standard identifier, if there is one.
+ */
+static uint32_t can_elems_banks(const can_elem_t *e, size_t n)
+{
+    uint32_t banks = 0;
+    uint32_t fifo;
+
+    for (fifo = 0; fifo < CAN_RX_FIFOS; fifo++) {
+        uint32_t c[CAN_CLS_COUNT];
+        uint32_t spare;
+        uint32_t std;
+
+        can_elems_count(e, n, fifo, c);
+        spare = (c[CAN_CLS_EXT_LIST] & 1u) + (c[CAN_CLS_STD_MASK] & 1u);
+        std = (c[CAN_CLS_STD_LIST] > spare) ? c[CAN_CLS_STD_LIST] - spare : 0u;
+        banks += c[CAN_CLS_EXT_MASK] + (c[CAN_CLS_EXT_LIST] + 1u) / 2u +
+                 (c[CAN_CLS_STD_MASK] + 1u) / 2u + (std + 3u) / 4u;
+    }
+    return banks;
+}
+
+/*
+ * Merge the two compatible elements whose union keeps the most identifier
+ * bits, i.e. lets the fewest unwanted identifiers through.  False if no
+ * two elements are compatible.
+ */
+static bool can_elems_merge(can_elem_t *e, size_t *n)
+{
+    int best = -1;
+    size_t bi = 0;
+    size_t bj = 0;
+    uint32_t best_mask = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < *n; i++) {
+        for (j = i + 1u; j < *n; j++) {
+            uint32_t m;
+            int score;
+
+            if (e[i].fifo != e[j].fifo || e[i].flags != e[j].flags) {
+                continue;
+            }
+            m = e[i].mask & e[j].mask & ~(e[i].id ^ e[j].id);
+            score = __builtin_popcount(m);
+            if (score > best) {
+                best = score;
+                best_mask = m;
+                bi = i;
+                bj = j;
+            }
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+    e[bi].mask = best_mask;
+    e[bi].id &= best_mask;
+    e[bi].entry = CAN_FMI_CHECK;
+    memmove(&e[bj], &e[bj + 1u], (*n - bj - 1u) * sizeof(e[0]));
+    *n = can_elems_reduce(e, *n - 1u);
+    return true;
+}
+
+/* 16-bit images: STID[10:0] RTR IDE EXID[17:15]; the mask tests RTR and IDE. */
+STM32_INLINE uint32_t can_f16(const can_elem_t *e)
+{
+    return (e->id << CAN_F16_STID_SHIFT) | (((e->flags & CAN_FRAME_RTR) != 0u) ? CAN_F16_RTR : 0u);
+}
+
+STM32_INLINE uint32_t can_f16_mask(const can_elem_t *e)
+{
+    return (e->mask << CAN_F16_STID_SHIFT) | CAN_F16_RTR | CAN_F16_IDE;
+}
+
+static void can_plan_bank(can_filter_plan_t *plan, uint32_t fifo, bool wide, bool list,
+                          uint32_t fr1, uint32_t fr2, const can_elem_t *const *el, uint32_t nel)
+{
+    uint32_t b = plan->banks++;
+    uint32_t i;
+
+    plan->fm1r |= (uint16_t)((list ? 1u : 0u) << b);
+    plan->fs1r |= (uint16_t)((wide ? 1u : 0u) << b);
+    plan->ffa1r |= (uint16_t)(fifo << b);
+    plan->fr[b][0] = fr1;
+    plan->fr[b][1] = fr2;
+    for (i = 0; i < nel; i++) {
+        plan->map[fifo][plan->count[fifo]++] = el[i]->entry;
+    }
+}
+
+/* Lay out the banks of one FIFO; see can.h for the packing. */
+static void can_plan_fifo(can_filter_plan_t *plan, const can_elem_t *e, size_t n, uint32_t fifo)
+{
+    uint8_t cls[CAN_CLS_COUNT][CAN_FILTERS_MAX];
+    uint32_t c[CAN_CLS_COUNT] = { 0 };
+    uint32_t std = 0;       /* Next unplaced exact standard identifier. */
+    const can_elem_t *el[4];
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (e[i].fifo == fifo) {
+            uint32_t k = can_elem_class(&e[i]);
+
+            cls[k][c[k]++] = (uint8_t)i;
+        }
+    }
+
+    for (i = 0; i < c[CAN_CLS_EXT_MASK]; i++) {
+        el[0] = &e[cls[CAN_CLS_EXT_MASK][i]];
+        can_plan_bank(plan, fifo, true, false, can_ir32(el[0]->id, el[0]->flags),
+                      can_ir32(el[0]->mask, el[0]->flags) | CAN_IR_IDE | CAN_IR_RTR, el, 1u);
+    }
+    for (i = 0; i < c[CAN_CLS_EXT_LIST]; i += 2u) {
+        el[0] = &e[cls[CAN_CLS_EXT_LIST][i]];
+        if (i + 1u < c[CAN_CLS_EXT_LIST]) {
+            el[1] = &e[cls[CAN_CLS_EXT_LIST][i + 1u]];
+        } else if (std < c[CAN_CLS_STD_LIST]) {
+            el[1] = &e[cls[CAN_CLS_STD_LIST][std++]];
+        } else {
+            el[1] = el[0];
+        }
+        can_plan_bank(plan, fifo, true, true, can_ir32(el[0]->id, el[0]->flags),
+                      can_ir32(el[1]->id, el[1]->flags), el, 2u);
+    }
+    for (i = 0; i < c[CAN_CLS_STD_MASK]; i += 2u) {
+        el[0] = &e[cls[CAN_CLS_STD_MASK][i]];
+        if (i + 1u < c[CAN_CLS_STD_MASK]) {
+            el[1] = &e[cls[CAN_CLS_STD_MASK][i + 1u]];
+        } else if (std < c[CAN_CLS_STD_LIST]) {
+            el[1] = &e[cls[CAN_CLS_STD_LIST][std++]];
+        } else {
+            el[1] = el[0];
+        }
+        can_plan_bank(plan, fifo, false, false,
+                      can_f16(el[0]) | (can_f16_mask(el[0]) << 16),
+                      can_f16(el[1]) | (can_f16_mask(el[1]) << 16), el, 2u);
+    }
+    while (std < c[CAN_CLS_STD_LIST]) {
+        /* Unused slots repeat the last identifier of the bank. */
+        for (i = 0; i < 4u; i++) {
+            el[i] = &e[cls[CAN_CLS_STD_LIST][(std < c[CAN_CLS_STD_LIST]) ? std++ : std - 1u]];
+        }
+        can_plan_bank(plan, fifo, false, true, can_f16(el[0]) | (can_f16(el[1]) << 16),
+                      can_f16(el[2]) | (can_f16(el[3]) << 16), el, 4u);
+    }
+}
+
+drv_status_t can_filter_compile(const can_filter_t *filters, size_t n, uint32_t max_banks,
+                                can_filter_plan_t *plan)
+{
+    can_elem_t e[CAN_FILTERS_MAX];
+    size_t i;
+
+    if (plan == NULL || n > CAN_FILTERS_MAX || (n != 0u && filters == NULL) ||
+        max_banks > CAN_BANKS_PER_PORT) {
+        return DRV_ERR_PARAM;
+    }
+    for (i = 0; i < n; i++) {
+        uint32_t width = can_id_mask(filters[i].flags);
+
+        if ((filters[i].id & ~width) != 0u || filters[i].fifo >= CAN_RX_FIFOS ||
+            (filters[i].flags & ~(uint32_t)(CAN_FRAME_EXT | CAN_FRAME_RTR)) != 0u) {
+            return DRV_ERR_PARAM;
+        }
+        e[i].mask = filters[i].mask & width;
+        e[i].id = filters[i].id & e[i].mask;
+        e[i].flags = filters[i].flags;
+        e[i].fifo = filters[i].fifo;
+        e[i].entry = (uint8_t)i;
+    }
+    n = can_elems_reduce(e, n);
+    while (can_elems_banks(e, n) > max_banks) {
+        if (!can_elems_merge(e, &n)) {
+            return DRV_ERR_NORES;
+        }
+    }
+
+    memset(plan, 0, sizeof(*plan));
+    can_plan_fifo(plan, e, n, 0u);
+    can_plan_fifo(plan, e, n, 1u);
+    return DRV_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Receive                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/* First entry of the list that wants @p f; CAN_FMI_CHECK if none does. */
+static uint8_t can_filter_find(const can_t *h, const can_frame_t *f)
+{
+    uint32_t i;
+
+    for (i = 0; i < h->nfilters; i++) {
+        const can_filter_t *flt = &h->filters[i];
+
+        if (flt->fifo == f->fifo && flt->flags == f->flags &&
+            ((f->id ^ flt->id) & flt->mask & can_id_mask(flt->flags)) == 0u) {
+            return (uint8_t)i;
+        }
+    }
+    return CAN_FMI_CHECK;
+}
+
+/* Move every frame in FIFO @p fifo to the receive queue. */
+static void can_rx_drain(can_t *h, uint32_t fifo)
+{
+    can_regs_t *can = h->can;
+    volatile uint32_t *rfr = (fifo == 0u) ? &can->RF0R : &can->RF1R;
+    can_rx_mailbox_t *mb = &can->RX[fifo];
+    uint32_t r;
+
+    while (reg_field_get(r = REG_READ(*rfr), CAN_RFR_FMP) != 0u) {
+        uint32_t rir = REG_READ(mb->RIR);
+        uint32_t rdtr = REG_READ(mb->RDTR);
+        uint32_t data[2] = { REG_READ(mb->RDLR), REG_READ(mb->RDHR) };
+        uint32_t head = h->rx_head;
+        uint32_t fmi = reg_field_get(rdtr, CAN_DTR_FMI);
+        can_frame_t *f;
+
+        REG_WRITE(*rfr, CAN_RFR_RFOM);
+        /* The next frame is in the output mailbox once RFOM reads back 0. */
+        while (REG_TEST_BITS(*rfr, CAN_RFR_RFOM)) {
+        }
+        if (head - stm32_load_acquire(&h->rx_tail) > h->rx_mask) {
+            h->rx_dropped++;
+            continue;
+        }
+
+        f = &h->rx_buf[head & h->rx_mask];
+        if ((rir & CAN_IR_IDE) != 0u) {
+            f->id = reg_field_get(rir, CAN_IR_EXID);
+            f->flags = CAN_FRAME_EXT;
+        } else {
+            f->id = reg_field_get(rir, CAN_IR_STID);
+            f->flags = 0;
+        }
+        if ((rir & CAN_IR_RTR) != 0u) {
+            f->flags |= CAN_FRAME_RTR;
+        }
+        f->len = (uint8_t)reg_field_get(rdtr, CAN_DTR_DLC);
+        f->fifo = (uint8_t)fifo;
+        memcpy(f->data, data, sizeof(f->data));
+        f->filter = (fmi < CAN_FMI_MAX) ? h->map[fifo][fmi] : CAN_FMI_CHECK;
+        if (f->filter == CAN_FMI_CHECK) {
+            f->filter = can_filter_find(h, f);
+            if (f->filter == CAN_FMI_CHECK) {
+                h->rx_rejected++;
+                continue;
+            }
+        }
+        stm32_store_release(&h->rx_head, head + 1u);
+        h->rx_frames++;
+    }
+    if ((r & (CAN_RFR_FULL | CAN_RFR_FOVR)) != 0u) {
+        if ((r & CAN_RFR_FOVR) != 0u) {
+            h->rx_overruns++;
+        }
+        REG_WRITE(*rfr, r & (CAN_RFR_FULL | CAN_RFR_FOVR));
+    }
+}
+
+void can_rx_irq(can_t *h, uint32_t fifo)
+{
+    can_rx_drain(h, fifo);
+}
+
+bool can_recv(can_t *h, can_frame_t *f)
+{
+    uint32_t tail = h->rx_tail;
+
+    if (stm32_load_acquire(&h->rx_head) == tail) {
+        return false;
+    }
+    *f = h->rx_buf[tail & h->rx_mask];
+    stm32_store_release(&h->rx_tail, tail + 1u);
+    return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Transmit                                                                 */
+/* ------------------------------------------------------------------------ */
+
+STM32_INLINE bool can_tx_before(const can_tx_entry_t *a, const can_tx_entry_t *b)
+{
+    return a->key < b->key || (a->key == b->key && (int32_t)(a->seq - b->seq) < 0);
+}
+
+static void can_heap_push(can_t *h, const can_tx_entry_t *e)
+{
+    uint32_t i = h->txq_len++;
+
+    while (i != 0u) {
+        uint32_t parent = (i - 1u) / 2u;
+
+        if (!can_tx_before(e, &h->txq[parent])) {
+            break;
+        }
+        h->txq[i] = h->txq[parent];
+        i = parent;
+    }
+    h->txq[i] = *e;
+}
+
+static void can_heap_pop(can_t *h)
+{
+    const can_tx_entry_t *last = &h->txq[--h->txq_len];
+    uint32_t n = h->txq_len;
+    uint32_t i = 0;
+
+    for (;;) {
+        uint32_t child = 2u * i + 1u;
+
+        if (child >= n) {
+            break;
+        }
+        if (child + 1u < n && can_tx_before(&h->txq[child + 1u], &h->txq[child])) {
+            child++;
+        }
+        if (!can_tx_before(&h->txq[child], last)) {
+            break;
+        }
+        h->txq[i] = h->txq[child];
+        i = child;
+    }
+    h->txq[i] = *last;
+}
+
+/*
+ * All mailboxes are loaded and @p key waits: abort the lowest-priority
+ * mailbox if @p key outranks it.  One abort at a time; the transmit
+ * interrupt requeues the frame unless it made it onto the bus first.
+ */
+static void can_tx_preempt(can_t *h, uint32_t key)
+{
+    uint32_t worst = CAN_TX_MAILBOXES;
+    uint32_t n;
+
+    if (h->mb_abort != 0u) {
+        return;
+    }
+    for (n = 0; n < CAN_TX_MAILBOXES; n++) {
+        if ((h->mb_busy & (1u << n)) != 0u &&
+            (worst == CAN_TX_MAILBOXES || h->mailbox[n].key > h->mailbox[worst].key)) {
+            worst = n;
+        }
+    }
+    if (worst != CAN_TX_MAILBOXES && key < h->mailbox[worst].key) {
+        h->mb_abort = (uint8_t)(1u << worst);
+        REG_WRITE(h->can->TSR, CAN_TSR_ABRQ(worst));
+    }
+}
+
+/* Move frames from the heap into empty mailboxes.  Interrupts masked. */
+static void can_tx_load(can_t *h)
+{
+    can_regs_t *can = h->can;
+
+    while (h->txq_len != 0u) {
+        const can_tx_entry_t *top = &h->txq[0];
+        uint32_t tsr = REG_READ(can->TSR);
+        can_tx_mailbox_t *mb;
+        uint32_t data[2];
+        uint32_t n;
+
+        /* Mailboxes go out by identifier: equal ones would swap order. */
+        for (n = 0; n < CAN_TX_MAILBOXES; n++) {
+            if ((h->mb_busy & (1u << n)) != 0u && h->mailbox[n].key == top->key) {
+                return;
+            }
+        }
+        if ((tsr & CAN_TSR_TME_ALL) == 0u) {
+            can_tx_preempt(h, top->key);
+            return;
+        }
+        n = reg_field_get(tsr, CAN_TSR_CODE);
+        mb = &can->TX[n];
+        memcpy(data, top->frame.data, sizeof(data));
+        REG_WRITE(mb->TDTR, top->frame.len);
+        REG_WRITE(mb->TDLR, data[0]);
+        REG_WRITE(mb->TDHR, data[1]);
+        REG_WRITE(mb->TIR, top->key | CAN_IR_TXRQ);
+        h->mailbox[n] = *top;
+        h->mb_busy |= (uint8_t)(1u << n);
+        can_heap_pop(h);
+    }
+}
+
+uint32_t can_tx_pending(const can_t *h)
+{
+    return h->txq_len + (uint32_t)__builtin_popcount(h->mb_busy);
+}
+
+drv_status_t can_send(can_t *h, const can_frame_t *f)
+{
+    can_tx_entry_t e;
+    uint32_t primask;
+    drv_status_t rc = DRV_OK;
+
+    if (h == NULL || f == NULL || f->len > 8u || (f->id & ~can_id_mask(f->flags)) != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    e.key = can_ir32(f->id, f->flags);
+    e.frame = *f;
+
+    primask = stm32_irq_save();
+    if (can_tx_pending(h) >= h->txq_size) {
+        rc = DRV_ERR_NORES;
+    } else {
+        e.seq = h->tx_seq++;
+        can_heap_push(h, &e);
+        can_tx_load(h);
+    }
+    stm32_irq_restore(primask);
+    return rc;
+}
+
+void can_tx_irq(can_t *h)
+{
+    uint32_t primask = stm32_irq_save();
+    uint32_t tsr = REG_READ(h->can->TSR);
+    uint32_t n;
+
+    /* Clears RQCP with TXOK, ALST and TERR. */
+    REG_WRITE(h->can->TSR, tsr & CAN_TSR_RQCP_ALL);
+    for (n = 0; n < CAN_TX_MAILBOXES; n++) {
+        uint8_t bit = (uint8_t)(1u << n);
+
+        if ((tsr & CAN_TSR_RQCP(n)) == 0u || (h->mb_busy & bit) == 0u) {
+            continue;
+        }
+        h->mb_busy &= (uint8_t)~bit;
+        h->mb_abort &= (uint8_t)~bit;
+        if ((tsr & CAN_TSR_TXOK(n)) != 0u) {
+            h->tx_frames++;
+        } else {
+            /* Aborted: back in line, ahead of later equal identifiers. */
+            can_heap_push(h, &h->mailbox[n]);
+            h->tx_requeued++;
+        }
+    }
+    can_tx_load(h);
+    stm32_irq_restore(primask);
+}
+
+void can_sce_irq(can_t *h)
+{
+    /* Acknowledge first: an error after the ESR read raises ERRI again. */
+    REG_WRITE(h->can->MSR, CAN_MSR_ERRI);
+    h->esr = REG_READ(h->can->ESR);
+    h->errors++;
+    REG_FIELD_WRITE(h->can->ESR, CAN_ESR_LEC, 0u);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Setup                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static drv_status_t can_mode_wait(can_regs_t *can, uint32_t mask, uint32_t want)
+{
+    uint32_t n;
+
+    for (n = 0; n < CAN_MODE_TIMEOUT; n++) {
+        if ((REG_READ(can->MSR) & mask) == want) {
+            return DRV_OK;
+        }
+    }
+    return DRV_ERR_TIMEOUT;
+}
+
+/* Load @p plan into the banks from @p first on, in filter init mode. */
+static void can_filters_load(uint32_t first, const can_filter_plan_t *plan)
+{
+    const uint32_t range = ((1u << CAN_BANKS_PER_PORT) - 1u) << first;
+    uint32_t b;
+
+    REG_SET_BITS(CAN1->FMR, CAN_FMR_FINIT);
+    REG_FIELD_WRITE(CAN1->FMR, CAN_FMR_CAN2SB, CAN_BANKS_PER_PORT);
+    REG_CLR_BITS(CAN1->FA1R, range);
+    REG_MODIFY(CAN1->FM1R, range, (uint32_t)plan->fm1r << first);
+    REG_MODIFY(CAN1->FS1R, range, (uint32_t)plan->fs1r << first);
+    REG_MODIFY(CAN1->FFA1R, range, (uint32_t)plan->ffa1r << first);
+    for (b = 0; b < plan->banks; b++) {
+        REG_WRITE(CAN1->FB[first + b].FR1, plan->fr[b][0]);
+        REG_WRITE(CAN1->FB[first + b].FR2, plan->fr[b][1]);
+    }
+    REG_SET_BITS(CAN1->FA1R, ((1u << plan->banks) - 1u) << first);
+    REG_CLR_BITS(CAN1->FMR, CAN_FMR_FINIT);
+}
+
+drv_status_t can_filters_set(can_t *h, const can_filter_t *filters, size_t n)
+{
+    can_filter_plan_t plan;
+    uint32_t primask;
+    drv_status_t rc;
+
+    if (h == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    rc = can_filter_compile(filters, n, CAN_BANKS_PER_PORT, &plan);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    primask = stm32_irq_save();
+    can_rx_drain(h, 0u);
+    can_rx_drain(h, 1u);
+    can_filters_load(h->first_bank, &plan);
+    memcpy(h->map, plan.map, sizeof(h->map));
+    h->filters = filters;
+    h->nfilters = (uint8_t)n;
+    stm32_irq_restore(primask);
+    return DRV_OK;
+}
+
+drv_status_t can_init(can_t *h, can_regs_t *can, const can_config_t *cfg)
+{
+    static const can_filter_plan_t none = { 0 };
+    size_t idx = can_hw_index(can);
+    uint32_t btr;
+    drv_status_t rc;
+
+    if (h == NULL || cfg == NULL || idx == STM32_ARRAY_SIZE(can_hw) ||
+        cfg->rx_buf == NULL || cfg->rx_size == 0u || (cfg->rx_size & (cfg->rx_size - 1u)) != 0u ||
+        cfg->tx_buf == NULL || cfg->tx_size == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    rc = can_timing(rcc_current()->pclk1_hz, cfg->bitrate, cfg->sample_permille, &btr);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    if (cfg->loopback) {
+        btr |= CAN_BTR_LBKM;
+    }
+    if (cfg->silent) {
+        btr |= CAN_BTR_SILM;
+    }
+
+    memset(h, 0, sizeof(*h));
+    h->can = can;
+    h->first_bank = can_hw[idx].first_bank;
+    h->rx_buf = cfg->rx_buf;
+    h->rx_mask = cfg->rx_size - 1u;
+    h->txq = cfg->tx_buf;
+    h->txq_size = cfg->tx_size;
+
+    /* The filter banks sit in CAN1. */
+    REG_SET_BITS(RCC->APB1ENR, can_hw[idx].en | RCC_APB1ENR_CAN1EN);
+    REG_WRITE(can->MCR, CAN_MCR_INRQ | CAN_MCR_DBF);
+    rc = can_mode_wait(can, CAN_MSR_INAK | CAN_MSR_SLAK, CAN_MSR_INAK);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    /* Bus-off recovery in hardware, mailboxes by identifier, overrun keeps the newest. */
+    REG_WRITE(can->MCR, CAN_MCR_INRQ | CAN_MCR_DBF | CAN_MCR_ABOM);
+    REG_WRITE(can->BTR, btr);
+    REG_WRITE(can->IER, CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FOVIE0 |
+                        CAN_IER_FMPIE1 | CAN_IER_FOVIE1 | CAN_IER_EWGIE |
+                        CAN_IER_EPVIE | CAN_IER_BOFIE | CAN_IER_ERRIE);
+    can_filters_load(h->first_bank, &none);
+    can_handles[idx] = h;
+
+    REG_WRITE(can->MCR, CAN_MCR_DBF | CAN_MCR_ABOM);
+    return can_mode_wait(can, CAN_MSR_INAK, 0u);
+}
+
+void can_deinit(can_t *h)
+{
+    size_t idx = can_hw_index(h->can);
+    uint32_t primask;
+
+    REG_WRITE(h->can->IER, 0u);
+    REG_WRITE(h->can->MCR, CAN_MCR_SLEEP | CAN_MCR_DBF);
+    primask = stm32_irq_save();
+    h->txq_len = 0;
+    h->mb_busy = 0;
+    h->mb_abort = 0;
+    if (idx < STM32_ARRAY_SIZE(can_hw)) {
+        can_handles[idx] = NULL;
+    }
+    stm32_irq_restore(primask);
+}
+
+#define CAN_IRQ_HANDLERS(n)                                                 \
+    void CAN##n##_TX_IRQHandler(void);                                      \
+    void CAN##n##_TX_IRQHandler(void)                                       \
+    {                                                                       \
+        if (can_handles[(n) - 1] != NULL) {                                 \
+            can_tx_irq(can_handles[(n) - 1]);                               \
+        }                                                                   \
+    }                                                                       \
+    void CAN##n##_RX0_IRQHandler(void);                                     \
+    void CAN##n##_RX0_IRQHandler(void)                                      \
+    {                                                                       \
+        if (can_handles[(n) - 1] != NULL) {                                 \
+            can_rx_irq(can_handles[(n) - 1], 0u);                           \
+        }                                                                   \
+    }                                                                       \
+    void CAN##n##_RX1_IRQHandler(void);                                     \
+    void CAN##n##_RX1_IRQHandler(void)                                      \
+    {                                                                       \
+        if (can_handles[(n) - 1] != NULL) {                                 \
+            can_rx_irq(can_handles[(n) - 1], 1u);                           \
+        }                                                                   \
+    }                                                                       \
+    void CAN##n##_SCE_IRQHandler(void);                                     \
+    void CAN##n##_SCE_IRQHandler(void)                                      \
+    {                                                                       \
+        if (can_handles[(n) - 1] != NULL) {                                 \
+            can_sce_irq(can_handles[(n) - 1]);                              \
+        }                                                                   \
+    }
+
+CAN_IRQ_HANDLERS(1)
+CAN_IRQ_HANDLERS(2)
@@ -0,0 +1,393 @@
+/**
+ * @file    crc.c
+ * @brief   32-bit CRC: hardware unit with DMA feed, slicing-by-8 fallback.
+ */
+#include <string.h>
+
+#include "crc.h"
+
+/* The host build without the simulator has RAM where the unit would be. */
+#if defined(STM32_HOST) && !defined(STM32_SIM)
+#define CRC_HW_PRESENT      0
+#else
+#define CRC_HW_PRESENT      1
+#endif
+
+#define CRC_DMA_CHUNK_WORDS 0xFFFFu     /* NDTR limit per descriptor. */
+
+const crc_spec_t crc_spec_crc32 = {
+    0x04C11DB7u, 0xFFFFFFFFu, 0xFFFFFFFFu, CRC_ORDER_LSB,
+};
+const crc_spec_t crc_spec_crc32c = {
+    0x1EDC6F41u, 0xFFFFFFFFu, 0xFFFFFFFFu, CRC_ORDER_LSB,
+};
+const crc_spec_t crc_spec_mpeg2 = {
+    0x04C11DB7u, 0xFFFFFFFFu, 0x00000000u, CRC_ORDER_MSB,
+};
+const crc_spec_t crc_spec_stm32 = {
+    CRC_POLY_DEFAULT, CRC_INIT_DEFAULT, 0x00000000u, CRC_ORDER_WORD,
+};
+
+static volatile bool crc_unit_busy;
+
+static void crc_dma_event(void *ctx, uint32_t events);
+
+STM32_INLINE uint32_t crc_rbit(uint32_t v)
+{
+#if defined(__arm__)
+    __asm ("rbit %0, %1" : "=r" (v) : "r" (v));
+    return v;
+#else
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+    return __builtin_bswap32(v);
+#endif
+}
+
+STM32_INLINE uint32_t crc_load32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Software engine                                                          */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t crc_bit_byte(const crc_spec_t *s, uint32_t crc, uint8_t b)
+{
+    uint32_t i;
+
+    if (s->order == CRC_ORDER_LSB) {
+        const uint32_t rpoly = crc_rbit(s->poly);
+
+        crc ^= b;
+        for (i = 0; i < 8u; i++) {
+            crc = (crc >> 1) ^ (rpoly & (0u - (crc & 1u)));
+        }
+    } else {
+        crc ^= (uint32_t)b << 24;
+        for (i = 0; i < 8u; i++) {
+            crc = (crc << 1) ^ (s->poly & (0u - (crc >> 31)));
+        }
+    }
+    return crc;
+}
+
+static void crc_table_fill(crc_table_t *t, const crc_spec_t *s)
+{
+    const bool lsb = (s->order == CRC_ORDER_LSB);
+    uint32_t b;
+    uint32_t k;
+
+    for (b = 0; b < 256u; b++) {
+        t->t[0][b] = crc_bit_byte(s, 0u, (uint8_t)b);
+    }
+    /* t[k][b]: byte b followed by k zero bytes. */
+    for (k = 1; k < 8u; k++) {
+        for (b = 0; b < 256u; b++) {
+            uint32_t v = t->t[k - 1u][b];
+
+            t->t[k][b] = lsb ? (v >> 8) ^ t->t[0][v & 0xFFu]
+                             : (v << 8) ^ t->t[0][v >> 24];
+        }
+    }
+}
+
+STM32_INLINE uint32_t crc_tab_byte(const crc_table_t *t, bool lsb, uint32_t crc, uint8_t b)
+{
+    return lsb ? t->t[0][(crc ^ b) & 0xFFu] ^ (crc >> 8)
+               : t->t[0][(crc >> 24) ^ b] ^ (crc << 8);
+}
+
+/* Feed the bytes of a CRC_ORDER_WORD word, most significant first. */
+static uint32_t crc_sw_word(const crc_t *h, uint32_t crc, uint32_t w)
+{
+    int32_t sh;
+
+    for (sh = 24; sh >= 0; sh -= 8) {
+        uint8_t b = (uint8_t)(w >> sh);
+
+        crc = (h->table != NULL) ? crc_tab_byte(h->table, false, crc, b)
+                                 : crc_bit_byte(&h->spec, crc, b);
+    }
+    return crc;
+}
+
+/*
+ * Advance register @p crc over @p len bytes.  With a table, eight bytes per
+ * step: the first word is folded into the register and both words are
+ * looked up independently, so the eight loads do not depend on each other.
+ */
+static uint32_t crc_sw_update(const crc_t *h, uint32_t crc, const uint8_t *p, size_t len)
+{
+    const crc_table_t *t = h->table;
+    const crc_order_t order = h->spec.order;
+    const bool lsb = (order == CRC_ORDER_LSB);
+
+    if (t != NULL) {
+        for (; len >= 8u; p += 8, len -= 8u) {
+            uint32_t w0 = crc_load32(p);
+            uint32_t w1 = crc_load32(p + 4);
+
+            if (lsb) {
+                crc ^= w0;
+                crc = t->t[7][crc & 0xFFu] ^ t->t[6][(crc >> 8) & 0xFFu] ^
+                      t->t[5][(crc >> 16) & 0xFFu] ^ t->t[4][crc >> 24] ^
+                      t->t[3][w1 & 0xFFu] ^ t->t[2][(w1 >> 8) & 0xFFu] ^
+                      t->t[1][(w1 >> 16) & 0xFFu] ^ t->t[0][w1 >> 24];
+                continue;
+            }
+            if (order == CRC_ORDER_MSB) {
+                w0 = __builtin_bswap32(w0);
+                w1 = __builtin_bswap32(w1);
+            }
+            crc ^= w0;
+            crc = t->t[7][crc >> 24] ^ t->t[6][(crc >> 16) & 0xFFu] ^
+                  t->t[5][(crc >> 8) & 0xFFu] ^ t->t[4][crc & 0xFFu] ^
+                  t->t[3][w1 >> 24] ^ t->t[2][(w1 >> 16) & 0xFFu] ^
+                  t->t[1][(w1 >> 8) & 0xFFu] ^ t->t[0][w1 & 0xFFu];
+        }
+    }
+    if (order == CRC_ORDER_WORD) {
+        for (; len >= 4u; p += 4, len -= 4u) {
+            crc = crc_sw_word(h, crc, crc_load32(p));
+        }
+        return crc;
+    }
+    for (; len != 0u; p++, len--) {
+        crc = (t != NULL) ? crc_tab_byte(t, lsb, crc, *p) : crc_bit_byte(&h->spec, crc, *p);
+    }
+    return crc;
+}
+
+static uint32_t crc_sw_init(const crc_spec_t *s)
+{
+    return (s->order == CRC_ORDER_LSB) ? crc_rbit(s->init) : s->init;
+}
+
+uint32_t crc_compute_sw(const crc_t *h, const void *data, size_t len)
+{
+    return crc_sw_update(h, crc_sw_init(&h->spec), data, len) ^ h->spec.xorout;
+}
+
+/* ------------------------------------------------------------------------ */
+/* CRC unit                                                                 */
+/* ------------------------------------------------------------------------ */
+
+static bool crc_hw_can(const crc_spec_t *s)
+{
+    return CRC_HW_PRESENT &&
+           (CRC_PROGRAMMABLE || (s->poly == CRC_POLY_DEFAULT && s->init == CRC_INIT_DEFAULT));
+}
+
+/* The DMA writes words untouched; only the unit itself may reorder them. */
+static bool crc_dma_can(const crc_spec_t *s)
+{
+    return crc_hw_can(s) &&
+           (s->order == CRC_ORDER_WORD || (CRC_PROGRAMMABLE && s->order == CRC_ORDER_LSB));
+}
+
+static bool crc_claim(void)
+{
+    uint32_t primask = stm32_irq_save();
+    bool ok = !crc_unit_busy;
+
+    crc_unit_busy = true;
+    stm32_irq_restore(primask);
+    return ok;
+}
+
+static void crc_hw_begin(const crc_spec_t *s)
+{
+#if CRC_PROGRAMMABLE
+    REG_WRITE(CRC->POL, s->poly);
+    REG_WRITE(CRC->INIT, s->init);
+    REG_WRITE(CRC->CR, CRC_CR_RESET |
+              ((s->order == CRC_ORDER_LSB) ?
+               reg_field_prep(CRC_CR_REV_IN, CRC_REV_IN_WORD) | CRC_CR_REV_OUT : 0u));
+#else
+    (void)s;
+    REG_WRITE(CRC->CR, CRC_CR_RESET);
+#endif
+}
+
+/* Register value in the software engine's form (reflected for LSB). */
+static uint32_t crc_hw_state(const crc_spec_t *s)
+{
+    uint32_t v = REG_READ(CRC->DR);
+
+    return (!CRC_PROGRAMMABLE && s->order == CRC_ORDER_LSB) ? crc_rbit(v) : v;
+}
+
+static uint32_t crc_hw_run(const crc_t *h, const uint8_t *p, size_t len)
+{
+    const crc_order_t order = h->spec.order;
+    size_t n = len / 4u;
+
+    crc_hw_begin(&h->spec);
+    for (; n != 0u; n--, p += 4) {
+        uint32_t w = crc_load32(p);
+
+        if (order == CRC_ORDER_MSB) {
+            w = __builtin_bswap32(w);
+        } else if (!CRC_PROGRAMMABLE && order == CRC_ORDER_LSB) {
+            w = crc_rbit(w);
+        }
+        REG_WRITE(CRC->DR, w);
+    }
+    return crc_sw_update(h, crc_hw_state(&h->spec), p, len % 4u) ^ h->spec.xorout;
+}
+
+drv_status_t crc_init(crc_t *h, const crc_spec_t *spec, crc_table_t *table, bool use_dma)
+{
+    if (h == NULL || spec == NULL || spec->order > CRC_ORDER_WORD) {
+        return DRV_ERR_PARAM;
+    }
+    memset(h, 0, sizeof(*h));
+    h->spec = *spec;
+    h->hw = crc_hw_can(spec);
+    if (table != NULL) {
+        crc_table_fill(table, spec);
+        h->table = table;
+    }
+    if (use_dma && crc_dma_can(spec) && dma_alloc(DMA_REQ_MEM, &h->dma) == DRV_OK) {
+        const dma_config_t cfg = {
+            .dir = DMA_DIR_M2M, .psize = DMA_SIZE_WORD, .msize = DMA_SIZE_WORD,
+            .pinc = true, .minc = false,
+        };
+
+        (void)dma_configure(h->dma, &cfg);
+    }
+    if (h->hw) {
+        REG_SET_BITS(RCC->AHB1ENR, RCC_AHB1ENR_CRCEN);
+    }
+    return DRV_OK;
+}
+
+void crc_deinit(crc_t *h)
+{
+    if (h->dma != NULL) {
+        dma_free(h->dma);
+        h->dma = NULL;
+    }
+}
+
+bool crc_busy(void)
+{
+    return crc_unit_busy;
+}
+
+drv_status_t crc_compute(crc_t *h, const void *data, size_t len, uint32_t *out)
+{
+    if (data == NULL && len != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    if (h->spec.order == CRC_ORDER_WORD && (len % 4u) != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    if (h->hw && crc_claim()) {
+        *out = crc_hw_run(h, data, len);
+        crc_unit_busy = false;
+        return DRV_OK;
+    }
+    if (h->hw && h->table == NULL) {
+        return DRV_ERR_BUSY;
+    }
+    *out = crc_compute_sw(h, data, len);
+    return DRV_OK;
+}
+
+static drv_status_t crc_dma_next(crc_t *h)
+{
+    uint32_t n = (h->words_left < CRC_DMA_CHUNK_WORDS) ? h->words_left : CRC_DMA_CHUNK_WORDS;
+    dma_xfer_t *x = &h->xfer[h->chunk & 1u];
+
+    *x = (dma_xfer_t){
+        .periph = REG_ADDR(h->next),
+        .mem0 = (void *)(uintptr_t)&CRC->DR,
+        .count = (uint16_t)n,
+        .cb = crc_dma_event,
+        .ctx = h,
+    };
+    h->next += 4u * n;
+    h->words_left -= n;
+    h->chunk++;
+    return dma_submit(h->dma, x);
+}
+
+static void crc_dma_finish(crc_t *h, drv_status_t status)
+{
+    uint32_t crc = 0;
+
+    if (status == DRV_OK) {
+        crc = crc_sw_update(h, crc_hw_state(&h->spec), h->tail, h->tail_len) ^ h->spec.xorout;
+    }
+    crc_unit_busy = false;
+    h->cb(h->ctx, status, crc);
+}
+
+drv_status_t crc_compute_dma(crc_t *h, const void *data, size_t len,
+                             crc_done_cb_t cb, void *ctx)
+{
+    const uint8_t *p = data;
+    drv_status_t rc;
+    uint32_t crc;
+
+    if (cb == NULL || (data == NULL && len != 0u) ||
+        (h->spec.order == CRC_ORDER_WORD && (len % 4u) != 0u)) {
+        return DRV_ERR_PARAM;
+    }
+    if (crc_unit_busy) {
+        return DRV_ERR_BUSY;
+    }
+    if (h->dma == NULL || len < CRC_DMA_MIN_BYTES || ((uintptr_t)p & 3u) != 0u) {
+        rc = crc_compute(h, data, len, &crc);
+        if (rc == DRV_OK) {
+            cb(ctx, DRV_OK, crc);
+        }
+        return rc;
+    }
+    if (!crc_claim()) {
+        return DRV_ERR_BUSY;
+    }
+    h->next = p;
+    h->words_left = (uint32_t)(len / 4u);
+    h->tail = p + (len & ~(size_t)3u);
+    h->tail_len = (uint8_t)(len % 4u);
+    h->chunk = 0;
+    h->cb = cb;
+    h->ctx = ctx;
+    crc_hw_begin(&h->spec);
+    rc = crc_dma_next(h);
+    if (rc != DRV_OK) {
+        crc_unit_busy = false;
+    }
+    return rc;
+}
+
+static void crc_dma_event(void *ctx, uint32_t events)
+{
+    crc_t *h = ctx;
+    drv_status_t rc;
+
+    if ((events & (DMA_FLAG_TEIF | DMA_FLAG_DMEIF)) != 0u) {
+        dma_abort(h->dma);
+        crc_dma_finish(h, DRV_ERR_HW);
+        return;
+    }
+    if ((events & DMA_FLAG_TCIF) == 0u) {
+        return;
+    }
+    if (h->words_left == 0u) {
+        crc_dma_finish(h, DRV_OK);
+        return;
+    }
+    rc = crc_dma_next(h);
+    if (rc != DRV_OK) {
+        crc_dma_finish(h, rc);
+    }
+}
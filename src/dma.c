@@ -0,0 +1,406 @@
+/**
+ * @file    dma.c
+ * @brief   DMA stream allocator and transfer engine (DMA1/DMA2).
+ */
+#include "cache.h"
+#include "dma.h"
+
+#define DMA_ROUTES_MAX      3u
+
+/* Route encoding: valid bit, controller, stream, channel. */
+#define DMA_ROUTE(c, s, ch) (0x80u | ((c) << 6) | ((s) << 3) | (ch))
+#define DMA_ROUTE_CTRL(r)   (((r) >> 6) & 1u)
+#define DMA_ROUTE_STREAM(r) (((r) >> 3) & 7u)
+#define DMA_ROUTE_CHAN(r)   ((r) & 7u)
+
+#define D1(s, ch)           DMA_ROUTE(0u, s, ch)
+#define D2(s, ch)           DMA_ROUTE(1u, s, ch)
+
+/* Candidate streams per request, in order of preference. */
+static const uint8_t dma_routes[DMA_REQ_COUNT][DMA_ROUTES_MAX] = {
+    [DMA_REQ_USART1_RX] = { D2(2, 4), D2(5, 4) },
+    [DMA_REQ_USART1_TX] = { D2(7, 4) },
+    [DMA_REQ_USART2_RX] = { D1(5, 4) },
+    [DMA_REQ_USART2_TX] = { D1(6, 4) },
+    [DMA_REQ_USART3_RX] = { D1(1, 4) },
+    [DMA_REQ_USART3_TX] = { D1(3, 4), D1(4, 7) },
+    [DMA_REQ_UART4_RX]  = { D1(2, 4) },
+    [DMA_REQ_UART4_TX]  = { D1(4, 4) },
+    [DMA_REQ_UART5_RX]  = { D1(0, 4) },
+    [DMA_REQ_UART5_TX]  = { D1(7, 4) },
+    [DMA_REQ_USART6_RX] = { D2(1, 5), D2(2, 5) },
+    [DMA_REQ_USART6_TX] = { D2(6, 5), D2(7, 5) },
+    [DMA_REQ_SPI1_RX]   = { D2(0, 3), D2(2, 3) },
+    [DMA_REQ_SPI1_TX]   = { D2(3, 3), D2(5, 3) },
+    [DMA_REQ_SPI2_RX]   = { D1(3, 0) },
+    [DMA_REQ_SPI2_TX]   = { D1(4, 0) },
+    [DMA_REQ_SPI3_RX]   = { D1(0, 0), D1(2, 0) },
+    [DMA_REQ_SPI3_TX]   = { D1(5, 0), D1(7, 0) },
+    [DMA_REQ_I2C1_RX]   = { D1(0, 1), D1(5, 1) },
+    [DMA_REQ_I2C1_TX]   = { D1(6, 1), D1(7, 1) },
+    [DMA_REQ_I2C2_RX]   = { D1(2, 7), D1(3, 7) },
+    [DMA_REQ_I2C2_TX]   = { D1(7, 7) },
+    [DMA_REQ_I2C3_RX]   = { D1(2, 3) },
+    [DMA_REQ_I2C3_TX]   = { D1(4, 3) },
+    [DMA_REQ_ADC1]      = { D2(0, 0), D2(4, 0) },
+    [DMA_REQ_ADC2]      = { D2(2, 1), D2(3, 1) },
+    [DMA_REQ_ADC3]      = { D2(0, 2), D2(1, 2) },
+    [DMA_REQ_TIM1_UP]   = { D2(5, 6) },
+    [DMA_REQ_TIM2_UP]   = { D1(1, 3), D1(7, 3) },
+    [DMA_REQ_TIM3_UP]   = { D1(2, 5) },
+    [DMA_REQ_TIM4_UP]   = { D1(6, 2) },
+    [DMA_REQ_TIM5_UP]   = { D1(0, 6), D1(6, 6) },
+    [DMA_REQ_TIM8_UP]   = { D2(1, 7) },
+    [DMA_REQ_SDIO]      = { D2(3, 4), D2(6, 4) },
+    [DMA_REQ_QUADSPI]   = { D2(7, 3) },
+};
+
+static const irqn_t dma_irqs[2][8] = {
+    { DMA1_Stream0_IRQn, DMA1_Stream1_IRQn, DMA1_Stream2_IRQn, DMA1_Stream3_IRQn,
+      DMA1_Stream4_IRQn, DMA1_Stream5_IRQn, DMA1_Stream6_IRQn, DMA1_Stream7_IRQn },
+    { DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+      DMA2_Stream4_IRQn, DMA2_Stream5_IRQn, DMA2_Stream6_IRQn, DMA2_Stream7_IRQn },
+};
+
+static dma_stream_t dma_streams[2][8];
+
+static dma_regs_t *dma_ctrl(uint32_t ctrl)
+{
+    return (ctrl == 0u) ? DMA1 : DMA2;
+}
+
+static dma_stream_t *dma_claim(uint32_t ctrl, uint32_t stream, uint32_t channel)
+{
+    dma_stream_t *s = &dma_streams[ctrl][stream];
+
+    if (s->used) {
+        return NULL;
+    }
+    s->used = true;
+    s->dma = dma_ctrl(ctrl);
+    s->regs = &s->dma->S[stream];
+    s->irqn = dma_irqs[ctrl][stream];
+    s->ctrl = (uint8_t)ctrl;
+    s->stream = (uint8_t)stream;
+    s->channel = (uint8_t)channel;
+    s->cr = 0;
+    s->fcr = 0;
+    s->head = NULL;
+    s->tail = NULL;
+    return s;
+}
+
+drv_status_t dma_alloc(dma_req_t req, dma_stream_t **out)
+{
+    dma_stream_t *s = NULL;
+    uint32_t i;
+
+    if (out == NULL || (uint32_t)req >= DMA_REQ_COUNT) {
+        return DRV_ERR_PARAM;
+    }
+    if (req == DMA_REQ_MEM) {
+        /* Only DMA2 can do memory-to-memory.  Take the highest free stream:
+         * the low ones carry most of the peripheral routes. */
+        for (i = 8u; i-- > 0u && s == NULL;) {
+            s = dma_claim(1u, i, 0u);
+        }
+    } else {
+        for (i = 0; i < DMA_ROUTES_MAX && s == NULL; i++) {
+            uint8_t r = dma_routes[req][i];
+
+            if (r != 0u) {
+                s = dma_claim(DMA_ROUTE_CTRL(r), DMA_ROUTE_STREAM(r), DMA_ROUTE_CHAN(r));
+            }
+        }
+    }
+    if (s == NULL) {
+        return DRV_ERR_NORES;
+    }
+    REG_SET_BITS(RCC->AHB1ENR, (s->ctrl == 0u) ? RCC_AHB1ENR_DMA1EN : RCC_AHB1ENR_DMA2EN);
+    *out = s;
+    return DRV_OK;
+}
+
+void dma_free(dma_stream_t *s)
+{
+    dma_abort(s);
+    s->used = false;
+}
+
+/* A burst of @p burst beats of @p size must fit the 16-byte FIFO (RM0090 9.3.11). */
+static bool dma_burst_fits(uint32_t burst, uint32_t size)
+{
+    return burst == DMA_BURST_SINGLE || ((4u << (burst - 1u)) << size) <= 16u;
+}
+
+drv_status_t dma_configure(dma_stream_t *s, const dma_config_t *cfg)
+{
+    bool fifo;
+
+    if (cfg == NULL || cfg->dir > DMA_DIR_M2M || cfg->psize > DMA_SIZE_WORD ||
+        cfg->msize > DMA_SIZE_WORD || cfg->priority > 3u || cfg->burst > DMA_BURST_INCR16 ||
+        !dma_burst_fits(cfg->burst, cfg->psize) || !dma_burst_fits(cfg->burst, cfg->msize) ||
+        (cfg->dir == DMA_DIR_M2M && (cfg->circular || s->ctrl == 0u)) ||
+        (cfg->pfctrl && (cfg->circular || cfg->dir == DMA_DIR_M2M))) {
+        return DRV_ERR_PARAM;
+    }
+    if (s->head != NULL) {
+        return DRV_ERR_BUSY;
+    }
+
+    /* Direct mode cannot pack or unpack and is not allowed for M2M. */
+    fifo = cfg->fifo || cfg->dir == DMA_DIR_M2M || cfg->psize != cfg->msize ||
+           cfg->burst != DMA_BURST_SINGLE;
+
+    s->cr = reg_field_prep(DMA_SCR_CHSEL, s->channel)
+          | reg_field_prep(DMA_SCR_DIR, cfg->dir)
+          | reg_field_prep(DMA_SCR_PSIZE, cfg->psize)
+          | reg_field_prep(DMA_SCR_MSIZE, cfg->msize)
+          | reg_field_prep(DMA_SCR_PL, cfg->priority)
+          | reg_field_prep(DMA_SCR_PBURST, cfg->burst)
+          | reg_field_prep(DMA_SCR_MBURST, cfg->burst)
+          | (cfg->pinc ? DMA_SCR_PINC : 0u)
+          | (cfg->minc ? DMA_SCR_MINC : 0u)
+          | (cfg->circular ? DMA_SCR_CIRC : 0u)
+          | (cfg->pfctrl ? DMA_SCR_PFCTRL : 0u)
+          | (cfg->half ? DMA_SCR_HTIE : 0u)
+          | DMA_SCR_TCIE | DMA_SCR_TEIE | (fifo ? 0u : DMA_SCR_DMEIE);
+    s->fcr = fifo ? (DMA_SFCR_DMDIS | reg_field_prep(DMA_SFCR_FTH, 3u)) : 0u;
+    return DRV_OK;
+}
+
+uint32_t dma_flags(const dma_stream_t *s)
+{
+    uint32_t isr = (s->stream < 4u) ? REG_READ(s->dma->LISR) : REG_READ(s->dma->HISR);
+
+    return (isr >> DMA_ISR_SHIFT(s->stream)) & DMA_FLAG_ALL;
+}
+
+void dma_clear(const dma_stream_t *s, uint32_t flags)
+{
+    uint32_t v = (flags & DMA_FLAG_ALL) << DMA_ISR_SHIFT(s->stream);
+
+    if (s->stream < 4u) {
+        REG_WRITE(s->dma->LIFCR, v);
+    } else {
+        REG_WRITE(s->dma->HIFCR, v);
+    }
+}
+
+static void dma_disable(dma_stream_t *s)
+{
+    REG_CLR_BITS(s->regs->CR, DMA_SCR_EN);
+    while (REG_TEST_BITS(s->regs->CR, DMA_SCR_EN)) {
+    }
+    dma_clear(s, DMA_FLAG_ALL);
+}
+
+static void dma_start(dma_stream_t *s, const dma_xfer_t *x)
+{
+    dma_stream_regs_t *st = s->regs;
+    uint32_t cr = s->cr;
+
+    if (x->mem1 != NULL) {
+        cr |= DMA_SCR_DBM;
+        REG_WRITE(st->M1AR, REG_ADDR(x->mem1));
+    }
+    dma_clear(s, DMA_FLAG_ALL);
+    REG_WRITE(st->PAR, x->periph);
+    REG_WRITE(st->M0AR, REG_ADDR(x->mem0));
+    REG_WRITE(st->NDTR, x->count);
+    REG_WRITE(st->FCR, s->fcr);
+    REG_WRITE(st->CR, cr);
+    /* Descriptor writes must land before the stream fetches from memory. */
+    stm32_dmb();
+    REG_WRITE(st->CR, cr | DMA_SCR_EN);
+}
+
+/* Bytes of memory one side of a transfer touches. */
+static size_t dma_span(uint32_t cr, uint16_t count, bool mem)
+{
+    uint32_t psize = reg_field_get(cr, DMA_SCR_PSIZE);
+
+    if ((cr & (mem ? DMA_SCR_MINC : DMA_SCR_PINC)) == 0u) {
+        return (size_t)1u << (mem ? reg_field_get(cr, DMA_SCR_MSIZE) : psize);
+    }
+    /* NDTR counts peripheral-size items on both sides. */
+    return (size_t)count << psize;
+}
+
+/*
+ * Make memory the stream is about to use coherent with the data cache:
+ * sources are written back, destinations are dropped so no dirty line
+ * gets evicted over what the stream stores.
+ */
+static void dma_cache_submit(uint32_t cr, const dma_xfer_t *x)
+{
+    size_t len = dma_span(cr, x->count, true);
+
+    switch (reg_field_get(cr, DMA_SCR_DIR)) {
+    case DMA_DIR_M2P:
+        cache_clean(x->mem0, len);
+        if (x->mem1 != NULL) {
+            cache_clean(x->mem1, len);
+        }
+        break;
+    case DMA_DIR_M2M:
+        cache_clean(REG_PTR(x->periph), dma_span(cr, x->count, false));
+        cache_invalidate(x->mem0, len);
+        break;
+    default:
+        cache_invalidate(x->mem0, len);
+        if (x->mem1 != NULL) {
+            cache_invalidate(x->mem1, len);
+        }
+        break;
+    }
+}
+
+/*
+ * Drop lines the stream has just filled, before the callback reads them:
+ * the CPU may have speculatively refilled them while the transfer ran.
+ */
+static void dma_cache_done(uint32_t cr, const dma_xfer_t *x, uint32_t flags)
+{
+    size_t len = dma_span(cr, x->count, true);
+    size_t half;
+    size_t lo;
+    size_t hi;
+
+    if (reg_field_get(cr, DMA_SCR_DIR) == DMA_DIR_M2P ||
+        (flags & (DMA_FLAG_TCIF | DMA_FLAG_HTIF)) == 0u) {
+        return;
+    }
+    if ((cr & DMA_SCR_DBM) != 0u) {
+        /* CT has already moved on to the other buffer. */
+        if ((flags & DMA_FLAG_TCIF) != 0u) {
+            cache_invalidate(((cr & DMA_SCR_CT) != 0u) ? x->mem0 : x->mem1, len);
+        }
+        return;
+    }
+    if ((cr & DMA_SCR_MINC) == 0u) {
+        cache_invalidate(x->mem0, len);
+        return;
+    }
+    half = dma_span(cr, x->count / 2u, true);
+    lo = ((flags & DMA_FLAG_HTIF) != 0u || (cr & DMA_SCR_CIRC) == 0u) ? 0u : half;
+    hi = ((flags & DMA_FLAG_TCIF) != 0u) ? len : half;
+    cache_invalidate((uint8_t *)x->mem0 + lo, hi - lo);
+}
+
+drv_status_t dma_submit(dma_stream_t *s, dma_xfer_t *x)
+{
+    uint32_t primask;
+    bool idle;
+
+    if (x == NULL || x->mem0 == NULL || x->count == 0u || s->cr == 0u ||
+        (x->mem1 != NULL && (reg_field_get(s->cr, DMA_SCR_DIR) == DMA_DIR_M2M ||
+                             (s->cr & DMA_SCR_PFCTRL) != 0u))) {
+        return DRV_ERR_PARAM;
+    }
+    x->next = NULL;
+    dma_cache_submit(s->cr, x);
+
+    primask = stm32_irq_save();
+    idle = (s->head == NULL);
+    if (idle) {
+        s->head = x;
+    } else {
+        s->tail->next = x;
+    }
+    s->tail = x;
+    stm32_irq_restore(primask);
+
+    if (idle) {
+        dma_start(s, x);
+    }
+    return DRV_OK;
+}
+
+void dma_abort(dma_stream_t *s)
+{
+    uint32_t primask = stm32_irq_save();
+
+    s->head = NULL;
+    s->tail = NULL;
+    stm32_irq_restore(primask);
+    dma_disable(s);
+}
+
+uint32_t dma_remaining(const dma_stream_t *s)
+{
+    return REG_READ(s->regs->NDTR);
+}
+
+uint32_t dma_current_target(const dma_stream_t *s)
+{
+    return REG_TEST_BITS(s->regs->CR, DMA_SCR_CT) ? 1u : 0u;
+}
+
+void dma_irq(dma_regs_t *dma, uint32_t stream)
+{
+    dma_stream_t *s = &dma_streams[(dma == DMA1) ? 0u : 1u][stream & 7u];
+    dma_xfer_t *x = s->head;
+    uint32_t flags;
+    uint32_t cr;
+
+    if (!s->used) {
+        return;
+    }
+    flags = dma_flags(s);
+    dma_clear(s, flags);
+    if (x == NULL) {
+        return;
+    }
+    cr = REG_READ(s->regs->CR);
+    dma_cache_done(cr, x, flags);
+
+    /*
+     * Circular/double-buffer transfers keep running past TC; anything else
+     * is done once TC or TE is set (TE disables the stream in hardware).
+     */
+    if ((flags & DMA_FLAG_TEIF) != 0u ||
+        ((flags & DMA_FLAG_TCIF) != 0u && (cr & (DMA_SCR_CIRC | DMA_SCR_DBM)) == 0u)) {
+        dma_xfer_t *next;
+
+        if ((flags & DMA_FLAG_TEIF) != 0u) {
+            dma_disable(s);
+        }
+        next = x->next;
+        s->head = next;
+        if (next == NULL) {
+            s->tail = NULL;
+        } else {
+            /* Restart first: the callback's latency is not the stream's. */
+            dma_start(s, next);
+        }
+    }
+    /* HTIF and FEIF are set regardless of their enables: report HT only
+     * when asked for, FIFO errors never (the FIFO recovers on its own). */
+    flags &= DMA_FLAG_TCIF | DMA_FLAG_TEIF | DMA_FLAG_DMEIF |
+             (((cr & DMA_SCR_HTIE) != 0u) ? DMA_FLAG_HTIF : 0u);
+    if (x->cb != NULL && flags != 0u) {
+        x->cb(x->ctx, flags);
+    }
+}
+
+#define DMA_IRQ_HANDLER(c, n)                                               \
+    void DMA##c##_Stream##n##_IRQHandler(void);                             \
+    void DMA##c##_Stream##n##_IRQHandler(void) { dma_irq(DMA##c, n); }
+
+DMA_IRQ_HANDLER(1, 0)
+DMA_IRQ_HANDLER(1, 1)
+DMA_IRQ_HANDLER(1, 2)
+DMA_IRQ_HANDLER(1, 3)
+DMA_IRQ_HANDLER(1, 4)
+DMA_IRQ_HANDLER(1, 5)
+DMA_IRQ_HANDLER(1, 6)
+DMA_IRQ_HANDLER(1, 7)
+DMA_IRQ_HANDLER(2, 0)
+DMA_IRQ_HANDLER(2, 1)
+DMA_IRQ_HANDLER(2, 2)
+DMA_IRQ_HANDLER(2, 3)
+DMA_IRQ_HANDLER(2, 4)
+DMA_IRQ_HANDLER(2, 5)
+DMA_IRQ_HANDLER(2, 6)
+DMA_IRQ_HANDLER(2, 7)
@@ -0,0 +1,571 @@
+/**
+ * @file    eth.c
+ * @brief   Ethernet MAC driver: descriptor rings, packet buffer pool, MDIO.
+ */
+#include <string.h>
+
+#include "eth.h"
+#include "rcc.h"
+
+/* Polls of DMABMR.SR for the DMA reset, and of MACMIIAR.MB per MDIO access. */
+#define ETH_RESET_TIMEOUT   100000u
+#define ETH_MDIO_TIMEOUT    100000u
+
+#define ETH_HCLK_MIN        25000000u
+
+/* Burst length: 32 beats each way, address-aligned fixed bursts. */
+#define ETH_DMABMR          (ETH_DMABMR_EDFE | ETH_DMABMR_AAB | ETH_DMABMR_FB |       \
+                             ETH_DMABMR_USP)
+#define ETH_BURST           32u
+
+#define ETH_DMAIER          (ETH_DMA_NIS | ETH_DMA_RS | ETH_DMA_TS | ETH_DMA_TBUS |   \
+                             ETH_DMA_AIS | ETH_DMA_RBUS | ETH_DMA_FBES)
+#define ETH_DMASR_EVENTS    REG_MASK(0u, 17u)
+
+#define ETH_RDES4_CSUM_ERR  (ETH_RDES4_IPHE | ETH_RDES4_IPPE | ETH_RDES4_IPCB)
+
+/* Instance served by ETH_IRQHandler. */
+static eth_t *eth_handle;
+
+/* ------------------------------------------------------------------------ */
+/* Packet buffer pool                                                       */
+/* ------------------------------------------------------------------------ */
+
+drv_status_t eth_pool_init(eth_pool_t *pool, eth_pbuf_t *pbufs, uint8_t *storage, uint32_t n)
+{
+    uint32_t i;
+
+    if (pool == NULL || pbufs == NULL || storage == NULL || n == 0u || n > UINT16_MAX) {
+        return DRV_ERR_PARAM;
+    }
+    pool->free = NULL;
+    for (i = n; i-- != 0u;) {
+        pbufs[i].data = storage + i * ETH_PBUF_SIZE;
+        pbufs[i].len = 0;
+        pbufs[i].flags = 0;
+        pbufs[i].next = pool->free;
+        pool->free = &pbufs[i];
+    }
+    pool->size = (uint16_t)n;
+    pool->avail = (uint16_t)n;
+    pool->min_avail = (uint16_t)n;
+    return DRV_OK;
+}
+
+eth_pbuf_t *eth_pbuf_alloc(eth_pool_t *pool)
+{
+    uint32_t primask = stm32_irq_save();
+    eth_pbuf_t *p = pool->free;
+
+    if (p != NULL) {
+        pool->free = p->next;
+        pool->avail--;
+        if (pool->avail < pool->min_avail) {
+            pool->min_avail = pool->avail;
+        }
+    }
+    stm32_irq_restore(primask);
+    if (p != NULL) {
+        p->next = NULL;
+        p->len = 0;
+        p->flags = 0;
+    }
+    return p;
+}
+
+void eth_pbuf_free(eth_pool_t *pool, eth_pbuf_t *p)
+{
+    uint32_t primask = stm32_irq_save();
+
+    while (p != NULL) {
+        eth_pbuf_t *next = p->next;
+
+        p->next = pool->free;
+        pool->free = p;
+        pool->avail++;
+        p = next;
+    }
+    stm32_irq_restore(primask);
+}
+
+/* ------------------------------------------------------------------------ */
+/* MDIO                                                                     */
+/* ------------------------------------------------------------------------ */
+
+static drv_status_t eth_mdio_wait(eth_regs_t *eth)
+{
+    uint32_t n;
+
+    for (n = 0; n < ETH_MDIO_TIMEOUT; n++) {
+        if ((REG_READ(eth->MACMIIAR) & ETH_MACMIIAR_MB) == 0u) {
+            return DRV_OK;
+        }
+    }
+    return DRV_ERR_TIMEOUT;
+}
+
+static uint32_t eth_mdio_cmd(const eth_t *h, uint32_t reg)
+{
+    return reg_field_prep(ETH_MACMIIAR_PA, h->phy_addr) | reg_field_prep(ETH_MACMIIAR_MR, reg) |
+           reg_field_prep(ETH_MACMIIAR_CR, h->mdc_div) | ETH_MACMIIAR_MB;
+}
+
+drv_status_t eth_phy_read(eth_t *h, uint32_t reg, uint16_t *val)
+{
+    drv_status_t rc;
+
+    if (reg > 31u || val == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    rc = eth_mdio_wait(h->eth);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_WRITE(h->eth->MACMIIAR, eth_mdio_cmd(h, reg));
+    rc = eth_mdio_wait(h->eth);
+    if (rc == DRV_OK) {
+        *val = (uint16_t)REG_READ(h->eth->MACMIIDR);
+    }
+    return rc;
+}
+
+drv_status_t eth_phy_write(eth_t *h, uint32_t reg, uint16_t val)
+{
+    drv_status_t rc;
+
+    if (reg > 31u) {
+        return DRV_ERR_PARAM;
+    }
+    rc = eth_mdio_wait(h->eth);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_WRITE(h->eth->MACMIIDR, val);
+    REG_WRITE(h->eth->MACMIIAR, eth_mdio_cmd(h, reg) | ETH_MACMIIAR_MW);
+    return eth_mdio_wait(h->eth);
+}
+
+bool eth_link_poll(eth_t *h)
+{
+    uint16_t bmsr;
+    uint16_t anar;
+    uint16_t anlpar;
+    uint16_t common;
+
+    if (eth_phy_read(h, ETH_PHY_BMSR, &bmsr) != DRV_OK ||
+        eth_phy_read(h, ETH_PHY_BMSR, &bmsr) != DRV_OK) {
+        h->link = false;
+        return false;
+    }
+    h->link = (bmsr & ETH_BMSR_LINK) != 0u;
+    if (!h->link || (bmsr & ETH_BMSR_ANC) == 0u ||
+        eth_phy_read(h, ETH_PHY_ANAR, &anar) != DRV_OK ||
+        eth_phy_read(h, ETH_PHY_ANLPAR, &anlpar) != DRV_OK) {
+        return h->link;
+    }
+    common = anar & anlpar;
+    h->fast = (common & (ETH_AN_100FD | ETH_AN_100HD)) != 0u;
+    h->full_duplex = (common & (h->fast ? ETH_AN_100FD : ETH_AN_10FD)) != 0u;
+    REG_MODIFY(h->eth->MACCR, ETH_MACCR_FES | ETH_MACCR_DM,
+               (h->fast ? ETH_MACCR_FES : 0u) | (h->full_duplex ? ETH_MACCR_DM : 0u));
+    return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Receive                                                                  */
+/* ------------------------------------------------------------------------ */
+
+static uint16_t eth_next(uint16_t i, uint16_t count)
+{
+    return (i + 1u == count) ? 0u : (uint16_t)(i + 1u);
+}
+
+/* Point receive descriptor @p i at @p p and give it to the DMA. */
+static void eth_rx_arm(eth_t *h, uint16_t i, eth_pbuf_t *p)
+{
+    eth_dma_desc_t *d = &h->rx_desc[i];
+
+    h->rx_pbuf[i] = p;
+    cache_invalidate(p->data, ETH_PBUF_SIZE);
+    d->des2 = REG_ADDR(p->data);
+    d->des4 = 0;
+    stm32_dmb();
+    d->des0 = ETH_DES0_OWN;
+    cache_clean((const void *)d, sizeof(*d));
+}
+
+static uint16_t eth_rx_flags(const eth_t *h, uint32_t des0, uint32_t des4)
+{
+    uint16_t flags = 0;
+
+    if ((des0 & ETH_RDES0_ESA) == 0u) {
+        return 0;
+    }
+    if ((des4 & ETH_RDES4_IPV4PR) != 0u) {
+        flags |= ETH_RX_IPV4;
+    }
+    if (h->csum && (des4 & ETH_RDES4_CSUM_ERR) == 0u &&
+        reg_field_get(des4, ETH_RDES4_IPPT) != ETH_IPPT_UNKNOWN) {
+        flags |= ETH_RX_CSUM_OK;
+    }
+    return flags;
+}
+
+eth_pbuf_t *eth_recv(eth_t *h)
+{
+    for (;;) {
+        uint16_t i = h->rx_next;
+        eth_dma_desc_t *d = &h->rx_desc[i];
+        eth_pbuf_t *p = h->rx_pbuf[i];
+        eth_pbuf_t *fresh;
+        uint32_t des0;
+
+        cache_invalidate((void *)d, sizeof(*d));
+        des0 = d->des0;
+        if ((des0 & ETH_DES0_OWN) != 0u) {
+            return NULL;
+        }
+        stm32_dmb();
+        h->rx_next = eth_next(i, h->rx_count);
+
+        if ((des0 & (ETH_RDES0_ES | ETH_RDES0_FS | ETH_RDES0_LS)) !=
+            (ETH_RDES0_FS | ETH_RDES0_LS)) {
+            h->rx_errors++;
+            fresh = NULL;
+        } else {
+            fresh = eth_pbuf_alloc(h->pool);
+            if (fresh == NULL) {
+                h->rx_nobuf++;
+            }
+        }
+        if (fresh == NULL) {
+            /* Drop the frame; its buffer goes straight back to the DMA. */
+            eth_rx_arm(h, i, p);
+            REG_WRITE(h->eth->DMARPDR, 0u);
+            continue;
+        }
+
+        p->len = (uint16_t)reg_field_get(des0, ETH_RDES0_FL);
+        p->flags = eth_rx_flags(h, des0, d->des4);
+        cache_invalidate(p->data, CACHE_ROUND(p->len));
+        eth_rx_arm(h, i, fresh);
+        REG_WRITE(h->eth->DMARPDR, 0u);
+        h->rx_frames++;
+        return p;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Transmit                                                                 */
+/* ------------------------------------------------------------------------ */
+
+uint32_t eth_tx_reclaim(eth_t *h)
+{
+    uint32_t frames = 0;
+
+    while (h->tx_used != 0u) {
+        uint16_t i = h->tx_tail;
+        eth_dma_desc_t *d = &h->tx_desc[i];
+        uint32_t des0;
+
+        cache_invalidate((void *)d, sizeof(*d));
+        des0 = d->des0;
+        if ((des0 & ETH_DES0_OWN) != 0u) {
+            break;
+        }
+        if ((des0 & ETH_TDES0_LS) != 0u) {
+            if ((des0 & ETH_TDES0_ES) != 0u) {
+                h->tx_errors++;
+            } else {
+                h->tx_frames++;
+            }
+            eth_pbuf_free(h->pool, h->tx_pbuf[i]);
+            h->tx_pbuf[i] = NULL;
+            frames++;
+        }
+        h->tx_tail = eth_next(i, h->tx_count);
+        h->tx_used--;
+    }
+    return frames;
+}
+
+drv_status_t eth_send(eth_t *h, eth_pbuf_t *p)
+{
+    const eth_pbuf_t *q;
+    uint32_t segs = 0;
+    uint32_t total = 0;
+    uint32_t ctl;
+    uint32_t first_ctl = 0;
+    uint16_t first = h->tx_head;
+    uint16_t i = first;
+    uint16_t last = first;
+    bool ic;
+
+    for (q = p; q != NULL; q = q->next) {
+        if (q->len == 0u || q->len > ETH_PBUF_SIZE) {
+            return DRV_ERR_PARAM;
+        }
+        segs++;
+        total += q->len;
+    }
+    if (segs == 0u || total < ETH_HEADER_LEN || total > ETH_FRAME_MAX) {
+        return DRV_ERR_PARAM;
+    }
+    (void)eth_tx_reclaim(h);
+    if (segs > (uint32_t)(h->tx_count - h->tx_used)) {
+        return DRV_ERR_NORES;
+    }
+
+    ic = ++h->tx_since_ic >= h->tx_coalesce;
+    if (ic) {
+        h->tx_since_ic = 0;
+    }
+    for (q = p; q != NULL; q = q->next) {
+        eth_dma_desc_t *d = &h->tx_desc[i];
+
+        ctl = (h->csum ? reg_field_prep(ETH_TDES0_CIC, ETH_CIC_FULL) : 0u) |
+              ((i + 1u == h->tx_count) ? ETH_TDES0_TER : 0u);
+        if (q == p) {
+            ctl |= ETH_TDES0_FS;
+        }
+        if (q->next == NULL) {
+            ctl |= ETH_TDES0_LS | (ic ? ETH_TDES0_IC : 0u);
+            last = i;
+        }
+        cache_clean(q->data, q->len);
+        d->des1 = reg_field_prep(ETH_TDES1_TBS1, q->len);
+        d->des2 = REG_ADDR(q->data);
+        h->tx_pbuf[i] = NULL;
+        if (q == p) {
+            first_ctl = ctl;
+        } else {
+            d->des0 = ctl | ETH_DES0_OWN;
+            cache_clean((const void *)d, sizeof(*d));
+        }
+        i = eth_next(i, h->tx_count);
+    }
+    h->tx_pbuf[last] = p;
+    h->tx_head = i;
+    h->tx_used = (uint16_t)(h->tx_used + segs);
+
+    /* The first descriptor goes last, so the DMA never sees half a frame. */
+    stm32_dsb();
+    h->tx_desc[first].des0 = first_ctl | ETH_DES0_OWN;
+    cache_clean((const void *)&h->tx_desc[first], sizeof(h->tx_desc[first]));
+    stm32_dsb();
+    REG_WRITE(h->eth->DMATPDR, 0u);
+    return DRV_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Interrupt                                                                */
+/* ------------------------------------------------------------------------ */
+
+void eth_irq(eth_t *h)
+{
+    eth_regs_t *eth = h->eth;
+    uint32_t sr = REG_READ(eth->DMASR) & ETH_DMASR_EVENTS;
+    uint32_t events = 0;
+
+    REG_WRITE(eth->DMASR, sr);
+    h->irqs++;
+    if ((sr & ETH_DMA_RS) != 0u) {
+        events |= ETH_EVENT_RX;
+    }
+    if ((sr & ETH_DMA_RBUS) != 0u) {
+        events |= ETH_EVENT_RX | ETH_EVENT_RX_STALL;
+        h->rx_stalls++;
+    }
+    if ((sr & (ETH_DMA_TS | ETH_DMA_TBUS)) != 0u) {
+        events |= ETH_EVENT_TX;
+    }
+    if ((sr & ETH_DMA_FBES) != 0u) {
+        events |= ETH_EVENT_ERROR;
+    }
+    if (events != 0u) {
+        h->events |= events;
+        if (h->event != NULL) {
+            h->event(h, events);
+        }
+    }
+}
+
+void ETH_IRQHandler(void);
+void ETH_IRQHandler(void)
+{
+    if (eth_handle != NULL) {
+        eth_irq(eth_handle);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Setup                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t eth_mdc_div(uint32_t hclk_hz)
+{
+    if (hclk_hz < 35000000u) {
+        return ETH_MDC_DIV_16;
+    }
+    if (hclk_hz < 60000000u) {
+        return ETH_MDC_DIV_26;
+    }
+    if (hclk_hz < 100000000u) {
+        return ETH_MDC_DIV_42;
+    }
+    if (hclk_hz < 150000000u) {
+        return ETH_MDC_DIV_62;
+    }
+    return ETH_MDC_DIV_102;
+}
+
+/* Receive watchdog in units of 256 HCLK cycles, rounded up, 1..255. */
+static uint32_t eth_rswt(uint32_t hclk_hz, uint32_t us)
+{
+    uint64_t cycles = (uint64_t)hclk_hz * us / 1000000u;
+    uint64_t units = (cycles + ETH_RSWT_CYCLES - 1u) / ETH_RSWT_CYCLES;
+
+    if (units == 0u) {
+        return 1u;
+    }
+    return (units > 255u) ? 255u : (uint32_t)units;
+}
+
+static void eth_mac_setup(eth_regs_t *eth, const eth_config_t *cfg)
+{
+    REG_WRITE(eth->MACCR, ETH_MACCR_CSTF | ETH_MACCR_APCS | ETH_MACCR_FES | ETH_MACCR_DM |
+                          (cfg->csum_offload ? ETH_MACCR_IPCO : 0u));
+    REG_WRITE(eth->MACFFR, (cfg->promiscuous ? ETH_MACFFR_PM : 0u) |
+                           (cfg->all_multicast ? ETH_MACFFR_PAM : 0u));
+    REG_WRITE(eth->MACA0HR, ((uint32_t)cfg->mac[5] << 8) | cfg->mac[4]);
+    REG_WRITE(eth->MACA0LR, ((uint32_t)cfg->mac[3] << 24) | ((uint32_t)cfg->mac[2] << 16) |
+                            ((uint32_t)cfg->mac[1] << 8) | cfg->mac[0]);
+    REG_WRITE(eth->MACIMR, ETH_MACIMR_PMTIM | ETH_MACIMR_TSTIM);
+    REG_WRITE(eth->MMCRIMR, ETH_MMCRIMR_ALL);
+    REG_WRITE(eth->MMCTIMR, ETH_MMCTIMR_ALL);
+}
+
+static void eth_ring_setup(eth_t *h, const eth_config_t *cfg)
+{
+    uint32_t n = (cfg->rx_coalesce != 0u) ? cfg->rx_coalesce : 1u;
+    uint16_t i;
+
+    for (i = 0; i < h->rx_count; i++) {
+        eth_dma_desc_t *d = &h->rx_desc[i];
+
+        memset((void *)d, 0, sizeof(*d));
+        d->des1 = reg_field_prep(ETH_RDES1_RBS1, ETH_PBUF_SIZE) |
+                  ((i + 1u == h->rx_count) ? ETH_RDES1_RER : 0u) |
+                  (((i + 1u) % n != 0u) ? ETH_RDES1_DIC : 0u);
+        eth_rx_arm(h, i, eth_pbuf_alloc(h->pool));
+    }
+    for (i = 0; i < h->tx_count; i++) {
+        eth_dma_desc_t *d = &h->tx_desc[i];
+
+        memset((void *)d, 0, sizeof(*d));
+        d->des0 = (i + 1u == h->tx_count) ? ETH_TDES0_TER : 0u;
+        h->tx_pbuf[i] = NULL;
+        cache_clean((const void *)d, sizeof(*d));
+    }
+}
+
+drv_status_t eth_init(eth_t *h, const eth_config_t *cfg)
+{
+    eth_regs_t *eth = ETH;
+    uint32_t hclk = rcc_current()->hclk_hz;
+    uint32_t n;
+
+    if (h == NULL || cfg == NULL || cfg->pool == NULL || cfg->rx_desc == NULL ||
+        cfg->rx_pbuf == NULL || cfg->rx_count < 2u || cfg->tx_desc == NULL ||
+        cfg->tx_pbuf == NULL || cfg->tx_count < 2u || cfg->phy_addr > 31u ||
+        hclk < ETH_HCLK_MIN) {
+        return DRV_ERR_PARAM;
+    }
+    if (cfg->pool->avail < cfg->rx_count) {
+        return DRV_ERR_NORES;
+    }
+
+    memset(h, 0, sizeof(*h));
+    h->eth = eth;
+    h->pool = cfg->pool;
+    h->event = cfg->event;
+    h->ctx = cfg->ctx;
+    h->phy_addr = cfg->phy_addr;
+    h->mdc_div = (uint8_t)eth_mdc_div(hclk);
+    h->csum = cfg->csum_offload;
+    h->rx_desc = cfg->rx_desc;
+    h->rx_pbuf = cfg->rx_pbuf;
+    h->rx_count = cfg->rx_count;
+    h->tx_desc = cfg->tx_desc;
+    h->tx_pbuf = cfg->tx_pbuf;
+    h->tx_count = cfg->tx_count;
+    h->tx_coalesce = (cfg->tx_coalesce != 0u) ? cfg->tx_coalesce : 1u;
+    h->fast = true;
+    h->full_duplex = true;
+
+    /* The interface type is latched while the MAC is held in reset. */
+    REG_SET_BITS(RCC->APB2ENR, RCC_APB2ENR_SYSCFGEN);
+    REG_SET_BITS(RCC->AHB1RSTR, RCC_AHB1RSTR_ETHMACRST);
+    REG_MODIFY(SYSCFG->PMC, SYSCFG_PMC_MII_RMII_SEL, cfg->rmii ? SYSCFG_PMC_MII_RMII_SEL : 0u);
+    REG_CLR_BITS(RCC->AHB1RSTR, RCC_AHB1RSTR_ETHMACRST);
+    REG_SET_BITS(RCC->AHB1ENR, RCC_AHB1ENR_ETHMACEN | RCC_AHB1ENR_ETHMACTXEN |
+                               RCC_AHB1ENR_ETHMACRXEN);
+
+    /* The DMA reset completes only with the PHY clocks running. */
+    REG_SET_BITS(eth->DMABMR, ETH_DMABMR_SR);
+    for (n = 0; (REG_READ(eth->DMABMR) & ETH_DMABMR_SR) != 0u; n++) {
+        if (n == ETH_RESET_TIMEOUT) {
+            return DRV_ERR_TIMEOUT;
+        }
+    }
+
+    eth_mac_setup(eth, cfg);
+    eth_ring_setup(h, cfg);
+    REG_WRITE(eth->DMARDLAR, REG_ADDR(h->rx_desc));
+    REG_WRITE(eth->DMATDLAR, REG_ADDR(h->tx_desc));
+    REG_WRITE(eth->DMABMR, ETH_DMABMR | reg_field_prep(ETH_DMABMR_PBL, ETH_BURST) |
+                           reg_field_prep(ETH_DMABMR_RDP, ETH_BURST));
+    /* Store and forward both ways: checksum offload needs whole frames. */
+    REG_WRITE(eth->DMAOMR, ETH_DMAOMR_RSF | ETH_DMAOMR_TSF);
+    REG_WRITE(eth->DMARSWTR, eth_rswt(hclk, (cfg->rx_timeout_us != 0u) ? cfg->rx_timeout_us
+                                                                       : ETH_RX_TIMEOUT_US));
+    REG_WRITE(eth->DMASR, ETH_DMASR_EVENTS);
+    REG_WRITE(eth->DMAIER, ETH_DMAIER);
+
+    eth_handle = h;
+    REG_SET_BITS(eth->MACCR, ETH_MACCR_TE);
+    REG_SET_BITS(eth->DMAOMR, ETH_DMAOMR_FTF);
+    REG_SET_BITS(eth->DMAOMR, ETH_DMAOMR_ST);
+    REG_SET_BITS(eth->MACCR, ETH_MACCR_RE);
+    REG_SET_BITS(eth->DMAOMR, ETH_DMAOMR_SR);
+    return DRV_OK;
+}
+
+void eth_deinit(eth_t *h)
+{
+    eth_regs_t *eth = h->eth;
+    uint32_t primask;
+    uint16_t i;
+
+    REG_CLR_BITS(eth->DMAOMR, ETH_DMAOMR_ST);
+    REG_CLR_BITS(eth->MACCR, ETH_MACCR_RE);
+    REG_CLR_BITS(eth->DMAOMR, ETH_DMAOMR_SR);
+    REG_SET_BITS(eth->DMAOMR, ETH_DMAOMR_FTF);
+    REG_CLR_BITS(eth->MACCR, ETH_MACCR_TE);
+    REG_WRITE(eth->DMAIER, 0u);
+    primask = stm32_irq_save();
+    if (eth_handle == h) {
+        eth_handle = NULL;
+    }
+    stm32_irq_restore(primask);
+
+    for (i = 0; i < h->rx_count; i++) {
+        eth_pbuf_free(h->pool, h->rx_pbuf[i]);
+        h->rx_pbuf[i] = NULL;
+    }
+    for (i = 0; i < h->tx_count; i++) {
+        eth_pbuf_free(h->pool, h->tx_pbuf[i]);
+        h->tx_pbuf[i] = NULL;
+    }
+    h->tx_used = 0;
+}
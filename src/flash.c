@@ -0,0 +1,357 @@
+/**
+ * @file    flash.c
+ * @brief   Internal flash programming and sector erase.
+ */
+#include <string.h>
+
+#include "cache.h"
+#include "flash.h"
+
+#define FLASH_PROGRAM_TIMEOUT   100000u
+#define FLASH_ERASE_TIMEOUT     (1u << 28)     /* Large sectors take seconds. */
+#define FLASH_STAGE_WORDS       16u
+
+static uint32_t flash_psize;
+static uint32_t flash_unit_bytes;
+
+STM32_INLINE volatile uint32_t *flash_word(uint32_t addr)
+{
+    return &FLASHMEM->W[(addr - FLASH_MEM_BASE) / 4u];
+}
+
+static bool flash_range_ok(uint32_t addr, size_t len)
+{
+    return addr >= FLASH_MEM_BASE && addr - FLASH_MEM_BASE <= FLASH_MEM_SIZE &&
+           len <= FLASH_MEM_SIZE - (addr - FLASH_MEM_BASE);
+}
+
+/*
+ * Spin until the interface is idle; the operation's error flags, or BSY if
+ * it never finished.  Always inlined, so it runs wherever its caller does.
+ */
+STM32_INLINE uint32_t flash_wait(uint32_t limit)
+{
+    uint32_t sr;
+    uint32_t n;
+
+    for (n = 0; n < limit; n++) {
+        sr = REG_READ(FLASH->SR);
+        if ((sr & FLASH_SR_BSY) == 0u) {
+            return sr & FLASH_SR_ERRORS;
+        }
+    }
+    return FLASH_SR_BSY;
+}
+
+/*
+ * Program @p words words, one or two (@p step) per operation, stopping at
+ * the first error.  From RAM, so the wait does not stall on fetches.
+ */
+static STM32_RAMFUNC uint32_t flash_program_run(volatile uint32_t *dst, const uint32_t *src,
+                                                uint32_t words, uint32_t step)
+{
+    uint32_t sr = 0;
+
+    while (words != 0u && sr == 0u) {
+        REG_WRITE(dst[0], src[0]);
+        if (step == 2u) {
+            REG_WRITE(dst[1], src[1]);
+        }
+        stm32_dsb();
+        sr = flash_wait(FLASH_PROGRAM_TIMEOUT);
+        dst += step;
+        src += step;
+        words -= step;
+    }
+    return sr;
+}
+
+/* Start the erase set up in @p cr and wait for it, from RAM. */
+static STM32_RAMFUNC uint32_t flash_erase_run(uint32_t cr)
+{
+    REG_WRITE(FLASH->CR, cr);
+    REG_WRITE(FLASH->CR, cr | FLASH_CR_STRT);
+    stm32_dsb();
+    return flash_wait(FLASH_ERASE_TIMEOUT);
+}
+
+static drv_status_t flash_unlock(void)
+{
+    if (flash_wait(FLASH_ERASE_TIMEOUT) == FLASH_SR_BSY) {
+        return DRV_ERR_BUSY;
+    }
+    if (REG_TEST_BITS(FLASH->CR, FLASH_CR_LOCK)) {
+        REG_WRITE(FLASH->KEYR, FLASH_KEY1);
+        REG_WRITE(FLASH->KEYR, FLASH_KEY2);
+        if (REG_TEST_BITS(FLASH->CR, FLASH_CR_LOCK)) {
+            return DRV_ERR_HW;
+        }
+    }
+    /* Flags left by an earlier operation would block the next one. */
+    REG_WRITE(FLASH->SR, FLASH_SR_EOP | FLASH_SR_ERRORS);
+    return DRV_OK;
+}
+
+static void flash_lock(void)
+{
+    REG_WRITE(FLASH->CR, FLASH_CR_LOCK);
+}
+
+static drv_status_t flash_result(uint32_t sr)
+{
+    if (sr == FLASH_SR_BSY) {
+        return DRV_ERR_TIMEOUT;
+    }
+    return (sr != 0u) ? DRV_ERR_HW : DRV_OK;
+}
+
+/* Drop whatever the flash caches hold of [addr, addr + len). */
+static void flash_caches_flush(uint32_t addr, uint32_t len)
+{
+#if defined(STM32F7)
+    uint32_t acr = REG_READ(FLASH->ACR);
+
+    cache_invalidate((void *)(uintptr_t)flash_ptr(addr), len);
+    if ((acr & FLASH_ACR_ARTEN) != 0u) {
+        REG_WRITE(FLASH->ACR, acr & ~FLASH_ACR_ARTEN);
+        REG_WRITE(FLASH->ACR, (acr & ~FLASH_ACR_ARTEN) | FLASH_ACR_ARTRST);
+        REG_WRITE(FLASH->ACR, acr & ~FLASH_ACR_ARTEN);
+        REG_WRITE(FLASH->ACR, acr);
+    }
+#else
+    /* The caches are not addressable by line: reset them (while off). */
+    uint32_t acr = REG_READ(FLASH->ACR);
+    uint32_t on = acr & (FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+
+    (void)addr;
+    (void)len;
+    if (on != 0u) {
+        REG_WRITE(FLASH->ACR, acr & ~on);
+        REG_WRITE(FLASH->ACR, (acr & ~on) | FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+        REG_WRITE(FLASH->ACR, acr & ~on);
+        REG_WRITE(FLASH->ACR, acr);
+    }
+#endif
+}
+
+drv_status_t flash_init(uint32_t vdd_mv, bool vpp)
+{
+    if (vdd_mv == 0u) {
+        vdd_mv = 3300u;
+    }
+    if (vpp) {
+        flash_psize = FLASH_PSIZE_X64;
+        flash_unit_bytes = 8u;
+    } else if (vdd_mv >= 2700u) {
+        flash_psize = FLASH_PSIZE_X32;
+        flash_unit_bytes = 4u;
+    } else {
+        flash_unit_bytes = 0u;
+        return DRV_ERR_PARAM;
+    }
+    return DRV_OK;
+}
+
+uint32_t flash_unit(void)
+{
+    return flash_unit_bytes;
+}
+
+uint32_t flash_sector_of(uint32_t addr)
+{
+    uint32_t off = addr - FLASH_MEM_BASE;
+
+    if (addr < FLASH_MEM_BASE || off >= FLASH_MEM_SIZE) {
+        return FLASH_SECTOR_COUNT;
+    }
+    if (off < 4u * FLASH_SECTOR_UNIT) {
+        return off / FLASH_SECTOR_UNIT;
+    }
+    if (off < 8u * FLASH_SECTOR_UNIT) {
+        return 4u;
+    }
+    return 4u + off / (8u * FLASH_SECTOR_UNIT);
+}
+
+uint32_t flash_sector_base(uint32_t sector)
+{
+    return FLASH_MEM_BASE + FLASH_SECTOR_OFFSET(sector);
+}
+
+uint32_t flash_sector_size(uint32_t sector)
+{
+    return FLASH_SECTOR_SIZE(sector);
+}
+
+const void *flash_ptr(uint32_t addr)
+{
+    return (const uint8_t *)FLASHMEM->W + (addr - FLASH_MEM_BASE);
+}
+
+drv_status_t flash_erase_sector(uint32_t sector)
+{
+    drv_status_t rc;
+    uint32_t sr;
+
+    if (sector >= FLASH_SECTOR_COUNT || flash_unit_bytes == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    rc = flash_unlock();
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    sr = flash_erase_run(FLASH_CR_SER | reg_field_prep(FLASH_CR_SNB, sector) |
+                         reg_field_prep(FLASH_CR_PSIZE, flash_psize));
+    flash_lock();
+    flash_caches_flush(flash_sector_base(sector), flash_sector_size(sector));
+    return flash_result(sr);
+}
+
+drv_status_t flash_erase(uint32_t addr, uint32_t len)
+{
+    uint32_t sector;
+    uint32_t last;
+    drv_status_t rc = DRV_OK;
+
+    if (!flash_range_ok(addr, len)) {
+        return DRV_ERR_PARAM;
+    }
+    if (len == 0u) {
+        return DRV_OK;
+    }
+    last = flash_sector_of(addr + len - 1u);
+    for (sector = flash_sector_of(addr); sector <= last && rc == DRV_OK; sector++) {
+        rc = flash_erase_sector(sector);
+    }
+    return rc;
+}
+
+drv_status_t flash_program(uint32_t addr, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    uint32_t stage[FLASH_STAGE_WORDS];
+    uint32_t step = flash_unit_bytes / 4u;
+    uint32_t sr = 0;
+    size_t done = 0;
+    drv_status_t rc;
+
+    if (flash_unit_bytes == 0u || !flash_range_ok(addr, len) ||
+        ((addr | (uint32_t)len) & (flash_unit_bytes - 1u)) != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    if (len == 0u) {
+        return DRV_OK;
+    }
+    rc = flash_unlock();
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_WRITE(FLASH->CR, FLASH_CR_PG | reg_field_prep(FLASH_CR_PSIZE, flash_psize));
+
+    while (done < len && sr == 0u) {
+        const uint32_t *words = (const uint32_t *)(const void *)(src + done);
+        size_t n = len - done;
+
+        /* Unaligned sources go through an aligned copy, a chunk at a time. */
+        if (((uintptr_t)src & 3u) != 0u) {
+            if (n > sizeof(stage)) {
+                n = sizeof(stage);
+            }
+            memcpy(stage, src + done, n);
+            words = stage;
+        }
+        sr = flash_program_run(flash_word(addr + (uint32_t)done), words, (uint32_t)(n / 4u), step);
+        done += n;
+    }
+
+    flash_lock();
+    flash_caches_flush(addr, (uint32_t)len);
+    rc = flash_result(sr);
+    if (rc == DRV_OK && memcmp(flash_ptr(addr), data, len) != 0) {
+        rc = DRV_ERR_HW;
+    }
+    return rc;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Streaming writer                                                         */
+/* ------------------------------------------------------------------------ */
+
+drv_status_t flash_writer_open(flash_writer_t *w, uint32_t addr, uint32_t len)
+{
+    if (w == NULL || flash_unit_bytes == 0u || !flash_range_ok(addr, len) ||
+        (addr & (flash_unit_bytes - 1u)) != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    w->addr = addr;
+    w->end = addr + len;
+    w->fill = 0;
+    return DRV_OK;
+}
+
+drv_status_t flash_writer_write(flash_writer_t *w, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    const uint32_t unit = flash_unit_bytes;
+    drv_status_t rc;
+    size_t n;
+
+    if (len > (size_t)(w->end - w->addr - w->fill)) {
+        return DRV_ERR_PARAM;
+    }
+
+    /* Top up a partial unit first. */
+    if (w->fill != 0u) {
+        n = unit - w->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&w->buf[w->fill], src, n);
+        w->fill = (uint8_t)(w->fill + n);
+        src += n;
+        len -= n;
+        if (w->fill < unit) {
+            return DRV_OK;
+        }
+        rc = flash_program(w->addr, w->buf, unit);
+        if (rc != DRV_OK) {
+            return rc;
+        }
+        w->addr += unit;
+        w->fill = 0;
+    }
+
+    /* Whole units straight from the caller's buffer. */
+    n = len & ~(size_t)(unit - 1u);
+    if (n != 0u) {
+        rc = flash_program(w->addr, src, n);
+        if (rc != DRV_OK) {
+            return rc;
+        }
+        w->addr += (uint32_t)n;
+        src += n;
+        len -= n;
+    }
+
+    if (len != 0u) {
+        memcpy(w->buf, src, len);
+        w->fill = (uint8_t)len;
+    }
+    return DRV_OK;
+}
+
+drv_status_t flash_writer_close(flash_writer_t *w)
+{
+    drv_status_t rc;
+
+    if (w->fill == 0u) {
+        return DRV_OK;
+    }
+    memset(&w->buf[w->fill], 0xFF, flash_unit_bytes - w->fill);
+    rc = flash_program(w->addr, w->buf, flash_unit_bytes);
+    if (rc == DRV_OK) {
+        w->addr += flash_unit_bytes;
+        w->fill = 0;
+    }
+    return rc;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file    gpio.c
+ * @brief   GPIO driver: pin configuration and groups.
+ */
+#include "gpio.h"
+
+static gpio_regs_t *const gpio_ports[] = {
+    GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH, GPIOI,
+};
+
+/* Replicate a per-pin value into every field of a 2-bit-per-pin register. */
+static uint32_t gpio_spread2(uint16_t pins, uint32_t v, uint32_t *mask)
+{
+    uint32_t m = 0;
+    uint32_t n;
+
+    for (n = 0; n < 16u; n++) {
+        if ((pins & (1u << n)) != 0u) {
+            m |= 3u << (2u * n);
+        }
+    }
+    *mask = m;
+    return m & (v * 0x55555555u);
+}
+
+drv_status_t gpio_configure(gpio_regs_t *port, uint16_t pins, const gpio_config_t *cfg)
+{
+    uint32_t mask;
+    uint32_t val;
+    uint32_t i;
+    uint32_t n;
+
+    if (cfg == NULL || cfg->mode > GPIO_MODE_ANALOG || cfg->otype > 1u ||
+        cfg->speed > GPIO_SPEED_VERY_HIGH || cfg->pull > GPIO_PULL_DOWN ||
+        cfg->af > 15u) {
+        return DRV_ERR_PARAM;
+    }
+    for (i = 0; i < STM32_ARRAY_SIZE(gpio_ports); i++) {
+        if (gpio_ports[i] == port) {
+            break;
+        }
+    }
+    if (i == STM32_ARRAY_SIZE(gpio_ports)) {
+        return DRV_ERR_PARAM;
+    }
+    REG_SET_BITS(RCC->AHB1ENR, RCC_AHB1ENR_GPIOEN(i));
+
+    /* One read-modify-write per register for the whole pin set; the
+     * alternate function is set before MODER so the pin never drives a
+     * stale function. */
+    if (cfg->mode == GPIO_MODE_AF) {
+        for (i = 0; i < 2u; i++) {
+            uint32_t afm = 0;
+
+            for (n = 0; n < 8u; n++) {
+                if ((pins & (1u << (8u * i + n))) != 0u) {
+                    afm |= 0xFu << (4u * n);
+                }
+            }
+            if (afm != 0u) {
+                REG_MODIFY(port->AFR[i], afm, afm & (cfg->af * 0x11111111u));
+            }
+        }
+    }
+    REG_MODIFY(port->OTYPER, pins, cfg->otype ? pins : 0u);
+    val = gpio_spread2(pins, cfg->speed, &mask);
+    REG_MODIFY(port->OSPEEDR, mask, val);
+    val = gpio_spread2(pins, cfg->pull, &mask);
+    REG_MODIFY(port->PUPDR, mask, val);
+    val = gpio_spread2(pins, cfg->mode, &mask);
+    REG_MODIFY(port->MODER, mask, val);
+    return DRV_OK;
+}
+
+drv_status_t gpio_group_init(gpio_group_t *g, gpio_regs_t *port, uint8_t first, uint8_t width)
+{
+    if (g == NULL || port == NULL || width == 0u || first + width > 16u) {
+        return DRV_ERR_PARAM;
+    }
+    g->port = port;
+    g->shift = first;
+    g->mask = (uint16_t)(((1u << width) - 1u) << first);
+    return DRV_OK;
+}
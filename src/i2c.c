@@ -0,0 +1,574 @@
+/**
+ * @file    i2c.c
+ * @brief   I2C master driver: queued, interrupt/DMA-driven transactions.
+ */
+#include "gpio.h"
+#include "i2c.h"
+#include "rcc.h"
+
+/* Polls of CR1.STOP before the bus is considered stuck (~1 ms). */
+#define I2C_SPIN_MAX    100000u
+
+enum {
+    I2C_ST_IDLE = 0,
+    I2C_ST_START_W,     /* START for the write phase; waiting for SB. */
+    I2C_ST_ADDR_W,      /* Address + W sent; waiting for ADDR. */
+    I2C_ST_REG,         /* Register address bytes from TXE. */
+    I2C_ST_DATA_W,      /* Payload by TX DMA. */
+    I2C_ST_BTF,         /* Last byte written; waiting for BTF. */
+    I2C_ST_START_R,     /* (Repeated) START for the read phase. */
+    I2C_ST_ADDR_R,      /* Address + R sent; waiting for ADDR. */
+    I2C_ST_DATA_R,      /* Two or more bytes by RX DMA. */
+    I2C_ST_RX1,         /* Single byte from RXNE. */
+};
+
+typedef struct {
+    i2c_regs_t *i2c;
+    uint32_t en;
+    dma_req_t rx_req;
+    dma_req_t tx_req;
+} i2c_hw_t;
+
+static const i2c_hw_t i2c_hw[] = {
+    { I2C1, RCC_APB1ENR_I2C1EN, DMA_REQ_I2C1_RX, DMA_REQ_I2C1_TX },
+    { I2C2, RCC_APB1ENR_I2C2EN, DMA_REQ_I2C2_RX, DMA_REQ_I2C2_TX },
+    { I2C3, RCC_APB1ENR_I2C3EN, DMA_REQ_I2C3_RX, DMA_REQ_I2C3_TX },
+};
+
+/* Buses by instance, for the interrupt handlers. */
+static i2c_bus_t *i2c_buses[STM32_ARRAY_SIZE(i2c_hw)];
+
+static void i2c_finish(i2c_bus_t *bus, drv_status_t status);
+static void i2c_tx_done(void *ctx, uint32_t events);
+static void i2c_rx_done(void *ctx, uint32_t events);
+
+static size_t i2c_hw_index(const i2c_regs_t *i2c)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(i2c_hw); i++) {
+        if (i2c_hw[i].i2c == i2c) {
+            break;
+        }
+    }
+    return i;
+}
+
+/*
+ * CCR counts PCLK1 periods per SCL phase: standard mode high = low = CCR,
+ * fast mode (DUTY = 0) low = 2 * CCR, high = CCR.  Rounded up so SCL never
+ * runs faster than asked.  TRISE is the 1000 ns / 300 ns rise time limit in
+ * PCLK1 periods, plus one.
+ */
+static drv_status_t i2c_timing(i2c_bus_t *bus, uint32_t pclk, uint32_t hz)
+{
+    uint32_t mhz = pclk / 1000000u;
+    uint32_t ccr;
+
+    if (hz == 0u || hz > I2C_FAST_HZ || mhz < 2u || mhz > 50u) {
+        return DRV_ERR_PARAM;
+    }
+    if (hz <= I2C_STANDARD_HZ) {
+        ccr = (pclk + 2u * hz - 1u) / (2u * hz);
+        ccr = (ccr < 4u) ? 4u : ccr;
+        bus->trise = mhz + 1u;
+    } else {
+        if (mhz < 4u) {
+            return DRV_ERR_PARAM;
+        }
+        ccr = (pclk + 3u * hz - 1u) / (3u * hz);
+        ccr = (ccr < 1u) ? 1u : ccr;
+        ccr |= I2C_CCR_FS;
+        bus->trise = mhz * 300u / 1000u + 1u;
+    }
+    if (reg_field_get(ccr, I2C_CCR_CCR) != (ccr & ~I2C_CCR_FS)) {
+        return DRV_ERR_PARAM;
+    }
+    bus->ccr = ccr;
+    bus->cr2 = reg_field_prep(I2C_CR2_FREQ, mhz) | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+    return DRV_OK;
+}
+
+/* Software reset, then the configuration back in; clears a latched BUSY. */
+static void i2c_reset(i2c_bus_t *bus)
+{
+    i2c_regs_t *i2c = bus->i2c;
+
+    REG_WRITE(i2c->CR1, I2C_CR1_SWRST);
+    REG_WRITE(i2c->CR1, 0u);
+    REG_WRITE(i2c->CR2, bus->cr2);
+    REG_WRITE(i2c->CCR, bus->ccr);
+    REG_WRITE(i2c->TRISE, bus->trise);
+    REG_WRITE(i2c->CR1, I2C_CR1_PE);
+}
+
+static void i2c_pins_af(const i2c_bus_t *bus)
+{
+    const gpio_config_t af = {
+        .mode = GPIO_MODE_AF, .otype = GPIO_OTYPE_OPENDRAIN,
+        .speed = GPIO_SPEED_HIGH, .af = I2C_GPIO_AF,
+    };
+
+    (void)gpio_configure(bus->scl_port, GPIO_PIN(bus->scl_pin), &af);
+    (void)gpio_configure(bus->sda_port, GPIO_PIN(bus->sda_pin), &af);
+}
+
+drv_status_t i2c_init(i2c_bus_t *bus, i2c_regs_t *i2c, const i2c_config_t *cfg)
+{
+    const dma_config_t rc_cfg = {
+        .dir = DMA_DIR_P2M, .psize = DMA_SIZE_BYTE, .msize = DMA_SIZE_BYTE,
+        .priority = 2u, .minc = true,
+    };
+    const dma_config_t tc_cfg = {
+        .dir = DMA_DIR_M2P, .psize = DMA_SIZE_BYTE, .msize = DMA_SIZE_BYTE,
+        .priority = 1u, .minc = true,
+    };
+    size_t idx = i2c_hw_index(i2c);
+    drv_status_t rc;
+
+    if (bus == NULL || cfg == NULL || idx == STM32_ARRAY_SIZE(i2c_hw) ||
+        cfg->scl_port == NULL || cfg->sda_port == NULL ||
+        cfg->scl_pin > 15u || cfg->sda_pin > 15u) {
+        return DRV_ERR_PARAM;
+    }
+    rc = i2c_timing(bus, rcc_current()->pclk1_hz, cfg->speed_hz);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    rc = dma_alloc(i2c_hw[idx].rx_req, &bus->rx);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    rc = dma_alloc(i2c_hw[idx].tx_req, &bus->tx);
+    if (rc != DRV_OK) {
+        dma_free(bus->rx);
+        return rc;
+    }
+    (void)dma_configure(bus->rx, &rc_cfg);
+    (void)dma_configure(bus->tx, &tc_cfg);
+    REG_SET_BITS(RCC->APB1ENR, i2c_hw[idx].en);
+
+    bus->i2c = i2c;
+    bus->head = NULL;
+    bus->tail = NULL;
+    bus->state = I2C_ST_IDLE;
+    bus->scl_port = cfg->scl_port;
+    bus->scl_pin = cfg->scl_pin;
+    bus->sda_port = cfg->sda_port;
+    bus->sda_pin = cfg->sda_pin;
+    /* A delay loop iteration is a few cycles; ~5 us per half period. */
+    bus->spins = rcc_current()->sysclk_hz / (8u * I2C_STANDARD_HZ);
+    bus->recoveries = 0;
+
+    /* Released (high) in ODR first, so switching modes never drives a low. */
+    gpio_set(cfg->scl_port, GPIO_PIN(cfg->scl_pin));
+    gpio_set(cfg->sda_port, GPIO_PIN(cfg->sda_pin));
+    i2c_pins_af(bus);
+    i2c_reset(bus);
+    i2c_buses[idx] = bus;
+    return DRV_OK;
+}
+
+void i2c_deinit(i2c_bus_t *bus)
+{
+    dma_free(bus->tx);
+    dma_free(bus->rx);
+    REG_WRITE(bus->i2c->CR2, 0u);
+    REG_WRITE(bus->i2c->CR1, 0u);
+    i2c_buses[i2c_hw_index(bus->i2c)] = NULL;
+    bus->head = NULL;
+    bus->tail = NULL;
+    bus->state = I2C_ST_IDLE;
+}
+
+static void i2c_delay(const i2c_bus_t *bus)
+{
+    uint32_t n;
+
+    for (n = bus->spins; n != 0u; n--) {
+        STM32_COMPILER_BARRIER();
+    }
+}
+
+static void i2c_scl(const i2c_bus_t *bus, bool level)
+{
+    gpio_pin_write(bus->scl_port, bus->scl_pin, level);
+    i2c_delay(bus);
+}
+
+drv_status_t i2c_recover(i2c_bus_t *bus)
+{
+    const gpio_config_t od = {
+        .mode = GPIO_MODE_OUTPUT, .otype = GPIO_OTYPE_OPENDRAIN, .speed = GPIO_SPEED_HIGH,
+    };
+    const gpio_config_t in = { .mode = GPIO_MODE_INPUT };
+    uint16_t sda = GPIO_PIN(bus->sda_pin);
+    bool released;
+    uint32_t n;
+
+    bus->recoveries++;
+    REG_CLR_BITS(bus->i2c->CR1, I2C_CR1_PE);
+    (void)gpio_configure(bus->scl_port, GPIO_PIN(bus->scl_pin), &od);
+    (void)gpio_configure(bus->sda_port, sda, &in);
+
+    /* A target stuck mid-byte lets go of SDA at the latest by the ACK slot
+     * of the byte it is sending: at most nine clocks. */
+    for (n = 0; n < I2C_RECOVERY_CLOCKS && !gpio_pin_read(bus->sda_port, bus->sda_pin); n++) {
+        i2c_scl(bus, false);
+        i2c_scl(bus, true);
+    }
+    released = gpio_pin_read(bus->sda_port, bus->sda_pin);
+
+    /* STOP by hand (SDA rising while SCL is high) so every target resets
+     * its bus logic. */
+    i2c_scl(bus, false);
+    gpio_clear(bus->sda_port, sda);
+    (void)gpio_configure(bus->sda_port, sda, &od);
+    i2c_delay(bus);
+    i2c_scl(bus, true);
+    gpio_set(bus->sda_port, sda);
+    i2c_delay(bus);
+
+    i2c_pins_af(bus);
+    i2c_reset(bus);
+    return released ? DRV_OK : DRV_ERR_HW;
+}
+
+static bool i2c_wait_clear(const volatile uint32_t *reg, uint32_t mask)
+{
+    uint32_t n;
+
+    for (n = 0; n < I2C_SPIN_MAX; n++) {
+        if ((REG_READ(*reg) & mask) == 0u) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static drv_status_t i2c_xfer_start(i2c_bus_t *bus)
+{
+    const i2c_xfer_t *x = bus->head;
+    i2c_regs_t *i2c = bus->i2c;
+    drv_status_t rc;
+
+    /* The previous STOP still going out for too long, or a target holding
+     * the lines: the START would never be generated. */
+    if (!i2c_wait_clear(&i2c->CR1, I2C_CR1_STOP) || REG_TEST_BITS(i2c->SR2, I2C_SR2_BUSY)) {
+        rc = i2c_recover(bus);
+        if (rc != DRV_OK) {
+            return rc;
+        }
+    }
+    bus->reg_left = x->reg_len;
+    bus->state = (x->reg_len != 0u || x->tx_len != 0u || x->rx_len == 0u) ?
+                 I2C_ST_START_W : I2C_ST_START_R;
+    REG_SET_BITS(i2c->CR1, I2C_CR1_START);
+    return DRV_OK;
+}
+
+/* Retire the head transaction and run its callback. */
+static void i2c_complete(i2c_bus_t *bus, drv_status_t status)
+{
+    i2c_xfer_t *x = bus->head;
+    uint32_t primask;
+
+    primask = stm32_irq_save();
+    bus->head = x->next;
+    if (bus->head == NULL) {
+        bus->tail = NULL;
+    }
+    stm32_irq_restore(primask);
+
+    if (x->cb != NULL) {
+        x->cb(x->ctx, x, status);
+    }
+}
+
+/* Start queued transactions until one is running; a callback may have
+ * started one already. */
+static void i2c_kick(i2c_bus_t *bus)
+{
+    while (bus->state == I2C_ST_IDLE && bus->head != NULL) {
+        drv_status_t rc = i2c_xfer_start(bus);
+
+        if (rc == DRV_OK) {
+            break;
+        }
+        i2c_complete(bus, rc);
+    }
+}
+
+static void i2c_finish(i2c_bus_t *bus, drv_status_t status)
+{
+    REG_MODIFY(bus->i2c->CR2, I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST,
+               I2C_CR2_ITEVTEN);
+    REG_CLR_BITS(bus->i2c->CR1, I2C_CR1_ACK);
+    bus->state = I2C_ST_IDLE;
+    i2c_complete(bus, status);
+    i2c_kick(bus);
+}
+
+/* Abort the running transaction; @p stop releases the bus when the
+ * interface still owns it. */
+static void i2c_fail(i2c_bus_t *bus, drv_status_t status, bool stop)
+{
+    dma_abort(bus->rx);
+    dma_abort(bus->tx);
+    if (stop) {
+        REG_SET_BITS(bus->i2c->CR1, I2C_CR1_STOP);
+    }
+    i2c_finish(bus, status);
+}
+
+static void i2c_tx_start(i2c_bus_t *bus)
+{
+    const i2c_xfer_t *x = bus->head;
+
+    bus->txd = (dma_xfer_t){
+        .periph = REG_ADDR(&bus->i2c->DR),
+        .mem0 = (void *)x->tx,
+        .count = x->tx_len,
+        .cb = i2c_tx_done,
+        .ctx = bus,
+    };
+    (void)dma_submit(bus->tx, &bus->txd);
+    /* No events while the stream runs: BTF would fire between bytes if the
+     * stream is held up, and the stream interrupt ends the phase anyway. */
+    REG_MODIFY(bus->i2c->CR2, I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN, I2C_CR2_DMAEN);
+    bus->state = I2C_ST_DATA_W;
+}
+
+/* Write phase over (or empty): repeated START for the read, or STOP. */
+static void i2c_write_done(i2c_bus_t *bus)
+{
+    if (bus->head->rx_len != 0u) {
+        bus->state = I2C_ST_START_R;
+        REG_SET_BITS(bus->i2c->CR1, I2C_CR1_START);
+    } else {
+        REG_SET_BITS(bus->i2c->CR1, I2C_CR1_STOP);
+        i2c_finish(bus, DRV_OK);
+    }
+}
+
+/* Reading SR2 clears ADDR and releases SCL, so everything the next phase
+ * needs is set up first. */
+static void i2c_addr_w(i2c_bus_t *bus)
+{
+    const i2c_xfer_t *x = bus->head;
+
+    if (bus->reg_left != 0u) {
+        REG_SET_BITS(bus->i2c->CR2, I2C_CR2_ITBUFEN);
+        bus->state = I2C_ST_REG;
+    } else if (x->tx_len != 0u) {
+        i2c_tx_start(bus);
+    }
+    (void)REG_READ(bus->i2c->SR2);
+    if (bus->reg_left == 0u && x->tx_len == 0u) {
+        i2c_write_done(bus);
+    }
+}
+
+static void i2c_reg_byte(i2c_bus_t *bus)
+{
+    const i2c_xfer_t *x = bus->head;
+
+    bus->reg_left--;
+    REG_WRITE(bus->i2c->DR, (x->reg >> (8u * bus->reg_left)) & 0xFFu);
+    if (bus->reg_left != 0u) {
+        return;
+    }
+    if (x->tx_len != 0u) {
+        i2c_tx_start(bus);
+    } else {
+        REG_CLR_BITS(bus->i2c->CR2, I2C_CR2_ITBUFEN);
+        bus->state = I2C_ST_BTF;
+    }
+}
+
+static void i2c_addr_r(i2c_bus_t *bus)
+{
+    const i2c_xfer_t *x = bus->head;
+    i2c_regs_t *i2c = bus->i2c;
+
+    if (x->rx_len == 1u) {
+        /* One byte: NACK it, and STOP right after ADDR is cleared. */
+        bus->state = I2C_ST_RX1;
+        REG_CLR_BITS(i2c->CR1, I2C_CR1_ACK);
+        REG_SET_BITS(i2c->CR2, I2C_CR2_ITBUFEN);
+        (void)REG_READ(i2c->SR2);
+        REG_SET_BITS(i2c->CR1, I2C_CR1_STOP);
+        return;
+    }
+    bus->rxd = (dma_xfer_t){
+        .periph = REG_ADDR(&i2c->DR),
+        .mem0 = x->rx,
+        .count = x->rx_len,
+        .cb = i2c_rx_done,
+        .ctx = bus,
+    };
+    (void)dma_submit(bus->rx, &bus->rxd);
+    bus->state = I2C_ST_DATA_R;
+    /* ACK every byte but the one ending the stream (LAST). */
+    REG_SET_BITS(i2c->CR1, I2C_CR1_ACK);
+    REG_MODIFY(i2c->CR2, I2C_CR2_ITEVTEN, I2C_CR2_DMAEN | I2C_CR2_LAST);
+    (void)REG_READ(i2c->SR2);
+}
+
+void i2c_ev_irq(i2c_bus_t *bus)
+{
+    i2c_regs_t *i2c = bus->i2c;
+    i2c_xfer_t *x = bus->head;
+    uint32_t sr1 = REG_READ(i2c->SR1);
+
+    if (x == NULL) {
+        return;
+    }
+    switch (bus->state) {
+    case I2C_ST_START_W:
+    case I2C_ST_START_R:
+        if ((sr1 & I2C_SR1_SB) != 0u) {
+            bool rd = (bus->state == I2C_ST_START_R);
+
+            bus->state = rd ? I2C_ST_ADDR_R : I2C_ST_ADDR_W;
+            REG_WRITE(i2c->DR, ((uint32_t)x->addr << 1) | (rd ? 1u : 0u));
+        }
+        break;
+    case I2C_ST_ADDR_W:
+        if ((sr1 & I2C_SR1_ADDR) != 0u) {
+            i2c_addr_w(bus);
+        }
+        break;
+    case I2C_ST_REG:
+        if ((sr1 & I2C_SR1_TXE) != 0u) {
+            i2c_reg_byte(bus);
+        }
+        break;
+    case I2C_ST_BTF:
+        if ((sr1 & I2C_SR1_BTF) != 0u) {
+            i2c_write_done(bus);
+        }
+        break;
+    case I2C_ST_ADDR_R:
+        if ((sr1 & I2C_SR1_ADDR) != 0u) {
+            i2c_addr_r(bus);
+        }
+        break;
+    case I2C_ST_RX1:
+        if ((sr1 & I2C_SR1_RXNE) != 0u) {
+            x->rx[0] = (uint8_t)REG_READ(i2c->DR);
+            i2c_finish(bus, DRV_OK);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void i2c_er_irq(i2c_bus_t *bus)
+{
+    i2c_regs_t *i2c = bus->i2c;
+    uint32_t err = REG_READ(i2c->SR1) & I2C_SR1_ERRORS;
+
+    if (err == 0u) {
+        return;
+    }
+    REG_WRITE(i2c->SR1, ~err);
+    if (bus->head == NULL || bus->state == I2C_ST_IDLE) {
+        return;
+    }
+    if ((err & (I2C_SR1_BERR | I2C_SR1_ARLO)) != 0u) {
+        /* Misplaced START/STOP or another master won: the interface is no
+         * longer master and the bus state is unknown. */
+        dma_abort(bus->rx);
+        dma_abort(bus->tx);
+        (void)i2c_recover(bus);
+        i2c_finish(bus, DRV_ERR_HW);
+        return;
+    }
+    i2c_fail(bus, (err & I2C_SR1_AF) != 0u ? DRV_ERR_NACK : DRV_ERR_HW, true);
+}
+
+static void i2c_tx_done(void *ctx, uint32_t events)
+{
+    i2c_bus_t *bus = ctx;
+
+    if ((events & (DMA_FLAG_TEIF | DMA_FLAG_DMEIF)) != 0u) {
+        i2c_fail(bus, DRV_ERR_HW, true);
+        return;
+    }
+    if ((events & DMA_FLAG_TCIF) == 0u || bus->state != I2C_ST_DATA_W) {
+        return;
+    }
+    /* The stream has written the last byte into DR; BTF marks it sent. */
+    bus->state = I2C_ST_BTF;
+    REG_MODIFY(bus->i2c->CR2, I2C_CR2_DMAEN, I2C_CR2_ITEVTEN);
+}
+
+static void i2c_rx_done(void *ctx, uint32_t events)
+{
+    i2c_bus_t *bus = ctx;
+
+    if ((events & (DMA_FLAG_TEIF | DMA_FLAG_DMEIF)) != 0u) {
+        i2c_fail(bus, DRV_ERR_HW, true);
+        return;
+    }
+    if ((events & DMA_FLAG_TCIF) == 0u || bus->state != I2C_ST_DATA_R) {
+        return;
+    }
+    /* The last byte was NACKed (LAST); end with STOP. */
+    REG_SET_BITS(bus->i2c->CR1, I2C_CR1_STOP);
+    i2c_finish(bus, DRV_OK);
+}
+
+drv_status_t i2c_submit(i2c_bus_t *bus, i2c_xfer_t *x)
+{
+    uint32_t primask;
+    bool idle;
+
+    if (bus == NULL || x == NULL || x->addr > 0x7Fu || x->reg_len > 4u ||
+        (x->tx_len != 0u && x->tx == NULL) || (x->rx_len != 0u && x->rx == NULL)) {
+        return DRV_ERR_PARAM;
+    }
+    x->next = NULL;
+
+    primask = stm32_irq_save();
+    idle = (bus->head == NULL);
+    if (idle) {
+        bus->head = x;
+    } else {
+        bus->tail->next = x;
+    }
+    bus->tail = x;
+    stm32_irq_restore(primask);
+
+    if (idle) {
+        i2c_kick(bus);
+    }
+    return DRV_OK;
+}
+
+bool i2c_busy(const i2c_bus_t *bus)
+{
+    return bus->head != NULL;
+}
+
+#define I2C_IRQ_HANDLERS(n)                                                 \
+    void I2C##n##_EV_IRQHandler(void);                                      \
+    void I2C##n##_EV_IRQHandler(void)                                       \
+    {                                                                       \
+        if (i2c_buses[(n) - 1] != NULL) {                                   \
+            i2c_ev_irq(i2c_buses[(n) - 1]);                                 \
+        }                                                                   \
+    }                                                                       \
+    void I2C##n##_ER_IRQHandler(void);                                      \
+    void I2C##n##_ER_IRQHandler(void)                                       \
+    {                                                                       \
+        if (i2c_buses[(n) - 1] != NULL) {                                   \
+            i2c_er_irq(i2c_buses[(n) - 1]);                                 \
+        }                                                                   \
+    }
+
+I2C_IRQ_HANDLERS(1)
+I2C_IRQ_HANDLERS(2)
+I2C_IRQ_HANDLERS(3)
@@ -0,0 +1,296 @@
+/**
+ * @file    irq.c
+ * @brief   NVIC priorities and the RAM vector table.
+ */
+#include "irq.h"
+
+/* Polls for the probe handler; entry takes a dozen cycles. */
+#define IRQ_PROBE_TIMEOUT   100000u
+
+#if defined(STM32_HOST)
+#define IRQ_VECTORS_ATTR
+#else
+#define IRQ_VECTORS_ATTR    STM32_SECTION(".ram_vectors")
+#endif
+
+/* VTOR wants the table aligned to its size rounded up to a power of two. */
+STM32_STATIC_ASSERT(IRQ_VECTORS * 4u <= 512u, "vector table outgrew its alignment");
+static irq_handler_t irq_vectors[IRQ_VECTORS] STM32_ALIGNED(512) IRQ_VECTORS_ATTR;
+
+static volatile uint32_t irq_probe_stamp;
+static volatile uint32_t irq_probe_hit;
+static uint32_t irq_samples[BENCH_MAX_SAMPLES];
+
+static bool irq_valid(irqn_t irqn)
+{
+    return (int)irqn >= (int)NonMaskableInt_IRQn && (int)irqn < STM32_IRQ_COUNT;
+}
+
+static bool irq_line(irqn_t irqn)
+{
+    return (int)irqn >= 0 && (int)irqn < STM32_IRQ_COUNT;
+}
+
+/*
+ * Priority byte of @p irqn: NVIC IPR for interrupt lines, SCB SHPR for the
+ * system handlers from MemManage (-12) up.  Both are accessed as words.
+ */
+static volatile uint32_t *irq_prio_reg(irqn_t irqn, uint32_t *shift)
+{
+    uint32_t i;
+
+    if ((int)irqn >= 0) {
+        i = (uint32_t)irqn;
+        *shift = 8u * (i % 4u);
+        return &NVIC->IPR[i / 4u];
+    }
+    i = (uint32_t)((int)irqn + 12);
+    *shift = 8u * (i % 4u);
+    return &SCB->SHPR[i / 4u];
+}
+
+drv_status_t irq_init(const irq_handler_t *boot, uint32_t preempt_bits)
+{
+    uint32_t primask;
+    uint32_t i;
+
+    if (preempt_bits > NVIC_PRIO_BITS) {
+        return DRV_ERR_PARAM;
+    }
+    primask = stm32_irq_save();
+    if (boot == NULL) {
+        boot = REG_PTR(REG_READ(SCB->VTOR));
+    }
+    if (boot != irq_vectors) {
+        for (i = 0; i < IRQ_VECTORS; i++) {
+#if defined(STM32_HOST)
+            /* No boot table on the host until a test installs one. */
+            irq_vectors[i] = (boot != NULL) ? boot[i] : irq_unhandled;
+#else
+            irq_vectors[i] = boot[i];
+#endif
+        }
+    }
+    /* The copy must be complete before the core fetches from it. */
+    stm32_dsb();
+    REG_WRITE(SCB->VTOR, REG_ADDR(irq_vectors));
+    stm32_dsb();
+    stm32_isb();
+    (void)irq_set_grouping(preempt_bits);
+    stm32_irq_restore(primask);
+    return DRV_OK;
+}
+
+const irq_handler_t *irq_vector_table(void)
+{
+    return irq_vectors;
+}
+
+irq_handler_t irq_set_handler(irqn_t irqn, irq_handler_t handler)
+{
+    irq_handler_t prev;
+
+    if (!irq_valid(irqn)) {
+        return NULL;
+    }
+    prev = irq_vectors[16 + (int)irqn];
+    irq_vectors[16 + (int)irqn] = handler;
+    /* An interrupt taken right after this returns must see the new entry. */
+    stm32_dsb();
+    return prev;
+}
+
+drv_status_t irq_set_grouping(uint32_t preempt_bits)
+{
+    if (preempt_bits > NVIC_PRIO_BITS) {
+        return DRV_ERR_PARAM;
+    }
+    /* PRIGROUP n: bits [7:n+1] of each priority byte are the preemption level. */
+    REG_WRITE(SCB->AIRCR, reg_field_prep(SCB_AIRCR_VECTKEY, SCB_AIRCR_KEY) |
+                          reg_field_prep(SCB_AIRCR_PRIGROUP, 7u - preempt_bits));
+    stm32_dsb();
+    return DRV_OK;
+}
+
+uint32_t irq_grouping(void)
+{
+    uint32_t g = REG_FIELD_READ(SCB->AIRCR, SCB_AIRCR_PRIGROUP);
+
+    return (g < 8u - NVIC_PRIO_BITS) ? NVIC_PRIO_BITS : 7u - g;
+}
+
+drv_status_t irq_set_priority(irqn_t irqn, uint32_t preempt, uint32_t sub)
+{
+    const uint32_t pbits = irq_grouping();
+    const uint32_t sbits = NVIC_PRIO_BITS - pbits;
+    volatile uint32_t *reg;
+    uint32_t shift;
+    uint32_t prio;
+    uint32_t primask;
+
+    if (!irq_valid(irqn) || (int)irqn < (int)MemoryManagement_IRQn ||
+        preempt >= (1u << pbits) || sub >= (1u << sbits)) {
+        return DRV_ERR_PARAM;
+    }
+    prio = ((preempt << sbits) | sub) << (8u - NVIC_PRIO_BITS);
+    reg = irq_prio_reg(irqn, &shift);
+    primask = stm32_irq_save();
+    REG_MODIFY(*reg, 0xFFu << shift, prio << shift);
+    stm32_irq_restore(primask);
+    return DRV_OK;
+}
+
+uint8_t irq_priority(irqn_t irqn)
+{
+    volatile uint32_t *reg;
+    uint32_t shift;
+
+    if (!irq_valid(irqn) || (int)irqn < (int)MemoryManagement_IRQn) {
+        return 0u;
+    }
+    reg = irq_prio_reg(irqn, &shift);
+    return (uint8_t)(REG_READ(*reg) >> shift);
+}
+
+void irq_enable(irqn_t irqn)
+{
+    if (irq_line(irqn)) {
+        REG_WRITE(NVIC->ISER[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+    }
+}
+
+void irq_disable(irqn_t irqn)
+{
+    if (irq_line(irqn)) {
+        REG_WRITE(NVIC->ICER[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+        /* Not taken any more once this returns. */
+        stm32_dsb();
+        stm32_isb();
+    }
+}
+
+bool irq_enabled(irqn_t irqn)
+{
+    return irq_line(irqn) &&
+           REG_TEST_BITS(NVIC->ISER[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+}
+
+void irq_set_pending(irqn_t irqn)
+{
+    if (irq_line(irqn)) {
+        REG_WRITE(NVIC->ISPR[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+    }
+}
+
+void irq_clear_pending(irqn_t irqn)
+{
+    if (irq_line(irqn)) {
+        REG_WRITE(NVIC->ICPR[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+    }
+}
+
+bool irq_pending(irqn_t irqn)
+{
+    return irq_line(irqn) &&
+           REG_TEST_BITS(NVIC->ISPR[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+}
+
+bool irq_active(irqn_t irqn)
+{
+    return irq_line(irqn) &&
+           REG_TEST_BITS(NVIC->IABR[(uint32_t)irqn / 32u], 1u << ((uint32_t)irqn % 32u));
+}
+
+void irq_trigger(irqn_t irqn)
+{
+    if (irq_line(irqn)) {
+        REG_WRITE(SCB->STIR, (uint32_t)irqn);
+    }
+}
+
+static void irq_probe(void)
+{
+    irq_probe_stamp = bench_cycles();
+    irq_probe_hit = 1u;
+}
+
+static void irq_sort(uint32_t *v, uint32_t n)
+{
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 1; i < n; i++) {
+        uint32_t x = v[i];
+
+        for (j = i; j > 0u && v[j - 1u] > x; j--) {
+            v[j] = v[j - 1u];
+        }
+        v[j] = x;
+    }
+}
+
+drv_status_t irq_measure_latency(irqn_t irqn, uint32_t samples, bench_result_t *out)
+{
+    uint32_t overhead = UINT32_MAX;
+    irq_handler_t prev;
+    bool was_enabled;
+    drv_status_t rc = DRV_OK;
+    uint32_t i;
+    uint32_t n;
+
+    if (!irq_line(irqn) || out == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    if (samples == 0u || samples > BENCH_MAX_SAMPLES) {
+        samples = BENCH_MAX_SAMPLES;
+    }
+    for (i = 0; i < 16u; i++) {
+        uint32_t t0 = bench_cycles();
+        uint32_t d = bench_cycles() - t0;
+
+        if (d < overhead) {
+            overhead = d;
+        }
+    }
+
+    was_enabled = irq_enabled(irqn);
+    prev = irq_set_handler(irqn, irq_probe);
+    irq_clear_pending(irqn);
+    irq_enable(irqn);
+    for (i = 0; i < samples && rc == DRV_OK; i++) {
+        uint32_t t0;
+        uint32_t d;
+
+        irq_probe_hit = 0u;
+        t0 = bench_cycles();
+        irq_trigger(irqn);
+        for (n = 0; irq_probe_hit == 0u; n++) {
+            if (n == IRQ_PROBE_TIMEOUT) {
+                rc = DRV_ERR_TIMEOUT;
+                break;
+            }
+        }
+        d = irq_probe_stamp - t0;
+        irq_samples[i] = (d > overhead) ? d - overhead : 0u;
+    }
+    if (!was_enabled) {
+        irq_disable(irqn);
+    }
+    irq_clear_pending(irqn);
+    (void)irq_set_handler(irqn, prev);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+
+    irq_sort(irq_samples, samples);
+    out->min = irq_samples[0];
+    out->median = irq_samples[samples / 2u];
+    out->max = irq_samples[samples - 1u];
+    return DRV_OK;
+}
+
+STM32_WEAK void irq_unhandled(void)
+{
+    for (;;) {
+    }
+}
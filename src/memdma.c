@@ -0,0 +1,254 @@
+/**
+ * @file    memdma.c
+ * @brief   memcpy/memset offloaded to a memory-to-memory DMA stream.
+ */
+#include <string.h>
+
+#include "memdma.h"
+
+/* The host build without the simulator has RAM where the streams would be. */
+#if defined(STM32_HOST) && !defined(STM32_SIM)
+#define MEMDMA_HW_PRESENT   0
+#else
+#define MEMDMA_HW_PRESENT   1
+#endif
+
+/* Destination alignment the CPU establishes: one four-word burst. */
+#define MEMDMA_ALIGN        16u
+
+/* NDTR limit, rounded down to whole bursts / packed words. */
+#define MEMDMA_CHUNK_MAX    0xFFFFu
+#define MEMDMA_CHUNK_PACKED 0xFFFCu
+
+static void memdma_event(void *ctx, uint32_t events);
+
+drv_status_t memdma_init(memdma_t *m)
+{
+    if (m == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    m->dma = NULL;
+    m->copy_min = MEMDMA_COPY_MIN_BYTES;
+    m->set_min = MEMDMA_SET_MIN_BYTES;
+    m->busy = false;
+    m->status = DRV_OK;
+#if MEMDMA_HW_PRESENT
+    return dma_alloc(DMA_REQ_MEM, &m->dma);
+#else
+    return DRV_OK;
+#endif
+}
+
+void memdma_deinit(memdma_t *m)
+{
+    if (m->dma != NULL) {
+        dma_free(m->dma);
+        m->dma = NULL;
+    }
+    m->busy = false;
+}
+
+static void memdma_finish(memdma_t *m, drv_status_t status)
+{
+    memdma_cb_t cb = m->cb;
+
+    m->status = status;
+    m->busy = false;
+    if (cb != NULL) {
+        cb(m->ctx, status);
+    }
+}
+
+static drv_status_t memdma_next(memdma_t *m)
+{
+    size_t items = m->left >> m->shift;
+    size_t bytes;
+
+    if (items > m->chunk) {
+        items = m->chunk;
+    }
+    bytes = items << m->shift;
+    m->xfer = (dma_xfer_t){
+        .periph = REG_ADDR((m->src != NULL) ? (const void *)m->src : (const void *)&m->pattern),
+        .mem0 = m->dst,
+        .count = (uint16_t)items,
+        .cb = memdma_event,
+        .ctx = m,
+    };
+    m->dst += bytes;
+    if (m->src != NULL) {
+        m->src += bytes;
+    }
+    m->left -= bytes;
+    return dma_submit(m->dma, &m->xfer);
+}
+
+/*
+ * Hand [m->dst, m->dst + len) to the stream, @p psize items at a time,
+ * with @p burst.  The CPU has already done everything outside it.
+ */
+static drv_status_t memdma_start(memdma_t *m, size_t len, uint8_t psize, uint8_t burst,
+                                 memdma_cb_t cb, void *ctx)
+{
+    const dma_config_t cfg = {
+        .dir = DMA_DIR_M2M,
+        .psize = psize,
+        .msize = DMA_SIZE_WORD,
+        .priority = 0,
+        .pinc = (m->src != NULL),
+        .minc = true,
+        .fifo = true,
+        .burst = burst,
+    };
+    drv_status_t rc;
+
+    m->cb = cb;
+    m->ctx = ctx;
+    if (len == 0u) {
+        memdma_finish(m, DRV_OK);
+        return DRV_OK;
+    }
+    rc = dma_configure(m->dma, &cfg);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    m->left = len;
+    m->shift = psize;
+    m->chunk = (burst != DMA_BURST_SINGLE || psize != DMA_SIZE_WORD) ?
+               MEMDMA_CHUNK_PACKED : MEMDMA_CHUNK_MAX;
+    m->status = DRV_OK;
+    m->busy = true;
+    rc = memdma_next(m);
+    if (rc != DRV_OK) {
+        m->busy = false;
+    }
+    return rc;
+}
+
+drv_status_t memdma_copy(memdma_t *m, void *dst, const void *src, size_t len,
+                         memdma_cb_t cb, void *ctx)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    size_t head;
+    size_t tail;
+    uint8_t psize;
+    uint8_t burst = DMA_BURST_SINGLE;
+
+    if (m == NULL || (len != 0u && (dst == NULL || src == NULL))) {
+        return DRV_ERR_PARAM;
+    }
+    if (m->busy) {
+        return DRV_ERR_BUSY;
+    }
+    if (m->dma == NULL || len < m->copy_min || len < MEMDMA_ALIGN) {
+        memcpy(d, s, len);
+        m->status = DRV_OK;
+        if (cb != NULL) {
+            cb(ctx, DRV_OK);
+        }
+        return DRV_OK;
+    }
+
+    head = (0u - (uintptr_t)d) & (MEMDMA_ALIGN - 1u);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+
+    if (((uintptr_t)s & (MEMDMA_ALIGN - 1u)) == 0u) {
+        psize = DMA_SIZE_WORD;
+        burst = DMA_BURST_INCR4;
+        tail = len & (MEMDMA_ALIGN - 1u);
+    } else {
+        /* Unaligned sources are read in bytes and packed by the FIFO. */
+        psize = (((uintptr_t)s & 3u) == 0u) ? DMA_SIZE_WORD : DMA_SIZE_BYTE;
+        tail = len & 3u;
+    }
+    len -= tail;
+    memcpy(d + len, s + len, tail);
+
+    m->dst = d;
+    m->src = s;
+    return memdma_start(m, len, psize, burst, cb, ctx);
+}
+
+drv_status_t memdma_set(memdma_t *m, void *dst, uint8_t value, size_t len,
+                        memdma_cb_t cb, void *ctx)
+{
+    uint8_t *d = dst;
+    size_t head;
+    size_t tail;
+
+    if (m == NULL || (len != 0u && dst == NULL)) {
+        return DRV_ERR_PARAM;
+    }
+    if (m->busy) {
+        return DRV_ERR_BUSY;
+    }
+    if (m->dma == NULL || len < m->set_min || len < MEMDMA_ALIGN) {
+        memset(d, value, len);
+        m->status = DRV_OK;
+        if (cb != NULL) {
+            cb(ctx, DRV_OK);
+        }
+        return DRV_OK;
+    }
+
+    head = (0u - (uintptr_t)d) & (MEMDMA_ALIGN - 1u);
+    memset(d, value, head);
+    d += head;
+    len -= head;
+    tail = len & (MEMDMA_ALIGN - 1u);
+    len -= tail;
+    memset(d + len, value, tail);
+
+    m->pattern = value * 0x01010101u;
+    m->dst = d;
+    m->src = NULL;
+    return memdma_start(m, len, DMA_SIZE_WORD, DMA_BURST_INCR4, cb, ctx);
+}
+
+static void memdma_event(void *ctx, uint32_t events)
+{
+    memdma_t *m = ctx;
+    drv_status_t rc;
+
+    if ((events & DMA_FLAG_TEIF) != 0u) {
+        dma_abort(m->dma);
+        memdma_finish(m, DRV_ERR_HW);
+        return;
+    }
+    if ((events & DMA_FLAG_TCIF) == 0u) {
+        return;
+    }
+    if (m->left == 0u) {
+        memdma_finish(m, DRV_OK);
+        return;
+    }
+    rc = memdma_next(m);
+    if (rc != DRV_OK) {
+        memdma_finish(m, rc);
+    }
+}
+
+bool memdma_poll(memdma_t *m)
+{
+    if (m->busy && m->dma != NULL) {
+        /* Masked, so the stream interrupt cannot service the flags twice. */
+        uint32_t primask = stm32_irq_save();
+
+        if ((dma_flags(m->dma) & (DMA_FLAG_TCIF | DMA_FLAG_TEIF)) != 0u) {
+            dma_irq(m->dma->dma, m->dma->stream);
+        }
+        stm32_irq_restore(primask);
+    }
+    return m->busy;
+}
+
+drv_status_t memdma_wait(memdma_t *m)
+{
+    while (memdma_poll(m)) {
+    }
+    return m->status;
+}
@@ -0,0 +1,235 @@
+/**
+ * @file    pwm.c
+ * @brief   Multi-channel PWM on a timer, duty cycles streamed by DMA burst.
+ */
+#include "pwm.h"
+#include "rcc.h"
+
+/* Polls for the priming burst; it is a few bus cycles per channel. */
+#define PWM_BURST_TIMEOUT   10000u
+
+typedef struct {
+    tim_regs_t *tim;
+    bool apb2;
+    uint32_t en;
+    dma_req_t req;
+} pwm_hw_t;
+
+static const pwm_hw_t pwm_hw[] = {
+    { TIM1, true,  RCC_APB2ENR_TIM1EN, DMA_REQ_TIM1_UP },
+    { TIM2, false, RCC_APB1ENR_TIM2EN, DMA_REQ_TIM2_UP },
+    { TIM3, false, RCC_APB1ENR_TIM3EN, DMA_REQ_TIM3_UP },
+    { TIM4, false, RCC_APB1ENR_TIM4EN, DMA_REQ_TIM4_UP },
+    { TIM5, false, RCC_APB1ENR_TIM5EN, DMA_REQ_TIM5_UP },
+    { TIM8, true,  RCC_APB2ENR_TIM8EN, DMA_REQ_TIM8_UP },
+};
+
+static void pwm_dma_event(void *ctx, uint32_t events);
+
+static const pwm_hw_t *pwm_hw_find(const tim_regs_t *tim)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(pwm_hw); i++) {
+        if (pwm_hw[i].tim == tim) {
+            return &pwm_hw[i];
+        }
+    }
+    return NULL;
+}
+
+drv_status_t pwm_init(pwm_t *h, tim_regs_t *tim, const pwm_config_t *cfg)
+{
+    const pwm_hw_t *hw = pwm_hw_find(tim);
+    uint32_t ccmr[2] = { 0 };
+    uint32_t ccer = 0;
+    uint32_t clk;
+    uint32_t ticks;
+    uint32_t psc;
+    uint32_t period;
+    uint32_t ch;
+    drv_status_t rc;
+
+    if (h == NULL || hw == NULL || cfg == NULL || cfg->freq_hz == 0u ||
+        cfg->nchannels == 0u || cfg->nchannels > PWM_MAX_CHANNELS) {
+        return DRV_ERR_PARAM;
+    }
+    clk = rcc_timer_clock(rcc_current(), hw->apb2);
+    ticks = (clk + cfg->freq_hz / 2u) / cfg->freq_hz;
+    if (ticks < 2u) {
+        return DRV_ERR_PARAM;
+    }
+    /* Finest resolution: the smallest prescaler that fits a 16-bit duty. */
+    psc = (ticks - 1u) / 0xFFFFu;
+    period = (ticks + psc / 2u) / (psc + 1u);
+    if (psc > 0xFFFFu) {
+        return DRV_ERR_PARAM;
+    }
+
+    rc = dma_alloc(hw->req, &h->dma);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->tim = tim;
+    h->nch = cfg->nchannels;
+    h->advanced = (tim == TIM1 || tim == TIM8);
+    h->loop = false;
+    h->nframes = 0;
+    h->period = period;
+    h->freq_hz = clk / ((psc + 1u) * period);
+    h->cb = cfg->cb;
+    h->ctx = cfg->ctx;
+
+    for (ch = 1; ch <= cfg->nchannels; ch++) {
+        ccmr[(ch - 1u) / 2u] |= reg_field_prep(TIM_CCMR_OCM(ch), TIM_OCM_PWM1) |
+                                TIM_CCMR_OCPE(ch);
+        ccer |= TIM_CCER_CCE(ch) | (cfg->active_low ? TIM_CCER_CCP(ch) : 0u);
+        REG_WRITE(tim->CCR[ch - 1u], 0u);
+    }
+
+    if (hw->apb2) {
+        REG_SET_BITS(RCC->APB2ENR, hw->en);
+    } else {
+        REG_SET_BITS(RCC->APB1ENR, hw->en);
+    }
+    REG_WRITE(tim->CR1, TIM_CR1_ARPE);
+    REG_WRITE(tim->DIER, 0u);
+    REG_WRITE(tim->PSC, psc);
+    REG_WRITE(tim->ARR, period - 1u);
+    REG_WRITE(tim->CCMR1, ccmr[0]);
+    REG_WRITE(tim->CCMR2, ccmr[1]);
+    REG_WRITE(tim->CCER, ccer);
+    REG_WRITE(tim->DCR, reg_field_prep(TIM_DCR_DBA, TIM_DBA(CCR[0])) |
+                        reg_field_prep(TIM_DCR_DBL, cfg->nchannels - 1u));
+    /* Load PSC, ARR and the zero duties before the outputs come on. */
+    REG_WRITE(tim->EGR, TIM_EGR_UG);
+    REG_WRITE(tim->SR, 0u);
+    if (h->advanced) {
+        REG_WRITE(tim->BDTR, TIM_BDTR_MOE);
+    }
+    return DRV_OK;
+}
+
+/* Stop the waveform stream; duties already loaded stay. */
+static void pwm_dma_stop(pwm_t *h)
+{
+    REG_CLR_BITS(h->tim->DIER, TIM_DIER_UDE);
+    dma_abort(h->dma);
+}
+
+drv_status_t pwm_start(pwm_t *h, const uint16_t *table, uint16_t nframes, bool loop)
+{
+    const dma_config_t dcfg = {
+        .dir = DMA_DIR_M2P, .psize = DMA_SIZE_HALFWORD, .msize = DMA_SIZE_HALFWORD,
+        .priority = 3u, .minc = true, .circular = loop, .half = loop,
+    };
+    const uint32_t total = (uint32_t)nframes * h->nch;
+    uint32_t n;
+    drv_status_t rc;
+
+    if (table == NULL || nframes < 2u || total > 0xFFFFu ||
+        (loop && (nframes & 1u) != 0u)) {
+        return DRV_ERR_PARAM;
+    }
+    REG_CLR_BITS(h->tim->CR1, TIM_CR1_CEN);
+    pwm_dma_stop(h);
+    (void)dma_configure(h->dma, &dcfg);
+    h->loop = loop;
+    h->nframes = nframes;
+    h->xfer = (dma_xfer_t){
+        .periph = REG_ADDR(&h->tim->DMAR),
+        .mem0 = (void *)(uintptr_t)table,
+        .count = (uint16_t)total,
+        .cb = pwm_dma_event,
+        .ctx = h,
+    };
+    rc = dma_submit(h->dma, &h->xfer);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+
+    /*
+     * Prime with the counter stopped.  The first UG bursts frame 0 into the
+     * preload registers; the second makes it active and bursts frame 1, which
+     * the first overflow then activates.  URS = 0: UG must request DMA.
+     */
+    REG_CLR_BITS(h->tim->CR1, TIM_CR1_URS);
+    REG_SET_BITS(h->tim->DIER, TIM_DIER_UDE);
+    REG_WRITE(h->tim->EGR, TIM_EGR_UG);
+    for (n = 0; dma_remaining(h->dma) > total - h->nch; n++) {
+        if (n == PWM_BURST_TIMEOUT) {
+            pwm_dma_stop(h);
+            return DRV_ERR_TIMEOUT;
+        }
+    }
+    REG_WRITE(h->tim->EGR, TIM_EGR_UG);
+    REG_WRITE(h->tim->SR, 0u);
+    REG_SET_BITS(h->tim->CR1, TIM_CR1_CEN);
+    return DRV_OK;
+}
+
+void pwm_set(pwm_t *h, const uint16_t *duty)
+{
+    uint32_t ch;
+
+    pwm_dma_stop(h);
+    for (ch = 0; ch < h->nch; ch++) {
+        REG_WRITE(h->tim->CCR[ch], duty[ch]);
+    }
+    if (!REG_TEST_BITS(h->tim->CR1, TIM_CR1_CEN)) {
+        /* Not running: load the duties now instead of after a period. */
+        REG_WRITE(h->tim->EGR, TIM_EGR_UG);
+        REG_WRITE(h->tim->SR, 0u);
+        REG_SET_BITS(h->tim->CR1, TIM_CR1_CEN);
+    }
+}
+
+void pwm_stop(pwm_t *h)
+{
+    uint32_t ch;
+
+    REG_CLR_BITS(h->tim->CR1, TIM_CR1_CEN);
+    pwm_dma_stop(h);
+    for (ch = 0; ch < h->nch; ch++) {
+        REG_WRITE(h->tim->CCR[ch], 0u);
+    }
+    REG_WRITE(h->tim->EGR, TIM_EGR_UG);
+    REG_WRITE(h->tim->SR, 0u);
+}
+
+void pwm_deinit(pwm_t *h)
+{
+    pwm_stop(h);
+    if (h->advanced) {
+        REG_WRITE(h->tim->BDTR, 0u);
+    }
+    REG_WRITE(h->tim->CCER, 0u);
+    dma_free(h->dma);
+}
+
+static void pwm_dma_event(void *ctx, uint32_t events)
+{
+    pwm_t *h = ctx;
+    uint32_t half = h->nframes / 2u;
+
+    if ((events & (DMA_FLAG_TEIF | DMA_FLAG_DMEIF)) != 0u) {
+        /* Hold the duties already loaded rather than play garbage. */
+        pwm_dma_stop(h);
+        return;
+    }
+    if (!h->loop) {
+        if ((events & DMA_FLAG_TCIF) != 0u) {
+            REG_CLR_BITS(h->tim->DIER, TIM_DIER_UDE);
+            if (h->cb != NULL) {
+                h->cb(h->ctx, 0, h->nframes);
+            }
+        }
+        return;
+    }
+    if ((events & DMA_FLAG_HTIF) != 0u && h->cb != NULL) {
+        h->cb(h->ctx, 0, half);
+    }
+    if ((events & DMA_FLAG_TCIF) != 0u && h->cb != NULL) {
+        h->cb(h->ctx, half, h->nframes - half);
+    }
+}
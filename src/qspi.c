@@ -0,0 +1,544 @@
+/**
+ * @file    qspi.c
+ * @brief   Serial NOR flash on the QUADSPI.
+ */
+#include <string.h>
+
+#include "qspi.h"
+#include "rcc.h"
+
+/*
+ * Polls of SR per command or page transfer, and for the flash's busy time
+ * per operation.  The auto-polling itself is hardware; these only bound
+ * the wait loops (a status read on the bus is a few hundred ns, so the
+ * limits are several times the worst-case datasheet times).
+ */
+#define QSPI_CMD_TIMEOUT    100000u
+#define QSPI_PAGE_TIMEOUT   1000000u
+#define QSPI_ERASE_TIMEOUT  100000000u
+#define QSPI_CHIP_TIMEOUT   0xFFFFFFFFu
+
+/* Commands (JESD216 basic set) */
+#define QSPI_WRITE_STATUS   0x01u
+#define QSPI_PAGE_PROGRAM   0x02u
+#define QSPI_READ_STATUS    0x05u
+#define QSPI_WRITE_ENABLE   0x06u
+#define QSPI_SECTOR_ERASE   0x20u
+#define QSPI_READ_STATUS2   0x35u
+#define QSPI_RESET_ENABLE   0x66u
+#define QSPI_RESET          0x99u
+#define QSPI_READ_ID        0x9Fu
+#define QSPI_CHIP_ERASE     0xC7u
+#define QSPI_BLOCK_ERASE    0xD8u
+#define QSPI_QUAD_READ      0xEBu       /* 1-4-4 with a mode byte */
+
+/* Status register 1 and 2 */
+#define QSPI_SR1_WIP        REG_BIT(0)  /* Write in progress */
+#define QSPI_SR1_WEL        REG_BIT(1)  /* Write enable latch */
+#define QSPI_SR1_QE         REG_BIT(6)
+#define QSPI_SR2_QE         REG_BIT(1)
+
+/* 0xEB mode byte: anything but the vendor's continuous-read pattern. */
+#define QSPI_MODE_BYTE      0xFFu
+/* Flash clock cycles between two automatic status reads. */
+#define QSPI_POLL_INTERVAL  16u
+/* Minimum CS high time between commands, ns (tSHSL). */
+#define QSPI_CS_HIGH_NS     50u
+
+/* One-line instruction with @p admode address and @p dmode data phases. */
+static uint32_t qspi_ccr(uint32_t ins, uint32_t fmode, uint32_t admode, uint32_t dmode)
+{
+    return reg_field_prep(QUADSPI_CCR_INSTRUCTION, ins) |
+           reg_field_prep(QUADSPI_CCR_IMODE, QUADSPI_LINES_1) |
+           reg_field_prep(QUADSPI_CCR_ADMODE, admode) |
+           reg_field_prep(QUADSPI_CCR_ADSIZE, 2u) |
+           reg_field_prep(QUADSPI_CCR_DMODE, dmode) |
+           reg_field_prep(QUADSPI_CCR_FMODE, fmode);
+}
+
+/* Stop whatever runs (a command, polling, memory-mapped reads). */
+static drv_status_t qspi_abort(qspi_t *h)
+{
+    quadspi_regs_t *q = h->qspi;
+    uint32_t n;
+
+    REG_SET_BITS(q->CR, QUADSPI_CR_ABORT);
+    for (n = 0; REG_TEST_BITS(q->CR, QUADSPI_CR_ABORT) ||
+                REG_TEST_BITS(q->SR, QUADSPI_SR_BUSY); n++) {
+        if (n == QSPI_CMD_TIMEOUT) {
+            return DRV_ERR_TIMEOUT;
+        }
+    }
+    REG_CLR_BITS(q->CR, QUADSPI_CR_DMAEN);
+    REG_WRITE(q->FCR, QUADSPI_FCR_ALL);
+    return DRV_OK;
+}
+
+static void qspi_dma_event(void *ctx, uint32_t events)
+{
+    qspi_t *h = ctx;
+
+    if ((events & DMA_FLAG_TEIF) != 0u) {
+        h->dma_error = true;
+    }
+    h->dma_busy = false;
+}
+
+/* Retire the stream's transfer from thread mode, for a disabled line. */
+static void qspi_dma_poll(qspi_t *h)
+{
+    uint32_t primask = stm32_irq_save();
+
+    if ((dma_flags(h->dma) & (DMA_FLAG_TCIF | DMA_FLAG_TEIF)) != 0u) {
+        dma_irq(h->dma->dma, h->dma->stream);
+    }
+    stm32_irq_restore(primask);
+}
+
+/*
+ * Wait for @p flag in SR, and for the DMA transfer if one is running.  On
+ * failure the QUADSPI and the stream are stopped.
+ */
+static drv_status_t qspi_wait(qspi_t *h, uint32_t flag, uint32_t limit)
+{
+    quadspi_regs_t *q = h->qspi;
+    drv_status_t rc = DRV_OK;
+    uint32_t sr;
+    uint32_t n;
+
+    for (n = 0;; n++) {
+        sr = REG_READ(q->SR);
+        if ((sr & QUADSPI_SR_TEF) != 0u || h->dma_error) {
+            rc = DRV_ERR_HW;
+            break;
+        }
+        if ((sr & flag) != 0u && !h->dma_busy) {
+            break;
+        }
+        if (n == limit) {
+            h->timeouts++;
+            rc = DRV_ERR_TIMEOUT;
+            break;
+        }
+        if (h->dma_busy) {
+            qspi_dma_poll(h);
+        }
+    }
+    if (rc != DRV_OK) {
+        if (h->dma_busy) {
+            dma_abort(h->dma);
+            h->dma_busy = false;
+        }
+        (void)qspi_abort(h);
+        return rc;
+    }
+    REG_WRITE(q->FCR, QUADSPI_FCR_ALL);
+    return DRV_OK;
+}
+
+/* Instruction only, or with alternate bytes @p ab (@p ab_len of them, 0..2). */
+static drv_status_t qspi_command(qspi_t *h, uint32_t ins, uint32_t ab, uint32_t ab_len)
+{
+    quadspi_regs_t *q = h->qspi;
+    uint32_t ccr = qspi_ccr(ins, QUADSPI_FMODE_WRITE, QUADSPI_LINES_NONE, QUADSPI_LINES_NONE);
+
+    if (ab_len != 0u) {
+        REG_WRITE(q->ABR, ab);
+        ccr |= reg_field_prep(QUADSPI_CCR_ABMODE, QUADSPI_LINES_1) |
+               reg_field_prep(QUADSPI_CCR_ABSIZE, ab_len - 1u);
+    }
+    REG_WRITE(q->CCR, ccr);
+    return qspi_wait(h, QUADSPI_SR_TCF, QSPI_CMD_TIMEOUT);
+}
+
+/* Read @p len (1..4) register bytes; the first received ends up in bits 7:0. */
+static drv_status_t qspi_read_reg(qspi_t *h, uint32_t ins, uint32_t len, uint32_t *out)
+{
+    quadspi_regs_t *q = h->qspi;
+    drv_status_t rc;
+
+    REG_WRITE(q->DLR, len - 1u);
+    REG_WRITE(q->CCR, qspi_ccr(ins, QUADSPI_FMODE_READ, QUADSPI_LINES_NONE, QUADSPI_LINES_1));
+    rc = qspi_wait(h, QUADSPI_SR_TCF, QSPI_CMD_TIMEOUT);
+    if (rc == DRV_OK) {
+        *out = REG_READ(q->DR) & (0xFFFFFFFFu >> (32u - 8u * len));
+    }
+    return rc;
+}
+
+/*
+ * Let the QUADSPI read status register 1 every QSPI_POLL_INTERVAL clocks
+ * until (SR1 & @p mask) == @p match.
+ */
+static drv_status_t qspi_poll(qspi_t *h, uint32_t mask, uint32_t match, uint32_t limit)
+{
+    quadspi_regs_t *q = h->qspi;
+
+    REG_WRITE(q->PSMKR, mask);
+    REG_WRITE(q->PSMAR, match);
+    REG_WRITE(q->PIR, QSPI_POLL_INTERVAL);
+    REG_WRITE(q->DLR, 0u);
+    REG_MODIFY(q->CR, QUADSPI_CR_PMM, QUADSPI_CR_APMS);
+    REG_WRITE(q->CCR, qspi_ccr(QSPI_READ_STATUS, QUADSPI_FMODE_POLL, QUADSPI_LINES_NONE,
+                               QUADSPI_LINES_1));
+    h->polls++;
+    return qspi_wait(h, QUADSPI_SR_SMF, limit);
+}
+
+static drv_status_t qspi_write_enable(qspi_t *h)
+{
+    drv_status_t rc = qspi_command(h, QSPI_WRITE_ENABLE, 0u, 0u);
+
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    return qspi_poll(h, QSPI_SR1_WEL, QSPI_SR1_WEL, QSPI_CMD_TIMEOUT);
+}
+
+/* Write-enabled command with an address and no data: an erase. */
+static drv_status_t qspi_erase_cmd(qspi_t *h, uint32_t ins, uint32_t addr, bool has_addr,
+                                   uint32_t limit)
+{
+    quadspi_regs_t *q = h->qspi;
+    drv_status_t rc;
+
+    rc = qspi_write_enable(h);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_WRITE(q->CCR, qspi_ccr(ins, QUADSPI_FMODE_WRITE,
+                               has_addr ? QUADSPI_LINES_1 : QUADSPI_LINES_NONE,
+                               QUADSPI_LINES_NONE));
+    if (has_addr) {
+        REG_WRITE(q->AR, addr);
+    }
+    rc = qspi_wait(h, QUADSPI_SR_TCF, QSPI_CMD_TIMEOUT);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->erases++;
+    return qspi_poll(h, QSPI_SR1_WIP, 0u, limit);
+}
+
+/*
+ * Program @p n bytes at @p addr, within one page.  The data go through
+ * h->page widened to whole words with 0xFF on either side, so the DMA
+ * moves words into the FIFO; the padding programs nothing.
+ */
+static drv_status_t qspi_program(qspi_t *h, uint32_t addr, const uint8_t *src, uint32_t n)
+{
+    quadspi_regs_t *q = h->qspi;
+    const dma_config_t cfg = {
+        .dir = DMA_DIR_M2P,
+        .psize = DMA_SIZE_WORD,
+        .msize = DMA_SIZE_WORD,
+        .priority = h->dma_priority,
+        .minc = true,
+    };
+    uint32_t head = addr & 3u;
+    uint32_t len = (head + n + 3u) & ~3u;
+    drv_status_t rc;
+
+    memset(h->page, 0xFF, len);
+    memcpy(&h->page[head], src, n);
+    rc = qspi_write_enable(h);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    rc = dma_configure(h->dma, &cfg);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->xfer = (dma_xfer_t){
+        .periph = REG_ADDR(&q->DR),
+        .mem0 = h->page,
+        .count = (uint16_t)(len / 4u),
+        .cb = qspi_dma_event,
+        .ctx = h,
+    };
+    h->dma_busy = true;
+    h->dma_error = false;
+    REG_WRITE(q->DLR, len - 1u);
+    REG_SET_BITS(q->CR, QUADSPI_CR_DMAEN);
+    rc = dma_submit(h->dma, &h->xfer);
+    if (rc != DRV_OK) {
+        h->dma_busy = false;
+        REG_CLR_BITS(q->CR, QUADSPI_CR_DMAEN);
+        return rc;
+    }
+    REG_WRITE(q->CCR, qspi_ccr(QSPI_PAGE_PROGRAM, QUADSPI_FMODE_WRITE, QUADSPI_LINES_1,
+                               QUADSPI_LINES_1));
+    REG_WRITE(q->AR, addr - head);
+    rc = qspi_wait(h, QUADSPI_SR_TCF, QSPI_CMD_TIMEOUT);
+    REG_CLR_BITS(q->CR, QUADSPI_CR_DMAEN);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->pages++;
+    return qspi_poll(h, QSPI_SR1_WIP, 0u, QSPI_PAGE_TIMEOUT);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Memory-mapped mode                                                       */
+/* ------------------------------------------------------------------------ */
+
+static void qspi_map(qspi_t *h)
+{
+    quadspi_regs_t *q = h->qspi;
+
+    if (h->mapped) {
+        return;
+    }
+    REG_WRITE(q->FCR, QUADSPI_FCR_ALL);
+    REG_WRITE(q->ABR, QSPI_MODE_BYTE);
+    REG_WRITE(q->CCR, h->map_ccr);
+    h->mapped = true;
+}
+
+static drv_status_t qspi_unmap(qspi_t *h)
+{
+    if (!h->mapped) {
+        return DRV_OK;
+    }
+    h->mapped = false;
+    return qspi_abort(h);
+}
+
+/* Contents under [addr, addr + len) changed: drop stale cached lines. */
+static void qspi_changed(qspi_t *h, uint32_t addr, uint32_t len)
+{
+    (void)h;
+    cache_invalidate((uint8_t *)QSPIMEM->B + addr, len);
+}
+
+static bool qspi_range_ok(const qspi_t *h, uint32_t addr, size_t len)
+{
+    return h != NULL && h->size != 0u && len != 0u && addr < h->size &&
+           len <= h->size - addr;
+}
+
+const void *qspi_ptr(const qspi_t *h, uint32_t addr)
+{
+    (void)h;
+    return (const uint8_t *)QSPIMEM->B + addr;
+}
+
+drv_status_t qspi_read(qspi_t *h, uint32_t addr, void *buf, size_t len)
+{
+    if (!qspi_range_ok(h, addr, len) || buf == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    qspi_map(h);
+    memcpy(buf, qspi_ptr(h, addr), len);
+    return DRV_OK;
+}
+
+drv_status_t qspi_write(qspi_t *h, uint32_t addr, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    uint32_t start = addr;
+    uint32_t n;
+    drv_status_t rc;
+
+    if (!qspi_range_ok(h, addr, len) || buf == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    rc = qspi_unmap(h);
+    for (; rc == DRV_OK && len > 0u; addr += n, p += n, len -= n) {
+        n = QSPI_PAGE_SIZE - (addr & (QSPI_PAGE_SIZE - 1u));
+        if (n > len) {
+            n = (uint32_t)len;
+        }
+        rc = qspi_program(h, addr, p, n);
+    }
+    qspi_changed(h, start, addr - start);
+    qspi_map(h);
+    return rc;
+}
+
+drv_status_t qspi_erase(qspi_t *h, uint32_t addr, uint32_t len)
+{
+    uint32_t start = addr;
+    uint32_t end;
+    drv_status_t rc;
+
+    if (!qspi_range_ok(h, addr, len) || ((addr | len) & (QSPI_SECTOR_SIZE - 1u)) != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    end = addr + len;
+    rc = qspi_unmap(h);
+    if (rc == DRV_OK && addr == 0u && len == h->size) {
+        rc = qspi_erase_cmd(h, QSPI_CHIP_ERASE, 0u, false, QSPI_CHIP_TIMEOUT);
+        addr = end;
+    }
+    while (rc == DRV_OK && addr < end) {
+        if ((addr & (QSPI_BLOCK_SIZE - 1u)) == 0u && end - addr >= QSPI_BLOCK_SIZE) {
+            rc = qspi_erase_cmd(h, QSPI_BLOCK_ERASE, addr, true, QSPI_ERASE_TIMEOUT);
+            addr += QSPI_BLOCK_SIZE;
+        } else {
+            rc = qspi_erase_cmd(h, QSPI_SECTOR_ERASE, addr, true, QSPI_ERASE_TIMEOUT);
+            addr += QSPI_SECTOR_SIZE;
+        }
+    }
+    qspi_changed(h, start, len);
+    qspi_map(h);
+    return rc;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Initialisation                                                           */
+/* ------------------------------------------------------------------------ */
+
+/* Set the quad enable bit if the flash has one and it is clear. */
+static drv_status_t qspi_quad_enable(qspi_t *h, qspi_qe_t qe)
+{
+    uint32_t sr1;
+    uint32_t sr2 = 0;
+    drv_status_t rc;
+
+    if (qe == QSPI_QE_NONE) {
+        return DRV_OK;
+    }
+    rc = qspi_read_reg(h, QSPI_READ_STATUS, 1u, &sr1);
+    if (rc == DRV_OK && qe == QSPI_QE_SR2_BIT1) {
+        rc = qspi_read_reg(h, QSPI_READ_STATUS2, 1u, &sr2);
+    }
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    if ((qe == QSPI_QE_SR2_BIT1) ? (sr2 & QSPI_SR2_QE) != 0u : (sr1 & QSPI_SR1_QE) != 0u) {
+        return DRV_OK;
+    }
+    /* Non-volatile: written only when clear.  The value goes out as alternate bytes. */
+    rc = qspi_write_enable(h);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    if (qe == QSPI_QE_SR2_BIT1) {
+        rc = qspi_command(h, QSPI_WRITE_STATUS, (sr1 << 8) | sr2 | QSPI_SR2_QE, 2u);
+    } else {
+        rc = qspi_command(h, QSPI_WRITE_STATUS, sr1 | QSPI_SR1_QE, 1u);
+    }
+    if (rc == DRV_OK) {
+        rc = qspi_poll(h, QSPI_SR1_WIP, 0u, QSPI_ERASE_TIMEOUT);
+    }
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    rc = qspi_read_reg(h, (qe == QSPI_QE_SR2_BIT1) ? QSPI_READ_STATUS2 : QSPI_READ_STATUS, 1u,
+                       &sr1);
+    if (rc == DRV_OK &&
+        (sr1 & ((qe == QSPI_QE_SR2_BIT1) ? QSPI_SR2_QE : QSPI_SR1_QE)) == 0u) {
+        rc = DRV_ERR_HW;
+    }
+    return rc;
+}
+
+static drv_status_t qspi_flash_init(qspi_t *h, const qspi_config_t *cfg)
+{
+    uint32_t id;
+    drv_status_t rc;
+
+    /*
+     * Software reset, out of whatever a bootloader left behind.  Until the
+     * flash is back it drives nothing and the pulled-up lines read WIP
+     * set, so polling for WIP clear also waits out the reset time.
+     */
+    rc = qspi_command(h, QSPI_RESET_ENABLE, 0u, 0u);
+    if (rc == DRV_OK) {
+        rc = qspi_command(h, QSPI_RESET, 0u, 0u);
+    }
+    if (rc == DRV_OK) {
+        rc = qspi_poll(h, QSPI_SR1_WIP, 0u, QSPI_CMD_TIMEOUT);
+    }
+    if (rc == DRV_OK) {
+        rc = qspi_read_reg(h, QSPI_READ_ID, 3u, &id);
+    }
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->jedec_id = ((id & 0xFFu) << 16) | (id & 0xFF00u) | (id >> 16);
+    if (h->jedec_id == 0u || h->jedec_id == 0xFFFFFFu) {
+        return DRV_ERR_HW;
+    }
+    return qspi_quad_enable(h, cfg->qe);
+}
+
+static void qspi_stop(qspi_t *h)
+{
+    quadspi_regs_t *q = h->qspi;
+
+    (void)qspi_abort(h);
+    REG_WRITE(q->CR, 0u);
+    dma_free(h->dma);
+    h->dma = NULL;
+    h->size = 0;
+    h->mapped = false;
+}
+
+drv_status_t qspi_init(qspi_t *h, const qspi_config_t *cfg)
+{
+    quadspi_regs_t *q = QUADSPI;
+    uint32_t hclk = rcc_current()->hclk_hz;
+    uint32_t max_hz;
+    uint32_t div;
+    uint32_t csht;
+    drv_status_t rc;
+
+    if (h == NULL || cfg == NULL || cfg->size_log2 < 16u || cfg->size_log2 > 24u ||
+        cfg->dummy_cycles > 31u || cfg->qe > QSPI_QE_SR1_BIT6 || cfg->dma_priority > 3u) {
+        return DRV_ERR_PARAM;
+    }
+    memset(h, 0, sizeof(*h));
+    h->qspi = q;
+    h->dma_priority = cfg->dma_priority;
+    rc = dma_alloc(DMA_REQ_QUADSPI, &h->dma);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_SET_BITS(RCC->AHB3ENR, RCC_AHB3ENR_QSPIEN);
+    if (REG_TEST_BITS(q->CR, QUADSPI_CR_EN)) {
+        /* Memory-mapped by a bootloader, say: the settings are locked while busy. */
+        (void)qspi_abort(h);
+    }
+
+    max_hz = (cfg->max_hz != 0u) ? cfg->max_hz : QSPI_MAX_HZ;
+    div = (hclk + max_hz - 1u) / max_hz;
+    div = (div == 0u) ? 1u : (div > 256u) ? 256u : div;
+    h->clock_hz = hclk / div;
+    csht = (uint32_t)(((uint64_t)h->clock_hz * QSPI_CS_HIGH_NS + 999999999u) / 1000000000u);
+    csht = (csht == 0u) ? 1u : (csht > 8u) ? 8u : csht;
+    REG_WRITE(q->CR, 0u);
+    REG_WRITE(q->DCR, reg_field_prep(QUADSPI_DCR_FSIZE, cfg->size_log2 - 1u) |
+                      reg_field_prep(QUADSPI_DCR_CSHT, csht - 1u));
+    /* Half-cycle sample shift for the flash's output delay; a word per FIFO request. */
+    REG_WRITE(q->CR, reg_field_prep(QUADSPI_CR_PRESCALER, div - 1u) |
+                     reg_field_prep(QUADSPI_CR_FTHRES, 3u) | QUADSPI_CR_SSHIFT | QUADSPI_CR_EN);
+
+    h->map_ccr = reg_field_prep(QUADSPI_CCR_INSTRUCTION, QSPI_QUAD_READ) |
+                 reg_field_prep(QUADSPI_CCR_IMODE, QUADSPI_LINES_1) |
+                 reg_field_prep(QUADSPI_CCR_ADMODE, QUADSPI_LINES_4) |
+                 reg_field_prep(QUADSPI_CCR_ADSIZE, 2u) |
+                 reg_field_prep(QUADSPI_CCR_ABMODE, QUADSPI_LINES_4) |
+                 reg_field_prep(QUADSPI_CCR_DCYC, (cfg->dummy_cycles != 0u) ? cfg->dummy_cycles
+                                                                          : QSPI_DUMMY_CYCLES) |
+                 reg_field_prep(QUADSPI_CCR_DMODE, QUADSPI_LINES_4) |
+                 reg_field_prep(QUADSPI_CCR_FMODE, QUADSPI_FMODE_MAP);
+
+    rc = qspi_flash_init(h, cfg);
+    if (rc != DRV_OK) {
+        qspi_stop(h);
+        return rc;
+    }
+    h->size = 1u << cfg->size_log2;
+    qspi_map(h);
+    return DRV_OK;
+}
+
+void qspi_deinit(qspi_t *h)
+{
+    if (h->dma == NULL) {
+        return;
+    }
+    qspi_stop(h);
+}
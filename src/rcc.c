@@ -0,0 +1,284 @@
+/**
+ * @file    rcc.c
+ * @brief   Clock tree solver and switch sequence.
+ */
+#include "rcc.h"
+
+/* Ready-flag polls before giving up; oscillator start-up is a few ms at most. */
+#define RCC_READY_TIMEOUT   1000000u
+
+static const rcc_plan_t rcc_hsi_plan = {
+    .src_hz = RCC_HSI_HZ,
+    .hpre = 1, .ppre1 = 1, .ppre2 = 1,
+    .sysclk_hz = RCC_HSI_HZ,
+    .hclk_hz = RCC_HSI_HZ,
+    .pclk1_hz = RCC_HSI_HZ,
+    .pclk2_hz = RCC_HSI_HZ,
+};
+
+static rcc_plan_t rcc_plan = rcc_hsi_plan;
+
+static uint32_t rcc_limit(uint32_t req, uint32_t max)
+{
+    return (req == 0u || req > max) ? max : req;
+}
+
+/* Smallest power-of-two divider (1..16) that brings @p hz to at most @p max. */
+static uint8_t rcc_apb_div(uint32_t hz, uint32_t max)
+{
+    uint8_t d = 1;
+
+    while (d < 16u && hz / d > max) {
+        d = (uint8_t)(d * 2u);
+    }
+    return (hz / d > max) ? 0u : d;
+}
+
+/* Register encodings of the dividers. */
+static uint32_t rcc_ppre_bits(uint32_t div)
+{
+    uint32_t bits = 0;
+
+    if (div > 1u) {
+        bits = 4u;
+        while (div > 2u) {
+            div >>= 1;
+            bits++;
+        }
+    }
+    return bits;
+}
+
+static uint32_t rcc_hpre_bits(uint32_t div)
+{
+    uint32_t bits = 0;
+
+    if (div > 1u) {
+        bits = 8u;
+        while (div > 2u) {
+            div >>= 1;
+            bits++;
+        }
+        if (bits > 11u) {
+            bits--;             /* there is no /32 setting */
+        }
+    }
+    return bits;
+}
+
+static void rcc_consider(rcc_plan_t *best, uint32_t fin, uint32_t m, uint32_t n,
+                         uint32_t p, uint32_t q, uint32_t target)
+{
+    uint32_t vco = RCC_PLL_VCO(fin, m, n);
+    uint32_t sys = vco / p;
+
+    if (n < RCC_PLLN_MIN || n > RCC_PLLN_MAX || vco < RCC_VCO_OUT_MIN_HZ ||
+        vco > RCC_VCO_OUT_MAX_HZ || sys > target || vco / q > RCC_PLL48_HZ) {
+        return;
+    }
+    /* Strictly better only: the first hit at a given SYSCLK has the
+     * smallest M, i.e. the highest VCO input and the least PLL jitter. */
+    if (sys > best->sysclk_hz) {
+        best->pllm = (uint8_t)m;
+        best->plln = (uint16_t)n;
+        best->pllp = (uint8_t)p;
+        best->pllq = (uint8_t)q;
+        best->sysclk_hz = sys;
+        best->pll48_hz = vco / q;
+    }
+}
+
+drv_status_t rcc_solve(const rcc_request_t *req, rcc_plan_t *plan)
+{
+    rcc_plan_t best = { 0 };
+    uint32_t fin;
+    uint32_t target;
+    uint32_t mv;
+    uint32_t m;
+    uint32_t m_lo;
+    uint32_t m_hi;
+    uint32_t p;
+
+    if (req == NULL || plan == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    fin = (req->hse_hz != 0u) ? req->hse_hz : RCC_HSI_HZ;
+    target = rcc_limit(req->sysclk_max_hz, RCC_SYSCLK_MAX_HZ);
+    mv = (req->vdd_mv != 0u) ? req->vdd_mv : 3300u;
+
+    m_lo = (fin + RCC_VCO_IN_MAX_HZ - 1u) / RCC_VCO_IN_MAX_HZ;
+    m_hi = fin / RCC_VCO_IN_MIN_HZ;
+    if (m_lo < RCC_PLLM_MIN) {
+        m_lo = RCC_PLLM_MIN;
+    }
+    if (m_hi > RCC_PLLM_MAX) {
+        m_hi = RCC_PLLM_MAX;
+    }
+
+    for (m = m_lo; m <= m_hi; m++) {
+        for (p = 2u; p <= 8u; p += 2u) {
+            if (req->need_48mhz) {
+                /* VCO must be an exact multiple of 48 MHz. */
+                uint32_t q;
+
+                for (q = RCC_PLLQ_MIN; q <= RCC_PLLQ_MAX; q++) {
+                    uint64_t num = (uint64_t)RCC_PLL48_HZ * q * m;
+
+                    if (num % fin == 0u) {
+                        rcc_consider(&best, fin, m, (uint32_t)(num / fin), p, q, target);
+                    }
+                }
+            } else {
+                /* Highest N that stays at or below the target and VCO max. */
+                uint64_t n = (uint64_t)target * p * m / fin;
+                uint32_t vco;
+
+                if (n > RCC_PLLN_MAX) {
+                    n = RCC_PLLN_MAX;
+                }
+                while (n >= RCC_PLLN_MIN && RCC_PLL_VCO(fin, m, n) > RCC_VCO_OUT_MAX_HZ) {
+                    n--;
+                }
+                vco = RCC_PLL_VCO(fin, m, n);
+                rcc_consider(&best, fin, m, (uint32_t)n, p,
+                             (vco + RCC_PLL48_HZ - 1u) / RCC_PLL48_HZ < RCC_PLLQ_MIN ?
+                             RCC_PLLQ_MIN : (vco + RCC_PLL48_HZ - 1u) / RCC_PLL48_HZ,
+                             target);
+            }
+        }
+    }
+    if (best.sysclk_hz == 0u) {
+        return DRV_ERR_PARAM;
+    }
+
+    best.src_hz = fin;
+    best.hse = (req->hse_hz != 0u);
+    best.hse_bypass = best.hse && req->hse_bypass;
+    best.hpre = 1;
+    best.hclk_hz = best.sysclk_hz;
+    best.ppre1 = rcc_apb_div(best.hclk_hz, rcc_limit(req->apb1_max_hz, RCC_APB1_MAX_HZ));
+    best.ppre2 = rcc_apb_div(best.hclk_hz, rcc_limit(req->apb2_max_hz, RCC_APB2_MAX_HZ));
+    if (best.ppre1 == 0u || best.ppre2 == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    best.pclk1_hz = best.hclk_hz / best.ppre1;
+    best.pclk2_hz = best.hclk_hz / best.ppre2;
+    best.latency = (uint8_t)RCC_FLASH_LATENCY(best.hclk_hz, mv);
+    *plan = best;
+    return DRV_OK;
+}
+
+static bool rcc_wait(volatile uint32_t *reg, uint32_t mask, uint32_t value)
+{
+    uint32_t n;
+
+    for (n = 0; n < RCC_READY_TIMEOUT; n++) {
+        if ((REG_READ(*reg) & mask) == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool rcc_switch(uint32_t sw)
+{
+    REG_FIELD_WRITE(RCC->CFGR, RCC_CFGR_SW, sw);
+    return rcc_wait(&RCC->CFGR, reg_field_mask(RCC_CFGR_SWS),
+                    reg_field_prep(RCC_CFGR_SWS, sw));
+}
+
+static void rcc_set_latency(uint32_t ws)
+{
+    REG_FIELD_WRITE(FLASH->ACR, FLASH_ACR_LATENCY, ws);
+    /* The new setting must be in effect before the clock changes. */
+    while (REG_FIELD_READ(FLASH->ACR, FLASH_ACR_LATENCY) != ws) {
+    }
+}
+
+drv_status_t rcc_apply(const rcc_plan_t *plan)
+{
+    uint32_t cur_ws;
+
+    if (plan == NULL || plan->pllm == 0u) {
+        return DRV_ERR_PARAM;
+    }
+
+    if (plan->hse) {
+        if (plan->hse_bypass) {
+            REG_SET_BITS(RCC->CR, RCC_CR_HSEBYP);
+        }
+        REG_SET_BITS(RCC->CR, RCC_CR_HSEON);
+        if (!rcc_wait(&RCC->CR, RCC_CR_HSERDY, RCC_CR_HSERDY)) {
+            REG_CLR_BITS(RCC->CR, RCC_CR_HSEON | RCC_CR_HSEBYP);
+            return DRV_ERR_TIMEOUT;
+        }
+    }
+
+    /* The PLL can only be reprogrammed while it is not the system clock. */
+    if (REG_FIELD_READ(RCC->CFGR, RCC_CFGR_SWS) != RCC_CFGR_SW_HSI) {
+        REG_SET_BITS(RCC->CR, RCC_CR_HSION);
+        (void)rcc_wait(&RCC->CR, RCC_CR_HSIRDY, RCC_CR_HSIRDY);
+        (void)rcc_switch(RCC_CFGR_SW_HSI);
+        REG_MODIFY(RCC->CFGR,
+                   reg_field_mask(RCC_CFGR_HPRE) | reg_field_mask(RCC_CFGR_PPRE1) |
+                   reg_field_mask(RCC_CFGR_PPRE2), 0u);
+        rcc_plan = rcc_hsi_plan;
+    }
+
+    cur_ws = REG_FIELD_READ(FLASH->ACR, FLASH_ACR_LATENCY);
+    if (plan->latency > cur_ws) {
+        rcc_set_latency(plan->latency);
+    }
+
+    REG_CLR_BITS(RCC->CR, RCC_CR_PLLON);
+    (void)rcc_wait(&RCC->CR, RCC_CR_PLLRDY, 0u);
+    REG_MODIFY(RCC->PLLCFGR,
+               reg_field_mask(RCC_PLLCFGR_PLLM) | reg_field_mask(RCC_PLLCFGR_PLLN) |
+               reg_field_mask(RCC_PLLCFGR_PLLP) | reg_field_mask(RCC_PLLCFGR_PLLQ) |
+               RCC_PLLCFGR_PLLSRC,
+               reg_field_prep(RCC_PLLCFGR_PLLM, plan->pllm) |
+               reg_field_prep(RCC_PLLCFGR_PLLN, plan->plln) |
+               reg_field_prep(RCC_PLLCFGR_PLLP, plan->pllp / 2u - 1u) |
+               reg_field_prep(RCC_PLLCFGR_PLLQ, plan->pllq) |
+               (plan->hse ? RCC_PLLCFGR_PLLSRC : 0u));
+    REG_SET_BITS(RCC->CR, RCC_CR_PLLON);
+    if (!rcc_wait(&RCC->CR, RCC_CR_PLLRDY, RCC_CR_PLLRDY)) {
+        REG_CLR_BITS(RCC->CR, RCC_CR_PLLON);
+        return DRV_ERR_TIMEOUT;
+    }
+
+    /* Dividers first, so no bus ever sees more than its limit. */
+    REG_MODIFY(RCC->CFGR,
+               reg_field_mask(RCC_CFGR_HPRE) | reg_field_mask(RCC_CFGR_PPRE1) |
+               reg_field_mask(RCC_CFGR_PPRE2),
+               reg_field_prep(RCC_CFGR_HPRE, rcc_hpre_bits(plan->hpre)) |
+               reg_field_prep(RCC_CFGR_PPRE1, rcc_ppre_bits(plan->ppre1)) |
+               reg_field_prep(RCC_CFGR_PPRE2, rcc_ppre_bits(plan->ppre2)));
+    if (!rcc_switch(RCC_CFGR_SW_PLL)) {
+        return DRV_ERR_TIMEOUT;
+    }
+
+    if (plan->latency < cur_ws) {
+        rcc_set_latency(plan->latency);
+    }
+    rcc_plan = *plan;
+    return DRV_OK;
+}
+
+const rcc_plan_t *rcc_current(void)
+{
+    return &rcc_plan;
+}
+
+void rcc_set_current(const rcc_plan_t *plan)
+{
+    rcc_plan = (plan != NULL) ? *plan : rcc_hsi_plan;
+}
+
+uint32_t rcc_timer_clock(const rcc_plan_t *plan, bool apb2)
+{
+    uint32_t div = apb2 ? plan->ppre2 : plan->ppre1;
+    uint32_t pclk = apb2 ? plan->pclk2_hz : plan->pclk1_hz;
+
+    return (div == 1u) ? pclk : 2u * pclk;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file    ringbuf.c
+ * @brief   Lock-free single-producer/single-consumer byte ring buffer.
+ */
+#include <string.h>
+
+#include "ringbuf.h"
+
+drv_status_t ringbuf_init(ringbuf_t *rb, uint8_t *storage, uint32_t size)
+{
+    if (rb == NULL || storage == NULL || size == 0u || (size & (size - 1u)) != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    rb->buf = storage;
+    rb->mask = size - 1u;
+    rb->head = 0;
+    rb->tail = 0;
+    return DRV_OK;
+}
+
+uint32_t ringbuf_write(ringbuf_t *rb, const void *data, uint32_t len)
+{
+    const uint8_t *src = data;
+    uint32_t done = 0;
+
+    /* At most two spans: up to the end of storage, then from the start. */
+    while (done < len) {
+        uint8_t *dst;
+        uint32_t n = ringbuf_write_span(rb, &dst);
+
+        if (n == 0u) {
+            break;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(dst, src + done, n);
+        ringbuf_write_commit(rb, n);
+        done += n;
+    }
+    return done;
+}
+
+uint32_t ringbuf_read(ringbuf_t *rb, void *data, uint32_t len)
+{
+    uint8_t *dst = data;
+    uint32_t done = 0;
+
+    while (done < len) {
+        const uint8_t *src;
+        uint32_t n = ringbuf_read_span(rb, &src);
+
+        if (n == 0u) {
+            break;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(dst + done, src, n);
+        ringbuf_read_commit(rb, n);
+        done += n;
+    }
+    return done;
+}
@@ -0,0 +1,652 @@
+/**
+ * @file    sdio.c
+ * @brief   SD memory card driver on the SDIO/SDMMC host.
+ */
+#include <string.h>
+
+#include "rcc.h"
+#include "sdio.h"
+
+/* Polls of STA per command, of the transfer flags per data transfer, and
+ * CMD13 rounds while the card programs.  The hardware times out commands
+ * (64 bus clocks) and data (DTIMER) itself; these only bound the loops. */
+#define SDIO_CMD_TIMEOUT    100000u
+#define SDIO_XFER_TIMEOUT   20000000u
+#define SDIO_BUSY_TIMEOUT   500000u
+/* ACMD41 rounds until the card leaves its power-up busy state (~1 s). */
+#define SDIO_INIT_TRIES     4000u
+
+/* Commands (SD physical layer simplified specification, section 4.7) */
+#define SD_GO_IDLE_STATE        0u
+#define SD_ALL_SEND_CID         2u
+#define SD_SEND_RELATIVE_ADDR   3u
+#define SD_SWITCH_FUNC          6u
+#define SD_SELECT_CARD          7u
+#define SD_SEND_IF_COND         8u
+#define SD_SEND_CSD             9u
+#define SD_STOP_TRANSMISSION    12u
+#define SD_SEND_STATUS          13u
+#define SD_SET_BLOCKLEN         16u
+#define SD_READ_SINGLE_BLOCK    17u
+#define SD_READ_MULTIPLE_BLOCK  18u
+#define SD_WRITE_BLOCK          24u
+#define SD_WRITE_MULTIPLE_BLOCK 25u
+#define SD_APP_CMD              55u
+/* Application commands, after SD_APP_CMD */
+#define SD_SET_BUS_WIDTH        6u
+#define SD_SEND_OP_COND         41u
+
+/*
+ * Response types: the WAITRESP field plus how to check the response.
+ * R3 carries no CRC (the host flags CCRCFAIL) and neither it nor the long
+ * R2 echoes the command index.  R1b after CMD12 is not checked for status
+ * errors: a multi-block read ending at the last block makes some cards
+ * report OUT_OF_RANGE for the block they had started to prefetch.
+ */
+#define SDIO_R_NOCRC        0x4u
+#define SDIO_R_STATUS       0x8u
+#define SDIO_R0             SDIO_RESP_NONE
+#define SDIO_R1             (SDIO_RESP_SHORT | SDIO_R_STATUS)
+#define SDIO_R1B            SDIO_RESP_SHORT
+#define SDIO_R2             SDIO_RESP_LONG
+#define SDIO_R3             (SDIO_RESP_SHORT | SDIO_R_NOCRC)
+#define SDIO_R6             SDIO_RESP_SHORT
+#define SDIO_R7             SDIO_RESP_SHORT
+
+/* CMD8: 2.7-3.6 V and a check pattern the card echoes. */
+#define SDIO_IF_COND        0x000001AAu
+/* ACMD41 argument and OCR response */
+#define SDIO_OCR_WINDOW     0x00FF8000u     /* 2.7-3.6 V */
+#define SDIO_OCR_HCS        REG_BIT(30)     /* Host takes SDHC; card is SDHC (CCS). */
+#define SDIO_OCR_READY      REG_BIT(31)
+
+/* R1 card status */
+#define SDIO_R1_ERRORS      0xFDF98008u
+#define SDIO_R1_STATE       REG_FIELD(9u, 4u)
+#define SDIO_R1_READY       REG_BIT(8)      /* READY_FOR_DATA */
+#define SDIO_R1_APP_CMD     REG_BIT(5)
+#define SDIO_STATE_TRAN     4u
+
+/* CSD word 1 (bits 95:64): command class 10 (switch) supported. */
+#define SDIO_CSD1_CCC_SWITCH REG_BIT(30)
+
+/* CMD6: set function group 1 to high speed; 64-byte status back. */
+#define SDIO_SWITCH_HS      0x80FFFFF1u
+#define SDIO_SWITCH_LEN     64u
+
+#define SDIO_ICR_CMD        (SDIO_STA_CCRCFAIL | SDIO_STA_CTIMEOUT | SDIO_STA_CMDREND |   \
+                             SDIO_STA_CMDSENT)
+#define SDIO_DATA_ERRORS    (SDIO_STA_DCRCFAIL | SDIO_STA_DTIMEOUT | SDIO_STA_TXUNDERR |  \
+                             SDIO_STA_RXOVERR | SDIO_STA_STBITERR)
+#define SDIO_ICR_DATA       (SDIO_DATA_ERRORS | SDIO_STA_DATAEND | SDIO_STA_DBCKEND)
+
+/* Instance served by SDIO_IRQHandler. */
+static sdio_t *sdio_handle;
+
+/* ------------------------------------------------------------------------ */
+/* Commands                                                                 */
+/* ------------------------------------------------------------------------ */
+
+static drv_status_t sdio_cmd(sdio_t *h, uint32_t idx, uint32_t arg, uint32_t resp)
+{
+    sdio_regs_t *s = h->sdio;
+    uint32_t wait = resp & SDIO_RESP_LONG;
+    uint32_t done = (wait != SDIO_RESP_NONE) ? (SDIO_STA_CMDREND | SDIO_STA_CCRCFAIL |
+                                                SDIO_STA_CTIMEOUT)
+                                             : SDIO_STA_CMDSENT;
+    uint32_t sta;
+    uint32_t n;
+
+    REG_WRITE(s->ICR, SDIO_ICR_CMD);
+    REG_WRITE(s->ARG, arg);
+    REG_WRITE(s->CMD, reg_field_prep(SDIO_CMD_CMDINDEX, idx) |
+                      reg_field_prep(SDIO_CMD_WAITRESP, wait) | SDIO_CMD_CPSMEN);
+    for (n = 0; ((sta = REG_READ(s->STA)) & done) == 0u; n++) {
+        if (n == SDIO_CMD_TIMEOUT) {
+            return DRV_ERR_TIMEOUT;
+        }
+    }
+    REG_WRITE(s->ICR, SDIO_ICR_CMD);
+
+    if ((sta & SDIO_STA_CTIMEOUT) != 0u) {
+        return DRV_ERR_TIMEOUT;
+    }
+    if ((resp & SDIO_R_NOCRC) == 0u &&
+        ((sta & SDIO_STA_CCRCFAIL) != 0u ||
+         (wait == SDIO_RESP_SHORT && REG_READ(s->RESPCMD) != idx))) {
+        return DRV_ERR_HW;
+    }
+    if ((resp & SDIO_R_STATUS) != 0u && (REG_READ(s->RESP[0]) & SDIO_R1_ERRORS) != 0u) {
+        return DRV_ERR_HW;
+    }
+    return DRV_OK;
+}
+
+static drv_status_t sdio_acmd(sdio_t *h, uint32_t idx, uint32_t arg, uint32_t resp)
+{
+    drv_status_t rc = sdio_cmd(h, SD_APP_CMD, h->rca, SDIO_R1);
+
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    if ((REG_READ(h->sdio->RESP[0]) & SDIO_R1_APP_CMD) == 0u) {
+        return DRV_ERR_HW;
+    }
+    return sdio_cmd(h, idx, arg, resp);
+}
+
+/* Wait for the card to finish programming: back in tran, ready for data. */
+static drv_status_t sdio_ready(sdio_t *h)
+{
+    drv_status_t rc;
+    uint32_t st;
+    uint32_t n;
+
+    if (!h->programming) {
+        return DRV_OK;
+    }
+    for (n = 0; n < SDIO_BUSY_TIMEOUT; n++) {
+        rc = sdio_cmd(h, SD_SEND_STATUS, h->rca, SDIO_R1);
+        if (rc != DRV_OK) {
+            return rc;
+        }
+        st = REG_READ(h->sdio->RESP[0]);
+        if ((st & SDIO_R1_READY) != 0u && reg_field_get(st, SDIO_R1_STATE) == SDIO_STATE_TRAN) {
+            h->programming = false;
+            return DRV_OK;
+        }
+    }
+    return DRV_ERR_TIMEOUT;
+}
+
+/* Bus clock of at most @p max_hz from SDIOCLK; data timeout 250 ms of it. */
+static void sdio_clock(sdio_t *h, uint32_t max_hz)
+{
+    uint32_t sdioclk = rcc_current()->pll48_hz;
+    uint32_t div;
+    uint32_t bits;
+
+    if (sdioclk <= max_hz) {
+        bits = SDIO_CLKCR_BYPASS;
+        h->bus_hz = sdioclk;
+    } else {
+        div = (sdioclk + max_hz - 1u) / max_hz;
+        if (div > 257u) {
+            div = 257u;
+        }
+        bits = reg_field_prep(SDIO_CLKCR_CLKDIV, div - 2u);
+        h->bus_hz = sdioclk / div;
+    }
+    REG_MODIFY(h->sdio->CLKCR, reg_field_mask(SDIO_CLKCR_CLKDIV) | SDIO_CLKCR_BYPASS, bits);
+    h->dtimer = h->bus_hz / 4u;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Data                                                                     */
+/* ------------------------------------------------------------------------ */
+
+static void sdio_dma_event(void *ctx, uint32_t events)
+{
+    sdio_t *h = ctx;
+
+    if ((events & DMA_FLAG_TEIF) != 0u) {
+        h->dma_error = true;
+        h->dma_busy = false;
+    } else if ((events & DMA_FLAG_TCIF) != 0u) {
+        h->dma_busy = false;
+    }
+}
+
+void sdio_irq(sdio_t *h)
+{
+    sdio_regs_t *s = h->sdio;
+    uint32_t sta = REG_READ(s->STA) & REG_READ(s->MASK);
+
+    h->irqs++;
+    REG_WRITE(s->ICR, sta);
+    if ((sta & (SDIO_DATA_ERRORS | SDIO_STA_DATAEND)) != 0u) {
+        REG_WRITE(s->MASK, 0u);
+        h->data_errors |= sta & SDIO_DATA_ERRORS;
+        h->data_busy = false;
+    }
+}
+
+void SDIO_IRQHandler(void);
+void SDIO_IRQHandler(void)
+{
+    if (sdio_handle != NULL) {
+        sdio_irq(sdio_handle);
+    }
+}
+
+/* Service both interrupt sources from thread mode, for disabled lines. */
+static void sdio_poll(sdio_t *h)
+{
+    uint32_t primask = stm32_irq_save();
+
+    if ((REG_READ(h->sdio->STA) & REG_READ(h->sdio->MASK)) != 0u) {
+        sdio_irq(h);
+    }
+    if ((dma_flags(h->dma) & (DMA_FLAG_TCIF | DMA_FLAG_TEIF)) != 0u) {
+        dma_irq(h->dma->dma, h->dma->stream);
+    }
+    stm32_irq_restore(primask);
+}
+
+/*
+ * The data path is done when the SDIO has seen DATAEND and the stream has
+ * moved the last word (FIFO drained on receive, filled on transmit).
+ */
+static drv_status_t sdio_wait(sdio_t *h)
+{
+    uint32_t n;
+
+    for (n = 0; h->data_busy || h->dma_busy; n++) {
+        if (h->data_errors != 0u || h->dma_error) {
+            break;
+        }
+        if (n == SDIO_XFER_TIMEOUT) {
+            return DRV_ERR_TIMEOUT;
+        }
+        sdio_poll(h);
+    }
+    if ((h->data_errors & SDIO_STA_DTIMEOUT) != 0u) {
+        h->timeouts++;
+        return DRV_ERR_TIMEOUT;
+    }
+    if ((h->data_errors & SDIO_STA_DCRCFAIL) != 0u) {
+        h->crc_errors++;
+    }
+    return (h->data_errors != 0u || h->dma_error) ? DRV_ERR_HW : DRV_OK;
+}
+
+/*
+ * One data transfer of @p len bytes in blocks of 2^@p bsize bytes, started
+ * by command @p idx.  The receive path is armed before the command since
+ * the card sends as soon as it has answered; the transmit path after the
+ * response, as the card only takes data once it has accepted the command.
+ */
+static drv_status_t sdio_data(sdio_t *h, uint32_t idx, uint32_t arg, void *buf, uint32_t len,
+                              uint32_t bsize, bool rx)
+{
+    sdio_regs_t *s = h->sdio;
+    const dma_config_t cfg = {
+        .dir = rx ? DMA_DIR_P2M : DMA_DIR_M2P,
+        .psize = DMA_SIZE_WORD,
+        .msize = DMA_SIZE_WORD,
+        .priority = h->dma_priority,
+        .minc = true,
+        .burst = DMA_BURST_INCR4,
+        .pfctrl = true,
+    };
+    uint32_t dctrl = SDIO_DCTRL_DTEN | SDIO_DCTRL_DMAEN |
+                     reg_field_prep(SDIO_DCTRL_DBLOCKSIZE, bsize) | (rx ? SDIO_DCTRL_DTDIR : 0u);
+    drv_status_t rc;
+
+    rc = dma_configure(h->dma, &cfg);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->xfer = (dma_xfer_t){
+        .periph = REG_ADDR(&s->FIFO[0]),
+        .mem0 = buf,
+        .count = (uint16_t)(len / 4u),
+        .cb = sdio_dma_event,
+        .ctx = h,
+    };
+    h->data_busy = true;
+    h->data_errors = 0;
+    h->dma_busy = true;
+    h->dma_error = false;
+    REG_WRITE(s->ICR, SDIO_ICR_DATA);
+    rc = dma_submit(h->dma, &h->xfer);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    REG_WRITE(s->DTIMER, h->dtimer);
+    REG_WRITE(s->DLEN, len);
+    REG_WRITE(s->MASK, SDIO_DATA_ERRORS | SDIO_STA_DATAEND);
+    h->commands++;
+
+    if (rx) {
+        REG_WRITE(s->DCTRL, dctrl);
+        rc = sdio_cmd(h, idx, arg, SDIO_R1);
+    } else {
+        rc = sdio_cmd(h, idx, arg, SDIO_R1);
+        if (rc == DRV_OK) {
+            REG_WRITE(s->DCTRL, dctrl);
+        }
+    }
+    if (rc == DRV_OK) {
+        rc = sdio_wait(h);
+    }
+
+    REG_WRITE(s->MASK, 0u);
+    REG_WRITE(s->DCTRL, 0u);
+    if (rc != DRV_OK) {
+        dma_abort(h->dma);
+    }
+    REG_WRITE(s->ICR, SDIO_ICR_DATA);
+    h->data_busy = false;
+    h->dma_busy = false;
+    return rc;
+}
+
+/* One read or write command for @p count (<= SDIO_MULTI_MAX) blocks. */
+static drv_status_t sdio_blocks(sdio_t *h, uint32_t block, void *buf, uint32_t count, bool rx)
+{
+    bool multi = count > 1u;
+    uint32_t idx;
+    drv_status_t rc;
+    drv_status_t stop;
+
+    rc = sdio_ready(h);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    if (rx) {
+        idx = multi ? SD_READ_MULTIPLE_BLOCK : SD_READ_SINGLE_BLOCK;
+    } else {
+        idx = multi ? SD_WRITE_MULTIPLE_BLOCK : SD_WRITE_BLOCK;
+    }
+    rc = sdio_data(h, idx, h->sdhc ? block : block * SDIO_BLOCK_SIZE, buf,
+                   count * SDIO_BLOCK_SIZE, 9u, rx);
+    if (multi) {
+        /* Also after an error: the card stays in data/rcv state until told. */
+        stop = sdio_cmd(h, SD_STOP_TRANSMISSION, 0u, SDIO_R1B);
+        if (rc == DRV_OK) {
+            rc = stop;
+        }
+    }
+    if (!rx) {
+        h->programming = true;
+    }
+    return rc;
+}
+
+static drv_status_t sdio_run(sdio_t *h, uint32_t block, uint8_t *p, uint32_t count, bool rx)
+{
+    drv_status_t rc = DRV_OK;
+    uint32_t n;
+
+    if (h == NULL || p == NULL || count == 0u || block >= h->blocks ||
+        count > h->blocks - block) {
+        return DRV_ERR_PARAM;
+    }
+    if (((uintptr_t)p & (SDIO_DMA_ALIGN - 1u)) != 0u) {
+        /* Misaligned for bursts or cache lines: one block at a time. */
+        for (; count > 0u && rc == DRV_OK; count--, block++, p += SDIO_BLOCK_SIZE) {
+            if (!rx) {
+                memcpy(h->bounce, p, SDIO_BLOCK_SIZE);
+            }
+            rc = sdio_blocks(h, block, h->bounce, 1u, rx);
+            if (rx && rc == DRV_OK) {
+                memcpy(p, h->bounce, SDIO_BLOCK_SIZE);
+            }
+        }
+        return rc;
+    }
+    for (; count > 0u && rc == DRV_OK; count -= n, block += n, p += n * SDIO_BLOCK_SIZE) {
+        n = (count < SDIO_MULTI_MAX) ? count : SDIO_MULTI_MAX;
+        rc = sdio_blocks(h, block, p, n, rx);
+    }
+    return rc;
+}
+
+drv_status_t sdio_read(sdio_t *h, uint32_t block, void *buf, uint32_t count)
+{
+    return sdio_run(h, block, buf, count, true);
+}
+
+drv_status_t sdio_write(sdio_t *h, uint32_t block, const void *buf, uint32_t count)
+{
+    return sdio_run(h, block, (uint8_t *)(uintptr_t)buf, count, false);
+}
+
+drv_status_t sdio_sync(sdio_t *h)
+{
+    if (h == NULL || h->blocks == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    return sdio_ready(h);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Card identification                                                      */
+/* ------------------------------------------------------------------------ */
+
+/* Capacity in 512-byte blocks from the CSD (RESP[0] = bits 127:96). */
+static uint32_t sdio_csd_blocks(const uint32_t csd[4])
+{
+    uint32_t c_size;
+    uint32_t mult;
+    uint32_t bl_len;
+
+    if ((csd[0] >> 30) == 1u) {
+        /* CSD 2.0 (SDHC/SDXC): C_SIZE[69:48] in units of 512 KiB. */
+        c_size = ((csd[1] & 0x3Fu) << 16) | (csd[2] >> 16);
+        return (c_size + 1u) * 1024u;
+    }
+    /* CSD 1.0: (C_SIZE[73:62] + 1) << (C_SIZE_MULT[49:47] + 2) blocks of READ_BL_LEN[83:80]. */
+    bl_len = (csd[1] >> 16) & 0xFu;
+    c_size = ((csd[1] & 0x3FFu) << 2) | (csd[2] >> 30);
+    mult = (csd[2] >> 15) & 7u;
+    if (bl_len < 9u || bl_len > 11u) {
+        return 0;
+    }
+    return (c_size + 1u) << (mult + 2u + bl_len - 9u);
+}
+
+static void sdio_resp_long(const sdio_t *h, uint32_t out[4])
+{
+    uint32_t i;
+
+    for (i = 0; i < 4u; i++) {
+        out[i] = REG_READ(h->sdio->RESP[i]);
+    }
+}
+
+/* CMD6: switch to high speed if the card has it, then raise the clock. */
+static drv_status_t sdio_high_speed(sdio_t *h)
+{
+    drv_status_t rc;
+
+    rc = sdio_data(h, SD_SWITCH_FUNC, SDIO_SWITCH_HS, h->bounce, SDIO_SWITCH_LEN, 6u, true);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    /* Function group 1 result, status bits 379:376: 1 if now high speed. */
+    if ((h->bounce[16] & 0xFu) == 1u) {
+        /* The card runs at the new timing 8 clocks after the status block. */
+        sdio_clock(h, SDIO_HS_HZ);
+        h->high_speed = true;
+    }
+    return DRV_OK;
+}
+
+static drv_status_t sdio_card_init(sdio_t *h, const sdio_config_t *cfg)
+{
+    uint32_t csd[4];
+    uint32_t ocr = 0;
+    uint32_t n;
+    bool v2;
+    drv_status_t rc;
+
+    rc = sdio_cmd(h, SD_GO_IDLE_STATE, 0u, SDIO_R0);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    /* SD 1.x cards do not know CMD8 and stay silent. */
+    rc = sdio_cmd(h, SD_SEND_IF_COND, SDIO_IF_COND, SDIO_R7);
+    if (rc == DRV_OK && (REG_READ(h->sdio->RESP[0]) & 0xFFFu) != SDIO_IF_COND) {
+        return DRV_ERR_HW;
+    }
+    if (rc != DRV_OK && rc != DRV_ERR_TIMEOUT) {
+        return rc;
+    }
+    v2 = (rc == DRV_OK);
+
+    for (n = 0; (ocr & SDIO_OCR_READY) == 0u; n++) {
+        if (n == SDIO_INIT_TRIES) {
+            return DRV_ERR_HW;
+        }
+        rc = sdio_acmd(h, SD_SEND_OP_COND, SDIO_OCR_WINDOW | (v2 ? SDIO_OCR_HCS : 0u), SDIO_R3);
+        if (rc != DRV_OK) {
+            return rc;
+        }
+        ocr = REG_READ(h->sdio->RESP[0]);
+    }
+    h->sdhc = (ocr & SDIO_OCR_HCS) != 0u;
+
+    rc = sdio_cmd(h, SD_ALL_SEND_CID, 0u, SDIO_R2);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    sdio_resp_long(h, h->cid);
+    rc = sdio_cmd(h, SD_SEND_RELATIVE_ADDR, 0u, SDIO_R6);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    h->rca = REG_READ(h->sdio->RESP[0]) & 0xFFFF0000u;
+    rc = sdio_cmd(h, SD_SEND_CSD, h->rca, SDIO_R2);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    sdio_resp_long(h, csd);
+    h->blocks = sdio_csd_blocks(csd);
+    if (h->blocks == 0u) {
+        return DRV_ERR_HW;
+    }
+    rc = sdio_cmd(h, SD_SELECT_CARD, h->rca, SDIO_R1);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    sdio_clock(h, SDIO_DS_HZ);
+
+    if (cfg->bus_width != 1u) {
+        rc = sdio_acmd(h, SD_SET_BUS_WIDTH, 2u, SDIO_R1);
+        if (rc != DRV_OK) {
+            return rc;
+        }
+        REG_MODIFY(h->sdio->CLKCR, reg_field_mask(SDIO_CLKCR_WIDBUS),
+                   reg_field_prep(SDIO_CLKCR_WIDBUS, SDIO_WIDBUS_4));
+        h->wide = true;
+    }
+    /* Fixed at 512 on SDHC; SDSC cards may default to their READ_BL_LEN. */
+    rc = sdio_cmd(h, SD_SET_BLOCKLEN, SDIO_BLOCK_SIZE, SDIO_R1);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    if (!cfg->default_speed && (csd[1] & SDIO_CSD1_CCC_SWITCH) != 0u) {
+        rc = sdio_high_speed(h);
+    }
+    return rc;
+}
+
+static void sdio_stop(sdio_t *h)
+{
+    sdio_regs_t *s = h->sdio;
+    uint32_t primask = stm32_irq_save();
+
+    if (sdio_handle == h) {
+        sdio_handle = NULL;
+    }
+    stm32_irq_restore(primask);
+    REG_WRITE(s->MASK, 0u);
+    REG_WRITE(s->DCTRL, 0u);
+    REG_WRITE(s->CLKCR, 0u);
+    REG_WRITE(s->POWER, 0u);
+    dma_free(h->dma);
+    h->dma = NULL;
+    h->blocks = 0;
+}
+
+drv_status_t sdio_init(sdio_t *h, const sdio_config_t *cfg)
+{
+    sdio_regs_t *s = SDIO;
+    uint32_t sdioclk = rcc_current()->pll48_hz;
+    drv_status_t rc;
+
+    if (h == NULL || cfg == NULL || cfg->dma_priority > 3u ||
+        (cfg->bus_width != 0u && cfg->bus_width != 1u && cfg->bus_width != 4u) ||
+        sdioclk < 2u * SDIO_INIT_HZ || sdioclk > SDIO_HS_HZ) {
+        return DRV_ERR_PARAM;
+    }
+    memset(h, 0, sizeof(*h));
+    h->sdio = s;
+    h->dma_priority = cfg->dma_priority;
+    rc = dma_alloc(DMA_REQ_SDIO, &h->dma);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+
+    REG_SET_BITS(RCC->APB2ENR, RCC_APB2ENR_SDIOEN);
+    REG_WRITE(s->MASK, 0u);
+    REG_WRITE(s->ICR, SDIO_ICR_STATIC);
+    /*
+     * Rising-edge clocking, 1-bit bus to start with.  Hardware flow
+     * control stops the clock instead of overrunning the FIFO, but on F4
+     * it can glitch SDIO_CK and corrupt data (ES0182), so there only the
+     * DMA bursts keep up.
+     */
+#if defined(STM32F7)
+    REG_WRITE(s->CLKCR, SDIO_CLKCR_HWFC_EN);
+#else
+    REG_WRITE(s->CLKCR, 0u);
+#endif
+    sdio_clock(h, SDIO_INIT_HZ);
+    REG_WRITE(s->POWER, reg_field_prep(SDIO_POWER_PWRCTRL, SDIO_POWER_ON));
+    REG_SET_BITS(s->CLKCR, SDIO_CLKCR_CLKEN);
+
+    rc = sdio_card_init(h, cfg);
+    if (rc != DRV_OK) {
+        sdio_stop(h);
+        return rc;
+    }
+    sdio_handle = h;
+    return DRV_OK;
+}
+
+void sdio_deinit(sdio_t *h)
+{
+    if (h->dma == NULL) {
+        return;
+    }
+    (void)sdio_ready(h);
+    /* Deselect: CMD7 to RCA 0 gets no response. */
+    (void)sdio_cmd(h, SD_SELECT_CARD, 0u, SDIO_R0);
+    sdio_stop(h);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Block device                                                             */
+/* ------------------------------------------------------------------------ */
+
+static drv_status_t sdio_bd_read(void *ctx, uint32_t block, void *buf, uint32_t count)
+{
+    return sdio_read(ctx, block, buf, count);
+}
+
+static drv_status_t sdio_bd_write(void *ctx, uint32_t block, const void *buf, uint32_t count)
+{
+    return sdio_write(ctx, block, buf, count);
+}
+
+static drv_status_t sdio_bd_sync(void *ctx)
+{
+    return sdio_sync(ctx);
+}
+
+static const blockdev_ops_t sdio_blockdev_ops = {
+    .read = sdio_bd_read,
+    .write = sdio_bd_write,
+    .sync = sdio_bd_sync,
+};
+
+void sdio_blockdev(sdio_t *h, blockdev_t *bd)
+{
+    bd->ops = &sdio_blockdev_ops;
+    bd->ctx = h;
+    bd->block_count = h->blocks;
+    bd->block_size = SDIO_BLOCK_SIZE;
+}
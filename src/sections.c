@@ -0,0 +1,248 @@
+/**
+ * @file    sections.c
+ * @brief   Startup initialisation of RAM sections from the linker tables.
+ */
+#include <stdbool.h>
+
+#include "sections.h"
+
+/* NDTR is 16 bits; whole INCR4 bursts only. */
+#define SECTIONS_DMA_MAX_WORDS  0xFFFCu
+
+/* Status polls for the DMA clear: ~256 KiB at one word per few cycles. */
+#define SECTIONS_DMA_TIMEOUT    (1u << 22)
+
+/*
+ * Word loops.  On target, four words move per LDM/STM pair: the scripts
+ * only word-align section bounds, and the Cortex-M multi-word transfers do
+ * not need more than that.  The remaining 0..3 words go one at a time.
+ */
+static void sections_copy_words(uint32_t *dst, const uint32_t *src, const uint32_t *end)
+{
+#if defined(__arm__)
+    uint32_t blocks = (uint32_t)(end - dst) / 4u;
+
+    if (blocks != 0u) {
+        __asm volatile (
+            "1: ldmia   %[s]!, {r3, r4, r5, r12}    \n"
+            "   stmia   %[d]!, {r3, r4, r5, r12}    \n"
+            "   subs    %[n], %[n], #1              \n"
+            "   bne     1b                          \n"
+            : [s] "+r" (src), [d] "+r" (dst), [n] "+r" (blocks)
+            :
+            : "r3", "r4", "r5", "r12", "cc", "memory");
+    }
+#endif
+    while (dst < end) {
+        *dst++ = *src++;
+    }
+}
+
+static void sections_zero_words(uint32_t *dst, const uint32_t *end)
+{
+#if defined(__arm__)
+    uint32_t blocks = (uint32_t)(end - dst) / 4u;
+
+    if (blocks != 0u) {
+        __asm volatile (
+            "   movs    r3, #0                      \n"
+            "   movs    r4, #0                      \n"
+            "   movs    r5, #0                      \n"
+            "   mov     r12, r3                     \n"
+            "1: stmia   %[d]!, {r3, r4, r5, r12}    \n"
+            "   subs    %[n], %[n], #1              \n"
+            "   bne     1b                          \n"
+            : [d] "+r" (dst), [n] "+r" (blocks)
+            :
+            : "r3", "r4", "r5", "r12", "cc", "memory");
+    }
+#endif
+    while (dst < end) {
+        *dst++ = 0u;
+    }
+}
+
+void sections_copy(const sections_copy_t *first, const sections_copy_t *last)
+{
+    const sections_copy_t *s;
+
+    for (s = first; s < last; s++) {
+        /* Run address equal to load address: nothing to move. */
+        if (s->load != s->start) {
+            sections_copy_words(s->start, s->load, s->end);
+        }
+    }
+}
+
+void sections_zero(const sections_zero_t *first, const sections_zero_t *last)
+{
+    const sections_zero_t *s;
+
+    for (s = first; s < last; s++) {
+        sections_zero_words(s->start, s->end);
+    }
+}
+
+#if SECTIONS_DMA_MIN_BYTES > 0
+
+/* DMA source: one zero word in flash, read without increment. */
+static const uint32_t sections_zero_source = 0u;
+
+static bool sections_dma_reachable(const uint32_t *p)
+{
+#if defined(STM32_HOST)
+    (void)p;
+    return true;
+#else
+    /* Flash, ITCM RAM and the F4 CCM sit below SRAM, off the DMA ports. */
+    return (uintptr_t)p >= SRAM1_BASE;
+#endif
+}
+
+/*
+ * Largest DMA-reachable entry of [@p first, @p last) worth a stream, and
+ * the 16-byte aligned run of whole bursts inside it the DMA is to clear.
+ */
+static const sections_zero_t *sections_dma_pick(const sections_zero_t *first,
+                                                const sections_zero_t *last,
+                                                uint32_t **dst, uint32_t *words)
+{
+    const sections_zero_t *best = NULL;
+    const sections_zero_t *s;
+    uint32_t *p;
+    uint32_t n;
+
+    for (s = first; s < last; s++) {
+        uint32_t bytes = (uint32_t)(s->end - s->start) * 4u;
+
+        if (bytes >= SECTIONS_DMA_MIN_BYTES && sections_dma_reachable(s->start) &&
+            (best == NULL || s->end - s->start > best->end - best->start)) {
+            best = s;
+        }
+    }
+    if (best == NULL) {
+        return NULL;
+    }
+    /* Bursts must not cross a 1 KiB boundary: start them 16-byte aligned. */
+    p = (uint32_t *)(((uintptr_t)best->start + 15u) & ~(uintptr_t)15u);
+    n = (p < best->end) ? (uint32_t)(best->end - p) & ~3u : 0u;
+    if (n > SECTIONS_DMA_MAX_WORDS) {
+        n = SECTIONS_DMA_MAX_WORDS;
+    }
+    if (n == 0u) {
+        return NULL;
+    }
+    *dst = p;
+    *words = n;
+    return best;
+}
+
+/* Start the clear; returns whether DMA2 was clocked already. */
+static bool sections_dma_start(uint32_t *dst, uint32_t words)
+{
+    dma_stream_regs_t *st = &DMA2->S[SECTIONS_DMA_STREAM];
+    bool clocked = REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN);
+
+    REG_SET_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN);
+    /* Read back: the clock is running before the first DMA2 access. */
+    (void)REG_READ(RCC->AHB1ENR);
+    REG_WRITE(st->PAR, REG_ADDR(&sections_zero_source));
+    REG_WRITE(st->M0AR, REG_ADDR(dst));
+    REG_WRITE(st->NDTR, words);
+    REG_WRITE(st->FCR, DMA_SFCR_DMDIS | reg_field_prep(DMA_SFCR_FTH, DMA_FTH_FULL));
+    REG_WRITE(st->CR, reg_field_prep(DMA_SCR_DIR, DMA_DIR_M2M) | DMA_SCR_MINC |
+                      reg_field_prep(DMA_SCR_PSIZE, DMA_SIZE_WORD) |
+                      reg_field_prep(DMA_SCR_MSIZE, DMA_SIZE_WORD) |
+                      reg_field_prep(DMA_SCR_MBURST, DMA_BURST_INCR4) |
+                      reg_field_prep(DMA_SCR_PL, 3u));
+    REG_SET_BITS(st->CR, DMA_SCR_EN);
+    return clocked;
+}
+
+/*
+ * Wait for the clear and put the stream back to its reset state, and the
+ * DMA2 clock unless it was @p clocked before; false if the clear failed.
+ */
+static bool sections_dma_finish(bool clocked)
+{
+    dma_stream_regs_t *st = &DMA2->S[SECTIONS_DMA_STREAM];
+    const uint32_t shift = DMA_ISR_SHIFT(SECTIONS_DMA_STREAM % 4u);
+    volatile uint32_t *isr = (SECTIONS_DMA_STREAM < 4u) ? &DMA2->LISR : &DMA2->HISR;
+    volatile uint32_t *ifcr = (SECTIONS_DMA_STREAM < 4u) ? &DMA2->LIFCR : &DMA2->HIFCR;
+    uint32_t flags = 0u;
+    uint32_t n;
+
+    for (n = 0; n < SECTIONS_DMA_TIMEOUT; n++) {
+        flags = (REG_READ(*isr) >> shift) & (DMA_FLAG_TCIF | DMA_FLAG_TEIF);
+        if (flags != 0u) {
+            break;
+        }
+    }
+    REG_WRITE(st->CR, 0u);
+    for (n = 0; n < SECTIONS_DMA_TIMEOUT && REG_TEST_BITS(st->CR, DMA_SCR_EN); n++) {
+    }
+    REG_WRITE(*ifcr, DMA_FLAG_ALL << shift);
+    REG_WRITE(st->NDTR, 0u);
+    REG_WRITE(st->PAR, 0u);
+    REG_WRITE(st->M0AR, 0u);
+    REG_WRITE(st->FCR, reg_field_prep(DMA_SFCR_FS, 4u) | reg_field_prep(DMA_SFCR_FTH, 1u));
+    if (!clocked) {
+        REG_CLR_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN);
+    }
+    stm32_dmb();
+    return flags == DMA_FLAG_TCIF;
+}
+
+#endif /* SECTIONS_DMA_MIN_BYTES > 0 */
+
+void sections_run(const sections_copy_t *copy, const sections_copy_t *copy_end,
+                  const sections_zero_t *zero, const sections_zero_t *zero_end)
+{
+    const sections_zero_t *dma = NULL;
+    uint32_t *dst = NULL;
+    uint32_t words = 0u;
+    const sections_zero_t *s;
+#if SECTIONS_DMA_MIN_BYTES > 0
+    bool clocked = false;
+
+    dma = sections_dma_pick(zero, zero_end, &dst, &words);
+    if (dma != NULL) {
+        clocked = sections_dma_start(dst, words);
+    }
+#endif
+
+    /* The CPU copies and clears everything else while the stream runs. */
+    sections_copy(copy, copy_end);
+    for (s = zero; s < zero_end; s++) {
+        if (s == dma) {
+            sections_zero_words(s->start, dst);
+            sections_zero_words(dst + words, s->end);
+        } else {
+            sections_zero_words(s->start, s->end);
+        }
+    }
+
+#if SECTIONS_DMA_MIN_BYTES > 0
+    if (dma != NULL && !sections_dma_finish(clocked)) {
+        sections_zero_words(dst, dst + words);
+    }
+#endif
+}
+
+#if !defined(STM32_HOST)
+
+extern const sections_copy_t __copy_table_start__[];
+extern const sections_copy_t __copy_table_end__[];
+extern const sections_zero_t __zero_table_start__[];
+extern const sections_zero_t __zero_table_end__[];
+
+void sections_init(void)
+{
+    sections_run(__copy_table_start__, __copy_table_end__,
+                 __zero_table_start__, __zero_table_end__);
+    /* Code copied to RAM must not be fetched from stale prefetch state. */
+    stm32_dsb();
+    stm32_isb();
+}
+
+#endif /* !STM32_HOST */
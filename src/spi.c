@@ -0,0 +1,314 @@
+/**
+ * @file    spi.c
+ * @brief   SPI master driver: queued full-duplex DMA transactions.
+ */
+#include "gpio.h"
+#include "spi.h"
+
+typedef struct {
+    spi_regs_t *spi;
+    bool apb2;
+    uint32_t en;
+    dma_req_t rx_req;
+    dma_req_t tx_req;
+} spi_hw_t;
+
+static const spi_hw_t spi_hw[] = {
+    { SPI1, true,  RCC_APB2ENR_SPI1EN, DMA_REQ_SPI1_RX, DMA_REQ_SPI1_TX },
+    { SPI2, false, RCC_APB1ENR_SPI2EN, DMA_REQ_SPI2_RX, DMA_REQ_SPI2_TX },
+    { SPI3, false, RCC_APB1ENR_SPI3EN, DMA_REQ_SPI3_RX, DMA_REQ_SPI3_TX },
+};
+
+static void spi_dma_done(void *ctx, uint32_t events);
+
+static const spi_hw_t *spi_hw_find(const spi_regs_t *spi)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(spi_hw); i++) {
+        if (spi_hw[i].spi == spi) {
+            return &spi_hw[i];
+        }
+    }
+    return NULL;
+}
+
+drv_status_t spi_init(spi_bus_t *bus, spi_regs_t *spi, const spi_config_t *cfg)
+{
+    const spi_hw_t *hw = spi_hw_find(spi);
+    drv_status_t rc;
+
+    if (bus == NULL || cfg == NULL || hw == NULL || cfg->pclk_hz == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    rc = dma_alloc(hw->rx_req, &bus->rx);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    rc = dma_alloc(hw->tx_req, &bus->tx);
+    if (rc != DRV_OK) {
+        dma_free(bus->rx);
+        return rc;
+    }
+    if (hw->apb2) {
+        REG_SET_BITS(RCC->APB2ENR, hw->en);
+    } else {
+        REG_SET_BITS(RCC->APB1ENR, hw->en);
+    }
+
+    bus->spi = spi;
+    bus->pclk_hz = cfg->pclk_hz;
+    bus->head = NULL;
+    bus->tail = NULL;
+    bus->seg = 0;
+    bus->cur = NULL;
+    bus->cs = NULL;
+    bus->fill = cfg->fill;
+
+    /* Software NSS held high keeps the master out of mode fault. */
+    REG_WRITE(spi->CR1, SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI);
+    REG_WRITE(spi->CR2, SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+    return DRV_OK;
+}
+
+void spi_deinit(spi_bus_t *bus)
+{
+    dma_free(bus->tx);
+    dma_free(bus->rx);
+    REG_WRITE(bus->spi->CR2, 0u);
+    REG_WRITE(bus->spi->CR1, 0u);
+    bus->head = NULL;
+    bus->tail = NULL;
+    bus->cur = NULL;
+}
+
+drv_status_t spi_dev_init(spi_dev_t *dev, spi_bus_t *bus)
+{
+    uint32_t br;
+
+    if (dev == NULL || bus == NULL || dev->mode > 3u || dev->max_hz == 0u ||
+        dev->cs_pin > 15u) {
+        return DRV_ERR_PARAM;
+    }
+    for (br = 0; br < 8u; br++) {
+        if ((bus->pclk_hz >> (br + 1u)) <= dev->max_hz) {
+            break;
+        }
+    }
+    if (br == 8u) {
+        return DRV_ERR_PARAM;
+    }
+
+    dev->bus = bus;
+    dev->cr1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI
+             | reg_field_prep(SPI_CR1_BR, br)
+             | ((dev->mode & 2u) ? SPI_CR1_CPOL : 0u)
+             | ((dev->mode & 1u) ? SPI_CR1_CPHA : 0u)
+             | (dev->frame16 ? SPI_CR1_DFF : 0u)
+             | (dev->lsb_first ? SPI_CR1_LSBFIRST : 0u);
+
+    if (dev->cs_port != NULL) {
+        const gpio_config_t out = { .mode = GPIO_MODE_OUTPUT, .speed = GPIO_SPEED_HIGH };
+
+        /* Drive high before switching to output so CS never glitches low. */
+        gpio_set(dev->cs_port, GPIO_PIN(dev->cs_pin));
+        return gpio_configure(dev->cs_port, GPIO_PIN(dev->cs_pin), &out);
+    }
+    return DRV_OK;
+}
+
+static void spi_cs(const spi_dev_t *dev, bool assert)
+{
+    if (dev->cs_port != NULL) {
+        gpio_pin_write(dev->cs_port, dev->cs_pin, !assert);
+    }
+}
+
+/* Program CR1 for @p dev.  Frame format and prescaler may only change with
+ * the peripheral disabled, so this is skipped when the device is unchanged. */
+static void spi_select(spi_bus_t *bus, const spi_dev_t *dev)
+{
+    spi_regs_t *spi = bus->spi;
+
+    if (bus->cur == dev) {
+        return;
+    }
+    if (bus->cur == NULL || bus->cur->cr1 != dev->cr1) {
+        while (REG_TEST_BITS(spi->SR, SPI_SR_BSY)) {
+        }
+        REG_WRITE(spi->CR1, dev->cr1);
+    }
+    REG_WRITE(spi->CR1, dev->cr1 | SPI_CR1_SPE);
+    bus->cur = dev;
+}
+
+static bool spi_packable(const void *buf, uint16_t len)
+{
+    return buf != NULL && (len & 1u) == 0u && ((uintptr_t)buf & 3u) == 0u;
+}
+
+static void spi_seg_start(spi_bus_t *bus)
+{
+    const spi_xfer_t *x = bus->head;
+    const spi_seg_t *sg = &x->segs[bus->seg];
+    uint8_t size = x->dev->frame16 ? DMA_SIZE_HALFWORD : DMA_SIZE_BYTE;
+    dma_config_t rc = {
+        .dir = DMA_DIR_P2M, .psize = size, .msize = size,
+        .priority = 3u, .minc = sg->rx != NULL,
+    };
+    dma_config_t tc = {
+        .dir = DMA_DIR_M2P, .psize = size, .msize = size,
+        .priority = 2u, .minc = sg->tx != NULL,
+    };
+
+    /* Two 16-bit frames per memory access when the buffers allow it. */
+    if (x->dev->frame16) {
+        if (spi_packable(sg->rx, sg->len)) {
+            rc.msize = DMA_SIZE_WORD;
+        }
+        if (spi_packable(sg->tx, sg->len)) {
+            tc.msize = DMA_SIZE_WORD;
+        }
+    }
+    (void)dma_configure(bus->rx, &rc);
+    (void)dma_configure(bus->tx, &tc);
+
+    bus->rxd = (dma_xfer_t){
+        .periph = REG_ADDR(&bus->spi->DR),
+        .mem0 = (sg->rx != NULL) ? sg->rx : &bus->sink,
+        .count = sg->len,
+        .cb = spi_dma_done,
+        .ctx = bus,
+    };
+    bus->txd = (dma_xfer_t){
+        .periph = REG_ADDR(&bus->spi->DR),
+        .mem0 = (sg->tx != NULL) ? (void *)sg->tx : &bus->fill,
+        .count = sg->len,
+    };
+    /* Receive side first: it must be ready before the first frame lands. */
+    (void)dma_submit(bus->rx, &bus->rxd);
+    (void)dma_submit(bus->tx, &bus->txd);
+}
+
+static void spi_xfer_start(spi_bus_t *bus)
+{
+    spi_xfer_t *x = bus->head;
+
+    if (bus->cs != NULL && bus->cs != x->dev) {
+        spi_cs(bus->cs, false);
+        bus->cs = NULL;
+    }
+    spi_select(bus, x->dev);
+    if (bus->cs == NULL) {
+        spi_cs(x->dev, true);
+    }
+    bus->cs = x->dev;
+    bus->seg = 0;
+    spi_seg_start(bus);
+}
+
+static void spi_xfer_finish(spi_bus_t *bus, drv_status_t status)
+{
+    spi_xfer_t *x = bus->head;
+    spi_xfer_t *next;
+    uint32_t primask;
+
+    /* The last frame has been received, so the shifter is idle or about to be. */
+    while (REG_TEST_BITS(bus->spi->SR, SPI_SR_BSY)) {
+    }
+    if ((x->flags & SPI_XFER_KEEP_CS) == 0u || status != DRV_OK) {
+        spi_cs(x->dev, false);
+        bus->cs = NULL;
+    }
+
+    primask = stm32_irq_save();
+    next = x->next;
+    bus->head = next;
+    if (next == NULL) {
+        bus->tail = NULL;
+    }
+    stm32_irq_restore(primask);
+
+    if (next != NULL) {
+        spi_xfer_start(bus);
+    }
+    if (x->cb != NULL) {
+        x->cb(x->ctx, x, status);
+    }
+}
+
+static void spi_dma_done(void *ctx, uint32_t events)
+{
+    spi_bus_t *bus = ctx;
+
+    if ((events & (DMA_FLAG_TEIF | DMA_FLAG_DMEIF)) != 0u) {
+        dma_abort(bus->rx);
+        dma_abort(bus->tx);
+        spi_xfer_finish(bus, DRV_ERR_HW);
+        return;
+    }
+    if ((events & DMA_FLAG_TCIF) == 0u) {
+        return;
+    }
+    /* Every frame is received after it was sent: TX finished too.  Retire
+     * its descriptor here rather than waiting for its own interrupt. */
+    dma_abort(bus->tx);
+    if (++bus->seg < bus->head->nsegs) {
+        spi_seg_start(bus);
+    } else {
+        spi_xfer_finish(bus, DRV_OK);
+    }
+}
+
+drv_status_t spi_submit(spi_xfer_t *x)
+{
+    spi_bus_t *bus;
+    uint32_t primask;
+    uint32_t i;
+    bool idle;
+
+    if (x == NULL || x->dev == NULL || x->dev->bus == NULL || x->segs == NULL ||
+        x->nsegs == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    for (i = 0; i < x->nsegs; i++) {
+        if (x->segs[i].len == 0u) {
+            return DRV_ERR_PARAM;
+        }
+    }
+    bus = x->dev->bus;
+    x->next = NULL;
+
+    primask = stm32_irq_save();
+    idle = (bus->head == NULL);
+    if (idle) {
+        bus->head = x;
+    } else {
+        bus->tail->next = x;
+    }
+    bus->tail = x;
+    stm32_irq_restore(primask);
+
+    if (idle) {
+        spi_xfer_start(bus);
+    }
+    return DRV_OK;
+}
+
+bool spi_busy(const spi_bus_t *bus)
+{
+    return bus->head != NULL;
+}
+
+uint16_t spi_exchange(spi_bus_t *bus, const spi_dev_t *dev, uint16_t frame)
+{
+    spi_regs_t *spi = bus->spi;
+
+    spi_select(bus, dev);
+    while (!REG_TEST_BITS(spi->SR, SPI_SR_TXE)) {
+    }
+    REG_WRITE(spi->DR, frame);
+    while (!REG_TEST_BITS(spi->SR, SPI_SR_RXNE)) {
+    }
+    return (uint16_t)REG_READ(spi->DR);
+}
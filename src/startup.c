@@ -0,0 +1,133 @@
+/**
+ * @file    startup.c
+ * @brief   Reset handler, boot vector table and boot timing.
+ *
+ * Target only: linked into each firmware image, not into the library.
+ */
+#include "irq.h"
+#include "sections.h"
+#include "startup.h"
+
+/* Peripheral lines with a CMSIS handler name, by irqn_t. */
+#define STARTUP_IRQ_LIST(X)                                                   \
+    X(WWDG) X(PVD) X(TAMP_STAMP) X(RTC_WKUP) X(FLASH) X(RCC)                  \
+    X(EXTI0) X(EXTI1) X(EXTI2) X(EXTI3) X(EXTI4)                              \
+    X(DMA1_Stream0) X(DMA1_Stream1) X(DMA1_Stream2) X(DMA1_Stream3)           \
+    X(DMA1_Stream4) X(DMA1_Stream5) X(DMA1_Stream6) X(ADC)                    \
+    X(CAN1_TX) X(CAN1_RX0) X(CAN1_RX1) X(CAN1_SCE) X(EXTI9_5)                 \
+    X(TIM1_BRK_TIM9) X(TIM1_UP_TIM10) X(TIM1_TRG_COM_TIM11) X(TIM1_CC)        \
+    X(TIM2) X(TIM3) X(TIM4) X(I2C1_EV) X(I2C1_ER) X(I2C2_EV) X(I2C2_ER)       \
+    X(SPI1) X(SPI2) X(USART1) X(USART2) X(USART3) X(EXTI15_10)                \
+    X(RTC_Alarm) X(OTG_FS_WKUP) X(TIM8_BRK_TIM12) X(TIM8_UP_TIM13)            \
+    X(TIM8_TRG_COM_TIM14) X(TIM8_CC) X(DMA1_Stream7) X(FSMC) X(SDIO)          \
+    X(TIM5) X(SPI3) X(UART4) X(UART5) X(TIM6_DAC) X(TIM7)                     \
+    X(DMA2_Stream0) X(DMA2_Stream1) X(DMA2_Stream2) X(DMA2_Stream3)           \
+    X(DMA2_Stream4) X(ETH) X(ETH_WKUP) X(CAN2_TX) X(CAN2_RX0) X(CAN2_RX1)     \
+    X(CAN2_SCE) X(OTG_FS) X(DMA2_Stream5) X(DMA2_Stream6) X(DMA2_Stream7)     \
+    X(USART6) X(I2C3_EV) X(I2C3_ER) X(OTG_HS_EP1_OUT) X(OTG_HS_EP1_IN)        \
+    X(OTG_HS_WKUP) X(OTG_HS) X(DCMI) X(HASH_RNG) X(FPU) X(UART7) X(UART8)     \
+    X(SPI4) X(SPI5) X(SPI6) X(SAI1) X(LTDC) X(LTDC_ER) X(DMA2D) X(QUADSPI)
+
+#define STARTUP_WEAK_HANDLER    __attribute__((weak, alias("Default_Handler")))
+
+#define STARTUP_DECLARE(name) void name##_IRQHandler(void) STARTUP_WEAK_HANDLER;
+#define STARTUP_VECTOR(name)  [16 + name##_IRQn] = name##_IRQHandler,
+
+void NMI_Handler(void) STARTUP_WEAK_HANDLER;
+void HardFault_Handler(void) STARTUP_WEAK_HANDLER;
+void MemManage_Handler(void) STARTUP_WEAK_HANDLER;
+void BusFault_Handler(void) STARTUP_WEAK_HANDLER;
+void UsageFault_Handler(void) STARTUP_WEAK_HANDLER;
+void SVC_Handler(void) STARTUP_WEAK_HANDLER;
+void DebugMon_Handler(void) STARTUP_WEAK_HANDLER;
+void PendSV_Handler(void) STARTUP_WEAK_HANDLER;
+void SysTick_Handler(void) STARTUP_WEAK_HANDLER;
+STARTUP_IRQ_LIST(STARTUP_DECLARE)
+
+extern uint32_t _estack[];
+extern void __libc_init_array(void);
+extern int main(void);
+
+STM32_SECTION(".isr_vector")
+const irq_handler_t startup_vectors[IRQ_VECTORS] = {
+    [0] = (irq_handler_t)(uintptr_t)_estack,
+    [1] = Reset_Handler,
+    [16 + NonMaskableInt_IRQn] = NMI_Handler,
+    [16 + HardFault_IRQn] = HardFault_Handler,
+    [16 + MemoryManagement_IRQn] = MemManage_Handler,
+    [16 + BusFault_IRQn] = BusFault_Handler,
+    [16 + UsageFault_IRQn] = UsageFault_Handler,
+    [16 + SVCall_IRQn] = SVC_Handler,
+    [16 + DebugMonitor_IRQn] = DebugMon_Handler,
+    [16 + PendSV_IRQn] = PendSV_Handler,
+    [16 + SysTick_IRQn] = SysTick_Handler,
+    STARTUP_IRQ_LIST(STARTUP_VECTOR)
+};
+
+static startup_timing_t startup_cycles;
+
+/* The counter runs from here on; bench_init() later restarts it from 0. */
+static void startup_counter_init(void)
+{
+    REG_SET_BITS(COREDEBUG->DEMCR, COREDEBUG_DEMCR_TRCENA);
+#if defined(STM32F7)
+    REG_WRITE(DWT->LAR, DWT_LAR_UNLOCK);
+#endif
+    REG_WRITE(DWT->CYCCNT, 0u);
+    REG_SET_BITS(DWT->CTRL, DWT_CTRL_CYCCNTENA);
+}
+
+STM32_WEAK const rcc_plan_t *startup_clock_init(void)
+{
+    return NULL;
+}
+
+/*
+ * Nothing here may read .data or .bss before sections_init(): the timing
+ * stays in locals until then.
+ */
+void Reset_Handler(void)
+{
+    const rcc_plan_t *plan;
+    uint32_t t_clock;
+    uint32_t t_sections;
+    uint32_t t_ctors;
+
+#if defined(__ARM_FP)
+    REG_MODIFY(SCB->CPACR, reg_field_mask(SCB_CPACR_CP10) | reg_field_mask(SCB_CPACR_CP11),
+               reg_field_prep(SCB_CPACR_CP10, SCB_CPACR_FULL) |
+               reg_field_prep(SCB_CPACR_CP11, SCB_CPACR_FULL));
+    stm32_dsb();
+    stm32_isb();
+#endif
+    startup_counter_init();
+
+    plan = startup_clock_init();
+    t_clock = REG_READ(DWT->CYCCNT);
+
+    sections_init();
+    t_sections = REG_READ(DWT->CYCCNT);
+    rcc_set_current(plan);
+
+    __libc_init_array();
+    t_ctors = REG_READ(DWT->CYCCNT);
+
+    startup_cycles.clock = t_clock;
+    startup_cycles.sections = t_sections - t_clock;
+    startup_cycles.ctors = t_ctors - t_sections;
+    startup_cycles.total = REG_READ(DWT->CYCCNT);
+
+    (void)main();
+    for (;;) {
+    }
+}
+
+const startup_timing_t *startup_timing(void)
+{
+    return &startup_cycles;
+}
+
+void Default_Handler(void)
+{
+    irq_unhandled();
+}
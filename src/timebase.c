@@ -0,0 +1,462 @@
+/**
+ * @file    timebase.c
+ * @brief   Tickless 64-bit monotonic time and software timers.
+ */
+#include "irq.h"
+#include "rcc.h"
+#include "timebase.h"
+
+#define TIMEBASE_SLOT_MASK  (TIMEBASE_WHEEL_SLOTS - 1u)
+#define TIMEBASE_SLOT_BITS  (~(uint64_t)0 >> (64u - TIMEBASE_WHEEL_SLOTS))
+#define TIMEBASE_HALF       0x80000000u
+
+STM32_STATIC_ASSERT(TIMEBASE_WHEEL_SLOTS <= 64u &&
+                    (TIMEBASE_WHEEL_SLOTS & TIMEBASE_SLOT_MASK) == 0u,
+                    "wheel slots must be a power of two up to 64");
+
+typedef struct {
+    tim_regs_t *tim;
+    uint32_t en;
+    irqn_t irqn;
+} timebase_hw_t;
+
+typedef struct {
+    const timebase_hw_t *hw;
+    uint32_t hz;
+    volatile uint32_t epoch;    /**< Half counter periods elapsed. */
+    uint64_t pos;               /**< Absolute slot the wheel stands at. */
+    uint64_t busy;              /**< Non-empty slots. */
+    timebase_timer_t *slots[TIMEBASE_WHEEL_SLOTS];
+    timebase_timer_t *far;      /**< Past the horizon, by deadline. */
+} timebase_t;
+
+static const timebase_hw_t timebase_hw[] = {
+    { TIM2, RCC_APB1ENR_TIM2EN, TIM2_IRQn },
+    { TIM5, RCC_APB1ENR_TIM5EN, TIM5_IRQn },
+};
+
+static timebase_t tb;
+
+static uint64_t timebase_slot(uint64_t ticks)
+{
+    return ticks >> TIMEBASE_SLOT_SHIFT;
+}
+
+/* Bring the epoch level with the counter's half; interrupt context only. */
+static void timebase_sync(void)
+{
+    uint32_t e = tb.epoch;
+    uint32_t c = REG_READ(tb.hw->tim->CNT);
+
+    if (((e ^ (c >> 31)) & 1u) != 0u) {
+        tb.epoch = e + 1u;
+    }
+}
+
+uint64_t timebase_now(void)
+{
+    uint32_t e;
+    uint32_t c;
+
+    if (tb.hw == NULL) {
+        return 0u;
+    }
+    /* Epoch first: the counter read after it is never behind it. */
+    e = tb.epoch;
+    c = REG_READ(tb.hw->tim->CNT);
+    e += (e ^ (c >> 31)) & 1u;
+    return ((uint64_t)(e >> 1) << 32) | c;
+}
+
+static void timebase_link(timebase_timer_t **head, timebase_timer_t *t)
+{
+    t->prev = NULL;
+    t->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = t;
+    }
+    *head = t;
+    t->list = head;
+}
+
+/* Link @p t into @p head keeping deadlines ascending. */
+static void timebase_link_sorted(timebase_timer_t **head, timebase_timer_t *t)
+{
+    timebase_timer_t *p = *head;
+
+    if (p == NULL || t->deadline < p->deadline) {
+        timebase_link(head, t);
+        return;
+    }
+    while (p->next != NULL && p->next->deadline <= t->deadline) {
+        p = p->next;
+    }
+    t->prev = p;
+    t->next = p->next;
+    if (p->next != NULL) {
+        p->next->prev = t;
+    }
+    p->next = t;
+    t->list = head;
+}
+
+static void timebase_unlink(timebase_timer_t *t)
+{
+    timebase_timer_t **head = t->list;
+
+    if (t->prev != NULL) {
+        t->prev->next = t->next;
+    } else {
+        *head = t->next;
+    }
+    if (t->next != NULL) {
+        t->next->prev = t->prev;
+    }
+    if (*head == NULL && head >= tb.slots && head < tb.slots + TIMEBASE_WHEEL_SLOTS) {
+        tb.busy &= ~((uint64_t)1 << (uint32_t)(head - tb.slots));
+    }
+    t->next = NULL;
+    t->prev = NULL;
+    t->list = NULL;
+}
+
+/* Into the wheel when within its horizon (past deadlines: current slot). */
+static void timebase_insert(timebase_timer_t *t)
+{
+    uint64_t s = timebase_slot(t->deadline);
+    uint32_t i;
+
+    if (s < tb.pos) {
+        s = tb.pos;
+    }
+    if (s - tb.pos >= TIMEBASE_WHEEL_SLOTS) {
+        timebase_link_sorted(&tb.far, t);
+        return;
+    }
+    i = (uint32_t)s & TIMEBASE_SLOT_MASK;
+    timebase_link(&tb.slots[i], t);
+    tb.busy |= (uint64_t)1 << i;
+}
+
+/* Distance from absolute slot @p from to the next non-empty slot. */
+static uint32_t timebase_next_busy(uint64_t from)
+{
+    uint32_t n = (uint32_t)from & TIMEBASE_SLOT_MASK;
+    uint64_t b = tb.busy;
+
+    if (n != 0u) {
+        b = ((b >> n) | (b << (TIMEBASE_WHEEL_SLOTS - n))) & TIMEBASE_SLOT_BITS;
+    }
+    return (uint32_t)__builtin_ctzll(b);
+}
+
+/*
+ * Every wheel timer lies in [pos, pos + slots), so the first busy slot from
+ * pos holds the earliest deadline, and any far timer comes later.
+ */
+static uint64_t timebase_earliest(void)
+{
+    uint64_t best = UINT64_MAX;
+    const timebase_timer_t *t;
+
+    if (tb.busy == 0u) {
+        return (tb.far != NULL) ? tb.far->deadline : UINT64_MAX;
+    }
+    t = tb.slots[(uint32_t)(tb.pos + timebase_next_busy(tb.pos)) & TIMEBASE_SLOT_MASK];
+    for (; t != NULL; t = t->next) {
+        if (t->deadline < best) {
+            best = t->deadline;
+        }
+    }
+    return best;
+}
+
+/*
+ * Move timers due at @p now to @p done (by deadline), turn the wheel to
+ * @p now and pull in far timers that came within the horizon.
+ */
+static void timebase_expire(uint64_t now, timebase_timer_t **done)
+{
+    const uint64_t now_slot = timebase_slot(now);
+    uint64_t from = tb.pos;
+
+    while (tb.busy != 0u) {
+        uint64_t s = from + timebase_next_busy(from);
+        timebase_timer_t *t;
+        timebase_timer_t *next;
+
+        if (s > now_slot) {
+            break;
+        }
+        for (t = tb.slots[(uint32_t)s & TIMEBASE_SLOT_MASK]; t != NULL; t = next) {
+            next = t->next;
+            if (t->deadline <= now) {
+                timebase_unlink(t);
+                timebase_link_sorted(done, t);
+            }
+        }
+        if (s == now_slot) {
+            break;
+        }
+        from = s + 1u;
+    }
+    if (now_slot > tb.pos) {
+        tb.pos = now_slot;
+    }
+    while (tb.far != NULL && timebase_slot(tb.far->deadline) < tb.pos + TIMEBASE_WHEEL_SLOTS) {
+        timebase_timer_t *t = tb.far;
+
+        timebase_unlink(t);
+        timebase_insert(t);
+    }
+}
+
+/* Point channel 1 at the earliest deadline; true if it has passed already. */
+static bool timebase_arm(void)
+{
+    tim_regs_t *tim = tb.hw->tim;
+    uint64_t next = timebase_earliest();
+
+    if (next == UINT64_MAX) {
+        REG_CLR_BITS(tim->DIER, TIM_DIER_CCIE(1));
+        return false;
+    }
+    /* Deadlines further out than a wrap match early and are re-armed. */
+    REG_WRITE(tim->SR, ~TIM_SR_CCIF(1));
+    REG_WRITE(tim->CCR[0], (uint32_t)next);
+    REG_SET_BITS(tim->DIER, TIM_DIER_CCIE(1));
+    return timebase_now() >= next;
+}
+
+static const timebase_hw_t *timebase_hw_find(const tim_regs_t *tim)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(timebase_hw); i++) {
+        if (timebase_hw[i].tim == tim) {
+            return &timebase_hw[i];
+        }
+    }
+    return NULL;
+}
+
+drv_status_t timebase_init(tim_regs_t *tim, uint32_t hz)
+{
+    const timebase_hw_t *hw = timebase_hw_find(tim);
+    uint32_t clk;
+    uint32_t i;
+
+    if (hw == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    clk = rcc_timer_clock(rcc_current(), false);
+    if (hz == 0u) {
+        hz = clk;
+    }
+    if (hz > clk || clk % hz != 0u || clk / hz > 0x10000u) {
+        return DRV_ERR_PARAM;
+    }
+    if (tb.hw != NULL) {
+        timebase_deinit();
+    }
+
+    tb.hw = hw;
+    tb.hz = hz;
+    tb.epoch = 0u;
+    tb.pos = 0u;
+    tb.busy = 0u;
+    tb.far = NULL;
+    for (i = 0; i < TIMEBASE_WHEEL_SLOTS; i++) {
+        tb.slots[i] = NULL;
+    }
+
+    REG_SET_BITS(RCC->APB1ENR, hw->en);
+    REG_WRITE(tim->CR1, TIM_CR1_URS);
+    REG_WRITE(tim->DIER, 0u);
+    REG_WRITE(tim->CCMR1, 0u);          /* Channels 1 and 2: frozen compare. */
+    REG_WRITE(tim->PSC, clk / hz - 1u);
+    REG_WRITE(tim->ARR, 0xFFFFFFFFu);
+    REG_WRITE(tim->CCR[1], TIMEBASE_HALF);
+    /* Load the prescaler; URS keeps this from counting as an overflow. */
+    REG_WRITE(tim->EGR, TIM_EGR_UG);
+    REG_WRITE(tim->CNT, 0u);
+    REG_WRITE(tim->SR, 0u);
+    REG_WRITE(tim->DIER, TIM_DIER_UIE | TIM_DIER_CCIE(2));
+    REG_SET_BITS(tim->CR1, TIM_CR1_CEN);
+    return DRV_OK;
+}
+
+static void timebase_drop(timebase_timer_t **head)
+{
+    while (*head != NULL) {
+        timebase_unlink(*head);
+    }
+}
+
+void timebase_deinit(void)
+{
+    tim_regs_t *tim;
+    uint32_t primask;
+    uint32_t i;
+
+    if (tb.hw == NULL) {
+        return;
+    }
+    tim = tb.hw->tim;
+    primask = stm32_irq_save();
+    REG_WRITE(tim->CR1, 0u);
+    REG_WRITE(tim->DIER, 0u);
+    REG_WRITE(tim->SR, 0u);
+    REG_CLR_BITS(RCC->APB1ENR, tb.hw->en);
+    for (i = 0; i < TIMEBASE_WHEEL_SLOTS; i++) {
+        timebase_drop(&tb.slots[i]);
+    }
+    timebase_drop(&tb.far);
+    tb.hw = NULL;
+    stm32_irq_restore(primask);
+}
+
+uint32_t timebase_hz(void)
+{
+    return tb.hz;
+}
+
+irqn_t timebase_irqn(void)
+{
+    return (tb.hw != NULL) ? tb.hw->irqn : TIM5_IRQn;
+}
+
+uint64_t timebase_us(uint64_t us)
+{
+    return us / 1000000u * tb.hz + ((us % 1000000u) * tb.hz + 999999u) / 1000000u;
+}
+
+uint64_t timebase_ns(uint64_t ticks)
+{
+    return ticks / tb.hz * 1000000000u + (ticks % tb.hz) * 1000000000u / tb.hz;
+}
+
+void timebase_timer_init(timebase_timer_t *t, timebase_cb_t cb, void *ctx)
+{
+    t->next = NULL;
+    t->prev = NULL;
+    t->list = NULL;
+    t->deadline = 0u;
+    t->period = 0u;
+    t->cb = cb;
+    t->ctx = ctx;
+}
+
+drv_status_t timebase_timer_start(timebase_timer_t *t, uint64_t deadline, uint32_t period)
+{
+    uint32_t primask;
+
+    if (t == NULL || t->cb == NULL || tb.hw == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    primask = stm32_irq_save();
+    if (t->list != NULL) {
+        timebase_unlink(t);
+    }
+    t->deadline = deadline;
+    t->period = period;
+    timebase_insert(t);
+    if (timebase_arm()) {
+        irq_set_pending(tb.hw->irqn);
+    }
+    stm32_irq_restore(primask);
+    return DRV_OK;
+}
+
+drv_status_t timebase_timer_after(timebase_timer_t *t, uint64_t delay, uint32_t period)
+{
+    return timebase_timer_start(t, timebase_now() + delay, period);
+}
+
+bool timebase_timer_stop(timebase_timer_t *t)
+{
+    uint32_t primask = stm32_irq_save();
+    bool was = (t->list != NULL);
+
+    /* The compare may still fire for it; the interrupt then finds nothing. */
+    if (was) {
+        timebase_unlink(t);
+    }
+    stm32_irq_restore(primask);
+    return was;
+}
+
+bool timebase_timer_pending(const timebase_timer_t *t)
+{
+    return t->list != NULL;
+}
+
+uint64_t timebase_next_deadline(void)
+{
+    uint32_t primask = stm32_irq_save();
+    uint64_t next = timebase_earliest();
+
+    stm32_irq_restore(primask);
+    return next;
+}
+
+void timebase_irq(void)
+{
+    tim_regs_t *tim;
+    timebase_timer_t *done = NULL;
+    uint32_t primask;
+    bool again;
+
+    if (tb.hw == NULL) {
+        return;
+    }
+    tim = tb.hw->tim;
+    REG_WRITE(tim->SR, ~(TIM_SR_UIF | TIM_SR_CCIF(1) | TIM_SR_CCIF(2)));
+    timebase_sync();
+
+    do {
+        primask = stm32_irq_save();
+        timebase_expire(timebase_now(), &done);
+        stm32_irq_restore(primask);
+
+        /* Callbacks run unmasked; one may stop another still on the list. */
+        for (;;) {
+            timebase_timer_t *t;
+
+            primask = stm32_irq_save();
+            t = done;
+            if (t != NULL) {
+                timebase_unlink(t);
+                if (t->period != 0u) {
+                    t->deadline += t->period;
+                    timebase_insert(t);
+                }
+            }
+            stm32_irq_restore(primask);
+            if (t == NULL) {
+                break;
+            }
+            t->cb(t, t->ctx);
+        }
+
+        primask = stm32_irq_save();
+        again = timebase_arm();
+        stm32_irq_restore(primask);
+    } while (again);
+}
+
+void TIM2_IRQHandler(void);
+void TIM2_IRQHandler(void)
+{
+    if (tb.hw != NULL && tb.hw->tim == TIM2) {
+        timebase_irq();
+    }
+}
+
+void TIM5_IRQHandler(void);
+void TIM5_IRQHandler(void)
+{
+    if (tb.hw != NULL && tb.hw->tim == TIM5) {
+        timebase_irq();
+    }
+}
@@ -0,0 +1,230 @@
+/**
+ * @file    usart.c
+ * @brief   USART driver: polled transmit and DMA circular receive.
+ */
+#include "usart.h"
+
+typedef struct {
+    usart_regs_t *usart;
+    bool apb2;
+    uint32_t en;
+    dma_req_t rx_req;
+} usart_hw_t;
+
+static const usart_hw_t usart_hw[] = {
+    { USART1, true,  RCC_APB2ENR_USART1EN, DMA_REQ_USART1_RX },
+    { USART2, false, RCC_APB1ENR_USART2EN, DMA_REQ_USART2_RX },
+    { USART3, false, RCC_APB1ENR_USART3EN, DMA_REQ_USART3_RX },
+    { UART4,  false, RCC_APB1ENR_UART4EN,  DMA_REQ_UART4_RX },
+    { UART5,  false, RCC_APB1ENR_UART5EN,  DMA_REQ_UART5_RX },
+    { USART6, true,  RCC_APB2ENR_USART6EN, DMA_REQ_USART6_RX },
+};
+
+static const usart_hw_t *usart_hw_find(const usart_regs_t *usart)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(usart_hw); i++) {
+        if (usart_hw[i].usart == usart) {
+            return &usart_hw[i];
+        }
+    }
+    return NULL;
+}
+
+drv_status_t usart_init(usart_regs_t *usart, const usart_config_t *cfg)
+{
+    const usart_hw_t *hw;
+    uint32_t brr;
+    uint32_t cr1 = USART_CR1_TE | USART_CR1_RE;
+
+    if (cfg == NULL || cfg->baud == 0u || cfg->pclk_hz < 8u * cfg->baud) {
+        return DRV_ERR_PARAM;
+    }
+    hw = usart_hw_find(usart);
+    if (hw == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    if (hw->apb2) {
+        REG_SET_BITS(RCC->APB2ENR, hw->en);
+    } else {
+        REG_SET_BITS(RCC->APB1ENR, hw->en);
+    }
+
+    REG_WRITE(usart->CR1, 0u);
+    if (cfg->pclk_hz >= 16u * cfg->baud) {
+        /* BRR holds USARTDIV in 1/16 units: pclk / baud, rounded. */
+        brr = (cfg->pclk_hz + cfg->baud / 2u) / cfg->baud;
+    } else {
+        /* Oversampling by 8 doubles the ceiling: USARTDIV in 1/8 units,
+         * with the 3-bit fraction right-aligned in BRR[3:0]. */
+        brr = (cfg->pclk_hz + cfg->baud / 2u) / cfg->baud;
+        brr = ((brr & ~0x7u) << 1) | (brr & 0x7u);
+        cr1 |= USART_CR1_OVER8;
+    }
+    REG_WRITE(usart->BRR, brr);
+    REG_WRITE(usart->CR2, 0u);
+    REG_WRITE(usart->CR3, 0u);
+    REG_WRITE(usart->CR1, cr1);
+    REG_WRITE(usart->CR1, cr1 | USART_CR1_UE);
+    return DRV_OK;
+}
+
+void usart_write_byte(usart_regs_t *usart, uint8_t byte)
+{
+    while (!REG_TEST_BITS(usart->SR, USART_SR_TXE)) {
+    }
+    REG_WRITE(usart->DR, byte);
+}
+
+void usart_write(usart_regs_t *usart, const uint8_t *data, size_t len)
+{
+    while (len-- != 0u) {
+        usart_write_byte(usart, *data++);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Interrupt-driven transmit                                                */
+/* ------------------------------------------------------------------------ */
+
+drv_status_t usart_txq_init(usart_txq_t *q, usart_regs_t *usart,
+                            uint8_t *storage, uint32_t size)
+{
+    q->usart = usart;
+    return ringbuf_init(&q->rb, storage, size);
+}
+
+uint32_t usart_txq_write(usart_txq_t *q, const uint8_t *data, uint32_t len)
+{
+    uint32_t n = ringbuf_write(&q->rb, data, len);
+
+    /*
+     * The ISR only ever clears TXEIE, and only once the queue is empty.  If
+     * it runs between the publish above and this RMW, the worst outcome is
+     * one spurious TXE interrupt that finds the queue empty.
+     */
+    if (n != 0u) {
+        REG_SET_BITS(q->usart->CR1, USART_CR1_TXEIE);
+    }
+    return n;
+}
+
+void usart_txq_irq(usart_txq_t *q)
+{
+    uint8_t byte;
+
+    while (REG_TEST_BITS(q->usart->SR, USART_SR_TXE)) {
+        if (!ringbuf_pop(&q->rb, &byte)) {
+            REG_CLR_BITS(q->usart->CR1, USART_CR1_TXEIE);
+            return;
+        }
+        REG_WRITE(q->usart->DR, byte);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* DMA circular receive                                                     */
+/* ------------------------------------------------------------------------ */
+
+/* Hand everything between tail and the DMA write position to the callback. */
+static void usart_dma_rx_process(usart_dma_rx_t *rx)
+{
+    size_t head = rx->size - dma_remaining(rx->dma);
+
+    if (head == rx->size) {
+        head = 0;
+    }
+    if (head == rx->tail) {
+        return;
+    }
+    if (head > rx->tail) {
+        rx->cb(rx->ctx, rx->buf + rx->tail, head - rx->tail);
+    } else {
+        rx->cb(rx->ctx, rx->buf + rx->tail, rx->size - rx->tail);
+        if (head != 0u) {
+            rx->cb(rx->ctx, rx->buf, head);
+        }
+    }
+    rx->tail = head;
+}
+
+static void usart_dma_rx_event(void *ctx, uint32_t events)
+{
+    usart_dma_rx_t *rx = ctx;
+
+    usart_dma_rx_process(rx);
+    if ((events & DMA_FLAG_TEIF) != 0u) {
+        /* A transfer error stops the stream: restart from the buffer start. */
+        rx->tail = 0;
+        (void)dma_submit(rx->dma, &rx->xfer);
+    }
+}
+
+drv_status_t usart_dma_rx_start(usart_dma_rx_t *rx, usart_regs_t *usart,
+                                const usart_dma_rx_config_t *cfg)
+{
+    const dma_config_t dcfg = {
+        .dir = DMA_DIR_P2M,
+        .psize = DMA_SIZE_BYTE,
+        .msize = DMA_SIZE_BYTE,
+        .priority = 2u,
+        .minc = true,
+        .circular = true,
+        .half = true,
+    };
+    const usart_hw_t *hw = usart_hw_find(usart);
+    drv_status_t rc;
+
+    if (rx == NULL || cfg == NULL || hw == NULL || cfg->buf == NULL ||
+        cfg->cb == NULL || cfg->size == 0u || cfg->size > 0xFFFFu) {
+        return DRV_ERR_PARAM;
+    }
+    rc = dma_alloc(hw->rx_req, &rx->dma);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    (void)dma_configure(rx->dma, &dcfg);
+
+    rx->usart = usart;
+    rx->buf = cfg->buf;
+    rx->size = cfg->size;
+    rx->tail = 0;
+    rx->cb = cfg->cb;
+    rx->ctx = cfg->ctx;
+    rx->xfer = (dma_xfer_t){
+        .periph = REG_ADDR(&usart->DR),
+        .mem0 = cfg->buf,
+        .count = (uint16_t)cfg->size,
+        .cb = usart_dma_rx_event,
+        .ctx = rx,
+    };
+    (void)dma_submit(rx->dma, &rx->xfer);
+
+    /* Clear a stale IDLE flag (SR then DR read) before enabling its IRQ. */
+    (void)REG_READ(usart->SR);
+    (void)REG_READ(usart->DR);
+    REG_SET_BITS(usart->CR3, USART_CR3_DMAR);
+    REG_SET_BITS(usart->CR1, USART_CR1_IDLEIE);
+    return DRV_OK;
+}
+
+void usart_dma_rx_stop(usart_dma_rx_t *rx)
+{
+    REG_CLR_BITS(rx->usart->CR1, USART_CR1_IDLEIE);
+    REG_CLR_BITS(rx->usart->CR3, USART_CR3_DMAR);
+    usart_dma_rx_process(rx);
+    dma_free(rx->dma);
+    rx->dma = NULL;
+}
+
+void usart_dma_rx_usart_irq(usart_dma_rx_t *rx)
+{
+    uint32_t sr = REG_READ(rx->usart->SR);
+
+    if ((sr & (USART_SR_IDLE | USART_SR_ORE)) != 0u) {
+        /* SR read followed by DR read clears IDLE/ORE. */
+        (void)REG_READ(rx->usart->DR);
+        usart_dma_rx_process(rx);
+    }
+}
@@ -0,0 +1,1000 @@
+/**
+ * @file    usb.c
+ * @brief   USB full-speed device core on OTG_FS: enumeration, endpoint 0
+ *          and FIFO access for class drivers.
+ */
+#include <string.h>
+
+#include "rcc.h"
+#include "usb.h"
+
+/* Polls of GRSTCTL / DIEPINT for the core to finish a reset, flush or disable. */
+#define USB_RESET_TIMEOUT   100000u
+
+#define USB_GINTMSK         (OTG_GINT_USBRST | OTG_GINT_ENUMDNE | OTG_GINT_RXFLVL |   \
+                             OTG_GINT_IEPINT | OTG_GINT_OEPINT | OTG_GINT_USBSUSP |    \
+                             OTG_GINT_WKUPINT)
+#define USB_DOEPMSK         (OTG_EPINT_XFRC | OTG_EPINT_STUP)
+#define USB_DIEPMSK         (OTG_EPINT_XFRC)
+
+/* Control transfer stages. */
+enum {
+    USB_EP0_IDLE = 0,       /* Waiting for SETUP. */
+    USB_EP0_DATA_IN,
+    USB_EP0_DATA_OUT,
+    USB_EP0_STATUS_IN,
+    USB_EP0_STATUS_OUT,
+};
+
+/* Turnaround time in PHY clocks by minimum HCLK (RM0090 table 206). */
+static const struct {
+    uint32_t hclk_hz;
+    uint8_t trdt;
+} usb_trdt_table[] = {
+    { 32000000u, 0x6u }, { 27500000u, 0x7u }, { 24000000u, 0x8u }, { 21800000u, 0x9u },
+    { 20000000u, 0xAu }, { 18500000u, 0xBu }, { 17200000u, 0xCu }, { 16000000u, 0xDu },
+    { 15000000u, 0xEu }, { 14200000u, 0xFu },
+};
+
+/* Device served by OTG_FS_IRQHandler. */
+static usb_dev_t *usb_handle;
+
+/* ------------------------------------------------------------------------ */
+/* FIFO access                                                              */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Pop @p na bytes into @p a, then @p nb into @p b: the two halves of a
+ * wrapped ring region.  The word straddling the halves is split bytewise;
+ * every other word is one (possibly unaligned) store.
+ */
+static void usb_fifo_pop(usb_dev_t *d, uint8_t *a, uint32_t na, uint8_t *b, uint32_t nb)
+{
+    volatile uint32_t *fifo = &d->otg->FIFO[0][0];
+    uint32_t w;
+    uint32_t k;
+
+    for (; na >= 4u; na -= 4u, a += 4u) {
+        w = REG_READ(*fifo);
+        memcpy(a, &w, 4u);
+    }
+    if (na != 0u) {
+        w = REG_READ(*fifo);
+        memcpy(a, &w, na);
+        k = (nb < 4u - na) ? nb : 4u - na;
+        if (k != 0u) {
+            memcpy(b, (const uint8_t *)&w + na, k);
+            b += k;
+            nb -= k;
+        }
+    }
+    for (; nb >= 4u; nb -= 4u, b += 4u) {
+        w = REG_READ(*fifo);
+        memcpy(b, &w, 4u);
+    }
+    if (nb != 0u) {
+        w = REG_READ(*fifo);
+        memcpy(b, &w, nb);
+    }
+}
+
+/* Push @p na bytes from @p a, then @p nb from @p b, as one packet to IN FIFO @p ep. */
+static void usb_fifo_push(usb_dev_t *d, uint32_t ep, const uint8_t *a, uint32_t na,
+                          const uint8_t *b, uint32_t nb)
+{
+    volatile uint32_t *fifo = &d->otg->FIFO[ep][0];
+    uint32_t w;
+    uint32_t k;
+
+    for (; na >= 4u; na -= 4u, a += 4u) {
+        memcpy(&w, a, 4u);
+        REG_WRITE(*fifo, w);
+    }
+    if (na != 0u) {
+        w = 0;
+        memcpy(&w, a, na);
+        k = (nb < 4u - na) ? nb : 4u - na;
+        if (k != 0u) {
+            memcpy((uint8_t *)&w + na, b, k);
+            b += k;
+            nb -= k;
+        }
+        REG_WRITE(*fifo, w);
+    }
+    for (; nb >= 4u; nb -= 4u, b += 4u) {
+        memcpy(&w, b, 4u);
+        REG_WRITE(*fifo, w);
+    }
+    if (nb != 0u) {
+        w = 0;
+        memcpy(&w, b, nb);
+        REG_WRITE(*fifo, w);
+    }
+}
+
+/* Drop the rest of the current OUT packet. */
+static void usb_fifo_skip(usb_dev_t *d)
+{
+    uint32_t words = (d->rx_left + 3u) / 4u;
+
+    d->rx_dropped += d->rx_left;
+    d->rx_left = 0;
+    while (words-- != 0u) {
+        (void)REG_READ(d->otg->FIFO[0][0]);
+    }
+}
+
+static drv_status_t usb_grstctl_wait(otg_regs_t *otg, uint32_t bits)
+{
+    uint32_t n;
+
+    for (n = 0; n < USB_RESET_TIMEOUT; n++) {
+        if ((REG_READ(otg->GRSTCTL) & bits) == 0u) {
+            return DRV_OK;
+        }
+    }
+    return DRV_ERR_TIMEOUT;
+}
+
+static void usb_tx_flush(otg_regs_t *otg, uint32_t txfnum)
+{
+    REG_WRITE(otg->GRSTCTL, OTG_GRSTCTL_TXFFLSH | reg_field_prep(OTG_GRSTCTL_TXFNUM, txfnum));
+    (void)usb_grstctl_wait(otg, OTG_GRSTCTL_TXFFLSH);
+}
+
+uint32_t usb_ep_read(usb_dev_t *d, void *data, uint32_t len)
+{
+    uint32_t n = (len < d->rx_left) ? len : d->rx_left;
+    uint32_t words = (n + 3u) / 4u;
+
+    usb_fifo_pop(d, data, n, NULL, 0u);
+    d->rx_left -= (4u * words < d->rx_left) ? 4u * words : d->rx_left;
+    return n;
+}
+
+uint32_t usb_ep_read_ring(usb_dev_t *d, ringbuf_t *rb, uint32_t len)
+{
+    uint8_t *a;
+    uint32_t na;
+    uint32_t n = (len < d->rx_left) ? len : d->rx_left;
+    uint32_t words;
+
+    if (n > ringbuf_free(rb)) {
+        n = ringbuf_free(rb);
+    }
+    words = (n + 3u) / 4u;
+    na = ringbuf_write_span(rb, &a);
+    if (na > n) {
+        na = n;
+    }
+    usb_fifo_pop(d, a, na, rb->buf, n - na);
+    ringbuf_write_commit(rb, n);
+    d->rx_left -= (4u * words < d->rx_left) ? 4u * words : d->rx_left;
+    return n;
+}
+
+bool usb_ep_write(usb_dev_t *d, uint8_t ep, const void *data, uint32_t len)
+{
+    otg_regs_t *otg = d->otg;
+
+    ep &= 0x0Fu;
+    if (REG_FIELD_READ(otg->IEP[ep].TXFSTS, OTG_TXFSTS_INEPTFSAV) < (len + 3u) / 4u) {
+        return false;
+    }
+    usb_fifo_push(d, ep, data, len, NULL, 0u);
+    d->in_left[ep] -= (len < d->in_left[ep]) ? len : d->in_left[ep];
+    if (d->in_left[ep] == 0u && (d->empmsk & REG_BIT(ep)) != 0u) {
+        d->empmsk &= ~REG_BIT(ep);
+        REG_WRITE(otg->DIEPEMPMSK, d->empmsk);
+    }
+    return true;
+}
+
+uint32_t usb_ep_write_ring(usb_dev_t *d, uint8_t ep, ringbuf_t *rb)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t mps;
+    uint32_t space;
+    uint32_t total = 0;
+
+    ep &= 0x0Fu;
+    mps = d->mps_in[ep];
+    space = REG_FIELD_READ(otg->IEP[ep].TXFSTS, OTG_TXFSTS_INEPTFSAV);
+    while (d->in_left[ep] != 0u) {
+        uint32_t n = (d->in_left[ep] < mps) ? d->in_left[ep] : mps;
+        uint32_t words = (n + 3u) / 4u;
+        const uint8_t *a;
+        uint32_t na;
+
+        if (space < words) {
+            break;
+        }
+        na = ringbuf_read_span(rb, &a);
+        if (na > n) {
+            na = n;
+        }
+        usb_fifo_push(d, ep, a, na, rb->buf, n - na);
+        ringbuf_read_commit(rb, n);
+        d->in_left[ep] -= n;
+        space -= words;
+        total += n;
+    }
+    if (d->in_left[ep] == 0u && (d->empmsk & REG_BIT(ep)) != 0u) {
+        d->empmsk &= ~REG_BIT(ep);
+        REG_WRITE(otg->DIEPEMPMSK, d->empmsk);
+    }
+    return total;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Endpoints                                                                */
+/* ------------------------------------------------------------------------ */
+
+drv_status_t usb_ep_open(usb_dev_t *d, uint8_t addr, uint32_t type, uint32_t mps)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t ep = addr & 0x0Fu;
+    uint32_t ctl;
+
+    if (ep == 0u || ep >= USB_EP_COUNT || type > USB_EP_INTERRUPT || mps == 0u ||
+        mps > ((type == USB_EP_ISO) ? 1023u : USB_FS_MPS_MAX)) {
+        return DRV_ERR_PARAM;
+    }
+    ctl = reg_field_prep(OTG_EPCTL_MPSIZ, mps) | reg_field_prep(OTG_EPCTL_EPTYP, type) |
+          OTG_EPCTL_SD0PID | OTG_EPCTL_USBAEP | OTG_EPCTL_SNAK;
+    if ((addr & USB_EP_IN) != 0u) {
+        if (d->cfg->tx_fifo_words[ep] < (mps + 3u) / 4u) {
+            return DRV_ERR_NORES;
+        }
+        d->mps_in[ep] = (uint16_t)mps;
+        d->in_left[ep] = 0;
+        REG_WRITE(otg->IEP[ep].CTL, ctl | reg_field_prep(OTG_EPCTL_TXFNUM, ep));
+        REG_SET_BITS(otg->DAINTMSK, OTG_DAINT_IEP(ep));
+    } else {
+        d->mps_out[ep] = (uint16_t)mps;
+        REG_WRITE(otg->OEP[ep].CTL, ctl);
+        REG_SET_BITS(otg->DAINTMSK, OTG_DAINT_OEP(ep));
+    }
+    return DRV_OK;
+}
+
+/* Disable a busy endpoint and wait for the core to confirm. */
+static void usb_ep_disable(otg_ep_regs_t *r)
+{
+    uint32_t n;
+
+    if ((REG_READ(r->CTL) & OTG_EPCTL_EPENA) == 0u) {
+        return;
+    }
+    REG_SET_BITS(r->CTL, OTG_EPCTL_EPDIS | OTG_EPCTL_SNAK);
+    for (n = 0; n < USB_RESET_TIMEOUT; n++) {
+        if ((REG_READ(r->INT) & OTG_EPINT_EPDISD) != 0u) {
+            break;
+        }
+    }
+    REG_WRITE(r->INT, OTG_EPINT_EPDISD);
+}
+
+void usb_ep_close(usb_dev_t *d, uint8_t addr)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t ep = addr & 0x0Fu;
+
+    if (ep == 0u || ep >= USB_EP_COUNT) {
+        return;
+    }
+    if ((addr & USB_EP_IN) != 0u) {
+        REG_CLR_BITS(otg->DAINTMSK, OTG_DAINT_IEP(ep));
+        d->empmsk &= ~REG_BIT(ep);
+        REG_WRITE(otg->DIEPEMPMSK, d->empmsk);
+        usb_ep_disable(&otg->IEP[ep]);
+        REG_WRITE(otg->IEP[ep].CTL, OTG_EPCTL_SNAK);
+        usb_tx_flush(otg, ep);
+        d->mps_in[ep] = 0;
+        d->in_left[ep] = 0;
+    } else {
+        REG_CLR_BITS(otg->DAINTMSK, OTG_DAINT_OEP(ep));
+        usb_ep_disable(&otg->OEP[ep]);
+        REG_WRITE(otg->OEP[ep].CTL, OTG_EPCTL_SNAK);
+        d->mps_out[ep] = 0;
+    }
+}
+
+static void usb_ep_close_all(usb_dev_t *d)
+{
+    uint8_t ep;
+
+    for (ep = 1; ep < USB_EP_COUNT; ep++) {
+        usb_ep_close(d, ep | USB_EP_IN);
+        usb_ep_close(d, ep);
+    }
+}
+
+void usb_ep_stall(usb_dev_t *d, uint8_t addr, bool stall)
+{
+    uint32_t ep = addr & 0x0Fu;
+    otg_ep_regs_t *r = ((addr & USB_EP_IN) != 0u) ? &d->otg->IEP[ep] : &d->otg->OEP[ep];
+
+    if (stall) {
+        if ((addr & USB_EP_IN) != 0u) {
+            usb_ep_disable(r);
+        }
+        REG_SET_BITS(r->CTL, OTG_EPCTL_STALL);
+    } else {
+        REG_MODIFY(r->CTL, OTG_EPCTL_STALL, (ep != 0u) ? OTG_EPCTL_SD0PID : 0u);
+    }
+}
+
+bool usb_ep_stalled(const usb_dev_t *d, uint8_t addr)
+{
+    uint32_t ep = addr & 0x0Fu;
+    const otg_ep_regs_t *r = ((addr & USB_EP_IN) != 0u) ? &d->otg->IEP[ep] : &d->otg->OEP[ep];
+
+    return (REG_READ(r->CTL) & OTG_EPCTL_STALL) != 0u;
+}
+
+void usb_ep_out_arm(usb_dev_t *d, uint8_t ep, uint32_t packets)
+{
+    otg_ep_regs_t *r = &d->otg->OEP[ep & 0x0Fu];
+
+    REG_WRITE(r->TSIZ, reg_field_prep(OTG_TSIZ_PKTCNT, packets) |
+                       reg_field_prep(OTG_TSIZ_XFRSIZ, packets * d->mps_out[ep & 0x0Fu]));
+    REG_SET_BITS(r->CTL, OTG_EPCTL_EPENA | OTG_EPCTL_CNAK);
+}
+
+void usb_ep_in_start(usb_dev_t *d, uint8_t ep, uint32_t len)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t mps;
+    uint32_t pkts;
+
+    ep &= 0x0Fu;
+    mps = d->mps_in[ep];
+    pkts = (len == 0u) ? 1u : (len + mps - 1u) / mps;
+    d->in_left[ep] = len;
+    REG_WRITE(otg->IEP[ep].TSIZ, reg_field_prep(OTG_TSIZ_PKTCNT, pkts) |
+                                 reg_field_prep(OTG_TSIZ_XFRSIZ, len));
+    REG_SET_BITS(otg->IEP[ep].CTL, OTG_EPCTL_EPENA | OTG_EPCTL_CNAK);
+    if (len != 0u) {
+        d->empmsk |= REG_BIT(ep);
+        REG_WRITE(otg->DIEPEMPMSK, d->empmsk);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Endpoint 0                                                               */
+/* ------------------------------------------------------------------------ */
+
+/* Accept SETUP and one OUT packet (data or status stage) on EP0. */
+static void usb_ep0_out_arm(usb_dev_t *d)
+{
+    otg_ep_regs_t *r = &d->otg->OEP[0];
+
+    REG_WRITE(r->TSIZ, reg_field_prep(OTG_TSIZ_STUPCNT, 3u) |
+                       reg_field_prep(OTG_TSIZ_PKTCNT_EP0, 1u) |
+                       reg_field_prep(OTG_TSIZ_XFRSIZ_EP0, USB_EP0_MPS));
+    REG_SET_BITS(r->CTL, OTG_EPCTL_EPENA | OTG_EPCTL_CNAK);
+}
+
+/* Send the next packet of the data stage (a zero-length one ends it). */
+static void usb_ep0_send(usb_dev_t *d)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t n = (d->ep0_left < USB_EP0_MPS) ? d->ep0_left : USB_EP0_MPS;
+
+    if (n < USB_EP0_MPS) {
+        d->ep0_zlp = false;
+    }
+    REG_WRITE(otg->IEP[0].TSIZ, reg_field_prep(OTG_TSIZ_PKTCNT_EP0, 1u) |
+                                reg_field_prep(OTG_TSIZ_XFRSIZ_EP0, n));
+    REG_SET_BITS(otg->IEP[0].CTL, OTG_EPCTL_EPENA | OTG_EPCTL_CNAK);
+    if (n != 0u) {
+        usb_fifo_push(d, 0u, d->ep0_data, n, NULL, 0u);
+    }
+    d->ep0_data += n;
+    d->ep0_left -= (uint16_t)n;
+}
+
+static void usb_ep0_status_in(usb_dev_t *d)
+{
+    d->ep0_stage = USB_EP0_STATUS_IN;
+    d->ep0_left = 0;
+    d->ep0_zlp = false;
+    usb_ep0_send(d);
+}
+
+static void usb_ep0_stall(usb_dev_t *d)
+{
+    d->ep0_stage = USB_EP0_IDLE;
+    REG_SET_BITS(d->otg->IEP[0].CTL, OTG_EPCTL_STALL);
+    REG_SET_BITS(d->otg->OEP[0].CTL, OTG_EPCTL_STALL);
+    usb_ep0_out_arm(d);
+}
+
+static uint16_t usb_get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint16_t usb_string_desc(usb_dev_t *d, const char *s)
+{
+    uint32_t n = 0;
+
+    while (s[n] != '\0' && 2u + 2u * (n + 1u) <= sizeof(d->ep0_buf)) {
+        d->ep0_buf[2u + 2u * n] = (uint8_t)s[n];
+        d->ep0_buf[3u + 2u * n] = 0u;
+        n++;
+    }
+    d->ep0_buf[0] = (uint8_t)(2u + 2u * n);
+    d->ep0_buf[1] = USB_DESC_STRING;
+    return (uint16_t)(2u + 2u * n);
+}
+
+static drv_status_t usb_get_descriptor(usb_dev_t *d, const usb_setup_t *req,
+                                       const uint8_t **data, uint16_t *len)
+{
+    static const uint8_t langid[4] = { 4u, USB_DESC_STRING, 0x09u, 0x04u };
+    const usb_config_t *cfg = d->cfg;
+    uint32_t idx = req->wValue & 0xFFu;
+
+    switch (req->wValue >> 8) {
+    case USB_DESC_DEVICE:
+        *data = cfg->device_desc;
+        *len = cfg->device_desc[0];
+        return DRV_OK;
+    case USB_DESC_CONFIG:
+        if (idx != 0u) {
+            return DRV_ERR_PARAM;
+        }
+        *data = cfg->config_desc;
+        *len = usb_get_le16(&cfg->config_desc[2]);
+        return DRV_OK;
+    case USB_DESC_STRING:
+        if (idx == 0u) {
+            *data = langid;
+            *len = sizeof(langid);
+            return DRV_OK;
+        }
+        if (idx > cfg->nstrings || cfg->strings[idx - 1u] == NULL) {
+            return DRV_ERR_PARAM;
+        }
+        *data = d->ep0_buf;
+        *len = usb_string_desc(d, cfg->strings[idx - 1u]);
+        return DRV_OK;
+    default:
+        /* Full-speed only: no device qualifier or other-speed descriptors. */
+        return DRV_ERR_PARAM;
+    }
+}
+
+static drv_status_t usb_set_config(usb_dev_t *d, uint32_t value)
+{
+    const usb_class_t *cls = d->cfg->cls;
+    drv_status_t rc = DRV_OK;
+
+    if (d->state < USB_STATE_ADDRESS ||
+        (value != 0u && value != d->cfg->config_desc[5])) {
+        return DRV_ERR_PARAM;
+    }
+    if (d->config != 0u) {
+        usb_ep_close_all(d);
+        d->config = 0;
+        d->state = USB_STATE_ADDRESS;
+        if (cls->configure != NULL) {
+            (void)cls->configure(d, 0u);
+        }
+    }
+    if (value != 0u) {
+        d->config = (uint8_t)value;
+        d->state = USB_STATE_CONFIGURED;
+        if (cls->configure != NULL) {
+            rc = cls->configure(d, (uint8_t)value);
+        }
+        if (rc != DRV_OK) {
+            usb_ep_close_all(d);
+            d->config = 0;
+            d->state = USB_STATE_ADDRESS;
+        }
+    }
+    return rc;
+}
+
+/* Endpoint @p addr named by a request exists in the current state. */
+static bool usb_ep_valid(const usb_dev_t *d, uint32_t addr)
+{
+    uint32_t ep = addr & 0x0Fu;
+
+    if (ep == 0u) {
+        return true;
+    }
+    if (d->state != USB_STATE_CONFIGURED || ep >= USB_EP_COUNT) {
+        return false;
+    }
+    return (((addr & USB_EP_IN) != 0u) ? d->mps_in[ep] : d->mps_out[ep]) != 0u;
+}
+
+static drv_status_t usb_std_request(usb_dev_t *d, const usb_setup_t *req,
+                                    const uint8_t **data, uint16_t *len)
+{
+    uint32_t recip = req->bmRequestType & USB_REQ_RECIP_MASK;
+
+    *data = d->ep0_buf;
+    *len = 0;
+    switch (recip) {
+    case USB_REQ_RECIP_DEVICE:
+        switch (req->bRequest) {
+        case USB_REQ_GET_STATUS:
+            d->ep0_buf[0] = ((d->cfg->config_desc[7] & 0x40u) != 0u) ? 1u : 0u;
+            d->ep0_buf[1] = 0u;
+            *len = 2;
+            return DRV_OK;
+        case USB_REQ_CLEAR_FEATURE:
+        case USB_REQ_SET_FEATURE:
+            return (req->wValue == USB_FEATURE_REMOTE_WAKEUP) ? DRV_OK : DRV_ERR_PARAM;
+        case USB_REQ_SET_ADDRESS:
+            if (req->wValue > 127u || d->state == USB_STATE_CONFIGURED) {
+                return DRV_ERR_PARAM;
+            }
+            /* Takes effect after the status stage; the core holds it until then. */
+            REG_FIELD_WRITE(d->otg->DCFG, OTG_DCFG_DAD, req->wValue);
+            d->state = (req->wValue != 0u) ? USB_STATE_ADDRESS : USB_STATE_DEFAULT;
+            return DRV_OK;
+        case USB_REQ_GET_DESCRIPTOR:
+            return usb_get_descriptor(d, req, data, len);
+        case USB_REQ_GET_CONFIGURATION:
+            d->ep0_buf[0] = d->config;
+            *len = 1;
+            return DRV_OK;
+        case USB_REQ_SET_CONFIGURATION:
+            return usb_set_config(d, req->wValue);
+        default:
+            return DRV_ERR_PARAM;
+        }
+    case USB_REQ_RECIP_INTERFACE:
+        if (d->state != USB_STATE_CONFIGURED) {
+            return DRV_ERR_PARAM;
+        }
+        switch (req->bRequest) {
+        case USB_REQ_GET_STATUS:
+            d->ep0_buf[0] = 0u;
+            d->ep0_buf[1] = 0u;
+            *len = 2;
+            return DRV_OK;
+        case USB_REQ_GET_INTERFACE:
+            d->ep0_buf[0] = 0u;
+            *len = 1;
+            return DRV_OK;
+        case USB_REQ_SET_INTERFACE:
+            return (req->wValue == 0u) ? DRV_OK : DRV_ERR_PARAM;
+        default:
+            break;
+        }
+        break;
+    case USB_REQ_RECIP_ENDPOINT:
+        if (!usb_ep_valid(d, req->wIndex)) {
+            return DRV_ERR_PARAM;
+        }
+        switch (req->bRequest) {
+        case USB_REQ_GET_STATUS:
+            d->ep0_buf[0] = usb_ep_stalled(d, (uint8_t)req->wIndex) ? 1u : 0u;
+            d->ep0_buf[1] = 0u;
+            *len = 2;
+            return DRV_OK;
+        case USB_REQ_CLEAR_FEATURE:
+        case USB_REQ_SET_FEATURE:
+            if (req->wValue != USB_FEATURE_ENDPOINT_HALT) {
+                return DRV_ERR_PARAM;
+            }
+            if ((req->wIndex & 0x0Fu) != 0u) {
+                usb_ep_stall(d, (uint8_t)req->wIndex, req->bRequest == USB_REQ_SET_FEATURE);
+            }
+            return DRV_OK;
+        default:
+            return DRV_ERR_PARAM;
+        }
+    default:
+        break;
+    }
+    /* Other standard interface requests belong to the class. */
+    if (d->cfg->cls->setup == NULL) {
+        return DRV_ERR_PARAM;
+    }
+    return d->cfg->cls->setup(d, req, data, len);
+}
+
+static void usb_ep0_setup(usb_dev_t *d)
+{
+    const uint8_t *raw = (const uint8_t *)d->setup_raw;
+    usb_setup_t *req = &d->setup;
+    const uint8_t *data = NULL;
+    uint16_t len = 0;
+    drv_status_t rc;
+
+    req->bmRequestType = raw[0];
+    req->bRequest = raw[1];
+    req->wValue = usb_get_le16(&raw[2]);
+    req->wIndex = usb_get_le16(&raw[4]);
+    req->wLength = usb_get_le16(&raw[6]);
+
+    if ((req->bmRequestType & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD) {
+        rc = usb_std_request(d, req, &data, &len);
+    } else if (d->cfg->cls->setup != NULL) {
+        rc = d->cfg->cls->setup(d, req, &data, &len);
+    } else {
+        rc = DRV_ERR_PARAM;
+    }
+    if (rc != DRV_OK) {
+        usb_ep0_stall(d);
+        return;
+    }
+
+    if (req->wLength == 0u) {
+        usb_ep0_status_in(d);
+        usb_ep0_out_arm(d);
+    } else if ((req->bmRequestType & USB_REQ_DIR_IN) != 0u) {
+        d->ep0_stage = USB_EP0_DATA_IN;
+        d->ep0_data = data;
+        d->ep0_left = (len < req->wLength) ? len : req->wLength;
+        d->ep0_zlp = d->ep0_left < req->wLength && (d->ep0_left % USB_EP0_MPS) == 0u;
+        usb_ep0_send(d);
+        /* The host may end the data stage early with the status OUT. */
+        usb_ep0_out_arm(d);
+    } else if (req->wLength <= sizeof(d->ep0_buf)) {
+        d->ep0_stage = USB_EP0_DATA_OUT;
+        d->ep0_rx_len = 0;
+        usb_ep0_out_arm(d);
+    } else {
+        usb_ep0_stall(d);
+    }
+}
+
+static void usb_ep0_in_done(usb_dev_t *d)
+{
+    switch (d->ep0_stage) {
+    case USB_EP0_DATA_IN:
+        if (d->ep0_left != 0u || d->ep0_zlp) {
+            usb_ep0_send(d);
+        } else {
+            d->ep0_stage = USB_EP0_STATUS_OUT;
+        }
+        break;
+    case USB_EP0_STATUS_IN:
+        d->ep0_stage = USB_EP0_IDLE;
+        break;
+    default:
+        break;
+    }
+}
+
+static void usb_ep0_out_done(usb_dev_t *d)
+{
+    const usb_class_t *cls = d->cfg->cls;
+
+    switch (d->ep0_stage) {
+    case USB_EP0_DATA_OUT:
+        if (d->ep0_rx_len < d->setup.wLength) {
+            usb_ep0_out_arm(d);
+            break;
+        }
+        if (cls->ctrl_out != NULL) {
+            cls->ctrl_out(d, &d->setup, d->ep0_buf, d->ep0_rx_len);
+        }
+        usb_ep0_status_in(d);
+        usb_ep0_out_arm(d);
+        break;
+    case USB_EP0_STATUS_OUT:
+        d->ep0_stage = USB_EP0_IDLE;
+        usb_ep0_out_arm(d);
+        break;
+    default:
+        usb_ep0_out_arm(d);
+        break;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Interrupts                                                               */
+/* ------------------------------------------------------------------------ */
+
+static void usb_bus_reset(usb_dev_t *d)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t ep;
+
+    d->resets++;
+    REG_CLR_BITS(otg->DCTL, OTG_DCTL_RWUSIG);
+    if (d->config != 0u) {
+        usb_ep_close_all(d);
+        d->config = 0;
+        if (d->cfg->cls->configure != NULL) {
+            (void)d->cfg->cls->configure(d, 0u);
+        }
+    }
+    usb_tx_flush(otg, OTG_GRSTCTL_TXFNUM_ALL);
+    for (ep = 0; ep < USB_EP_COUNT; ep++) {
+        REG_WRITE(otg->IEP[ep].INT, 0xFFFFFFFFu);
+        REG_WRITE(otg->OEP[ep].INT, 0xFFFFFFFFu);
+    }
+    d->empmsk = 0;
+    REG_WRITE(otg->DIEPEMPMSK, 0u);
+    REG_WRITE(otg->DAINTMSK, OTG_DAINT_IEP(0) | OTG_DAINT_OEP(0));
+    REG_FIELD_WRITE(otg->DCFG, OTG_DCFG_DAD, 0u);
+    d->ep0_stage = USB_EP0_IDLE;
+    d->state = USB_STATE_DEFAULT;
+    d->suspended = false;
+    usb_ep0_out_arm(d);
+}
+
+static void usb_enum_done(usb_dev_t *d)
+{
+    otg_regs_t *otg = d->otg;
+
+    d->mps_in[0] = USB_EP0_MPS;
+    d->mps_out[0] = USB_EP0_MPS;
+    REG_FIELD_WRITE(otg->IEP[0].CTL, OTG_EPCTL_MPSIZ_EP0, 0u);
+    REG_WRITE(otg->DCTL, REG_READ(otg->DCTL) | OTG_DCTL_CGINAK);
+    usb_ep0_out_arm(d);
+}
+
+static void usb_rx_drain(usb_dev_t *d)
+{
+    otg_regs_t *otg = d->otg;
+    const usb_class_t *cls = d->cfg->cls;
+
+    while ((REG_READ(otg->GINTSTS) & OTG_GINT_RXFLVL) != 0u) {
+        uint32_t sts = REG_READ(otg->GRXSTSP);
+        uint8_t ep = (uint8_t)reg_field_get(sts, OTG_GRXSTS_EPNUM);
+
+        d->rx_left = reg_field_get(sts, OTG_GRXSTS_BCNT);
+        switch (reg_field_get(sts, OTG_GRXSTS_PKTSTS)) {
+        case OTG_PKTSTS_SETUP_DATA:
+            usb_fifo_pop(d, (uint8_t *)d->setup_raw, 8u, NULL, 0u);
+            d->rx_left = 0;
+            break;
+        case OTG_PKTSTS_OUT_DATA:
+            if (ep == 0u) {
+                if (d->ep0_stage == USB_EP0_DATA_OUT) {
+                    uint32_t room = d->setup.wLength - d->ep0_rx_len;
+
+                    d->ep0_rx_len += (uint16_t)usb_ep_read(d, &d->ep0_buf[d->ep0_rx_len],
+                                                           room);
+                }
+            } else if (cls->rx != NULL) {
+                cls->rx(d, ep, d->rx_left);
+            }
+            break;
+        default:
+            break;
+        }
+        if (d->rx_left != 0u) {
+            usb_fifo_skip(d);
+        }
+    }
+}
+
+static void usb_out_irq(usb_dev_t *d, uint8_t ep)
+{
+    otg_ep_regs_t *r = &d->otg->OEP[ep];
+    uint32_t flags = REG_READ(r->INT) & USB_DOEPMSK;
+
+    REG_WRITE(r->INT, flags);
+    if (ep == 0u) {
+        if ((flags & OTG_EPINT_XFRC) != 0u) {
+            usb_ep0_out_done(d);
+        }
+        if ((flags & OTG_EPINT_STUP) != 0u) {
+            usb_ep0_setup(d);
+        }
+    } else if ((flags & OTG_EPINT_XFRC) != 0u && d->cfg->cls->rx_done != NULL) {
+        d->cfg->cls->rx_done(d, ep);
+    }
+}
+
+static void usb_in_irq(usb_dev_t *d, uint8_t ep)
+{
+    otg_ep_regs_t *r = &d->otg->IEP[ep];
+    const usb_class_t *cls = d->cfg->cls;
+    uint32_t flags = REG_READ(r->INT);
+
+    if ((flags & OTG_EPINT_XFRC) != 0u) {
+        REG_WRITE(r->INT, OTG_EPINT_XFRC);
+        if (ep == 0u) {
+            usb_ep0_in_done(d);
+        } else if (cls->tx_done != NULL) {
+            cls->tx_done(d, ep);
+        }
+    }
+    if ((flags & OTG_EPINT_TXFE) != 0u && (d->empmsk & REG_BIT(ep)) != 0u) {
+        if (d->in_left[ep] != 0u && cls->tx_space != NULL) {
+            cls->tx_space(d, ep);
+        } else {
+            d->empmsk &= ~REG_BIT(ep);
+            REG_WRITE(d->otg->DIEPEMPMSK, d->empmsk);
+        }
+    }
+}
+
+void usb_irq(usb_dev_t *d)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t gint = REG_READ(otg->GINTSTS) & USB_GINTMSK;
+    uint32_t daint;
+    uint8_t ep;
+
+    if ((gint & OTG_GINT_USBRST) != 0u) {
+        REG_WRITE(otg->GINTSTS, OTG_GINT_USBRST);
+        usb_bus_reset(d);
+    }
+    if ((gint & OTG_GINT_ENUMDNE) != 0u) {
+        REG_WRITE(otg->GINTSTS, OTG_GINT_ENUMDNE);
+        usb_enum_done(d);
+    }
+    if ((gint & OTG_GINT_RXFLVL) != 0u) {
+        usb_rx_drain(d);
+        /* Popping the status entries raises the endpoint interrupts. */
+        gint |= REG_READ(otg->GINTSTS) & (OTG_GINT_OEPINT | OTG_GINT_IEPINT);
+    }
+    if ((gint & (OTG_GINT_OEPINT | OTG_GINT_IEPINT)) != 0u) {
+        daint = REG_READ(otg->DAINT) & REG_READ(otg->DAINTMSK);
+        for (ep = 0; ep < USB_EP_COUNT; ep++) {
+            if ((daint & OTG_DAINT_OEP(ep)) != 0u) {
+                usb_out_irq(d, ep);
+            }
+        }
+        for (ep = 0; ep < USB_EP_COUNT; ep++) {
+            if ((daint & OTG_DAINT_IEP(ep)) != 0u) {
+                usb_in_irq(d, ep);
+            }
+        }
+    }
+    if ((gint & OTG_GINT_USBSUSP) != 0u) {
+        REG_WRITE(otg->GINTSTS, OTG_GINT_USBSUSP);
+        d->suspended = true;
+    }
+    if ((gint & OTG_GINT_WKUPINT) != 0u) {
+        REG_WRITE(otg->GINTSTS, OTG_GINT_WKUPINT);
+        d->suspended = false;
+    }
+}
+
+void OTG_FS_IRQHandler(void);
+void OTG_FS_IRQHandler(void)
+{
+    if (usb_handle != NULL) {
+        usb_irq(usb_handle);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* Setup                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t usb_trdt(uint32_t hclk_hz)
+{
+    size_t i;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(usb_trdt_table); i++) {
+        if (hclk_hz >= usb_trdt_table[i].hclk_hz) {
+            return usb_trdt_table[i].trdt;
+        }
+    }
+    return 0;
+}
+
+/* Lay the FIFOs out back to back: RX, then the IN FIFOs by endpoint. */
+static drv_status_t usb_fifo_setup(otg_regs_t *otg, const usb_config_t *cfg)
+{
+    uint32_t addr = (cfg->rx_fifo_words != 0u) ? cfg->rx_fifo_words : USB_RX_FIFO_WORDS;
+    uint32_t ep;
+
+    REG_WRITE(otg->GRXFSIZ, addr);
+    for (ep = 0; ep < USB_EP_COUNT; ep++) {
+        uint32_t words = cfg->tx_fifo_words[ep];
+        uint32_t val;
+
+        if (ep == 0u && words < USB_EP0_FIFO_WORDS) {
+            words = USB_EP0_FIFO_WORDS;
+        }
+        val = reg_field_prep(OTG_TXF_START, addr) | reg_field_prep(OTG_TXF_DEPTH, words);
+        if (ep == 0u) {
+            REG_WRITE(otg->DIEPTXF0, val);
+        } else {
+            REG_WRITE(otg->DIEPTXF[ep - 1u], val);
+        }
+        addr += words;
+    }
+    return (addr <= OTG_FS_FIFO_WORDS) ? DRV_OK : DRV_ERR_NORES;
+}
+
+drv_status_t usb_init(usb_dev_t *d, const usb_config_t *cfg)
+{
+    otg_regs_t *otg = OTG_FS;
+    const rcc_plan_t *clk = rcc_current();
+    uint32_t trdt = usb_trdt(clk->hclk_hz);
+    uint32_t words;
+    uint32_t ep;
+    drv_status_t rc;
+
+    if (d == NULL || cfg == NULL || cfg->cls == NULL || cfg->device_desc == NULL ||
+        cfg->config_desc == NULL || (cfg->nstrings != 0u && cfg->strings == NULL) ||
+        clk->pll48_hz != RCC_PLL48_HZ || trdt == 0u) {
+        return DRV_ERR_PARAM;
+    }
+    words = (cfg->rx_fifo_words != 0u) ? cfg->rx_fifo_words : USB_RX_FIFO_WORDS;
+    for (ep = 0; ep < USB_EP_COUNT; ep++) {
+        words += (ep == 0u && cfg->tx_fifo_words[0] < USB_EP0_FIFO_WORDS) ? USB_EP0_FIFO_WORDS
+                                                                          : cfg->tx_fifo_words[ep];
+    }
+    if (words > OTG_FS_FIFO_WORDS) {
+        return DRV_ERR_NORES;
+    }
+
+    memset(d, 0, sizeof(*d));
+    d->otg = otg;
+    d->cfg = cfg;
+    d->ctx = cfg->ctx;
+
+    REG_SET_BITS(RCC->AHB2ENR, RCC_AHB2ENR_OTGFSEN);
+    for (ep = 0; (REG_READ(otg->GRSTCTL) & OTG_GRSTCTL_AHBIDL) == 0u; ep++) {
+        if (ep == USB_RESET_TIMEOUT) {
+            return DRV_ERR_TIMEOUT;
+        }
+    }
+    REG_WRITE(otg->GRSTCTL, OTG_GRSTCTL_CSRST);
+    rc = usb_grstctl_wait(otg, OTG_GRSTCTL_CSRST);
+    if (rc != DRV_OK) {
+        return rc;
+    }
+
+    REG_WRITE(otg->GUSBCFG, OTG_GUSBCFG_PHYSEL | OTG_GUSBCFG_FDMOD |
+                            reg_field_prep(OTG_GUSBCFG_TRDT, trdt));
+#if defined(STM32F7)
+    /* No VBUS sensing: report a valid B session instead. */
+    REG_WRITE(otg->GOTGCTL, OTG_GOTGCTL_BVALOEN | OTG_GOTGCTL_BVALOVAL);
+    REG_WRITE(otg->GCCFG, OTG_GCCFG_PWRDWN);
+#else
+    REG_WRITE(otg->GCCFG, OTG_GCCFG_PWRDWN | OTG_GCCFG_NOVBUSSENS);
+#endif
+    REG_WRITE(otg->PCGCCTL, 0u);
+    REG_WRITE(otg->DCFG, reg_field_prep(OTG_DCFG_DSPD, OTG_DCFG_DSPD_FS));
+    (void)usb_fifo_setup(otg, cfg);
+    usb_tx_flush(otg, OTG_GRSTCTL_TXFNUM_ALL);
+    REG_WRITE(otg->GRSTCTL, OTG_GRSTCTL_RXFFLSH);
+    (void)usb_grstctl_wait(otg, OTG_GRSTCTL_RXFFLSH);
+
+    REG_WRITE(otg->DIEPMSK, USB_DIEPMSK);
+    REG_WRITE(otg->DOEPMSK, USB_DOEPMSK);
+    REG_WRITE(otg->DIEPEMPMSK, 0u);
+    REG_WRITE(otg->DAINTMSK, OTG_DAINT_IEP(0) | OTG_DAINT_OEP(0));
+    REG_WRITE(otg->GINTSTS, 0xFFFFFFFFu);
+    REG_WRITE(otg->GINTMSK, USB_GINTMSK);
+    REG_WRITE(otg->GAHBCFG, OTG_GAHBCFG_GINT);
+
+    usb_handle = d;
+    REG_CLR_BITS(otg->DCTL, OTG_DCTL_SDIS);
+    return DRV_OK;
+}
+
+void usb_deinit(usb_dev_t *d)
+{
+    otg_regs_t *otg = d->otg;
+    uint32_t primask;
+
+    REG_SET_BITS(otg->DCTL, OTG_DCTL_SDIS);
+    REG_WRITE(otg->GAHBCFG, 0u);
+    REG_WRITE(otg->GINTMSK, 0u);
+    primask = stm32_irq_save();
+    if (d->config != 0u) {
+        usb_ep_close_all(d);
+        d->config = 0;
+        if (d->cfg->cls->configure != NULL) {
+            (void)d->cfg->cls->configure(d, 0u);
+        }
+    }
+    d->state = USB_STATE_DETACHED;
+    if (usb_handle == d) {
+        usb_handle = NULL;
+    }
+    stm32_irq_restore(primask);
+    REG_CLR_BITS(otg->GCCFG, OTG_GCCFG_PWRDWN);
+}
@@ -0,0 +1,308 @@
+/**
+ * @file    usb_cdc.c
+ * @brief   USB CDC-ACM class: descriptors, class requests and ring-buffer
+ *          bulk transfers.
+ */
+#include <string.h>
+
+#include "usb_cdc.h"
+
+#define USB_CDC_EP_OUT          (USB_CDC_EP_DATA_OUT & 0x0Fu)
+#define USB_CDC_EP_IN           (USB_CDC_EP_DATA_IN & 0x0Fu)
+/** Longest transfer one DOEPTSIZ/DIEPTSIZ programming covers (PKTCNT). */
+#define USB_CDC_MAX_PACKETS     1023u
+
+#define USB_CDC_CONFIG_LEN      67u
+
+static const uint8_t usb_cdc_config_desc[USB_CDC_CONFIG_LEN] = {
+    /* Configuration 1: two interfaces, bus powered, 100 mA. */
+    9u, USB_DESC_CONFIG, USB_CDC_CONFIG_LEN, 0u, 2u, 1u, 0u, 0x80u, 50u,
+    /* Interface 0: communications, ACM, AT commands; notification endpoint. */
+    9u, USB_DESC_INTERFACE, 0u, 0u, 1u, 0x02u, 0x02u, 0x01u, 0u,
+    5u, 0x24u, 0x00u, 0x10u, 0x01u,         /* Header, CDC 1.10 */
+    5u, 0x24u, 0x01u, 0x00u, 0x01u,         /* Call management: data interface 1 */
+    4u, 0x24u, 0x02u, 0x02u,                /* ACM: line coding and state */
+    5u, 0x24u, 0x06u, 0x00u, 0x01u,         /* Union: master 0, slave 1 */
+    7u, USB_DESC_ENDPOINT, USB_CDC_EP_NOTIFY, USB_EP_INTERRUPT, USB_CDC_NOTIFY_MPS, 0u, 16u,
+    /* Interface 1: data, two bulk endpoints. */
+    9u, USB_DESC_INTERFACE, 1u, 0u, 2u, 0x0Au, 0u, 0u, 0u,
+    7u, USB_DESC_ENDPOINT, USB_CDC_EP_DATA_OUT, USB_EP_BULK, USB_CDC_DATA_MPS, 0u, 0u,
+    7u, USB_DESC_ENDPOINT, USB_CDC_EP_DATA_IN, USB_EP_BULK, USB_CDC_DATA_MPS, 0u, 0u,
+};
+
+static usb_cdc_t *usb_cdc_of(usb_dev_t *d)
+{
+    return d->ctx;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Data endpoints                                                           */
+/* ------------------------------------------------------------------------ */
+
+/* Arm the OUT endpoint for as many whole packets as the receive ring takes. */
+static void usb_cdc_rx_arm(usb_cdc_t *c)
+{
+    uint32_t packets;
+
+    if (c->rx_armed || c->usb.state != USB_STATE_CONFIGURED) {
+        return;
+    }
+    packets = ringbuf_free(c->rx) / USB_CDC_DATA_MPS;
+    if (packets == 0u) {
+        return;     /* The endpoint NAKs until the application reads. */
+    }
+    if (packets > USB_CDC_MAX_PACKETS) {
+        packets = USB_CDC_MAX_PACKETS;
+    }
+    c->rx_armed = true;
+    usb_ep_out_arm(&c->usb, USB_CDC_EP_OUT, packets);
+}
+
+/* Start an IN transfer of everything queued, prefilling the FIFO. */
+static void usb_cdc_tx_start(usb_cdc_t *c)
+{
+    uint32_t len;
+
+    if (c->tx_busy || c->usb.state != USB_STATE_CONFIGURED) {
+        return;
+    }
+    len = ringbuf_count(c->tx);
+    if (len == 0u) {
+        return;
+    }
+    if (len > USB_CDC_MAX_PACKETS * USB_CDC_DATA_MPS) {
+        len = USB_CDC_MAX_PACKETS * USB_CDC_DATA_MPS;
+    }
+    c->tx_busy = true;
+    c->tx_len = len;
+    usb_ep_in_start(&c->usb, USB_CDC_EP_IN, len);
+    (void)usb_ep_write_ring(&c->usb, USB_CDC_EP_IN, c->tx);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Class hooks                                                              */
+/* ------------------------------------------------------------------------ */
+
+static drv_status_t usb_cdc_configure(usb_dev_t *d, uint8_t config)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+    drv_status_t rc;
+
+    c->rx_armed = false;
+    c->tx_busy = false;
+    if (config == 0u) {
+        c->lines = 0;
+        return DRV_OK;
+    }
+    rc = usb_ep_open(d, USB_CDC_EP_NOTIFY, USB_EP_INTERRUPT, USB_CDC_NOTIFY_MPS);
+    if (rc == DRV_OK) {
+        rc = usb_ep_open(d, USB_CDC_EP_DATA_OUT, USB_EP_BULK, USB_CDC_DATA_MPS);
+    }
+    if (rc == DRV_OK) {
+        rc = usb_ep_open(d, USB_CDC_EP_DATA_IN, USB_EP_BULK, USB_CDC_DATA_MPS);
+    }
+    if (rc != DRV_OK) {
+        return rc;
+    }
+    /* The core sets CONFIGURED before calling here. */
+    usb_cdc_rx_arm(c);
+    usb_cdc_tx_start(c);
+    return DRV_OK;
+}
+
+static drv_status_t usb_cdc_setup(usb_dev_t *d, const usb_setup_t *req, const uint8_t **data,
+                                  uint16_t *len)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+    uint8_t *buf = d->ep0_buf;
+
+    if ((req->bmRequestType & (USB_REQ_TYPE_MASK | USB_REQ_RECIP_MASK)) !=
+            (USB_REQ_TYPE_CLASS | USB_REQ_RECIP_INTERFACE) ||
+        req->wIndex != 0u) {
+        return DRV_ERR_PARAM;
+    }
+    switch (req->bRequest) {
+    case USB_CDC_SET_LINE_CODING:
+        return (req->wLength == 7u) ? DRV_OK : DRV_ERR_PARAM;
+    case USB_CDC_GET_LINE_CODING:
+        buf[0] = (uint8_t)c->coding.baud;
+        buf[1] = (uint8_t)(c->coding.baud >> 8);
+        buf[2] = (uint8_t)(c->coding.baud >> 16);
+        buf[3] = (uint8_t)(c->coding.baud >> 24);
+        buf[4] = c->coding.stop_bits;
+        buf[5] = c->coding.parity;
+        buf[6] = c->coding.data_bits;
+        *data = buf;
+        *len = 7;
+        return DRV_OK;
+    case USB_CDC_SET_CONTROL_LINE_STATE:
+        c->lines = (uint8_t)(req->wValue & (USB_CDC_LINE_DTR | USB_CDC_LINE_RTS));
+        return DRV_OK;
+    case USB_CDC_SEND_BREAK:
+        return DRV_OK;
+    default:
+        return DRV_ERR_PARAM;
+    }
+}
+
+static void usb_cdc_ctrl_out(usb_dev_t *d, const usb_setup_t *req, const uint8_t *data,
+                             uint16_t len)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+
+    if (req->bRequest == USB_CDC_SET_LINE_CODING && len >= 7u) {
+        c->coding.baud = (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                         ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        c->coding.stop_bits = data[4];
+        c->coding.parity = data[5];
+        c->coding.data_bits = data[6];
+    }
+}
+
+static void usb_cdc_rx(usb_dev_t *d, uint8_t ep, uint32_t len)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+
+    if (ep == USB_CDC_EP_OUT) {
+        c->rx_bytes += usb_ep_read_ring(d, c->rx, len);
+    }
+}
+
+static void usb_cdc_rx_done(usb_dev_t *d, uint8_t ep)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+
+    if (ep == USB_CDC_EP_OUT) {
+        c->rx_armed = false;
+        usb_cdc_rx_arm(c);
+    }
+}
+
+static void usb_cdc_tx_space(usb_dev_t *d, uint8_t ep)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+
+    if (ep == USB_CDC_EP_IN) {
+        (void)usb_ep_write_ring(d, ep, c->tx);
+    }
+}
+
+static void usb_cdc_tx_done(usb_dev_t *d, uint8_t ep)
+{
+    usb_cdc_t *c = usb_cdc_of(d);
+    uint32_t len = c->tx_len;
+
+    if (ep != USB_CDC_EP_IN) {
+        return;
+    }
+    c->tx_bytes += len;
+    c->tx_busy = false;
+    if (len != 0u && (len % USB_CDC_DATA_MPS) == 0u && ringbuf_count(c->tx) == 0u) {
+        /* Nothing follows: end the host's read with a short packet. */
+        c->tx_busy = true;
+        c->tx_len = 0;
+        usb_ep_in_start(d, ep, 0u);
+        return;
+    }
+    usb_cdc_tx_start(c);
+}
+
+static const usb_class_t usb_cdc_class = {
+    .configure = usb_cdc_configure,
+    .setup = usb_cdc_setup,
+    .ctrl_out = usb_cdc_ctrl_out,
+    .rx = usb_cdc_rx,
+    .rx_done = usb_cdc_rx_done,
+    .tx_space = usb_cdc_tx_space,
+    .tx_done = usb_cdc_tx_done,
+};
+
+/* ------------------------------------------------------------------------ */
+/* API                                                                      */
+/* ------------------------------------------------------------------------ */
+
+drv_status_t usb_cdc_init(usb_cdc_t *c, const usb_cdc_config_t *cfg)
+{
+    uint8_t *dd;
+
+    if (c == NULL || cfg == NULL || cfg->rx == NULL || cfg->tx == NULL ||
+        ringbuf_capacity(cfg->rx) < USB_CDC_DATA_MPS) {
+        return DRV_ERR_PARAM;
+    }
+    memset(c, 0, sizeof(*c));
+    c->rx = cfg->rx;
+    c->tx = cfg->tx;
+    c->coding.baud = 115200u;
+    c->coding.data_bits = 8u;
+
+    c->strings[0] = cfg->manufacturer;
+    c->strings[1] = cfg->product;
+    c->strings[2] = cfg->serial;
+    dd = c->device_desc;
+    dd[0] = sizeof(c->device_desc);
+    dd[1] = USB_DESC_DEVICE;
+    dd[2] = 0x00u;                  /* bcdUSB 2.00 */
+    dd[3] = 0x02u;
+    dd[4] = 0x02u;                  /* Communications device class */
+    dd[5] = 0u;
+    dd[6] = 0u;
+    dd[7] = USB_EP0_MPS;
+    dd[8] = (uint8_t)cfg->vid;
+    dd[9] = (uint8_t)(cfg->vid >> 8);
+    dd[10] = (uint8_t)cfg->pid;
+    dd[11] = (uint8_t)(cfg->pid >> 8);
+    dd[12] = (uint8_t)cfg->bcd_device;
+    dd[13] = (uint8_t)(cfg->bcd_device >> 8);
+    dd[14] = (cfg->manufacturer != NULL) ? 1u : 0u;
+    dd[15] = (cfg->product != NULL) ? 2u : 0u;
+    dd[16] = (cfg->serial != NULL) ? 3u : 0u;
+    dd[17] = 1u;
+
+    c->usb_cfg.cls = &usb_cdc_class;
+    c->usb_cfg.ctx = c;
+    c->usb_cfg.device_desc = c->device_desc;
+    c->usb_cfg.config_desc = usb_cdc_config_desc;
+    c->usb_cfg.strings = c->strings;
+    c->usb_cfg.nstrings = 3u;
+    c->usb_cfg.tx_fifo_words[0] = USB_EP0_FIFO_WORDS;
+    c->usb_cfg.tx_fifo_words[USB_CDC_EP_IN] = USB_CDC_TX_FIFO_WORDS;
+    c->usb_cfg.tx_fifo_words[USB_CDC_EP_NOTIFY & 0x0Fu] = USB_EP0_FIFO_WORDS;
+    return usb_init(&c->usb, &c->usb_cfg);
+}
+
+void usb_cdc_deinit(usb_cdc_t *c)
+{
+    usb_deinit(&c->usb);
+}
+
+uint32_t usb_cdc_write(usb_cdc_t *c, const void *data, uint32_t len)
+{
+    uint32_t n = ringbuf_write(c->tx, data, len);
+
+    usb_cdc_tx_kick(c);
+    return n;
+}
+
+uint32_t usb_cdc_read(usb_cdc_t *c, void *data, uint32_t len)
+{
+    uint32_t n = ringbuf_read(c->rx, data, len);
+
+    usb_cdc_rx_kick(c);
+    return n;
+}
+
+void usb_cdc_tx_kick(usb_cdc_t *c)
+{
+    uint32_t primask = stm32_irq_save();
+
+    usb_cdc_tx_start(c);
+    stm32_irq_restore(primask);
+}
+
+void usb_cdc_rx_kick(usb_cdc_t *c)
+{
+    uint32_t primask = stm32_irq_save();
+
+    usb_cdc_rx_arm(c);
+    stm32_irq_restore(primask);
+}
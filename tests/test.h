@@ -0,0 +1,60 @@
+/**
+ * @file    test.h
+ * @brief   Minimal unit test helpers for the host build.
+ *
+ * Each test binary defines its cases as `static void test_xxx(void)` and
+ * runs them from main() with TEST_RUN(); main() returns TEST_RESULT().
+ */
+#ifndef STM32_TEST_H
+#define STM32_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static int test_failures;
+static const char *test_current;
+
+#define TEST_FAIL(...)                                                      \
+    do {                                                                    \
+        fprintf(stderr, "%s:%d: %s: ", __FILE__, __LINE__, test_current);  \
+        fprintf(stderr, __VA_ARGS__);                                       \
+        fputc('\n', stderr);                                                \
+        test_failures++;                                                    \
+    } while (0)
+
+#define TEST_ASSERT(cond)                                                   \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            TEST_FAIL("assertion failed: %s", #cond);                      \
+        }                                                                   \
+    } while (0)
+
+#define TEST_ASSERT_EQ(a, b)                                                \
+    do {                                                                    \
+        unsigned long long test_a_ = (unsigned long long)(a);               \
+        unsigned long long test_b_ = (unsigned long long)(b);               \
+        if (test_a_ != test_b_) {                                           \
+            TEST_FAIL("%s == %s failed: 0x%llx != 0x%llx",                 \
+                      #a, #b, test_a_, test_b_);                            \
+        }                                                                   \
+    } while (0)
+
+#define TEST_ASSERT_MEM_EQ(a, b, n)                                         \
+    do {                                                                    \
+        if (memcmp((a), (b), (n)) != 0) {                                   \
+            TEST_FAIL("memory %s != %s (%zu bytes)", #a, #b, (size_t)(n)); \
+        }                                                                   \
+    } while (0)
+
+#define TEST_RUN(fn)                                                        \
+    do {                                                                    \
+        int test_before_ = test_failures;                                   \
+        test_current = #fn;                                                 \
+        fn();                                                               \
+        printf("%s %s\n", test_failures == test_before_ ? "PASS" : "FAIL", #fn); \
+    } while (0)
+
+#define TEST_RESULT()   (test_failures == 0 ? 0 : 1)
+
+#endif /* STM32_TEST_H */
@@ -0,0 +1,276 @@
+/**
+ * @file    test_adc.c
+ * @brief   ADC driver tests: triggered scan, DMA halves, decimation, overrun.
+ */
+#include "adc.h"
+#include "sim.h"
+#include "test.h"
+
+#define NCH         8u
+#define HALF        16u
+#define DECIM       4u
+#define TRIPS       8u      /* Buffer wraps in test_stream. */
+
+static const uint8_t chans[NCH] = { 0, 1, 2, 3, 10, 11, 12, 13 };
+static uint16_t buf[2u * HALF * NCH];
+
+static uint16_t out[TRIPS * 2u * HALF / DECIM][NCH];
+static uint32_t out_len;
+
+/* Channel level plus a ramp over time: averages are easy to predict. */
+static uint16_t waveform(void *ctx, uint32_t channel, uint32_t seq)
+{
+    (void)ctx;
+    return (uint16_t)(channel * 256u + (seq & 0xFFu));
+}
+
+static void collect(void *ctx, const uint16_t *frames, uint32_t nframes)
+{
+    uint32_t i;
+
+    (void)ctx;
+    for (i = 0; i < nframes && out_len < STM32_ARRAY_SIZE(out); i++) {
+        memcpy(out[out_len++], frames + i * NCH, sizeof(out[0]));
+    }
+}
+
+static void service(const adc_t *h)
+{
+    while (sim_irq_take(h->dma->irqn)) {
+        dma_irq(h->dma->dma, h->dma->stream);
+    }
+}
+
+static void setup(adc_t *h)
+{
+    const adc_config_t cfg = {
+        .channels = chans, .nchannels = NCH, .smp = ADC_SMP_15,
+        .trigger = ADC_TRIG_TIM2, .rate_hz = 10000u,
+        .buf = buf, .half_frames = HALF, .decim = DECIM,
+        .cb = collect,
+    };
+
+    sim_reset();
+    out_len = 0;
+    memset(buf, 0, sizeof(buf));
+    sim_adc_attach(ADC1, waveform, NULL);
+    TEST_ASSERT_EQ(adc_init(h, ADC1, &cfg), DRV_OK);
+}
+
+/* Frame k of the decimated output covers sequences DECIM*k .. DECIM*k+3. */
+static bool check_frame(const uint16_t *f, uint32_t k)
+{
+    uint32_t c;
+
+    for (c = 0; c < NCH; c++) {
+        uint32_t sum = 0;
+        uint32_t s;
+
+        for (s = 0; s < DECIM; s++) {
+            sum += waveform(NULL, chans[c], DECIM * k + s);
+        }
+        if (f[c] != (sum + DECIM / 2u) / DECIM) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_config(void)
+{
+    adc_t h;
+    uint32_t k;
+
+    setup(&h);
+    /* HSI: PCLK2 = 16 MHz, ADCCLK = 8 MHz, TIM2 at 16 MHz. */
+    TEST_ASSERT_EQ(REG_FIELD_READ(ADC_COMMON->CCR, ADC_CCR_ADCPRE), 0u);
+    TEST_ASSERT_EQ(REG_READ(TIM2->PSC), 0u);
+    TEST_ASSERT_EQ(REG_READ(TIM2->ARR), 1599u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(TIM2->CR2, TIM_CR2_MMS), TIM_MMS_UPDATE);
+    TEST_ASSERT_EQ(h.rate_hz, 10000u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(ADC1->SQR1, ADC_SQR1_L), NCH - 1u);
+    for (k = 0; k < NCH; k++) {
+        const volatile uint32_t *sqr = (k < 6u) ? &ADC1->SQR3 : &ADC1->SQR2;
+
+        TEST_ASSERT_EQ(reg_field_get(REG_READ(*sqr), ADC_SQR_SQ(k)), chans[k]);
+    }
+    TEST_ASSERT_EQ(REG_FIELD_READ(ADC1->SMPR1, ADC_SMPR_SMP(13)), ADC_SMP_15);
+    TEST_ASSERT_EQ(REG_FIELD_READ(ADC1->CR2, ADC_CR2_EXTSEL), ADC_EXTSEL_TIM2_TRGO);
+    /* Not triggered until started. */
+    TEST_ASSERT_EQ(REG_FIELD_READ(ADC1->CR2, ADC_CR2_EXTEN), ADC_EXTEN_OFF);
+    adc_deinit(&h);
+}
+
+static void test_limits(void)
+{
+    const adc_config_t slow = {
+        .channels = chans, .nchannels = NCH, .smp = ADC_SMP_480,
+        .trigger = ADC_TRIG_TIM3, .rate_hz = 10000u,
+        .buf = buf, .half_frames = HALF, .decim = DECIM,
+    };
+    const adc_config_t odd = {
+        .channels = chans, .nchannels = NCH, .trigger = ADC_TRIG_TIM3,
+        .rate_hz = 1000u, .buf = buf, .half_frames = HALF, .decim = 3,
+    };
+    adc_t h;
+
+    sim_reset();
+    /* 8 x (480 + 12) cycles at 8 MHz take ~490 us: no room at 10 kHz. */
+    TEST_ASSERT_EQ(adc_init(&h, ADC1, &slow), DRV_ERR_PARAM);
+    /* Half-buffer not a whole number of decimated frames. */
+    TEST_ASSERT_EQ(adc_init(&h, ADC1, &odd), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(adc_init(&h, (adc_regs_t *)buf, &odd), DRV_ERR_PARAM);
+}
+
+static void test_stream(void)
+{
+    adc_t h;
+    uint32_t k;
+    uint32_t t;
+
+    setup(&h);
+    TEST_ASSERT_EQ(adc_start(&h), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(TIM2->CR1, TIM_CR1_CEN));
+
+    /* Several trips around the buffer, servicing the stream like its ISR. */
+    for (t = 0; t < TRIPS * 2u * HALF; t++) {
+        sim_tim_update(TIM2, 1);
+        service(&h);
+    }
+    TEST_ASSERT_EQ(sim_adc_sequences(ADC1), TRIPS * 2u * HALF);
+    /* Output rate: one frame per DECIM sequences. */
+    TEST_ASSERT_EQ(out_len, TRIPS * 2u * HALF / DECIM);
+    for (k = 0; k < out_len; k++) {
+        TEST_ASSERT(check_frame(out[k], k));
+    }
+    TEST_ASSERT_EQ(h.overruns, 0u);
+
+    adc_stop(&h);
+    sim_tim_update(TIM2, 4);
+    TEST_ASSERT_EQ(sim_adc_sequences(ADC1), TRIPS * 2u * HALF);
+    adc_deinit(&h);
+}
+
+static void test_overrun(void)
+{
+    adc_t h;
+    uint32_t t;
+
+    setup(&h);
+    TEST_ASSERT_EQ(adc_start(&h), DRV_OK);
+    /* Stream stalls: the second result overwrites the first. */
+    dma_abort(h.dma);
+    sim_tim_update(TIM2, 1);
+    TEST_ASSERT(REG_TEST_BITS(ADC1->SR, ADC_SR_OVR));
+    TEST_ASSERT(sim_irq_take(ADC_IRQn));
+    adc_irq(&h);
+    TEST_ASSERT_EQ(h.overruns, 1u);
+    TEST_ASSERT(!REG_TEST_BITS(ADC1->SR, ADC_SR_OVR));
+
+    /* Back in step: the next half starts at the buffer start again. */
+    for (t = 0; t < HALF; t++) {
+        sim_tim_update(TIM2, 1);
+        service(&h);
+    }
+    TEST_ASSERT_EQ(out_len, HALF / DECIM);
+    for (t = 0; t < out_len; t++) {
+        /* Sequence numbers are offset by the one lost sequence. */
+        uint32_t c;
+
+        for (c = 0; c < NCH; c++) {
+            uint32_t base = 1u + DECIM * t;
+
+            TEST_ASSERT_EQ(out[t][c], chans[c] * 256u + base + 2u);
+        }
+    }
+    TEST_ASSERT(!sim_irq_take(ADC_IRQn));
+    adc_deinit(&h);
+}
+
+static void test_software(void)
+{
+    const uint8_t ch[3] = { 5, 6, 18 };
+    const adc_config_t cfg = {
+        .channels = ch, .nchannels = 3, .res = ADC_RES_8,
+        .trigger = ADC_TRIG_SOFTWARE, .buf = buf, .half_frames = 1,
+    };
+    adc_t h;
+
+    sim_reset();
+    sim_adc_attach(ADC2, waveform, NULL);
+    TEST_ASSERT_EQ(adc_init(&h, ADC2, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(adc_start(&h), DRV_OK);
+    TEST_ASSERT_EQ(sim_adc_sequences(ADC2), 1u);
+    /* 8-bit results: the 12-bit level shifted down by 4. */
+    TEST_ASSERT_EQ(buf[0], (5u * 256u) >> 4);
+    TEST_ASSERT_EQ(buf[1], (6u * 256u) >> 4);
+    TEST_ASSERT_EQ(buf[2], (uint16_t)((18u * 256u) & 0xFFFu) >> 4);
+    adc_deinit(&h);
+}
+
+/* Straightforward reference for the optimised kernels. */
+static void decimate_ref(uint16_t *dst, const uint16_t *src, uint32_t nch,
+                         uint32_t frames, uint32_t factor)
+{
+    uint32_t o;
+    uint32_t c;
+    uint32_t f;
+
+    for (o = 0; o < frames / factor; o++) {
+        for (c = 0; c < nch; c++) {
+            uint32_t sum = 0;
+
+            for (f = 0; f < factor; f++) {
+                sum += src[(o * factor + f) * nch + c];
+            }
+            dst[o * nch + c] = (uint16_t)((sum + factor / 2u) / factor);
+        }
+    }
+}
+
+static void test_decimate(void)
+{
+    static const uint32_t shapes[][3] = {
+        /* nch, frames, factor */
+        { 8, 64, 8 },       /* paired lanes, shift */
+        { 8, 60, 3 },       /* paired lanes, divide */
+        { 2, 64, 16 },      /* paired lanes at the lane limit */
+        { 7, 64, 4 },       /* odd channel count: scalar */
+        { 2, 64, 32 },      /* too many for a lane: scalar */
+        { 16, 32, 2 },
+    };
+    static uint16_t data[1024] STM32_ALIGNED(4);
+    static uint16_t ref[1024];
+    uint32_t i;
+    uint32_t n;
+
+    for (i = 0; i < STM32_ARRAY_SIZE(shapes); i++) {
+        uint32_t nch = shapes[i][0];
+        uint32_t frames = shapes[i][1];
+        uint32_t factor = shapes[i][2];
+        uint32_t seed = 12345u + i;
+
+        for (n = 0; n < nch * frames; n++) {
+            seed = seed * 1103515245u + 12345u;
+            data[n] = (uint16_t)((seed >> 16) & 0x0FFFu);
+        }
+        /* Worst case for carries between lanes. */
+        data[0] = 0x0FFFu;
+        data[nch] = 0x0FFFu;
+        decimate_ref(ref, data, nch, frames, factor);
+        TEST_ASSERT_EQ(adc_decimate(data, nch, frames, factor), frames / factor);
+        TEST_ASSERT_MEM_EQ(data, ref, (frames / factor) * nch * sizeof(data[0]));
+    }
+    TEST_ASSERT_EQ(adc_decimate(data, 8, 64, 1), 64u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_config);
+    TEST_RUN(test_limits);
+    TEST_RUN(test_stream);
+    TEST_RUN(test_overrun);
+    TEST_RUN(test_software);
+    TEST_RUN(test_decimate);
+    return TEST_RESULT();
+}
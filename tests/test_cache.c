@@ -0,0 +1,126 @@
+/**
+ * @file    test_cache.c
+ * @brief   Flash accelerator / L1 cache enable and cache maintenance tests.
+ */
+#include "cache.h"
+#include "dma.h"
+#include "sim.h"
+#include "test.h"
+
+static sim_cache_op_t ops[256];
+
+static uint8_t buf[128] CACHE_ALIGNED;
+
+static void test_init(void)
+{
+    uint32_t acr;
+
+    sim_reset();
+    REG_FIELD_WRITE(FLASH->ACR, FLASH_ACR_LATENCY, 5u);
+    cache_init();
+    acr = REG_READ(FLASH->ACR);
+    TEST_ASSERT_EQ(reg_field_get(acr, FLASH_ACR_LATENCY), 5u);
+    TEST_ASSERT((acr & FLASH_ACR_PRFTEN) != 0u);
+#if defined(STM32F7)
+    TEST_ASSERT((acr & FLASH_ACR_ARTEN) != 0u);
+    TEST_ASSERT((acr & FLASH_ACR_ARTRST) == 0u);
+    TEST_ASSERT(REG_TEST_BITS(SCB->CCR, SCB_CCR_IC));
+    TEST_ASSERT(REG_TEST_BITS(SCB->CCR, SCB_CCR_DC));
+    /* I-cache invalidated, then every set/way of the D-cache. */
+    TEST_ASSERT_EQ(sim_cache_take(ops, STM32_ARRAY_SIZE(ops)), 1u + 32u * 4u);
+    TEST_ASSERT_EQ(ops[0].reg, 0x250u);
+    TEST_ASSERT_EQ(ops[1].reg, 0x260u);
+    TEST_ASSERT_EQ(ops[128].arg, SCB_DCSW(31, 3));
+
+    /* Already enabled: no second invalidate that would drop dirty lines. */
+    cache_init();
+    TEST_ASSERT_EQ(sim_cache_take(ops, STM32_ARRAY_SIZE(ops)), 0u);
+#else
+    TEST_ASSERT_EQ(acr & (FLASH_ACR_ICEN | FLASH_ACR_DCEN), FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+    TEST_ASSERT_EQ(acr & (FLASH_ACR_ICRST | FLASH_ACR_DCRST), 0u);
+    TEST_ASSERT_EQ(sim_cache_take(ops, STM32_ARRAY_SIZE(ops)), 0u);
+#endif
+}
+
+static void test_ranges(void)
+{
+    uint32_t a = REG_ADDR(buf);
+
+    sim_reset();
+    cache_clean(buf + 4, 40);
+    cache_invalidate(buf + 4, 64);
+    cache_invalidate(buf, 64);
+    cache_invalidate(buf + 33, 2);
+    cache_clean_invalidate(buf, 1);
+    cache_clean(buf, 0);
+#if STM32_HAS_DCACHE
+    TEST_ASSERT_EQ(sim_cache_take(ops, STM32_ARRAY_SIZE(ops)), 9u);
+    /* Clean: both lines touched by [4, 44). */
+    TEST_ASSERT_EQ(ops[0].reg, 0x268u);
+    TEST_ASSERT_EQ(ops[0].arg, a);
+    TEST_ASSERT_EQ(ops[1].arg, a + 32u);
+    /* Invalidate [4, 68): partial edge lines are cleaned as well. */
+    TEST_ASSERT_EQ(ops[2].reg, 0x270u);
+    TEST_ASSERT_EQ(ops[2].arg, a);
+    TEST_ASSERT_EQ(ops[3].reg, 0x270u);
+    TEST_ASSERT_EQ(ops[3].arg, a + 64u);
+    TEST_ASSERT_EQ(ops[4].reg, 0x25Cu);
+    TEST_ASSERT_EQ(ops[4].arg, a + 32u);
+    /* Aligned: plain invalidate. */
+    TEST_ASSERT_EQ(ops[5].reg, 0x25Cu);
+    TEST_ASSERT_EQ(ops[6].reg, 0x25Cu);
+    TEST_ASSERT_EQ(ops[6].arg, a + 32u);
+    /* Inside one line: a single clean+invalidate. */
+    TEST_ASSERT_EQ(ops[7].reg, 0x270u);
+    TEST_ASSERT_EQ(ops[7].arg, a + 32u);
+    TEST_ASSERT_EQ(ops[8].reg, 0x270u);
+#else
+    (void)a;
+    TEST_ASSERT_EQ(sim_cache_take(ops, STM32_ARRAY_SIZE(ops)), 0u);
+#endif
+}
+
+static void test_dma(void)
+{
+    static uint8_t dst[64] CACHE_ALIGNED;
+    const dma_config_t cfg = {
+        .dir = DMA_DIR_M2M, .psize = DMA_SIZE_WORD, .msize = DMA_SIZE_WORD,
+        .pinc = true, .minc = true,
+    };
+    dma_xfer_t x = { .periph = REG_ADDR(buf), .mem0 = dst, .count = 16 };
+    dma_stream_t *s;
+    size_t n;
+
+    sim_reset();
+    memset(buf, 0x5A, sizeof(buf));
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_MEM, &s), DRV_OK);
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(dma_submit(s, &x), DRV_OK);
+    while (sim_irq_take(s->irqn)) {
+        dma_irq(s->dma, s->stream);
+    }
+    TEST_ASSERT_MEM_EQ(dst, buf, sizeof(dst));
+    n = sim_cache_take(ops, STM32_ARRAY_SIZE(ops));
+#if STM32_HAS_DCACHE
+    /* Source cleaned, destination invalidated before and after. */
+    TEST_ASSERT_EQ(n, 6u);
+    TEST_ASSERT_EQ(ops[0].reg, 0x268u);
+    TEST_ASSERT_EQ(ops[0].arg, REG_ADDR(buf));
+    TEST_ASSERT_EQ(ops[1].reg, 0x268u);
+    TEST_ASSERT_EQ(ops[2].reg, 0x25Cu);
+    TEST_ASSERT_EQ(ops[2].arg, REG_ADDR(dst));
+    TEST_ASSERT_EQ(ops[4].reg, 0x25Cu);
+    TEST_ASSERT_EQ(ops[5].arg, REG_ADDR(dst) + 32u);
+#else
+    TEST_ASSERT_EQ(n, 0u);
+#endif
+    dma_free(s);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_ranges);
+    TEST_RUN(test_dma);
+    return TEST_RESULT();
+}
@@ -0,0 +1,569 @@
+/**
+ * @file    test_can.c
+ * @brief   CAN tests: bit timing, filter bank packing and merging, replay of
+ *          recorded bus traces through the hardware filters, FIFO draining
+ *          and overruns, transmit priority with mailbox preemption, and the
+ *          CAN2 bank split.
+ */
+#include <string.h>
+
+#include "can.h"
+#include "sim.h"
+#include "test.h"
+
+#define RX_SIZE     64u
+#define TX_SIZE     16u
+
+static can_frame_t rx_buf[RX_SIZE];
+static can_tx_entry_t tx_buf[TX_SIZE];
+
+/* candump -l of a powertrain bus, trimmed. */
+static const char trace[] =
+    "(1436509052.249713) can0 0C4#3A1F000000000000\n"
+    "(1436509052.250112) can0 123#DEADBEEF\n"
+    "(1436509052.250530) can0 18FEF100#FFFF20FFFF00FFFF\n"
+    "(1436509052.250998) can0 1A0#0102\n"
+    "(1436509052.251402) can0 7DF#0201050000000000\n"
+    "(1436509052.251890) can0 7E8#034105780000AAAA\n"
+    "(1436509052.252301) can0 124#00\n"
+    "(1436509052.252766) can0 18FEEE00#5C5E0FFF2CFFFFFF\n"
+    "(1436509052.253110) can0 0C4#3A20000000000000\n"
+    "(1436509052.253597) can0 1A1#R\n"
+    "(1436509052.254020) can0 7E9#03410D3200000000\n"
+    "(1436509052.254488) can0 2F0#\n"
+    "(1436509052.254903) can0 18FEF100#FFFF21FFFF00FFFF\n"
+    "(1436509052.255311) can0 1A3#0A0B0C\n"
+    "(1436509052.255820) can0 3E0#1122334455667788\n"
+    "(1436509052.256207) can0 0CF00400#F07D7D0000F0FFFF\n"
+    "(1436509052.256699) can0 123#CAFEBABE\n"
+    "(1436509052.257104) can0 1A2#0203\n"
+    "(1436509052.257588) can0 7E0#0201050000000000\n"
+    "(1436509052.258011) can0 1A1#11\n";
+
+static const can_filter_t wanted[] = {
+    { 0x123, CAN_MASK_EXACT, 0, 0 },
+    { 0x0C4, CAN_MASK_EXACT, 0, 0 },
+    { 0x7E8, 0x7F8, 0, 1 },                             /* 7E8..7EF */
+    { 0x1A0, 0x7FC, 0, 0 },                             /* 1A0..1A3 data */
+    { 0x1A1, CAN_MASK_EXACT, CAN_FRAME_RTR, 0 },
+    { 0x18FEF100, CAN_MASK_EXACT, CAN_FRAME_EXT, 1 },
+    { 0x0CF00400, 0x1FFFFF00, CAN_FRAME_EXT, 0 },
+};
+
+static bool want(const can_filter_t *f, size_t n, const sim_can_frame_t *fr, size_t *idx)
+{
+    uint8_t flags = (uint8_t)((fr->ext ? CAN_FRAME_EXT : 0u) | (fr->rtr ? CAN_FRAME_RTR : 0u));
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t width = (f[i].flags & CAN_FRAME_EXT) ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK;
+
+        if (f[i].flags == flags && ((fr->id ^ f[i].id) & f[i].mask & width) == 0u) {
+            if (idx != NULL) {
+                *idx = i;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void service(can_t *h)
+{
+    bool can1 = (h->can == CAN1);
+
+    while (sim_irq_take(can1 ? CAN1_TX_IRQn : CAN2_TX_IRQn)) {
+        can_tx_irq(h);
+    }
+    while (sim_irq_take(can1 ? CAN1_RX0_IRQn : CAN2_RX0_IRQn)) {
+        can_rx_irq(h, 0u);
+    }
+    while (sim_irq_take(can1 ? CAN1_RX1_IRQn : CAN2_RX1_IRQn)) {
+        can_rx_irq(h, 1u);
+    }
+    while (sim_irq_take(can1 ? CAN1_SCE_IRQn : CAN2_SCE_IRQn)) {
+        can_sce_irq(h);
+    }
+}
+
+static void setup(can_t *h, can_regs_t *can, bool loopback)
+{
+    const can_config_t cfg = {
+        .bitrate = 500000u,
+        .loopback = loopback,
+        .rx_buf = rx_buf,
+        .rx_size = RX_SIZE,
+        .tx_buf = tx_buf,
+        .tx_size = TX_SIZE,
+    };
+
+    sim_reset();
+    TEST_ASSERT_EQ(can_init(h, can, &cfg), DRV_OK);
+    TEST_ASSERT(!REG_TEST_BITS(can->MSR, CAN_MSR_INAK | CAN_MSR_SLAK));
+}
+
+static sim_can_frame_t std_frame(uint32_t id, uint8_t tag)
+{
+    sim_can_frame_t f = { .id = id, .len = 1, .data = { tag } };
+
+    return f;
+}
+
+static can_frame_t tx_frame(uint32_t id, uint8_t tag)
+{
+    can_frame_t f = { .id = id, .len = 2, .data = { tag, (uint8_t)id } };
+
+    return f;
+}
+
+static void test_timing(void)
+{
+    uint32_t btr = 0;
+
+    /* 16 MHz / 500 kbit/s: 16 quanta of 125 ns, sample at 14/16. */
+    TEST_ASSERT_EQ(can_timing(16000000u, 500000u, 0u, &btr), DRV_OK);
+    TEST_ASSERT_EQ(reg_field_get(btr, CAN_BTR_BRP), 1u);
+    TEST_ASSERT_EQ(reg_field_get(btr, CAN_BTR_TS1) + 2u, 14u);
+    TEST_ASSERT_EQ(reg_field_get(btr, CAN_BTR_TS2) + 1u, 2u);
+    TEST_ASSERT_EQ(reg_field_get(btr, CAN_BTR_SJW) + 1u, 2u);
+
+    /* 42 MHz / 1 Mbit/s: 21 quanta would need TS1 17; 14 fits. */
+    TEST_ASSERT_EQ(can_timing(42000000u, 1000000u, 875u, &btr), DRV_OK);
+    TEST_ASSERT_EQ(reg_field_get(btr, CAN_BTR_BRP), 2u);
+    TEST_ASSERT_EQ(reg_field_get(btr, CAN_BTR_TS1) + reg_field_get(btr, CAN_BTR_TS2) + 3u, 14u);
+
+    TEST_ASSERT_EQ(can_timing(16000000u, 333333u, 0u, &btr), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(can_timing(16000000u, 0u, 0u, &btr), DRV_ERR_PARAM);
+}
+
+static void test_compile_packing(void)
+{
+    can_filter_t f[10];
+    can_filter_plan_t plan;
+    uint32_t i;
+
+    /* Eight standard identifiers: two 16-bit list banks. */
+    for (i = 0; i < 8u; i++) {
+        f[i] = (can_filter_t){ 0x100u + i, CAN_MASK_EXACT, 0, 0 };
+    }
+    TEST_ASSERT_EQ(can_filter_compile(f, 8u, CAN_BANKS_PER_PORT, &plan), DRV_OK);
+    TEST_ASSERT_EQ(plan.banks, 2u);
+    TEST_ASSERT_EQ(plan.fm1r, 3u);
+    TEST_ASSERT_EQ(plan.fs1r, 0u);
+    TEST_ASSERT_EQ(plan.fr[0][0], (0x100u << 5) | (0x101u << 21));
+    TEST_ASSERT_EQ(plan.count[0], 8u);
+    TEST_ASSERT_EQ(plan.map[0][5], 5u);
+
+    /* Five: the last bank repeats its identifier in the unused slots. */
+    TEST_ASSERT_EQ(can_filter_compile(f, 5u, CAN_BANKS_PER_PORT, &plan), DRV_OK);
+    TEST_ASSERT_EQ(plan.banks, 2u);
+    TEST_ASSERT_EQ(plan.fr[1][1], (0x104u << 5) | (0x104u << 21));
+    TEST_ASSERT_EQ(plan.map[0][7], 4u);
+
+    /* One extended identifier shares its 32-bit list bank with a standard one. */
+    f[0] = (can_filter_t){ 0x12345678u, CAN_MASK_EXACT, CAN_FRAME_EXT, 0 };
+    f[1] = (can_filter_t){ 0x7FFu, CAN_MASK_EXACT, 0, 0 };
+    TEST_ASSERT_EQ(can_filter_compile(f, 2u, CAN_BANKS_PER_PORT, &plan), DRV_OK);
+    TEST_ASSERT_EQ(plan.banks, 1u);
+    TEST_ASSERT_EQ(plan.fs1r & plan.fm1r, 1u);
+    TEST_ASSERT_EQ(plan.fr[0][0], (0x12345678u << 3) | CAN_IR_IDE);
+    TEST_ASSERT_EQ(plan.fr[0][1], 0x7FFu << 21);
+
+    /* Three masks and an identifier: two 16-bit mask banks. */
+    f[0] = (can_filter_t){ 0x200u, 0x7F0u, 0, 0 };
+    f[1] = (can_filter_t){ 0x300u, 0x7F0u, 0, 0 };
+    f[2] = (can_filter_t){ 0x400u, 0x7F0u, 0, 0 };
+    f[3] = (can_filter_t){ 0x555u, CAN_MASK_EXACT, 0, 0 };
+    TEST_ASSERT_EQ(can_filter_compile(f, 4u, CAN_BANKS_PER_PORT, &plan), DRV_OK);
+    TEST_ASSERT_EQ(plan.banks, 2u);
+    TEST_ASSERT_EQ(plan.fm1r, 0u);
+    TEST_ASSERT_EQ(plan.fr[1][1] & 0xFFFFu, 0x555u << 5);
+    TEST_ASSERT_EQ(plan.fr[1][1] >> 16, (0x7FFu << 5) | CAN_F16_RTR | CAN_F16_IDE);
+    TEST_ASSERT_EQ(plan.map[0][3], 3u);
+
+    /* Covered entries cost nothing; FIFOs get banks of their own. */
+    f[4] = (can_filter_t){ 0x205u, CAN_MASK_EXACT, 0, 0 };
+    f[5] = (can_filter_t){ 0x300u, 0x7F0u, 0, 0 };
+    f[6] = (can_filter_t){ 0x600u, CAN_MASK_EXACT, 0, 1 };
+    TEST_ASSERT_EQ(can_filter_compile(f, 7u, CAN_BANKS_PER_PORT, &plan), DRV_OK);
+    TEST_ASSERT_EQ(plan.banks, 3u);
+    TEST_ASSERT_EQ(plan.ffa1r, 4u);
+    TEST_ASSERT_EQ(plan.count[0], 4u);
+    TEST_ASSERT_EQ(plan.count[1], 4u);
+    TEST_ASSERT_EQ(plan.map[1][0], 6u);
+
+    /* Bad entries. */
+    f[0] = (can_filter_t){ 0x800u, CAN_MASK_EXACT, 0, 0 };
+    TEST_ASSERT_EQ(can_filter_compile(f, 1u, CAN_BANKS_PER_PORT, &plan), DRV_ERR_PARAM);
+    f[0] = (can_filter_t){ 0x100u, CAN_MASK_EXACT, 0, 2 };
+    TEST_ASSERT_EQ(can_filter_compile(f, 1u, CAN_BANKS_PER_PORT, &plan), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(can_filter_compile(f, CAN_FILTERS_MAX + 1u, CAN_BANKS_PER_PORT, &plan),
+                   DRV_ERR_PARAM);
+}
+
+static void test_compile_merge(void)
+{
+    can_filter_t f[CAN_FILTERS_MAX];
+    can_filter_plan_t plan;
+    uint32_t checked = 0;
+    uint32_t i;
+
+    /* 60 identifiers need 15 list banks: one too many. */
+    for (i = 0; i < 60u; i++) {
+        f[i] = (can_filter_t){ 0x400u + 3u * i, CAN_MASK_EXACT, 0, 0 };
+    }
+    TEST_ASSERT_EQ(can_filter_compile(f, 60u, 15u, &plan), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(can_filter_compile(f, 60u, CAN_BANKS_PER_PORT, &plan), DRV_OK);
+    TEST_ASSERT(plan.banks <= CAN_BANKS_PER_PORT);
+    for (i = 0; i < plan.count[0]; i++) {
+        checked += (plan.map[0][i] & CAN_FMI_CHECK) ? 1u : 0u;
+    }
+    TEST_ASSERT(checked != 0u);
+
+    /* Down to a single bank: everything ends up in one or two masks. */
+    TEST_ASSERT_EQ(can_filter_compile(f, 60u, 1u, &plan), DRV_OK);
+    TEST_ASSERT_EQ(plan.banks, 1u);
+    TEST_ASSERT_EQ(plan.fm1r | plan.fs1r, 0u);
+    TEST_ASSERT_EQ(plan.map[0][0], CAN_FMI_CHECK);
+
+    /* Standard and extended entries never merge. */
+    f[0] = (can_filter_t){ 0x100u, CAN_MASK_EXACT, 0, 0 };
+    f[1] = (can_filter_t){ 0x100u, CAN_MASK_EXACT, CAN_FRAME_EXT, 0 };
+    TEST_ASSERT_EQ(can_filter_compile(f, 2u, 1u, &plan), DRV_OK);
+    f[1].fifo = 1;
+    TEST_ASSERT_EQ(can_filter_compile(f, 2u, 1u, &plan), DRV_ERR_NORES);
+}
+
+/* Replay @p text into @p h, checking every frame against @p f. */
+static void replay(can_t *h, const char *text, const can_filter_t *f, size_t n,
+                   uint32_t *delivered)
+{
+    sim_can_frame_t fr;
+    can_frame_t got;
+
+    while (sim_can_parse(&text, &fr)) {
+        size_t idx = 0;
+        bool wanted_frame = want(f, n, &fr, &idx);
+        bool passed = sim_can_receive(h->can, &fr);
+
+        service(h);
+        if (!wanted_frame) {
+            /* Either stopped in hardware or checked out in the interrupt. */
+            TEST_ASSERT(!can_recv(h, &got));
+            continue;
+        }
+        TEST_ASSERT(passed);
+        TEST_ASSERT(can_recv(h, &got));
+        TEST_ASSERT_EQ(got.id, fr.id);
+        TEST_ASSERT_EQ(got.len, fr.len);
+        TEST_ASSERT_MEM_EQ(got.data, fr.data, fr.len);
+        TEST_ASSERT_EQ((got.flags & CAN_FRAME_EXT) != 0u, fr.ext);
+        TEST_ASSERT_EQ((got.flags & CAN_FRAME_RTR) != 0u, fr.rtr);
+        /* The reported entry accepts the frame and chose its FIFO. */
+        TEST_ASSERT(got.filter < n);
+        TEST_ASSERT(want(&f[got.filter], 1u, &fr, NULL));
+        TEST_ASSERT_EQ(got.fifo, f[got.filter].fifo);
+        (*delivered)++;
+    }
+}
+
+static void test_trace_replay(void)
+{
+    const char *text = trace;
+    sim_can_frame_t fr;
+    uint32_t delivered = 0;
+    uint32_t frames = 0;
+    can_t h;
+
+    TEST_ASSERT(sim_can_parse(&text, &fr));
+    TEST_ASSERT_EQ(fr.id, 0x0C4u);
+    TEST_ASSERT_EQ(fr.len, 8u);
+    TEST_ASSERT_EQ(fr.data[1], 0x1Fu);
+    text = trace;
+    while (sim_can_parse(&text, &fr)) {
+        frames++;
+    }
+    TEST_ASSERT_EQ(frames, 20u);
+
+    setup(&h, CAN1, false);
+    /* Nothing passes before filters are set. */
+    fr = std_frame(0x123u, 1u);
+    TEST_ASSERT(!sim_can_receive(CAN1, &fr));
+
+    TEST_ASSERT_EQ(can_filters_set(&h, wanted, STM32_ARRAY_SIZE(wanted)), DRV_OK);
+    replay(&h, trace, wanted, STM32_ARRAY_SIZE(wanted), &delivered);
+    TEST_ASSERT_EQ(delivered, 14u);
+    TEST_ASSERT_EQ(h.rx_frames, 14u);
+    /* Exact packing: no frame needed a look at the list. */
+    TEST_ASSERT_EQ(h.rx_rejected, 0u);
+    TEST_ASSERT_EQ(h.rx_dropped + h.rx_overruns, 0u);
+}
+
+static void test_trace_merged(void)
+{
+    static can_filter_t f[CAN_FILTERS_MAX];
+    static char text[CAN_FILTERS_MAX * 2u * 32u];
+    uint32_t delivered = 0;
+    size_t len = 0;
+    uint32_t i;
+    can_t h;
+
+    /* More identifiers than the banks hold: some filters get merged. */
+    for (i = 0; i < CAN_FILTERS_MAX; i++) {
+        f[i] = (can_filter_t){ 0x100u + 7u * i, CAN_MASK_EXACT, 0, (uint8_t)(i & 1u) };
+    }
+    /* A trace of the wanted identifiers and their neighbours. */
+    for (i = 0; i < CAN_FILTERS_MAX; i++) {
+        len += (size_t)snprintf(&text[len], sizeof(text) - len, "(%u.000000) can0 %03X#%02X\n"
+                                "(%u.000500) can0 %03X#%02X\n", (unsigned)i,
+                                (unsigned)(0x100u + 7u * i), (unsigned)i, (unsigned)i,
+                                (unsigned)(0x101u + 7u * i), (unsigned)i);
+    }
+
+    setup(&h, CAN1, false);
+    TEST_ASSERT_EQ(can_filters_set(&h, f, CAN_FILTERS_MAX), DRV_OK);
+    replay(&h, text, f, CAN_FILTERS_MAX, &delivered);
+    TEST_ASSERT_EQ(delivered, CAN_FILTERS_MAX);
+    TEST_ASSERT(h.rx_rejected != 0u);
+    TEST_ASSERT(h.rx_rejected < CAN_FILTERS_MAX);
+}
+
+static void test_fifo_overrun(void)
+{
+    static const can_filter_t all[] = { { 0, 0, 0, 0 } };
+    sim_can_frame_t fr;
+    can_frame_t got;
+    uint32_t i;
+    can_t h;
+
+    setup(&h, CAN1, false);
+    TEST_ASSERT_EQ(can_filters_set(&h, all, 1u), DRV_OK);
+
+    /* Four frames with the interrupt held off: the fourth replaces the third. */
+    for (i = 0; i < 4u; i++) {
+        fr = std_frame(0x10u + i, (uint8_t)i);
+        TEST_ASSERT(sim_can_receive(CAN1, &fr));
+    }
+    TEST_ASSERT(REG_TEST_BITS(CAN1->RF0R, CAN_RFR_FOVR));
+    service(&h);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(CAN1->RF0R), CAN_RFR_FMP), 0u);
+    TEST_ASSERT(!REG_TEST_BITS(CAN1->RF0R, CAN_RFR_FOVR | CAN_RFR_FULL));
+    TEST_ASSERT_EQ(h.rx_overruns, 1u);
+    TEST_ASSERT_EQ(can_rx_count(&h), 3u);
+    TEST_ASSERT(can_recv(&h, &got) && got.id == 0x10u);
+    TEST_ASSERT(can_recv(&h, &got) && got.id == 0x11u);
+    TEST_ASSERT(can_recv(&h, &got) && got.id == 0x13u);
+
+    /* A full queue drops frames but still empties the hardware FIFO. */
+    for (i = 0; i < RX_SIZE + 2u; i++) {
+        fr = std_frame(0x20u, (uint8_t)i);
+        TEST_ASSERT(sim_can_receive(CAN1, &fr));
+        service(&h);
+    }
+    TEST_ASSERT_EQ(can_rx_count(&h), RX_SIZE);
+    TEST_ASSERT_EQ(h.rx_dropped, 2u);
+    TEST_ASSERT(can_recv(&h, &got) && got.data[0] == 0u);
+}
+
+/* Let the bus send everything; record the identifiers in order. */
+static uint32_t drain_bus(can_t *h, uint32_t *ids, uint8_t *tags, uint32_t max)
+{
+    sim_can_frame_t fr;
+    uint32_t n = 0;
+
+    service(h);
+    while (n < max && sim_can_transmit(h->can, &fr)) {
+        ids[n] = fr.id;
+        if (tags != NULL) {
+            tags[n] = fr.data[0];
+        }
+        n++;
+        service(h);
+    }
+    return n;
+}
+
+static void test_tx_priority(void)
+{
+    static const uint32_t order[] = { 0x300, 0x200, 0x100, 0x050, 0x400, 0x010 };
+    uint32_t ids[8];
+    can_frame_t f;
+    uint32_t i;
+    can_t h;
+
+    setup(&h, CAN1, false);
+    for (i = 0; i < STM32_ARRAY_SIZE(order); i++) {
+        f = tx_frame(order[i], (uint8_t)i);
+        TEST_ASSERT_EQ(can_send(&h, &f), DRV_OK);
+        service(&h);
+        /* The mailboxes never sit idle while frames are queued. */
+        TEST_ASSERT_EQ(sim_can_pending(CAN1), (i < 2u) ? (2u << i) - 1u : 7u);
+    }
+    TEST_ASSERT_EQ(can_tx_pending(&h), 6u);
+    /* 0x050 and 0x010 each displaced the lowest-priority mailbox. */
+    TEST_ASSERT_EQ(h.tx_requeued, 2u);
+
+    TEST_ASSERT_EQ(drain_bus(&h, ids, NULL, 8u), 6u);
+    TEST_ASSERT_EQ(ids[0], 0x010u);
+    TEST_ASSERT_EQ(ids[1], 0x050u);
+    TEST_ASSERT_EQ(ids[2], 0x100u);
+    TEST_ASSERT_EQ(ids[3], 0x200u);
+    TEST_ASSERT_EQ(ids[4], 0x300u);
+    TEST_ASSERT_EQ(ids[5], 0x400u);
+    TEST_ASSERT_EQ(h.tx_frames, 6u);
+    TEST_ASSERT_EQ(can_tx_pending(&h), 0u);
+
+    /* Standard beats extended with the same base identifier. */
+    f = (can_frame_t){ .id = 0x123u << 18, .flags = CAN_FRAME_EXT };
+    TEST_ASSERT_EQ(can_send(&h, &f), DRV_OK);
+    f = (can_frame_t){ .id = 0x123u, .flags = CAN_FRAME_RTR };
+    TEST_ASSERT_EQ(can_send(&h, &f), DRV_OK);
+    TEST_ASSERT_EQ(drain_bus(&h, ids, NULL, 8u), 2u);
+    TEST_ASSERT_EQ(ids[0], 0x123u);
+}
+
+static void test_tx_order(void)
+{
+    uint32_t ids[TX_SIZE];
+    uint8_t tags[TX_SIZE];
+    can_frame_t f;
+    uint32_t i;
+    can_t h;
+
+    setup(&h, CAN1, false);
+    /* A segmented transfer on one identifier must not be reordered. */
+    for (i = 0; i < 5u; i++) {
+        f = tx_frame(0x7E0u, (uint8_t)i);
+        TEST_ASSERT_EQ(can_send(&h, &f), DRV_OK);
+    }
+    f = tx_frame(0x7E1u, 9u);
+    TEST_ASSERT_EQ(can_send(&h, &f), DRV_OK);
+    /* One of them in a mailbox at a time; 0x7E1 ranks below them anyway. */
+    TEST_ASSERT_EQ(sim_can_pending(CAN1), 1u);
+    TEST_ASSERT_EQ(drain_bus(&h, ids, tags, TX_SIZE), 6u);
+    for (i = 0; i < 5u; i++) {
+        TEST_ASSERT_EQ(ids[i], 0x7E0u);
+        TEST_ASSERT_EQ(tags[i], i);
+    }
+    TEST_ASSERT_EQ(ids[5], 0x7E1u);
+
+    /* The queue holds tx_size frames, mailboxes included. */
+    for (i = 0; i < TX_SIZE; i++) {
+        f = tx_frame(0x100u + i, 0u);
+        TEST_ASSERT_EQ(can_send(&h, &f), DRV_OK);
+    }
+    TEST_ASSERT_EQ(can_send(&h, &f), DRV_ERR_NORES);
+    f.id = 0x800u;
+    TEST_ASSERT_EQ(can_send(&h, &f), DRV_ERR_PARAM);
+}
+
+static void test_loopback(void)
+{
+    static const can_filter_t f[] = {
+        { 0x15555555u, 0x1FFF0000u, CAN_FRAME_EXT, 1 },
+        { 0x321u, CAN_MASK_EXACT, 0, 0 },
+    };
+    can_frame_t tx = { .id = 0x15551234u, .len = 8, .flags = CAN_FRAME_EXT,
+                       .data = { 1, 2, 3, 4, 5, 6, 7, 8 } };
+    can_frame_t rx;
+    can_t h;
+
+    setup(&h, CAN1, true);
+    TEST_ASSERT_EQ(can_filters_set(&h, f, 2u), DRV_OK);
+    TEST_ASSERT_EQ(can_send(&h, &tx), DRV_OK);
+    tx = tx_frame(0x321u, 0xAAu);
+    TEST_ASSERT_EQ(can_send(&h, &tx), DRV_OK);
+    tx = tx_frame(0x322u, 0xBBu);
+    TEST_ASSERT_EQ(can_send(&h, &tx), DRV_OK);
+    while (sim_can_transmit(CAN1, NULL)) {
+        service(&h);
+    }
+    service(&h);
+    TEST_ASSERT_EQ(h.tx_frames, 3u);
+    TEST_ASSERT_EQ(can_rx_count(&h), 2u);
+    TEST_ASSERT(can_recv(&h, &rx));
+    TEST_ASSERT_EQ(rx.id, 0x321u);
+    TEST_ASSERT_EQ(rx.filter, 1u);
+    TEST_ASSERT(can_recv(&h, &rx));
+    TEST_ASSERT_EQ(rx.id, 0x15551234u);
+    TEST_ASSERT_EQ(rx.flags, CAN_FRAME_EXT);
+    TEST_ASSERT_EQ(rx.fifo, 1u);
+    TEST_ASSERT_EQ(rx.data[7], 8u);
+}
+
+static void test_can2_banks(void)
+{
+    static const can_filter_t f1[] = { { 0x100u, CAN_MASK_EXACT, 0, 0 } };
+    static const can_filter_t f2[] = {
+        { 0x200u, CAN_MASK_EXACT, 0, 0 },
+        { 0x300u, 0x700u, 0, 0 },
+    };
+    static can_frame_t rx2[8];
+    static can_tx_entry_t tx2[4];
+    const can_config_t cfg = {
+        .bitrate = 250000u, .rx_buf = rx2, .rx_size = 8u, .tx_buf = tx2, .tx_size = 4u,
+    };
+    sim_can_frame_t fr;
+    can_frame_t got;
+    can_t h1;
+    can_t h2;
+
+    setup(&h1, CAN1, false);
+    TEST_ASSERT_EQ(can_init(&h2, CAN2, &cfg), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(RCC->APB1ENR, RCC_APB1ENR_CAN1EN | RCC_APB1ENR_CAN2EN));
+    TEST_ASSERT_EQ(can_filters_set(&h1, f1, 1u), DRV_OK);
+    TEST_ASSERT_EQ(can_filters_set(&h2, f2, 2u), DRV_OK);
+    TEST_ASSERT_EQ(REG_FIELD_READ(CAN1->FMR, CAN_FMR_CAN2SB), CAN_BANKS_PER_PORT);
+    TEST_ASSERT_EQ(REG_READ(CAN1->FA1R), 1u | (1u << CAN_BANKS_PER_PORT));
+
+    fr = std_frame(0x100u, 1u);
+    TEST_ASSERT(sim_can_receive(CAN1, &fr));
+    TEST_ASSERT(!sim_can_receive(CAN2, &fr));
+    fr = std_frame(0x345u, 2u);
+    TEST_ASSERT(!sim_can_receive(CAN1, &fr));
+    TEST_ASSERT(sim_can_receive(CAN2, &fr));
+    service(&h1);
+    service(&h2);
+    TEST_ASSERT(can_recv(&h2, &got));
+    TEST_ASSERT_EQ(got.id, 0x345u);
+    TEST_ASSERT_EQ(got.filter, 1u);
+    TEST_ASSERT(can_recv(&h1, &got));
+    TEST_ASSERT_EQ(got.id, 0x100u);
+
+    /* Reloading CAN1's filters leaves CAN2's banks alone. */
+    TEST_ASSERT_EQ(can_filters_set(&h1, f2, 1u), DRV_OK);
+    TEST_ASSERT_EQ(REG_READ(CAN1->FA1R), 1u | (1u << CAN_BANKS_PER_PORT));
+    can_deinit(&h2);
+    TEST_ASSERT(REG_TEST_BITS(CAN2->MSR, CAN_MSR_SLAK));
+    TEST_ASSERT(!sim_can_receive(CAN2, &fr));
+}
+
+static void test_errors(void)
+{
+    can_t h;
+
+    setup(&h, CAN1, false);
+    sim_can_error(CAN1, CAN_ESR_EPVF | reg_field_prep(CAN_ESR_LEC, 3u));
+    service(&h);
+    TEST_ASSERT_EQ(h.errors, 1u);
+    TEST_ASSERT(h.esr & CAN_ESR_EPVF);
+    TEST_ASSERT_EQ(reg_field_get(h.esr, CAN_ESR_LEC), 3u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(CAN1->ESR, CAN_ESR_LEC), 0u);
+    TEST_ASSERT(!REG_TEST_BITS(CAN1->MSR, CAN_MSR_ERRI));
+}
+
+int main(void)
+{
+    TEST_RUN(test_timing);
+    TEST_RUN(test_compile_packing);
+    TEST_RUN(test_compile_merge);
+    TEST_RUN(test_trace_replay);
+    TEST_RUN(test_trace_merged);
+    TEST_RUN(test_fifo_overrun);
+    TEST_RUN(test_tx_priority);
+    TEST_RUN(test_tx_order);
+    TEST_RUN(test_loopback);
+    TEST_RUN(test_can2_banks);
+    TEST_RUN(test_errors);
+    return TEST_RESULT();
+}
@@ -0,0 +1,243 @@
+/**
+ * @file    test_crc.c
+ * @brief   CRC tests: catalogue check values, hardware vs. software paths,
+ *          DMA feed with chunking and tails, unit ownership.
+ */
+#include <string.h>
+
+#include "crc.h"
+#include "test.h"
+
+#if defined(STM32_SIM)
+#include "sim.h"
+#endif
+
+static const uint8_t check[] = "123456789";
+
+static crc_table_t table;
+
+static void reset(void)
+{
+#if defined(STM32_SIM)
+    sim_reset();
+#endif
+}
+
+static void fill(uint8_t *p, size_t len, uint32_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        p[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static uint32_t run(const crc_spec_t *spec, crc_table_t *t, const void *p, size_t len)
+{
+    crc_t h;
+    uint32_t v = 0;
+
+    TEST_ASSERT_EQ(crc_init(&h, spec, t, false), DRV_OK);
+    TEST_ASSERT_EQ(crc_compute(&h, p, len, &v), DRV_OK);
+    crc_deinit(&h);
+    return v;
+}
+
+static void test_check_values(void)
+{
+    const crc_spec_t bzip2 = { 0x04C11DB7u, 0xFFFFFFFFu, 0xFFFFFFFFu, CRC_ORDER_MSB };
+    const crc_spec_t posix_like = { 0x04C11DB7u, 0x00000000u, 0xFFFFFFFFu, CRC_ORDER_MSB };
+
+    reset();
+    TEST_ASSERT_EQ(run(&crc_spec_crc32, &table, check, 9), 0xCBF43926u);
+    TEST_ASSERT_EQ(run(&crc_spec_crc32, NULL, check, 9), 0xCBF43926u);
+    TEST_ASSERT_EQ(run(&crc_spec_crc32c, &table, check, 9), 0xE3069283u);
+    TEST_ASSERT_EQ(run(&crc_spec_crc32c, NULL, check, 9), 0xE3069283u);
+    TEST_ASSERT_EQ(run(&crc_spec_mpeg2, &table, check, 9), 0x0376E6E7u);
+    TEST_ASSERT_EQ(run(&crc_spec_mpeg2, NULL, check, 9), 0x0376E6E7u);
+    TEST_ASSERT_EQ(run(&bzip2, &table, check, 9), 0xFC891918u);
+    /* CRC-32/CKSUM without the length suffix: preset 0 (software on F4). */
+    TEST_ASSERT_EQ(run(&posix_like, &table, check, 9), run(&posix_like, NULL, check, 9));
+    TEST_ASSERT_EQ(run(&crc_spec_crc32, &table, check, 0), 0u);
+}
+
+/* The unit's word order is MPEG-2 over each word's bytes, high byte first. */
+static void test_word_order(void)
+{
+    static uint32_t words[64];
+    static uint32_t swapped[64];
+    uint32_t i;
+
+    reset();
+    fill((uint8_t *)words, sizeof(words), 7);
+    for (i = 0; i < 64u; i++) {
+        swapped[i] = __builtin_bswap32(words[i]);
+    }
+    TEST_ASSERT_EQ(run(&crc_spec_stm32, &table, words, sizeof(words)),
+                   run(&crc_spec_mpeg2, &table, swapped, sizeof(swapped)));
+    TEST_ASSERT_EQ(run(&crc_spec_stm32, NULL, words, sizeof(words)),
+                   run(&crc_spec_mpeg2, NULL, swapped, sizeof(swapped)));
+    /* A single reset value word: the register cancels to zero. */
+    words[0] = 0xFFFFFFFFu;
+    TEST_ASSERT_EQ(run(&crc_spec_stm32, &table, words, 4), 0u);
+}
+
+/* Every length and alignment: unit (when usable), table and bit loop agree. */
+static void test_paths_agree(void)
+{
+    static const crc_spec_t *const specs[] = {
+        &crc_spec_crc32, &crc_spec_crc32c, &crc_spec_mpeg2, &crc_spec_stm32,
+    };
+    static uint8_t buf[128 + 3];
+    crc_t hw;
+    crc_t bit;
+    uint32_t s;
+    uint32_t off;
+    uint32_t len;
+
+    reset();
+    fill(buf, sizeof(buf), 99);
+    for (s = 0; s < STM32_ARRAY_SIZE(specs); s++) {
+        TEST_ASSERT_EQ(crc_init(&hw, specs[s], &table, false), DRV_OK);
+        TEST_ASSERT_EQ(crc_init(&bit, specs[s], NULL, false), DRV_OK);
+        for (off = 0; off < 4u; off++) {
+            for (len = 0; len <= 128u; len++) {
+                uint32_t a = 0;
+                uint32_t b = 0;
+
+                if (specs[s]->order == CRC_ORDER_WORD && (len % 4u) != 0u) {
+                    TEST_ASSERT_EQ(crc_compute(&hw, buf + off, len, &a), DRV_ERR_PARAM);
+                    continue;
+                }
+                TEST_ASSERT_EQ(crc_compute(&hw, buf + off, len, &a), DRV_OK);
+                TEST_ASSERT_EQ(crc_compute(&bit, buf + off, len, &b), DRV_OK);
+                TEST_ASSERT_EQ(a, b);
+                TEST_ASSERT_EQ(crc_compute_sw(&hw, buf + off, len), b);
+            }
+        }
+    }
+#if defined(STM32_SIM)
+    /* The unit did the work where it can. */
+    TEST_ASSERT(sim_crc_words() > 0u);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_CRCEN));
+#endif
+}
+
+#if defined(STM32_SIM)
+
+static crc_table_t table2;
+
+/* 300 KiB: more than one DMA descriptor's worth of words. */
+static uint32_t big[75000];
+
+static uint32_t ndone;
+static drv_status_t done_status;
+static uint32_t done_crc;
+
+static void done(void *ctx, drv_status_t status, uint32_t crc)
+{
+    (void)ctx;
+    ndone++;
+    done_status = status;
+    done_crc = crc;
+}
+
+static void service(crc_t *h)
+{
+    while (sim_irq_take(h->dma->irqn)) {
+        dma_irq(h->dma->dma, h->dma->stream);
+    }
+}
+
+static void test_dma(void)
+{
+    crc_t h;
+    crc_t other;
+    crc_t bare;
+    uint32_t v;
+    uint32_t words;
+
+    reset();
+    ndone = 0;
+    fill((uint8_t *)big, sizeof(big), 3);
+    TEST_ASSERT_EQ(crc_init(&h, &crc_spec_stm32, &table, true), DRV_OK);
+    TEST_ASSERT(h.dma != NULL);
+    TEST_ASSERT(h.dma->dma == DMA2);
+
+    /* 75000 words: a 65535-word chunk, then the rest. */
+    words = sim_crc_words();
+    TEST_ASSERT_EQ(crc_compute_dma(&h, big, sizeof(big), done, NULL), DRV_OK);
+    TEST_ASSERT(crc_busy());
+    TEST_ASSERT_EQ(ndone, 0u);
+
+    /* The unit is taken: software if possible, else busy. */
+    TEST_ASSERT_EQ(crc_init(&other, &crc_spec_crc32, &table2, false), DRV_OK);
+    TEST_ASSERT_EQ(crc_compute(&other, check, 9, &v), DRV_OK);
+    TEST_ASSERT_EQ(v, 0xCBF43926u);
+    TEST_ASSERT_EQ(crc_init(&bare, &crc_spec_crc32, NULL, false), DRV_OK);
+    TEST_ASSERT_EQ(crc_compute(&bare, check, 9, &v), DRV_ERR_BUSY);
+    TEST_ASSERT_EQ(crc_compute_dma(&other, check, 9, done, NULL), DRV_ERR_BUSY);
+
+    service(&h);
+    TEST_ASSERT_EQ(ndone, 1u);
+    TEST_ASSERT_EQ(done_status, DRV_OK);
+    TEST_ASSERT_EQ(done_crc, crc_compute_sw(&h, big, sizeof(big)));
+    TEST_ASSERT_EQ(sim_crc_words() - words, 75000u);
+    TEST_ASSERT_EQ(h.chunk, 2u);
+    TEST_ASSERT(!crc_busy());
+
+    /* Short or unaligned blocks complete in place. */
+    TEST_ASSERT_EQ(crc_compute_dma(&h, big, 64, done, NULL), DRV_OK);
+    TEST_ASSERT_EQ(ndone, 2u);
+    TEST_ASSERT_EQ(done_crc, crc_compute_sw(&h, big, 64));
+    TEST_ASSERT_EQ(crc_compute_dma(&h, (uint8_t *)big + 2, 1024, done, NULL), DRV_OK);
+    TEST_ASSERT_EQ(ndone, 3u);
+    TEST_ASSERT_EQ(done_crc, crc_compute_sw(&h, (uint8_t *)big + 2, 1024));
+    TEST_ASSERT_EQ(crc_compute_dma(&h, big, 1022, done, NULL), DRV_ERR_PARAM);
+    crc_deinit(&h);
+    crc_deinit(&other);
+    crc_deinit(&bare);
+}
+
+/* Reflected CRC-32 by DMA: the F7 unit reverses bits itself; F4 cannot. */
+static void test_dma_reflected(void)
+{
+    crc_t h;
+    uint32_t words;
+
+    reset();
+    ndone = 0;
+    TEST_ASSERT_EQ(crc_init(&h, &crc_spec_crc32, &table, true), DRV_OK);
+#if CRC_PROGRAMMABLE
+    TEST_ASSERT(h.dma != NULL);
+#else
+    TEST_ASSERT(h.dma == NULL);
+#endif
+    words = sim_crc_words();
+    /* 1027 bytes: 256 words by DMA (or CPU), 3 tail bytes in software. */
+    TEST_ASSERT_EQ(crc_compute_dma(&h, big, 1027, done, NULL), DRV_OK);
+    if (h.dma != NULL) {
+        TEST_ASSERT_EQ(ndone, 0u);
+        service(&h);
+    }
+    TEST_ASSERT_EQ(ndone, 1u);
+    TEST_ASSERT_EQ(done_status, DRV_OK);
+    TEST_ASSERT_EQ(done_crc, crc_compute_sw(&h, big, 1027));
+    TEST_ASSERT_EQ(sim_crc_words() - words, 256u);
+    crc_deinit(&h);
+}
+
+#endif /* STM32_SIM */
+
+int main(void)
+{
+    TEST_RUN(test_check_values);
+    TEST_RUN(test_word_order);
+    TEST_RUN(test_paths_agree);
+#if defined(STM32_SIM)
+    TEST_RUN(test_dma);
+    TEST_RUN(test_dma_reflected);
+#endif
+    return TEST_RESULT();
+}
@@ -0,0 +1,303 @@
+/**
+ * @file    test_dma.c
+ * @brief   DMA allocator and transfer engine tests.
+ */
+#include "dma.h"
+#include "sim.h"
+#include "test.h"
+#include "usart.h"
+
+static uint32_t order[8];
+static uint32_t order_len;
+static uint32_t targets[8];
+static uint32_t events_seen[8];
+
+static dma_stream_t *chain_stream;
+static dma_xfer_t chain_extra;
+
+static void record(void *ctx, uint32_t events)
+{
+    if (order_len < STM32_ARRAY_SIZE(order)) {
+        events_seen[order_len] = events;
+        order[order_len++] = (uint32_t)(uintptr_t)ctx;
+    }
+}
+
+static void record_and_chain(void *ctx, uint32_t events)
+{
+    record(ctx, events);
+    TEST_ASSERT_EQ(dma_submit(chain_stream, &chain_extra), DRV_OK);
+}
+
+static void record_target(void *ctx, uint32_t events)
+{
+    dma_stream_t *s = ctx;
+
+    if (order_len < STM32_ARRAY_SIZE(targets)) {
+        events_seen[order_len] = events;
+        targets[order_len++] = dma_current_target(s);
+    }
+}
+
+static void service(dma_stream_t *s)
+{
+    while (sim_irq_take(s->irqn)) {
+        dma_irq(s->dma, s->stream);
+    }
+}
+
+static void reset(void)
+{
+    sim_reset();
+    order_len = 0;
+    memset(order, 0, sizeof(order));
+    memset(events_seen, 0, sizeof(events_seen));
+}
+
+static void test_alloc_conflicts(void)
+{
+    dma_stream_t *a;
+    dma_stream_t *b;
+    dma_stream_t *c;
+    dma_stream_t *d;
+
+    reset();
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_USART2_RX, &a), DRV_OK);
+    TEST_ASSERT(a->regs == &DMA1->S[5] && a->channel == 4u);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA1EN));
+    /* Single route, already taken. */
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_USART2_RX, &d), DRV_ERR_NORES);
+
+    /* Two routes: both get used, then the pool is exhausted. */
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_SPI3_RX, &b), DRV_OK);
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_SPI3_RX, &c), DRV_OK);
+    TEST_ASSERT(b->stream == 0u && c->stream == 2u);
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_SPI3_RX, &d), DRV_ERR_NORES);
+
+    /* I2C1 RX can use DMA1 stream 0 or 5, both held by other requests. */
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_I2C1_RX, &d), DRV_ERR_NORES);
+    dma_free(a);
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_I2C1_RX, &d), DRV_OK);
+    TEST_ASSERT(d == a && d->stream == 5u && d->channel == 1u);
+
+    /* Memory-to-memory only on DMA2, from the top stream down. */
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_MEM, &a), DRV_OK);
+    TEST_ASSERT(a->dma == DMA2 && a->stream == 7u);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN));
+
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_COUNT, &a), DRV_ERR_PARAM);
+
+    dma_free(a);
+    dma_free(b);
+    dma_free(c);
+    dma_free(d);
+}
+
+static void test_configure_checks(void)
+{
+    dma_config_t cfg = {
+        .dir = DMA_DIR_M2M, .psize = DMA_SIZE_WORD, .msize = DMA_SIZE_WORD,
+        .pinc = true, .minc = true, .circular = true,
+    };
+    uint32_t src[4] = { 1, 2, 3, 4 };
+    uint32_t dst[4];
+    dma_xfer_t x = { .periph = REG_ADDR(src), .mem0 = dst, .count = 4 };
+    dma_stream_t *s;
+
+    reset();
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_MEM, &s), DRV_OK);
+    /* Circular M2M is not allowed by the hardware. */
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_PARAM);
+    /* Not configured yet. */
+    TEST_ASSERT_EQ(dma_submit(s, &x), DRV_ERR_PARAM);
+
+    cfg.circular = false;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    /* M2M always runs through the FIFO. */
+    TEST_ASSERT_EQ(dma_submit(s, &x), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(s->regs->FCR, DMA_SFCR_DMDIS));
+    /* Busy until the completion has been serviced. */
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_BUSY);
+    service(s);
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    TEST_ASSERT_MEM_EQ(dst, src, sizeof(src));
+    dma_free(s);
+}
+
+static void test_burst(void)
+{
+    dma_config_t cfg = {
+        .dir = DMA_DIR_P2M, .psize = DMA_SIZE_WORD, .msize = DMA_SIZE_WORD,
+        .minc = true, .burst = DMA_BURST_INCR4,
+    };
+    dma_stream_t *s;
+
+    reset();
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_SPI1_RX, &s), DRV_OK);
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(reg_field_get(s->cr, DMA_SCR_PBURST), DMA_BURST_INCR4);
+    TEST_ASSERT_EQ(reg_field_get(s->cr, DMA_SCR_MBURST), DMA_BURST_INCR4);
+    /* Bursts need the FIFO, even with equal sizes. */
+    TEST_ASSERT((s->fcr & DMA_SFCR_DMDIS) != 0u);
+    TEST_ASSERT((s->cr & DMA_SCR_DMEIE) == 0u);
+    cfg.burst = 4u;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_PARAM);
+    /* A burst larger than the 16-byte FIFO on either side. */
+    cfg.burst = DMA_BURST_INCR8;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_PARAM);
+    cfg.psize = DMA_SIZE_BYTE;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_PARAM);
+    cfg.msize = DMA_SIZE_HALFWORD;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    cfg.burst = DMA_BURST_INCR16;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_PARAM);
+    cfg.msize = DMA_SIZE_BYTE;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    dma_free(s);
+}
+
+static void test_m2m_chain_order(void)
+{
+    const dma_config_t cfg = {
+        .dir = DMA_DIR_M2M, .psize = DMA_SIZE_BYTE, .msize = DMA_SIZE_BYTE,
+        .pinc = true, .minc = true,
+    };
+    static const uint8_t src[16] = "0123456789abcdef";
+    uint8_t dst[4][4];
+    dma_xfer_t x[3];
+    dma_stream_t *s;
+    uint32_t i;
+
+    reset();
+    memset(dst, 0, sizeof(dst));
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_MEM, &s), DRV_OK);
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+
+    for (i = 0; i < 3u; i++) {
+        x[i] = (dma_xfer_t){
+            .periph = REG_ADDR(&src[4u * i]), .mem0 = dst[i], .count = 4,
+            .cb = (i == 2u) ? record_and_chain : record,
+            .ctx = (void *)(uintptr_t)(i + 1u),
+        };
+    }
+    chain_stream = s;
+    chain_extra = (dma_xfer_t){
+        .periph = REG_ADDR(&src[12]), .mem0 = dst[3], .count = 4,
+        .cb = record, .ctx = (void *)(uintptr_t)4u,
+    };
+
+    for (i = 0; i < 3u; i++) {
+        TEST_ASSERT_EQ(dma_submit(s, &x[i]), DRV_OK);
+    }
+    /* Only the first transfer has run; the others wait for its TC. */
+    TEST_ASSERT_MEM_EQ(dst[0], "0123", 4);
+    TEST_ASSERT_EQ(dst[1][0], 0u);
+
+    service(s);
+    TEST_ASSERT_EQ(order_len, 4u);
+    for (i = 0; i < 4u; i++) {
+        TEST_ASSERT_EQ(order[i], i + 1u);
+        TEST_ASSERT_EQ(events_seen[i], DMA_FLAG_TCIF);
+    }
+    TEST_ASSERT_MEM_EQ(dst, src, sizeof(src));
+    TEST_ASSERT(s->head == NULL);
+    dma_free(s);
+}
+
+static void test_double_buffer(void)
+{
+    const dma_config_t cfg = {
+        .dir = DMA_DIR_P2M, .psize = DMA_SIZE_BYTE, .msize = DMA_SIZE_BYTE,
+        .minc = true,
+    };
+    const usart_config_t ucfg = { .pclk_hz = 42000000u, .baud = 115200u };
+    uint8_t buf0[4];
+    uint8_t buf1[4];
+    dma_xfer_t x;
+    dma_stream_t *s;
+
+    reset();
+    memset(targets, 0xFF, sizeof(targets));
+    TEST_ASSERT_EQ(usart_init(USART2, &ucfg), DRV_OK);
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_USART2_RX, &s), DRV_OK);
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    x = (dma_xfer_t){
+        .periph = REG_ADDR(&USART2->DR), .mem0 = buf0, .mem1 = buf1, .count = 4,
+        .cb = record_target, .ctx = s,
+    };
+    TEST_ASSERT_EQ(dma_submit(s, &x), DRV_OK);
+    REG_SET_BITS(USART2->CR3, USART_CR3_DMAR);
+
+    sim_usart_rx(USART2, (const uint8_t *)"ABCD", 4);
+    service(s);
+    sim_usart_rx(USART2, (const uint8_t *)"EFGH", 4);
+    service(s);
+    sim_usart_rx(USART2, (const uint8_t *)"IJ", 2);
+    service(s);
+
+    /* One TC per buffer; the DMA has already moved on to the other one. */
+    TEST_ASSERT_EQ(order_len, 2u);
+    TEST_ASSERT_EQ(targets[0], 1u);
+    TEST_ASSERT_EQ(targets[1], 0u);
+    TEST_ASSERT_EQ(events_seen[0], DMA_FLAG_TCIF);
+    TEST_ASSERT_MEM_EQ(buf0, "IJCD", 4);
+    TEST_ASSERT_MEM_EQ(buf1, "EFGH", 4);
+    TEST_ASSERT_EQ(dma_remaining(s), 2u);
+    /* Never completes: still owned by the engine. */
+    TEST_ASSERT(s->head == &x);
+
+    dma_free(s);
+    TEST_ASSERT(!REG_TEST_BITS(DMA1->S[5].CR, DMA_SCR_EN));
+}
+
+static void test_peripheral_flow(void)
+{
+    dma_config_t cfg = {
+        .dir = DMA_DIR_P2M, .psize = DMA_SIZE_WORD, .msize = DMA_SIZE_WORD,
+        .minc = true, .circular = true, .pfctrl = true,
+    };
+    uint32_t fifo = 0x5A5A5A5Au;
+    uint32_t buf[8];
+    dma_xfer_t x = { .periph = REG_ADDR(&fifo), .mem0 = buf, .count = 8, .cb = record };
+    dma_stream_t *s;
+
+    reset();
+    memset(buf, 0, sizeof(buf));
+    TEST_ASSERT_EQ(dma_alloc(DMA_REQ_SDIO, &s), DRV_OK);
+    TEST_ASSERT(s->dma == DMA2 && s->stream == 3u && s->channel == 4u);
+    /* The peripheral decides when a circular transfer would wrap: no. */
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_ERR_PARAM);
+    cfg.circular = false;
+    TEST_ASSERT_EQ(dma_configure(s, &cfg), DRV_OK);
+    TEST_ASSERT((s->cr & DMA_SCR_PFCTRL) != 0u);
+    x.mem1 = buf + 4;
+    TEST_ASSERT_EQ(dma_submit(s, &x), DRV_ERR_PARAM);
+    x.mem1 = NULL;
+    TEST_ASSERT_EQ(dma_submit(s, &x), DRV_OK);
+
+    /* Three items, then the peripheral ends the transfer early. */
+    sim_dma_request(SIM_DREQ_SDIO);
+    sim_dma_request(SIM_DREQ_SDIO);
+    sim_dma_request(SIM_DREQ_SDIO);
+    TEST_ASSERT_EQ(dma_remaining(s), 0xFFFFu - 3u);
+    TEST_ASSERT_EQ(order_len, 0u);
+    sim_dma_flow_end(SIM_DREQ_SDIO);
+    service(s);
+    TEST_ASSERT_EQ(order_len, 1u);
+    TEST_ASSERT_EQ(events_seen[0], DMA_FLAG_TCIF);
+    TEST_ASSERT_EQ(buf[2], 0x5A5A5A5Au);
+    TEST_ASSERT_EQ(buf[3], 0u);
+    TEST_ASSERT(s->head == NULL);
+    dma_free(s);
+}
+
+int main(void)
+{
+    TEST_RUN(test_alloc_conflicts);
+    TEST_RUN(test_configure_checks);
+    TEST_RUN(test_burst);
+    TEST_RUN(test_m2m_chain_order);
+    TEST_RUN(test_double_buffer);
+    TEST_RUN(test_peripheral_flow);
+    return TEST_RESULT();
+}
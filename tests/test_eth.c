@@ -0,0 +1,619 @@
+/**
+ * @file    test_eth.c
+ * @brief   Ethernet tests: packet buffer pool, MAC and DMA setup, PHY link
+ *          resolution over MDIO, zero-copy receive and descriptor
+ *          ownership, ring exhaustion and resume, checksum offload both
+ *          ways, chained transmit, interrupt coalescing with the receive
+ *          watchdog, and transmit ring back-pressure.
+ */
+#include <string.h>
+
+#include "eth.h"
+#include "rcc.h"
+#include "sim.h"
+#include "test.h"
+
+#define RX_COUNT    8u
+#define TX_COUNT    4u
+#define POOL_SIZE   16u
+#define PHY_ADDR    1u
+
+static eth_dma_desc_t rx_desc[RX_COUNT] ETH_DESC_ALIGNED;
+static eth_dma_desc_t tx_desc[TX_COUNT] ETH_DESC_ALIGNED;
+static eth_pbuf_t *rx_pbuf[RX_COUNT];
+static eth_pbuf_t *tx_pbuf[TX_COUNT];
+
+ETH_POOL_DEFINE(pool, POOL_SIZE);
+
+static const uint8_t own_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t peer_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+static const uint8_t other_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 };
+static const uint8_t bcast_mac[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t mcast_mac[6] = { 0x01, 0x00, 0x5E, 0x00, 0x00, 0xFB };
+
+static uint32_t seen_events;
+
+static void on_event(eth_t *h, uint32_t events)
+{
+    (void)h;
+    seen_events |= events;
+}
+
+static eth_config_t base_cfg(void)
+{
+    eth_config_t cfg = {
+        .rmii = true,
+        .phy_addr = PHY_ADDR,
+        .csum_offload = true,
+        .pool = &pool,
+        .rx_desc = rx_desc,
+        .rx_pbuf = rx_pbuf,
+        .rx_count = RX_COUNT,
+        .tx_desc = tx_desc,
+        .tx_pbuf = tx_pbuf,
+        .tx_count = TX_COUNT,
+        .event = on_event,
+    };
+
+    memcpy(cfg.mac, own_mac, sizeof(own_mac));
+    return cfg;
+}
+
+static void service(eth_t *h)
+{
+    while (sim_irq_take(ETH_IRQn)) {
+        eth_irq(h);
+    }
+}
+
+static void clock_168mhz(void)
+{
+    const rcc_request_t req = { .hse_hz = 8000000u, .need_48mhz = true };
+    rcc_plan_t plan;
+
+    TEST_ASSERT_EQ(rcc_solve(&req, &plan), DRV_OK);
+    rcc_set_current(&plan);
+}
+
+static void setup(eth_t *h, const eth_config_t *cfg)
+{
+    sim_reset();
+    clock_168mhz();
+    TEST_ASSERT_EQ(ETH_POOL_INIT(pool), DRV_OK);
+    TEST_ASSERT_EQ(eth_init(h, cfg), DRV_OK);
+    /* The transmit DMA suspends on the empty ring as soon as it starts. */
+    service(h);
+    seen_events = 0;
+    h->irqs = 0;
+}
+
+static void teardown(eth_t *h)
+{
+    eth_deinit(h);
+    TEST_ASSERT_EQ(pool.avail, POOL_SIZE);
+    rcc_set_current(NULL);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Frames                                                                   */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t sum16(uint32_t sum, const uint8_t *p, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 1u < n; i += 2u) {
+        sum += ((uint32_t)p[i] << 8) | p[i + 1u];
+    }
+    if ((n & 1u) != 0u) {
+        sum += (uint32_t)p[n - 1u] << 8;
+    }
+    while ((sum >> 16) != 0u) {
+        sum = (sum & 0xFFFFu) + (sum >> 16);
+    }
+    return sum;
+}
+
+static uint32_t udp_pseudo(const uint8_t *ip, uint32_t udp_len)
+{
+    return sum16(0u, &ip[12], 8u) + 17u + udp_len;
+}
+
+/*
+ * Ethernet + IPv4 + UDP frame from peer to @p dst with @p payload bytes of
+ * counting data.  With @p csum the checksums are filled in, otherwise they
+ * are left zero for the MAC to insert.  Returns the frame length.
+ */
+static size_t udp_frame(uint8_t *f, const uint8_t dst[6], size_t payload, bool csum)
+{
+    uint8_t *ip = &f[14];
+    uint8_t *udp = &ip[20];
+    uint32_t udp_len = 8u + (uint32_t)payload;
+    uint32_t total = 20u + udp_len;
+    uint32_t c;
+    size_t i;
+
+    memcpy(&f[0], dst, 6);
+    memcpy(&f[6], peer_mac, 6);
+    f[12] = 0x08;
+    f[13] = 0x00;
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    ip[2] = (uint8_t)(total >> 8);
+    ip[3] = (uint8_t)total;
+    ip[4] = 0x12;
+    ip[5] = 0x34;
+    ip[8] = 64;
+    ip[9] = 17;
+    ip[12] = 192; ip[13] = 168; ip[14] = 1; ip[15] = 2;
+    ip[16] = 192; ip[17] = 168; ip[18] = 1; ip[19] = 1;
+    udp[0] = 0x30; udp[1] = 0x39;
+    udp[2] = 0x00; udp[3] = 0x07;
+    udp[4] = (uint8_t)(udp_len >> 8);
+    udp[5] = (uint8_t)udp_len;
+    udp[6] = 0;
+    udp[7] = 0;
+    for (i = 0; i < payload; i++) {
+        udp[8 + i] = (uint8_t)(i + 1u);
+    }
+    if (csum) {
+        c = ~sum16(0u, ip, 20u) & 0xFFFFu;
+        ip[10] = (uint8_t)(c >> 8);
+        ip[11] = (uint8_t)c;
+        c = ~sum16(udp_pseudo(ip, udp_len), udp, udp_len) & 0xFFFFu;
+        udp[6] = (uint8_t)(c >> 8);
+        udp[7] = (uint8_t)c;
+    }
+    return 14u + total;
+}
+
+static bool udp_frame_valid(const uint8_t *f)
+{
+    const uint8_t *ip = &f[14];
+    uint32_t udp_len = (((uint32_t)ip[2] << 8) | ip[3]) - 20u;
+
+    return sum16(0u, ip, 20u) == 0xFFFFu &&
+           sum16(udp_pseudo(ip, udp_len), &ip[20], udp_len) == 0xFFFFu;
+}
+
+static eth_pbuf_t *pbuf_with(const void *data, size_t len)
+{
+    eth_pbuf_t *p = eth_pbuf_alloc(&pool);
+
+    TEST_ASSERT(p != NULL);
+    memcpy(p->data, data, len);
+    p->len = (uint16_t)len;
+    return p;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Tests                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static void test_pool(void)
+{
+    eth_pbuf_t *p[POOL_SIZE];
+    size_t i;
+
+    TEST_ASSERT_EQ(ETH_POOL_INIT(pool), DRV_OK);
+    TEST_ASSERT_EQ(pool.size, POOL_SIZE);
+    for (i = 0; i < POOL_SIZE; i++) {
+        p[i] = eth_pbuf_alloc(&pool);
+        TEST_ASSERT(p[i] != NULL);
+        TEST_ASSERT_EQ((uintptr_t)p[i]->data % STM32_CACHE_LINE, 0u);
+        TEST_ASSERT(p[i]->next == NULL);
+    }
+    TEST_ASSERT(eth_pbuf_alloc(&pool) == NULL);
+    TEST_ASSERT_EQ(pool.avail, 0u);
+    TEST_ASSERT_EQ(pool.min_avail, 0u);
+    TEST_ASSERT(p[1]->data - p[0]->data == (ptrdiff_t)ETH_PBUF_SIZE ||
+                p[0]->data - p[1]->data == (ptrdiff_t)ETH_PBUF_SIZE);
+
+    /* Freeing a chain returns every segment. */
+    p[0]->next = p[1];
+    p[1]->next = p[2];
+    eth_pbuf_free(&pool, p[0]);
+    TEST_ASSERT_EQ(pool.avail, 3u);
+    for (i = 3; i < POOL_SIZE; i++) {
+        eth_pbuf_free(&pool, p[i]);
+    }
+    TEST_ASSERT_EQ(pool.avail, POOL_SIZE);
+    TEST_ASSERT_EQ(pool.min_avail, 0u);
+
+    TEST_ASSERT_EQ(eth_pool_init(&pool, NULL, NULL, 4u), DRV_ERR_PARAM);
+}
+
+static void test_init(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    eth_regs_t *eth = ETH;
+    size_t i;
+
+    sim_reset();
+    TEST_ASSERT_EQ(ETH_POOL_INIT(pool), DRV_OK);
+    rcc_set_current(NULL);
+    TEST_ASSERT_EQ(eth_init(&h, &cfg), DRV_ERR_PARAM);     /* HSI: HCLK too slow */
+    clock_168mhz();
+    cfg.rx_count = 1u;
+    TEST_ASSERT_EQ(eth_init(&h, &cfg), DRV_ERR_PARAM);
+    cfg = base_cfg();
+    (void)eth_pbuf_alloc(&pool);
+    (void)eth_pbuf_alloc(&pool);
+    cfg.rx_count = POOL_SIZE;
+    TEST_ASSERT_EQ(eth_init(&h, &cfg), DRV_ERR_NORES);
+
+    cfg = base_cfg();
+    cfg.rx_coalesce = 4u;
+    setup(&h, &cfg);
+    TEST_ASSERT((RCC->AHB1ENR & RCC_AHB1ENR_ETHMACEN) != 0u);
+    TEST_ASSERT((SYSCFG->PMC & SYSCFG_PMC_MII_RMII_SEL) != 0u);
+    TEST_ASSERT_EQ(h.mdc_div, ETH_MDC_DIV_102);
+    TEST_ASSERT_EQ(eth->MACCR & (ETH_MACCR_RE | ETH_MACCR_TE | ETH_MACCR_IPCO | ETH_MACCR_CSTF),
+                   ETH_MACCR_RE | ETH_MACCR_TE | ETH_MACCR_IPCO | ETH_MACCR_CSTF);
+    TEST_ASSERT_EQ(eth->MACA0HR, ETH_MACA0HR_MO | 0x0100u);
+    TEST_ASSERT_EQ(eth->MACA0LR, 0x00000002u);
+    TEST_ASSERT((eth->DMABMR & ETH_DMABMR_EDFE) != 0u);
+    TEST_ASSERT_EQ(eth->DMAOMR & (ETH_DMAOMR_RSF | ETH_DMAOMR_TSF | ETH_DMAOMR_DTCEFD),
+                   ETH_DMAOMR_RSF | ETH_DMAOMR_TSF);
+    /* 100 us at 168 MHz is 16800 cycles: 66 units of 256. */
+    TEST_ASSERT_EQ(eth->DMARSWTR, 66u);
+    TEST_ASSERT_EQ(eth->DMARDLAR, REG_ADDR(rx_desc));
+    TEST_ASSERT_EQ(eth->DMATDLAR, REG_ADDR(tx_desc));
+    for (i = 0; i < RX_COUNT; i++) {
+        TEST_ASSERT((rx_desc[i].des0 & ETH_DES0_OWN) != 0u);
+        TEST_ASSERT_EQ(rx_desc[i].des2, REG_ADDR(rx_pbuf[i]->data));
+        TEST_ASSERT_EQ((rx_desc[i].des1 & ETH_RDES1_DIC) != 0u, (i % 4u) != 3u);
+        TEST_ASSERT_EQ((rx_desc[i].des1 & ETH_RDES1_RER) != 0u, i == RX_COUNT - 1u);
+    }
+    TEST_ASSERT((tx_desc[TX_COUNT - 1u].des0 & ETH_TDES0_TER) != 0u);
+    TEST_ASSERT_EQ(pool.avail, POOL_SIZE - RX_COUNT);
+    teardown(&h);
+}
+
+static void test_link(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint16_t v;
+
+    setup(&h, &cfg);
+    TEST_ASSERT_EQ(eth_phy_read(&h, 2u, &v), DRV_OK);
+    TEST_ASSERT_EQ(v, 0xFFFFu);                             /* No PHY yet. */
+
+    sim_eth_phy(ETH, PHY_ADDR, false, 0u);
+    TEST_ASSERT_EQ(eth_phy_read(&h, 2u, &v), DRV_OK);
+    TEST_ASSERT_EQ(v, 0x0007u);
+    TEST_ASSERT(!eth_link_poll(&h));
+
+    /* Partner without 100FD: 100 Mbit/s half duplex. */
+    sim_eth_phy(ETH, PHY_ADDR, true, ETH_AN_100HD | ETH_AN_10FD | ETH_AN_10HD);
+    TEST_ASSERT(eth_link_poll(&h));
+    TEST_ASSERT(h.fast);
+    TEST_ASSERT(!h.full_duplex);
+    TEST_ASSERT_EQ(ETH->MACCR & (ETH_MACCR_FES | ETH_MACCR_DM), ETH_MACCR_FES);
+
+    /* We stop advertising 100 Mbit/s: 10 Mbit/s full duplex. */
+    TEST_ASSERT_EQ(eth_phy_write(&h, ETH_PHY_ANAR, ETH_AN_10FD | ETH_AN_10HD | 1u), DRV_OK);
+    TEST_ASSERT(eth_link_poll(&h));
+    TEST_ASSERT(!h.fast);
+    TEST_ASSERT(h.full_duplex);
+    TEST_ASSERT_EQ(ETH->MACCR & (ETH_MACCR_FES | ETH_MACCR_DM), ETH_MACCR_DM);
+
+    /* PHY reset restores the advertisement. */
+    TEST_ASSERT_EQ(eth_phy_write(&h, ETH_PHY_BMCR, ETH_BMCR_RESET), DRV_OK);
+    TEST_ASSERT_EQ(eth_phy_read(&h, ETH_PHY_ANAR, &v), DRV_OK);
+    TEST_ASSERT_EQ(v, 0x01E1u);
+    TEST_ASSERT_EQ(eth_phy_read(&h, 32u, &v), DRV_ERR_PARAM);
+    teardown(&h);
+}
+
+static void test_rx_zero_copy(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[128];
+    size_t n = udp_frame(f, own_mac, 50u, true);
+    eth_pbuf_t *armed;
+    eth_pbuf_t *p;
+
+    setup(&h, &cfg);
+    armed = rx_pbuf[0];
+    TEST_ASSERT(eth_recv(&h) == NULL);
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    TEST_ASSERT((rx_desc[0].des0 & ETH_DES0_OWN) == 0u);    /* Handed back by the DMA. */
+    TEST_ASSERT((rx_desc[1].des0 & ETH_DES0_OWN) != 0u);
+    service(&h);
+    TEST_ASSERT_EQ(seen_events, ETH_EVENT_RX);
+
+    p = eth_recv(&h);
+    TEST_ASSERT(p == armed);                                /* The buffer the DMA wrote. */
+    TEST_ASSERT_EQ(p->len, n);
+    TEST_ASSERT_MEM_EQ(p->data, f, n);
+    TEST_ASSERT_EQ(p->flags, ETH_RX_IPV4 | ETH_RX_CSUM_OK);
+    TEST_ASSERT(rx_pbuf[0] != armed);                       /* Refilled from the pool. */
+    TEST_ASSERT_EQ(rx_desc[0].des2, REG_ADDR(rx_pbuf[0]->data));
+    TEST_ASSERT((rx_desc[0].des0 & ETH_DES0_OWN) != 0u);
+    TEST_ASSERT(eth_recv(&h) == NULL);
+    TEST_ASSERT_EQ(h.rx_frames, 1u);
+    TEST_ASSERT_EQ(pool.avail, POOL_SIZE - RX_COUNT - 1u);
+    eth_pbuf_free(&pool, p);
+
+    /* Address filter. */
+    n = udp_frame(f, other_mac, 10u, true);
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_FILTERED);
+    n = udp_frame(f, mcast_mac, 10u, true);
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_FILTERED);
+    n = udp_frame(f, bcast_mac, 10u, true);
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    p = eth_recv(&h);
+    TEST_ASSERT(p != NULL);
+    TEST_ASSERT_MEM_EQ(p->data, bcast_mac, 6u);
+    eth_pbuf_free(&pool, p);
+    teardown(&h);
+}
+
+static void test_rx_exhaust(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[128];
+    size_t n;
+    size_t i;
+    eth_pbuf_t *p;
+
+    setup(&h, &cfg);
+    for (i = 0; i < RX_COUNT; i++) {
+        n = udp_frame(f, own_mac, 20u + i, true);
+        TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    }
+    /* Every descriptor is the driver's: the DMA suspends. */
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_MISSED);
+    TEST_ASSERT_EQ(REG_FIELD_READ(ETH->DMASR, ETH_DMASR_RPS), ETH_DMA_RPS_SUSPENDED);
+    TEST_ASSERT_EQ(REG_FIELD_READ(ETH->DMAMFBOCR, ETH_DMAMFBOCR_MFC), 1u);
+    TEST_ASSERT_EQ(REG_READ(ETH->DMAMFBOCR), 0u);           /* Cleared on read. */
+    service(&h);
+    TEST_ASSERT_EQ(seen_events, ETH_EVENT_RX | ETH_EVENT_RX_STALL);
+    TEST_ASSERT_EQ(h.rx_stalls, 1u);
+
+    /* Frames come out in order; re-arming resumes the DMA. */
+    for (i = 0; i < RX_COUNT; i++) {
+        p = eth_recv(&h);
+        TEST_ASSERT(p != NULL);
+        TEST_ASSERT_EQ(p->len, 14u + 28u + 20u + i);
+        eth_pbuf_free(&pool, p);
+    }
+    TEST_ASSERT(eth_recv(&h) == NULL);
+    TEST_ASSERT_EQ(REG_FIELD_READ(ETH->DMASR, ETH_DMASR_RPS), 3u);
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+
+    /* Pool empty: the frame is dropped and its buffer stays in the ring. */
+    {
+        eth_pbuf_t *held[POOL_SIZE];
+        size_t k = 0;
+
+        while ((held[k] = eth_pbuf_alloc(&pool)) != NULL) {
+            k++;
+        }
+        TEST_ASSERT(eth_recv(&h) == NULL);
+        TEST_ASSERT_EQ(h.rx_nobuf, 1u);
+        TEST_ASSERT((rx_desc[0].des0 & ETH_DES0_OWN) != 0u);
+        while (k != 0u) {
+            eth_pbuf_free(&pool, held[--k]);
+        }
+    }
+    teardown(&h);
+}
+
+static void test_rx_csum(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[128];
+    size_t n;
+    eth_pbuf_t *p;
+
+    setup(&h, &cfg);
+    /* Corrupt payload: the MAC drops it. */
+    n = udp_frame(f, own_mac, 32u, true);
+    f[n - 1u] ^= 0x5A;
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_DROPPED);
+    /* Corrupt IP header likewise. */
+    n = udp_frame(f, own_mac, 32u, true);
+    f[14 + 8] = 1;
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_DROPPED);
+    TEST_ASSERT(eth_recv(&h) == NULL);
+
+    /* Not IP: no flags. */
+    n = udp_frame(f, own_mac, 32u, true);
+    f[12] = 0x08;
+    f[13] = 0x06;
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    p = eth_recv(&h);
+    TEST_ASSERT(p != NULL);
+    TEST_ASSERT_EQ(p->flags, 0u);
+    eth_pbuf_free(&pool, p);
+    teardown(&h);
+
+    /* Without offload frames pass unchecked and unflagged. */
+    cfg.csum_offload = false;
+    setup(&h, &cfg);
+    n = udp_frame(f, own_mac, 32u, true);
+    f[n - 1u] ^= 0x5A;
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    p = eth_recv(&h);
+    TEST_ASSERT(p != NULL);
+    TEST_ASSERT_EQ(p->flags, 0u);
+    eth_pbuf_free(&pool, p);
+    teardown(&h);
+}
+
+static void test_tx_chain(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[256];
+    uint8_t wire[256];
+    size_t n = udp_frame(f, peer_mac, 100u, false);
+    eth_pbuf_t *hdr;
+    eth_pbuf_t *pay;
+
+    setup(&h, &cfg);
+    /* Headers and payload in separate buffers, checksums left to the MAC. */
+    hdr = pbuf_with(f, 42u);
+    pay = pbuf_with(&f[42], n - 42u);
+    hdr->next = pay;
+    TEST_ASSERT_EQ(eth_send(&h, hdr), DRV_OK);
+    TEST_ASSERT_EQ(h.tx_used, 2u);
+    TEST_ASSERT_EQ(tx_desc[0].des0 & (ETH_DES0_OWN | ETH_TDES0_FS | ETH_TDES0_LS),
+                   ETH_DES0_OWN | ETH_TDES0_FS);
+    TEST_ASSERT_EQ(tx_desc[1].des0 & (ETH_DES0_OWN | ETH_TDES0_FS | ETH_TDES0_LS),
+                   ETH_DES0_OWN | ETH_TDES0_LS);
+    TEST_ASSERT_EQ(REG_FIELD_READ(tx_desc[0].des0, ETH_TDES0_CIC), ETH_CIC_FULL);
+    TEST_ASSERT(tx_pbuf[1] == hdr);
+
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    TEST_ASSERT_MEM_EQ(wire, f, 24u);                       /* Up to the IP checksum. */
+    TEST_ASSERT_MEM_EQ(&wire[42], &f[42], n - 42u);
+    TEST_ASSERT(udp_frame_valid(wire));
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), 0u);
+    service(&h);
+    TEST_ASSERT((seen_events & ETH_EVENT_TX) != 0u);
+
+    TEST_ASSERT_EQ(eth_tx_reclaim(&h), 1u);
+    TEST_ASSERT_EQ(h.tx_used, 0u);
+    TEST_ASSERT_EQ(h.tx_frames, 1u);
+    TEST_ASSERT_EQ(pool.avail, POOL_SIZE - RX_COUNT);
+
+    /* A short frame goes out padded; zero-length segments are refused. */
+    hdr = pbuf_with(f, 20u);
+    TEST_ASSERT_EQ(eth_send(&h, hdr), DRV_OK);
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), 60u);
+    pay = pbuf_with(f, 0u);
+    TEST_ASSERT_EQ(eth_send(&h, pay), DRV_ERR_PARAM);
+    eth_pbuf_free(&pool, pay);
+    teardown(&h);
+}
+
+static void test_rx_coalesce(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[128];
+    size_t n = udp_frame(f, own_mac, 16u, true);
+    size_t i;
+    eth_pbuf_t *p;
+
+    cfg.rx_coalesce = 4u;
+    cfg.rx_timeout_us = 50u;
+    setup(&h, &cfg);
+    /* One interrupt per four frames. */
+    for (i = 0; i < 3u; i++) {
+        TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+        TEST_ASSERT(!sim_irq_pending(ETH_IRQn));
+    }
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    service(&h);
+    TEST_ASSERT_EQ(h.irqs, 1u);
+    TEST_ASSERT_EQ(seen_events, ETH_EVENT_RX);
+    while ((p = eth_recv(&h)) != NULL) {
+        eth_pbuf_free(&pool, p);
+    }
+    TEST_ASSERT_EQ(h.rx_frames, 4u);
+
+    /* A lone frame is signalled by the watchdog: 50 us is 33 units here. */
+    TEST_ASSERT_EQ(ETH->DMARSWTR, 33u);
+    TEST_ASSERT_EQ(sim_eth_receive(ETH, f, n), SIM_ETH_RX_OK);
+    sim_eth_advance(ETH, 33u * 256u - 1u);
+    TEST_ASSERT(!sim_irq_pending(ETH_IRQn));
+    sim_eth_advance(ETH, 1u);
+    service(&h);
+    TEST_ASSERT_EQ(h.irqs, 2u);
+    p = eth_recv(&h);
+    TEST_ASSERT(p != NULL);
+    eth_pbuf_free(&pool, p);
+    teardown(&h);
+}
+
+static void test_tx_coalesce(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[128];
+    uint8_t wire[128];
+    size_t n = udp_frame(f, peer_mac, 32u, false);
+    size_t i;
+
+    cfg.tx_coalesce = 3u;
+    setup(&h, &cfg);
+    for (i = 0; i < 3u; i++) {
+        TEST_ASSERT_EQ(eth_send(&h, pbuf_with(f, n)), DRV_OK);
+    }
+    TEST_ASSERT_EQ(tx_desc[0].des0 & ETH_TDES0_IC, 0u);
+    TEST_ASSERT_EQ(tx_desc[1].des0 & ETH_TDES0_IC, 0u);
+    TEST_ASSERT(tx_desc[2].des0 & ETH_TDES0_IC);
+    /* Queued behind each other: no interrupt until the third. */
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    TEST_ASSERT(!sim_irq_pending(ETH_IRQn));
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    TEST_ASSERT((ETH->DMASR & (ETH_DMA_TS | ETH_DMA_TBUS)) == (ETH_DMA_TS | ETH_DMA_TBUS));
+    service(&h);
+    TEST_ASSERT_EQ(h.irqs, 1u);
+    TEST_ASSERT_EQ(seen_events, ETH_EVENT_TX);
+
+    /* A frame without IC still ends in an interrupt once the ring drains. */
+    TEST_ASSERT_EQ(eth_send(&h, pbuf_with(f, n)), DRV_OK);     /* Poll demand resumes. */
+    TEST_ASSERT_EQ(tx_desc[3].des0 & ETH_TDES0_IC, 0u);
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    service(&h);
+    TEST_ASSERT_EQ(h.irqs, 2u);
+    TEST_ASSERT_EQ(h.tx_frames, 3u);                        /* Reclaimed by eth_send(). */
+    TEST_ASSERT_EQ(eth_tx_reclaim(&h), 1u);
+    TEST_ASSERT_EQ(h.tx_frames, 4u);
+    teardown(&h);
+}
+
+static void test_tx_full(void)
+{
+    eth_config_t cfg = base_cfg();
+    eth_t h;
+    uint8_t f[128];
+    uint8_t wire[128];
+    size_t n = udp_frame(f, peer_mac, 32u, false);
+    eth_pbuf_t *p;
+    size_t i;
+
+    setup(&h, &cfg);
+    for (i = 0; i < TX_COUNT; i++) {
+        TEST_ASSERT_EQ(eth_send(&h, pbuf_with(f, n)), DRV_OK);
+    }
+    p = pbuf_with(f, n);
+    TEST_ASSERT_EQ(eth_send(&h, p), DRV_ERR_NORES);
+    /* One frame out: eth_send() reclaims its descriptor itself. */
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    TEST_ASSERT_EQ(eth_send(&h, p), DRV_OK);
+    TEST_ASSERT_EQ(h.tx_frames, 1u);
+    TEST_ASSERT(tx_pbuf[0] == p);                           /* Wrapped to the ring start. */
+    for (i = 0; i < TX_COUNT; i++) {
+        TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), n);
+    }
+    TEST_ASSERT_EQ(sim_eth_transmit(ETH, wire, sizeof(wire)), 0u);
+    TEST_ASSERT_EQ(eth_tx_reclaim(&h), TX_COUNT);
+    teardown(&h);
+}
+
+int main(void)
+{
+    TEST_RUN(test_pool);
+    TEST_RUN(test_init);
+    TEST_RUN(test_link);
+    TEST_RUN(test_rx_zero_copy);
+    TEST_RUN(test_rx_exhaust);
+    TEST_RUN(test_rx_csum);
+    TEST_RUN(test_tx_chain);
+    TEST_RUN(test_rx_coalesce);
+    TEST_RUN(test_tx_coalesce);
+    TEST_RUN(test_tx_full);
+    return TEST_RESULT();
+}
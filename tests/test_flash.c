@@ -0,0 +1,235 @@
+/**
+ * @file    test_flash.c
+ * @brief   Flash tests: sector map, x32 and x64 programming, bits that only
+ *          clear, erase ranges, lock handling and the streaming writer.
+ */
+#include <string.h>
+
+#include "flash.h"
+#include "sim.h"
+#include "test.h"
+
+static uint8_t pattern[256];
+
+static void setup(bool vpp)
+{
+    size_t i;
+
+    sim_reset();
+    TEST_ASSERT_EQ(flash_init(3300u, vpp), DRV_OK);
+    for (i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t)(i * 7u + 3u);
+    }
+}
+
+static bool erased(uint32_t addr, uint32_t len)
+{
+    const uint8_t *p = flash_ptr(addr);
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (p[i] != 0xFFu) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_init(void)
+{
+    sim_reset();
+    TEST_ASSERT_EQ(flash_init(2000u, false), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_unit(), 0u);
+    TEST_ASSERT_EQ(flash_program(FLASH_MEM_BASE, pattern, 4u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_init(0u, false), DRV_OK);
+    TEST_ASSERT_EQ(flash_unit(), 4u);
+    TEST_ASSERT_EQ(flash_init(2000u, true), DRV_OK);
+    TEST_ASSERT_EQ(flash_unit(), 8u);
+}
+
+static void test_sectors(void)
+{
+    uint32_t n;
+
+    TEST_ASSERT_EQ(flash_sector_of(FLASH_MEM_BASE), 0u);
+    TEST_ASSERT_EQ(flash_sector_of(FLASH_MEM_BASE + FLASH_SECTOR_UNIT), 1u);
+    TEST_ASSERT_EQ(flash_sector_of(FLASH_MEM_BASE + 5u * FLASH_SECTOR_UNIT), 4u);
+    TEST_ASSERT_EQ(flash_sector_size(4u), 4u * FLASH_SECTOR_UNIT);
+    TEST_ASSERT_EQ(flash_sector_of(FLASH_MEM_BASE + FLASH_MEM_SIZE - 1u), FLASH_SECTOR_COUNT - 1u);
+    TEST_ASSERT_EQ(flash_sector_of(FLASH_MEM_BASE + FLASH_MEM_SIZE), FLASH_SECTOR_COUNT);
+    TEST_ASSERT_EQ(flash_sector_of(FLASH_MEM_BASE - 1u), FLASH_SECTOR_COUNT);
+#if defined(STM32F7)
+    TEST_ASSERT_EQ(flash_sector_size(7u), 0x40000u);
+#else
+    TEST_ASSERT_EQ(flash_sector_size(11u), 0x20000u);
+#endif
+
+    for (n = 0; n < FLASH_SECTOR_COUNT; n++) {
+        TEST_ASSERT_EQ(flash_sector_of(flash_sector_base(n)), n);
+        TEST_ASSERT_EQ(flash_sector_of(flash_sector_base(n) + flash_sector_size(n) - 1u), n);
+    }
+    TEST_ASSERT_EQ(flash_sector_base(FLASH_SECTOR_COUNT - 1u) +
+                   flash_sector_size(FLASH_SECTOR_COUNT - 1u), FLASH_MEM_BASE + FLASH_MEM_SIZE);
+}
+
+static void test_program(void)
+{
+    const uint32_t addr = flash_sector_base(1u) + 16u;
+    static const uint8_t ones[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t zeros[4] = { 0 };
+    uint8_t expect[4];
+
+    setup(false);
+    TEST_ASSERT(erased(addr, 64u));
+    TEST_ASSERT_EQ(flash_program(addr, pattern, 64u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr), pattern, 64u);
+    TEST_ASSERT(erased(addr + 64u, 64u));
+    TEST_ASSERT(REG_TEST_BITS(FLASH->CR, FLASH_CR_LOCK));
+    TEST_ASSERT_EQ(REG_FIELD_READ(FLASH->CR, FLASH_CR_PSIZE), 0u);
+
+    /* Bits only clear: ones over data leave it, and fail verification. */
+    TEST_ASSERT_EQ(flash_program(addr, ones, 4u), DRV_ERR_HW);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr), pattern, 4u);
+    TEST_ASSERT_EQ(flash_program(addr, zeros, 4u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr), zeros, 4u);
+    memcpy(expect, &pattern[4], 4u);
+    expect[0] &= 0x0Fu;
+    TEST_ASSERT_EQ(flash_program(addr + 4u, expect, 4u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr + 4u), expect, 4u);
+
+    TEST_ASSERT_EQ(flash_program(addr + 2u, pattern, 4u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_program(addr, pattern, 6u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_program(FLASH_MEM_BASE + FLASH_MEM_SIZE - 4u, pattern, 8u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_program(FLASH_MEM_BASE + FLASH_MEM_SIZE - 4u, pattern, 4u), DRV_OK);
+}
+
+static void test_unaligned_source(void)
+{
+    const uint32_t addr = flash_sector_base(2u);
+
+    setup(false);
+    TEST_ASSERT_EQ(flash_program(addr, &pattern[1], 200u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr), &pattern[1], 200u);
+}
+
+static void test_x64(void)
+{
+    const uint32_t addr = flash_sector_base(3u);
+
+    setup(true);
+    TEST_ASSERT_EQ(flash_program(addr, pattern, 40u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr), pattern, 40u);
+    TEST_ASSERT_EQ(flash_program(addr + 44u, pattern, 8u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_program(addr + 40u, pattern, 4u), DRV_ERR_PARAM);
+
+    /* A lone word in x64 mode is not a double word: nothing is stored. */
+    REG_WRITE(FLASH->KEYR, FLASH_KEY1);
+    REG_WRITE(FLASH->KEYR, FLASH_KEY2);
+    REG_WRITE(FLASH->CR, FLASH_CR_PG | reg_field_prep(FLASH_CR_PSIZE, FLASH_PSIZE_X64));
+    REG_WRITE(FLASHMEM->W[(addr - FLASH_MEM_BASE) / 4u + 11u], 0u);
+    TEST_ASSERT(REG_TEST_BITS(FLASH->SR, FLASH_SR_PGAERR));
+    TEST_ASSERT(erased(addr + 40u, 8u));
+}
+
+static void test_erase(void)
+{
+    const uint32_t a = flash_sector_base(3u) + flash_sector_size(3u) - 8u;
+    const uint32_t b = flash_sector_base(4u);
+
+    setup(false);
+    TEST_ASSERT_EQ(flash_program(flash_sector_base(2u), pattern, 8u), DRV_OK);
+    TEST_ASSERT_EQ(flash_program(a, pattern, 8u), DRV_OK);
+    TEST_ASSERT_EQ(flash_program(b, pattern, 8u), DRV_OK);
+    TEST_ASSERT_EQ(flash_program(flash_sector_base(5u), pattern, 8u), DRV_OK);
+
+    /* [a, b + 1) touches sectors 3 and 4 only. */
+    TEST_ASSERT_EQ(flash_erase(a, 9u), DRV_OK);
+    TEST_ASSERT(erased(flash_sector_base(3u), flash_sector_size(3u)));
+    TEST_ASSERT(erased(b, flash_sector_size(4u)));
+    TEST_ASSERT_MEM_EQ(flash_ptr(flash_sector_base(2u)), pattern, 8u);
+    TEST_ASSERT_MEM_EQ(flash_ptr(flash_sector_base(5u)), pattern, 8u);
+    TEST_ASSERT(REG_TEST_BITS(FLASH->CR, FLASH_CR_LOCK));
+
+    TEST_ASSERT_EQ(flash_erase_sector(FLASH_SECTOR_COUNT), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_erase(FLASH_MEM_BASE + FLASH_MEM_SIZE, 1u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_erase(b, 0u), DRV_OK);
+}
+
+static void test_caches(void)
+{
+#if defined(STM32F7)
+    const uint32_t on = FLASH_ACR_ARTEN | FLASH_ACR_PRFTEN;
+#else
+    const uint32_t on = FLASH_ACR_ICEN | FLASH_ACR_DCEN | FLASH_ACR_PRFTEN;
+#endif
+
+    setup(false);
+    REG_WRITE(FLASH->ACR, on | 5u);
+    TEST_ASSERT_EQ(flash_erase_sector(0u), DRV_OK);
+    TEST_ASSERT_EQ(REG_READ(FLASH->ACR), on | 5u);
+}
+
+static void test_locked_out(void)
+{
+    setup(false);
+    /* A wrong key locks CR until reset. */
+    REG_WRITE(FLASH->KEYR, 0x12345678u);
+    TEST_ASSERT_EQ(flash_program(FLASH_MEM_BASE, pattern, 4u), DRV_ERR_HW);
+    TEST_ASSERT(erased(FLASH_MEM_BASE, 4u));
+
+    /* Stores without PG change nothing and flag a sequence error. */
+    sim_reset();
+    REG_WRITE(FLASHMEM->W[0], 0u);
+    TEST_ASSERT(erased(FLASH_MEM_BASE, 4u));
+    TEST_ASSERT(REG_TEST_BITS(FLASH->SR, FLASH_SR_ERRORS));
+    TEST_ASSERT_EQ(flash_program(FLASH_MEM_BASE, pattern, 4u), DRV_OK);
+}
+
+static void test_writer(void)
+{
+    static const size_t pieces[] = { 3u, 5u, 1u, 20u, 7u, 0u, 13u };
+    const uint32_t addr = flash_sector_base(6u);
+    flash_writer_t w;
+    size_t off = 0;
+    size_t i;
+
+    setup(false);
+    TEST_ASSERT_EQ(flash_writer_open(&w, addr + 2u, 64u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_writer_open(&w, addr, 64u), DRV_OK);
+    for (i = 0; i < STM32_ARRAY_SIZE(pieces); i++) {
+        TEST_ASSERT_EQ(flash_writer_write(&w, &pattern[off], pieces[i]), DRV_OK);
+        off += pieces[i];
+        /* Whole units are programmed, the partial one waits. */
+        TEST_ASSERT_MEM_EQ(flash_ptr(addr), pattern, off & ~(size_t)3u);
+        TEST_ASSERT(erased(addr + (uint32_t)(off & ~(size_t)3u), 4u));
+    }
+    TEST_ASSERT_EQ(off, 49u);
+    TEST_ASSERT_EQ(flash_writer_write(&w, pattern, 16u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(flash_writer_write(&w, &pattern[off], 15u), DRV_OK);
+    TEST_ASSERT_EQ(flash_writer_close(&w), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr), pattern, 64u);
+    TEST_ASSERT(erased(addr + 64u, 64u));
+
+    /* Close pads the last unit with erased bytes. */
+    TEST_ASSERT_EQ(flash_writer_open(&w, addr + 64u, 64u), DRV_OK);
+    TEST_ASSERT_EQ(flash_writer_write(&w, pattern, 5u), DRV_OK);
+    TEST_ASSERT_EQ(flash_writer_close(&w), DRV_OK);
+    TEST_ASSERT_MEM_EQ(flash_ptr(addr + 64u), pattern, 5u);
+    TEST_ASSERT(erased(addr + 69u, 3u));
+    TEST_ASSERT_EQ(w.addr, addr + 72u);
+    TEST_ASSERT_EQ(flash_writer_close(&w), DRV_OK);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_sectors);
+    TEST_RUN(test_program);
+    TEST_RUN(test_unaligned_source);
+    TEST_RUN(test_x64);
+    TEST_RUN(test_erase);
+    TEST_RUN(test_caches);
+    TEST_RUN(test_locked_out);
+    TEST_RUN(test_writer);
+    return TEST_RESULT();
+}
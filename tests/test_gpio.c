@@ -0,0 +1,97 @@
+/**
+ * @file    test_gpio.c
+ * @brief   GPIO driver tests: single-store port operations, groups, config.
+ */
+#include "gpio.h"
+#include "sim.h"
+#include "test.h"
+
+static void test_configure(void)
+{
+    const gpio_config_t af = {
+        .mode = GPIO_MODE_AF, .otype = GPIO_OTYPE_OPENDRAIN,
+        .speed = GPIO_SPEED_VERY_HIGH, .pull = GPIO_PULL_UP, .af = 7,
+    };
+    const gpio_config_t bad = { .mode = 4 };
+
+    sim_reset();
+    REG_WRITE(GPIOC->MODER, 0xFFFFFFFFu);
+    TEST_ASSERT_EQ(gpio_configure(GPIOC, GPIO_PIN(2) | GPIO_PIN(9), &af), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_GPIOEN(2)));
+    TEST_ASSERT_EQ(REG_READ(GPIOC->MODER), 0xFFFFFFFFu & ~(1u << 4) & ~(1u << 18));
+    TEST_ASSERT_EQ(REG_READ(GPIOC->OTYPER), GPIO_PIN(2) | GPIO_PIN(9));
+    TEST_ASSERT_EQ(REG_READ(GPIOC->OSPEEDR), (3u << 4) | (3u << 18));
+    TEST_ASSERT_EQ(REG_READ(GPIOC->PUPDR), (1u << 4) | (1u << 18));
+    TEST_ASSERT_EQ(REG_READ(GPIOC->AFR[0]), 7u << 8);
+    TEST_ASSERT_EQ(REG_READ(GPIOC->AFR[1]), 7u << 4);
+
+    TEST_ASSERT_EQ(gpio_configure(GPIOC, GPIO_PIN(0), &bad), DRV_ERR_PARAM);
+}
+
+static void test_single_store(void)
+{
+    sim_reset();
+    REG_WRITE(GPIOD->ODR, 0x00F0u);
+
+    sim_stats = (sim_stats_t){ 0 };
+    gpio_set(GPIOD, GPIO_PIN(0) | GPIO_PIN(1));
+    gpio_clear(GPIOD, GPIO_PIN(4));
+    gpio_write_masked(GPIOD, 0xFF00u, 0xA5A5u);
+    /* Three operations, three stores, no reads. */
+    TEST_ASSERT_EQ(sim_stats.writes, 3u);
+    TEST_ASSERT_EQ(sim_stats.reads, 0u);
+    TEST_ASSERT_EQ(REG_READ(GPIOD->ODR), 0xA5E3u);
+
+    sim_stats = (sim_stats_t){ 0 };
+    gpio_toggle(GPIOD, 0x0F0Fu);
+    TEST_ASSERT_EQ(sim_stats.writes, 1u);
+    TEST_ASSERT_EQ(sim_stats.reads, 1u);
+    TEST_ASSERT_EQ(REG_READ(GPIOD->ODR), 0xAAECu);
+
+    gpio_pin_write(GPIOD, 15, false);
+    gpio_pin_write(GPIOD, 0, true);
+    TEST_ASSERT_EQ(REG_READ(GPIOD->ODR), 0x2AEDu);
+}
+
+static void test_inputs(void)
+{
+    sim_reset();
+    sim_gpio_set_input(GPIOE, 0xFFFFu, 0x1234u);
+    TEST_ASSERT_EQ(gpio_read(GPIOE), 0x1234u);
+    TEST_ASSERT(gpio_pin_read(GPIOE, 2));
+    TEST_ASSERT(!gpio_pin_read(GPIOE, 3));
+}
+
+static void test_group(void)
+{
+    const gpio_config_t out = { .mode = GPIO_MODE_OUTPUT };
+    gpio_group_t bus;
+
+    sim_reset();
+    TEST_ASSERT_EQ(gpio_group_init(&bus, GPIOB, 4, 8), DRV_OK);
+    TEST_ASSERT_EQ(bus.mask, 0x0FF0u);
+    TEST_ASSERT_EQ(gpio_configure(GPIOB, bus.mask, &out), DRV_OK);
+
+    REG_WRITE(GPIOB->ODR, 0xF00Fu);
+    sim_stats = (sim_stats_t){ 0 };
+    gpio_group_write(&bus, 0x3C);
+    TEST_ASSERT_EQ(sim_stats.writes, 1u);
+    /* Pins outside the group keep their level. */
+    TEST_ASSERT_EQ(REG_READ(GPIOB->ODR), 0xF3CFu);
+    /* Output pins read back their driven level. */
+    TEST_ASSERT_EQ(gpio_group_read(&bus), 0x3Cu);
+    /* Values wider than the group are truncated to it. */
+    gpio_group_write(&bus, 0x1FF);
+    TEST_ASSERT_EQ(REG_READ(GPIOB->ODR), 0xFFFFu);
+
+    TEST_ASSERT_EQ(gpio_group_init(&bus, GPIOB, 12, 5), DRV_ERR_PARAM);
+}
+
+int main(void)
+{
+    TEST_RUN(test_configure);
+    TEST_RUN(test_single_store);
+    TEST_RUN(test_inputs);
+    TEST_RUN(test_group);
+    return TEST_RESULT();
+}
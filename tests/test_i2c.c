@@ -0,0 +1,434 @@
+/**
+ * @file    test_i2c.c
+ * @brief   I2C driver tests: EEPROM and sensor targets, queueing, NACK,
+ *          bus errors and stuck-bus recovery.
+ */
+#include "i2c.h"
+#include "sim.h"
+#include "test.h"
+
+#define EEPROM_ADDR     0x50u
+#define SENSOR_ADDR     0x48u
+#define EEPROM_SIZE     1024u
+#define EEPROM_PAGE     64u
+#define EEPROM_BUSY     3u      /* Address attempts NACKed after a write. */
+
+#define SCL_PIN         6u
+#define SDA_PIN         7u
+
+/* 24Cxx-style EEPROM: 16-bit address, page write, busy while programming. */
+typedef struct {
+    uint8_t mem[EEPROM_SIZE];
+    uint16_t ptr;
+    uint8_t addr_bytes;     /* Address bytes seen in this write. */
+    uint8_t page[EEPROM_PAGE];
+    uint8_t npage;
+    uint16_t page_base;
+    uint32_t busy;
+    uint32_t cycles;        /* Write cycles completed. */
+} eeprom_t;
+
+static bool eeprom_start(void *ctx, bool read)
+{
+    eeprom_t *e = ctx;
+
+    if (e->busy != 0u) {
+        e->busy--;
+        return false;
+    }
+    if (!read) {
+        e->addr_bytes = 0;
+        e->npage = 0;
+    }
+    return true;
+}
+
+static bool eeprom_write(void *ctx, uint8_t byte)
+{
+    eeprom_t *e = ctx;
+
+    if (e->addr_bytes < 2u) {
+        e->ptr = (uint16_t)(((e->ptr << 8) | byte) % EEPROM_SIZE);
+        if (++e->addr_bytes == 2u) {
+            e->page_base = e->ptr;
+        }
+        return true;
+    }
+    /* Latched into the page buffer; the address wraps within the page. */
+    e->page[e->npage % EEPROM_PAGE] = byte;
+    e->npage++;
+    return true;
+}
+
+static uint8_t eeprom_read(void *ctx)
+{
+    eeprom_t *e = ctx;
+    uint8_t v = e->mem[e->ptr];
+
+    e->ptr = (uint16_t)((e->ptr + 1u) % EEPROM_SIZE);
+    return v;
+}
+
+static void eeprom_stop(void *ctx)
+{
+    eeprom_t *e = ctx;
+    uint32_t n;
+
+    if (e->npage == 0u) {
+        return;
+    }
+    for (n = 0; n < e->npage && n < EEPROM_PAGE; n++) {
+        uint16_t a = (uint16_t)((e->page_base & ~(EEPROM_PAGE - 1u)) |
+                                ((e->page_base + n) & (EEPROM_PAGE - 1u)));
+
+        e->mem[a] = e->page[n];
+    }
+    e->npage = 0;
+    e->busy = EEPROM_BUSY;
+    e->cycles++;
+}
+
+static const sim_i2c_target_t eeprom_ops = {
+    eeprom_start, eeprom_write, eeprom_read, eeprom_stop,
+};
+
+/* Register-pointer sensor: first written byte selects the register. */
+typedef struct {
+    uint8_t regs[16];
+    uint8_t ptr;
+    bool have_ptr;
+} sensor_t;
+
+static bool sensor_start(void *ctx, bool read)
+{
+    sensor_t *s = ctx;
+
+    if (!read) {
+        s->have_ptr = false;
+    }
+    return true;
+}
+
+static bool sensor_write(void *ctx, uint8_t byte)
+{
+    sensor_t *s = ctx;
+
+    if (!s->have_ptr) {
+        s->ptr = byte & 0x0Fu;
+        s->have_ptr = true;
+        return true;
+    }
+    s->regs[s->ptr] = byte;
+    s->ptr = (s->ptr + 1u) & 0x0Fu;
+    return true;
+}
+
+static uint8_t sensor_read(void *ctx)
+{
+    sensor_t *s = ctx;
+    uint8_t v = s->regs[s->ptr];
+
+    s->ptr = (s->ptr + 1u) & 0x0Fu;
+    return v;
+}
+
+static const sim_i2c_target_t sensor_ops = { sensor_start, sensor_write, sensor_read, NULL };
+
+static eeprom_t eeprom;
+static sensor_t sensor;
+
+static uint32_t ndone;
+static uint32_t done_tag[16];
+static drv_status_t done_status[16];
+
+static void done(void *ctx, i2c_xfer_t *x, drv_status_t status)
+{
+    (void)x;
+    if (ndone < STM32_ARRAY_SIZE(done_tag)) {
+        done_tag[ndone] = (uint32_t)(uintptr_t)ctx;
+        done_status[ndone++] = status;
+    }
+}
+
+static void service(i2c_bus_t *bus)
+{
+    bool again = true;
+
+    while (again) {
+        again = false;
+        if (sim_irq_take(I2C1_EV_IRQn)) {
+            i2c_ev_irq(bus);
+            again = true;
+        }
+        if (sim_irq_take(I2C1_ER_IRQn)) {
+            i2c_er_irq(bus);
+            again = true;
+        }
+        if (sim_irq_take(bus->rx->irqn)) {
+            dma_irq(bus->rx->dma, bus->rx->stream);
+            again = true;
+        }
+        if (sim_irq_take(bus->tx->irqn)) {
+            dma_irq(bus->tx->dma, bus->tx->stream);
+            again = true;
+        }
+    }
+}
+
+static void setup(i2c_bus_t *bus, uint32_t hz)
+{
+    const i2c_config_t cfg = {
+        .speed_hz = hz,
+        .scl_port = GPIOB, .scl_pin = SCL_PIN,
+        .sda_port = GPIOB, .sda_pin = SDA_PIN,
+    };
+    uint32_t i;
+
+    sim_reset();
+    memset(&eeprom, 0, sizeof(eeprom));
+    memset(&sensor, 0, sizeof(sensor));
+    for (i = 0; i < EEPROM_SIZE; i++) {
+        eeprom.mem[i] = (uint8_t)(i * 7u);
+    }
+    for (i = 0; i < STM32_ARRAY_SIZE(sensor.regs); i++) {
+        sensor.regs[i] = (uint8_t)(0xA0u + i);
+    }
+    sim_i2c_attach(I2C1, EEPROM_ADDR, &eeprom_ops, &eeprom);
+    sim_i2c_attach(I2C1, SENSOR_ADDR, &sensor_ops, &sensor);
+    sim_i2c_wire(I2C1, GPIOB, SCL_PIN, GPIOB, SDA_PIN);
+    ndone = 0;
+    TEST_ASSERT_EQ(i2c_init(bus, I2C1, &cfg), DRV_OK);
+}
+
+/* Submit @p x and run the bus until its queue drains. */
+static drv_status_t run(i2c_bus_t *bus, i2c_xfer_t *x)
+{
+    uint32_t before = ndone;
+
+    x->cb = done;
+    TEST_ASSERT_EQ(i2c_submit(bus, x), DRV_OK);
+    service(bus);
+    TEST_ASSERT(!i2c_busy(bus));
+    TEST_ASSERT_EQ(ndone, before + 1u);
+    return done_status[before];
+}
+
+static void test_init(void)
+{
+    i2c_bus_t bus;
+    const i2c_config_t bad = {
+        .speed_hz = 1000000u, .scl_port = GPIOB, .scl_pin = 6, .sda_port = GPIOB, .sda_pin = 7,
+    };
+
+    /* HSI: PCLK1 = 16 MHz. */
+    setup(&bus, I2C_STANDARD_HZ);
+    TEST_ASSERT_EQ(REG_FIELD_READ(I2C1->CR2, I2C_CR2_FREQ), 16u);
+    TEST_ASSERT_EQ(REG_READ(I2C1->CCR), 80u);
+    TEST_ASSERT_EQ(REG_READ(I2C1->TRISE), 17u);
+    TEST_ASSERT(REG_TEST_BITS(I2C1->CR1, I2C_CR1_PE));
+    TEST_ASSERT(REG_TEST_BITS(RCC->APB1ENR, RCC_APB1ENR_I2C1EN));
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(GPIOB->MODER), GPIO_MODER_MODE(SCL_PIN)), GPIO_MODE_AF);
+    TEST_ASSERT_EQ(REG_READ(GPIOB->OTYPER) & 0xC0u, 0xC0u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(GPIOB->AFR[0]), GPIO_AFR_AF(SDA_PIN)), I2C_GPIO_AF);
+    i2c_deinit(&bus);
+
+    setup(&bus, I2C_FAST_HZ);
+    /* 16 MHz / (3 * 400 kHz) = 13.3, rounded up so SCL stays <= 400 kHz. */
+    TEST_ASSERT_EQ(REG_READ(I2C1->CCR), I2C_CCR_FS | 14u);
+    TEST_ASSERT_EQ(REG_READ(I2C1->TRISE), 5u);
+    i2c_deinit(&bus);
+
+    TEST_ASSERT_EQ(i2c_init(&bus, I2C1, &bad), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(i2c_init(&bus, (i2c_regs_t *)&eeprom, &bad), DRV_ERR_PARAM);
+}
+
+static void test_eeprom(void)
+{
+    static uint8_t wr[EEPROM_PAGE];
+    static uint8_t rd[80];
+    i2c_bus_t bus;
+    i2c_xfer_t w = { .addr = EEPROM_ADDR, .reg_len = 2, .reg = 0x0140u,
+                     .tx = wr, .tx_len = sizeof(wr) };
+    i2c_xfer_t r = { .addr = EEPROM_ADDR, .reg_len = 2, .reg = 0x0130u,
+                     .rx = rd, .rx_len = sizeof(rd) };
+    i2c_xfer_t probe = { .addr = EEPROM_ADDR };
+    uint32_t polls = 0;
+    uint32_t i;
+
+    setup(&bus, I2C_FAST_HZ);
+    for (i = 0; i < sizeof(wr); i++) {
+        wr[i] = (uint8_t)(0x80u + i);
+    }
+    TEST_ASSERT_EQ(run(&bus, &w), DRV_OK);
+    TEST_ASSERT_EQ(eeprom.cycles, 1u);
+    TEST_ASSERT_MEM_EQ(&eeprom.mem[0x140], wr, sizeof(wr));
+
+    /* Programming: the part NACKs its address until it is done. */
+    while (run(&bus, &probe) == DRV_ERR_NACK) {
+        polls++;
+    }
+    TEST_ASSERT_EQ(polls, EEPROM_BUSY);
+
+    /* Random read across the page boundary: register write, repeated
+     * START, 80 bytes by DMA, the last one NACKed. */
+    TEST_ASSERT_EQ(run(&bus, &r), DRV_OK);
+    for (i = 0; i < sizeof(rd); i++) {
+        uint32_t a = 0x130u + i;
+        uint8_t want = (a >= 0x140u && a < 0x180u) ? wr[a - 0x140u] : (uint8_t)(a * 7u);
+
+        TEST_ASSERT_EQ(rd[i], want);
+    }
+    /* Exactly rx_len bytes were clocked out of the part. */
+    TEST_ASSERT_EQ(eeprom.ptr, 0x130u + sizeof(rd));
+    TEST_ASSERT(!REG_TEST_BITS(I2C1->SR2, I2C_SR2_BUSY));
+    i2c_deinit(&bus);
+}
+
+static void test_sensor(void)
+{
+    i2c_bus_t bus;
+    uint8_t one = 0;
+    uint8_t two[2] = { 0 };
+    const uint8_t cfg[3] = { 0x11, 0x22, 0x33 };
+    i2c_xfer_t r1 = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x05, .rx = &one, .rx_len = 1 };
+    i2c_xfer_t r2 = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x0E, .rx = two, .rx_len = 2 };
+    i2c_xfer_t w = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x02, .tx = cfg, .tx_len = 3 };
+    i2c_xfer_t cmd = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x09 };
+    i2c_xfer_t cont = { .addr = SENSOR_ADDR, .rx = two, .rx_len = 2 };
+
+    setup(&bus, I2C_STANDARD_HZ);
+    /* Single byte: NACK + STOP set around ADDR, read from RXNE. */
+    TEST_ASSERT_EQ(run(&bus, &r1), DRV_OK);
+    TEST_ASSERT_EQ(one, 0xA5u);
+    TEST_ASSERT_EQ(sensor.ptr, 6u);
+
+    TEST_ASSERT_EQ(run(&bus, &r2), DRV_OK);
+    TEST_ASSERT_EQ(two[0], 0xAEu);
+    TEST_ASSERT_EQ(two[1], 0xAFu);
+
+    TEST_ASSERT_EQ(run(&bus, &w), DRV_OK);
+    TEST_ASSERT_MEM_EQ(&sensor.regs[2], cfg, sizeof(cfg));
+
+    /* Register pointer only, then a plain read (no repeated START). */
+    TEST_ASSERT_EQ(run(&bus, &cmd), DRV_OK);
+    TEST_ASSERT_EQ(run(&bus, &cont), DRV_OK);
+    TEST_ASSERT_EQ(two[0], 0xA9u);
+    TEST_ASSERT_EQ(two[1], 0xAAu);
+    i2c_deinit(&bus);
+}
+
+static void test_queue(void)
+{
+    i2c_bus_t bus;
+    uint8_t a[4];
+    uint8_t b[3];
+    uint8_t c = 0;
+    i2c_xfer_t xa = { .addr = EEPROM_ADDR, .reg_len = 2, .reg = 0x10, .rx = a, .rx_len = 4,
+                      .cb = done, .ctx = (void *)1 };
+    i2c_xfer_t xn = { .addr = 0x33, .reg_len = 1, .reg = 0, .cb = done, .ctx = (void *)2 };
+    i2c_xfer_t xb = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x00, .rx = b, .rx_len = 3,
+                      .cb = done, .ctx = (void *)3 };
+    i2c_xfer_t xc = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x0F, .rx = &c, .rx_len = 1,
+                      .cb = done, .ctx = (void *)4 };
+    uint32_t i;
+
+    setup(&bus, I2C_FAST_HZ);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &xa), DRV_OK);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &xn), DRV_OK);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &xb), DRV_OK);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &xc), DRV_OK);
+    TEST_ASSERT(i2c_busy(&bus));
+    service(&bus);
+    TEST_ASSERT(!i2c_busy(&bus));
+
+    /* In order; the absent device fails alone. */
+    TEST_ASSERT_EQ(ndone, 4u);
+    for (i = 0; i < 4u; i++) {
+        TEST_ASSERT_EQ(done_tag[i], i + 1u);
+    }
+    TEST_ASSERT_EQ(done_status[0], DRV_OK);
+    TEST_ASSERT_EQ(done_status[1], DRV_ERR_NACK);
+    TEST_ASSERT_EQ(done_status[2], DRV_OK);
+    TEST_ASSERT_EQ(done_status[3], DRV_OK);
+    for (i = 0; i < 4u; i++) {
+        TEST_ASSERT_EQ(a[i], (uint8_t)((0x10u + i) * 7u));
+    }
+    TEST_ASSERT_EQ(b[0], 0xA0u);
+    TEST_ASSERT_EQ(b[2], 0xA2u);
+    TEST_ASSERT_EQ(c, 0xAFu);
+
+    TEST_ASSERT_EQ(i2c_submit(&bus, &(i2c_xfer_t){ .addr = 0x80 }), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &(i2c_xfer_t){ .addr = 0x10, .reg_len = 5 }),
+                   DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &(i2c_xfer_t){ .addr = 0x10, .rx_len = 1 }),
+                   DRV_ERR_PARAM);
+    i2c_deinit(&bus);
+}
+
+static void test_stuck_bus(void)
+{
+    i2c_bus_t bus;
+    uint8_t v = 0;
+    i2c_xfer_t r = { .addr = SENSOR_ADDR, .reg_len = 1, .reg = 0x03, .rx = &v, .rx_len = 1 };
+
+    setup(&bus, I2C_STANDARD_HZ);
+    /* A target reset mid-read keeps SDA low for five more clocks. */
+    sim_i2c_stuck(I2C1, 5);
+    TEST_ASSERT(REG_TEST_BITS(I2C1->SR2, I2C_SR2_BUSY));
+    TEST_ASSERT_EQ(run(&bus, &r), DRV_OK);
+    TEST_ASSERT_EQ(v, 0xA3u);
+    TEST_ASSERT_EQ(bus.recoveries, 1u);
+    /* Five clocks to free SDA, one more for the STOP. */
+    TEST_ASSERT_EQ(sim_i2c_scl_pulses(I2C1), 6u);
+    /* Pins are back on the peripheral. */
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(GPIOB->MODER), GPIO_MODER_MODE(SCL_PIN)), GPIO_MODE_AF);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(GPIOB->MODER), GPIO_MODER_MODE(SDA_PIN)), GPIO_MODE_AF);
+
+    /* Shorted to ground: nine clocks, then the transaction fails. */
+    sim_i2c_stuck(I2C1, 1000);
+    TEST_ASSERT_EQ(run(&bus, &r), DRV_ERR_HW);
+    TEST_ASSERT_EQ(sim_i2c_scl_pulses(I2C1), 6u + I2C_RECOVERY_CLOCKS + 1u);
+    TEST_ASSERT_EQ(bus.recoveries, 2u);
+
+    /* Released later: the interface still reports BUSY (no STOP seen), so
+     * the next transaction recovers once more and then goes through. */
+    sim_i2c_stuck(I2C1, 0);
+    TEST_ASSERT_EQ(run(&bus, &r), DRV_OK);
+    TEST_ASSERT_EQ(bus.recoveries, 3u);
+    i2c_deinit(&bus);
+}
+
+static void test_bus_error(void)
+{
+    static uint8_t rd[16];
+    i2c_bus_t bus;
+    i2c_xfer_t r = { .addr = EEPROM_ADDR, .reg_len = 2, .reg = 0, .rx = rd, .rx_len = 16 };
+    i2c_xfer_t again = r;
+
+    setup(&bus, I2C_FAST_HZ);
+    r.cb = done;
+    again.cb = done;
+    TEST_ASSERT_EQ(i2c_submit(&bus, &r), DRV_OK);
+    TEST_ASSERT_EQ(i2c_submit(&bus, &again), DRV_OK);
+    /* Misplaced START/STOP seen while the first one is addressing. */
+    sim_i2c_fault(I2C1, I2C_SR1_BERR);
+    service(&bus);
+    TEST_ASSERT_EQ(ndone, 2u);
+    TEST_ASSERT_EQ(done_status[0], DRV_ERR_HW);
+    TEST_ASSERT_EQ(done_status[1], DRV_OK);
+    TEST_ASSERT_EQ(bus.recoveries, 1u);
+    TEST_ASSERT_EQ(rd[15], (uint8_t)(15u * 7u));
+    TEST_ASSERT_EQ(REG_READ(I2C1->SR1) & I2C_SR1_ERRORS, 0u);
+    i2c_deinit(&bus);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_eeprom);
+    TEST_RUN(test_sensor);
+    TEST_RUN(test_queue);
+    TEST_RUN(test_stuck_bus);
+    TEST_RUN(test_bus_error);
+    return TEST_RESULT();
+}
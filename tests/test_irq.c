@@ -0,0 +1,241 @@
+/**
+ * @file    test_irq.c
+ * @brief   RAM vector table, handler registration, priority and preemption
+ *          tests against the NVIC model.
+ */
+#include "irq.h"
+#include "sim.h"
+#include "test.h"
+
+static irq_handler_t boot[IRQ_VECTORS];
+
+static char trace[32];
+static size_t ntrace;
+
+static void mark(char c)
+{
+    if (ntrace < sizeof(trace) - 1u) {
+        trace[ntrace++] = c;
+        trace[ntrace] = '\0';
+    }
+}
+
+static void setup(uint32_t preempt_bits)
+{
+    sim_reset();
+    ntrace = 0;
+    trace[0] = '\0';
+    TEST_ASSERT_EQ(irq_init(NULL, preempt_bits), DRV_OK);
+}
+
+static void boot_handler(void)
+{
+    mark('b');
+}
+
+static uint32_t hits;
+
+static void count(void)
+{
+    TEST_ASSERT(irq_active(EXTI0_IRQn));
+    hits++;
+}
+
+static void test_init(void)
+{
+    const irq_handler_t *t;
+
+    sim_reset();
+    boot[16 + DMA2_Stream0_IRQn] = boot_handler;
+    TEST_ASSERT_EQ(irq_init(boot, 2), DRV_OK);
+    t = irq_vector_table();
+    TEST_ASSERT(REG_PTR(REG_READ(SCB->VTOR)) == (const void *)t);
+    TEST_ASSERT(t[16 + DMA2_Stream0_IRQn] == boot_handler);
+    TEST_ASSERT_EQ(irq_grouping(), 2u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(SCB->AIRCR, SCB_AIRCR_PRIGROUP), 5u);
+
+    /* Re-initialising from the active table keeps the entries. */
+    TEST_ASSERT_EQ(irq_init(NULL, 4), DRV_OK);
+    TEST_ASSERT(t[16 + DMA2_Stream0_IRQn] == boot_handler);
+    TEST_ASSERT_EQ(irq_grouping(), 4u);
+    TEST_ASSERT_EQ(irq_init(NULL, 5), DRV_ERR_PARAM);
+
+    /* Without a boot table every entry is the default handler. */
+    sim_reset();
+    TEST_ASSERT_EQ(irq_init(NULL, 2), DRV_OK);
+    TEST_ASSERT(t[16 + DMA2_Stream0_IRQn] == irq_unhandled);
+    TEST_ASSERT(t[16 + SysTick_IRQn] == irq_unhandled);
+
+    /* AIRCR ignores writes without the key. */
+    REG_WRITE(SCB->AIRCR, reg_field_prep(SCB_AIRCR_PRIGROUP, 7u));
+    TEST_ASSERT_EQ(irq_grouping(), 2u);
+}
+
+static void test_dispatch(void)
+{
+    setup(2);
+    hits = 0;
+    TEST_ASSERT(irq_set_handler(EXTI0_IRQn, count) == irq_unhandled);
+    TEST_ASSERT(irq_vector_table()[16 + EXTI0_IRQn] == count);
+
+    /* Disabled: pends, does not run. */
+    irq_trigger(EXTI0_IRQn);
+    TEST_ASSERT_EQ(hits, 0u);
+    TEST_ASSERT(irq_pending(EXTI0_IRQn));
+    TEST_ASSERT(REG_TEST_BITS(NVIC->ISPR[0], 1u << EXTI0_IRQn));
+
+    /* Enabling takes the pending line straight away. */
+    irq_enable(EXTI0_IRQn);
+    TEST_ASSERT(irq_enabled(EXTI0_IRQn));
+    TEST_ASSERT_EQ(hits, 1u);
+    TEST_ASSERT(!irq_pending(EXTI0_IRQn));
+    TEST_ASSERT(!irq_active(EXTI0_IRQn));
+
+    irq_trigger(EXTI0_IRQn);
+    irq_set_pending(EXTI0_IRQn);
+    TEST_ASSERT_EQ(hits, 3u);
+
+    /* A model raising the line goes through the table too. */
+    sim_irq_raise(EXTI0_IRQn);
+    TEST_ASSERT_EQ(hits, 4u);
+
+    irq_disable(EXTI0_IRQn);
+    TEST_ASSERT(!irq_enabled(EXTI0_IRQn));
+    irq_trigger(EXTI0_IRQn);
+    TEST_ASSERT_EQ(hits, 4u);
+    irq_clear_pending(EXTI0_IRQn);
+    TEST_ASSERT(!irq_pending(EXTI0_IRQn));
+
+    TEST_ASSERT(irq_set_handler((irqn_t)STM32_IRQ_COUNT, count) == NULL);
+    TEST_ASSERT(irq_set_handler(EXTI0_IRQn, irq_unhandled) == count);
+}
+
+static void test_priority(void)
+{
+    setup(2);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 1, 2), DRV_OK);
+    TEST_ASSERT_EQ(irq_priority(USART1_IRQn), 0x60u);
+    TEST_ASSERT_EQ((REG_READ(NVIC->IPR[USART1_IRQn / 4]) >> (8 * (USART1_IRQn % 4))) & 0xFFu,
+                   0x60u);
+    TEST_ASSERT_EQ(irq_set_priority(USART2_IRQn, 3, 3), DRV_OK);
+    TEST_ASSERT_EQ(irq_priority(USART1_IRQn), 0x60u);
+    TEST_ASSERT_EQ(irq_priority(USART2_IRQn), 0xF0u);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 4, 0), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 0, 4), DRV_ERR_PARAM);
+
+    /* System handlers live in SHPR: SysTick is the top byte of SHPR3. */
+    TEST_ASSERT_EQ(irq_set_priority(SysTick_IRQn, 3, 3), DRV_OK);
+    TEST_ASSERT_EQ(REG_READ(SCB->SHPR[2]) >> 24, 0xF0u);
+    TEST_ASSERT_EQ(irq_set_priority(PendSV_IRQn, 3, 2), DRV_OK);
+    TEST_ASSERT_EQ((REG_READ(SCB->SHPR[2]) >> 16) & 0xFFu, 0xE0u);
+    TEST_ASSERT_EQ(irq_priority(SysTick_IRQn), 0xF0u);
+    TEST_ASSERT_EQ(irq_set_priority(HardFault_IRQn, 0, 0), DRV_ERR_PARAM);
+
+    /* All preemption bits, then none. */
+    TEST_ASSERT_EQ(irq_set_grouping(4), DRV_OK);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 15, 0), DRV_OK);
+    TEST_ASSERT_EQ(irq_priority(USART1_IRQn), 0xF0u);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 0, 1), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(irq_set_grouping(0), DRV_OK);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 0, 15), DRV_OK);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 1, 0), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(irq_set_grouping(5), DRV_ERR_PARAM);
+}
+
+/* Fast: preemption 0.  Slow: preemption 3.  Peer/PeerHi: preemption 1. */
+static void fast(void)
+{
+    mark('F');
+    if (ntrace == 1u) {
+        irq_trigger(TIM2_IRQn);
+        irq_trigger(USART2_IRQn);
+        irq_trigger(USART1_IRQn);
+    }
+    mark('f');
+}
+
+static void slow(void)
+{
+    mark('S');
+    TEST_ASSERT(irq_active(TIM2_IRQn));
+    if (ntrace == 1u) {
+        irq_trigger(DMA2_Stream0_IRQn);
+    }
+    mark('s');
+}
+
+static void peer(void)
+{
+    mark('P');
+    if (ntrace == 1u) {
+        irq_trigger(USART1_IRQn);
+    }
+    mark('p');
+}
+
+static void peer_hi(void)
+{
+    mark('Q');
+    mark('q');
+}
+
+static void test_preemption(void)
+{
+    setup(2);
+    (void)irq_set_handler(DMA2_Stream0_IRQn, fast);
+    (void)irq_set_handler(TIM2_IRQn, slow);
+    (void)irq_set_handler(USART2_IRQn, peer);
+    (void)irq_set_handler(USART1_IRQn, peer_hi);
+    TEST_ASSERT_EQ(irq_set_priority(DMA2_Stream0_IRQn, 0, 0), DRV_OK);
+    TEST_ASSERT_EQ(irq_set_priority(TIM2_IRQn, 3, 0), DRV_OK);
+    TEST_ASSERT_EQ(irq_set_priority(USART2_IRQn, 1, 3), DRV_OK);
+    TEST_ASSERT_EQ(irq_set_priority(USART1_IRQn, 1, 0), DRV_OK);
+    irq_enable(DMA2_Stream0_IRQn);
+    irq_enable(TIM2_IRQn);
+    irq_enable(USART2_IRQn);
+    irq_enable(USART1_IRQn);
+
+    /* The fast handler preempts the slow one. */
+    irq_trigger(TIM2_IRQn);
+    TEST_ASSERT(strcmp(trace, "SFfs") == 0);
+
+    /* Lower levels wait; pending together, the lower priority byte wins. */
+    ntrace = 0;
+    irq_trigger(DMA2_Stream0_IRQn);
+    TEST_ASSERT(strcmp(trace, "FfQqPpSs") == 0);
+
+    /* Same preemption level: no preemption whatever the sub-priority. */
+    ntrace = 0;
+    irq_trigger(USART2_IRQn);
+    TEST_ASSERT(strcmp(trace, "PpQq") == 0);
+    TEST_ASSERT(!irq_pending(USART1_IRQn));
+}
+
+static void test_latency(void)
+{
+    bench_result_t r;
+
+    setup(2);
+    bench_init();
+    TEST_ASSERT_EQ(irq_measure_latency(TIM7_IRQn, 32, &r), DRV_OK);
+    TEST_ASSERT(r.min <= r.median && r.median <= r.max);
+    TEST_ASSERT(irq_vector_table()[16 + TIM7_IRQn] == irq_unhandled);
+    TEST_ASSERT(!irq_enabled(TIM7_IRQn));
+    TEST_ASSERT(!irq_pending(TIM7_IRQn));
+    TEST_ASSERT_EQ(irq_measure_latency(SysTick_IRQn, 32, &r), DRV_ERR_PARAM);
+
+    /* VTOR not set up: the probe never runs. */
+    sim_reset();
+    TEST_ASSERT_EQ(irq_measure_latency(TIM7_IRQn, 4, &r), DRV_ERR_TIMEOUT);
+    TEST_ASSERT(!irq_enabled(TIM7_IRQn));
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_dispatch);
+    TEST_RUN(test_priority);
+    TEST_RUN(test_preemption);
+    TEST_RUN(test_latency);
+    return TEST_RESULT();
+}
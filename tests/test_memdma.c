@@ -0,0 +1,204 @@
+/**
+ * @file    test_memdma.c
+ * @brief   memdma tests: inline below the thresholds, burst / word / packed
+ *          byte paths with CPU heads and tails, chunk chaining, fills,
+ *          polling without the interrupt and busy handles.
+ */
+#include <string.h>
+
+#include "memdma.h"
+#include "sim.h"
+#include "test.h"
+
+#define BIG         300000u     /* More than one transfer of four-word bursts. */
+#define GUARD       0x5Au
+
+static STM32_ALIGNED(16) uint8_t src_buf[BIG + 64u];
+static STM32_ALIGNED(16) uint8_t dst_buf[BIG + 64u];
+static STM32_ALIGNED(16) uint8_t ref_buf[BIG + 64u];
+
+static uint32_t ncb;
+static drv_status_t last_status;
+static memdma_t *chain_m;
+
+static void done(void *ctx, drv_status_t status)
+{
+    (void)ctx;
+    ncb++;
+    last_status = status;
+}
+
+static void setup(memdma_t *m)
+{
+    size_t i;
+
+    sim_reset();
+    ncb = 0;
+    last_status = DRV_ERR_PARAM;
+    for (i = 0; i < sizeof(src_buf); i++) {
+        src_buf[i] = (uint8_t)(i * 13u + (i >> 8));
+    }
+    memset(dst_buf, GUARD, sizeof(dst_buf));
+    TEST_ASSERT_EQ(memdma_init(m), DRV_OK);
+    TEST_ASSERT(m->dma != NULL);
+}
+
+static void service(memdma_t *m)
+{
+    while (sim_irq_take(m->dma->irqn)) {
+        dma_irq(m->dma->dma, m->dma->stream);
+    }
+}
+
+/* dst_buf holds GUARD around [off, off + len) and @p expect inside it. */
+static void check(size_t off, const uint8_t *expect, size_t len)
+{
+    TEST_ASSERT_MEM_EQ(&dst_buf[off], expect, len);
+    TEST_ASSERT_EQ(dst_buf[off - 1u], GUARD);
+    TEST_ASSERT_EQ(dst_buf[off + len], GUARD);
+}
+
+static void test_inline(void)
+{
+    memdma_t m;
+
+    setup(&m);
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], src_buf, 100u, done, NULL), DRV_OK);
+    /* Below the threshold: done before the call returns, no stream used. */
+    TEST_ASSERT_EQ(ncb, 1u);
+    TEST_ASSERT_EQ(last_status, DRV_OK);
+    TEST_ASSERT(!memdma_poll(&m));
+    TEST_ASSERT(!REG_TEST_BITS(m.dma->regs->CR, DMA_SCR_EN));
+    TEST_ASSERT_EQ(REG_READ(m.dma->regs->M0AR), 0u);
+    check(16u, src_buf, 100u);
+
+    TEST_ASSERT_EQ(memdma_set(&m, &dst_buf[16], 0u, MEMDMA_SET_MIN_BYTES - 1u, NULL, NULL), DRV_OK);
+    TEST_ASSERT_EQ(REG_READ(m.dma->regs->M0AR), 0u);
+    TEST_ASSERT_EQ(memdma_copy(&m, dst_buf, src_buf, 0u, NULL, NULL), DRV_OK);
+    TEST_ASSERT_EQ(memdma_copy(&m, NULL, src_buf, 4u, NULL, NULL), DRV_ERR_PARAM);
+    memdma_deinit(&m);
+}
+
+static void test_burst(void)
+{
+    memdma_t m;
+
+    setup(&m);
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], &src_buf[32], 4096u, done, NULL), DRV_OK);
+    TEST_ASSERT(m.busy);
+    TEST_ASSERT_EQ(ncb, 0u);
+    service(&m);
+    TEST_ASSERT_EQ(ncb, 1u);
+    TEST_ASSERT_EQ(last_status, DRV_OK);
+    TEST_ASSERT(!memdma_poll(&m));
+    check(16u, &src_buf[32], 4096u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_MBURST), DMA_BURST_INCR4);
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_PSIZE), DMA_SIZE_WORD);
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_PL), 0u);
+    memdma_deinit(&m);
+}
+
+static void test_alignments(void)
+{
+    memdma_t m;
+
+    /* Same word alignment: CPU head to 16 bytes, then single words. */
+    setup(&m);
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[20], &src_buf[8], 3001u, done, NULL), DRV_OK);
+    TEST_ASSERT_EQ(memdma_wait(&m), DRV_OK);
+    TEST_ASSERT_EQ(ncb, 1u);
+    check(20u, &src_buf[8], 3001u);
+    TEST_ASSERT_EQ(REG_READ(m.dma->regs->M0AR), REG_ADDR(&dst_buf[32]));
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_MBURST), DMA_BURST_SINGLE);
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_PSIZE), DMA_SIZE_WORD);
+    memdma_deinit(&m);
+
+    /* Unrelated alignment: bytes in, words out. */
+    setup(&m);
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[3], &src_buf[6], 3003u, done, NULL), DRV_OK);
+    TEST_ASSERT_EQ(memdma_wait(&m), DRV_OK);
+    check(3u, &src_buf[6], 3003u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_PSIZE), DMA_SIZE_BYTE);
+    TEST_ASSERT_EQ(REG_FIELD_READ(m.dma->regs->CR, DMA_SCR_MSIZE), DMA_SIZE_WORD);
+    memdma_deinit(&m);
+}
+
+static void test_chunks(void)
+{
+    memdma_t m;
+
+    setup(&m);
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], &src_buf[16], BIG, done, NULL), DRV_OK);
+    /* The first transfer is as long as NDTR allows in whole bursts. */
+    TEST_ASSERT_EQ(m.xfer.count, 0xFFFCu);
+    TEST_ASSERT_EQ(memdma_wait(&m), DRV_OK);
+    TEST_ASSERT_EQ(ncb, 1u);
+    check(16u, &src_buf[16], BIG);
+
+    /* Packed bytes: chunks stay whole words. */
+    memset(dst_buf, GUARD, sizeof(dst_buf));
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], &src_buf[1], 0x20000u, done, NULL), DRV_OK);
+    TEST_ASSERT_EQ(m.xfer.count, 0xFFFCu);
+    TEST_ASSERT_EQ(memdma_wait(&m), DRV_OK);
+    check(16u, &src_buf[1], 0x20000u);
+    memdma_deinit(&m);
+}
+
+static void test_set(void)
+{
+    memdma_t m;
+
+    setup(&m);
+    memset(ref_buf, 0xA5, 5000u);
+    TEST_ASSERT_EQ(memdma_set(&m, &dst_buf[1], 0xA5u, 5000u, done, NULL), DRV_OK);
+    TEST_ASSERT_EQ(memdma_wait(&m), DRV_OK);
+    TEST_ASSERT_EQ(ncb, 1u);
+    check(1u, ref_buf, 5000u);
+    /* The pattern word is the stream's fixed source. */
+    TEST_ASSERT_EQ(REG_READ(m.dma->regs->PAR), REG_ADDR(&m.pattern));
+    TEST_ASSERT(!REG_TEST_BITS(m.dma->regs->CR, DMA_SCR_PINC));
+    memdma_deinit(&m);
+}
+
+static void chain(void *ctx, drv_status_t status)
+{
+    done(ctx, status);
+    if (ncb == 1u) {
+        TEST_ASSERT_EQ(memdma_set(chain_m, &dst_buf[16], 0u, 4096u, done, NULL), DRV_OK);
+    }
+}
+
+static void test_busy(void)
+{
+    memdma_t m;
+
+    setup(&m);
+    m.copy_min = 0;
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], src_buf, 64u, done, NULL), DRV_OK);
+    TEST_ASSERT(m.busy);
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], src_buf, 64u, done, NULL), DRV_ERR_BUSY);
+    TEST_ASSERT_EQ(memdma_set(&m, &dst_buf[16], 0u, 64u, done, NULL), DRV_ERR_BUSY);
+    TEST_ASSERT_EQ(memdma_wait(&m), DRV_OK);
+    check(16u, src_buf, 64u);
+
+    /* The callback may start the next operation. */
+    chain_m = &m;
+    ncb = 0;
+    TEST_ASSERT_EQ(memdma_copy(&m, &dst_buf[16], src_buf, 4096u, chain, NULL), DRV_OK);
+    service(&m);
+    TEST_ASSERT_EQ(ncb, 2u);
+    memset(ref_buf, 0, 4096u);
+    check(16u, ref_buf, 4096u);
+    memdma_deinit(&m);
+}
+
+int main(void)
+{
+    TEST_RUN(test_inline);
+    TEST_RUN(test_burst);
+    TEST_RUN(test_alignments);
+    TEST_RUN(test_chunks);
+    TEST_RUN(test_set);
+    TEST_RUN(test_busy);
+    return TEST_RESULT();
+}
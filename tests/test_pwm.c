@@ -0,0 +1,272 @@
+/**
+ * @file    test_pwm.c
+ * @brief   PWM driver tests: timer setup, DMA burst reload timing, looping
+ *          and one-shot waveforms, streaming refill.
+ */
+#include "pwm.h"
+#include "sim.h"
+#include "test.h"
+
+#define FRAMES      8u
+
+static uint32_t ncb;
+static uint32_t cb_frame[8];
+static uint32_t cb_count[8];
+
+static void progress(void *ctx, uint32_t frame, uint32_t nframes)
+{
+    (void)ctx;
+    if (ncb < STM32_ARRAY_SIZE(cb_frame)) {
+        cb_frame[ncb] = frame;
+        cb_count[ncb] = nframes;
+    }
+    ncb++;
+}
+
+static void service(pwm_t *h)
+{
+    while (sim_irq_take(h->dma->irqn)) {
+        dma_irq(h->dma->dma, h->dma->stream);
+    }
+}
+
+/* One period elapses: update event, burst, then the stream interrupt. */
+static void period(pwm_t *h)
+{
+    sim_tim_update(h->tim, 1);
+    service(h);
+}
+
+static void check_frame(pwm_t *h, const uint16_t *frame)
+{
+    uint32_t ch;
+
+    for (ch = 1; ch <= h->nch; ch++) {
+        TEST_ASSERT_EQ(sim_tim_compare(h->tim, ch), frame[ch - 1u]);
+    }
+}
+
+static void setup(void)
+{
+    sim_reset();
+    ncb = 0;
+}
+
+static void test_init(void)
+{
+    pwm_t h;
+    pwm_config_t cfg = { .freq_hz = 20000u, .nchannels = 4 };
+
+    /* HSI: every timer clock is 16 MHz. */
+    setup();
+    TEST_ASSERT_EQ(pwm_init(&h, TIM3, &cfg), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(RCC->APB1ENR, RCC_APB1ENR_TIM3EN));
+    TEST_ASSERT_EQ(REG_READ(TIM3->PSC), 0u);
+    TEST_ASSERT_EQ(REG_READ(TIM3->ARR), 799u);
+    TEST_ASSERT_EQ(h.period, 800u);
+    TEST_ASSERT_EQ(h.freq_hz, 20000u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(TIM3->CCMR1), TIM_CCMR_OCM(1)), TIM_OCM_PWM1);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(TIM3->CCMR1), TIM_CCMR_OCM(2)), TIM_OCM_PWM1);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(TIM3->CCMR2), TIM_CCMR_OCM(4)), TIM_OCM_PWM1);
+    TEST_ASSERT(REG_TEST_BITS(TIM3->CCMR2, TIM_CCMR_OCPE(3) | TIM_CCMR_OCPE(4)));
+    TEST_ASSERT_EQ(REG_READ(TIM3->CCER), TIM_CCER_CCE(1) | TIM_CCER_CCE(2) |
+                                         TIM_CCER_CCE(3) | TIM_CCER_CCE(4));
+    /* Burst of four from CCR1 (offset 0x34). */
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(TIM3->DCR), TIM_DCR_DBA), 13u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(TIM3->DCR), TIM_DCR_DBL), 3u);
+    TEST_ASSERT(REG_TEST_BITS(TIM3->CR1, TIM_CR1_ARPE));
+    TEST_ASSERT(!REG_TEST_BITS(TIM3->CR1, TIM_CR1_CEN));
+    TEST_ASSERT(!REG_TEST_BITS(TIM3->DIER, TIM_DIER_UDE));
+    pwm_deinit(&h);
+    TEST_ASSERT_EQ(REG_READ(TIM3->CCER), 0u);
+
+    /* 50 Hz needs a prescaler; the advanced timer needs MOE. */
+    cfg = (pwm_config_t){ .freq_hz = 50u, .nchannels = 2, .active_low = true };
+    TEST_ASSERT_EQ(pwm_init(&h, TIM1, &cfg), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(RCC->APB2ENR, RCC_APB2ENR_TIM1EN));
+    TEST_ASSERT_EQ(REG_READ(TIM1->PSC), 4u);
+    TEST_ASSERT_EQ(REG_READ(TIM1->ARR), 63999u);
+    TEST_ASSERT_EQ(h.freq_hz, 50u);
+    TEST_ASSERT(REG_TEST_BITS(TIM1->BDTR, TIM_BDTR_MOE));
+    TEST_ASSERT_EQ(REG_READ(TIM1->CCER), TIM_CCER_CCE(1) | TIM_CCER_CCP(1) |
+                                         TIM_CCER_CCE(2) | TIM_CCER_CCP(2));
+    TEST_ASSERT_EQ(REG_READ(TIM1->CCMR2), 0u);
+    pwm_deinit(&h);
+    TEST_ASSERT_EQ(REG_READ(TIM1->BDTR), 0u);
+
+    cfg.freq_hz = 20000000u;
+    TEST_ASSERT_EQ(pwm_init(&h, TIM1, &cfg), DRV_ERR_PARAM);
+    cfg.freq_hz = 1000u;
+    cfg.nchannels = 5;
+    TEST_ASSERT_EQ(pwm_init(&h, TIM1, &cfg), DRV_ERR_PARAM);
+    cfg.nchannels = 1;
+    TEST_ASSERT_EQ(pwm_init(&h, (tim_regs_t *)&cfg, &cfg), DRV_ERR_PARAM);
+}
+
+static void test_loop(void)
+{
+    static uint16_t table[FRAMES][4];
+    const pwm_config_t cfg = { .freq_hz = 20000u, .nchannels = 4, .cb = progress };
+    pwm_t h;
+    uint32_t f;
+    uint32_t c;
+    uint32_t k;
+
+    setup();
+    for (f = 0; f < FRAMES; f++) {
+        for (c = 0; c < 4u; c++) {
+            table[f][c] = (uint16_t)(100u * f + 10u * c);
+        }
+    }
+    TEST_ASSERT_EQ(pwm_init(&h, TIM2, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(pwm_start(&h, &table[0][0], FRAMES, true), DRV_OK);
+    service(&h);
+    TEST_ASSERT(REG_TEST_BITS(TIM2->CR1, TIM_CR1_CEN));
+    TEST_ASSERT(REG_TEST_BITS(TIM2->DIER, TIM_DIER_UDE));
+    /* Frame 0 is on the outputs from the first period, frame 1 preloaded. */
+    check_frame(&h, table[0]);
+    TEST_ASSERT_EQ(REG_READ(TIM2->CCR[3]), table[1][3]);
+    TEST_ASSERT_EQ(dma_remaining(h.dma), (FRAMES - 2u) * 4u);
+    TEST_ASSERT_EQ(ncb, 0u);
+
+    /* Each update activates the next frame and bursts one more in. */
+    for (k = 1; k <= 3u * FRAMES; k++) {
+        period(&h);
+        check_frame(&h, table[k % FRAMES]);
+        TEST_ASSERT_EQ(REG_READ(TIM2->CCR[0]), table[(k + 1u) % FRAMES][0]);
+    }
+    /* Halves are reported as they are consumed: 3 laps plus the primed
+     * frames 0 and 1 of the fourth. */
+    TEST_ASSERT_EQ(ncb, 6u);
+    for (k = 0; k < 6u; k++) {
+        TEST_ASSERT_EQ(cb_frame[k], (k & 1u) ? FRAMES / 2u : 0u);
+        TEST_ASSERT_EQ(cb_count[k], FRAMES / 2u);
+    }
+    TEST_ASSERT_EQ(sim_irq_pending(TIM2_IRQn), false);
+
+    pwm_stop(&h);
+    TEST_ASSERT(!REG_TEST_BITS(TIM2->CR1, TIM_CR1_CEN));
+    TEST_ASSERT(!REG_TEST_BITS(TIM2->DIER, TIM_DIER_UDE));
+    for (c = 1; c <= 4u; c++) {
+        TEST_ASSERT_EQ(sim_tim_compare(TIM2, c), 0u);
+    }
+    pwm_deinit(&h);
+}
+
+/* Streaming: the producer refills each half as soon as it is loaded. */
+static uint16_t stream[FRAMES][2];
+static uint32_t produced;
+
+static void refill(void *ctx, uint32_t frame, uint32_t nframes)
+{
+    uint32_t f;
+
+    (void)ctx;
+    for (f = frame; f < frame + nframes; f++) {
+        stream[f][0] = (uint16_t)produced;
+        stream[f][1] = (uint16_t)(1000u - produced);
+        produced++;
+    }
+}
+
+static void test_stream(void)
+{
+    const pwm_config_t cfg = { .freq_hz = 1000u, .nchannels = 2, .cb = refill };
+    pwm_t h;
+    uint32_t k;
+
+    setup();
+    produced = 0;
+    refill(NULL, 0, FRAMES);
+    TEST_ASSERT_EQ(pwm_init(&h, TIM8, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(pwm_start(&h, &stream[0][0], FRAMES, true), DRV_OK);
+    service(&h);
+    /* Period k plays sample k: every refill lands before it is needed. */
+    TEST_ASSERT_EQ(sim_tim_compare(TIM8, 1), 0u);
+    for (k = 1; k < 5u * FRAMES; k++) {
+        period(&h);
+        TEST_ASSERT_EQ(sim_tim_compare(TIM8, 1), k);
+        TEST_ASSERT_EQ(sim_tim_compare(TIM8, 2), 1000u - k);
+    }
+    pwm_deinit(&h);
+}
+
+static void test_oneshot(void)
+{
+    static const uint16_t table[5][3] = {
+        { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 }, { 10, 11, 12 }, { 13, 14, 15 },
+    };
+    const pwm_config_t cfg = { .freq_hz = 40000u, .nchannels = 3, .cb = progress };
+    pwm_t h;
+    uint32_t k;
+
+    setup();
+    TEST_ASSERT_EQ(pwm_init(&h, TIM1, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(pwm_start(&h, &table[0][0], 5, false), DRV_OK);
+    service(&h);
+    check_frame(&h, table[0]);
+    for (k = 1; k < 5u; k++) {
+        period(&h);
+        check_frame(&h, table[k]);
+    }
+    /* The last frame was loaded one period before it played. */
+    TEST_ASSERT_EQ(ncb, 1u);
+    TEST_ASSERT_EQ(cb_frame[0], 0u);
+    TEST_ASSERT_EQ(cb_count[0], 5u);
+    TEST_ASSERT(!REG_TEST_BITS(TIM1->DIER, TIM_DIER_UDE));
+    /* Then it holds. */
+    for (k = 0; k < 3u; k++) {
+        period(&h);
+        check_frame(&h, table[4]);
+    }
+    TEST_ASSERT(REG_TEST_BITS(TIM1->CR1, TIM_CR1_CEN));
+
+    /* A second waveform replays from its first frame. */
+    TEST_ASSERT_EQ(pwm_start(&h, &table[2][0], 2, false), DRV_OK);
+    service(&h);
+    check_frame(&h, table[2]);
+    period(&h);
+    check_frame(&h, table[3]);
+    TEST_ASSERT_EQ(ncb, 2u);
+    pwm_deinit(&h);
+}
+
+static void test_set(void)
+{
+    static const uint16_t table[2][2] = { { 1, 2 }, { 3, 4 } };
+    const uint16_t duty[2] = { 400, 200 };
+    const pwm_config_t cfg = { .freq_hz = 20000u, .nchannels = 2 };
+    pwm_t h;
+
+    setup();
+    TEST_ASSERT_EQ(pwm_init(&h, TIM4, &cfg), DRV_OK);
+    pwm_set(&h, duty);
+    check_frame(&h, duty);
+    TEST_ASSERT(REG_TEST_BITS(TIM4->CR1, TIM_CR1_CEN));
+
+    /* While running a new duty waits for the period to end. */
+    TEST_ASSERT_EQ(pwm_start(&h, &table[0][0], 2, true), DRV_OK);
+    period(&h);
+    pwm_set(&h, duty);
+    check_frame(&h, table[1]);
+    period(&h);
+    check_frame(&h, duty);
+    period(&h);
+    check_frame(&h, duty);
+    TEST_ASSERT(!REG_TEST_BITS(TIM4->DIER, TIM_DIER_UDE));
+
+    TEST_ASSERT_EQ(pwm_start(&h, NULL, 2, false), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(pwm_start(&h, &table[0][0], 1, false), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(pwm_start(&h, &table[0][0], 3, true), DRV_ERR_PARAM);
+    pwm_deinit(&h);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_loop);
+    TEST_RUN(test_stream);
+    TEST_RUN(test_oneshot);
+    TEST_RUN(test_set);
+    return TEST_RESULT();
+}
@@ -0,0 +1,349 @@
+/**
+ * @file    test_qspi.c
+ * @brief   QUADSPI NOR flash tests: reset and identification, quad enable,
+ *          memory-mapped reads, page programs across page boundaries,
+ *          sector, block and chip erase, busy polling and failures.
+ */
+#include <string.h>
+
+#include "qspi.h"
+#include "rcc.h"
+#include "sim.h"
+#include "test.h"
+
+#define FLASH_LOG2  20u
+#define FLASH_SIZE  (1u << FLASH_LOG2)
+#define FLASH_ID    0xEF4014u           /* Winbond, SPI NOR, 1 MiB */
+
+#define OP_WRSR     0x01u
+#define OP_PP       0x02u
+#define OP_RDSR     0x05u
+#define OP_SE       0x20u
+#define OP_CE       0xC7u
+#define OP_BE       0xD8u
+
+static uint8_t flash_data[FLASH_SIZE];
+static uint8_t buf[1024];
+
+static uint8_t pattern(size_t i, uint32_t seed)
+{
+    return (uint8_t)(i * 13u + (i >> 8) + seed);
+}
+
+static void fill(uint8_t *p, size_t len, uint32_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        p[i] = pattern(i, seed);
+    }
+}
+
+static void setup(sim_qspi_flash_t *flash)
+{
+    rcc_plan_t plan;
+
+    sim_reset();
+    TEST_ASSERT_EQ(rcc_solve(&(rcc_request_t){ .hse_hz = 8000000u, .need_48mhz = true }, &plan),
+                   DRV_OK);
+    rcc_set_current(&plan);
+    fill(flash_data, sizeof(flash_data), 0x5Au);
+    *flash = (sim_qspi_flash_t){
+        .data = flash_data,
+        .size = FLASH_SIZE,
+        .jedec_id = FLASH_ID,
+        .qe = SIM_QSPI_QE_SR2,
+        .dummy_cycles = QSPI_DUMMY_CYCLES,
+        .program_busy = 3,
+        .erase_busy = 10,
+    };
+}
+
+static const qspi_config_t cfg_default = { .size_log2 = FLASH_LOG2, .qe = QSPI_QE_SR2_BIT1 };
+
+static void start(qspi_t *h, const sim_qspi_flash_t *flash, const qspi_config_t *cfg)
+{
+    sim_qspi_attach(QUADSPI, flash);
+    TEST_ASSERT_EQ(qspi_init(h, cfg), DRV_OK);
+}
+
+static void teardown(qspi_t *h)
+{
+    qspi_deinit(h);
+    TEST_ASSERT_EQ(REG_READ(QUADSPI->CR), 0u);
+    TEST_ASSERT_EQ(sim_qspi_errors(QUADSPI), 0u);
+    rcc_set_current(NULL);
+}
+
+static void test_init(void)
+{
+    sim_qspi_flash_t flash;
+    uint8_t sr2;
+    qspi_t h;
+
+    setup(&flash);
+    start(&h, &flash, &cfg_default);
+    TEST_ASSERT_EQ(h.jedec_id, FLASH_ID);
+    TEST_ASSERT_EQ(h.size, FLASH_SIZE);
+    TEST_ASSERT(h.mapped);
+    TEST_ASSERT(h.clock_hz <= QSPI_MAX_HZ);
+    TEST_ASSERT_EQ(h.clock_hz, rcc_current()->hclk_hz /
+                   (reg_field_get(REG_READ(QUADSPI->CR), QUADSPI_CR_PRESCALER) + 1u));
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(QUADSPI->DCR), QUADSPI_DCR_FSIZE), FLASH_LOG2 - 1u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(QUADSPI->CCR), QUADSPI_CCR_FMODE), QUADSPI_FMODE_MAP);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, 0x66u), 1u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, 0x99u), 1u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_WRSR), 1u);
+    (void)sim_qspi_status_regs(QUADSPI, &sr2);
+    TEST_ASSERT_EQ(sr2 & 0x02u, 0x02u);
+    TEST_ASSERT_MEM_EQ((const void *)QSPIMEM->B, flash_data, FLASH_SIZE);
+    qspi_deinit(&h);
+
+    /* The enable bit is non-volatile: not written again. */
+    TEST_ASSERT_EQ(qspi_init(&h, &cfg_default), DRV_OK);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_WRSR), 1u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, 0x99u), 2u);
+    teardown(&h);
+}
+
+static void test_quad_enable(void)
+{
+    sim_qspi_flash_t flash;
+    qspi_t h;
+
+    /* Macronix style: QE in status register 1. */
+    setup(&flash);
+    flash.qe = SIM_QSPI_QE_SR1;
+    start(&h, &flash, &(qspi_config_t){ .size_log2 = FLASH_LOG2, .qe = QSPI_QE_SR1_BIT6 });
+    TEST_ASSERT_EQ(sim_qspi_status_regs(QUADSPI, NULL) & 0x40u, 0x40u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_WRSR), 1u);
+    TEST_ASSERT_MEM_EQ((const void *)QSPIMEM->B, flash_data, FLASH_SIZE);
+    teardown(&h);
+
+    /* Set at the factory: only read. */
+    setup(&flash);
+    flash.sr2 = 0x02u;
+    start(&h, &flash, &cfg_default);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_WRSR), 0u);
+    teardown(&h);
+
+    /* No quad enable configured for a flash that needs it: quad reads fail. */
+    setup(&flash);
+    start(&h, &flash, &(qspi_config_t){ .size_log2 = FLASH_LOG2 });
+    TEST_ASSERT_EQ(sim_qspi_errors(QUADSPI), 1u);
+    TEST_ASSERT_EQ(QSPIMEM->B[0], 0xFFu);
+    qspi_deinit(&h);
+    rcc_set_current(NULL);
+}
+
+static void test_config(void)
+{
+    sim_qspi_flash_t flash;
+    qspi_t h;
+
+    setup(&flash);
+    sim_qspi_attach(QUADSPI, &flash);
+    TEST_ASSERT_EQ(qspi_init(&h, &(qspi_config_t){ .size_log2 = 15u }), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_init(&h, &(qspi_config_t){ .size_log2 = 25u }), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_init(&h, &(qspi_config_t){ .size_log2 = 20u, .qe = 3 }), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_init(&h, NULL), DRV_ERR_PARAM);
+
+    /* Slow flash: the clock is divided down, the dummy cycles follow. */
+    flash.dummy_cycles = 6u;
+    start(&h, &flash, &(qspi_config_t){ .size_log2 = FLASH_LOG2, .max_hz = 20000000u,
+                                        .dummy_cycles = 6u, .qe = QSPI_QE_SR2_BIT1 });
+    TEST_ASSERT(h.clock_hz <= 20000000u);
+    TEST_ASSERT(h.clock_hz > 10000000u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(QUADSPI->CCR), QUADSPI_CCR_DCYC), 6u);
+    TEST_ASSERT_MEM_EQ((const void *)QSPIMEM->B, flash_data, 4096u);
+    teardown(&h);
+}
+
+static void test_no_flash(void)
+{
+    sim_qspi_flash_t flash;
+    qspi_t h;
+
+    /* Lines pulled up: the reset never seems to finish. */
+    setup(&flash);
+    sim_qspi_attach(QUADSPI, NULL);
+    TEST_ASSERT_EQ(qspi_init(&h, &cfg_default), DRV_ERR_TIMEOUT);
+    TEST_ASSERT_EQ(REG_READ(QUADSPI->CR), 0u);
+    TEST_ASSERT(h.dma == NULL);
+
+    /* Something answering with an ID of zeros. */
+    flash.jedec_id = 0u;
+    sim_qspi_attach(QUADSPI, &flash);
+    TEST_ASSERT_EQ(qspi_init(&h, &cfg_default), DRV_ERR_HW);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, 0x9Fu), 1u);
+
+    /* The stream was given back each time. */
+    flash.jedec_id = FLASH_ID;
+    start(&h, &flash, &cfg_default);
+    TEST_ASSERT_EQ(h.jedec_id, FLASH_ID);
+    teardown(&h);
+}
+
+static void test_read(void)
+{
+    sim_qspi_flash_t flash;
+    qspi_t h;
+
+    setup(&flash);
+    start(&h, &flash, &cfg_default);
+    TEST_ASSERT(qspi_ptr(&h, 0x1234u) == (const void *)&QSPIMEM->B[0x1234u]);
+    TEST_ASSERT_MEM_EQ(qspi_ptr(&h, 0x1234u), &flash_data[0x1234u], 100u);
+
+    TEST_ASSERT_EQ(qspi_read(&h, 3u, buf, 777u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &flash_data[3], 777u);
+    TEST_ASSERT_EQ(qspi_read(&h, FLASH_SIZE - 10u, buf, 10u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &flash_data[FLASH_SIZE - 10u], 10u);
+
+    TEST_ASSERT_EQ(qspi_read(&h, FLASH_SIZE - 10u, buf, 11u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_read(&h, FLASH_SIZE, buf, 1u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_read(&h, 0u, buf, 0u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_read(&h, 0u, NULL, 1u), DRV_ERR_PARAM);
+
+    /* No commands beyond the one entering memory-mapped mode. */
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, 0xEBu), 1u);
+    teardown(&h);
+}
+
+static void test_write(void)
+{
+    sim_qspi_flash_t flash;
+    uint8_t ref[300];
+    uint32_t polls;
+    qspi_t h;
+
+    setup(&flash);
+    start(&h, &flash, &cfg_default);
+    TEST_ASSERT_EQ(qspi_erase(&h, 0u, QSPI_SECTOR_SIZE), DRV_OK);
+    polls = h.polls;
+
+    /* Unaligned start and length over three pages. */
+    fill(ref, sizeof(ref), 0x33u);
+    TEST_ASSERT_EQ(qspi_write(&h, 0xFDu, ref, sizeof(ref)), DRV_OK);
+    TEST_ASSERT_EQ(h.pages, 3u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_PP), 3u);
+    TEST_ASSERT_EQ(h.polls - polls, 6u);            /* WEL, then WIP, per page. */
+    TEST_ASSERT_MEM_EQ(&flash_data[0xFDu], ref, sizeof(ref));
+    TEST_ASSERT_EQ(flash_data[0xFCu], 0xFFu);       /* The word padding programs nothing. */
+    TEST_ASSERT_EQ(flash_data[0xFDu + sizeof(ref)], 0xFFu);
+    TEST_ASSERT(h.mapped);
+    TEST_ASSERT_MEM_EQ(qspi_ptr(&h, 0u), flash_data, QSPI_SECTOR_SIZE);
+
+    /* NOR: a second program only clears bits. */
+    TEST_ASSERT_EQ(qspi_write(&h, 0x400u, "\x0F", 1u), DRV_OK);
+    TEST_ASSERT_EQ(qspi_write(&h, 0x400u, "\xF1", 1u), DRV_OK);
+    TEST_ASSERT_EQ(flash_data[0x400u], 0x01u);
+    TEST_ASSERT_EQ(flash_data[0x3FFu], 0xFFu);
+    TEST_ASSERT_EQ(flash_data[0x401u], 0xFFu);
+
+    TEST_ASSERT_EQ(qspi_write(&h, FLASH_SIZE - 1u, ref, 2u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_write(&h, 0u, NULL, 1u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_PP), 5u);
+    teardown(&h);
+}
+
+static void test_erase(void)
+{
+    sim_qspi_flash_t flash;
+    qspi_t h;
+    uint32_t i;
+
+    setup(&flash);
+    start(&h, &flash, &cfg_default);
+
+    /* A sector, a whole block, then two sectors. */
+    TEST_ASSERT_EQ(qspi_erase(&h, 0xF000u, 0x1000u + QSPI_BLOCK_SIZE + 0x2000u), DRV_OK);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_SE), 3u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_BE), 1u);
+    TEST_ASSERT_EQ(h.erases, 4u);
+    for (i = 0xF000u; i < 0x22000u; i++) {
+        if (flash_data[i] != 0xFFu) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQ(i, 0x22000u);
+    TEST_ASSERT_EQ(flash_data[0xEFFFu], pattern(0xEFFFu, 0x5Au));
+    TEST_ASSERT_EQ(flash_data[0x22000u], pattern(0x22000u, 0x5Au));
+    TEST_ASSERT_EQ(QSPIMEM->B[0x10000u], 0xFFu);
+    TEST_ASSERT_EQ(QSPIMEM->B[0x22000u], flash_data[0x22000u]);
+
+    TEST_ASSERT_EQ(qspi_erase(&h, 0x100u, QSPI_SECTOR_SIZE), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_erase(&h, 0u, 0x800u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_erase(&h, FLASH_SIZE - QSPI_SECTOR_SIZE, 2u * QSPI_SECTOR_SIZE),
+                   DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(qspi_erase(&h, 0u, 0u), DRV_ERR_PARAM);
+
+    /* The whole range is one chip erase. */
+    TEST_ASSERT_EQ(qspi_erase(&h, 0u, FLASH_SIZE), DRV_OK);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_CE), 1u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_BE), 1u);
+    TEST_ASSERT_EQ(QSPIMEM->B[0], 0xFFu);
+    TEST_ASSERT_EQ(QSPIMEM->B[FLASH_SIZE - 1u], 0xFFu);
+    TEST_ASSERT_EQ(flash_data[0x80000u], 0xFFu);
+    teardown(&h);
+}
+
+static void test_busy(void)
+{
+    sim_qspi_flash_t flash;
+    uint32_t polls;
+    uint32_t reads;
+    qspi_t h;
+
+    /* A long busy time is still one polling run per wait. */
+    setup(&flash);
+    flash.erase_busy = 500u;
+    start(&h, &flash, &cfg_default);
+    polls = h.polls;
+    reads = sim_qspi_commands(QUADSPI, OP_RDSR);
+    TEST_ASSERT_EQ(qspi_erase(&h, 0u, QSPI_SECTOR_SIZE), DRV_OK);
+    TEST_ASSERT_EQ(h.polls - polls, 2u);
+    TEST_ASSERT(sim_qspi_commands(QUADSPI, OP_RDSR) - reads > 500u);
+    TEST_ASSERT_EQ(flash_data[0], 0xFFu);
+    TEST_ASSERT_EQ(h.timeouts, 0u);
+    teardown(&h);
+}
+
+static void test_errors(void)
+{
+    sim_qspi_flash_t flash;
+    uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    qspi_t h;
+
+    setup(&flash);
+    start(&h, &flash, &cfg_default);
+    TEST_ASSERT_EQ(qspi_erase(&h, 0u, QSPI_SECTOR_SIZE), DRV_OK);
+
+    /* The write enable latch never sets: timeout, nothing programmed. */
+    sim_qspi_fault(QUADSPI, SIM_QSPI_FAULT_NO_WEL);
+    TEST_ASSERT_EQ(qspi_write(&h, 0x10u, data, sizeof(data)), DRV_ERR_TIMEOUT);
+    TEST_ASSERT_EQ(h.timeouts, 1u);
+    TEST_ASSERT_EQ(h.pages, 0u);
+    TEST_ASSERT_EQ(sim_qspi_commands(QUADSPI, OP_PP), 0u);
+    TEST_ASSERT_EQ(flash_data[0x10u], 0xFFu);
+
+    /* Mapped again, and the next write goes through. */
+    TEST_ASSERT(h.mapped);
+    TEST_ASSERT_EQ(QSPIMEM->B[0x2000u], flash_data[0x2000u]);
+    TEST_ASSERT_EQ(qspi_write(&h, 0x10u, data, sizeof(data)), DRV_OK);
+    TEST_ASSERT_MEM_EQ(qspi_ptr(&h, 0x10u), data, sizeof(data));
+    teardown(&h);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_quad_enable);
+    TEST_RUN(test_config);
+    TEST_RUN(test_no_flash);
+    TEST_RUN(test_read);
+    TEST_RUN(test_write);
+    TEST_RUN(test_erase);
+    TEST_RUN(test_busy);
+    TEST_RUN(test_errors);
+    return TEST_RESULT();
+}
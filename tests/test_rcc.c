@@ -0,0 +1,198 @@
+/**
+ * @file    test_rcc.c
+ * @brief   Clock tree solver against the RM limits, and the switch sequence.
+ */
+#include "rcc.h"
+#include "sim.h"
+#include "test.h"
+
+/* The classic 8 MHz crystal plan, checked without running anything. */
+STM32_STATIC_ASSERT(RCC_PLL_VALID(8000000u, 4u, 168u, 2u, 7u), "8 MHz HSE plan");
+STM32_STATIC_ASSERT(RCC_PLL_48CK(8000000u, 4u, 168u, 7u) == RCC_PLL48_HZ, "8 MHz HSE 48 MHz");
+STM32_STATIC_ASSERT(!RCC_PLL_VALID(8000000u, 8u, 432u, 2u, 9u), "VCO above 432 MHz");
+STM32_STATIC_ASSERT(RCC_FLASH_LATENCY(30000000u, 3300u) == 0u, "30 MHz at 3.3 V");
+STM32_STATIC_ASSERT(RCC_FLASH_LATENCY(168000000u, 3300u) == 5u, "168 MHz at 3.3 V");
+
+/* Everything the reference manual requires of a plan. */
+static void check_plan(const rcc_request_t *req, const rcc_plan_t *p)
+{
+    uint32_t mv = (req->vdd_mv != 0u) ? req->vdd_mv : 3300u;
+    uint32_t apb1 = (req->apb1_max_hz != 0u) ? req->apb1_max_hz : RCC_APB1_MAX_HZ;
+    uint32_t apb2 = (req->apb2_max_hz != 0u) ? req->apb2_max_hz : RCC_APB2_MAX_HZ;
+
+    TEST_ASSERT(RCC_PLL_VALID(p->src_hz, p->pllm, p->plln, p->pllp, p->pllq));
+    TEST_ASSERT_EQ(p->sysclk_hz, RCC_PLL_SYSCLK(p->src_hz, p->pllm, p->plln, p->pllp));
+    TEST_ASSERT_EQ(p->pll48_hz, RCC_PLL_48CK(p->src_hz, p->pllm, p->plln, p->pllq));
+    TEST_ASSERT_EQ(p->hclk_hz, p->sysclk_hz / p->hpre);
+    TEST_ASSERT(p->pclk1_hz <= apb1 && p->pclk1_hz <= RCC_APB1_MAX_HZ);
+    TEST_ASSERT(p->pclk2_hz <= apb2 && p->pclk2_hz <= RCC_APB2_MAX_HZ);
+    /* Prescalers are the smallest that fit. */
+    TEST_ASSERT(p->ppre1 == 1u || p->hclk_hz / (p->ppre1 / 2u) > apb1);
+    TEST_ASSERT(p->ppre2 == 1u || p->hclk_hz / (p->ppre2 / 2u) > apb2);
+    /* Enough wait states, and not one more. */
+    TEST_ASSERT(p->hclk_hz <= (p->latency + 1u) * RCC_WS_STEP_HZ(mv));
+    TEST_ASSERT(p->latency == 0u || p->hclk_hz > p->latency * RCC_WS_STEP_HZ(mv));
+    if (req->need_48mhz) {
+        TEST_ASSERT_EQ(p->pll48_hz, RCC_PLL48_HZ);
+    }
+}
+
+static void test_hse_usb(void)
+{
+    const rcc_request_t req = { .hse_hz = 8000000u, .need_48mhz = true };
+    rcc_plan_t p;
+
+    TEST_ASSERT_EQ(rcc_solve(&req, &p), DRV_OK);
+    check_plan(&req, &p);
+    /* VCO = 336 MHz; on F7 the next multiple of 48 MHz overshoots 180 MHz. */
+    TEST_ASSERT_EQ(p.sysclk_hz, 168000000u);
+    /* Highest VCO input wins ties: 2 MHz. */
+    TEST_ASSERT_EQ(p.src_hz / p.pllm, RCC_VCO_IN_MAX_HZ);
+    TEST_ASSERT_EQ(p.ppre1, 4u);
+    TEST_ASSERT_EQ(p.ppre2, 2u);
+#if !defined(STM32F7)
+    TEST_ASSERT_EQ(p.pllm, 4u);
+    TEST_ASSERT_EQ(p.plln, 168u);
+    TEST_ASSERT_EQ(p.pllp, 2u);
+    TEST_ASSERT_EQ(p.pllq, 7u);
+    TEST_ASSERT_EQ(p.latency, 5u);
+#endif
+    TEST_ASSERT_EQ(rcc_timer_clock(&p, false), 2u * p.pclk1_hz);
+}
+
+static void test_hsi(void)
+{
+    const rcc_request_t req = { 0 };
+    rcc_plan_t p;
+
+    TEST_ASSERT_EQ(rcc_solve(&req, &p), DRV_OK);
+    check_plan(&req, &p);
+    TEST_ASSERT(!p.hse);
+    TEST_ASSERT_EQ(p.src_hz, RCC_HSI_HZ);
+    TEST_ASSERT_EQ(p.sysclk_hz, RCC_SYSCLK_MAX_HZ);
+}
+
+static void test_limits(void)
+{
+    const rcc_request_t slow = {
+        .hse_hz = 8000000u, .sysclk_max_hz = 100000000u, .vdd_mv = 1800u,
+    };
+    const rcc_request_t apb = {
+        .hse_hz = 8000000u, .sysclk_max_hz = 40000000u, .apb2_max_hz = 10000000u,
+    };
+    const rcc_request_t bad_hse = { .hse_hz = 500000u };
+    rcc_plan_t p;
+
+    TEST_ASSERT_EQ(rcc_solve(&slow, &p), DRV_OK);
+    check_plan(&slow, &p);
+    TEST_ASSERT_EQ(p.sysclk_hz, 100000000u);
+    TEST_ASSERT_EQ(p.latency, 4u);
+
+    TEST_ASSERT_EQ(rcc_solve(&apb, &p), DRV_OK);
+    check_plan(&apb, &p);
+    TEST_ASSERT_EQ(p.ppre1, 1u);
+    TEST_ASSERT_EQ(p.ppre2, 4u);
+    TEST_ASSERT_EQ(rcc_timer_clock(&p, false), 40000000u);
+    TEST_ASSERT_EQ(rcc_timer_clock(&p, true), 20000000u);
+
+    /* Below the 1 MHz VCO input floor even with M = 2. */
+    TEST_ASSERT_EQ(rcc_solve(&bad_hse, &p), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(rcc_solve(NULL, &p), DRV_ERR_PARAM);
+}
+
+/* Every crystal from 4 to 26 MHz in 100 kHz steps, with and without USB. */
+static void test_sweep(void)
+{
+    uint32_t hz;
+    unsigned usb;
+
+    for (hz = 4000000u; hz <= 26000000u; hz += 100000u) {
+        for (usb = 0; usb < 2u; usb++) {
+            const rcc_request_t req = { .hse_hz = hz, .need_48mhz = usb != 0u };
+            rcc_plan_t p;
+            drv_status_t rc = rcc_solve(&req, &p);
+
+            if (usb == 0u || hz % 1000000u == 0u) {
+                /* Whole-MHz crystals always reach 48 MHz exactly. */
+                TEST_ASSERT_EQ(rc, DRV_OK);
+            }
+            if (rc == DRV_OK) {
+                check_plan(&req, &p);
+            }
+        }
+    }
+}
+
+static void test_apply(void)
+{
+    const rcc_request_t fast = { .hse_hz = 8000000u, .need_48mhz = true };
+    const rcc_request_t slow = { .sysclk_max_hz = 60000000u };
+    rcc_plan_t p;
+    uint32_t cfgr;
+    uint32_t pll;
+
+    sim_reset();
+    TEST_ASSERT_EQ(rcc_current()->sysclk_hz, RCC_HSI_HZ);
+    TEST_ASSERT_EQ(rcc_solve(&fast, &p), DRV_OK);
+    TEST_ASSERT_EQ(rcc_apply(&p), DRV_OK);
+
+    TEST_ASSERT(REG_TEST_BITS(RCC->CR, RCC_CR_HSERDY));
+    TEST_ASSERT(REG_TEST_BITS(RCC->CR, RCC_CR_PLLRDY));
+    pll = REG_READ(RCC->PLLCFGR);
+    TEST_ASSERT_EQ(reg_field_get(pll, RCC_PLLCFGR_PLLM), p.pllm);
+    TEST_ASSERT_EQ(reg_field_get(pll, RCC_PLLCFGR_PLLN), p.plln);
+    TEST_ASSERT_EQ(reg_field_get(pll, RCC_PLLCFGR_PLLP), p.pllp / 2u - 1u);
+    TEST_ASSERT_EQ(reg_field_get(pll, RCC_PLLCFGR_PLLQ), p.pllq);
+    TEST_ASSERT((pll & RCC_PLLCFGR_PLLSRC) != 0u);
+    /* Reserved bit 29 keeps its reset value. */
+    TEST_ASSERT((pll & REG_BIT(29)) != 0u);
+    cfgr = REG_READ(RCC->CFGR);
+    TEST_ASSERT_EQ(reg_field_get(cfgr, RCC_CFGR_SWS), RCC_CFGR_SW_PLL);
+    TEST_ASSERT_EQ(reg_field_get(cfgr, RCC_CFGR_HPRE), 0u);
+    TEST_ASSERT_EQ(reg_field_get(cfgr, RCC_CFGR_PPRE1), 5u);     /* /4 */
+    TEST_ASSERT_EQ(reg_field_get(cfgr, RCC_CFGR_PPRE2), 4u);     /* /2 */
+    TEST_ASSERT_EQ(REG_FIELD_READ(FLASH->ACR, FLASH_ACR_LATENCY), p.latency);
+    TEST_ASSERT_EQ(rcc_current()->sysclk_hz, p.sysclk_hz);
+
+    /* Coming down: wait states follow the clock. */
+    TEST_ASSERT_EQ(rcc_solve(&slow, &p), DRV_OK);
+    TEST_ASSERT_EQ(rcc_apply(&p), DRV_OK);
+    TEST_ASSERT_EQ(REG_FIELD_READ(FLASH->ACR, FLASH_ACR_LATENCY), 1u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(RCC->CFGR, RCC_CFGR_PPRE1), 4u);  /* /2 */
+    TEST_ASSERT((REG_READ(RCC->PLLCFGR) & RCC_PLLCFGR_PLLSRC) == 0u);
+    TEST_ASSERT_EQ(rcc_current()->sysclk_hz, 60000000u);
+
+    /* Bookkeeping only, as after a switch made at startup. */
+    rcc_set_current(NULL);
+    TEST_ASSERT_EQ(rcc_current()->sysclk_hz, RCC_HSI_HZ);
+    rcc_set_current(&p);
+    TEST_ASSERT_EQ(rcc_current()->sysclk_hz, 60000000u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(FLASH->ACR, FLASH_ACR_LATENCY), 1u);
+}
+
+static void test_hse_timeout(void)
+{
+    const rcc_request_t req = { .hse_hz = 25000000u };
+    rcc_plan_t p;
+
+    sim_reset();
+    sim_rcc_hse_fail(true);
+    TEST_ASSERT_EQ(rcc_solve(&req, &p), DRV_OK);
+    TEST_ASSERT_EQ(rcc_apply(&p), DRV_ERR_TIMEOUT);
+    /* Still on HSI, oscillator switched back off, PLL untouched. */
+    TEST_ASSERT_EQ(REG_FIELD_READ(RCC->CFGR, RCC_CFGR_SWS), RCC_CFGR_SW_HSI);
+    TEST_ASSERT(!REG_TEST_BITS(RCC->CR, RCC_CR_HSEON));
+    TEST_ASSERT(!REG_TEST_BITS(RCC->CR, RCC_CR_PLLON));
+    TEST_ASSERT_EQ(REG_FIELD_READ(FLASH->ACR, FLASH_ACR_LATENCY), 0u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_hse_usb);
+    TEST_RUN(test_hsi);
+    TEST_RUN(test_limits);
+    TEST_RUN(test_sweep);
+    TEST_RUN(test_apply);
+    TEST_RUN(test_hse_timeout);
+    return TEST_RESULT();
+}
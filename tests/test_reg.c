@@ -0,0 +1,67 @@
+/**
+ * @file    test_reg.c
+ * @brief   Register access layer tests.
+ */
+#include "host.h"
+#include "stm32.h"
+#include "test.h"
+
+static void test_masks(void)
+{
+    TEST_ASSERT_EQ(REG_BIT(0), 0x1u);
+    TEST_ASSERT_EQ(REG_BIT(31), 0x80000000u);
+    TEST_ASSERT_EQ(REG_MASK(4u, 3u), 0x70u);
+    TEST_ASSERT_EQ(REG_MASK(0u, 32u), 0xFFFFFFFFu);
+    TEST_ASSERT_EQ(reg_field_mask(RCC_PLLCFGR_PLLN), 0x7FC0u);
+    TEST_ASSERT_EQ(reg_field_mask(GPIO_MODER_MODE(15)), 0xC0000000u);
+    TEST_ASSERT_EQ(reg_field_mask(GPIO_AFR_AF(9)), 0xF0u);
+}
+
+static void test_field_get_set(void)
+{
+    uint32_t v = 0xFFFFFFFFu;
+
+    v = reg_field_set(v, RCC_CFGR_HPRE, 0x8u);
+    TEST_ASSERT_EQ(v, 0xFFFFFF8Fu);
+    TEST_ASSERT_EQ(reg_field_get(v, RCC_CFGR_HPRE), 0x8u);
+    /* Values wider than the field are truncated, never spill over. */
+    TEST_ASSERT_EQ(reg_field_prep(RCC_CFGR_SW, 0x7u), 0x3u);
+}
+
+static void test_rmw_on_ram(void)
+{
+    stm32_host_reset();
+
+    REG_WRITE(GPIOA->MODER, 0xA8000000u);
+    REG_FIELD_WRITE(GPIOA->MODER, GPIO_MODER_MODE(5), GPIO_MODE_OUTPUT);
+    TEST_ASSERT_EQ(REG_READ(GPIOA->MODER), 0xA8000400u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(GPIOA->MODER, GPIO_MODER_MODE(15)), GPIO_MODE_AF);
+
+    REG_SET_BITS(RCC->AHB1ENR, RCC_AHB1ENR_GPIOEN(0) | RCC_AHB1ENR_DMA1EN);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA1EN));
+    REG_CLR_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA1EN);
+    TEST_ASSERT_EQ(REG_READ(RCC->AHB1ENR), RCC_AHB1ENR_GPIOEN(0));
+
+    REG_MODIFY(RCC->CFGR, reg_field_mask(RCC_CFGR_PPRE1) | reg_field_mask(RCC_CFGR_PPRE2),
+               reg_field_prep(RCC_CFGR_PPRE1, 5u) | reg_field_prep(RCC_CFGR_PPRE2, 4u));
+    TEST_ASSERT_EQ(REG_READ(RCC->CFGR), (5u << 10) | (4u << 13));
+}
+
+static void test_instances_distinct(void)
+{
+    stm32_host_reset();
+    REG_WRITE(GPIOB->ODR, 0x1234u);
+    TEST_ASSERT_EQ(REG_READ(GPIOA->ODR), 0u);
+    TEST_ASSERT_EQ(REG_READ(GPIOB->ODR), 0x1234u);
+    TEST_ASSERT_EQ(sizeof(*GPIOA), 0x28u);
+    TEST_ASSERT_EQ(sizeof(*RCC), 0x90u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_masks);
+    TEST_RUN(test_field_get_set);
+    TEST_RUN(test_rmw_on_ram);
+    TEST_RUN(test_instances_distinct);
+    return TEST_RESULT();
+}
@@ -0,0 +1,214 @@
+/**
+ * @file    test_ringbuf.c
+ * @brief   SPSC ring buffer tests, including a two-thread stress test.
+ */
+#include <pthread.h>
+#include <sched.h>
+
+#include "ringbuf.h"
+#include "test.h"
+
+#define STRESS_BYTES    (4u * 1024u * 1024u)
+
+RINGBUF_DEFINE(static_rb, 16);
+
+static void test_init(void)
+{
+    uint8_t storage[24];
+    ringbuf_t rb;
+
+    TEST_ASSERT_EQ(ringbuf_init(&rb, storage, 24), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(ringbuf_init(&rb, storage, 16), DRV_OK);
+    TEST_ASSERT_EQ(ringbuf_capacity(&rb), 16u);
+    TEST_ASSERT_EQ(ringbuf_count(&rb), 0u);
+    TEST_ASSERT_EQ(ringbuf_capacity(&static_rb), 16u);
+    TEST_ASSERT_EQ(ringbuf_free(&static_rb), 16u);
+}
+
+static void test_push_pop_full(void)
+{
+    uint8_t storage[8];
+    ringbuf_t rb;
+    uint8_t b = 0;
+    uint32_t i;
+
+    ringbuf_init(&rb, storage, sizeof(storage));
+    for (i = 0; i < 8u; i++) {
+        TEST_ASSERT(ringbuf_push(&rb, (uint8_t)i));
+    }
+    /* All slots usable: no sentinel slot. */
+    TEST_ASSERT(!ringbuf_push(&rb, 0xFF));
+    TEST_ASSERT_EQ(ringbuf_free(&rb), 0u);
+    for (i = 0; i < 8u; i++) {
+        TEST_ASSERT(ringbuf_pop(&rb, &b));
+        TEST_ASSERT_EQ(b, i);
+    }
+    TEST_ASSERT(!ringbuf_pop(&rb, &b));
+}
+
+static void test_spans_wrap(void)
+{
+    uint8_t storage[8];
+    uint8_t out[8];
+    const uint8_t *rp;
+    uint8_t *wp;
+    ringbuf_t rb;
+
+    ringbuf_init(&rb, storage, sizeof(storage));
+    TEST_ASSERT_EQ(ringbuf_write(&rb, "abcdef", 6), 6u);
+    TEST_ASSERT_EQ(ringbuf_read(&rb, out, 4), 4u);
+
+    /* Head at 6: contiguous free space runs to the end of storage only. */
+    TEST_ASSERT_EQ(ringbuf_write_span(&rb, &wp), 2u);
+    TEST_ASSERT(wp == &storage[6]);
+
+    /* Bulk write wraps transparently; 6 of 7 bytes fit. */
+    TEST_ASSERT_EQ(ringbuf_write(&rb, "ghijklm", 7), 6u);
+    TEST_ASSERT_EQ(ringbuf_read_span(&rb, &rp), 4u);
+    TEST_ASSERT(rp == &storage[4]);
+    ringbuf_read_commit(&rb, 4);
+    TEST_ASSERT_EQ(ringbuf_read(&rb, out, sizeof(out)), 4u);
+    TEST_ASSERT_MEM_EQ(out, "ijkl", 4);
+}
+
+static void test_index_overflow(void)
+{
+    uint8_t storage[4];
+    uint8_t b = 0;
+    ringbuf_t rb;
+
+    /* Free-running indices must survive 32-bit wrap-around. */
+    ringbuf_init(&rb, storage, sizeof(storage));
+    rb.head = rb.tail = 0xFFFFFFFEu;
+    TEST_ASSERT_EQ(ringbuf_write(&rb, "wxyz", 4), 4u);
+    TEST_ASSERT_EQ(ringbuf_count(&rb), 4u);
+    TEST_ASSERT(!ringbuf_push(&rb, 0));
+    TEST_ASSERT(ringbuf_pop(&rb, &b));
+    TEST_ASSERT_EQ(b, 'w');
+}
+
+/* ------------------------------------------------------------------------ */
+/* Two-thread stress: producer mixes push and bulk/span writes of a known   */
+/* sequence, consumer mixes pop and bulk/span reads and checks ordering.    */
+/* ------------------------------------------------------------------------ */
+
+static uint8_t stress_storage[256];
+static ringbuf_t stress_rb;
+static uint32_t stress_errors;
+
+static uint32_t lcg(uint32_t *s)
+{
+    *s = *s * 1664525u + 1013904223u;
+    return *s >> 16;
+}
+
+static void *producer(void *arg)
+{
+    uint32_t seed = 1;
+    uint32_t sent = 0;
+    uint8_t chunk[64];
+
+    (void)arg;
+    while (sent < STRESS_BYTES) {
+        uint32_t mode = lcg(&seed) % 3u;
+        uint32_t want = 1u + lcg(&seed) % 64u;
+        uint32_t i;
+
+        if (want > STRESS_BYTES - sent) {
+            want = STRESS_BYTES - sent;
+        }
+        if (ringbuf_free(&stress_rb) == 0u) {
+            /* Let the consumer run when both threads share one core. */
+            sched_yield();
+        }
+        if (mode == 0u) {
+            if (ringbuf_push(&stress_rb, (uint8_t)sent)) {
+                sent++;
+            }
+        } else if (mode == 1u) {
+            for (i = 0; i < want; i++) {
+                chunk[i] = (uint8_t)(sent + i);
+            }
+            sent += ringbuf_write(&stress_rb, chunk, want);
+        } else {
+            uint8_t *dst;
+            uint32_t n = ringbuf_write_span(&stress_rb, &dst);
+
+            n = (n < want) ? n : want;
+            for (i = 0; i < n; i++) {
+                dst[i] = (uint8_t)(sent + i);
+            }
+            ringbuf_write_commit(&stress_rb, n);
+            sent += n;
+        }
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    uint32_t seed = 7;
+    uint32_t got = 0;
+    uint8_t chunk[64];
+
+    (void)arg;
+    while (got < STRESS_BYTES) {
+        uint32_t mode = lcg(&seed) % 3u;
+        uint32_t i;
+        uint32_t n;
+
+        if (ringbuf_count(&stress_rb) == 0u) {
+            sched_yield();
+        }
+        if (mode == 0u) {
+            uint8_t b;
+
+            if (ringbuf_pop(&stress_rb, &b)) {
+                stress_errors += (b != (uint8_t)got);
+                got++;
+            }
+        } else if (mode == 1u) {
+            n = ringbuf_read(&stress_rb, chunk, 1u + lcg(&seed) % 64u);
+            for (i = 0; i < n; i++) {
+                stress_errors += (chunk[i] != (uint8_t)(got + i));
+            }
+            got += n;
+        } else {
+            const uint8_t *src;
+
+            n = ringbuf_read_span(&stress_rb, &src);
+            for (i = 0; i < n; i++) {
+                stress_errors += (src[i] != (uint8_t)(got + i));
+            }
+            ringbuf_read_commit(&stress_rb, n);
+            got += n;
+        }
+    }
+    return NULL;
+}
+
+static void test_two_thread_stress(void)
+{
+    pthread_t prod;
+    pthread_t cons;
+
+    ringbuf_init(&stress_rb, stress_storage, sizeof(stress_storage));
+    stress_errors = 0;
+    TEST_ASSERT_EQ(pthread_create(&cons, NULL, consumer, NULL), 0);
+    TEST_ASSERT_EQ(pthread_create(&prod, NULL, producer, NULL), 0);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    TEST_ASSERT_EQ(stress_errors, 0u);
+    TEST_ASSERT_EQ(ringbuf_count(&stress_rb), 0u);
+    TEST_ASSERT_EQ(stress_rb.head, STRESS_BYTES);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_push_pop_full);
+    TEST_RUN(test_spans_wrap);
+    TEST_RUN(test_index_overflow);
+    TEST_RUN(test_two_thread_stress);
+    return TEST_RESULT();
+}
@@ -0,0 +1,358 @@
+/**
+ * @file    test_sdio.c
+ * @brief   SDIO tests: identification of SDHC and standard capacity cards,
+ *          bus width and speed selection, multi-block DMA transfers and
+ *          their splitting, the bounce path, write busy, errors and the
+ *          block device interface.
+ */
+#include <string.h>
+
+#include "rcc.h"
+#include "sdio.h"
+#include "sim.h"
+#include "test.h"
+
+#define HC_BLOCKS   1024u       /* Smallest SDHC card the CSD can describe. */
+#define SC_BLOCKS   512u
+#define BUF_BLOCKS  300u        /* More than one multi-block command. */
+
+static uint8_t card_data[HC_BLOCKS * SDIO_BLOCK_SIZE];
+static uint8_t buf[BUF_BLOCKS * SDIO_BLOCK_SIZE + SDIO_DMA_ALIGN] CACHE_ALIGNED;
+static uint8_t ref[BUF_BLOCKS * SDIO_BLOCK_SIZE];
+
+static void fill(uint8_t *p, size_t len, uint32_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        p[i] = (uint8_t)(i * 7u + (i >> 9) + seed);
+    }
+}
+
+static void setup(sim_sdio_card_t *card, uint32_t blocks)
+{
+    rcc_plan_t plan;
+
+    sim_reset();
+    TEST_ASSERT_EQ(rcc_solve(&(rcc_request_t){ .hse_hz = 8000000u, .need_48mhz = true }, &plan),
+                   DRV_OK);
+    rcc_set_current(&plan);
+    fill(card_data, sizeof(card_data), 0x11u);
+    *card = (sim_sdio_card_t){ .data = card_data, .blocks = blocks };
+}
+
+static void start(sdio_t *h, const sim_sdio_card_t *card, const sdio_config_t *cfg)
+{
+    sim_sdio_insert(SDIO, card);
+    TEST_ASSERT_EQ(sdio_init(h, cfg), DRV_OK);
+}
+
+static void teardown(sdio_t *h)
+{
+    sdio_deinit(h);
+    TEST_ASSERT_EQ(REG_READ(SDIO->POWER), 0u);
+    rcc_set_current(NULL);
+}
+
+static void test_init_sdhc(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    card.init_busy = 3;
+    start(&h, &card, &(sdio_config_t){ 0 });
+    TEST_ASSERT(h.sdhc);
+    TEST_ASSERT(h.wide);
+    TEST_ASSERT(h.high_speed);
+    TEST_ASSERT_EQ(h.blocks, HC_BLOCKS);
+    TEST_ASSERT(h.rca != 0u);
+    TEST_ASSERT_EQ(h.bus_hz, 48000000u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(SDIO->CLKCR), SDIO_CLKCR_WIDBUS), SDIO_WIDBUS_4);
+    TEST_ASSERT(REG_TEST_BITS(SDIO->CLKCR, SDIO_CLKCR_BYPASS | SDIO_CLKCR_CLKEN));
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, SIM_SDIO_ACMD(41)), 4u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 6u), 1u);
+    TEST_ASSERT_EQ(h.cid[0], 0x03534453u);
+    teardown(&h);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 7u), 2u);    /* Selected, then deselected. */
+}
+
+static void test_init_sdsc(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, SC_BLOCKS);
+    card.sdsc = true;
+    card.no_high_speed = true;
+    start(&h, &card, &(sdio_config_t){ 0 });
+    TEST_ASSERT(!h.sdhc);
+    TEST_ASSERT(!h.high_speed);
+    TEST_ASSERT_EQ(h.blocks, SC_BLOCKS);
+    TEST_ASSERT_EQ(h.bus_hz, 24000000u);
+    TEST_ASSERT(!REG_TEST_BITS(SDIO->CLKCR, SDIO_CLKCR_BYPASS));
+
+    /* Byte addresses on the bus, block numbers in the API. */
+    TEST_ASSERT_EQ(sdio_read(&h, SC_BLOCKS - 2u, buf, 2u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &card_data[(SC_BLOCKS - 2u) * SDIO_BLOCK_SIZE],
+                       2u * SDIO_BLOCK_SIZE);
+    teardown(&h);
+}
+
+static void test_config(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    sim_sdio_insert(SDIO, &card);
+    TEST_ASSERT_EQ(sdio_init(&h, &(sdio_config_t){ .bus_width = 8 }), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(sdio_init(&h, &(sdio_config_t){ .dma_priority = 4 }), DRV_ERR_PARAM);
+    rcc_set_current(NULL);
+    TEST_ASSERT_EQ(sdio_init(&h, &(sdio_config_t){ 0 }), DRV_ERR_PARAM);    /* No PLL48CK */
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ .bus_width = 1, .default_speed = true });
+    TEST_ASSERT(!h.wide);
+    TEST_ASSERT(!h.high_speed);
+    TEST_ASSERT_EQ(h.bus_hz, 24000000u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(SDIO->CLKCR), SDIO_CLKCR_WIDBUS), SDIO_WIDBUS_1);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, SIM_SDIO_ACMD(6)), 0u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 6u), 0u);
+    TEST_ASSERT_EQ(sdio_read(&h, 5u, buf, 3u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &card_data[5u * SDIO_BLOCK_SIZE], 3u * SDIO_BLOCK_SIZE);
+    teardown(&h);
+}
+
+static void test_no_card(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    TEST_ASSERT_EQ(sdio_init(&h, &(sdio_config_t){ 0 }), DRV_ERR_TIMEOUT);
+    TEST_ASSERT_EQ(REG_READ(SDIO->POWER), 0u);
+    TEST_ASSERT(h.dma == NULL);
+
+    /* The stream went back to the pool. */
+    start(&h, &card, &(sdio_config_t){ 0 });
+    teardown(&h);
+}
+
+static void test_multi_block(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+    uint32_t commands;
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+    commands = h.commands;                                  /* CMD6 status read */
+
+    TEST_ASSERT_EQ(sdio_read(&h, 10u, buf, 32u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &card_data[10u * SDIO_BLOCK_SIZE], 32u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 18u), 1u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 12u), 1u);
+
+    fill(ref, 32u * SDIO_BLOCK_SIZE, 0x5Au);
+    memcpy(buf, ref, 32u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sdio_write(&h, 100u, buf, 32u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(&card_data[100u * SDIO_BLOCK_SIZE], ref, 32u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 25u), 1u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 12u), 2u);
+
+    memset(buf, 0, 32u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sdio_read(&h, 100u, buf, 32u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, ref, 32u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(h.commands - commands, 3u);
+    teardown(&h);
+}
+
+static void test_single_block(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+
+    TEST_ASSERT_EQ(sdio_read(&h, HC_BLOCKS - 1u, buf, 1u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &card_data[(HC_BLOCKS - 1u) * SDIO_BLOCK_SIZE], SDIO_BLOCK_SIZE);
+    fill(ref, SDIO_BLOCK_SIZE, 0x33u);
+    memcpy(buf, ref, SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sdio_write(&h, 0u, buf, 1u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(card_data, ref, SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 17u), 1u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 24u), 1u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 12u), 0u);
+
+    TEST_ASSERT_EQ(sdio_read(&h, HC_BLOCKS, buf, 1u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(sdio_read(&h, HC_BLOCKS - 1u, buf, 2u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(sdio_write(&h, 0u, buf, 0u), DRV_ERR_PARAM);
+    teardown(&h);
+}
+
+/* Unaligned buffers go one block at a time through the bounce buffer. */
+static void test_unaligned(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+    uint8_t *p = &buf[4];
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+
+    TEST_ASSERT_EQ(sdio_read(&h, 20u, p, 3u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(p, &card_data[20u * SDIO_BLOCK_SIZE], 3u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 17u), 3u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 18u), 0u);
+
+    fill(ref, 3u * SDIO_BLOCK_SIZE, 0x77u);
+    memcpy(p, ref, 3u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sdio_write(&h, 40u, p, 3u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(&card_data[40u * SDIO_BLOCK_SIZE], ref, 3u * SDIO_BLOCK_SIZE);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 24u), 3u);
+    teardown(&h);
+}
+
+/* Runs longer than SDIO_MULTI_MAX blocks take more than one command. */
+static void test_split(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+
+    fill(ref, sizeof(ref), 0x99u);
+    memcpy(buf, ref, sizeof(ref));
+    TEST_ASSERT_EQ(sdio_write(&h, 500u, buf, BUF_BLOCKS), DRV_OK);
+    TEST_ASSERT_MEM_EQ(&card_data[500u * SDIO_BLOCK_SIZE], ref, sizeof(ref));
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 25u), 2u);
+
+    memset(buf, 0, sizeof(ref));
+    TEST_ASSERT_EQ(sdio_read(&h, 500u, buf, BUF_BLOCKS), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, ref, sizeof(ref));
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 18u), 2u);
+    teardown(&h);
+}
+
+/* The card programs in the background; the next command waits for it. */
+static void test_write_busy(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    card.write_busy = 5;
+    start(&h, &card, &(sdio_config_t){ 0 });
+
+    TEST_ASSERT_EQ(sdio_write(&h, 1u, buf, 4u), DRV_OK);
+    TEST_ASSERT(h.programming);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 13u), 0u);
+    TEST_ASSERT_EQ(sdio_sync(&h), DRV_OK);
+    TEST_ASSERT(!h.programming);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 13u), 6u);
+    TEST_ASSERT_EQ(sdio_sync(&h), DRV_OK);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 13u), 6u);
+
+    TEST_ASSERT_EQ(sdio_write(&h, 1u, buf, 1u), DRV_OK);
+    TEST_ASSERT_EQ(sdio_read(&h, 1u, buf, 1u), DRV_OK);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 13u), 12u);
+    teardown(&h);
+}
+
+static void test_errors(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+
+    /* A CRC error partway: reported, the card stopped, the next read fine. */
+    sim_sdio_fault(SDIO, SIM_SDIO_FAULT_DATA_CRC);
+    TEST_ASSERT_EQ(sdio_read(&h, 0u, buf, 8u), DRV_ERR_HW);
+    TEST_ASSERT_EQ(h.crc_errors, 1u);
+    TEST_ASSERT_EQ(sim_sdio_commands(SDIO, 12u), 1u);
+    TEST_ASSERT_EQ(sdio_read(&h, 0u, buf, 8u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, card_data, 8u * SDIO_BLOCK_SIZE);
+
+    sim_sdio_fault(SDIO, SIM_SDIO_FAULT_DATA_CRC);
+    TEST_ASSERT_EQ(sdio_write(&h, 0u, buf, 1u), DRV_ERR_HW);
+    TEST_ASSERT_EQ(h.crc_errors, 2u);
+
+    sim_sdio_fault(SDIO, SIM_SDIO_FAULT_DATA_TIMEOUT);
+    TEST_ASSERT_EQ(sdio_read(&h, 3u, buf, 1u), DRV_ERR_TIMEOUT);
+    TEST_ASSERT_EQ(h.timeouts, 1u);
+
+    sim_sdio_fault(SDIO, SIM_SDIO_FAULT_CMD_TIMEOUT);
+    TEST_ASSERT_EQ(sdio_read(&h, 3u, buf, 1u), DRV_ERR_TIMEOUT);
+    TEST_ASSERT_EQ(sdio_read(&h, 3u, buf, 1u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, &card_data[3u * SDIO_BLOCK_SIZE], SDIO_BLOCK_SIZE);
+
+    /* The stream is the SDIO's to stop: nothing left running. */
+    TEST_ASSERT(!REG_TEST_BITS(h.dma->regs->CR, DMA_SCR_EN));
+    teardown(&h);
+}
+
+/* Completion is raised on the SDIO line too, for an enabled NVIC. */
+static void test_irq(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+    uint32_t irqs;
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+    while (sim_irq_take(SDIO_IRQn)) {
+    }
+    irqs = h.irqs;
+    TEST_ASSERT_EQ(sdio_read(&h, 0u, buf, 2u), DRV_OK);
+    TEST_ASSERT(sim_irq_take(SDIO_IRQn));
+    TEST_ASSERT_EQ(h.irqs - irqs, 1u);
+    TEST_ASSERT_EQ(REG_READ(SDIO->MASK), 0u);
+    teardown(&h);
+}
+
+static void test_blockdev(void)
+{
+    sim_sdio_card_t card;
+    sdio_t h;
+    blockdev_t bd;
+
+    setup(&card, HC_BLOCKS);
+    start(&h, &card, &(sdio_config_t){ 0 });
+    sdio_blockdev(&h, &bd);
+    TEST_ASSERT_EQ(bd.block_count, HC_BLOCKS);
+    TEST_ASSERT_EQ(bd.block_size, SDIO_BLOCK_SIZE);
+
+    fill(ref, 2u * SDIO_BLOCK_SIZE, 0x42u);
+    TEST_ASSERT_EQ(blockdev_write(&bd, 7u, ref, 2u), DRV_OK);
+    TEST_ASSERT_EQ(blockdev_sync(&bd), DRV_OK);
+    TEST_ASSERT_EQ(blockdev_read(&bd, 7u, buf, 2u), DRV_OK);
+    TEST_ASSERT_MEM_EQ(buf, ref, 2u * SDIO_BLOCK_SIZE);
+
+    TEST_ASSERT_EQ(blockdev_read(&bd, HC_BLOCKS, buf, 1u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(blockdev_read(&bd, HC_BLOCKS - 1u, buf, 2u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(blockdev_write(&bd, 0u, NULL, 1u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(blockdev_write(&bd, 0u, ref, 0u), DRV_ERR_PARAM);
+    teardown(&h);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init_sdhc);
+    TEST_RUN(test_init_sdsc);
+    TEST_RUN(test_config);
+    TEST_RUN(test_no_card);
+    TEST_RUN(test_multi_block);
+    TEST_RUN(test_single_block);
+    TEST_RUN(test_unaligned);
+    TEST_RUN(test_split);
+    TEST_RUN(test_write_busy);
+    TEST_RUN(test_errors);
+    TEST_RUN(test_irq);
+    TEST_RUN(test_blockdev);
+    return TEST_RESULT();
+}
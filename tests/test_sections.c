@@ -0,0 +1,143 @@
+/**
+ * @file    test_sections.c
+ * @brief   Startup copy/zero table walk tests.
+ */
+#include "sections.h"
+#include "test.h"
+
+#if defined(STM32_SIM)
+#include "sim.h"
+#endif
+
+static const uint32_t image_a[4] = { 1u, 2u, 3u, 4u };
+static const uint32_t image_b[3] = { 0xA5A5A5A5u, 0u, 0xFFFFFFFFu };
+
+static uint32_t run_a[4 + 1];
+static uint32_t run_b[3 + 1];
+static uint32_t bss_a[8 + 1];
+static uint32_t bss_b[2 + 1];
+
+/* Placement macros compile to plain objects on the host. */
+static STM32_FASTDATA uint32_t fast_data = 7u;
+static STM32_FASTBSS uint32_t fast_bss;
+
+static STM32_RAMFUNC uint32_t fast_add(uint32_t a, uint32_t b)
+{
+    return a + b;
+}
+
+static void test_copy(void)
+{
+    const sections_copy_t table[] = {
+        { image_a, run_a, run_a + 4 },
+        { image_b, run_b, run_b + 3 },
+        { image_a, run_a, run_a },          /* empty */
+    };
+    const sections_copy_t in_place[] = {
+        { run_a, run_a, run_a + 4 },
+    };
+
+    memset(run_a, 0xEE, sizeof(run_a));
+    memset(run_b, 0xEE, sizeof(run_b));
+    sections_copy(table, table + 3);
+    TEST_ASSERT_MEM_EQ(run_a, image_a, sizeof(image_a));
+    TEST_ASSERT_MEM_EQ(run_b, image_b, sizeof(image_b));
+    /* Nothing past the end of a section. */
+    TEST_ASSERT_EQ(run_a[4], 0xEEEEEEEEu);
+    TEST_ASSERT_EQ(run_b[3], 0xEEEEEEEEu);
+
+    /* Executing in place: the section is its own image. */
+    run_a[0] = 42u;
+    sections_copy(in_place, in_place + 1);
+    TEST_ASSERT_EQ(run_a[0], 42u);
+}
+
+static void test_zero(void)
+{
+    const sections_zero_t table[] = {
+        { bss_a, bss_a + 8 },
+        { bss_b, bss_b + 2 },
+    };
+    uint32_t i;
+
+    memset(bss_a, 0xEE, sizeof(bss_a));
+    memset(bss_b, 0xEE, sizeof(bss_b));
+    sections_zero(table, table + 2);
+    for (i = 0; i < 8u; i++) {
+        TEST_ASSERT_EQ(bss_a[i], 0u);
+    }
+    TEST_ASSERT_EQ(bss_b[0] | bss_b[1], 0u);
+    TEST_ASSERT_EQ(bss_a[8], 0xEEEEEEEEu);
+    TEST_ASSERT_EQ(bss_b[2], 0xEEEEEEEEu);
+}
+
+#if defined(STM32_SIM)
+
+/* Big enough for the DMA clear; one word off 16-byte alignment. */
+#define BIG_WORDS   (SECTIONS_DMA_MIN_BYTES / 4u + 7u)
+
+static uint32_t big[BIG_WORDS + 2] STM32_ALIGNED(16);
+
+static void test_run_dma(void)
+{
+    const sections_copy_t copy[] = {
+        { image_a, run_a, run_a + 4 },
+    };
+    const sections_zero_t zero[] = {
+        { bss_a, bss_a + 8 },
+        { big + 1, big + 1 + BIG_WORDS },
+        { bss_b, bss_b + 2 },
+    };
+    const dma_stream_regs_t *st = &DMA2->S[SECTIONS_DMA_STREAM];
+    uint32_t i;
+
+    sim_reset();
+    memset(run_a, 0xEE, sizeof(run_a));
+    memset(bss_a, 0xEE, sizeof(bss_a));
+    memset(bss_b, 0xEE, sizeof(bss_b));
+    memset(big, 0xEE, sizeof(big));
+    sections_run(copy, copy + 1, zero, zero + 3);
+
+    TEST_ASSERT_MEM_EQ(run_a, image_a, sizeof(image_a));
+    for (i = 1; i <= BIG_WORDS; i++) {
+        TEST_ASSERT_EQ(big[i], 0u);
+    }
+    TEST_ASSERT_EQ(big[0], 0xEEEEEEEEu);
+    TEST_ASSERT_EQ(big[BIG_WORDS + 1], 0xEEEEEEEEu);
+    TEST_ASSERT_EQ(bss_a[7] | bss_b[1], 0u);
+    TEST_ASSERT_EQ(bss_a[8], 0xEEEEEEEEu);
+
+    /* The stream and the DMA2 clock are back to reset. */
+    TEST_ASSERT_EQ(REG_READ(st->CR), 0u);
+    TEST_ASSERT_EQ(REG_READ(st->NDTR), 0u);
+    TEST_ASSERT_EQ(REG_READ(st->FCR), 0x21u);
+    TEST_ASSERT_EQ(REG_READ(DMA2->LISR) | REG_READ(DMA2->HISR), 0u);
+    TEST_ASSERT(!REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN));
+
+    /* A clock someone else turned on stays on. */
+    REG_SET_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN);
+    memset(big, 0xEE, sizeof(big));
+    sections_run(copy, copy, zero + 1, zero + 2);
+    TEST_ASSERT_EQ(big[1] | big[BIG_WORDS / 2u] | big[BIG_WORDS], 0u);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB1ENR, RCC_AHB1ENR_DMA2EN));
+}
+
+#endif /* STM32_SIM */
+
+static void test_placement(void)
+{
+    TEST_ASSERT_EQ(fast_data, 7u);
+    TEST_ASSERT_EQ(fast_bss, 0u);
+    TEST_ASSERT_EQ(fast_add(fast_data, 3u), 10u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_copy);
+    TEST_RUN(test_zero);
+#if defined(STM32_SIM)
+    TEST_RUN(test_run_dma);
+#endif
+    TEST_RUN(test_placement);
+    return TEST_RESULT();
+}
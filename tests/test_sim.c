@@ -0,0 +1,128 @@
+/**
+ * @file    test_sim.c
+ * @brief   Register simulator tests.
+ */
+#include "sim.h"
+#include "test.h"
+
+static const sim_reg_t fixture_regs[] = {
+    { .offset = 0x0, .reset = 0x000000F0u, .ro = 0x000000F0u },
+    { .offset = 0x4, .reset = 0x000000FFu, .w0c = 0x0000000Fu, .w1c = 0x000000F0u },
+    { .offset = 0x8, .sc = 0x00000001u },
+};
+
+static uint32_t fixture_kicks;
+
+static void fixture_write(sim_periph_t *p, uint32_t off, uint32_t old, uint32_t val)
+{
+    (void)p;
+    (void)old;
+    if (off == 0x8u && (val & 1u) != 0u) {
+        fixture_kicks++;
+    }
+}
+
+static const sim_model_t fixture_model = {
+    .regs = fixture_regs,
+    .nregs = STM32_ARRAY_SIZE(fixture_regs),
+    .write = fixture_write,
+};
+
+static volatile uint32_t fixture[3];
+
+static void test_attributes(void)
+{
+    sim_reset();
+    fixture_kicks = 0;
+    TEST_ASSERT(sim_attach("FIXTURE", 0x60000000u, (void *)fixture, sizeof(fixture),
+                           &fixture_model) != NULL);
+    TEST_ASSERT_EQ(REG_READ(fixture[0]), 0xF0u);
+    TEST_ASSERT_EQ(REG_READ(fixture[1]), 0xFFu);
+
+    /* Read-only bits keep their value. */
+    REG_WRITE(fixture[0], 0x0000000Fu);
+    TEST_ASSERT_EQ(REG_READ(fixture[0]), 0xFFu);
+
+    /* rc_w0 low nibble, rc_w1 high nibble. */
+    REG_WRITE(fixture[1], 0x0000001Eu);
+    TEST_ASSERT_EQ(REG_READ(fixture[1]), 0xEEu);
+    REG_WRITE(fixture[1], 0x000000F0u);
+    TEST_ASSERT_EQ(REG_READ(fixture[1]), 0x00u);
+
+    /* Self-clearing bit reaches the model, then reads back 0. */
+    REG_WRITE(fixture[2], 0x00000003u);
+    TEST_ASSERT_EQ(fixture_kicks, 1u);
+    TEST_ASSERT_EQ(REG_READ(fixture[2]), 0x2u);
+    TEST_ASSERT(sim_find_base(0x60000000u) != NULL);
+
+    sim_reset();
+    TEST_ASSERT(sim_find_base(0x60000000u) == NULL);
+}
+
+static void test_gpio_bsrr(void)
+{
+    sim_reset();
+    REG_WRITE(GPIOD->ODR, 0x00F0u);
+    REG_WRITE(GPIOD->BSRR, GPIO_BSRR_BS(0) | GPIO_BSRR_BR(4));
+    TEST_ASSERT_EQ(REG_READ(GPIOD->ODR), 0x00E1u);
+    TEST_ASSERT_EQ(REG_READ(GPIOD->BSRR), 0u);
+
+    /* Set wins when a pin is both set and reset. */
+    REG_WRITE(GPIOD->BSRR, GPIO_BSRR_BS(8) | GPIO_BSRR_BR(8));
+    TEST_ASSERT_EQ(REG_READ(GPIOD->ODR) & 0x100u, 0x100u);
+}
+
+static void test_gpio_idr(void)
+{
+    sim_reset();
+    REG_FIELD_WRITE(GPIOC->MODER, GPIO_MODER_MODE(1), GPIO_MODE_OUTPUT);
+    REG_WRITE(GPIOC->BSRR, GPIO_BSRR_BS(1));
+    sim_gpio_set_input(GPIOC, 0x0005u, 0x0005u);
+    TEST_ASSERT_EQ(REG_READ(GPIOC->IDR), 0x0007u);
+
+    /* IDR is read-only. */
+    REG_WRITE(GPIOC->IDR, 0u);
+    TEST_ASSERT_EQ(REG_READ(GPIOC->IDR), 0x0007u);
+
+    TEST_ASSERT_EQ(REG_READ(GPIOA->MODER), 0xA8000000u);
+}
+
+static void test_rcc_ready(void)
+{
+    sim_reset();
+    TEST_ASSERT(REG_TEST_BITS(RCC->CR, RCC_CR_HSIRDY));
+    TEST_ASSERT(!REG_TEST_BITS(RCC->CR, RCC_CR_HSERDY));
+
+    REG_SET_BITS(RCC->CR, RCC_CR_HSEON);
+    TEST_ASSERT(REG_TEST_BITS(RCC->CR, RCC_CR_HSERDY));
+
+    /* READY flags cannot be forced by software. */
+    REG_WRITE(RCC->CR, RCC_CR_HSION | RCC_CR_PLLRDY);
+    TEST_ASSERT_EQ(REG_READ(RCC->CR) & (RCC_CR_PLLRDY | RCC_CR_HSERDY), 0u);
+
+    REG_FIELD_WRITE(RCC->CFGR, RCC_CFGR_SW, RCC_CFGR_SW_PLL);
+    TEST_ASSERT_EQ(REG_FIELD_READ(RCC->CFGR, RCC_CFGR_SWS), RCC_CFGR_SW_PLL);
+}
+
+static void test_irq_and_stats(void)
+{
+    sim_reset();
+    TEST_ASSERT(!sim_irq_pending(USART2_IRQn));
+    sim_irq_raise(USART2_IRQn);
+    TEST_ASSERT(sim_irq_take(USART2_IRQn));
+    TEST_ASSERT(!sim_irq_take(USART2_IRQn));
+
+    REG_WRITE(GPIOE->BSRR, GPIO_BSRR_BS(3));
+    TEST_ASSERT_EQ(sim_stats.writes, 1u);
+    TEST_ASSERT_EQ(sim_stats.reads, 0u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_attributes);
+    TEST_RUN(test_gpio_bsrr);
+    TEST_RUN(test_gpio_idr);
+    TEST_RUN(test_rcc_ready);
+    TEST_RUN(test_irq_and_stats);
+    return TEST_RESULT();
+}
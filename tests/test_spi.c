@@ -0,0 +1,221 @@
+/**
+ * @file    test_spi.c
+ * @brief   SPI driver tests: loopback DMA, transaction queue, CS handling.
+ */
+#include "sim.h"
+#include "spi.h"
+#include "test.h"
+
+#define PIN_A   0u
+#define PIN_B   1u
+
+typedef struct {
+    uint16_t mosi;
+    uint8_t cs;         /* Bit 0: A selected, bit 1: B selected. */
+} frame_log_t;
+
+static frame_log_t frames[256];
+static uint32_t nframes;
+static uint32_t done_order[8];
+static drv_status_t done_status[8];
+static uint32_t ndone;
+
+/* Two devices on one bus: A answers mosi + 1, B answers ~mosi. */
+static uint16_t two_devices(void *ctx, uint16_t mosi)
+{
+    uint32_t odr = stm32_host_GPIOB.ODR;
+    uint8_t cs = (uint8_t)((~odr) & 3u);
+
+    (void)ctx;
+    if (nframes < STM32_ARRAY_SIZE(frames)) {
+        frames[nframes++] = (frame_log_t){ mosi, cs };
+    }
+    if (cs == 1u) {
+        return (uint16_t)(mosi + 1u);
+    }
+    if (cs == 2u) {
+        return (uint16_t)~mosi;
+    }
+    return 0xFFFFu;
+}
+
+static void done(void *ctx, spi_xfer_t *x, drv_status_t status)
+{
+    (void)x;
+    if (ndone < STM32_ARRAY_SIZE(done_order)) {
+        done_status[ndone] = status;
+        done_order[ndone++] = (uint32_t)(uintptr_t)ctx;
+    }
+}
+
+static void service(spi_bus_t *bus)
+{
+    bool again = true;
+
+    while (again) {
+        again = false;
+        if (sim_irq_take(bus->rx->irqn)) {
+            dma_irq(bus->rx->dma, bus->rx->stream);
+            again = true;
+        }
+        if (sim_irq_take(bus->tx->irqn)) {
+            dma_irq(bus->tx->dma, bus->tx->stream);
+            again = true;
+        }
+    }
+}
+
+static void setup(spi_bus_t *bus, spi_dev_t *a, spi_dev_t *b)
+{
+    const spi_config_t cfg = { .pclk_hz = 84000000u, .fill = 0xFFFFu };
+
+    sim_reset();
+    nframes = 0;
+    ndone = 0;
+    TEST_ASSERT_EQ(spi_init(bus, SPI1, &cfg), DRV_OK);
+    *a = (spi_dev_t){ .cs_port = GPIOB, .cs_pin = PIN_A, .max_hz = 10000000u };
+    *b = (spi_dev_t){ .cs_port = GPIOB, .cs_pin = PIN_B, .mode = 3u,
+                      .frame16 = true, .max_hz = 42000000u };
+    TEST_ASSERT_EQ(spi_dev_init(a, bus), DRV_OK);
+    TEST_ASSERT_EQ(spi_dev_init(b, bus), DRV_OK);
+}
+
+static void test_dev_init(void)
+{
+    spi_bus_t bus;
+    spi_dev_t a;
+    spi_dev_t b;
+
+    setup(&bus, &a, &b);
+    /* 84 MHz / 16 = 5.25 MHz is the fastest setting at or below 10 MHz. */
+    TEST_ASSERT_EQ(reg_field_get(a.cr1, SPI_CR1_BR), 3u);
+    TEST_ASSERT_EQ(reg_field_get(b.cr1, SPI_CR1_BR), 0u);
+    TEST_ASSERT((b.cr1 & (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_DFF)) ==
+                (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_DFF));
+    /* CS idles high as an output. */
+    TEST_ASSERT_EQ(REG_READ(GPIOB->ODR) & 3u, 3u);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(GPIOB->MODER), GPIO_MODER_MODE(PIN_B)),
+                   GPIO_MODE_OUTPUT);
+    TEST_ASSERT(REG_TEST_BITS(RCC->APB2ENR, RCC_APB2ENR_SPI1EN));
+
+    a.max_hz = 100000u;
+    TEST_ASSERT_EQ(spi_dev_init(&a, &bus), DRV_ERR_PARAM);
+    spi_deinit(&bus);
+}
+
+static void test_loopback(void)
+{
+    static const uint8_t msg[] = "full duplex over DMA";
+    uint8_t in[sizeof(msg)];
+    spi_seg_t seg = { .tx = msg, .rx = in, .len = sizeof(msg) };
+    spi_xfer_t x = { .segs = &seg, .nsegs = 1, .cb = done };
+    spi_bus_t bus;
+    spi_dev_t a;
+    spi_dev_t b;
+
+    setup(&bus, &a, &b);
+    x.dev = &a;
+    memset(in, 0, sizeof(in));
+    TEST_ASSERT_EQ(spi_submit(&x), DRV_OK);
+    service(&bus);
+    TEST_ASSERT_EQ(ndone, 1u);
+    TEST_ASSERT_EQ(done_status[0], DRV_OK);
+    TEST_ASSERT_MEM_EQ(in, msg, sizeof(msg));
+    TEST_ASSERT(!spi_busy(&bus));
+    TEST_ASSERT(!REG_TEST_BITS(SPI1->SR, SPI_SR_OVR));
+    TEST_ASSERT_EQ(REG_READ(GPIOB->ODR) & 3u, 3u);
+
+    /* Polled path shares the instance. */
+    TEST_ASSERT_EQ(spi_exchange(&bus, &a, 0x5Au), 0x5Au);
+    spi_deinit(&bus);
+}
+
+static void test_queue_and_cs(void)
+{
+    static const uint8_t cmd_a[2] = { 0x03, 0x10 };
+    static const uint16_t cmd_b = 0x1234;
+    uint8_t resp_a[3];
+    uint16_t resp_b[2];
+    uint8_t resp_a2[2];
+    const spi_seg_t segs_a[2] = {
+        { .tx = cmd_a, .len = 2 },                  /* command, reply dropped */
+        { .rx = resp_a, .len = 3 },                 /* payload, fill sent */
+    };
+    const spi_seg_t segs_b[1] = { { .tx = &cmd_b, .rx = resp_b, .len = 1 } };
+    const spi_seg_t segs_a2[1] = { { .tx = cmd_a, .rx = resp_a2, .len = 2 } };
+    spi_xfer_t x1 = { .segs = segs_a, .nsegs = 2, .cb = done, .ctx = (void *)1,
+                      .flags = SPI_XFER_KEEP_CS };
+    spi_xfer_t x2 = { .segs = segs_a2, .nsegs = 1, .cb = done, .ctx = (void *)2 };
+    spi_xfer_t x3 = { .segs = segs_b, .nsegs = 1, .cb = done, .ctx = (void *)3 };
+    spi_bus_t bus;
+    spi_dev_t a;
+    spi_dev_t b;
+    uint32_t i;
+
+    setup(&bus, &a, &b);
+    sim_spi_attach(SPI1, two_devices, NULL);
+    x1.dev = &a;
+    x2.dev = &a;
+    x3.dev = &b;
+
+    TEST_ASSERT_EQ(spi_submit(&x1), DRV_OK);
+    TEST_ASSERT_EQ(spi_submit(&x2), DRV_OK);
+    TEST_ASSERT_EQ(spi_submit(&x3), DRV_OK);
+    TEST_ASSERT(spi_busy(&bus));
+    service(&bus);
+
+    TEST_ASSERT_EQ(ndone, 3u);
+    for (i = 0; i < 3u; i++) {
+        TEST_ASSERT_EQ(done_order[i], i + 1u);
+        TEST_ASSERT_EQ(done_status[i], DRV_OK);
+    }
+    /* 2 + 3 frames for x1, 2 for x2, 1 for x3; exactly one CS low each. */
+    TEST_ASSERT_EQ(nframes, 8u);
+    for (i = 0; i < 7u; i++) {
+        TEST_ASSERT_EQ(frames[i].cs, 1u);
+    }
+    TEST_ASSERT_EQ(frames[7].cs, 2u);
+    TEST_ASSERT_EQ(frames[2].mosi, 0xFFu);          /* fill frame, 8-bit */
+    TEST_ASSERT_EQ(resp_a[0], 0x00u);               /* 0xFF + 1, truncated */
+    TEST_ASSERT_EQ(resp_a2[0], 0x04u);
+    TEST_ASSERT_EQ(resp_a2[1], 0x11u);
+    TEST_ASSERT_EQ(frames[7].mosi, 0x1234u);
+    TEST_ASSERT_EQ(resp_b[0], 0xEDCBu);
+    TEST_ASSERT_EQ(REG_READ(GPIOB->ODR) & 3u, 3u);
+    TEST_ASSERT(!REG_TEST_BITS(SPI1->SR, SPI_SR_OVR));
+    spi_deinit(&bus);
+}
+
+static void test_packing16(void)
+{
+    uint32_t out[4] = { 0x11112222u, 0x33334444u, 0x55556666u, 0x77778888u };
+    uint32_t in[4] = { 0 };
+    spi_seg_t seg = { .tx = out, .rx = in, .len = 8 };
+    spi_xfer_t x = { .segs = &seg, .nsegs = 1, .cb = done };
+    spi_bus_t bus;
+    spi_dev_t a;
+    spi_dev_t b;
+
+    setup(&bus, &a, &b);
+    x.dev = &b;
+    TEST_ASSERT_EQ(spi_submit(&x), DRV_OK);
+    /* Memory side moves words, peripheral side half-words. */
+    TEST_ASSERT_EQ(reg_field_get(bus.tx->cr, DMA_SCR_MSIZE), DMA_SIZE_WORD);
+    TEST_ASSERT_EQ(reg_field_get(bus.tx->cr, DMA_SCR_PSIZE), DMA_SIZE_HALFWORD);
+    TEST_ASSERT_EQ(reg_field_get(bus.rx->cr, DMA_SCR_MSIZE), DMA_SIZE_WORD);
+    service(&bus);
+    TEST_ASSERT_EQ(ndone, 1u);
+    TEST_ASSERT_EQ(sim_spi_frames(SPI1), 8u);
+    TEST_ASSERT_MEM_EQ(in, out, sizeof(out));
+    TEST_ASSERT(REG_TEST_BITS(SPI1->CR1, SPI_CR1_DFF));
+    spi_deinit(&bus);
+}
+
+int main(void)
+{
+    TEST_RUN(test_dev_init);
+    TEST_RUN(test_loopback);
+    TEST_RUN(test_queue_and_cs);
+    TEST_RUN(test_packing16);
+    return TEST_RESULT();
+}
@@ -0,0 +1,272 @@
+/**
+ * @file    test_timebase.c
+ * @brief   Time base tests: 64-bit time across half periods and wraps with
+ *          the interrupt late, timer wheel ordering, far timers, periodic
+ *          timers, past deadlines and stops from callbacks.
+ */
+#include "sim.h"
+#include "test.h"
+#include "timebase.h"
+
+#define HZ          1000000u
+#define WRAP        ((uint64_t)1 << 32)
+#define HORIZON     ((uint64_t)TIMEBASE_WHEEL_SLOTS << TIMEBASE_SLOT_SHIFT)
+
+static uint32_t nfired;
+static uint32_t fired_id[16];
+static uint64_t fired_at[16];
+static timebase_timer_t *victim;
+
+static void record(timebase_timer_t *t, void *ctx)
+{
+    (void)t;
+    if (nfired < STM32_ARRAY_SIZE(fired_id)) {
+        fired_id[nfired] = (uint32_t)(uintptr_t)ctx;
+        fired_at[nfired] = timebase_now();
+    }
+    nfired++;
+}
+
+static void stop_victim(timebase_timer_t *t, void *ctx)
+{
+    record(t, ctx);
+    TEST_ASSERT(timebase_timer_stop(victim));
+}
+
+static void service(void)
+{
+    while (sim_irq_take(TIM5_IRQn)) {
+        timebase_irq();
+    }
+}
+
+/*
+ * Let time pass, taking the interrupt at every armed deadline and at least
+ * every quarter counter period on the way.
+ */
+static void elapse(uint64_t ticks)
+{
+    while (ticks != 0u) {
+        uint64_t now = timebase_now();
+        uint64_t next = timebase_next_deadline();
+        uint64_t step = (ticks < 0x40000000u) ? ticks : 0x40000000u;
+
+        if (next > now && next - now < step) {
+            step = next - now;
+        }
+        sim_tim_advance(TIM5, step);
+        ticks -= step;
+        service();
+    }
+}
+
+static void setup(void)
+{
+    sim_reset();
+    nfired = 0;
+    TEST_ASSERT_EQ(timebase_init(TIM5, HZ), DRV_OK);
+}
+
+static void test_init(void)
+{
+    sim_reset();
+    TEST_ASSERT_EQ(timebase_init(TIM3, HZ), DRV_ERR_PARAM);     /* 16-bit */
+    TEST_ASSERT_EQ(timebase_init(TIM5, 3000000u), DRV_ERR_PARAM);
+    TEST_ASSERT_EQ(timebase_init(TIM5, 100u), DRV_ERR_PARAM);   /* PSC > 16 bits */
+    TEST_ASSERT_EQ(timebase_init(TIM5, 0u), DRV_OK);
+    TEST_ASSERT_EQ(timebase_hz(), 16000000u);
+
+    TEST_ASSERT_EQ(timebase_init(TIM5, HZ), DRV_OK);
+    TEST_ASSERT_EQ(timebase_hz(), HZ);
+    TEST_ASSERT_EQ(timebase_irqn(), TIM5_IRQn);
+    TEST_ASSERT_EQ(REG_READ(TIM5->PSC), 15u);
+    TEST_ASSERT_EQ(REG_READ(TIM5->ARR), 0xFFFFFFFFu);
+    TEST_ASSERT_EQ(REG_READ(TIM5->CCR[1]), 0x80000000u);
+    TEST_ASSERT(REG_TEST_BITS(TIM5->CR1, TIM_CR1_CEN));
+    TEST_ASSERT_EQ(REG_READ(TIM5->DIER), TIM_DIER_UIE | TIM_DIER_CCIE(2));
+    TEST_ASSERT_EQ(timebase_now(), 0u);
+    TEST_ASSERT_EQ(timebase_next_deadline(), UINT64_MAX);
+
+    TEST_ASSERT_EQ(timebase_us(1u), 1u);
+    TEST_ASSERT_EQ(timebase_us(2500000u), 2500000u);
+    TEST_ASSERT_EQ(timebase_ns(1500000u), 1500000000u);
+}
+
+static void test_now(void)
+{
+    uint32_t i;
+
+    setup();
+    sim_tim_advance(TIM5, 1234u);
+    TEST_ASSERT_EQ(timebase_now(), 1234u);
+
+    /* Half period passed, interrupt not taken yet: the reader corrects. */
+    sim_tim_advance(TIM5, 0x80000000u - 1234u + 5u);
+    TEST_ASSERT(sim_irq_pending(TIM5_IRQn));
+    TEST_ASSERT_EQ(timebase_now(), 0x80000005u);
+    service();
+    TEST_ASSERT_EQ(timebase_now(), 0x80000005u);
+
+    /* Same across the wrap. */
+    sim_tim_advance(TIM5, 0x80000000u);
+    TEST_ASSERT(sim_irq_pending(TIM5_IRQn));
+    TEST_ASSERT_EQ(timebase_now(), WRAP + 5u);
+    service();
+    TEST_ASSERT_EQ(timebase_now(), WRAP + 5u);
+
+    for (i = 0; i < 6u; i++) {
+        sim_tim_advance(TIM5, 0x80000000u);
+        service();
+    }
+    TEST_ASSERT_EQ(timebase_now(), 4u * WRAP + 5u);
+}
+
+static void test_order(void)
+{
+    timebase_timer_t t[4];
+    uint32_t i;
+
+    setup();
+    for (i = 0; i < 4u; i++) {
+        timebase_timer_init(&t[i], record, (void *)(uintptr_t)i);
+    }
+    TEST_ASSERT_EQ(timebase_timer_start(&t[0], 300u, 0u), DRV_OK);
+    TEST_ASSERT_EQ(timebase_timer_start(&t[1], 100u, 0u), DRV_OK);
+    TEST_ASSERT_EQ(timebase_timer_start(&t[2], 50000u, 0u), DRV_OK);
+    TEST_ASSERT_EQ(timebase_timer_start(&t[3], 299u, 0u), DRV_OK);
+    TEST_ASSERT_EQ(timebase_next_deadline(), 100u);
+    TEST_ASSERT_EQ(REG_READ(TIM5->CCR[0]), 100u);
+    TEST_ASSERT(timebase_timer_pending(&t[2]));
+
+    elapse(60000u);
+    TEST_ASSERT_EQ(nfired, 4u);
+    TEST_ASSERT_EQ(fired_id[0], 1u);
+    TEST_ASSERT_EQ(fired_at[0], 100u);
+    TEST_ASSERT_EQ(fired_id[1], 3u);
+    TEST_ASSERT_EQ(fired_at[1], 299u);
+    TEST_ASSERT_EQ(fired_id[2], 0u);
+    TEST_ASSERT_EQ(fired_at[2], 300u);
+    TEST_ASSERT_EQ(fired_id[3], 2u);
+    TEST_ASSERT_EQ(fired_at[3], 50000u);
+    TEST_ASSERT(!timebase_timer_pending(&t[2]));
+    TEST_ASSERT_EQ(timebase_next_deadline(), UINT64_MAX);
+    TEST_ASSERT(!REG_TEST_BITS(TIM5->DIER, TIM_DIER_CCIE(1)));
+
+    /* Late interrupt: both due timers run, earliest first. */
+    nfired = 0;
+    (void)timebase_timer_after(&t[0], 700u, 0u);
+    (void)timebase_timer_after(&t[1], 500u, 0u);
+    sim_tim_advance(TIM5, 1000u);
+    service();
+    TEST_ASSERT_EQ(nfired, 2u);
+    TEST_ASSERT_EQ(fired_id[0], 1u);
+    TEST_ASSERT_EQ(fired_id[1], 0u);
+}
+
+static void test_far(void)
+{
+    timebase_timer_t near;
+    timebase_timer_t far;
+    timebase_timer_t later;
+
+    setup();
+    timebase_timer_init(&near, record, (void *)1);
+    timebase_timer_init(&far, record, (void *)2);
+    timebase_timer_init(&later, record, (void *)3);
+    (void)timebase_timer_start(&far, 3u * HORIZON + 17u, 0u);
+    (void)timebase_timer_start(&later, 5u * WRAP + 3u, 0u);
+    (void)timebase_timer_start(&near, HORIZON / 2u, 0u);
+    TEST_ASSERT_EQ(timebase_next_deadline(), HORIZON / 2u);
+
+    elapse(4u * HORIZON);
+    TEST_ASSERT_EQ(nfired, 2u);
+    TEST_ASSERT_EQ(fired_at[0], HORIZON / 2u);
+    TEST_ASSERT_EQ(fired_id[1], 2u);
+    TEST_ASSERT_EQ(fired_at[1], 3u * HORIZON + 17u);
+
+    /* Several counter wraps away: early compare matches are re-armed. */
+    elapse(5u * WRAP);
+    TEST_ASSERT_EQ(nfired, 3u);
+    TEST_ASSERT_EQ(fired_id[2], 3u);
+    TEST_ASSERT_EQ(fired_at[2], 5u * WRAP + 3u);
+}
+
+static void test_periodic(void)
+{
+    timebase_timer_t t;
+    uint32_t i;
+
+    setup();
+    timebase_timer_init(&t, record, NULL);
+    (void)timebase_timer_after(&t, 1000u, 1000u);
+    elapse(5500u);
+    TEST_ASSERT_EQ(nfired, 5u);
+    for (i = 0; i < 5u; i++) {
+        TEST_ASSERT_EQ(fired_at[i], 1000u * (i + 1u));
+    }
+    TEST_ASSERT(timebase_timer_stop(&t));
+    TEST_ASSERT(!timebase_timer_stop(&t));
+    elapse(5000u);
+    TEST_ASSERT_EQ(nfired, 5u);
+}
+
+static void test_past(void)
+{
+    timebase_timer_t t;
+
+    setup();
+    sim_tim_advance(TIM5, 1000u);
+    timebase_timer_init(&t, record, NULL);
+    (void)timebase_timer_start(&t, 10u, 0u);
+    /* Nothing will match: the interrupt is pended instead. */
+    TEST_ASSERT(sim_irq_pending(TIM5_IRQn));
+    service();
+    TEST_ASSERT_EQ(nfired, 1u);
+    TEST_ASSERT_EQ(fired_at[0], 1000u);
+}
+
+static void test_stop_in_callback(void)
+{
+    timebase_timer_t a;
+    timebase_timer_t b;
+
+    setup();
+    timebase_timer_init(&a, stop_victim, (void *)1);
+    timebase_timer_init(&b, record, (void *)2);
+    victim = &b;
+    (void)timebase_timer_start(&a, 100u, 0u);
+    (void)timebase_timer_start(&b, 101u, 0u);
+    /* Both expire in one interrupt; a runs first and stops b. */
+    sim_tim_advance(TIM5, 200u);
+    service();
+    TEST_ASSERT_EQ(nfired, 1u);
+    TEST_ASSERT_EQ(fired_id[0], 1u);
+    TEST_ASSERT(!timebase_timer_pending(&b));
+}
+
+static void test_deinit(void)
+{
+    timebase_timer_t t;
+
+    setup();
+    timebase_timer_init(&t, record, NULL);
+    (void)timebase_timer_after(&t, 100u, 0u);
+    timebase_deinit();
+    TEST_ASSERT(!timebase_timer_pending(&t));
+    TEST_ASSERT(!REG_TEST_BITS(TIM5->CR1, TIM_CR1_CEN));
+    TEST_ASSERT(!REG_TEST_BITS(RCC->APB1ENR, RCC_APB1ENR_TIM5EN));
+    TEST_ASSERT_EQ(timebase_timer_after(&t, 100u, 0u), DRV_ERR_PARAM);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init);
+    TEST_RUN(test_now);
+    TEST_RUN(test_order);
+    TEST_RUN(test_far);
+    TEST_RUN(test_periodic);
+    TEST_RUN(test_past);
+    TEST_RUN(test_stop_in_callback);
+    TEST_RUN(test_deinit);
+    return TEST_RESULT();
+}
@@ -0,0 +1,204 @@
+/**
+ * @file    test_usart.c
+ * @brief   USART driver tests: baud rate, polled TX, DMA circular RX.
+ */
+#include <stdlib.h>
+
+#include "sim.h"
+#include "test.h"
+#include "usart.h"
+
+#define RX_BUF_SIZE     64u
+#define STREAM_LEN      20000u
+
+static uint8_t rx_buf[RX_BUF_SIZE];
+static uint8_t stream[STREAM_LEN];
+static uint8_t received[STREAM_LEN];
+static size_t received_len;
+static uint32_t callbacks;
+static bool span_outside;
+
+static void collect(void *ctx, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    callbacks++;
+    if (data < rx_buf || data + len > rx_buf + RX_BUF_SIZE || len == 0u) {
+        span_outside = true;
+    }
+    if (received_len + len <= STREAM_LEN) {
+        memcpy(received + received_len, data, len);
+    }
+    received_len += len;
+}
+
+static void start_rx(usart_dma_rx_t *rx)
+{
+    const usart_config_t cfg = { .pclk_hz = 42000000u, .baud = 2000000u };
+    const usart_dma_rx_config_t dcfg = {
+        .buf = rx_buf, .size = RX_BUF_SIZE, .cb = collect,
+    };
+
+    sim_reset();
+    received_len = 0;
+    callbacks = 0;
+    span_outside = false;
+    TEST_ASSERT_EQ(usart_init(USART2, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(usart_dma_rx_start(rx, USART2, &dcfg), DRV_OK);
+}
+
+static void service(usart_dma_rx_t *rx)
+{
+    if (sim_irq_take(rx->dma->irqn)) {
+        dma_irq(rx->dma->dma, rx->dma->stream);
+    }
+    if (sim_irq_take(USART2_IRQn)) {
+        usart_dma_rx_usart_irq(rx);
+    }
+}
+
+static void test_baud(void)
+{
+    usart_config_t cfg = { .pclk_hz = 42000000u, .baud = 115200u };
+
+    sim_reset();
+    TEST_ASSERT_EQ(usart_init(USART2, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(REG_READ(USART2->BRR), 0x16Du);
+    TEST_ASSERT(REG_TEST_BITS(RCC->APB1ENR, RCC_APB1ENR_USART2EN));
+
+    /* 4 Mbaud from 42 MHz needs oversampling by 8: USARTDIV = 1.3125
+     * becomes mantissa 1, fraction 3/8 (BRR[2:0] in 1/8 units). */
+    cfg.baud = 4000000u;
+    TEST_ASSERT_EQ(usart_init(USART2, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(REG_READ(USART2->BRR), 0x013u);
+    TEST_ASSERT(REG_TEST_BITS(USART2->CR1, USART_CR1_OVER8));
+
+    cfg.baud = 6000000u;
+    TEST_ASSERT_EQ(usart_init(USART2, &cfg), DRV_ERR_PARAM);
+}
+
+static void test_polled_tx(void)
+{
+    const usart_config_t cfg = { .pclk_hz = 84000000u, .baud = 115200u };
+    uint8_t out[8];
+
+    sim_reset();
+    TEST_ASSERT_EQ(usart_init(USART1, &cfg), DRV_OK);
+    usart_write(USART1, (const uint8_t *)"hello", 5);
+    TEST_ASSERT_EQ(sim_usart_tx_take(USART1, out, sizeof(out)), 5u);
+    TEST_ASSERT_MEM_EQ(out, "hello", 5);
+}
+
+static void test_txq(void)
+{
+    const usart_config_t cfg = { .pclk_hz = 84000000u, .baud = 921600u };
+    uint8_t storage[32];
+    uint8_t msg[200];
+    uint8_t out[256];
+    usart_txq_t q;
+    uint32_t queued = 0;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(msg); i++) {
+        msg[i] = (uint8_t)(i * 7u);
+    }
+    sim_reset();
+    TEST_ASSERT_EQ(usart_init(USART6, &cfg), DRV_OK);
+    TEST_ASSERT_EQ(usart_txq_init(&q, USART6, storage, sizeof(storage)), DRV_OK);
+
+    while (queued < sizeof(msg)) {
+        uint32_t n = usart_txq_write(&q, msg + queued, sizeof(msg) - queued);
+
+        /* A full queue accepts nothing until the ISR drains it. */
+        TEST_ASSERT(n <= sizeof(storage));
+        queued += n;
+        if (sim_irq_take(USART6_IRQn)) {
+            usart_txq_irq(&q);
+        }
+    }
+    while (sim_irq_take(USART6_IRQn)) {
+        usart_txq_irq(&q);
+    }
+    TEST_ASSERT(!REG_TEST_BITS(USART6->CR1, USART_CR1_TXEIE));
+    TEST_ASSERT_EQ(sim_usart_tx_take(USART6, out, sizeof(out)), sizeof(msg));
+    TEST_ASSERT_MEM_EQ(out, msg, sizeof(msg));
+}
+
+static void test_dma_rx_idle_only(void)
+{
+    usart_dma_rx_t rx;
+
+    start_rx(&rx);
+    /* USART2 RX has a single route: DMA1 stream 5, channel 4. */
+    TEST_ASSERT(rx.dma->regs == &DMA1->S[5]);
+    TEST_ASSERT_EQ(reg_field_get(REG_READ(DMA1->S[5].CR), DMA_SCR_CHSEL), 4u);
+    sim_usart_rx(USART2, (const uint8_t *)"abc", 3);
+    service(&rx);
+    /* Below half a buffer nothing fires until the line goes idle. */
+    TEST_ASSERT_EQ(callbacks, 0u);
+    sim_usart_idle(USART2);
+    service(&rx);
+    TEST_ASSERT_EQ(callbacks, 1u);
+    TEST_ASSERT_EQ(received_len, 3u);
+    TEST_ASSERT_MEM_EQ(received, "abc", 3);
+    TEST_ASSERT_EQ(rx.tail, 3u);
+    usart_dma_rx_stop(&rx);
+}
+
+static void test_dma_rx_random_stream(void)
+{
+    usart_dma_rx_t rx;
+    uint32_t idles = 0;
+    size_t i;
+
+    srand(12345);
+    for (i = 0; i < STREAM_LEN; i++) {
+        stream[i] = (uint8_t)rand();
+    }
+
+    start_rx(&rx);
+    for (i = 0; i < STREAM_LEN; i++) {
+        sim_usart_rx(USART2, &stream[i], 1);
+        service(&rx);
+        if (rand() % 37 == 0) {
+            sim_usart_idle(USART2);
+            idles++;
+            service(&rx);
+        }
+    }
+    sim_usart_idle(USART2);
+    service(&rx);
+
+    TEST_ASSERT_EQ(received_len, STREAM_LEN);
+    TEST_ASSERT_MEM_EQ(received, stream, STREAM_LEN);
+    TEST_ASSERT(!span_outside);
+    TEST_ASSERT(!REG_TEST_BITS(USART2->SR, USART_SR_ORE));
+    /* Only HT, TC and IDLE events reach the application: at most two spans
+     * per event, never one call per byte. */
+    TEST_ASSERT(callbacks <= 2u * (2u * STREAM_LEN / RX_BUF_SIZE + idles + 1u));
+
+    usart_dma_rx_stop(&rx);
+    TEST_ASSERT(!REG_TEST_BITS(DMA1->S[5].CR, DMA_SCR_EN));
+    TEST_ASSERT(!REG_TEST_BITS(USART2->CR3, USART_CR3_DMAR));
+}
+
+static void test_dma_rx_stop_flushes(void)
+{
+    usart_dma_rx_t rx;
+
+    start_rx(&rx);
+    sim_usart_rx(USART2, (const uint8_t *)"xyz", 3);
+    usart_dma_rx_stop(&rx);
+    TEST_ASSERT_EQ(received_len, 3u);
+    TEST_ASSERT_MEM_EQ(received, "xyz", 3);
+}
+
+int main(void)
+{
+    TEST_RUN(test_baud);
+    TEST_RUN(test_polled_tx);
+    TEST_RUN(test_txq);
+    TEST_RUN(test_dma_rx_idle_only);
+    TEST_RUN(test_dma_rx_random_stream);
+    TEST_RUN(test_dma_rx_stop_flushes);
+    return TEST_RESULT();
+}
@@ -0,0 +1,443 @@
+/**
+ * @file    test_usb.c
+ * @brief   USB device core tests: clock and FIFO checks, enumeration
+ *          against a simulated host, control transfers with short, exact
+ *          and zero-length-terminated data stages, endpoint halt and bus
+ *          reset.
+ */
+#include <string.h>
+
+#include "rcc.h"
+#include "sim.h"
+#include "test.h"
+#include "usb.h"
+
+#define TEST_CONFIG_LEN     64u     /* One EP0 packet exactly: needs a ZLP. */
+
+static const uint8_t device_desc[18] = {
+    18u, USB_DESC_DEVICE, 0x00u, 0x02u, 0xFFu, 0u, 0u, USB_EP0_MPS,
+    0x83u, 0x04u, 0x40u, 0x57u, 0x00u, 0x01u, 1u, 2u, 0u, 1u,
+};
+
+static const uint8_t config_desc[TEST_CONFIG_LEN] = {
+    9u, USB_DESC_CONFIG, TEST_CONFIG_LEN, 0u, 1u, 7u, 0u, 0xC0u, 0u,
+    9u, USB_DESC_INTERFACE, 0u, 0u, 2u, 0xFFu, 0u, 0u, 0u,
+    /* Vendor-specific padding descriptor. */
+    32u, 0x41u, 1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u, 9u, 10u, 11u, 12u, 13u, 14u,
+    15u, 16u, 17u, 18u, 19u, 20u, 21u, 22u, 23u, 24u, 25u, 26u, 27u, 28u, 29u, 30u,
+    7u, USB_DESC_ENDPOINT, 0x81u, USB_EP_BULK, 64u, 0u, 0u,
+    7u, USB_DESC_ENDPOINT, 0x01u, USB_EP_BULK, 64u, 0u, 0u,
+};
+
+static const char *const strings[] = { "Acme", "Widget" };
+
+/* What the test class saw. */
+static struct {
+    uint8_t config;
+    uint32_t configures;
+    uint8_t out[USB_EP0_BUF];
+    uint16_t out_len;
+    uint8_t rx[256];
+    uint32_t rx_len;
+    uint32_t rx_done;
+    uint32_t tx_done;
+} seen;
+
+static uint8_t vendor_reply[100];
+
+static drv_status_t cls_configure(usb_dev_t *d, uint8_t config)
+{
+    drv_status_t rc = DRV_OK;
+
+    seen.config = config;
+    seen.configures++;
+    if (config != 0u) {
+        rc = usb_ep_open(d, 0x81u, USB_EP_BULK, 64u);
+        if (rc == DRV_OK) {
+            rc = usb_ep_open(d, 0x01u, USB_EP_BULK, 64u);
+        }
+    }
+    return rc;
+}
+
+static drv_status_t cls_setup(usb_dev_t *d, const usb_setup_t *req, const uint8_t **data,
+                              uint16_t *len)
+{
+    (void)d;
+    if ((req->bmRequestType & USB_REQ_TYPE_MASK) != USB_REQ_TYPE_VENDOR) {
+        return DRV_ERR_PARAM;
+    }
+    switch (req->bRequest) {
+    case 1u:                        /* Read vendor_reply. */
+        *data = vendor_reply;
+        *len = (uint16_t)req->wValue;
+        return DRV_OK;
+    case 2u:                        /* Write up to USB_EP0_BUF bytes. */
+        return DRV_OK;
+    default:
+        return DRV_ERR_PARAM;
+    }
+}
+
+static void cls_ctrl_out(usb_dev_t *d, const usb_setup_t *req, const uint8_t *data,
+                         uint16_t len)
+{
+    (void)d;
+    (void)req;
+    memcpy(seen.out, data, len);
+    seen.out_len = len;
+}
+
+static void cls_rx(usb_dev_t *d, uint8_t ep, uint32_t len)
+{
+    (void)ep;
+    seen.rx_len += usb_ep_read(d, &seen.rx[seen.rx_len], len);
+}
+
+static void cls_rx_done(usb_dev_t *d, uint8_t ep)
+{
+    (void)d;
+    (void)ep;
+    seen.rx_done++;
+}
+
+static void cls_tx_done(usb_dev_t *d, uint8_t ep)
+{
+    (void)d;
+    (void)ep;
+    seen.tx_done++;
+}
+
+static const usb_class_t test_class = {
+    .configure = cls_configure,
+    .setup = cls_setup,
+    .ctrl_out = cls_ctrl_out,
+    .rx = cls_rx,
+    .rx_done = cls_rx_done,
+    .tx_done = cls_tx_done,
+};
+
+static const usb_config_t test_cfg = {
+    .cls = &test_class,
+    .device_desc = device_desc,
+    .config_desc = config_desc,
+    .strings = strings,
+    .nstrings = 2u,
+    .tx_fifo_words = { 16u, 32u },
+};
+
+static void service(usb_dev_t *d)
+{
+    while (sim_irq_take(OTG_FS_IRQn)) {
+        usb_irq(d);
+    }
+}
+
+static void clock_48mhz(void)
+{
+    const rcc_request_t req = { .hse_hz = 8000000u, .need_48mhz = true };
+    rcc_plan_t plan;
+
+    TEST_ASSERT_EQ(rcc_solve(&req, &plan), DRV_OK);
+    rcc_set_current(&plan);
+}
+
+static void setup(usb_dev_t *d)
+{
+    sim_reset();
+    clock_48mhz();
+    memset(&seen, 0, sizeof(seen));
+    TEST_ASSERT_EQ(usb_init(d, &test_cfg), DRV_OK);
+    TEST_ASSERT(sim_otg_connect(OTG_FS));
+    service(d);
+    TEST_ASSERT_EQ(d->state, USB_STATE_DEFAULT);
+}
+
+/*
+ * One control transfer as the host does it.  Returns the data stage
+ * length, or -1 if the device stalled.
+ */
+static int control(usb_dev_t *d, uint8_t type, uint8_t request, uint16_t value, uint16_t index,
+                   uint16_t length, void *data)
+{
+    otg_regs_t *otg = OTG_FS;
+    const uint8_t pkt[8] = { type, request, (uint8_t)value, (uint8_t)(value >> 8),
+                             (uint8_t)index, (uint8_t)(index >> 8),
+                             (uint8_t)length, (uint8_t)(length >> 8) };
+    uint8_t *buf = data;
+    uint32_t done = 0;
+    sim_otg_result_t r;
+    size_t n;
+
+    TEST_ASSERT_EQ(sim_otg_setup(otg, pkt), SIM_OTG_ACK);
+    service(d);
+    if ((type & USB_REQ_DIR_IN) != 0u && length != 0u) {
+        do {
+            r = sim_otg_in(otg, 0u, &buf[done], length - done, &n);
+            service(d);
+            if (r == SIM_OTG_STALL) {
+                return -1;
+            }
+            TEST_ASSERT_EQ(r, SIM_OTG_ACK);
+            if (r != SIM_OTG_ACK) {
+                return -2;
+            }
+            done += (uint32_t)n;
+        } while (n == USB_EP0_MPS && done < length);
+        r = sim_otg_out(otg, 0u, NULL, 0u);
+        service(d);
+        TEST_ASSERT_EQ(r, SIM_OTG_ACK);
+        return (int)done;
+    }
+    while (done < length) {
+        n = (length - done < USB_EP0_MPS) ? length - done : USB_EP0_MPS;
+        r = sim_otg_out(otg, 0u, &buf[done], n);
+        service(d);
+        if (r == SIM_OTG_STALL) {
+            return -1;
+        }
+        TEST_ASSERT_EQ(r, SIM_OTG_ACK);
+        if (r != SIM_OTG_ACK) {
+            return -2;
+        }
+        done += (uint32_t)n;
+    }
+    r = sim_otg_in(otg, 0u, NULL, 0u, &n);
+    service(d);
+    if (r == SIM_OTG_STALL) {
+        return -1;
+    }
+    TEST_ASSERT_EQ(r, SIM_OTG_ACK);
+    TEST_ASSERT_EQ(n, 0u);
+    return (int)done;
+}
+
+static void enumerate(usb_dev_t *d, uint8_t addr)
+{
+    uint8_t buf[64];
+
+    TEST_ASSERT_EQ(control(d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE << 8, 0u, 64u, buf),
+                   18);
+    TEST_ASSERT_EQ(control(d, 0x00u, USB_REQ_SET_ADDRESS, addr, 0u, 0u, NULL), 0);
+    sim_otg_address(OTG_FS, addr);
+    TEST_ASSERT_EQ(control(d, 0x00u, USB_REQ_SET_CONFIGURATION, 7u, 0u, 0u, NULL), 0);
+    TEST_ASSERT_EQ(d->state, USB_STATE_CONFIGURED);
+}
+
+static void test_init_checks(void)
+{
+    usb_dev_t d;
+    usb_config_t big = test_cfg;
+
+    sim_reset();
+    rcc_set_current(NULL);
+    TEST_ASSERT_EQ(usb_init(&d, &test_cfg), DRV_ERR_PARAM);     /* HSI: no 48 MHz. */
+    clock_48mhz();
+    big.tx_fifo_words[1] = 300u;
+    TEST_ASSERT_EQ(usb_init(&d, &big), DRV_ERR_NORES);
+    TEST_ASSERT(!sim_otg_connect(OTG_FS));                      /* Still detached. */
+
+    TEST_ASSERT_EQ(usb_init(&d, &test_cfg), DRV_OK);
+    TEST_ASSERT(REG_TEST_BITS(RCC->AHB2ENR, RCC_AHB2ENR_OTGFSEN));
+    TEST_ASSERT(REG_TEST_BITS(OTG_FS->GUSBCFG, OTG_GUSBCFG_FDMOD));
+    /* HCLK 168 MHz: minimum turnaround. */
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->GUSBCFG, OTG_GUSBCFG_TRDT), 6u);
+    /* RX, then EP0 and EP1 back to back. */
+    TEST_ASSERT_EQ(REG_READ(OTG_FS->GRXFSIZ), USB_RX_FIFO_WORDS);
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->DIEPTXF0, OTG_TXF_START), USB_RX_FIFO_WORDS);
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->DIEPTXF0, OTG_TXF_DEPTH), 16u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->DIEPTXF[0], OTG_TXF_START), USB_RX_FIFO_WORDS + 16u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->DIEPTXF[0], OTG_TXF_DEPTH), 32u);
+    TEST_ASSERT(sim_otg_connect(OTG_FS));
+
+    usb_deinit(&d);
+    TEST_ASSERT_EQ(d.state, USB_STATE_DETACHED);
+    TEST_ASSERT(!sim_otg_connect(OTG_FS));
+    rcc_set_current(NULL);
+}
+
+static void test_enumerate(void)
+{
+    usb_dev_t d;
+    uint8_t buf[128];
+
+    setup(&d);
+    TEST_ASSERT_EQ(d.resets, 1u);
+
+    /* The host learns bMaxPacketSize0 from the first 8 bytes. */
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE << 8, 0u, 8u,
+                           buf), 8);
+    TEST_ASSERT_MEM_EQ(buf, device_desc, 8u);
+
+    /* SET_ADDRESS: the status stage still goes to address 0. */
+    TEST_ASSERT_EQ(control(&d, 0x00u, USB_REQ_SET_ADDRESS, 9u, 0u, 0u, NULL), 0);
+    TEST_ASSERT_EQ(d.state, USB_STATE_ADDRESS);
+    TEST_ASSERT_EQ(sim_otg_setup(OTG_FS, buf), SIM_OTG_NORESP);
+    sim_otg_address(OTG_FS, 9u);
+
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE << 8, 0u, 18u,
+                           buf), 18);
+    TEST_ASSERT_MEM_EQ(buf, device_desc, 18u);
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_CONFIG << 8, 0u, 9u,
+                           buf), 9);
+    /* Exactly one packet, shorter than asked for: closed with a ZLP. */
+    memset(buf, 0, sizeof(buf));
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_CONFIG << 8, 0u, 255u,
+                           buf), TEST_CONFIG_LEN);
+    TEST_ASSERT_MEM_EQ(buf, config_desc, TEST_CONFIG_LEN);
+
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_STRING << 8, 0u, 255u,
+                           buf), 4);
+    TEST_ASSERT_EQ(buf[2] | (buf[3] << 8), 0x0409u);
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, (USB_DESC_STRING << 8) | 2u,
+                           0x0409u, 255u, buf), 14);
+    TEST_ASSERT_MEM_EQ(buf, "\x0E\x03W\0i\0d\0g\0e\0t\0", 14u);
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, (USB_DESC_STRING << 8) | 3u,
+                           0x0409u, 255u, buf), -1);
+    /* Full speed only. */
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE_QUALIFIER << 8,
+                           0u, 10u, buf), -1);
+
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_STATUS, 0u, 0u, 2u, buf), 2);
+    TEST_ASSERT_EQ(buf[0], 1u);                                 /* Self-powered. */
+    TEST_ASSERT_EQ(control(&d, 0x00u, USB_REQ_SET_CONFIGURATION, 2u, 0u, 0u, NULL), -1);
+    TEST_ASSERT_EQ(control(&d, 0x00u, USB_REQ_SET_CONFIGURATION, 7u, 0u, 0u, NULL), 0);
+    TEST_ASSERT_EQ(d.state, USB_STATE_CONFIGURED);
+    TEST_ASSERT_EQ(seen.config, 7u);
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_CONFIGURATION, 0u, 0u, 1u, buf), 1);
+    TEST_ASSERT_EQ(buf[0], 7u);
+    TEST_ASSERT(REG_TEST_BITS(OTG_FS->IEP[1].CTL, OTG_EPCTL_USBAEP));
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->IEP[1].CTL, OTG_EPCTL_TXFNUM), 1u);
+
+    /* Deconfigure. */
+    TEST_ASSERT_EQ(control(&d, 0x00u, USB_REQ_SET_CONFIGURATION, 0u, 0u, 0u, NULL), 0);
+    TEST_ASSERT_EQ(d.state, USB_STATE_ADDRESS);
+    TEST_ASSERT_EQ(seen.config, 0u);
+    TEST_ASSERT(!REG_TEST_BITS(OTG_FS->IEP[1].CTL, OTG_EPCTL_USBAEP));
+    TEST_ASSERT_EQ(sim_otg_fifo_errors(OTG_FS), 0u);
+}
+
+static void test_vendor_requests(void)
+{
+    usb_dev_t d;
+    uint8_t buf[128];
+    uint32_t i;
+
+    setup(&d);
+    enumerate(&d, 3u);
+    for (i = 0; i < sizeof(vendor_reply); i++) {
+        vendor_reply[i] = (uint8_t)(i * 7u);
+    }
+
+    /* Two packets, the second short. */
+    TEST_ASSERT_EQ(control(&d, 0xC0u, 1u, 100u, 0u, 100u, buf), 100);
+    TEST_ASSERT_MEM_EQ(buf, vendor_reply, 100u);
+    /* Device has less than asked for, on a packet boundary: ZLP. */
+    TEST_ASSERT_EQ(control(&d, 0xC0u, 1u, 64u, 0u, 100u, buf), 64);
+    /* Host asks for less than the device has. */
+    TEST_ASSERT_EQ(control(&d, 0xC0u, 1u, 100u, 0u, 70u, buf), 70);
+
+    /* Data stage OUT, two packets. */
+    for (i = 0; i < 100u; i++) {
+        buf[i] = (uint8_t)(0xFFu - i);
+    }
+    TEST_ASSERT_EQ(control(&d, 0x40u, 2u, 0u, 0u, 100u, buf), 100);
+    TEST_ASSERT_EQ(seen.out_len, 100u);
+    TEST_ASSERT_MEM_EQ(seen.out, buf, 100u);
+    /* Longer than the EP0 buffer: stalled. */
+    TEST_ASSERT_EQ(control(&d, 0x40u, 2u, 0u, 0u, USB_EP0_BUF + 1u, buf), -1);
+
+    /* Unknown requests stall; the next SETUP clears it. */
+    TEST_ASSERT_EQ(control(&d, 0xC0u, 9u, 0u, 0u, 4u, buf), -1);
+    TEST_ASSERT_EQ(control(&d, 0x00u, 0x55u, 0u, 0u, 0u, NULL), -1);
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_CONFIGURATION, 0u, 0u, 1u, buf), 1);
+    TEST_ASSERT_EQ(buf[0], 7u);
+    TEST_ASSERT_EQ(sim_otg_fifo_errors(OTG_FS), 0u);
+}
+
+static void test_bulk_and_halt(void)
+{
+    otg_regs_t *otg = OTG_FS;
+    usb_dev_t d;
+    uint8_t data[100];
+    uint8_t buf[64];
+    size_t n;
+    uint32_t i;
+
+    setup(&d);
+    enumerate(&d, 5u);
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i + 1u);
+    }
+
+    /* OUT: NAK until armed, then two packets complete the transfer. */
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, data, 64u), SIM_OTG_NAK);
+    usb_ep_out_arm(&d, 1u, 4u);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, data, 64u), SIM_OTG_ACK);
+    service(&d);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, &data[64], 36u), SIM_OTG_ACK);
+    service(&d);
+    TEST_ASSERT_EQ(seen.rx_len, 100u);
+    TEST_ASSERT_MEM_EQ(seen.rx, data, 100u);
+    TEST_ASSERT_EQ(seen.rx_done, 1u);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, data, 1u), SIM_OTG_NAK);
+
+    /* IN: one short packet. */
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_NAK);
+    usb_ep_in_start(&d, 1u, 10u);
+    TEST_ASSERT(usb_ep_write(&d, 1u, data, 10u));
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    service(&d);
+    TEST_ASSERT_EQ(n, 10u);
+    TEST_ASSERT_MEM_EQ(buf, data, 10u);
+    TEST_ASSERT_EQ(seen.tx_done, 1u);
+    TEST_ASSERT_EQ(REG_READ(otg->DIEPEMPMSK), 0u);
+
+    /* SET_FEATURE(ENDPOINT_HALT), GET_STATUS, CLEAR_FEATURE. */
+    TEST_ASSERT_EQ(control(&d, 0x02u, USB_REQ_SET_FEATURE, USB_FEATURE_ENDPOINT_HALT, 0x81u, 0u,
+                           NULL), 0);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_STALL);
+    TEST_ASSERT_EQ(control(&d, 0x82u, USB_REQ_GET_STATUS, 0u, 0x81u, 2u, buf), 2);
+    TEST_ASSERT_EQ(buf[0], 1u);
+    TEST_ASSERT_EQ(control(&d, 0x02u, USB_REQ_CLEAR_FEATURE, USB_FEATURE_ENDPOINT_HALT, 0x81u,
+                           0u, NULL), 0);
+    TEST_ASSERT(!usb_ep_stalled(&d, 0x81u));
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_NAK);
+    /* Endpoints not in the configuration. */
+    TEST_ASSERT_EQ(control(&d, 0x82u, USB_REQ_GET_STATUS, 0u, 0x83u, 2u, buf), -1);
+    TEST_ASSERT_EQ(sim_otg_fifo_errors(otg), 0u);
+}
+
+static void test_bus_reset(void)
+{
+    usb_dev_t d;
+    uint8_t buf[18];
+
+    setup(&d);
+    enumerate(&d, 4u);
+    TEST_ASSERT_EQ(seen.configures, 1u);
+
+    sim_otg_bus_reset(OTG_FS);
+    service(&d);
+    TEST_ASSERT_EQ(d.resets, 2u);
+    TEST_ASSERT_EQ(d.state, USB_STATE_DEFAULT);
+    TEST_ASSERT_EQ(seen.configures, 2u);
+    TEST_ASSERT_EQ(seen.config, 0u);
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->DCFG, OTG_DCFG_DAD), 0u);
+    TEST_ASSERT(!REG_TEST_BITS(OTG_FS->OEP[1].CTL, OTG_EPCTL_USBAEP));
+    /* Enumerates again from address 0. */
+    TEST_ASSERT_EQ(control(&d, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE << 8, 0u, 18u,
+                           buf), 18);
+    enumerate(&d, 6u);
+    TEST_ASSERT_EQ(seen.config, 7u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_init_checks);
+    TEST_RUN(test_enumerate);
+    TEST_RUN(test_vendor_requests);
+    TEST_RUN(test_bulk_and_halt);
+    TEST_RUN(test_bus_reset);
+    return TEST_RESULT();
+}
@@ -0,0 +1,279 @@
+/**
+ * @file    test_usb_cdc.c
+ * @brief   CDC-ACM tests: enumeration, line coding and control lines,
+ *          OUT packets landing in the receive ring across the wrap with
+ *          NAK back-pressure, and IN transfers from the transmit ring with
+ *          two-packet prefill and zero-length termination.
+ */
+#include <string.h>
+
+#include "rcc.h"
+#include "sim.h"
+#include "test.h"
+#include "usb_cdc.h"
+
+RINGBUF_DEFINE(rx_ring, 256);
+RINGBUF_DEFINE(tx_ring, 512);
+
+static const usb_cdc_config_t cdc_cfg = {
+    .vid = 0x0483u,
+    .pid = 0x5740u,
+    .bcd_device = 0x0100u,
+    .manufacturer = "Acme",
+    .product = "Serial",
+    .rx = &rx_ring,
+    .tx = &tx_ring,
+};
+
+static void service(usb_cdc_t *c)
+{
+    while (sim_irq_take(OTG_FS_IRQn)) {
+        usb_irq(&c->usb);
+    }
+}
+
+/* Control transfer with a data stage of at most one packet. */
+static int control(usb_cdc_t *c, uint8_t type, uint8_t request, uint16_t value,
+                   uint16_t length, void *data)
+{
+    otg_regs_t *otg = OTG_FS;
+    const uint8_t pkt[8] = { type, request, (uint8_t)value, (uint8_t)(value >> 8), 0u, 0u,
+                             (uint8_t)length, (uint8_t)(length >> 8) };
+    size_t n = 0;
+    size_t zlp;
+    sim_otg_result_t r;
+
+    TEST_ASSERT_EQ(sim_otg_setup(otg, pkt), SIM_OTG_ACK);
+    service(c);
+    if ((type & USB_REQ_DIR_IN) != 0u) {
+        r = sim_otg_in(otg, 0u, data, length, &n);
+        service(c);
+        if (r != SIM_OTG_ACK) {
+            return -1;
+        }
+        TEST_ASSERT_EQ(sim_otg_out(otg, 0u, NULL, 0u), SIM_OTG_ACK);
+    } else {
+        if (length != 0u) {
+            r = sim_otg_out(otg, 0u, data, length);
+            service(c);
+            if (r != SIM_OTG_ACK) {
+                return -1;
+            }
+            n = length;
+        }
+        r = sim_otg_in(otg, 0u, NULL, 0u, &zlp);
+        if (r != SIM_OTG_ACK) {
+            return -1;
+        }
+    }
+    service(c);
+    return (int)n;
+}
+
+static void setup(usb_cdc_t *c)
+{
+    const rcc_request_t req = { .hse_hz = 8000000u, .need_48mhz = true };
+    rcc_plan_t plan;
+    uint8_t buf[18];
+
+    sim_reset();
+    TEST_ASSERT_EQ(rcc_solve(&req, &plan), DRV_OK);
+    rcc_set_current(&plan);
+    rx_ring.head = rx_ring.tail = 0;
+    tx_ring.head = tx_ring.tail = 0;
+    TEST_ASSERT_EQ(usb_cdc_init(c, &cdc_cfg), DRV_OK);
+    TEST_ASSERT(sim_otg_connect(OTG_FS));
+    service(c);
+    TEST_ASSERT_EQ(control(c, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE << 8, 18u, buf),
+                   18);
+    TEST_ASSERT_EQ(control(c, 0x00u, USB_REQ_SET_ADDRESS, 2u, 0u, NULL), 0);
+    sim_otg_address(OTG_FS, 2u);
+    TEST_ASSERT(!usb_cdc_configured(c));
+    TEST_ASSERT_EQ(control(c, 0x00u, USB_REQ_SET_CONFIGURATION, 1u, 0u, NULL), 0);
+    TEST_ASSERT(usb_cdc_configured(c));
+}
+
+static void test_descriptors(void)
+{
+    usb_cdc_t c;
+    uint8_t buf[64];
+
+    setup(&c);
+    TEST_ASSERT_EQ(control(&c, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_DEVICE << 8, 18u, buf),
+                   18);
+    TEST_ASSERT_EQ(buf[4], 0x02u);
+    TEST_ASSERT_EQ(buf[8] | (buf[9] << 8), 0x0483u);
+    TEST_ASSERT_EQ(buf[10] | (buf[11] << 8), 0x5740u);
+    TEST_ASSERT_EQ(buf[16], 0u);                                /* No serial string. */
+    TEST_ASSERT_EQ(control(&c, 0x80u, USB_REQ_GET_DESCRIPTOR, USB_DESC_CONFIG << 8, 9u, buf),
+                   9);
+    TEST_ASSERT_EQ(buf[2] | (buf[3] << 8), 67u);
+    TEST_ASSERT_EQ(buf[4], 2u);
+    TEST_ASSERT_EQ(control(&c, 0x80u, USB_REQ_GET_DESCRIPTOR, (USB_DESC_STRING << 8) | 2u, 64u,
+                           buf), 14);
+    TEST_ASSERT_MEM_EQ(buf, "\x0E\x03S\0e\0r\0i\0a\0l\0", 14u);
+    /* Bulk IN has a two-packet FIFO. */
+    TEST_ASSERT_EQ(REG_FIELD_READ(OTG_FS->DIEPTXF[0], OTG_TXF_DEPTH), USB_CDC_TX_FIFO_WORDS);
+}
+
+static void test_line_coding(void)
+{
+    static const uint8_t coding[7] = { 0x80u, 0x25u, 0x00u, 0x00u, 2u, 2u, 7u };
+    usb_cdc_t c;
+    uint8_t buf[7];
+
+    setup(&c);
+    TEST_ASSERT_EQ(control(&c, 0xA1u, USB_CDC_GET_LINE_CODING, 0u, 7u, buf), 7);
+    TEST_ASSERT_EQ(buf[0] | (buf[1] << 8) | (buf[2] << 16), 115200u);
+    TEST_ASSERT_EQ(buf[6], 8u);
+
+    TEST_ASSERT_EQ(control(&c, 0x21u, USB_CDC_SET_LINE_CODING, 0u, 7u, (void *)coding), 7);
+    TEST_ASSERT_EQ(usb_cdc_line_coding(&c)->baud, 9600u);
+    TEST_ASSERT_EQ(usb_cdc_line_coding(&c)->stop_bits, 2u);
+    TEST_ASSERT_EQ(usb_cdc_line_coding(&c)->parity, 2u);
+    TEST_ASSERT_EQ(usb_cdc_line_coding(&c)->data_bits, 7u);
+    TEST_ASSERT_EQ(control(&c, 0xA1u, USB_CDC_GET_LINE_CODING, 0u, 7u, buf), 7);
+    TEST_ASSERT_MEM_EQ(buf, coding, 7u);
+
+    TEST_ASSERT_EQ(control(&c, 0x21u, USB_CDC_SET_CONTROL_LINE_STATE,
+                           USB_CDC_LINE_DTR | USB_CDC_LINE_RTS, 0u, NULL), 0);
+    TEST_ASSERT_EQ(usb_cdc_lines(&c), USB_CDC_LINE_DTR | USB_CDC_LINE_RTS);
+    TEST_ASSERT_EQ(control(&c, 0x21u, 0x7Fu, 0u, 0u, NULL), -1);
+    TEST_ASSERT_EQ(sim_otg_fifo_errors(OTG_FS), 0u);
+}
+
+static void test_rx_ring(void)
+{
+    otg_regs_t *otg = OTG_FS;
+    usb_cdc_t c;
+    uint8_t pkt[64];
+    uint8_t got[256];
+    uint32_t reads;
+    uint32_t i;
+    uint32_t k;
+
+    setup(&c);
+    for (i = 0; i < sizeof(pkt); i++) {
+        pkt[i] = (uint8_t)(i ^ 0x5Au);
+    }
+
+    /* A short packet ends the transfer; the OUT endpoint is re-armed for the rest. */
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 13u), SIM_OTG_ACK);
+    service(&c);
+    sim_stats.reads = 0;
+    for (k = 0; k < 3u; k++) {
+        TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 64u), SIM_OTG_ACK);
+        service(&c);
+    }
+    /* Straight from the FIFO: 16 data words per packet plus status and interrupt. */
+    reads = sim_stats.reads;
+    TEST_ASSERT(reads < 3u * (16u + 12u));
+    /* 51 bytes free: less than a packet, so the host is NAKed. */
+    TEST_ASSERT_EQ(ringbuf_count(&rx_ring), 13u + 3u * 64u);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 64u), SIM_OTG_NAK);
+
+    /* Reading makes room for two more, written across the wrap at offset 205. */
+    TEST_ASSERT_EQ(usb_cdc_read(&c, got, 100u), 100u);
+    TEST_ASSERT_MEM_EQ(got, pkt, 13u);
+    TEST_ASSERT_MEM_EQ(&got[13], pkt, 64u);
+    TEST_ASSERT_MEM_EQ(&got[77], pkt, 23u);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 64u), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 64u), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 64u), SIM_OTG_NAK);
+    TEST_ASSERT_EQ(usb_cdc_read(&c, got, sizeof(got)), 233u);
+    TEST_ASSERT_MEM_EQ(&got[105], pkt, 64u);
+    TEST_ASSERT_MEM_EQ(&got[169], pkt, 64u);
+    TEST_ASSERT_EQ(sim_otg_out(otg, 1u, pkt, 64u), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(c.rx_bytes, 13u + 6u * 64u);
+    TEST_ASSERT_EQ(c.usb.rx_dropped, 0u);
+    TEST_ASSERT_EQ(sim_otg_fifo_errors(otg), 0u);
+}
+
+static void test_tx_ring(void)
+{
+    otg_regs_t *otg = OTG_FS;
+    usb_cdc_t c;
+    uint8_t data[200];
+    uint8_t got[200];
+    uint8_t buf[64];
+    size_t n;
+    uint32_t len = 0;
+    uint32_t i;
+
+    setup(&c);
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 3u);
+    }
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_NAK);
+
+    /* 200 bytes: 64/64/64/8, the first two in the FIFO at once. */
+    TEST_ASSERT_EQ(usb_cdc_write(&c, data, sizeof(data)), 200u);
+    TEST_ASSERT_EQ(sim_otg_tx_words(otg, 1u), 32u);
+    do {
+        TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+        service(&c);
+        memcpy(&got[len], buf, n);
+        len += (uint32_t)n;
+    } while (n == 64u);
+    TEST_ASSERT_EQ(len, 200u);
+    TEST_ASSERT_MEM_EQ(got, data, 200u);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_NAK);
+    TEST_ASSERT_EQ(c.tx_bytes, 200u);
+
+    /* 128 bytes end on a packet boundary: a zero-length packet follows. */
+    TEST_ASSERT_EQ(usb_cdc_write(&c, data, 128u), 128u);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(n, 64u);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(n, 0u);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_NAK);
+
+    /* Data queued while a transfer runs goes in the next one: no ZLP. */
+    TEST_ASSERT_EQ(usb_cdc_write(&c, data, 64u), 64u);
+    TEST_ASSERT_EQ(usb_cdc_write(&c, &data[64], 10u), 10u);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    service(&c);
+    TEST_ASSERT_EQ(n, 10u);
+    TEST_ASSERT_MEM_EQ(buf, &data[64], 10u);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_NAK);
+    TEST_ASSERT_EQ(ringbuf_count(&tx_ring), 0u);
+    TEST_ASSERT_EQ(sim_otg_fifo_errors(otg), 0u);
+}
+
+static void test_write_before_configured(void)
+{
+    otg_regs_t *otg = OTG_FS;
+    usb_cdc_t c;
+    uint8_t buf[64];
+    size_t n;
+
+    setup(&c);
+    TEST_ASSERT_EQ(control(&c, 0x00u, USB_REQ_SET_CONFIGURATION, 0u, 0u, NULL), 0);
+    TEST_ASSERT(!usb_cdc_configured(&c));
+    /* Queued only; sent once the host configures the device. */
+    TEST_ASSERT_EQ(usb_cdc_write(&c, "hello", 5u), 5u);
+    TEST_ASSERT_EQ(sim_otg_tx_words(otg, 1u), 0u);
+    TEST_ASSERT_EQ(control(&c, 0x00u, USB_REQ_SET_CONFIGURATION, 1u, 0u, NULL), 0);
+    TEST_ASSERT_EQ(sim_otg_in(otg, 1u, buf, sizeof(buf), &n), SIM_OTG_ACK);
+    TEST_ASSERT_EQ(n, 5u);
+    TEST_ASSERT_MEM_EQ(buf, "hello", 5u);
+}
+
+int main(void)
+{
+    TEST_RUN(test_descriptors);
+    TEST_RUN(test_line_coding);
+    TEST_RUN(test_rx_ring);
+    TEST_RUN(test_tx_ring);
+    TEST_RUN(test_write_before_configured);
+    return TEST_RESULT();
+}
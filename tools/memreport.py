@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""Memory placement report for a linked firmware image.
+
+    memreport.py [--ld SCRIPT] [--top N] FIRMWARE.elf
+
+Prints the fill of every region in the linker script's MEMORY block, the
+output sections placed in each (run address, size, and flash load address
+of initialised RAM sections), and the symbols that landed in the
+fast-memory sections (.ram_vectors, .ramfunc, .fastdata, .fastbss),
+largest first.  Reads the ELF directly; no binutils needed.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+FAST_SECTIONS = (".ram_vectors", ".ramfunc", ".fastdata", ".fastbss")
+
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+PT_LOAD = 1
+STT_OBJECT = 1
+STT_FUNC = 2
+
+
+class Region:
+    def __init__(self, name, origin, length):
+        self.name = name
+        self.origin = origin
+        self.length = length
+        self.used = 0
+
+    def contains(self, addr):
+        return self.origin <= addr < self.origin + self.length
+
+
+class Section:
+    def __init__(self, name, kind, flags, addr, size):
+        self.name = name
+        self.kind = kind
+        self.flags = flags
+        self.addr = addr
+        self.size = size
+        self.load = addr
+
+
+class Symbol:
+    def __init__(self, name, value, size, kind, shndx):
+        self.name = name
+        self.value = value
+        self.size = size
+        self.kind = kind
+        self.shndx = shndx
+
+
+def ld_number(expr):
+    """Value of a linker script constant expression such as `16K - 64`."""
+    expr = re.sub(r"\b(\w+?)([KM])\b",
+                  lambda m: "(%s*%d)" % (m.group(1), 1024 if m.group(2) == "K" else 1 << 20),
+                  expr.strip())
+    if not re.match(r"^[0-9a-fA-FxX+\-*/() ]+$", expr):
+        raise SystemExit("unsupported MEMORY expression: %s" % expr)
+    return int(eval(expr.replace("/", "//")))
+
+
+def parse_memory(path):
+    """Regions of the MEMORY block of linker script @path, in order."""
+    with open(path) as f:
+        text = re.sub(r"/\*.*?\*/", "", f.read(), flags=re.S)
+    block = re.search(r"MEMORY\s*\{(.*?)\}", text, re.S)
+    if block is None:
+        raise SystemExit("%s: no MEMORY block" % path)
+    regions = []
+    pattern = r"(\w+)\s*(?:\([^)]*\))?\s*:\s*ORIGIN\s*=\s*([^,]+),\s*LENGTH\s*=\s*(.+)$"
+    for line in block.group(1).splitlines():
+        m = re.match(pattern, line.strip())
+        if m:
+            regions.append(Region(m.group(1), ld_number(m.group(2)), ld_number(m.group(3))))
+    return regions
+
+
+def read_elf(path):
+    """Allocated sections (with load addresses) and sized symbols."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"\x7fELF":
+        raise SystemExit("%s: not an ELF file" % path)
+    wide = data[4] == 2
+    end = "<" if data[5] == 1 else ">"
+
+    if wide:
+        hdr = struct.unpack_from(end + "HHIQQQIHHHHHH", data, 16)
+        shdr_fmt, phdr_fmt, sym_fmt = "IIQQQQIIQQ", "IIQQQQQQ", "IBBHQQ"
+    else:
+        hdr = struct.unpack_from(end + "HHIIIIIHHHHHH", data, 16)
+        shdr_fmt, phdr_fmt, sym_fmt = "IIIIIIIIII", "IIIIIIII", "IIIBBH"
+    phoff, shoff = hdr[4], hdr[5]
+    phentsize, phnum, shentsize, shnum, shstrndx = hdr[8:13]
+
+    raw = [struct.unpack_from(end + shdr_fmt, data, shoff + i * shentsize)
+           for i in range(shnum)]
+    strtab_off = raw[shstrndx][4]
+
+    def name_at(base, off):
+        stop = data.index(b"\0", base + off)
+        return data[base + off:stop].decode()
+
+    sections = []
+    for sh in raw:
+        sections.append(Section(name_at(strtab_off, sh[0]), sh[1], sh[2], sh[3], sh[5]))
+
+    segments = []
+    for i in range(phnum):
+        ph = struct.unpack_from(end + phdr_fmt, data, phoff + i * phentsize)
+        if wide:
+            p_type, _, _, vaddr, paddr, _, memsz, _ = ph
+        else:
+            p_type, _, vaddr, paddr, _, memsz, _, _ = ph
+        if p_type == PT_LOAD:
+            segments.append((vaddr, paddr, memsz))
+    for s in sections:
+        for vaddr, paddr, memsz in segments:
+            if vaddr <= s.addr < vaddr + memsz:
+                s.load = paddr + (s.addr - vaddr)
+                break
+
+    symbols = []
+    for sh in raw:
+        if sh[1] != SHT_SYMTAB:
+            continue
+        str_off = raw[sh[6]][4]
+        for off in range(sh[4], sh[4] + sh[5], sh[9]):
+            e = struct.unpack_from(end + sym_fmt, data, off)
+            if wide:
+                name, info, _, shndx, value, size = e
+            else:
+                name, value, size, info, _, shndx = e
+            kind = info & 0xF
+            if size > 0 and kind in (STT_OBJECT, STT_FUNC) and 0 < shndx < len(sections):
+                symbols.append(Symbol(name_at(str_off, name), value, size, kind, shndx))
+    return sections, symbols
+
+
+def region_of(regions, addr):
+    for r in regions:
+        if r.contains(addr):
+            return r
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("elf")
+    ap.add_argument("--ld", help="linker script with the MEMORY block")
+    ap.add_argument("--top", type=int, default=20,
+                    help="fast-memory symbols to list per section (default 20)")
+    args = ap.parse_args()
+
+    regions = parse_memory(args.ld) if args.ld else []
+    sections, symbols = read_elf(args.elf)
+    alloc = [s for s in sections if s.flags & SHF_ALLOC and s.size > 0]
+
+    for s in alloc:
+        run = region_of(regions, s.addr)
+        if run is not None:
+            run.used += s.size
+        load = region_of(regions, s.load)
+        if s.kind != SHT_NOBITS and s.load != s.addr and load is not None:
+            load.used += s.size
+
+    if regions:
+        print("%-8s %10s %10s %10s %10s %6s" % ("region", "origin", "length", "used", "free", "use%"))
+        for r in regions:
+            print("%-8s 0x%08x %10d %10d %10d %5.1f%%" % (
+                r.name, r.origin, r.length, r.used, r.length - r.used,
+                100.0 * r.used / r.length))
+        print()
+
+    print("%-16s %-8s %10s %10s  %s" % ("section", "region", "address", "size", "load"))
+    for s in sorted(alloc, key=lambda s: s.addr):
+        run = region_of(regions, s.addr)
+        load = ""
+        if s.kind != SHT_NOBITS and s.load != s.addr:
+            where = region_of(regions, s.load)
+            load = "%s 0x%08x" % (where.name if where else "-", s.load)
+        print("%-16s %-8s 0x%08x %10d  %s" % (
+            s.name, run.name if run else "-", s.addr, s.size, load))
+
+    index = {i: s for i, s in enumerate(sections)}
+    for name in FAST_SECTIONS:
+        placed = [y for y in symbols if index[y.shndx].name == name]
+        if not placed:
+            continue
+        placed.sort(key=lambda y: y.size, reverse=True)
+        print()
+        print("%s: %d symbols, %d bytes" % (name, len(placed), sum(y.size for y in placed)))
+        for y in placed[:args.top]:
+            print("  0x%08x %8d  %-4s %s" % (
+                y.value, y.size, "func" if y.kind == STT_FUNC else "data", y.name))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())